@@ -69,7 +69,7 @@ void BiomeManager::initTexturesAndModels(const std::string& base_dir_path, OpenG
 
 		PhysicsShape physics_shape;
 		BatchedMeshRef batched_mesh;
-		Reference<OpenGLMeshRenderData> gl_meshdata = ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(model_URL, resource_manager,
+		Reference<OpenGLMeshRenderData> gl_meshdata = ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(model_URL, resource_manager, /*processed_mesh_cache=*/NULL,
 			opengl_engine.vert_buf_allocator.ptr(), /*skip opengl calls=*/false, /*build_dynamic_physics_ob=*/false, physics_shape, batched_mesh);
 
 		elm_tree_physics_shape = physics_shape;
@@ -14,6 +14,7 @@ Copyright Glare Technologies Limited 2022 -
 #include <graphics/BatchedMesh.h>
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
+#include "../shared/TransformBatch.h"
 #include "../shared/Parcel.h"
 #include <networking/Networking.h>
 #include <vec3.h>
@@ -257,28 +258,8 @@ void ClientThread::doRun()
 						const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
 						const uint32 anim_state_and_input_bitflags = msg_buffer.readUInt32();
 
-						// Look up existing avatar in world state
-						{
-							Lock lock(world_state->mutex);
-							auto res = world_state->avatars.find(avatar_uid);
-							if(res != world_state->avatars.end())
-							{
-								Avatar* avatar = res->second.getPointer();
-								avatar->pos = pos;
-								avatar->rotation = rotation;
-								avatar->anim_state = anim_state_and_input_bitflags & 0xFF;
-								avatar->last_physics_input_bitflags = anim_state_and_input_bitflags >> 16;
-								avatar->transform_dirty = true;
-
-								//conPrint("updated avatar transform");
-
-								avatar->pos_snapshots      [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = pos;
-								avatar->rotation_snapshots [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = rotation;
-								avatar->snapshot_times     [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = Clock::getTimeSinceInit();
-								//avatar->last_snapshot_time = Clock::getCurTimeRealSec();
-								avatar->next_snapshot_i++;
-							}
-						}
+						Lock lock(world_state->mutex);
+						world_state->applyAvatarTransformUpdate(avatar_uid, pos, rotation, anim_state_and_input_bitflags, TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_ANIM_STATE);
 						break;
 					}
 				case Protocol::AvatarFullUpdate:
@@ -472,54 +453,8 @@ void ClientThread::doRun()
 
 						// conPrint("ClientThread: received ObjectTransformUpdate, transform_update_avatar_uid: " + toString(transform_update_avatar_uid));
 
-						if(transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard ObjectTransformUpdate messages we sent. 
-						{
-							// Look up existing object in world state
-							Lock lock(world_state->mutex);
-							auto res = world_state->objects.find(object_uid);
-							if(res != world_state->objects.end())
-							{
-								
-								WorldObject* ob = res.getValue().ptr();
-#if GUI_CLIENT
-								if(!ob->is_selected) // Don't update the selected object - we will consider the local client control authoritative while the object is selected.
-#endif
-								{
-									//conPrint("ObjectTransformUpdate: setting ob pos to " + pos.toString());
-#if GUI_CLIENT
-									//ob->last_pos = ob->pos;
-#endif
-									ob->pos = pos;
-									ob->axis = axis;
-									ob->angle = angle;
-									ob->scale = scale;
-
-									// If we had physics snapshots, reset snapshots.
-									if(ob->snapshots_are_physics_snapshots)
-									{
-										// conPrint("Resetting snapshots.");
-										ob->next_insertable_snapshot_i = 0;
-										ob->next_snapshot_i = 0;
-									}
-									ob->snapshots_are_physics_snapshots = false;
-
-									
-									ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = 
-										WorldObject::Snapshot({pos.toVec4fPoint(), Quatf::fromAxisAndAngle(normalise(axis), angle), /*linear vel=*/Vec4f(0.f), /*angular_vel=*/Vec4f(0.f), /*client time=*/0.0, /*local time=*/Clock::getTimeSinceInit()});
-
-									ob->next_snapshot_i++;
-
-									ob->from_remote_transform_dirty = true;
-									world_state->dirty_from_remote_objects.insert(ob);
-
-									//conPrint("updated object transform");
-								}
-							}
-						}
-						else
-						{
-							// conPrint("\tDiscarding ObjectTransformUpdate message, as we sent it.");
-						}
+						Lock lock(world_state->mutex);
+						world_state->applyObjectTransformUpdate(client_avatar_uid, object_uid, pos, axis, angle, scale, transform_update_avatar_uid, TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_SCALE);
 						break;
 					}
 					case Protocol::SummonObject:
@@ -575,57 +510,18 @@ void ClientThread::doRun()
 						//conPrint("ClientThread: received ObjectPhysicsTransformUpdate, transform_update_avatar_uid: " + toString(transform_update_avatar_uid));
 						//conPrint("transform_client_time: " + toString(transform_client_time) + ", cur global time: " + toString(world_state->getCurrentGlobalTime()));
 
-						if(transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard ObjectPhysicsTransformUpdate messages we sent.
-						{
-							// Look up existing object in world state
-							Lock lock(world_state->mutex);
-							auto res = world_state->objects.find(object_uid);
-							if(res != world_state->objects.end())
-							{
-								WorldObject* ob = res.getValue().ptr();
-
-								if(ob->physics_owner_id == transform_update_avatar_uid) // Only process messages that are from the physics owner of this object, discard others.
-								{
-									// If we had non-physics snapshots, reset snapshots.
-									if(!ob->snapshots_are_physics_snapshots)
-									{
-										// conPrint("Resetting snapshots.");
-										ob->next_insertable_snapshot_i = 0;
-										ob->next_snapshot_i = 0;
-									}
-									ob->snapshots_are_physics_snapshots = true;
-
-									const double local_time = Clock::getTimeSinceInit();
-
-									ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = WorldObject::Snapshot({pos.toVec4fPoint(), rot, linear_vel, angular_vel, transform_client_time, local_time});
-
-									ob->next_snapshot_i++;
-
-									// conPrint("ClientThread: Added snapshot " + toString(ob->next_snapshot_i));
-
-									//NEW: Compute transmission_time_offset: An estimate of local_clock_time - sending_clock_time.
-									// TODO: Handle a different client taking over sending messages.
-									/*if(ob->transmission_time_offset == std::numeric_limits<double>::infinity())
-									{
-										ob->transmission_time_offset = Clock::getTimeSinceInit() - last_transform_client_time;
-
-										conPrint("Storing new ob->transmission_time_offset: " + doubleToString(ob->transmission_time_offset));
-									}*/
-
-									ob->from_remote_physics_transform_dirty = true;
-									world_state->dirty_from_remote_objects.insert(ob);
-								}
-								else
-								{
-									// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as not from physics owner of object.");
-								}
-							}
-						}
-						else
-						{
-							// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as we sent it.");
-						}
+						Lock lock(world_state->mutex);
+						world_state->applyObjectPhysicsTransformUpdate(client_avatar_uid, object_uid, pos, rot, linear_vel, angular_vel, transform_update_avatar_uid, transform_client_time);
+						break;
+					}
+				case Protocol::TransformUpdateBatch:
+					{
+						// Sent instead of AvatarTransformUpdate, ObjectTransformUpdate and ObjectPhysicsTransformUpdate messages by servers with protocol version >= 40.
+						TransformBatch::readBatchMessage(msg_buffer, temp_transform_updates);
 
+						Lock lock(world_state->mutex);
+						for(size_t i=0; i<temp_transform_updates.size(); ++i)
+							world_state->applyTransformUpdate(client_avatar_uid, temp_transform_updates[i]);
 						break;
 					}
 				case Protocol::ObjectFullUpdate:
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "../shared/WorldSettings.h"
+#include "../shared/TransformBatch.h"
 #include "WorldState.h"
 #include <MessageableThread.h>
 #include <Platform.h>
@@ -269,6 +270,7 @@ private:
 	js::Vector<uint8, 16> data_to_send						GUARDED_BY(data_to_send_mutex);
 
 	BufferInStream msg_buffer;
+	std::vector<TransformUpdate> temp_transform_updates;
 
 	Reference<glare::PoolAllocator> world_ob_pool_allocator;
 
@@ -276,6 +276,25 @@ void ClientUDPHandlerThread::doRun()
 							}
 						}
 					}
+					else if(type == TransformUDPChannel::UDP_PACKET_TYPE) // If packet contains transform updates:
+					{
+						try
+						{
+							if(transform_datagram_receiver.processDatagram(packet_buf.data(), packet_len, transform_updates)) // Returns false if datagram is out of order.
+							{
+								Lock lock(world_state->mutex);
+
+								// The server doesn't send our own physics object updates by UDP, so there is no need to pass the client avatar UID.
+								for(size_t i=0; i<transform_updates.size(); ++i)
+									world_state->applyTransformUpdate(UID::invalidUID(), transform_updates[i]);
+							}
+							world_state->num_transform_datagrams_received++;
+						}
+						catch(glare::Exception& e)
+						{
+							conPrint("ClientUDPHandlerThread: invalid transform datagram: " + e.what());
+						}
+					}
 				}
 			}
 		}
@@ -17,6 +17,7 @@ Copyright Glare Technologies Limited 2023 -
 #include <BufferInStream.h>
 #include <string>
 #include "../audio/AudioEngine.h"
+#include "../shared/TransformUDPChannel.h"
 class WorldState;
 
 
@@ -41,4 +42,7 @@ public:
 
 	WorldState* world_state;
 	glare::AudioEngine* audio_engine;
+
+	TransformDatagramReceiver transform_datagram_receiver;
+	std::vector<TransformUpdate> transform_updates;
 };
@@ -9,6 +9,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "LoadTextureTask.h"
 #include "ThreadMessages.h"
 #include "ModelLoading.h"
+#include "ProcessedMeshCache.h"
 #include "../shared/ResourceManager.h"
 #include <indigo/TextureServer.h>
 #include <opengl/OpenGLEngine.h>
@@ -81,7 +82,7 @@ void LoadModelTask::run(size_t thread_index)
 			// We want to load and build the mesh at lod_model_url.
 			// conPrint("LoadModelTask: loading mesh with URL '" + lod_model_url + "'.");
 			BatchedMeshRef batched_mesh;
-			gl_meshdata = ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(lod_model_url, *this->resource_manager,
+			gl_meshdata = ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(lod_model_url, *this->resource_manager, this->processed_mesh_cache.ptr(),
 				/*vert_buf_allocator=*/NULL, 
 				true, // skip_opengl_calls - we need to do these on the main thread.
 				build_dynamic_physics_ob,
@@ -17,6 +17,7 @@ Copyright Glare Technologies Limited 2021 -
 class OpenGLEngine;
 class MeshManager;
 class ResourceManager;
+class ProcessedMeshCache;
 
 
 class ModelLoadedThreadMessage : public ThreadMessage
@@ -65,5 +66,6 @@ public:
 	PhysicsShape unit_cube_shape;
 	Reference<OpenGLEngine> opengl_engine;
 	Reference<ResourceManager> resource_manager;
+	Reference<ProcessedMeshCache> processed_mesh_cache; // May be NULL.
 	ThreadSafeQueue<Reference<ThreadMessage> >* result_msg_queue;
 };
@@ -46,6 +46,7 @@ Copyright Glare Technologies Limited 2020 -
 #include "URLWhitelist.h"
 #include "URLParser.h"
 #include "LoadModelTask.h"
+#include "ProcessedMeshCache.h"
 #include "BuildScatteringInfoTask.h"
 #include "LoadTextureTask.h"
 #include "LoadAudioTask.h"
@@ -396,6 +397,8 @@ MainWindow::MainWindow(const std::string& base_dir_path_, const std::string& app
 	print("resources_dir: " + resources_dir);
 	resource_manager = new ResourceManager(this->resources_dir);
 
+	processed_mesh_cache = new ProcessedMeshCache(cache_dir + "/processed_mesh_cache", /*max_total_size=*/2048ull * 1024 * 1024);
+
 	
 	// The user may have changed the resources dir (by changing the custom cache directory) since last time we ran.
 	// In this case, we want to check if each resources is actually present on disk in the current resources dir.
@@ -1861,6 +1864,7 @@ void MainWindow::loadModelForObject(WorldObject* ob)
 				load_model_task->unit_cube_shape = this->unit_cube_shape;
 				load_model_task->result_msg_queue = &this->msg_queue;
 				load_model_task->resource_manager = resource_manager;
+				load_model_task->processed_mesh_cache = processed_mesh_cache;
 				load_model_task->voxel_ob = ob;
 				load_model_task->build_dynamic_physics_ob = ob->isDynamic();
 
@@ -2024,6 +2028,7 @@ void MainWindow::loadModelForObject(WorldObject* ob)
 							load_model_task->unit_cube_shape = this->unit_cube_shape;
 							load_model_task->result_msg_queue = &this->msg_queue;
 							load_model_task->resource_manager = resource_manager;
+							load_model_task->processed_mesh_cache = processed_mesh_cache;
 							load_model_task->build_dynamic_physics_ob = ob->isDynamic();
 
 							load_item_queue.enqueueItem(*ob, load_model_task, max_dist_for_ob_model_lod_level);
@@ -2216,6 +2221,7 @@ void MainWindow::loadModelForAvatar(Avatar* avatar)
 					load_model_task->unit_cube_shape = this->unit_cube_shape;
 					load_model_task->result_msg_queue = &this->msg_queue;
 					load_model_task->resource_manager = resource_manager;
+					load_model_task->processed_mesh_cache = processed_mesh_cache;
 
 					load_item_queue.enqueueItem(*avatar, load_model_task, max_dist_for_ob_model_lod_level, our_avatar);
 				}
@@ -4173,6 +4179,7 @@ void MainWindow::timerEvent(QTimerEvent* event)
 				scratch_packet.clear();
 				scratch_packet.writeUInt32(2); // Packet type
 				writeToStream(this->client_avatar_uid, scratch_packet);
+				scratch_packet.writeUInt32((uint32)world_state->num_transform_datagrams_received); // Lets the server know if transform datagrams are getting through.
 
 				try
 				{
@@ -7194,6 +7201,7 @@ void MainWindow::handleMessages(double global_time, double cur_time)
 								load_model_task->unit_cube_shape = this->unit_cube_shape;
 								load_model_task->result_msg_queue = &this->msg_queue;
 								load_model_task->resource_manager = resource_manager;
+								load_model_task->processed_mesh_cache = processed_mesh_cache;
 								load_model_task->build_dynamic_physics_ob = build_dynamic_physics_ob;
 
 								load_item_queue.enqueueItem(pos.toVec4fPoint(), size_factor, load_model_task, 
@@ -14604,7 +14612,7 @@ int main(int argc, char *argv[])
 
 					PhysicsShape physics_shape;
 					BatchedMeshRef batched_mesh;
-					Reference<OpenGLMeshRenderData> mesh_data = ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(mesh_URL, *mw.resource_manager,
+					Reference<OpenGLMeshRenderData> mesh_data = ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(mesh_URL, *mw.resource_manager, /*processed_mesh_cache=*/NULL,
 						mw.ui->glWidget->opengl_engine->vert_buf_allocator.ptr(), false, /*build_dynamic_physics_ob=*/false, physics_shape, batched_mesh);
 
 					test_avatar->graphics.skinned_gl_ob = ModelLoading::makeGLObjectForMeshDataAndMaterials(*mw.ui->glWidget->opengl_engine, mesh_data, /*ob_lod_level=*/0, 
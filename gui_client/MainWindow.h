@@ -55,6 +55,7 @@ struct tls_config;
 class SubstrataVideoReaderCallback;
 struct CreateVidReaderTask;
 class BiomeManager;
+class ProcessedMeshCache;
 class ScriptLoadedThreadMessage;
 class ObjectPathController;
 namespace glare { class PoolAllocator; }
@@ -435,6 +436,7 @@ public:
 
 	std::string resources_dir;
 	Reference<ResourceManager> resource_manager;
+	Reference<ProcessedMeshCache> processed_mesh_cache;
 
 	// NOTE: these object sets need to be cleared in connectToServer(), also when removing a dead object in ob->state == WorldObject::State_Dead case in timerEvent, the object needs to be removed
 	// from any of these sets it is in.
@@ -9,6 +9,7 @@ Code By Nicholas Chapman.
 
 #include "MeshBuilding.h"
 #include "PhysicsWorld.h"
+#include "ProcessedMeshCache.h"
 #include "../shared/WorldObject.h"
 #include "../shared/ResourceManager.h"
 #include "../shared/VoxelMeshBuilding.h"
@@ -944,13 +945,9 @@ void ModelLoading::setMaterialTexPathsForLODLevel(GLObject& gl_ob, int ob_lod_le
 }
 
 
-Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
-	ResourceManager& resource_manager, VertexBufferAllocator* vert_buf_allocator,
-	bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out)
+// Load a mesh from disk, and sanitise and optimise it.
+static BatchedMeshRef loadAndProcessBatchedMesh(const std::string& model_path)
 {
-	// Load mesh from disk:
-	const std::string model_path = resource_manager.pathForURL(lod_model_URL);
-
 	BatchedMeshRef batched_mesh;
 
 	if(hasExtension(model_path, "obj"))
@@ -1011,14 +1008,42 @@ Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForMod
 		if(batched_mesh->animation_data.vrm_data.nonNull())
 			rotateVRMMesh(*batched_mesh);
 
+	return batched_mesh;
+}
+
+
+Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
+	ResourceManager& resource_manager, ProcessedMeshCache* processed_mesh_cache, VertexBufferAllocator* vert_buf_allocator,
+	bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out)
+{
+	BatchedMeshRef batched_mesh;
+	PhysicsShape physics_shape;
+	bool built_mesh = false;
+
+	if(!processed_mesh_cache || !processed_mesh_cache->tryLoad(lod_model_URL, build_dynamic_physics_ob, batched_mesh, physics_shape))
+	{
+		// Load mesh from disk:
+		const std::string model_path = resource_manager.pathForURL(lod_model_URL);
+
+		batched_mesh = loadAndProcessBatchedMesh(model_path);
+		built_mesh = true;
+	}
+
 	Reference<OpenGLMeshRenderData> gl_meshdata = GLMeshBuilding::buildBatchedMesh(vert_buf_allocator, batched_mesh, /*skip opengl calls=*/skip_opengl_calls, /*instancing_matrix_data=*/NULL);
 
 	gl_meshdata->animation_data = batched_mesh->animation_data;
 
 	gl_meshdata->num_materials_referenced = batched_mesh->numMaterialsReferenced();
 
-	physics_shape_out = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*is dynamic=*/build_dynamic_physics_ob);
+	if(built_mesh)
+	{
+		physics_shape = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*is dynamic=*/build_dynamic_physics_ob);
+
+		if(processed_mesh_cache)
+			processed_mesh_cache->store(lod_model_URL, build_dynamic_physics_ob, *batched_mesh, physics_shape);
+	}
 
+	physics_shape_out = physics_shape;
 	batched_mesh_out = batched_mesh;
 
 	return gl_meshdata;
@@ -21,6 +21,7 @@ class RayMesh;
 class PhysicsShape;
 class VoxelGroup;
 class VertexBufferAllocator;
+class ProcessedMeshCache;
 namespace Indigo { class TaskManager; }
 
 
@@ -83,8 +84,9 @@ public:
 
 
 	// Build a BatchedMesh and OpenGLMeshRenderData from a mesh on disk identified by lod_model_URL.  Also build a physics shape.
+	// If processed_mesh_cache is non-null, the processed BatchedMesh and physics shape are loaded from it if present, and stored in it otherwise.
 	static Reference<OpenGLMeshRenderData> makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
-		ResourceManager& resource_manager, VertexBufferAllocator* vert_buf_allocator,
+		ResourceManager& resource_manager, ProcessedMeshCache* processed_mesh_cache, VertexBufferAllocator* vert_buf_allocator,
 		bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out);
 
 	// Build OpenGLMeshRenderData from voxel data.  Also return a reference to an Indigo Mesh and physics shape.
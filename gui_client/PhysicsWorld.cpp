@@ -945,6 +945,113 @@ PhysicsShape PhysicsWorld::createCOMOffsetShapeForShape(const PhysicsShape& orig
 }
 
 
+// Appends written bytes to a js::Vector.
+class PhysicsWorldVectorStreamOut final : public JPH::StreamOut
+{
+public:
+	PhysicsWorldVectorStreamOut(js::Vector<uint8, 16>& data_) : data(data_) {}
+
+	virtual void WriteBytes(const void* inData, size_t inNumBytes) override
+	{
+		const size_t write_i = data.size();
+		data.resize(write_i + inNumBytes);
+		if(inNumBytes > 0)
+			std::memcpy(&data[write_i], inData, inNumBytes);
+	}
+
+	virtual bool IsFailed() const override { return false; }
+
+	js::Vector<uint8, 16>& data;
+};
+
+
+// Reads from a memory buffer, for example a memory-mapped file.
+class PhysicsWorldMemoryStreamIn final : public JPH::StreamIn
+{
+public:
+	PhysicsWorldMemoryStreamIn(const void* data_, size_t data_size_) : data((const uint8*)data_), data_size(data_size_), read_i(0), failed(false) {}
+
+	virtual void ReadBytes(void* outData, size_t inNumBytes) override
+	{
+		if(failed || (inNumBytes > data_size - read_i))
+		{
+			// Jolt doesn't check for failure after every read, so zero the output so we don't return uninitialised data.
+			std::memset(outData, 0, inNumBytes);
+			failed = true;
+			return;
+		}
+		std::memcpy(outData, data + read_i, inNumBytes);
+		read_i += inNumBytes;
+	}
+
+	virtual bool IsEOF() const override { return read_i >= data_size; }
+	virtual bool IsFailed() const override { return failed; }
+
+	const uint8* data;
+	size_t data_size;
+	size_t read_i;
+	bool failed;
+};
+
+
+static const uint32 MAX_NUM_SUBSTRATA_PHYSICS_MATERIALS = 32; // createJoltShapeForBatchedMesh() uses at most this many materials per shape.
+
+
+bool PhysicsWorld::serialiseJoltShape(const PhysicsShape& shape, js::Vector<uint8, 16>& data_out)
+{
+	if(shape.jolt_shape.GetPtr() == NULL)
+		return false;
+
+	// SubstrataPhysicsMaterial isn't registered with the Jolt factory, so it can't be saved with SaveBinaryState.
+	// Instead, assign each material the ID equal to its index, so that only the ID is written, and restore the materials from the ID in deserialiseJoltShape().
+	JPH::PhysicsMaterialList materials;
+	shape.jolt_shape->SaveMaterialState(materials);
+
+	JPH::Shape::MaterialToIDMap material_map;
+	for(size_t i=0; i<materials.size(); ++i)
+	{
+		if(materials[i] == NULL)
+			continue;
+
+		const SubstrataPhysicsMaterial* mat = dynamic_cast<const SubstrataPhysicsMaterial*>(materials[i].GetPtr());
+		if(!mat || (mat->index >= MAX_NUM_SUBSTRATA_PHYSICS_MATERIALS))
+			return false;
+		material_map[mat] = mat->index;
+	}
+
+	JPH::Shape::ShapeToIDMap shape_map;
+	PhysicsWorldVectorStreamOut stream(data_out);
+	shape.jolt_shape->SaveWithChildren(stream, shape_map, material_map);
+
+	return !stream.IsFailed() && (material_map.size() <= MAX_NUM_SUBSTRATA_PHYSICS_MATERIALS); // Check no materials were saved with SaveBinaryState.
+}
+
+
+PhysicsShape PhysicsWorld::deserialiseJoltShape(const void* data, size_t data_size)
+{
+	JPH::Shape::IDToMaterialMap material_map;
+	for(uint32 i=0; i<MAX_NUM_SUBSTRATA_PHYSICS_MATERIALS; ++i)
+		material_map.push_back(new SubstrataPhysicsMaterial(i));
+
+	JPH::Shape::IDToShapeMap shape_map;
+	PhysicsWorldMemoryStreamIn stream(data, data_size);
+	JPH::Shape::ShapeResult result = JPH::Shape::sRestoreWithChildren(stream, shape_map, material_map);
+	if(stream.IsFailed())
+		throw glare::Exception("Error restoring Jolt shape: unexpected end of data");
+	if(result.HasError())
+		throw glare::Exception(std::string("Error restoring Jolt shape: ") + result.GetError().c_str());
+	if(!result.IsValid() || (result.Get().GetPtr() == NULL))
+		throw glare::Exception("Error restoring Jolt shape");
+	if(material_map.size() != MAX_NUM_SUBSTRATA_PHYSICS_MATERIALS)
+		throw glare::Exception("Error restoring Jolt shape: unexpected materials");
+
+	PhysicsShape shape;
+	shape.jolt_shape = result.Get();
+	shape.size_B = computeSizeBForShape(shape.jolt_shape);
+	return shape;
+}
+
+
 void PhysicsWorld::addObject(const Reference<PhysicsObject>& object)
 {
 	assert(object->pos.isFinite());
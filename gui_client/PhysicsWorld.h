@@ -126,6 +126,13 @@ public:
 
 	static PhysicsShape createCOMOffsetShapeForShape(const PhysicsShape& shape, const Vec4f& COM_offset);
 
+	// Serialise a shape built by createJoltShapeForBatchedMesh() with Jolt's binary state saving, appending to data_out.
+	// Returns false if the shape can't be serialised, for example if it uses materials other than those assigned by createJoltShapeForBatchedMesh().
+	static bool serialiseJoltShape(const PhysicsShape& shape, js::Vector<uint8, 16>& data_out);
+
+	// Throws glare::Exception on failure.
+	static PhysicsShape deserialiseJoltShape(const void* data, size_t data_size);
+
 	void think(double dt);
 
 #if USE_JOLT
@@ -0,0 +1,482 @@
+/*=====================================================================
+ProcessedMeshCache.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ProcessedMeshCache.h"
+
+
+#include "PhysicsWorld.h"
+#include <utils/FileUtils.h>
+#include <utils/MemMappedFile.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Exception.h>
+#include <utils/Vector.h>
+#include <utils/Lock.h>
+#include <utils/Clock.h>
+#include <xxhash.h>
+#include <cstring>
+#include <algorithm>
+#if defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#else
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+
+static const uint32 PHYSICS_SHAPE_FILE_MAGIC_NUMBER = 0x5A8F3C11;
+static const uint32 PHYSICS_SHAPE_FILE_HEADER_SIZE = 8; // Magic number, pipeline version.
+
+
+// Returns the last modification time of the file, in seconds since 1970.  Throws glare::Exception on failure.
+static uint64 getFileModifiedTime(const std::string& path)
+{
+#if defined(_WIN32)
+	struct _stat64 file_stat;
+	if(_wstat64(StringUtils::UTF8ToPlatformUnicodeEncoding(path).c_str(), &file_stat) != 0)
+#else
+	struct stat file_stat;
+	if(stat(path.c_str(), &file_stat) != 0)
+#endif
+		throw glare::Exception("Failed to get modification time of '" + path + "'");
+	return (uint64)file_stat.st_mtime;
+}
+
+
+// Sets the last access and modification times of the file, in seconds since 1970.  Throws glare::Exception on failure.
+static void setFileModifiedTime(const std::string& path, uint64 time)
+{
+#if defined(_WIN32)
+	struct __utimbuf64 times;
+	times.actime = times.modtime = (__time64_t)time;
+	if(_wutime64(StringUtils::UTF8ToPlatformUnicodeEncoding(path).c_str(), &times) != 0)
+#else
+	struct utimbuf times;
+	times.actime = times.modtime = (time_t)time;
+	if(utime(path.c_str(), &times) != 0)
+#endif
+		throw glare::Exception("Failed to set modification time of '" + path + "'");
+}
+
+
+ProcessedMeshCache::ProcessedMeshCache(const std::string& cache_dir_, uint64 max_total_size_)
+:	cache_dir(cache_dir_),
+	max_total_size(max_total_size_),
+	num_hits(0),
+	num_misses(0),
+	next_temp_file_id(0),
+	bytes_stored_since_prune(0),
+	pruned_since_construction(false)
+{
+}
+
+
+ProcessedMeshCache::~ProcessedMeshCache()
+{
+}
+
+
+std::string ProcessedMeshCache::basePathForURL(const std::string& model_URL) const
+{
+	const std::string key_input = model_URL + "_v" + toString(PIPELINE_VERSION);
+	const uint64 hashkey = XXH64(key_input.data(), key_input.size(), /*seed=*/1);
+	const uint64 dir_bits = hashkey >> 58; // 6 bits for the dirs => 64 subdirs in the cache dir.
+	return cache_dir + "/" + ::toHexString(dir_bits) + "/" + ::toHexString(hashkey);
+}
+
+
+std::string ProcessedMeshCache::meshPathForURL(const std::string& model_URL) const
+{
+	return basePathForURL(model_URL) + ".bmesh";
+}
+
+
+std::string ProcessedMeshCache::physicsShapePathForURL(const std::string& model_URL, bool build_dynamic_physics_ob) const
+{
+	return basePathForURL(model_URL) + (build_dynamic_physics_ob ? "_dynamic.joltshape" : "_static.joltshape");
+}
+
+
+bool ProcessedMeshCache::tryLoad(const std::string& model_URL, bool build_dynamic_physics_ob, BatchedMeshRef& mesh_out, PhysicsShape& physics_shape_out)
+{
+	const std::string mesh_path = meshPathForURL(model_URL);
+	const std::string shape_path = physicsShapePathForURL(model_URL, build_dynamic_physics_ob);
+
+	if(!FileUtils::fileExists(mesh_path) || !FileUtils::fileExists(shape_path))
+	{
+		num_misses++;
+		return false;
+	}
+
+	try
+	{
+		PhysicsShape physics_shape;
+		{
+			MemMappedFile file(shape_path);
+			if(file.fileSize() < PHYSICS_SHAPE_FILE_HEADER_SIZE)
+				throw glare::Exception("Physics shape file too small");
+
+			uint32 header[2];
+			std::memcpy(header, file.fileData(), sizeof(header));
+			if(header[0] != PHYSICS_SHAPE_FILE_MAGIC_NUMBER)
+				throw glare::Exception("Invalid magic number in physics shape file");
+			if(header[1] != PIPELINE_VERSION)
+				throw glare::Exception("Unexpected version in physics shape file");
+
+			physics_shape = PhysicsWorld::deserialiseJoltShape((const uint8*)file.fileData() + PHYSICS_SHAPE_FILE_HEADER_SIZE, file.fileSize() - PHYSICS_SHAPE_FILE_HEADER_SIZE);
+		}
+
+		mesh_out = BatchedMesh::readFromFile(mesh_path);
+		physics_shape_out = physics_shape;
+		num_hits++;
+
+		// Touch the files, so that recently used entries are the last to be pruned.  Errors are ignored.
+		try
+		{
+			const uint64 now = (uint64)Clock::getSecsSince1970();
+			setFileModifiedTime(mesh_path, now);
+			setFileModifiedTime(shape_path, now);
+		}
+		catch(glare::Exception&)
+		{}
+		return true;
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ProcessedMeshCache: Error while loading cached mesh for '" + model_URL + "': " + e.what());
+		num_misses++;
+		return false;
+	}
+}
+
+
+void ProcessedMeshCache::store(const std::string& model_URL, bool build_dynamic_physics_ob, const BatchedMesh& mesh, const PhysicsShape& physics_shape)
+{
+	try
+	{
+		js::Vector<uint8, 16> shape_data(PHYSICS_SHAPE_FILE_HEADER_SIZE);
+		const uint32 header[2] = { PHYSICS_SHAPE_FILE_MAGIC_NUMBER, PIPELINE_VERSION };
+		std::memcpy(shape_data.data(), header, sizeof(header));
+
+		if(!PhysicsWorld::serialiseJoltShape(physics_shape, shape_data))
+			return; // Shape can't be cached, so don't cache the mesh either.
+
+		const std::string mesh_path = meshPathForURL(model_URL);
+		const std::string shape_path = physicsShapePathForURL(model_URL, build_dynamic_physics_ob);
+		FileUtils::createDirsForPath(mesh_path);
+
+		// Write to temp files first, then move into place, so that other threads never see partially written files.
+		const std::string temp_suffix = "_temp_" + toString((int64)(next_temp_file_id++));
+
+		uint64 bytes_stored = shape_data.size();
+
+		if(!FileUtils::fileExists(mesh_path)) // The mesh may already be present, if it was stored for the other physics shape type.
+		{
+			BatchedMesh::WriteOptions write_options;
+			write_options.compression_level = 1; // Use a fast compression level, as decompression speed is what matters here.
+			mesh.writeToFile(mesh_path + temp_suffix, write_options);
+			bytes_stored += FileUtils::getFileSize(mesh_path + temp_suffix);
+			FileUtils::moveFile(mesh_path + temp_suffix, mesh_path);
+		}
+
+		FileUtils::writeEntireFile(shape_path + temp_suffix, (const char*)shape_data.data(), shape_data.size());
+		FileUtils::moveFile(shape_path + temp_suffix, shape_path);
+
+		bool prune_needed;
+		{
+			Lock lock(prune_mutex);
+			bytes_stored_since_prune += bytes_stored;
+			prune_needed = !pruned_since_construction || (bytes_stored_since_prune > max_total_size / 8);
+		}
+		if(prune_needed)
+			pruneCache();
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("ProcessedMeshCache: Error while storing cached mesh for '" + model_URL + "': " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ProcessedMeshCache: Error while storing cached mesh for '" + model_URL + "': " + e.what());
+	}
+}
+
+
+struct CacheFileInfo
+{
+	std::string path;
+	uint64 last_modified_time;
+	uint64 size;
+};
+
+
+void ProcessedMeshCache::pruneCache()
+{
+	Lock lock(prune_mutex);
+
+	bytes_stored_since_prune = 0;
+	pruned_since_construction = true;
+
+	if(!FileUtils::fileExists(cache_dir))
+		return; // Cache dir may not have been created yet.
+
+	try
+	{
+		// Get the size and modification time of all the cache files.  Errors for individual files are ignored, as files may be added or removed by other threads while we are iterating.
+		const std::vector<std::string> paths = FileUtils::getFilesInDirRecursive(cache_dir); // Paths relative to cache_dir.
+
+		std::vector<CacheFileInfo> files;
+		files.reserve(paths.size());
+		uint64 total_size = 0;
+		for(size_t i=0; i<paths.size(); ++i)
+		{
+			if(paths[i].find("_temp_") != std::string::npos) // Don't delete files that are still being written.
+				continue;
+
+			try
+			{
+				CacheFileInfo info;
+				info.path = cache_dir + "/" + paths[i];
+				info.size = FileUtils::getFileSize(info.path);
+				info.last_modified_time = getFileModifiedTime(info.path);
+				files.push_back(info);
+				total_size += info.size;
+			}
+			catch(FileUtils::FileUtilsExcep&)
+			{}
+			catch(glare::Exception&)
+			{}
+		}
+
+		if(total_size <= max_total_size)
+			return;
+
+		// Delete the least recently used files until we are under the target size.  Prune to below the max size, so we don't have to prune again straight away.
+		std::sort(files.begin(), files.end(), [](const CacheFileInfo& a, const CacheFileInfo& b) { return a.last_modified_time < b.last_modified_time; });
+
+		const uint64 target_size = max_total_size / 4 * 3;
+		uint64 num_deleted = 0;
+		for(size_t i=0; (i<files.size()) && (total_size > target_size); ++i)
+		{
+			try
+			{
+				FileUtils::deleteFile(files[i].path);
+				total_size -= files[i].size;
+				num_deleted++;
+			}
+			catch(FileUtils::FileUtilsExcep&) // The file may be in use, or already deleted.
+			{}
+		}
+
+		conPrint("ProcessedMeshCache: Pruned " + toString(num_deleted) + " files, cache size is now " + toString(total_size / (1024 * 1024)) + " MB");
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("ProcessedMeshCache: Error while pruning cache: " + e.what());
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ModelLoading.h"
+#include "../shared/ResourceManager.h"
+#include "../shared/LODGeneration.h"
+#include <opengl/OpenGLMeshRenderData.h>
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/Timer.h>
+
+
+static void checkMeshesEqual(const BatchedMesh& a, const BatchedMesh& b)
+{
+	testAssert(a.numVerts() == b.numVerts());
+	testAssert(a.numIndices() == b.numIndices());
+	testAssert(a.index_type == b.index_type);
+	testAssert(a.batches.size() == b.batches.size());
+	testAssert(a.vertex_data.size() == b.vertex_data.size());
+	testAssert(a.index_data.size() == b.index_data.size());
+	testAssert(std::memcmp(a.vertex_data.data(), b.vertex_data.data(), a.vertex_data.size()) == 0);
+	testAssert(std::memcmp(a.index_data.data(), b.index_data.data(), a.index_data.size()) == 0);
+}
+
+
+// Load a model through makeGLMeshDataAndBatchedMeshForModelURL(), with or without a cache.
+static void loadModel(const std::string& URL, ResourceManager& resource_manager, ProcessedMeshCache* cache, bool dynamic, BatchedMeshRef& mesh_out, PhysicsShape& shape_out)
+{
+	ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(URL, resource_manager, cache, /*vert_buf_allocator=*/NULL, /*skip_opengl_calls=*/true, dynamic, shape_out, mesh_out);
+}
+
+
+void ProcessedMeshCache::test()
+{
+	conPrint("ProcessedMeshCache::test()");
+
+	// PhysicsWorld::init() needs to have been called already.
+
+	try
+	{
+		// Use a new dir for each run, so that we start with an empty cache.
+		const std::string test_dir = PlatformUtils::getTempDirPath() + "/processed_mesh_cache_test_" + toString((uint64)Clock::getSecsSince1970());
+		FileUtils::createDirIfDoesNotExist(test_dir);
+		FileUtils::createDirIfDoesNotExist(test_dir + "/resources");
+
+		Reference<ResourceManager> resource_manager = new ResourceManager(test_dir + "/resources");
+
+		const std::string URL = "processed_mesh_cache_test_grid.obj";
+		FileUtils::writeEntireFileTextMode(resource_manager->pathForURL(URL), LODGeneration::makeTestGridOBJ(64));
+
+		for(int dynamic=0; dynamic<2; ++dynamic)
+		{
+			ProcessedMeshCache cache(test_dir + "/cache_" + toString(dynamic), /*max_total_size=*/1024 * 1024 * 1024);
+
+			// Load without the cache, for reference
+			BatchedMeshRef ref_mesh;
+			PhysicsShape ref_shape;
+			loadModel(URL, *resource_manager, NULL, dynamic != 0, ref_mesh, ref_shape);
+
+			// Cold load: should miss, and store an entry.
+			BatchedMeshRef cold_mesh;
+			PhysicsShape cold_shape;
+			loadModel(URL, *resource_manager, &cache, dynamic != 0, cold_mesh, cold_shape);
+			testAssert(cache.numHits() == 0 && cache.numMisses() == 1);
+			testAssert(FileUtils::fileExists(cache.meshPathForURL(URL)));
+			testAssert(FileUtils::fileExists(cache.physicsShapePathForURL(URL, dynamic != 0)));
+			testAssert(!FileUtils::fileExists(cache.physicsShapePathForURL(URL, dynamic == 0)));
+			checkMeshesEqual(*cold_mesh, *ref_mesh);
+
+			// Warm load: should hit, and give the same results.
+			BatchedMeshRef warm_mesh;
+			PhysicsShape warm_shape;
+			loadModel(URL, *resource_manager, &cache, dynamic != 0, warm_mesh, warm_shape);
+			testAssert(cache.numHits() == 1 && cache.numMisses() == 1);
+			checkMeshesEqual(*warm_mesh, *ref_mesh);
+			testAssert(warm_shape.jolt_shape.GetPtr() != NULL);
+			testAssert(warm_shape.size_B == ref_shape.size_B);
+			testAssert(warm_shape.getAABBOS().toString() == ref_shape.getAABBOS().toString());
+			testAssert(warm_shape.jolt_shape->GetSubType() == ref_shape.jolt_shape->GetSubType());
+
+			// Loading with the other physics shape type should miss.
+			{
+				BatchedMeshRef mesh;
+				PhysicsShape shape;
+				loadModel(URL, *resource_manager, &cache, dynamic == 0, mesh, shape);
+				testAssert(cache.numHits() == 1 && cache.numMisses() == 2);
+			}
+
+			// A corrupted shape file should be treated as a miss.
+			{
+				FileUtils::writeEntireFile(cache.physicsShapePathForURL(URL, dynamic != 0), std::string("corrupted"));
+				BatchedMeshRef mesh;
+				PhysicsShape shape;
+				testAssert(!cache.tryLoad(URL, dynamic != 0, mesh, shape));
+			}
+		}
+
+		// Test pruning: the least recently used entries should be deleted first.
+		{
+			const std::string prune_cache_dir = test_dir + "/prune_cache";
+			std::vector<std::string> URLs;
+			std::vector<uint64> entry_sizes;
+			{
+				ProcessedMeshCache cache(prune_cache_dir, /*max_total_size=*/1024 * 1024 * 1024);
+				for(int i=0; i<3; ++i)
+				{
+					URLs.push_back("processed_mesh_cache_prune_test_" + toString(i) + ".obj");
+					FileUtils::writeEntireFileTextMode(resource_manager->pathForURL(URLs[i]), LODGeneration::makeTestGridOBJ(16 + i));
+
+					BatchedMeshRef mesh;
+					PhysicsShape shape;
+					loadModel(URLs[i], *resource_manager, &cache, /*dynamic=*/false, mesh, shape);
+				}
+
+				// Set the modification times so that entry 0 is the oldest, then load entry 0, which should make it the most recently used.
+				const uint64 now = (uint64)Clock::getSecsSince1970();
+				for(int i=0; i<3; ++i)
+				{
+					setFileModifiedTime(cache.meshPathForURL(URLs[i]), now - (300 - i * 100));
+					setFileModifiedTime(cache.physicsShapePathForURL(URLs[i], /*build_dynamic_physics_ob=*/false), now - (300 - i * 100));
+					testAssert(getFileModifiedTime(cache.meshPathForURL(URLs[i])) == now - (300 - i * 100));
+				}
+
+				BatchedMeshRef mesh;
+				PhysicsShape shape;
+				testAssert(cache.tryLoad(URLs[0], /*build_dynamic_physics_ob=*/false, mesh, shape));
+
+				for(int i=0; i<3; ++i)
+					entry_sizes.push_back(FileUtils::getFileSize(cache.meshPathForURL(URLs[i])) + FileUtils::getFileSize(cache.physicsShapePathForURL(URLs[i], /*build_dynamic_physics_ob=*/false)));
+			}
+
+			// Construct a cache with a max size just under the total size.  Construction shouldn't prune anything.
+			const uint64 total_size = entry_sizes[0] + entry_sizes[1] + entry_sizes[2];
+			testAssert((total_size - 1) / 4 * 3 >= entry_sizes[0] + entry_sizes[2]);
+			ProcessedMeshCache cache(prune_cache_dir, /*max_total_size=*/total_size - 1);
+
+			BatchedMeshRef mesh;
+			PhysicsShape shape;
+			testAssert(FileUtils::fileExists(cache.meshPathForURL(URLs[1])));
+
+			// Pruning should delete entry 1, now the least recently used.  The entries are of similar size, so after that the total size is under the 3/4 target.
+			cache.pruneCache();
+			testAssert(!cache.tryLoad(URLs[1], /*build_dynamic_physics_ob=*/false, mesh, shape));
+			testAssert(cache.tryLoad(URLs[0], /*build_dynamic_physics_ob=*/false, mesh, shape));
+			testAssert(cache.tryLoad(URLs[2], /*build_dynamic_physics_ob=*/false, mesh, shape));
+		}
+
+		// Perf test: cold vs warm load times over a corpus of models.
+		if(false)
+		{
+			const std::string corpus_dir = TestUtils::getTestReposDir() + "/testfiles/gltf";
+			const std::vector<std::string> paths = FileUtils::getFilesInDirWithExtensionFullPaths(corpus_dir, "glb");
+
+			// Copy the models into the resources dir.
+			std::vector<std::string> URLs;
+			for(size_t i=0; i<paths.size(); ++i)
+			{
+				const std::string corpus_URL = FileUtils::getFilename(paths[i]);
+				FileUtils::copyFile(paths[i], resource_manager->pathForURL(corpus_URL));
+				URLs.push_back(corpus_URL);
+			}
+
+			ProcessedMeshCache cache(test_dir + "/perf_cache", /*max_total_size=*/1024 * 1024 * 1024);
+
+			for(int pass=0; pass<2; ++pass)
+			{
+				Timer timer;
+				for(size_t i=0; i<URLs.size(); ++i)
+				{
+					try
+					{
+						BatchedMeshRef mesh;
+						PhysicsShape shape;
+						loadModel(URLs[i], *resource_manager, &cache, /*dynamic=*/false, mesh, shape);
+					}
+					catch(glare::Exception& e)
+					{
+						conPrint("Error loading '" + URLs[i] + "': " + e.what());
+					}
+				}
+				conPrint((pass == 0 ? "Cold" : "Warm") + std::string(" load of ") + toString(URLs.size()) + " models took " + timer.elapsedStringNSigFigs(4) + 
+					" (hits: " + toString(cache.numHits()) + ", misses: " + toString(cache.numMisses()) + ")");
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ProcessedMeshCache::test() done");
+}
+
+
+#endif // BUILD_TESTS
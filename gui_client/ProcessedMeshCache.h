@@ -0,0 +1,83 @@
+/*=====================================================================
+ProcessedMeshCache.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "PhysicsObject.h"
+#include <graphics/BatchedMesh.h>
+#include <ThreadSafeRefCounted.h>
+#include <AtomicInt.h>
+#include <Mutex.h>
+#include <string>
+
+
+/*=====================================================================
+ProcessedMeshCache
+------------------
+On-disk cache of processed model meshes and physics shapes.
+
+ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL() parses the source
+model, sanitises and optimises it, and builds a Jolt physics shape for it.
+The results of that are stored here, keyed by the model URL and
+PIPELINE_VERSION, so that later loads can just read them back.
+
+Resource URLs are content-addressed (a given URL always refers to the same
+file contents), so entries never need to be invalidated, unless the
+processing pipeline changes, in which case PIPELINE_VERSION should be
+incremented.
+
+The mesh is stored as a bmesh file, the physics shape is stored with Jolt's
+SaveWithChildren, and is restored from a memory-mapped file.  Static and
+dynamic physics shapes are stored separately.
+
+The total size of the cache files is kept under max_total_size by deleting
+the least recently used files, by modification time.  Files are touched when
+they are loaded.  Pruning is done on the first store(), and after every
+max_total_size / 8 bytes stored, so that it runs on the calling loader
+thread instead of when the cache is constructed.
+
+Threadsafe, files are written to a temporary path then moved into place.
+=====================================================================*/
+class ProcessedMeshCache : public ThreadSafeRefCounted
+{
+public:
+	ProcessedMeshCache(const std::string& cache_dir, uint64 max_total_size);
+	~ProcessedMeshCache();
+
+	// Increment this when the processing done in makeGLMeshDataAndBatchedMeshForModelURL() or PhysicsWorld::createJoltShapeForBatchedMesh() changes.
+	static const uint32 PIPELINE_VERSION = 1;
+
+	// Returns true and sets mesh_out and physics_shape_out if an entry for the URL is in the cache.
+	// Returns false if there is no entry, or it could not be read.
+	bool tryLoad(const std::string& model_URL, bool build_dynamic_physics_ob, BatchedMeshRef& mesh_out, PhysicsShape& physics_shape_out);
+
+	// Store a processed mesh and physics shape.  Errors are printed and otherwise ignored.
+	void store(const std::string& model_URL, bool build_dynamic_physics_ob, const BatchedMesh& mesh, const PhysicsShape& physics_shape);
+
+	std::string meshPathForURL(const std::string& model_URL) const;
+	std::string physicsShapePathForURL(const std::string& model_URL, bool build_dynamic_physics_ob) const;
+
+	// Delete the least recently used files until the total size of the cache files is at most 3/4 of max_total_size.
+	void pruneCache();
+
+	int64 numHits() const { return num_hits; }
+	int64 numMisses() const { return num_misses; }
+
+	static void test();
+
+private:
+	std::string basePathForURL(const std::string& model_URL) const;
+
+	std::string cache_dir;
+	uint64 max_total_size;
+	glare::AtomicInt num_hits;
+	glare::AtomicInt num_misses;
+	glare::AtomicInt next_temp_file_id;
+
+	Mutex prune_mutex;
+	uint64 bytes_stored_since_prune GUARDED_BY(prune_mutex);
+	bool pruned_since_construction GUARDED_BY(prune_mutex);
+};
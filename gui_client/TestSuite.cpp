@@ -8,12 +8,15 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "ModelLoading.h"
 #include "PhysicsWorld.h"
+#include "ProcessedMeshCache.h"
 #include "TerrainTests.h"
 #include "URLParser.h"
 #include "CameraController.h"
 #include "../shared/VoxelMeshBuilding.h"
 #include "../shared/LODGeneration.h"
 #include "../shared/ImageDecoding.h"
+#include "../shared/TransformBatch.h"
+#include "../shared/TransformUDPChannel.h"
 #include "../physics/TreeTest.h"
 #include "../opengl/TextureLoading.h"
 #include "../opengl/OpenGLEngineTests.h"
@@ -121,6 +124,8 @@ void TestSuite::test()
 	runTest([&]() { Maths::test(); });
 	runTest([&]() { DatabaseTests::test(); });
 	runTest([&]() { WorldObject::test(); });
+	runTest([&]() { TransformBatch::test(); });
+	runTest([&]() { TransformUDPChannel::test(); });
 	runTest([&]() { WorldMaterial::test(); });
 	runTest([&]() { glare::ArenaAllocator::test(); });
 	runTest([&]() { Matrix4f::test(); });
@@ -147,6 +152,7 @@ void TestSuite::test()
 	runTest([&]() { LODGeneration::test(); });
 	runTest([&]() { VoxelMeshBuilding::test(); });
 	runTest([&]() { ModelLoading::test(); });
+	runTest([&]() { ProcessedMeshCache::test(); });
 	runTest([&]() { glare::AudioFileReader::test(); });
 	runTest([&]() { TLSSocketTests::test(); }, /*mem leak allowed=*/true);
 	runTest([&]() { URLParser::test(); });
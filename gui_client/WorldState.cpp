@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2022 -
 
 
 #include "URLWhitelist.h"
+#include "../shared/TransformBatch.h"
 #include <ConPrint.h>
 #include <StringUtils.h>
 #include <Clock.h>
@@ -137,3 +138,150 @@ Parcel* WorldState::getParcelPointIsIn(const Vec3d& p_)
 
 	return NULL;
 }
+
+
+void WorldState::applyAvatarTransformUpdate(const UID& avatar_uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state_and_input_bitflags, uint32 present_fields)
+{
+	// Look up existing avatar in world state
+	auto res = avatars.find(avatar_uid);
+	if(res != avatars.end())
+	{
+		Avatar* avatar = res->second.getPointer();
+		avatar->pos = pos;
+		if(present_fields & TransformUpdate::FIELD_ROTATION)
+			avatar->rotation = rotation;
+		if(present_fields & TransformUpdate::FIELD_ANIM_STATE)
+		{
+			avatar->anim_state = anim_state_and_input_bitflags & 0xFF;
+			avatar->last_physics_input_bitflags = anim_state_and_input_bitflags >> 16;
+		}
+		avatar->transform_dirty = true;
+
+		//conPrint("updated avatar transform");
+
+		avatar->pos_snapshots      [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = pos;
+		avatar->rotation_snapshots [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = avatar->rotation;
+		avatar->snapshot_times     [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = Clock::getTimeSinceInit();
+		//avatar->last_snapshot_time = Clock::getCurTimeRealSec();
+		avatar->next_snapshot_i++;
+	}
+}
+
+
+void WorldState::applyObjectTransformUpdate(const UID& client_avatar_uid, const UID& object_uid, const Vec3d& pos, const Vec3f& axis, float angle, const Vec3f& scale, uint32 transform_update_avatar_uid, uint32 present_fields)
+{
+	if(transform_update_avatar_uid != (uint32)client_avatar_uid.value()) // Discard ObjectTransformUpdate messages we sent. 
+	{
+		// Look up existing object in world state
+		auto res = objects.find(object_uid);
+		if(res != objects.end())
+		{
+			WorldObject* ob = res.getValue().ptr();
+#if GUI_CLIENT
+			if(!ob->is_selected) // Don't update the selected object - we will consider the local client control authoritative while the object is selected.
+#endif
+			{
+				//conPrint("ObjectTransformUpdate: setting ob pos to " + pos.toString());
+				ob->pos = pos;
+				if(present_fields & TransformUpdate::FIELD_ROTATION)
+				{
+					ob->axis = axis;
+					ob->angle = angle;
+				}
+				if(present_fields & TransformUpdate::FIELD_SCALE)
+					ob->scale = scale;
+
+				// If we had physics snapshots, reset snapshots.
+				if(ob->snapshots_are_physics_snapshots)
+				{
+					// conPrint("Resetting snapshots.");
+					ob->next_insertable_snapshot_i = 0;
+					ob->next_snapshot_i = 0;
+				}
+				ob->snapshots_are_physics_snapshots = false;
+
+				ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = 
+					WorldObject::Snapshot({pos.toVec4fPoint(), Quatf::fromAxisAndAngle(normalise(ob->axis), ob->angle), /*linear vel=*/Vec4f(0.f), /*angular_vel=*/Vec4f(0.f), /*client time=*/0.0, /*local time=*/Clock::getTimeSinceInit()});
+
+				ob->next_snapshot_i++;
+
+				ob->from_remote_transform_dirty = true;
+				dirty_from_remote_objects.insert(ob);
+
+				//conPrint("updated object transform");
+			}
+		}
+	}
+	else
+	{
+		// conPrint("\tDiscarding ObjectTransformUpdate message, as we sent it.");
+	}
+}
+
+
+void WorldState::applyObjectPhysicsTransformUpdate(const UID& client_avatar_uid, const UID& object_uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel, uint32 transform_update_avatar_uid, double transform_client_time)
+{
+	if(transform_update_avatar_uid != (uint32)client_avatar_uid.value()) // Discard ObjectPhysicsTransformUpdate messages we sent.
+	{
+		// Look up existing object in world state
+		auto res = objects.find(object_uid);
+		if(res != objects.end())
+		{
+			WorldObject* ob = res.getValue().ptr();
+
+			if(ob->physics_owner_id == transform_update_avatar_uid) // Only process messages that are from the physics owner of this object, discard others.
+			{
+				// If we had non-physics snapshots, reset snapshots.
+				if(!ob->snapshots_are_physics_snapshots)
+				{
+					// conPrint("Resetting snapshots.");
+					ob->next_insertable_snapshot_i = 0;
+					ob->next_snapshot_i = 0;
+				}
+				ob->snapshots_are_physics_snapshots = true;
+
+				const double local_time = Clock::getTimeSinceInit();
+
+				ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = WorldObject::Snapshot({pos.toVec4fPoint(), rot, linear_vel, angular_vel, transform_client_time, local_time});
+
+				ob->next_snapshot_i++;
+
+				// conPrint("ClientThread: Added snapshot " + toString(ob->next_snapshot_i));
+
+				ob->from_remote_physics_transform_dirty = true;
+				dirty_from_remote_objects.insert(ob);
+			}
+			else
+			{
+				// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as not from physics owner of object.");
+			}
+		}
+	}
+	else
+	{
+		// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as we sent it.");
+	}
+}
+
+
+void WorldState::applyTransformUpdate(const UID& client_avatar_uid, const TransformUpdate& update)
+{
+	if(update.type == TransformUpdate::Type_Avatar)
+	{
+		applyAvatarTransformUpdate(update.uid, update.pos, update.avatar_rotation, update.anim_state, update.present_fields);
+	}
+	else if(update.type == TransformUpdate::Type_Object)
+	{
+		Vec4f unit_axis(0, 0, 1, 0);
+		float angle = 0;
+		if(update.present_fields & TransformUpdate::FIELD_ROTATION)
+			update.rot.toAxisAndAngle(unit_axis, angle);
+
+		applyObjectTransformUpdate(client_avatar_uid, update.uid, update.pos, Vec3f(unit_axis.x[0], unit_axis.x[1], unit_axis.x[2]), angle, update.scale, update.transform_update_avatar_uid, update.present_fields);
+	}
+	else // else if(update.type == TransformUpdate::Type_ObjectPhysics)
+	{
+		applyObjectPhysicsTransformUpdate(client_avatar_uid, update.uid, update.pos, update.rot, Vec4f(update.linear_vel.x, update.linear_vel.y, update.linear_vel.z, 0),
+			Vec4f(update.angular_vel.x, update.angular_vel.y, update.angular_vel.z, 0), update.transform_update_avatar_uid, update.client_time);
+	}
+}
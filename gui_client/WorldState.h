@@ -16,6 +16,7 @@ Copyright Glare Technologies Limited 2022 -
 #include <map>
 #include <unordered_set>
 class URLWhitelist;
+struct TransformUpdate;
 
 
 /*=====================================================================
@@ -37,10 +38,19 @@ public:
 
 	Parcel* getParcelPointIsIn(const Vec3d& p) REQUIRES(mutex); // Returns NULL if not in any parcel.  A lock on mutex must be held by the caller.
 
+	// Apply transform updates received from the server, from ClientThread or ClientUDPHandlerThread.  A lock on mutex must be held by the caller.
+	// Fields not in present_fields (see TransformUpdate) keep their current values.  Object updates sent by this client (identified by client_avatar_uid) are discarded.
+	void applyAvatarTransformUpdate(const UID& avatar_uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state_and_input_bitflags, uint32 present_fields) REQUIRES(mutex);
+	void applyObjectTransformUpdate(const UID& client_avatar_uid, const UID& object_uid, const Vec3d& pos, const Vec3f& axis, float angle, const Vec3f& scale, uint32 transform_update_avatar_uid, uint32 present_fields) REQUIRES(mutex);
+	void applyObjectPhysicsTransformUpdate(const UID& client_avatar_uid, const UID& object_uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel, uint32 transform_update_avatar_uid, double transform_client_time) REQUIRES(mutex);
+	void applyTransformUpdate(const UID& client_avatar_uid, const TransformUpdate& update) REQUIRES(mutex);
+
 	std::map<UID, Reference<Avatar>> avatars GUARDED_BY(mutex);
 
 	glare::AtomicInt avatars_changed;
 
+	glare::AtomicInt num_transform_datagrams_received; // Number of transform datagrams received by ClientUDPHandlerThread.  Reported to the server in UDP discovery packets.
+
 
 	glare::FastIterMap<UID, WorldObjectRef, UIDHasher> objects GUARDED_BY(mutex);
 	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects GUARDED_BY(mutex);
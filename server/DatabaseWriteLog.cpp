@@ -0,0 +1,629 @@
+/*=====================================================================
+DatabaseWriteLog.cpp
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "DatabaseWriteLog.h"
+
+
+#include "../shared/WorldObject.h"
+#include <utils/BufferOutStream.h>
+#include <utils/BufferViewInStream.h>
+#include <utils/FileUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Exception.h>
+#include <utils/IncludeXXHash.h>
+#include <cstring>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+static const uint32 WRITE_LOG_MAGIC_NUMBER = 0x4C57534D; // 'MSWL'
+static const uint32 WRITE_LOG_VERSION = 1;
+static const size_t WRITE_LOG_HEADER_SIZE = 8;
+
+static const uint32 ENTRY_RECORD_UPDATE = 1;
+static const uint32 ENTRY_DELETE = 3;
+
+// Entry layout: type (uint32), key (uint64), payload length (uint32), payload, checksum (uint64) of everything before it in the entry.
+static const size_t ENTRY_HEADER_SIZE = 4 + 8 + 4;
+static const size_t ENTRY_CHECKSUM_SIZE = 8;
+static const size_t MAX_PAYLOAD_LEN = 1 << 30;
+
+
+void LoggedObjectTransform::setFromObject(const WorldObject& ob)
+{
+	key = ob.database_key;
+	pos = ob.pos;
+	axis = ob.axis;
+	angle = ob.angle;
+	scale = ob.scale;
+	last_modified_time = ob.last_modified_time;
+}
+
+
+void LoggedObjectTransform::applyToObject(WorldObject& ob) const
+{
+	ob.pos = pos;
+	ob.axis = axis;
+	ob.angle = angle;
+	ob.scale = scale;
+	ob.last_modified_time = last_modified_time;
+}
+
+
+void LoggedObjectTransform::writeToStream(BufferOutStream& stream) const
+{
+	stream.writeDouble(pos.x);
+	stream.writeDouble(pos.y);
+	stream.writeDouble(pos.z);
+	stream.writeFloat(axis.x);
+	stream.writeFloat(axis.y);
+	stream.writeFloat(axis.z);
+	stream.writeFloat(angle);
+	stream.writeFloat(scale.x);
+	stream.writeFloat(scale.y);
+	stream.writeFloat(scale.z);
+	last_modified_time.writeToStream(stream);
+}
+
+
+void LoggedObjectTransform::readFromStream(BufferViewInStream& stream)
+{
+	pos.x = stream.readDouble();
+	pos.y = stream.readDouble();
+	pos.z = stream.readDouble();
+	axis.x = stream.readFloat();
+	axis.y = stream.readFloat();
+	axis.z = stream.readFloat();
+	angle = stream.readFloat();
+	scale.x = stream.readFloat();
+	scale.y = stream.readFloat();
+	scale.z = stream.readFloat();
+	last_modified_time.readFromStream(stream);
+}
+
+
+static void syncFileToDisk(std::FILE* file)
+{
+#if defined(_WIN32)
+	const int res = _commit(_fileno(file));
+#else
+	const int res = fsync(fileno(file));
+#endif
+	if(res != 0)
+		throw glare::Exception("Failed to sync write log to disk.");
+}
+
+
+static void truncateFile(std::FILE* file, uint64 size)
+{
+#if defined(_WIN32)
+	const bool ok = _chsize_s(_fileno(file), (__int64)size) == 0;
+#else
+	const bool ok = ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+	if(!ok)
+		throw glare::Exception("Failed to truncate write log.");
+}
+
+
+DatabaseWriteLog::DatabaseWriteLog()
+:	num_entries_read(0),
+	num_bytes_discarded(0),
+	file(NULL),
+	file_size(0)
+{
+}
+
+
+DatabaseWriteLog::~DatabaseWriteLog()
+{
+	close();
+}
+
+
+void DatabaseWriteLog::open(const std::string& path_)
+{
+	close();
+
+	path = path_;
+	updated_records.clear();
+	deleted_keys.clear();
+	num_entries_read = 0;
+	num_bytes_discarded = 0;
+
+	std::string contents;
+	if(FileUtils::fileExists(path))
+	{
+		try
+		{
+			contents = FileUtils::readEntireFile(path);
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			throw glare::Exception("Failed to read write log '" + path + "': " + e.what());
+		}
+	}
+
+	const uint8* data = (const uint8*)contents.data();
+	size_t valid_size = 0; // Size of the prefix of the file made of a valid header and complete, valid entries.
+
+	uint32 header[2];
+	if(contents.size() >= WRITE_LOG_HEADER_SIZE)
+	{
+		std::memcpy(header, data, WRITE_LOG_HEADER_SIZE);
+		if(header[0] != WRITE_LOG_MAGIC_NUMBER)
+			throw glare::Exception("Write log '" + path + "' has invalid magic number.");
+		if(header[1] > WRITE_LOG_VERSION)
+			throw glare::Exception("Write log '" + path + "' has unsupported version " + toString(header[1]) + ".");
+
+		valid_size = WRITE_LOG_HEADER_SIZE;
+		while(valid_size + ENTRY_HEADER_SIZE + ENTRY_CHECKSUM_SIZE <= contents.size())
+		{
+			const uint8* entry = data + valid_size;
+			uint32 type;
+			uint64 key_val;
+			uint32 payload_len;
+			std::memcpy(&type, entry, 4);
+			std::memcpy(&key_val, entry + 4, 8);
+			std::memcpy(&payload_len, entry + 12, 4);
+
+			if(payload_len > MAX_PAYLOAD_LEN || (valid_size + ENTRY_HEADER_SIZE + payload_len + ENTRY_CHECKSUM_SIZE > contents.size()))
+				break; // Incomplete entry
+
+			uint64 checksum;
+			std::memcpy(&checksum, entry + ENTRY_HEADER_SIZE + payload_len, 8);
+			if(XXH64(entry, ENTRY_HEADER_SIZE + payload_len, /*seed=*/1) != checksum)
+				break; // Corrupt entry
+
+			const DatabaseKey key(key_val);
+			const uint8* payload = entry + ENTRY_HEADER_SIZE;
+			if(type == ENTRY_RECORD_UPDATE)
+			{
+				applyRecordUpdate(key, payload, payload_len);
+			}
+			else if(type == ENTRY_DELETE)
+			{
+				applyDelete(key);
+			}
+			else
+				break; // Unknown entry type, treat as corrupt.
+
+			valid_size += ENTRY_HEADER_SIZE + payload_len + ENTRY_CHECKSUM_SIZE;
+			num_entries_read++;
+		}
+	}
+	// Else the file doesn't exist, or is too short to contain the header, for example if a crash happened while the log was being reset.  Treat it as empty.
+
+	num_bytes_discarded = (valid_size > 0) ? (contents.size() - valid_size) : 0;
+
+	if(num_bytes_discarded > 0)
+		conPrint("DatabaseWriteLog: Warning: discarding " + toString(num_bytes_discarded) + " B of incomplete or corrupt entries at the end of '" + path + "'.");
+
+	file = std::fopen(path.c_str(), (valid_size > 0) ? "r+b" : "w+b");
+	if(!file)
+		throw glare::Exception("Failed to open write log '" + path + "' for writing.");
+
+	if(valid_size == 0)
+	{
+		// Write the header
+		header[0] = WRITE_LOG_MAGIC_NUMBER;
+		header[1] = WRITE_LOG_VERSION;
+		if(std::fwrite(header, 1, WRITE_LOG_HEADER_SIZE, file) != WRITE_LOG_HEADER_SIZE)
+			throw glare::Exception("Failed to write header to write log '" + path + "'.");
+		valid_size = WRITE_LOG_HEADER_SIZE;
+		flush();
+	}
+	else if(num_bytes_discarded > 0)
+	{
+		// Remove the bad entries, so new entries are appended after the last valid entry.
+		truncateFile(file, valid_size);
+	}
+
+	if(std::fseek(file, (long)valid_size, SEEK_SET) != 0)
+		throw glare::Exception("Failed to seek in write log '" + path + "'.");
+	file_size = valid_size;
+}
+
+
+void DatabaseWriteLog::close()
+{
+	if(file)
+	{
+		std::fclose(file);
+		file = NULL;
+	}
+}
+
+
+void DatabaseWriteLog::writeEntry(uint32 type, const DatabaseKey& key, const uint8* payload, size_t payload_len)
+{
+	if(!file)
+		throw glare::Exception("Write log is not open.");
+	if(payload_len > MAX_PAYLOAD_LEN)
+		throw glare::Exception("Write log entry too large.");
+
+	const uint64 key_val = key.value();
+	const uint32 payload_len32 = (uint32)payload_len;
+
+	entry_buf.resize(ENTRY_HEADER_SIZE + payload_len + ENTRY_CHECKSUM_SIZE);
+	std::memcpy(&entry_buf[0], &type, 4);
+	std::memcpy(&entry_buf[4], &key_val, 8);
+	std::memcpy(&entry_buf[12], &payload_len32, 4);
+	if(payload_len > 0)
+		std::memcpy(&entry_buf[ENTRY_HEADER_SIZE], payload, payload_len);
+	const uint64 checksum = XXH64(entry_buf.data(), ENTRY_HEADER_SIZE + payload_len, /*seed=*/1);
+	std::memcpy(&entry_buf[ENTRY_HEADER_SIZE + payload_len], &checksum, 8);
+
+	if(std::fwrite(entry_buf.data(), 1, entry_buf.size(), file) != entry_buf.size())
+		throw glare::Exception("Failed to write to write log '" + path + "'.");
+	file_size += entry_buf.size();
+}
+
+
+void DatabaseWriteLog::appendRecordUpdate(const DatabaseKey& key, ArrayRef<uint8> record_data)
+{
+	writeEntry(ENTRY_RECORD_UPDATE, key, record_data.data(), record_data.size());
+	applyRecordUpdate(key, record_data.data(), record_data.size());
+}
+
+
+void DatabaseWriteLog::appendDelete(const DatabaseKey& key)
+{
+	writeEntry(ENTRY_DELETE, key, NULL, 0);
+	applyDelete(key);
+}
+
+
+void DatabaseWriteLog::flush()
+{
+	if(!file)
+		return;
+	if(std::fflush(file) != 0)
+		throw glare::Exception("Failed to flush write log '" + path + "'.");
+	syncFileToDisk(file);
+}
+
+
+void DatabaseWriteLog::reset()
+{
+	if(!file)
+		throw glare::Exception("Write log is not open.");
+
+	updated_records.clear();
+	deleted_keys.clear();
+
+	std::fflush(file);
+	truncateFile(file, WRITE_LOG_HEADER_SIZE);
+	if(std::fseek(file, (long)WRITE_LOG_HEADER_SIZE, SEEK_SET) != 0)
+		throw glare::Exception("Failed to seek in write log '" + path + "'.");
+	file_size = WRITE_LOG_HEADER_SIZE;
+
+	flush();
+}
+
+
+void DatabaseWriteLog::applyRecordUpdate(const DatabaseKey& key, const uint8* data, size_t len)
+{
+	updated_records[key].assign(data, data + len);
+	deleted_keys.erase(key);
+}
+
+
+void DatabaseWriteLog::applyDelete(const DatabaseKey& key)
+{
+	updated_records.erase(key);
+	deleted_keys.insert(key);
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ServerWorldState.h"
+#include "ServerTestUtils.h"
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/Lock.h>
+#include <maths/PCG32.h>
+#include <map>
+
+
+// The pending changes of a log, in a form that is easy to compare.
+struct TestLogState
+{
+	std::map<uint64, std::vector<uint8>> updated_records;
+	std::map<uint64, bool> deleted_keys;
+};
+
+
+static TestLogState getLogState(const DatabaseWriteLog& log)
+{
+	TestLogState state;
+	for(auto it = log.updated_records.begin(); it != log.updated_records.end(); ++it)
+		state.updated_records[it->first.value()] = it->second;
+	for(auto it = log.deleted_keys.begin(); it != log.deleted_keys.end(); ++it)
+		state.deleted_keys[it->value()] = true;
+	return state;
+}
+
+
+static bool logStatesEqual(const TestLogState& a, const TestLogState& b)
+{
+	return a.updated_records == b.updated_records && a.deleted_keys == b.deleted_keys;
+}
+
+
+void DatabaseWriteLog::test()
+{
+	conPrint("DatabaseWriteLog::test()");
+
+	const std::string log_path = PlatformUtils::getTempDirPath() + "/database_write_log_test.log";
+	const std::string truncated_log_path = PlatformUtils::getTempDirPath() + "/database_write_log_test_truncated.log";
+
+	try
+	{
+		//-------------------------- Test appending, reading back and replay semantics --------------------------
+		{
+			if(FileUtils::fileExists(log_path))
+				FileUtils::deleteFile(log_path);
+
+			PCG32 rng(1);
+			std::vector<uint64> entry_end_offsets; // File size after each entry
+			std::vector<TestLogState> states; // Expected state after each entry
+			{
+				DatabaseWriteLog log;
+				log.open(log_path);
+				testAssert(log.num_entries_read == 0 && !log.hasPendingChanges());
+				testAssert(log.getFileSize() == WRITE_LOG_HEADER_SIZE);
+				entry_end_offsets.push_back(log.getFileSize());
+				states.push_back(getLogState(log));
+
+				for(int i=0; i<300; ++i)
+				{
+					const DatabaseKey key(rng.nextUInt(20));
+					const float r = rng.unitRandom();
+					if(r < 0.8f)
+					{
+						std::vector<uint8> data(rng.nextUInt(200));
+						for(size_t z=0; z<data.size(); ++z)
+							data[z] = (uint8)rng.nextUInt(256);
+						log.appendRecordUpdate(key, ArrayRef<uint8>(data.data(), data.size()));
+					}
+					else
+						log.appendDelete(key);
+
+					entry_end_offsets.push_back(log.getFileSize());
+					states.push_back(getLogState(log));
+				}
+				log.flush();
+			}
+
+			// Check the semantics of the final state: a later update replaces an earlier one, a delete removes the update.
+			{
+				DatabaseWriteLog log;
+				log.open(log_path);
+				testAssert(log.num_entries_read == 300 && log.num_bytes_discarded == 0);
+				testAssert(logStatesEqual(getLogState(log), states.back()));
+
+				const uint8 data[] = { 1, 2, 3 };
+				log.appendRecordUpdate(DatabaseKey(1000), ArrayRef<uint8>(data, 3));
+				testAssert(log.updated_records.count(DatabaseKey(1000)) == 1);
+				log.appendRecordUpdate(DatabaseKey(1000), ArrayRef<uint8>(data, 2));
+				testAssert(log.updated_records[DatabaseKey(1000)].size() == 2);
+				log.appendDelete(DatabaseKey(1000));
+				testAssert(log.updated_records.count(DatabaseKey(1000)) == 0 && log.deleted_keys.count(DatabaseKey(1000)) == 1);
+				log.appendRecordUpdate(DatabaseKey(1000), ArrayRef<uint8>(data, 1));
+				testAssert(log.deleted_keys.count(DatabaseKey(1000)) == 0);
+			}
+
+			//-------------------------- Crash recovery: truncate the log at random byte offsets --------------------------
+			const std::string full_contents = FileUtils::readEntireFile(log_path);
+			for(int trial=0; trial<500; ++trial)
+			{
+				const size_t truncate_offset = (trial == 0) ? 0 : rng.nextUInt((uint32)entry_end_offsets.back() + 1);
+				FileUtils::writeEntireFile(truncated_log_path, full_contents.substr(0, truncate_offset));
+
+				// Find the last entry that is completely before the truncation offset.
+				size_t num_complete_entries = 0;
+				while(num_complete_entries + 1 < entry_end_offsets.size() && entry_end_offsets[num_complete_entries + 1] <= truncate_offset)
+					num_complete_entries++;
+
+				DatabaseWriteLog log;
+				log.open(truncated_log_path);
+				testAssert(log.num_entries_read == num_complete_entries);
+				testAssert(logStatesEqual(getLogState(log), states[num_complete_entries]));
+				if(truncate_offset >= WRITE_LOG_HEADER_SIZE)
+					testAssert(log.num_bytes_discarded == truncate_offset - entry_end_offsets[num_complete_entries]);
+
+				// Appending after recovery should continue from the last valid entry.
+				log.appendDelete(DatabaseKey(12345));
+				log.flush();
+				log.close();
+
+				DatabaseWriteLog log2;
+				log2.open(truncated_log_path);
+				testAssert(log2.num_entries_read == num_complete_entries + 1 && log2.num_bytes_discarded == 0);
+				testAssert(log2.deleted_keys.count(DatabaseKey(12345)) == 1);
+			}
+
+			//-------------------------- Crash recovery: corrupt a byte of an entry --------------------------
+			for(int trial=0; trial<100; ++trial)
+			{
+				const size_t entry_i = rng.nextUInt((uint32)entry_end_offsets.size() - 1); // Index of entry to corrupt
+				const size_t offset = entry_end_offsets[entry_i] + rng.nextUInt((uint32)(entry_end_offsets[entry_i + 1] - entry_end_offsets[entry_i]));
+				std::string corrupted = full_contents;
+				corrupted[offset] = (char)(corrupted[offset] ^ (1 + rng.nextUInt(255)));
+				FileUtils::writeEntireFile(truncated_log_path, corrupted);
+
+				DatabaseWriteLog log;
+				log.open(truncated_log_path);
+				testAssert(log.num_entries_read == entry_i);
+				testAssert(logStatesEqual(getLogState(log), states[entry_i]));
+			}
+
+			//-------------------------- Test reset --------------------------
+			{
+				DatabaseWriteLog log;
+				log.open(log_path);
+				testAssert(log.hasPendingChanges());
+				log.reset();
+				testAssert(!log.hasPendingChanges() && log.getFileSize() == WRITE_LOG_HEADER_SIZE);
+				log.close();
+
+				log.open(log_path);
+				testAssert(log.num_entries_read == 0 && !log.hasPendingChanges());
+			}
+		}
+
+		//-------------------------- Crash recovery of a ServerAllWorldsState, with the log truncated at random offsets --------------------------
+		{
+			const std::string db_path = PlatformUtils::getTempDirPath() + "/database_write_log_test_db.bin";
+			const std::string db_copy_path = PlatformUtils::getTempDirPath() + "/database_write_log_test_db_copy.bin";
+			const std::string resource_dir = PlatformUtils::getTempDirPath() + "/database_write_log_test_resources";
+			FileUtils::createDirIfDoesNotExist(resource_dir);
+
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(resource_dir);
+			world_state->createNewDatabase(db_path);
+
+			PCG32 rng(2);
+			const int NUM_OBS = 100;
+			std::vector<WorldObjectRef> obs;
+			{
+				Lock lock(world_state->mutex);
+				Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+				{
+					Lock world_lock(root_world->mutex);
+					for(int i=0; i<NUM_OBS; ++i)
+					{
+						WorldObjectRef ob = ServerTestUtils::makeTestObject(*world_state, rng);
+						root_world->objects[ob->uid] = ob;
+						root_world->addWorldObjectAsDBDirty(ob);
+						obs.push_back(ob);
+					}
+				}
+				world_state->serialiseToDisk(/*compact write log=*/true); // Write the objects to the main database file.
+			}
+
+			const std::string log_path_for_db = logPathForDatabase(db_path);
+			testAssert(FileUtils::getFileSize(log_path_for_db) == WRITE_LOG_HEADER_SIZE);
+
+			// Do a series of saves, each one moving, editing, or deleting some objects.  Record the state of the objects after each save.
+			std::vector<std::map<uint64, std::pair<Vec3d, std::string>>> saved_states; // For each save, map from object UID to (pos, content), for objects that exist.
+			std::vector<uint64> save_log_sizes;
+			for(int save=0; save<20; ++save)
+			{
+				Lock lock(world_state->mutex);
+				Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+				{
+					Lock world_lock(root_world->mutex);
+					for(int z=0; z<10; ++z)
+					{
+						WorldObjectRef ob = obs[rng.nextUInt((uint32)obs.size())];
+						if(root_world->objects.count(ob->uid) == 0)
+							continue; // Already deleted
+						const float r = rng.unitRandom();
+						if(r < 0.8f) // Move
+						{
+							ob->pos = Vec3d(rng.unitRandom() * 100, rng.unitRandom() * 100, (double)save);
+							root_world->addWorldObjectTransformAsDBDirty(ob);
+						}
+						else if(r < 0.95f) // Edit
+						{
+							ob->content = "content " + toString(save) + " " + toString(z);
+							root_world->addWorldObjectAsDBDirty(ob);
+						}
+						else // Delete
+						{
+							root_world->db_dirty_world_objects.erase(ob);
+							root_world->db_dirty_world_object_transforms.erase(ob);
+							root_world->db_records_to_delete.insert(ob->database_key);
+							root_world->objects.erase(ob->uid);
+						}
+					}
+
+					std::map<uint64, std::pair<Vec3d, std::string>> saved_state;
+					for(auto it = root_world->objects.begin(); it != root_world->objects.end(); ++it)
+						saved_state[it->first.value()] = std::make_pair(it->second->pos, it->second->content);
+					saved_states.push_back(saved_state);
+				}
+				world_state->serialiseToDisk();
+				save_log_sizes.push_back(FileUtils::getFileSize(log_path_for_db));
+			}
+
+			const std::string full_log_contents = FileUtils::readEntireFile(log_path_for_db);
+			testAssert(full_log_contents.size() == save_log_sizes.back());
+			world_state = NULL; // Close database
+
+			for(int trial=0; trial<50; ++trial)
+			{
+				const size_t truncate_offset = (trial == 0) ? full_log_contents.size() : rng.nextUInt((uint32)full_log_contents.size() + 1);
+				FileUtils::copyFile(db_path, db_copy_path);
+				FileUtils::writeEntireFile(logPathForDatabase(db_copy_path), full_log_contents.substr(0, truncate_offset));
+
+				// Find the last save that was completely written before the truncation offset.  -1 if none.
+				int last_complete_save = -1;
+				while(last_complete_save + 1 < (int)save_log_sizes.size() && save_log_sizes[last_complete_save + 1] <= truncate_offset)
+					last_complete_save++;
+
+				Reference<ServerAllWorldsState> loaded_world_state = new ServerAllWorldsState();
+				loaded_world_state->resource_manager = new ResourceManager(resource_dir);
+				loaded_world_state->readFromDisk(db_copy_path);
+
+				{
+					Lock lock(loaded_world_state->mutex);
+					Reference<ServerWorldState> loaded_root = loaded_world_state->getRootWorldState();
+					Lock world_lock(loaded_root->mutex);
+
+					// Each object should have its state from the last complete save, or from the following, partially written save.
+					for(uint64 uid=0; uid<(uint64)NUM_OBS; ++uid)
+					{
+						auto res = loaded_root->objects.find(UID(uid));
+						const bool exists = res != loaded_root->objects.end();
+
+						bool matches_a_state = false;
+						for(int s = last_complete_save; s <= last_complete_save + 1 && s < (int)saved_states.size(); ++s)
+						{
+							if(s == -1)
+								matches_a_state = matches_a_state || exists; // Before the first save, all objects exist.  (Positions are checked in the main db test)
+							else
+							{
+								auto saved_res = saved_states[s].find(uid);
+								if(saved_res == saved_states[s].end())
+									matches_a_state = matches_a_state || !exists;
+								else
+									matches_a_state = matches_a_state || (exists && res->second->pos == saved_res->second.first && res->second->content == saved_res->second.second);
+							}
+						}
+						testAssert(matches_a_state);
+					}
+
+					if(truncate_offset == full_log_contents.size())
+						testAssert(loaded_root->objects.size() == saved_states.back().size());
+				}
+
+				// The log should have been folded into the database on load.
+				testAssert(FileUtils::getFileSize(logPathForDatabase(db_copy_path)) == WRITE_LOG_HEADER_SIZE);
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("DatabaseWriteLog::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,115 @@
+/*=====================================================================
+DatabaseWriteLog.h
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/TimeStamp.h"
+#include <DatabaseKey.h>
+#include <maths/vec3.h>
+#include <utils/ArrayRef.h>
+#include <utils/Platform.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdio>
+class WorldObject;
+class BufferOutStream;
+class BufferViewInStream;
+
+
+// The transform of an object whose full record is already in the database or write log.  Saved in object transform records, see ServerAllWorldsState.
+struct LoggedObjectTransform
+{
+	void setFromObject(const WorldObject& ob);
+	void applyToObject(WorldObject& ob) const;
+
+	// Write and read the transform, not including the key.  readFromStream throws glare::Exception on failure.
+	void writeToStream(BufferOutStream& stream) const;
+	void readFromStream(BufferViewInStream& stream);
+
+	DatabaseKey key; // Database key of the object record.  (When reading transform records in ServerAllWorldsState, the key of the transform record.)
+	Vec3d pos;
+	Vec3f axis;
+	float angle;
+	Vec3f scale;
+	TimeStamp last_modified_time;
+};
+
+
+/*=====================================================================
+DatabaseWriteLog
+----------------
+An append-only log of changes to database records, kept in a file next to
+the main database file.
+
+Writing a change to the main Database rewrites the whole record, which for
+an object includes its content, materials, script and voxel data.  Instead,
+saved batches are appended to this log as a series of entries:
+  * record update: the full record data, for new records and records with changed fields.
+    (Moved objects are saved as small object transform records, so moving an object doesn't
+    log its full record.)
+  * delete: the key of a deleted record.
+
+The changes in the log that haven't been folded into the main database are
+also kept in memory (updated_records etc.)  Every so often the server folds
+them into the main database (see ServerAllWorldsState::compactWriteLog()),
+and the log is reset to empty.
+
+On startup the log is read back, and the changes are replayed over the
+records read from the main database file.
+
+Each entry ends with a checksum.  Reading stops at the first incomplete or
+corrupt entry, so an entry that was being written when the server crashed
+is discarded along with anything after it, and the log is truncated there.
+=====================================================================*/
+class DatabaseWriteLog
+{
+public:
+	DatabaseWriteLog();
+	~DatabaseWriteLog();
+
+	// Opens the log file at path, creating it if it doesn't exist.  Any existing entries are read into the pending changes.
+	// Throws glare::Exception on failure.
+	void open(const std::string& path);
+	void close();
+	bool isOpen() const { return file != NULL; }
+
+	// Append entries to the log, and update the pending changes.  Entries are not guaranteed to be on disk until flush() is called.  Throw glare::Exception on failure.
+	void appendRecordUpdate(const DatabaseKey& key, ArrayRef<uint8> record_data);
+	void appendDelete(const DatabaseKey& key);
+
+	void flush(); // Flushes the log file to disk.  Throws glare::Exception on failure.
+
+	// Clears the pending changes and resets the log file to empty.  Call after the pending record updates and deletes have been written to the main database.
+	void reset();
+
+	bool hasPendingChanges() const { return !updated_records.empty() || !deleted_keys.empty(); }
+	uint64 getFileSize() const { return file_size; }
+
+	static std::string logPathForDatabase(const std::string& database_path) { return database_path + ".log"; }
+
+	static void test();
+
+	// Changes in the log that haven't been folded into the main database yet.  A key is in at most one of updated_records and deleted_keys.
+	std::unordered_map<DatabaseKey, std::vector<uint8>, DatabaseKeyHash> updated_records;
+	std::unordered_set<DatabaseKey, DatabaseKeyHash> deleted_keys;
+
+	size_t num_entries_read; // Number of valid entries read by open().
+	size_t num_bytes_discarded; // Number of bytes at the end of the log discarded by open(), due to an incomplete or corrupt entry.
+
+private:
+	GLARE_DISABLE_COPY(DatabaseWriteLog);
+
+	void writeEntry(uint32 type, const DatabaseKey& key, const uint8* payload, size_t payload_len);
+	void applyRecordUpdate(const DatabaseKey& key, const uint8* data, size_t len);
+	void applyDelete(const DatabaseKey& key);
+
+	std::string path;
+	std::FILE* file;
+	uint64 file_size;
+	std::vector<uint8> entry_buf;
+};
@@ -0,0 +1,221 @@
+/*=====================================================================
+DatabaseWriterThread.cpp
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "DatabaseWriterThread.h"
+
+
+#include <ThreadManager.h>
+#include <PlatformUtils.h>
+#include <ConPrint.h>
+#include <Exception.h>
+
+
+DatabaseWriterThread::DatabaseWriterThread(ServerAllWorldsState* world_state_)
+:	world_state(world_state_)
+{
+}
+
+
+DatabaseWriterThread::~DatabaseWriterThread()
+{
+}
+
+
+void DatabaseWriterThread::enqueueBatch(ServerAllWorldsState* world_state, ThreadManager& thread_manager, const Reference<DatabaseWriteBatch>& batch)
+{
+	world_state->beginPendingDatabaseWrite();
+
+	Reference<WriteDatabaseBatchMessage> msg = new WriteDatabaseBatchMessage();
+	msg->batch = batch;
+	thread_manager.enqueueMessage(msg);
+}
+
+
+void DatabaseWriterThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("DatabaseWriterThread");
+
+	while(1)
+	{
+		// Block until we have a message
+		ThreadMessageRef msg;
+		getMessageQueue().dequeue(msg);
+
+		if(dynamic_cast<WriteDatabaseBatchMessage*>(msg.ptr()))
+		{
+			const WriteDatabaseBatchMessage* write_msg = static_cast<WriteDatabaseBatchMessage*>(msg.ptr());
+			try
+			{
+				world_state->writeBatchToDatabase(*write_msg->batch);
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("DatabaseWriterThread: Warning: saving world state to disk failed: " + e.what());
+			}
+
+			world_state->endPendingDatabaseWrite();
+		}
+		else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+		{
+			// Messages are processed in order, so any batches enqueued before the kill message have been written.
+			return;
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ServerTestUtils.h"
+#include "../shared/ResourceManager.h"
+#include <utils/TestUtils.h>
+#include <utils/FileUtils.h>
+#include <utils/Lock.h>
+#include <maths/PCG32.h>
+
+
+void DatabaseWriterThread::test()
+{
+	conPrint("DatabaseWriterThread::test()");
+
+	const std::string db_path = PlatformUtils::getTempDirPath() + "/database_writer_thread_test.bin";
+	const std::string resource_dir = PlatformUtils::getTempDirPath() + "/database_writer_thread_test_resources";
+	FileUtils::createDirIfDoesNotExist(resource_dir);
+
+	try
+	{
+		//-------------------------- Edit objects while batches are being written by the DatabaseWriterThread --------------------------
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->resource_manager = new ResourceManager(resource_dir);
+		world_state->createNewDatabase(db_path);
+
+		ThreadManager thread_manager;
+		thread_manager.addThread(new DatabaseWriterThread(world_state.ptr()));
+
+		PCG32 rng(1);
+		int num_batches_enqueued = 0;
+		uint32 num_obs_created = 0; // Object UIDs are allocated sequentially from 0.
+
+		{
+			Lock lock(world_state->mutex);
+			Reference<ServerWorldState> root_world = world_state->world_states[""];
+			Lock world_lock(root_world->mutex);
+			for(int i=0; i<1000; ++i)
+			{
+				WorldObjectRef ob = ServerTestUtils::makeTestObject(*world_state, rng);
+				root_world->objects[ob->uid] = ob;
+				root_world->addWorldObjectAsDBDirty(ob);
+				num_obs_created++;
+			}
+		}
+
+		for(int iter=0; iter<200; ++iter)
+		{
+			Reference<DatabaseWriteBatch> batch;
+			{
+				Lock lock(world_state->mutex);
+				Reference<ServerWorldState> root_world = world_state->world_states[""];
+				Lock world_lock(root_world->mutex);
+
+				// Make some edits
+				for(int z=0; z<20; ++z)
+				{
+					const float r = rng.unitRandom();
+					if(r < 0.8f) // Modify an existing object
+					{
+						auto it = root_world->objects.lower_bound(UID(rng.nextUInt(num_obs_created)));
+						if(it != root_world->objects.end())
+						{
+							WorldObject* ob = it->second.ptr();
+							ob->pos = Vec3d(rng.unitRandom() * 100, rng.unitRandom() * 100, (double)iter);
+							ob->content = "content " + toString(iter) + " " + toString(z);
+							root_world->addWorldObjectAsDBDirty(ob);
+						}
+					}
+					else if(r < 0.9f) // Create a new object
+					{
+						WorldObjectRef ob = ServerTestUtils::makeTestObject(*world_state, rng);
+						root_world->objects[ob->uid] = ob;
+						root_world->addWorldObjectAsDBDirty(ob);
+						num_obs_created++;
+					}
+					else // Delete an object, in the same way the main server loop does.
+					{
+						auto it = root_world->objects.lower_bound(UID(rng.nextUInt(num_obs_created)));
+						if(it != root_world->objects.end())
+						{
+							WorldObjectRef ob = it->second;
+							root_world->db_dirty_world_objects.erase(ob);
+							if(ob->database_key.valid())
+								root_world->db_records_to_delete.insert(ob->database_key);
+							root_world->objects.erase(it);
+						}
+					}
+				}
+
+				// Take a snapshot if the writer thread is not busy with a previous batch, as the main server loop does.
+				if(world_state->numPendingDatabaseWrites() == 0)
+					batch = world_state->snapshotDirtyRecords();
+			}
+
+			if(batch.nonNull())
+			{
+				DatabaseWriterThread::enqueueBatch(world_state.ptr(), thread_manager, batch);
+				num_batches_enqueued++;
+			}
+		}
+
+		// Write the final state, and wait for all batches to be written.
+		{
+			Lock lock(world_state->mutex);
+			DatabaseWriterThread::enqueueBatch(world_state.ptr(), thread_manager, world_state->snapshotDirtyRecords());
+			num_batches_enqueued++;
+		}
+		world_state->waitForPendingDatabaseWrites();
+		testAssert(world_state->numPendingDatabaseWrites() == 0);
+		testAssert(num_batches_enqueued >= 2);
+
+		thread_manager.killThreadsBlocking();
+
+		//-------------------------- Load the database from disk, check it matches the in-memory state --------------------------
+		Reference<ServerAllWorldsState> loaded_world_state = new ServerAllWorldsState();
+		loaded_world_state->resource_manager = new ResourceManager(resource_dir);
+		loaded_world_state->readFromDisk(db_path);
+
+		{
+			Lock lock(world_state->mutex);
+			Lock lock2(loaded_world_state->mutex);
+
+			Lock lock3(world_state->world_states[""]->mutex);
+			Lock lock4(loaded_world_state->world_states[""]->mutex);
+
+			const std::map<UID, WorldObjectRef>& obs = world_state->world_states[""]->objects;
+			const std::map<UID, WorldObjectRef>& loaded_obs = loaded_world_state->world_states[""]->objects;
+			testAssert(obs.size() == loaded_obs.size());
+
+			for(auto it = obs.begin(); it != obs.end(); ++it)
+			{
+				auto res = loaded_obs.find(it->first);
+				testAssert(res != loaded_obs.end());
+				testAssert(res->second->pos == it->second->pos);
+				testAssert(res->second->content == it->second->content);
+				testAssert(res->second->database_key.value() == it->second->database_key.value());
+			}
+		}
+
+		//-------------------------- Test the flush barrier with no pending writes --------------------------
+		world_state->waitForPendingDatabaseWrites();
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("DatabaseWriterThread::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,49 @@
+/*=====================================================================
+DatabaseWriterThread.h
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "ServerWorldState.h"
+#include <MessageableThread.h>
+class ThreadManager;
+
+
+class WriteDatabaseBatchMessage : public ThreadMessage
+{
+public:
+	Reference<DatabaseWriteBatch> batch;
+};
+
+
+/*=====================================================================
+DatabaseWriterThread
+--------------------
+Writes snapshots of dirty records (DatabaseWriteBatch) to the database write
+log (or to the database if the log is disabled), and flushes it to disk.
+Batches flagged with compact_write_log also fold the log into the database.  This means the main server loop only has to hold
+the world state mutex while serialising the dirty records, not while doing
+file I/O.
+
+Batches are written in the order they are enqueued.  Any batches enqueued
+before the thread is killed are written before the thread exits.
+=====================================================================*/
+class DatabaseWriterThread : public MessageableThread
+{
+public:
+	DatabaseWriterThread(ServerAllWorldsState* world_state);
+
+	virtual ~DatabaseWriterThread();
+
+	virtual void doRun();
+
+	// Enqueue a batch to be written by the DatabaseWriterThread in thread_manager.
+	static void enqueueBatch(ServerAllWorldsState* world_state, ThreadManager& thread_manager, const Reference<DatabaseWriteBatch>& batch);
+
+	static void test();
+
+private:
+	ServerAllWorldsState* world_state;
+};
@@ -0,0 +1,1131 @@
+/*=====================================================================
+EpollServer.cpp
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "EpollServer.h"
+
+
+#include "Server.h"
+#include "WorkerThread.h"
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+#include <Timer.h>
+#include <TLSSocket.h>
+#include <tls.h>
+#include <openssl/err.h>
+#include <algorithm>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fstream>
+#include <cstdio>
+#endif
+
+
+static const size_t MAX_WORLD_NAME_LEN = 1000; // Same as the limit used by WorkerThread when reading the world name.
+static const size_t RECV_CHUNK_SIZE = 65536;
+
+
+#if defined(__linux__)
+
+
+static void setSocketNonBlocking(int fd, bool non_blocking)
+{
+	const int flags = fcntl(fd, F_GETFL, 0);
+	if(flags == -1)
+		throw glare::Exception("fcntl F_GETFL failed: " + PlatformUtils::getLastErrorString());
+
+	const int new_flags = non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	if(fcntl(fd, F_SETFL, new_flags) == -1)
+		throw glare::Exception("fcntl F_SETFL failed: " + PlatformUtils::getLastErrorString());
+}
+
+
+static void epollControl(int epoll_fd, int op, int fd, uint32 events, void* tag)
+{
+	epoll_event ev;
+	ev.events = events;
+	ev.data.ptr = tag;
+	if(epoll_ctl(epoll_fd, op, fd, &ev) == -1)
+		throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+}
+
+
+static inline uint32 readUInt32FromBuf(const uint8* data)
+{
+	uint32 x;
+	std::memcpy(&x, data, sizeof(uint32));
+	return x;
+}
+
+
+EpollConnection::EpollConnection(MySocketRef plain_socket_, struct tls* tls_context_)
+:	state(State_ReadingHello),
+	plain_socket(plain_socket_),
+	tls_context(tls_context_),
+	fd((int)plain_socket_->getSocketHandle()),
+	recv_buf_used(0),
+	send_buf(SocketBufferOutStream::DontUseNetworkByteOrder),
+	send_buf_offset(0),
+	EPOLLOUT_registered(false),
+	tls_read_wants_write(false),
+	client_protocol_version(0),
+	world_name_len(0)
+{
+	socket_tag.connection = this;
+	socket_tag.is_event_fd = false;
+	event_fd_tag.connection = this;
+	event_fd_tag.is_event_fd = true;
+}
+
+
+EpollConnection::~EpollConnection()
+{
+	if(tls_context)
+	{
+		tls_close(tls_context); // Non-blocking, so may not complete, but that's fine as we are closing the socket anyway.
+		tls_free(tls_context);
+	}
+}
+
+
+EpollLoopThread::EpollLoopThread(Server* server_)
+:	server(server_),
+	should_quit(0),
+	num_connections(0)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd == -1)
+		throw glare::Exception("epoll_create1 failed: " + PlatformUtils::getLastErrorString());
+
+	wake_tag.connection = NULL;
+	wake_tag.is_event_fd = true;
+	epollControl(epoll_fd, EPOLL_CTL_ADD, wake_event_fd.efd, EPOLLIN, &wake_tag);
+}
+
+
+EpollLoopThread::~EpollLoopThread()
+{
+	close(epoll_fd);
+}
+
+
+void EpollLoopThread::kill()
+{
+	should_quit = 1;
+	wake_event_fd.notify();
+}
+
+
+void EpollLoopThread::addConnection(MySocketRef plain_socket, struct tls* tls_context)
+{
+	{
+		Lock lock(pending_mutex);
+		pending_connections.push_back(std::make_pair(plain_socket, tls_context));
+	}
+	wake_event_fd.notify();
+}
+
+
+void EpollLoopThread::addPendingConnections()
+{
+	std::vector<std::pair<MySocketRef, struct tls*>> new_connections;
+	{
+		Lock lock(pending_mutex);
+		new_connections.swap(pending_connections);
+	}
+
+	for(size_t i=0; i<new_connections.size(); ++i)
+	{
+		Reference<EpollConnection> conn = new EpollConnection(new_connections[i].first, new_connections[i].second); // Takes ownership of the TLS context.
+		try
+		{
+			epollControl(epoll_fd, EPOLL_CTL_ADD, conn->fd, EPOLLIN, &conn->socket_tag);
+			connections[conn.ptr()] = conn;
+			num_connections++;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("EpollLoopThread: failed to add connection: " + e.what());
+		}
+	}
+}
+
+
+size_t EpollLoopThread::readSome(EpollConnection* conn, void* buf, size_t max_len)
+{
+	if(conn->tls_context)
+	{
+		conn->tls_read_wants_write = false;
+		const ssize_t res = tls_read(conn->tls_context, buf, max_len);
+		if(res == TLS_WANT_POLLIN)
+			return 0;
+		if(res == TLS_WANT_POLLOUT)
+		{
+			conn->tls_read_wants_write = true;
+			return 0;
+		}
+		if(res == -1)
+			throw MySocketExcep("tls_read failed: " + getTLSErrorString(conn->tls_context));
+		if(res == 0)
+			throw MySocketExcep("Connection closed gracefully.", MySocketExcep::ExcepType_ConnectionClosedGracefully);
+		return (size_t)res;
+	}
+	else
+	{
+		const ssize_t res = ::recv(conn->fd, buf, max_len, 0);
+		if(res == -1)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return 0;
+			throw MySocketExcep("recv failed: " + PlatformUtils::getLastErrorString());
+		}
+		if(res == 0)
+			throw MySocketExcep("Connection closed gracefully.", MySocketExcep::ExcepType_ConnectionClosedGracefully);
+		return (size_t)res;
+	}
+}
+
+
+size_t EpollLoopThread::writeSome(EpollConnection* conn, const void* data, size_t len)
+{
+	if(conn->tls_context)
+	{
+		const ssize_t res = tls_write(conn->tls_context, data, len);
+		if(res == TLS_WANT_POLLIN || res == TLS_WANT_POLLOUT)
+			return 0;
+		if(res == -1)
+			throw MySocketExcep("tls_write failed: " + getTLSErrorString(conn->tls_context));
+		return (size_t)res;
+	}
+	else
+	{
+		const ssize_t res = ::send(conn->fd, data, len, MSG_NOSIGNAL);
+		if(res == -1)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return 0;
+			throw MySocketExcep("send failed: " + PlatformUtils::getLastErrorString());
+		}
+		return (size_t)res;
+	}
+}
+
+
+void EpollLoopThread::setWriteInterest(EpollConnection* conn, bool want_write)
+{
+	if(conn->EPOLLOUT_registered != want_write)
+	{
+		epollControl(epoll_fd, EPOLL_CTL_MOD, conn->fd, want_write ? (EPOLLIN | EPOLLOUT) : EPOLLIN, &conn->socket_tag);
+		conn->EPOLLOUT_registered = want_write;
+	}
+}
+
+
+// Write as much of the send buffer as the socket will take.  If not all of it could be written, wait for the socket to become writable.
+void EpollLoopThread::sendPendingData(EpollConnection* conn)
+{
+	js::Vector<uint8, 16>& buf = conn->send_buf.buf;
+	while(conn->send_buf_offset < buf.size())
+	{
+		const size_t num_written = writeSome(conn, buf.data() + conn->send_buf_offset, buf.size() - conn->send_buf_offset);
+		if(num_written == 0)
+			break;
+		conn->send_buf_offset += num_written;
+	}
+
+	if(conn->send_buf_offset == buf.size())
+	{
+		buf.resize(0);
+		conn->send_buf_offset = 0;
+	}
+	else if(conn->send_buf_offset >= RECV_CHUNK_SIZE)
+	{
+		// Remove the data that has been sent from the front of the buffer, so it doesn't grow without bound.
+		const size_t remaining = buf.size() - conn->send_buf_offset;
+		std::memmove(buf.data(), buf.data() + conn->send_buf_offset, remaining);
+		buf.resize(remaining);
+		conn->send_buf_offset = 0;
+	}
+
+	// If we left packets in the send queue because the send buffer was full, wait for the socket to become writable so we can take them.
+	const bool packets_left_in_queue = conn->worker.nonNull() && !conn->worker->send_queue.empty();
+
+	setWriteInterest(conn, /*want write=*/(conn->send_buf_offset < buf.size()) || conn->tls_read_wants_write || packets_left_in_queue);
+}
+
+
+// Handles the handshake data at the front of the received data.  Only the bytes needed for the current state are consumed.
+// Returns the number of bytes consumed, or 0 if more data is needed.
+size_t EpollLoopThread::processHandshakeData(EpollConnection* conn, const uint8* data, size_t size)
+{
+	switch(conn->state)
+	{
+	case EpollConnection::State_ReadingHello:
+		{
+			if(size < sizeof(uint32))
+				return 0;
+			const uint32 hello = readUInt32FromBuf(data);
+			if(hello != Protocol::CyberspaceHello)
+				throw glare::Exception("Received invalid hello message (" + toString(hello) + ") from client.");
+
+			conn->send_buf.writeUInt32(Protocol::CyberspaceHello); // Write hello response
+			conn->state = EpollConnection::State_ReadingProtocolVersion;
+			return sizeof(uint32);
+		}
+	case EpollConnection::State_ReadingProtocolVersion:
+		{
+			if(size < sizeof(uint32))
+				return 0;
+			conn->client_protocol_version = readUInt32FromBuf(data);
+			if(conn->client_protocol_version < 38) // We can't handle protocol versions < 38.  See WorkerThread::readHandshake().
+			{
+				conn->send_buf.writeUInt32(Protocol::ClientProtocolTooOld);
+				conn->send_buf.writeStringLengthFirst("Sorry, your Substrata client is too old. Please download and install an updated client from https://substrata.info/.");
+			}
+			else
+				conn->send_buf.writeUInt32(Protocol::ClientProtocolOK);
+
+			conn->send_buf.writeUInt32(Protocol::CyberspaceProtocolVersion);
+			conn->state = EpollConnection::State_ReadingConnectionType;
+			return sizeof(uint32);
+		}
+	case EpollConnection::State_ReadingConnectionType:
+		{
+			if(size < sizeof(uint32))
+				return 0;
+			const uint32 connection_type = readUInt32FromBuf(data);
+			if(connection_type == Protocol::ConnectionTypeUpdates)
+				conn->state = EpollConnection::State_ReadingWorldNameLength;
+			else
+				handOffToWorkerThread(conn, connection_type);
+			return sizeof(uint32);
+		}
+	case EpollConnection::State_ReadingWorldNameLength:
+		{
+			if(size < sizeof(uint32))
+				return 0;
+			conn->world_name_len = readUInt32FromBuf(data);
+			if(conn->world_name_len > MAX_WORLD_NAME_LEN)
+				throw glare::Exception("World name too long: " + toString(conn->world_name_len));
+			conn->state = EpollConnection::State_ReadingWorldName;
+			return sizeof(uint32);
+		}
+	case EpollConnection::State_ReadingWorldName:
+		{
+			if(size < conn->world_name_len)
+				return 0;
+			const std::string world_name((const char*)data, conn->world_name_len);
+
+			conn->worker = new WorkerThread(SocketInterfaceRef(), server);
+			conn->worker->nonblocking_send_buf = &conn->send_buf;
+			conn->worker->epoll_client_ip_addr = conn->plain_socket->getOtherEndIPAddress();
+			conn->worker->setHandshakeAlreadyDone(conn->client_protocol_version, Protocol::ConnectionTypeUpdates, /*unsent_handshake_data=*/NULL, /*unsent_handshake_data_len=*/0);
+			conn->state = EpollConnection::State_Updates;
+
+			conn->worker->connectToWorld(world_name);
+
+			// Packets may already have been enqueued on the worker before it was added to the epoll set, but the event fd will still be signalled, so they will be sent.
+			epollControl(epoll_fd, EPOLL_CTL_ADD, conn->worker->event_fd.efd, EPOLLIN, &conn->event_fd_tag);
+			{
+				Lock lock(server->epoll_clients_mutex);
+				server->epoll_clients.insert(conn->worker.ptr());
+			}
+			return conn->world_name_len;
+		}
+	default:
+		assert(0);
+		return 0;
+	}
+}
+
+
+// Handles all complete handshake fields and messages in the receive buffer, then removes them from the buffer.
+void EpollLoopThread::processReceivedData(EpollConnection* conn)
+{
+	size_t pos = 0;
+	while(conn->state != EpollConnection::State_HandedOff && conn->state != EpollConnection::State_Closed)
+	{
+		const uint8* data = conn->recv_buf.data() + pos;
+		const size_t available = conn->recv_buf_used - pos;
+
+		if(conn->state == EpollConnection::State_Updates)
+		{
+			if(available < sizeof(uint32) * 2)
+				break;
+
+			const uint32 msg_type = readUInt32FromBuf(data);
+			const uint32 msg_len = readUInt32FromBuf(data + sizeof(uint32)); // Length of message, including the message type and length fields.
+
+			if((msg_len < sizeof(uint32) * 2) || (msg_len > WorkerThread::MAX_MESSAGE_LEN))
+				throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+			if(available < msg_len)
+				break;
+
+			WorkerThread* worker = conn->worker.ptr();
+			worker->msg_buffer.buf.resizeNoCopy(msg_len);
+			std::memcpy(worker->msg_buffer.buf.data(), data, msg_len);
+			worker->msg_buffer.read_index = sizeof(uint32) * 2;
+			pos += msg_len;
+
+			worker->handleUpdatesMessage(msg_type);
+
+			if(worker->received_goodbye)
+				break;
+		}
+		else
+		{
+			const size_t consumed = processHandshakeData(conn, data, available);
+			if(consumed == 0)
+				break;
+			pos += consumed;
+		}
+	}
+
+	if(pos > 0)
+	{
+		std::memmove(conn->recv_buf.data(), conn->recv_buf.data() + pos, conn->recv_buf_used - pos);
+		conn->recv_buf_used -= pos;
+	}
+}
+
+
+void EpollLoopThread::readFromSocket(EpollConnection* conn)
+{
+	// Keep reading until the read would block.  Note that for TLS connections, there may be decrypted data buffered in the TLS context even if the socket is not readable,
+	// so we can't leave data unread and rely on epoll to tell us about it later.
+	while(conn->state != EpollConnection::State_HandedOff && conn->state != EpollConnection::State_Closed)
+	{
+		size_t max_read;
+		if(conn->state == EpollConnection::State_Updates)
+			max_read = RECV_CHUNK_SIZE;
+		else // During the handshake, only read the bytes needed for the current field, so we don't read data that should go to a WorkerThread the connection is handed off to.
+			max_read = ((conn->state == EpollConnection::State_ReadingWorldName) ? conn->world_name_len : sizeof(uint32)) - conn->recv_buf_used;
+
+		if(max_read > 0)
+		{
+			if(conn->recv_buf.size() < conn->recv_buf_used + max_read)
+				conn->recv_buf.resize(conn->recv_buf_used + max_read);
+
+			const size_t num_read = readSome(conn, conn->recv_buf.data() + conn->recv_buf_used, max_read);
+			if(num_read == 0)
+				break;
+			conn->recv_buf_used += num_read;
+		}
+
+		processReceivedData(conn);
+
+		if(conn->worker.nonNull() && conn->worker->received_goodbye)
+		{
+			conPrint("EpollLoopThread: received CyberspaceGoodbye, closing connection.");
+			sendPendingData(conn);
+			closeConnection(conn);
+			return;
+		}
+	}
+}
+
+
+void EpollLoopThread::handleSocketEvent(EpollConnection* conn, uint32 events)
+{
+	if((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) || conn->tls_read_wants_write)
+		readFromSocket(conn); // A closed connection or socket error will be reported by the read.
+
+	if(conn->state != EpollConnection::State_HandedOff && conn->state != EpollConnection::State_Closed)
+	{
+		if(conn->worker.nonNull())
+			takePacketsFromSendQueue(conn); // The socket may have become writable, in which case we may have room for packets we left in the send queue.
+		sendPendingData(conn);
+	}
+}
+
+
+// Moves packets from the worker's send queue into the connection send buffer.
+// While the socket is not keeping up, packets are left in the send queue, where superseded transform updates can be coalesced.
+void EpollLoopThread::takePacketsFromSendQueue(EpollConnection* conn)
+{
+	WorkerThread* worker = conn->worker.ptr();
+
+	if(worker->send_queue.hasOverflowed())
+		throw glare::Exception("Send queue for client went over the hard limit, disconnecting slow client.");
+
+	if(conn->send_buf.buf.size() - conn->send_buf_offset >= PacketSendQueue::GATHER_BUF_SIZE)
+		return;
+
+	worker->send_queue.takePackets(temp_packets);
+	if(!temp_packets.empty())
+	{
+		PacketSendQueue::writePackets(temp_packets, conn->send_buf, gather_buf);
+		temp_packets.clear();
+	}
+}
+
+
+// The worker's event fd was signalled, which means packets have been enqueued to send to the client.
+void EpollLoopThread::handleEventFDEvent(EpollConnection* conn)
+{
+	conn->worker->event_fd.read();
+
+	takePacketsFromSendQueue(conn);
+
+	sendPendingData(conn);
+}
+
+
+// Non-update connections (resource uploads etc.) are handled by a WorkerThread thread with blocking socket IO, as before.
+void EpollLoopThread::handOffToWorkerThread(EpollConnection* conn, uint32 connection_type)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+	setSocketNonBlocking(conn->fd, false);
+
+	SocketInterfaceRef use_socket = conn->plain_socket;
+	if(conn->tls_context)
+	{
+		use_socket = new TLSSocket(conn->plain_socket, conn->tls_context); // TLSSocket takes ownership of the TLS context.
+		conn->tls_context = NULL;
+	}
+
+	// Any handshake responses that haven't been sent yet are written by the worker thread, so a slow client can't block this loop thread.
+	Reference<WorkerThread> worker_thread = new WorkerThread(use_socket, server);
+	worker_thread->setHandshakeAlreadyDone(conn->client_protocol_version, connection_type, conn->send_buf.buf.data() + conn->send_buf_offset, conn->send_buf.buf.size() - conn->send_buf_offset);
+	conn->send_buf.buf.clear();
+	conn->send_buf_offset = 0;
+	server->worker_thread_manager.addThread(worker_thread);
+
+	conn->state = EpollConnection::State_HandedOff;
+	conn->plain_socket = NULL;
+
+	auto res = connections.find(conn);
+	if(res != connections.end())
+	{
+		closed_connections.push_back(res->second);
+		connections.erase(res);
+		num_connections--;
+	}
+}
+
+
+void EpollLoopThread::closeConnection(EpollConnection* conn)
+{
+	if(conn->state == EpollConnection::State_Closed)
+		return;
+
+	if(conn->state != EpollConnection::State_HandedOff)
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+
+	if(conn->worker.nonNull())
+	{
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->worker->event_fd.efd, NULL); // May fail if connectToWorld() threw, which is fine.
+		{
+			Lock lock(server->epoll_clients_mutex);
+			server->epoll_clients.erase(conn->worker.ptr());
+		}
+
+		// Note that we want to do this on broken connections etc. as well, so the avatar is removed.
+		conn->worker->connectionClosed();
+		conn->worker->nonblocking_send_buf = NULL;
+	}
+
+	conn->state = EpollConnection::State_Closed;
+
+	auto res = connections.find(conn);
+	if(res != connections.end())
+	{
+		closed_connections.push_back(res->second);
+		connections.erase(res);
+		num_connections--;
+	}
+}
+
+
+void EpollLoopThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("EpollLoopThread");
+
+	std::vector<epoll_event> events(256);
+
+	while(!should_quit)
+	{
+		const int num_events = epoll_wait(epoll_fd, events.data(), (int)events.size(), /*timeout=*/-1);
+		if(num_events == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			conPrint("EpollLoopThread: epoll_wait failed: " + PlatformUtils::getLastErrorString());
+			break;
+		}
+
+		for(int i=0; i<num_events; ++i)
+		{
+			const EpollConnection::EpollTag* tag = (const EpollConnection::EpollTag*)events[i].data.ptr;
+			if(tag == &wake_tag)
+			{
+				wake_event_fd.read();
+				addPendingConnections();
+				continue;
+			}
+
+			EpollConnection* conn = tag->connection;
+			if(conn->state == EpollConnection::State_HandedOff || conn->state == EpollConnection::State_Closed) // If connection was closed while handling an earlier event in this batch:
+				continue;
+
+			bool close_connection = false;
+			try
+			{
+				if(tag->is_event_fd)
+					handleEventFDEvent(conn);
+				else
+					handleSocketEvent(conn, events[i].events);
+			}
+			catch(MySocketExcep& e)
+			{
+				if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
+					conPrint("Updates client from " + IPAddress::formatIPAddressAndPort(conn->plain_socket->getOtherEndIPAddress(), conn->plain_socket->getOtherEndPort()) + " closed connection gracefully.");
+				else
+					conPrint("Socket error: " + e.what());
+				close_connection = true;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("EpollLoopThread: glare::Exception: " + e.what());
+				close_connection = true;
+			}
+			catch(std::bad_alloc&)
+			{
+				conPrint("EpollLoopThread: Caught std::bad_alloc.");
+				close_connection = true;
+			}
+
+			if(close_connection)
+				closeConnection(conn);
+		}
+
+		closed_connections.clear(); // No more events in this batch can refer to these connections, so free them.
+	}
+
+	while(!connections.empty())
+		closeConnection(connections.begin()->first);
+	closed_connections.clear();
+
+	ERR_remove_thread_state(/*thread id=*/NULL); // Remove thread-local OpenSSL error state, to avoid leaking it.
+}
+
+
+#endif // defined(__linux__)
+
+
+EpollListenerThread::EpollListenerThread(int listenport_, Server* server_, struct tls_config* tls_configuration_, int num_loop_threads_)
+:	listenport(listenport_), server(server_), tls_configuration(tls_configuration_), num_loop_threads(num_loop_threads_), should_quit(0)
+{
+}
+
+
+EpollListenerThread::~EpollListenerThread()
+{
+}
+
+
+void EpollListenerThread::kill()
+{
+	should_quit = 1;
+	quit_event_fd.notify();
+}
+
+
+void EpollListenerThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("EpollListenerThread");
+
+#if defined(__linux__)
+	ThreadManager loop_thread_manager;
+	std::vector<Reference<EpollLoopThread>> loop_threads;
+	struct tls* tls_context = NULL;
+	try
+	{
+		MySocketRef sock;
+
+		const int MAX_NUM_ATTEMPTS = 600;
+		bool bound = false;
+		for(int i=0; (i<MAX_NUM_ATTEMPTS) && !should_quit; ++i)
+		{
+			sock = new MySocket();
+			try
+			{
+				sock->bindAndListen(listenport, /*reuse address=*/true);
+				bound = true;
+				break;
+			}
+			catch(MySocketExcep& e)
+			{
+				conPrint("bindAndListen failed: " + e.what() + ", waiting and retrying...");
+				PlatformUtils::Sleep(5000);
+			}
+		}
+
+		if(bound)
+			conPrint("EpollListenerThread: Successfully bound and listening on port " + toString(listenport));
+		else
+			throw MySocketExcep("Failed to bind and listen.");
+
+		if(tls_configuration)
+		{
+			tls_context = tls_server();
+			if(!tls_context)
+				throw glare::Exception("Failed to create tls_context.");
+			if(tls_configure(tls_context, tls_configuration) == -1)
+				throw glare::Exception("tls_configure failed: " + getTLSErrorString(tls_context));
+		}
+
+		for(int i=0; i<myMax(1, num_loop_threads); ++i)
+		{
+			loop_threads.push_back(new EpollLoopThread(server));
+			loop_thread_manager.addThread(loop_threads.back());
+		}
+
+		size_t next_loop_thread = 0;
+		while(!should_quit)
+		{
+			if(!sock->readable(quit_event_fd)) // Block until there is a connection to accept, or the quit event fd is signalled.
+				continue;
+
+			try
+			{
+				MySocketRef plain_worker_sock = sock->acceptConnection();
+				plain_worker_sock->setUseNetworkByteOrder(false);
+
+				conPrint("Client connected from " + IPAddress::formatIPAddressAndPort(plain_worker_sock->getOtherEndIPAddress(), plain_worker_sock->getOtherEndPort()));
+
+				plain_worker_sock->enableTCPKeepAlive(30.f); // Some connections seem to get stuck doing nothing for long periods, so enable keepalive to kill them.
+				plain_worker_sock->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
+
+				setSocketNonBlocking((int)plain_worker_sock->getSocketHandle(), true);
+
+				struct tls* worker_tls_context = NULL;
+				if(tls_context)
+				{
+					if(tls_accept_socket(tls_context, &worker_tls_context, (int)plain_worker_sock->getSocketHandle()) != 0)
+						throw glare::Exception("tls_accept_socket failed: " + getTLSErrorString(tls_context));
+				}
+
+				loop_threads[next_loop_thread % loop_threads.size()]->addConnection(plain_worker_sock, worker_tls_context);
+				next_loop_thread++;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("EpollListenerThread: caught exception: " + e.what());
+			}
+		}
+	}
+	catch(MySocketExcep& e)
+	{
+		conPrint("EpollListenerThread: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("EpollListenerThread glare::Exception: " + e.what());
+	}
+
+	loop_thread_manager.killThreadsBlocking();
+
+	if(tls_context != NULL)
+		tls_free(tls_context);
+#else
+	conPrint("EpollListenerThread: epoll is only supported on Linux.");
+#endif
+
+	conPrint("EpollListenerThread terminated.");
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <BufferInStream.h>
+
+
+#if defined(__linux__)
+
+
+static const int TEST_PORT = 7610;
+
+
+// Connects to the server and does the handshake for an update connection, as the client does in ClientThread.
+static MySocketRef connectTestClient(int port, const std::string& world_name)
+{
+	MySocketRef socket = new MySocket("localhost", port);
+	socket->setUseNetworkByteOrder(false);
+	socket->setNoDelayEnabled(true);
+
+	socket->writeUInt32(Protocol::CyberspaceHello);
+	socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+	socket->writeUInt32(Protocol::ConnectionTypeUpdates);
+	socket->writeStringLengthFirst(world_name);
+
+	testAssert(socket->readUInt32() == Protocol::CyberspaceHello);
+	testAssert(socket->readUInt32() == Protocol::ClientProtocolOK);
+	testAssert(socket->readUInt32() == Protocol::CyberspaceProtocolVersion);
+	readUIDFromStream(*socket); // Read client avatar UID
+	return socket;
+}
+
+
+// Reads messages from the socket until one with the given type is read.  The message is left in msg_buffer.
+static void readUntilMessageType(MySocketRef& socket, uint32 wanted_msg_type, BufferInStream& msg_buffer)
+{
+	while(1)
+	{
+		const uint32 msg_type = socket->readUInt32();
+		const uint32 msg_len = socket->readUInt32();
+		testAssert(msg_len >= sizeof(uint32) * 2 && msg_len <= WorkerThread::MAX_MESSAGE_LEN);
+
+		msg_buffer.buf.resizeNoCopy(msg_len);
+		msg_buffer.read_index = sizeof(uint32) * 2;
+		std::memcpy(msg_buffer.buf.data(), &msg_type, sizeof(uint32));
+		std::memcpy(msg_buffer.buf.data() + sizeof(uint32), &msg_len, sizeof(uint32));
+		socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2);
+
+		if(msg_type == wanted_msg_type)
+			return;
+	}
+}
+
+
+static SharedPacketRef makeAdminMessagePacket(const std::string& msg)
+{
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	MessageUtils::initPacket(packet, Protocol::ServerAdminMessageID);
+	packet.writeStringLengthFirst(msg);
+	MessageUtils::updatePacketLengthField(packet);
+	return SharedPacket::make(packet);
+}
+
+
+static size_t numEpollClients(Server& server)
+{
+	Lock lock(server.epoll_clients_mutex);
+	return server.epoll_clients.size();
+}
+
+
+static void waitForNumEpollClients(Server& server, size_t target_num)
+{
+	Timer timer;
+	while(numEpollClients(server) != target_num)
+	{
+		testAssert(timer.elapsed() < 10.0);
+		PlatformUtils::Sleep(1);
+	}
+}
+
+
+// Returns resident set size of this process in bytes.
+static size_t getProcessRSS()
+{
+	std::ifstream file("/proc/self/status");
+	std::string line;
+	size_t rss_kb;
+	while(std::getline(file, line))
+		if(sscanf(line.c_str(), "VmRSS: %zu kB", &rss_kb) == 1)
+			return rss_kb * 1024;
+	return 0;
+}
+
+
+static int getProcessNumThreads()
+{
+	std::ifstream file("/proc/self/status");
+	std::string line;
+	int num_threads;
+	while(std::getline(file, line))
+		if(sscanf(line.c_str(), "Threads: %d", &num_threads) == 1)
+			return num_threads;
+	return 0;
+}
+
+
+struct BenchClient
+{
+	MySocketRef socket;
+	js::Vector<uint8, 16> buf;
+	size_t buf_used;
+	bool got_message;
+};
+
+
+// Measures server memory use and broadcast message latency with num_clients update connections, for either the thread-per-client model or the epoll model.
+// The clients are in this process, but their memory use is the same for both models.
+static void benchmarkConnectionModel(bool use_epoll, int num_clients, int port)
+{
+	conPrint("---------------------- " + std::string(use_epoll ? "epoll" : "thread-per-client") + ", " + toString(num_clients) + " clients ----------------------");
+
+	// Make sure we can open enough sockets.  Each connection uses 2 fds in this process, plus an event fd for the WorkerThread.
+	rlimit limit;
+	if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	Server server;
+
+	const size_t rss_before = getProcessRSS();
+	const int num_threads_before = getProcessNumThreads();
+
+	ThreadManager listener_thread_manager;
+	MySocketRef listener_socket;
+	if(use_epoll)
+	{
+		listener_thread_manager.addThread(new EpollListenerThread(port, &server, /*tls_configuration=*/NULL, /*num loop threads=*/4));
+		PlatformUtils::Sleep(100); // Wait for listener to bind
+	}
+	else
+	{
+		listener_socket = new MySocket();
+		listener_socket->bindAndListen(port, /*reuse address=*/true);
+	}
+
+	std::vector<BenchClient> clients(num_clients);
+	Timer connect_timer;
+	for(int i=0; i<num_clients; ++i)
+	{
+		MySocketRef socket = new MySocket("localhost", port);
+		socket->setUseNetworkByteOrder(false);
+		socket->setNoDelayEnabled(true);
+
+		if(!use_epoll)
+		{
+			// Accept the connection as ListenerThread does.
+			MySocketRef plain_worker_sock = listener_socket->acceptConnection();
+			plain_worker_sock->setUseNetworkByteOrder(false);
+			server.worker_thread_manager.addThread(new WorkerThread(plain_worker_sock, &server));
+		}
+
+		socket->writeUInt32(Protocol::CyberspaceHello);
+		socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+		socket->writeUInt32(Protocol::ConnectionTypeUpdates);
+		socket->writeStringLengthFirst("");
+
+		testAssert(socket->readUInt32() == Protocol::CyberspaceHello);
+		testAssert(socket->readUInt32() == Protocol::ClientProtocolOK);
+		testAssert(socket->readUInt32() == Protocol::CyberspaceProtocolVersion);
+		readUIDFromStream(*socket); // Read client avatar UID
+
+		setSocketNonBlocking((int)socket->getSocketHandle(), true);
+
+		clients[i].socket = socket;
+		clients[i].buf_used = 0;
+		clients[i].got_message = false;
+	}
+	conPrint("Connected " + toString(num_clients) + " clients in " + connect_timer.elapsedStringNPlaces(3));
+
+	PlatformUtils::Sleep(1000); // Let the server finish sending the initial state.
+
+	const size_t rss_after = getProcessRSS();
+	const int num_threads_after = getProcessNumThreads();
+
+	// Use epoll on the client side too, so we can see when each client receives the message.
+	const int client_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	testAssert(client_epoll_fd != -1);
+	for(int i=0; i<num_clients; ++i)
+	{
+		epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = (uint64)i;
+		testAssert(epoll_ctl(client_epoll_fd, EPOLL_CTL_ADD, (int)clients[i].socket->getSocketHandle(), &ev) == 0);
+	}
+
+	std::vector<double> latencies;
+	std::vector<epoll_event> events(1024);
+	const int NUM_ROUNDS = 10;
+	for(int r=0; r<NUM_ROUNDS; ++r)
+	{
+		for(int i=0; i<num_clients; ++i)
+			clients[i].got_message = false;
+		int num_remaining = num_clients;
+
+		Timer timer;
+		server.enqueuePacketToAllClients(makeAdminMessagePacket("round " + toString(r)));
+
+		while(num_remaining > 0)
+		{
+			const int num_events = epoll_wait(client_epoll_fd, events.data(), (int)events.size(), /*timeout ms=*/10000);
+			testAssert(num_events > 0);
+			for(int e=0; e<num_events; ++e)
+			{
+				BenchClient& client = clients[events[e].data.u64];
+				while(1)
+				{
+					if(client.buf.size() < client.buf_used + 4096)
+						client.buf.resize(client.buf_used + 4096);
+					const ssize_t res = ::recv((int)client.socket->getSocketHandle(), client.buf.data() + client.buf_used, client.buf.size() - client.buf_used, 0);
+					if(res <= 0)
+						break;
+					client.buf_used += res;
+				}
+
+				// Parse complete messages
+				size_t pos = 0;
+				while(client.buf_used - pos >= sizeof(uint32) * 2)
+				{
+					const uint32 msg_type = readUInt32FromBuf(client.buf.data() + pos);
+					const uint32 msg_len = readUInt32FromBuf(client.buf.data() + pos + sizeof(uint32));
+					testAssert(msg_len >= sizeof(uint32) * 2);
+					if(client.buf_used - pos < msg_len)
+						break;
+					if(msg_type == Protocol::ServerAdminMessageID && !client.got_message)
+					{
+						latencies.push_back(timer.elapsed());
+						client.got_message = true;
+						num_remaining--;
+					}
+					pos += msg_len;
+				}
+				std::memmove(client.buf.data(), client.buf.data() + pos, client.buf_used - pos);
+				client.buf_used -= pos;
+			}
+		}
+	}
+	close(client_epoll_fd);
+
+	std::sort(latencies.begin(), latencies.end());
+	conPrint("Server RSS increase:  " + doubleToStringNSigFigs((double)(rss_after - rss_before) / (1 << 20), 4) + " MB (" +
+		doubleToStringNSigFigs((double)(rss_after - rss_before) / num_clients / 1024, 4) + " KB per client)");
+	conPrint("Num threads:          " + toString(num_threads_after - num_threads_before));
+	conPrint("Broadcast latency p50: " + doubleToStringNSigFigs(latencies[latencies.size() / 2] * 1.0e3, 4) + " ms");
+	conPrint("Broadcast latency p99: " + doubleToStringNSigFigs(latencies[latencies.size() * 99 / 100] * 1.0e3, 4) + " ms");
+	conPrint("Broadcast latency max: " + doubleToStringNSigFigs(latencies.back() * 1.0e3, 4) + " ms");
+
+	clients.clear(); // Close client sockets, so the server side threads and connections finish.
+	listener_thread_manager.killThreadsBlocking();
+	server.worker_thread_manager.killThreadsBlocking();
+}
+
+
+#endif // defined(__linux__)
+
+
+void EpollListenerThread::test()
+{
+	conPrint("EpollListenerThread::test()");
+
+#if defined(__linux__)
+	{
+		Server server;
+
+		ThreadManager thread_manager;
+		thread_manager.addThread(new EpollListenerThread(TEST_PORT, &server, /*tls_configuration=*/NULL, /*num loop threads=*/2));
+		PlatformUtils::Sleep(100); // Wait for listener to bind
+
+		BufferInStream msg_buffer;
+
+		//------------------ Test update connections get the initial state, and broadcast messages ------------------
+		{
+			std::vector<MySocketRef> clients;
+			for(int i=0; i<8; ++i)
+				clients.push_back(connectTestClient(TEST_PORT, ""));
+
+			for(size_t i=0; i<clients.size(); ++i)
+				readUntilMessageType(clients[i], Protocol::WorldSettingsInitialSendMessage, msg_buffer);
+
+			waitForNumEpollClients(server, clients.size());
+
+			server.enqueuePacketToAllClients(makeAdminMessagePacket("hello clients"));
+
+			for(size_t i=0; i<clients.size(); ++i)
+			{
+				readUntilMessageType(clients[i], Protocol::ServerAdminMessageID, msg_buffer);
+				testAssert(msg_buffer.readStringLengthFirst(1000) == "hello clients");
+			}
+
+			// Test a request that gets a direct response.  There are no objects in the world, so we should just get AllObjectsSent.
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			MessageUtils::initPacket(packet, Protocol::GetAllObjects);
+			MessageUtils::updatePacketLengthField(packet);
+			clients[3]->writeData(packet.buf.data(), packet.buf.size());
+			readUntilMessageType(clients[3], Protocol::AllObjectsSent, msg_buffer);
+
+			// Test several messages written at once are all handled.
+			SocketBufferOutStream packets(SocketBufferOutStream::DontUseNetworkByteOrder);
+			for(int i=0; i<3; ++i)
+				packets.writeData(packet.buf.data(), packet.buf.size());
+			clients[4]->writeData(packets.buf.data(), packets.buf.size());
+			for(int i=0; i<3; ++i)
+				readUntilMessageType(clients[4], Protocol::AllObjectsSent, msg_buffer);
+
+			// Test goodbye closes the connection
+			MessageUtils::initPacket(packet, Protocol::CyberspaceGoodbye);
+			MessageUtils::updatePacketLengthField(packet);
+			clients[0]->writeData(packet.buf.data(), packet.buf.size());
+			waitForNumEpollClients(server, clients.size() - 1);
+
+			// Test clients closing their connections are removed.
+			clients.clear();
+			waitForNumEpollClients(server, 0);
+		}
+
+		//------------------ Test an invalid world name closes the connection ------------------
+		{
+			MySocketRef socket = new MySocket("localhost", TEST_PORT);
+			socket->setUseNetworkByteOrder(false);
+			socket->writeUInt32(Protocol::CyberspaceHello);
+			socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+			socket->writeUInt32(Protocol::ConnectionTypeUpdates);
+			socket->writeStringLengthFirst("no_such_world");
+
+			testAssert(socket->readUInt32() == Protocol::CyberspaceHello);
+			testAssert(socket->readUInt32() == Protocol::ClientProtocolOK);
+			testAssert(socket->readUInt32() == Protocol::CyberspaceProtocolVersion);
+			try
+			{
+				socket->readUInt32();
+				failTest("Expected connection to be closed.");
+			}
+			catch(MySocketExcep&)
+			{}
+			testAssert(numEpollClients(server) == 0);
+		}
+
+		//------------------ Test an invalid hello closes the connection ------------------
+		{
+			MySocketRef socket = new MySocket("localhost", TEST_PORT);
+			socket->setUseNetworkByteOrder(false);
+			socket->writeUInt32(12345);
+			try
+			{
+				socket->readUInt32();
+				failTest("Expected connection to be closed.");
+			}
+			catch(MySocketExcep&)
+			{}
+		}
+
+		thread_manager.killThreadsBlocking();
+		server.worker_thread_manager.killThreadsBlocking();
+	}
+
+	// Compare memory use and broadcast message latency for thread-per-client vs epoll.
+	if(false)
+	{
+		const int num_clients = 5000;
+		benchmarkConnectionModel(/*use_epoll=*/false, num_clients, TEST_PORT + 1);
+		benchmarkConnectionModel(/*use_epoll=*/true,  num_clients, TEST_PORT + 2);
+	}
+#endif // defined(__linux__)
+
+	conPrint("EpollListenerThread::test() done");
+}
+
+
+#endif // BUILD_TESTS
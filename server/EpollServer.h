@@ -0,0 +1,186 @@
+/*=====================================================================
+EpollServer.h
+-------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "WorkerThread.h"
+#include <MessageableThread.h>
+#include <ThreadManager.h>
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <MySocket.h>
+#include <EventFD.h>
+#include <Mutex.h>
+#include <AtomicInt.h>
+#include <SocketBufferOutStream.h>
+#include <Vector.h>
+#include <Platform.h>
+#include <unordered_map>
+#include <vector>
+class Server;
+struct tls;
+struct tls_config;
+
+
+#if defined(__linux__)
+
+
+/*=====================================================================
+EpollConnection
+---------------
+A client connection handled by an EpollLoopThread.
+
+The handshake (hello, protocol version, connection type and world name) is
+read incrementally as data arrives.  Once the client is connected to a
+world, the WorkerThread object holds the rest of the per-connection state,
+and handles each message as it is received.
+=====================================================================*/
+class EpollConnection : public ThreadSafeRefCounted
+{
+public:
+	EpollConnection(MySocketRef plain_socket, struct tls* tls_context);
+	~EpollConnection();
+
+	enum State
+	{
+		State_ReadingHello,
+		State_ReadingProtocolVersion,
+		State_ReadingConnectionType,
+		State_ReadingWorldNameLength,
+		State_ReadingWorldName,
+		State_Updates,
+		State_HandedOff, // Connection has been handed off to a WorkerThread thread.
+		State_Closed
+	};
+
+	// Tag stored in the epoll_event data, so we can tell which fd an event is for.
+	struct EpollTag
+	{
+		EpollConnection* connection;
+		bool is_event_fd; // If true, the event is for worker->event_fd, otherwise it is for the socket.
+	};
+
+	State state;
+	MySocketRef plain_socket;
+	struct tls* tls_context; // Per-connection TLS context, or NULL if this is not a TLS connection.
+	int fd;
+
+	js::Vector<uint8, 16> recv_buf;
+	size_t recv_buf_used; // Number of bytes of recv_buf that have been read from the socket and not yet processed.
+
+	SocketBufferOutStream send_buf; // Data to be written to the socket.
+	size_t send_buf_offset; // Bytes of send_buf before this offset have been written.
+	bool EPOLLOUT_registered; // Are we waiting for the socket to become writable?
+	bool tls_read_wants_write; // tls_read returned TLS_WANT_POLLOUT, so we need to wait for the socket to become writable before reading again.
+
+	uint32 client_protocol_version;
+	uint32 world_name_len;
+
+	Reference<WorkerThread> worker; // Non-null once the client has connected to a world.  Not run as a thread.
+
+	EpollTag socket_tag;
+	EpollTag event_fd_tag;
+};
+
+
+/*=====================================================================
+EpollLoopThread
+---------------
+Handles many client update connections on non-blocking sockets, with epoll.
+
+Each connection's socket, and the event fd of its WorkerThread (signalled
+when packets are enqueued to send to the client), are added to the epoll
+set.  Reading and writing never block, so a slow client does not hold up the
+other clients on the same thread.
+=====================================================================*/
+class EpollLoopThread : public MessageableThread
+{
+public:
+	EpollLoopThread(Server* server);
+	virtual ~EpollLoopThread();
+
+	virtual void doRun();
+
+	virtual void kill();
+
+	// Adds a newly accepted connection to be handled by this thread.  The socket must be non-blocking.  Takes ownership of tls_context.  Threadsafe.
+	void addConnection(MySocketRef plain_socket, struct tls* tls_context);
+
+	size_t numConnections() const { return num_connections; }
+
+private:
+	void addPendingConnections();
+	void handleSocketEvent(EpollConnection* conn, uint32 events);
+	void handleEventFDEvent(EpollConnection* conn);
+	void takePacketsFromSendQueue(EpollConnection* conn);
+	void readFromSocket(EpollConnection* conn);
+	void processReceivedData(EpollConnection* conn);
+	size_t processHandshakeData(EpollConnection* conn, const uint8* data, size_t size);
+	void sendPendingData(EpollConnection* conn);
+	void setWriteInterest(EpollConnection* conn, bool want_write);
+	void handOffToWorkerThread(EpollConnection* conn, uint32 connection_type);
+	void closeConnection(EpollConnection* conn);
+
+	// Returns number of bytes read or written, 0 if the operation would block, or throws MySocketExcep if the connection was closed or an error occurred.
+	size_t readSome(EpollConnection* conn, void* buf, size_t max_len);
+	size_t writeSome(EpollConnection* conn, const void* data, size_t len);
+
+	Server* server;
+	int epoll_fd;
+	EventFD wake_event_fd; // Signalled when new connections are added, or when the thread should quit.
+	EpollConnection::EpollTag wake_tag;
+	glare::AtomicInt should_quit;
+
+	Mutex pending_mutex;
+	std::vector<std::pair<MySocketRef, struct tls*>> pending_connections GUARDED_BY(pending_mutex);
+
+	std::unordered_map<EpollConnection*, Reference<EpollConnection>> connections;
+	std::vector<Reference<EpollConnection>> closed_connections; // Connections closed while handling the current batch of events.  Freed after the batch, as later events in the batch may refer to them.
+	glare::AtomicInt num_connections;
+
+	std::vector<SharedPacketRef> temp_packets;
+	js::Vector<uint8, 16> gather_buf;
+};
+
+
+#endif // defined(__linux__)
+
+
+/*=====================================================================
+EpollListenerThread
+-------------------
+Listens for client connections on the Substrata protocol port, like
+ListenerThread, but hands the accepted connections round-robin to a small
+pool of EpollLoopThreads, instead of creating a thread per client.
+
+Connections other than ConnectionTypeUpdates (resource uploads and downloads,
+bot connections) do a lot of blocking file IO, so after the handshake they are
+handed off to a WorkerThread thread as before.
+
+Only supported on Linux.
+=====================================================================*/
+class EpollListenerThread : public MessageableThread
+{
+public:
+	// If tls_configuration is NULL, connections will not use TLS.
+	EpollListenerThread(int listenport, Server* server, struct ::tls_config* tls_configuration, int num_loop_threads);
+	virtual ~EpollListenerThread();
+
+	virtual void doRun();
+
+	virtual void kill();
+
+	static void test();
+
+private:
+	int listenport;
+	Server* server;
+	struct tls_config* tls_configuration;
+	int num_loop_threads;
+
+	EventFD quit_event_fd;
+	glare::AtomicInt should_quit;
+};
@@ -0,0 +1,987 @@
+/*=====================================================================
+InterestManager.cpp
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "InterestManager.h"
+
+
+#include "ServerWorldState.h"
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include "../shared/TransformUDPChannel.h"
+#include <maths/mathstypes.h>
+#include <ConPrint.h>
+
+
+const double ClientUDPTransformState::ACK_TIMEOUT = 6.0; // Clients send UDP discovery packets every 2 s.
+const double ClientUDPTransformState::CLIENT_UDP_TIMEOUT = 10.0;
+
+
+ClientUDPTransformState::ClientUDPTransformState()
+:	enabled(false),
+	failed(false),
+	port(-1),
+	client_avatar_uid(UID::invalidUID()),
+	num_datagrams_sent(0),
+	first_datagram_time(-1)
+{
+}
+
+
+void ClientUDPTransformState::update(bool client_supports_UDP_transforms, const Reference<UDPSocket>& socket_, const IPAddress& client_ip_addr, int client_UDP_port, const UID& client_avatar_uid_,
+	uint32 num_datagrams_received_by_client, double last_client_UDP_packet_time, double cur_time)
+{
+	socket = socket_;
+	ip_addr = client_ip_addr;
+	port = client_UDP_port;
+	client_avatar_uid = client_avatar_uid_;
+
+	if(num_datagrams_sent > 0 && first_datagram_time < 0)
+		first_datagram_time = cur_time;
+
+	if(!failed && (num_datagrams_received_by_client == 0) && (first_datagram_time >= 0) && (cur_time - first_datagram_time > ACK_TIMEOUT))
+	{
+		conPrint("ClientUDPTransformState: client " + client_avatar_uid.toString() + " has not received any transform datagrams, sending transform updates over TCP instead.");
+		failed = true;
+	}
+
+	enabled = client_supports_UDP_transforms && socket.nonNull() && (port > 0) && !failed && (cur_time - last_client_UDP_packet_time < CLIENT_UDP_TIMEOUT);
+}
+
+
+InterestManager::InterestManager()
+:	radius(0),
+	hysteresis(0),
+	num_updates_suppressed(0),
+	num_enter_events(0),
+	num_leave_events(0),
+	udp_seq_num(0),
+	datagrams(SocketBufferOutStream::DontUseNetworkByteOrder)
+{
+}
+
+
+void InterestManager::setRadius(double radius_, double hysteresis_)
+{
+	radius = myMax(0.0, radius_);
+	hysteresis = myMax(0.0, hysteresis_);
+}
+
+
+InterestManager::Decision InterestManager::processUpdate(ClientInterestState& client, uint64 entity_key, const Vec3d& entity_pos) const
+{
+	if(!isEnabled() || !client.pos_known)
+		return Decision_Deliver;
+
+	const double dist2 = client.pos.getDist2(entity_pos);
+
+	auto res = client.stale_entities.find(entity_key);
+	if(res != client.stale_entities.end()) // If entity is currently outside of the area of interest:
+	{
+		if(dist2 <= radius * radius)
+		{
+			client.stale_entities.erase(res);
+			return Decision_Enter;
+		}
+		else
+			return Decision_Suppress;
+	}
+	else
+	{
+		if(dist2 > (radius + hysteresis) * (radius + hysteresis))
+		{
+			client.stale_entities.insert(entity_key);
+			return Decision_Leave;
+		}
+		else
+			return Decision_Deliver; // NOTE: entities with non-finite positions will end up here, as the comparison above will be false.
+	}
+}
+
+
+bool InterestManager::getEntityPos(ServerWorldState& world_state, uint64 entity_key, Vec3d& pos_out) const
+{
+	const UID uid(entity_key >> 1);
+	if(entity_key & 1) // If avatar:
+	{
+		auto res = world_state.avatars.find(uid);
+		if(res == world_state.avatars.end() || res->second->state == Avatar::State_Dead)
+			return false;
+		pos_out = res->second->pos;
+	}
+	else
+	{
+		auto res = world_state.objects.find(uid);
+		if(res == world_state.objects.end() || res->second->state == WorldObject::State_Dead)
+			return false;
+		pos_out = res->second->pos;
+	}
+	return true;
+}
+
+
+bool InterestManager::writeFullEntityUpdate(ServerWorldState& world_state, uint64 entity_key, SocketBufferOutStream& scratch_packet) const
+{
+	const UID uid(entity_key >> 1);
+	if(entity_key & 1) // If avatar:
+	{
+		auto res = world_state.avatars.find(uid);
+		if(res == world_state.avatars.end() || res->second->state == Avatar::State_Dead)
+			return false;
+
+		MessageUtils::initPacket(scratch_packet, Protocol::AvatarFullUpdate);
+		writeAvatarToNetworkStream(*res->second, scratch_packet);
+	}
+	else
+	{
+		auto res = world_state.objects.find(uid);
+		if(res == world_state.objects.end() || res->second->state == WorldObject::State_Dead)
+			return false;
+
+		MessageUtils::initPacket(scratch_packet, Protocol::ObjectFullUpdate);
+		res->second->writeToNetworkStream(scratch_packet);
+	}
+	MessageUtils::updatePacketLengthField(scratch_packet);
+	return true;
+}
+
+
+static inline void sendPacketToSink(const SocketBufferOutStream& packet, BroadcastSink* sink)
+{
+	sink->enqueuePacketToSend(SharedPacket::make(packet));
+}
+
+
+void InterestManager::makeTransformUpdateBatches(const std::vector<const TransformUpdate*>& updates, SocketBufferOutStream& scratch_packet, std::vector<SharedPacketRef>& batches_out)
+{
+	for(size_t begin=0; begin<updates.size(); begin += TransformBatch::MAX_UPDATES_PER_MESSAGE)
+	{
+		const size_t end = myMin(updates.size(), begin + TransformBatch::MAX_UPDATES_PER_MESSAGE);
+		temp_batch_updates.assign(updates.begin() + begin, updates.begin() + end);
+
+		TransformBatch::writeBatchMessage(temp_batch_updates, scratch_packet);
+		batches_out.push_back(SharedPacket::make(scratch_packet));
+	}
+}
+
+
+void InterestManager::settleUDPTransformUpdates(ServerWorldState& world_state, BroadcastSink* sink, ClientUDPTransformState& udp_state, bool settle_all, SocketBufferOutStream& scratch_packet)
+{
+	assert(sink->supportsTransformUpdateBatches()); // Clients that support UDP transform updates also support batches.
+
+	settled_updates.clear();
+	for(auto it = udp_state.unsettled_updates.begin(); it != udp_state.unsettled_updates.end(); )
+	{
+		if(!settle_all && (it->second.seq_num == udp_seq_num)) // If the entity was updated this tick, it may still be moving, so keep sending it by UDP.
+		{
+			++it;
+			continue;
+		}
+
+		Vec3d entity_pos;
+		if(getEntityPos(world_state, it->first, entity_pos)) // Don't bother sending updates for entities that have been removed.
+		{
+			settled_updates.push_back(it->second.update);
+			settled_updates.back().setPresentFields(NULL); // The client may not have received the earlier updates, so send all fields.
+		}
+		it = udp_state.unsettled_updates.erase(it);
+	}
+
+	if(!settled_updates.empty())
+	{
+		settled_update_ptrs.resize(settled_updates.size());
+		for(size_t i=0; i<settled_updates.size(); ++i)
+			settled_update_ptrs[i] = &settled_updates[i];
+
+		sink_transform_update_batches.clear();
+		makeTransformUpdateBatches(settled_update_ptrs, scratch_packet, sink_transform_update_batches);
+		for(size_t i=0; i<sink_transform_update_batches.size(); ++i)
+			sink->enqueuePacketToSend(sink_transform_update_batches[i]);
+	}
+}
+
+
+void InterestManager::sendTransformDatagrams(BroadcastSink* sink, ClientUDPTransformState& udp_state, const std::vector<const TransformUpdate*>& updates)
+{
+	datagrams.clear();
+	datagram_ends.clear();
+	TransformUDPChannel::writeDatagrams(udp_seq_num, updates, datagrams, datagram_ends);
+
+	size_t datagram_start = 0;
+	for(size_t i=0; i<datagram_ends.size(); ++i)
+	{
+		sink->sendTransformDatagram(datagrams.buf.data() + datagram_start, datagram_ends[i] - datagram_start);
+		datagram_start = datagram_ends[i];
+	}
+	udp_state.num_datagrams_sent += datagram_ends.size();
+}
+
+
+void InterestManager::deliverPackets(ServerWorldState& world_state, const std::vector<BroadcastPacket>& packets, const std::vector<BroadcastSink*>& sinks, SocketBufferOutStream& scratch_packet)
+{
+	udp_seq_num++;
+
+	all_transform_update_batches.clear();
+	bool made_all_transform_update_batches = false; // Made lazily, when the first client that receives all updates and supports batches is processed.
+
+	for(size_t s=0; s<sinks.size(); ++s)
+	{
+		BroadcastSink* sink = sinks[s];
+		ClientInterestState& client = sink->getInterestState();
+		const bool use_batches = sink->supportsTransformUpdateBatches() && !sink->isSendQueueCoalescing(); // If the send queue is backed up, send individual messages, which the queue can coalesce.
+		ClientUDPTransformState* udp_state = sink->getUDPTransformState();
+		const bool use_udp = udp_state && udp_state->enabled;
+
+		// If we have stopped sending updates to this client by UDP, resend the last updates that were sent by UDP over TCP, before any newer updates.
+		if(udp_state && !use_udp && !udp_state->unsettled_updates.empty())
+			settleUDPTransformUpdates(world_state, sink, *udp_state, /*settle_all=*/true, scratch_packet);
+
+		if(!isEnabled() || !client.pos_known)
+		{
+			client.stale_entities.clear();
+
+			if(!use_udp)
+			{
+				for(size_t i=0; i<packets.size(); ++i)
+					if(!(use_batches && packets[i].is_transform_update))
+						sink->enqueuePacketToSend(packets[i].data);
+
+				if(use_batches)
+				{
+					if(!made_all_transform_update_batches)
+					{
+						all_transform_updates.clear();
+						for(size_t i=0; i<packets.size(); ++i)
+							if(packets[i].is_transform_update)
+								all_transform_updates.push_back(&packets[i].transform_update);
+
+						makeTransformUpdateBatches(all_transform_updates, scratch_packet, all_transform_update_batches);
+						made_all_transform_update_batches = true;
+					}
+
+					for(size_t i=0; i<all_transform_update_batches.size(); ++i)
+						sink->enqueuePacketToSend(all_transform_update_batches[i]);
+				}
+				continue;
+			}
+		}
+
+		sink_transform_updates.clear();
+		sink_udp_updates.clear();
+
+		for(size_t i=0; i<packets.size(); ++i)
+		{
+			const BroadcastPacket& packet = packets[i];
+			if(!packet.filtered)
+			{
+				sink->enqueuePacketToSend(packet.data);
+				continue;
+			}
+
+			const Decision decision = processUpdate(client, packet.entity_key, packet.entity_pos);
+			if(decision == Decision_Deliver || decision == Decision_Leave)
+			{
+				const TransformUpdate& update = packet.transform_update;
+				if(use_udp && packet.is_transform_update && (update.type != TransformUpdate::Type_Object))
+				{
+					// Don't send physics updates back to the client that sent them, the client would discard them.
+					if(!((update.type == TransformUpdate::Type_ObjectPhysics) && (update.transform_update_avatar_uid == (uint32)udp_state->client_avatar_uid.value())))
+					{
+						sink_udp_updates.push_back(&update);
+						ClientUDPTransformState::UnsettledUpdate& unsettled = udp_state->unsettled_updates[packet.entity_key];
+						unsettled.update = update;
+						unsettled.seq_num = udp_seq_num;
+					}
+				}
+				else
+				{
+					if(udp_state)
+						udp_state->unsettled_updates.erase(packet.entity_key); // Superseded by this update sent over TCP.
+
+					if(use_batches && packet.is_transform_update)
+						sink_transform_updates.push_back(&update);
+					else
+						sink->enqueuePacketToSend(packet.data);
+				}
+
+				if(decision == Decision_Leave)
+					num_leave_events++;
+			}
+			else if(decision == Decision_Enter)
+			{
+				if(udp_state)
+					udp_state->unsettled_updates.erase(packet.entity_key);
+
+				if(writeFullEntityUpdate(world_state, packet.entity_key, scratch_packet))
+					sendPacketToSink(scratch_packet, sink);
+				else
+					sink->enqueuePacketToSend(packet.data);
+				num_enter_events++;
+			}
+			else
+			{
+				num_updates_suppressed++;
+			}
+		}
+
+		if(!sink_transform_updates.empty())
+		{
+			sink_transform_update_batches.clear();
+			makeTransformUpdateBatches(sink_transform_updates, scratch_packet, sink_transform_update_batches);
+			for(size_t i=0; i<sink_transform_update_batches.size(); ++i)
+				sink->enqueuePacketToSend(sink_transform_update_batches[i]);
+		}
+
+		if(use_udp)
+		{
+			if(!sink_udp_updates.empty())
+				sendTransformDatagrams(sink, *udp_state, sink_udp_updates);
+
+			settleUDPTransformUpdates(world_state, sink, *udp_state, /*settle_all=*/false, scratch_packet);
+		}
+
+		// Check stale entities, to see if they have entered the area of interest due to the client moving.
+		for(auto it = client.stale_entities.begin(); it != client.stale_entities.end(); )
+		{
+			Vec3d entity_pos;
+			if(!getEntityPos(world_state, *it, entity_pos)) // If entity no longer exists, stop tracking it.
+			{
+				it = client.stale_entities.erase(it);
+			}
+			else if(client.pos.getDist2(entity_pos) <= radius * radius)
+			{
+				if(udp_state)
+					udp_state->unsettled_updates.erase(*it);
+
+				if(writeFullEntityUpdate(world_state, *it, scratch_packet))
+					sendPacketToSink(scratch_packet, sink);
+				num_enter_events++;
+				it = client.stale_entities.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/BufferViewInStream.h>
+
+
+// Records the messages sent to it, in place of a WorkerThread.
+// Each update in a TransformUpdateBatch message is recorded as a separate message with type TransformUpdateBatch.
+class FakeBroadcastSink : public BroadcastSink
+{
+public:
+	FakeBroadcastSink(bool supports_batches_ = false, ClientUDPTransformState* udp_state_ = NULL) : supports_batches(supports_batches_), send_queue_coalescing(false), udp_state(udp_state_), num_datagrams(0) {}
+
+	virtual void enqueuePacketToSend(const SharedPacketRef& packet)
+	{
+		BufferViewInStream stream(ArrayRef<uint8>(packet->data.data(), packet->data.size()));
+		const uint32 msg_type = stream.readUInt32();
+		const uint32 msg_len = stream.readUInt32();
+		testAssert(msg_len == packet->data.size());
+		packets_received.push_back(packet);
+
+		if(msg_type == Protocol::TransformUpdateBatch)
+		{
+			testAssert(supports_batches);
+			std::vector<TransformUpdate> updates;
+			TransformBatch::readBatchMessage(stream, updates);
+			for(size_t i=0; i<updates.size(); ++i)
+			{
+				msg_types.push_back(msg_type);
+				uids.push_back(updates[i].uid);
+				batch_updates.push_back(updates[i]);
+			}
+		}
+		else
+		{
+			const UID uid = readUIDFromStream(stream);
+			msg_types.push_back(msg_type);
+			uids.push_back(uid);
+		}
+	}
+
+	virtual ClientInterestState& getInterestState() { return interest_state; }
+
+	virtual bool supportsTransformUpdateBatches() { return supports_batches; }
+
+	virtual bool isSendQueueCoalescing() { return send_queue_coalescing; }
+
+	virtual ClientUDPTransformState* getUDPTransformState() { return udp_state; }
+
+	virtual void sendTransformDatagram(const uint8* data, size_t len)
+	{
+		testAssert(udp_state && udp_state->enabled);
+		testAssert(len <= TransformUDPChannel::MAX_DATAGRAM_SIZE);
+		uint32 seq_num;
+		std::vector<TransformUpdate> updates;
+		TransformUDPChannel::readDatagram(data, len, seq_num, updates);
+		for(size_t i=0; i<updates.size(); ++i)
+			udp_uids.push_back(updates[i].uid);
+		num_datagrams++;
+	}
+
+	void clear() { msg_types.clear(); uids.clear(); packets_received.clear(); batch_updates.clear(); udp_uids.clear(); num_datagrams = 0; }
+
+	bool receivedMsg(uint32 msg_type, UID uid) const
+	{
+		for(size_t i=0; i<msg_types.size(); ++i)
+			if(msg_types[i] == msg_type && uids[i] == uid)
+				return true;
+		return false;
+	}
+
+	ClientInterestState interest_state;
+	std::vector<uint32> msg_types;
+	std::vector<UID> uids;
+	std::vector<SharedPacketRef> packets_received;
+	std::vector<TransformUpdate> batch_updates; // Updates received in TransformUpdateBatch messages.
+	bool supports_batches;
+	bool send_queue_coalescing;
+	ClientUDPTransformState* udp_state;
+	std::vector<UID> udp_uids; // UIDs of the updates received by UDP.
+	size_t num_datagrams;
+};
+
+
+static void makeObjectTransformUpdatePacket(const WorldObject& ob, BroadcastPacket& packet_out)
+{
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	MessageUtils::initPacket(scratch_packet, Protocol::ObjectTransformUpdate);
+	writeToStream(ob.uid, scratch_packet);
+	writeToStream(ob.pos, scratch_packet);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+
+	packet_out.data = SharedPacket::make(scratch_packet);
+	packet_out.filtered = true;
+	packet_out.entity_key = InterestManager::objectEntityKey(ob.uid);
+	packet_out.entity_pos = ob.pos;
+	packet_out.is_transform_update = true;
+	packet_out.transform_update = TransformUpdate::makeObjectUpdate(ob.uid, ob.pos, Quatf::identity(), Vec3f(1.f), 0);
+}
+
+
+static void makeAvatarTransformUpdatePacket(const Avatar& avatar, BroadcastPacket& packet_out)
+{
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
+	writeToStream(avatar.uid, scratch_packet);
+	writeToStream(avatar.pos, scratch_packet);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+
+	packet_out.data = SharedPacket::make(scratch_packet);
+	packet_out.filtered = true;
+	packet_out.entity_key = InterestManager::avatarEntityKey(avatar.uid);
+	packet_out.entity_pos = avatar.pos;
+	packet_out.is_transform_update = true;
+	packet_out.transform_update = TransformUpdate::makeAvatarUpdate(avatar.uid, avatar.pos, Vec3f(0.f), 0);
+}
+
+
+static void makeObjectPhysicsTransformUpdatePacket(const WorldObject& ob, uint32 transform_update_avatar_uid, BroadcastPacket& packet_out)
+{
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	MessageUtils::initPacket(scratch_packet, Protocol::ObjectPhysicsTransformUpdate);
+	writeToStream(ob.uid, scratch_packet);
+	writeToStream(ob.pos, scratch_packet);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+
+	packet_out.data = SharedPacket::make(scratch_packet);
+	packet_out.filtered = true;
+	packet_out.entity_key = InterestManager::objectEntityKey(ob.uid);
+	packet_out.entity_pos = ob.pos;
+	packet_out.is_transform_update = true;
+	packet_out.transform_update = TransformUpdate::makeObjectPhysicsUpdate(ob.uid, ob.pos, Quatf::identity(), Vec3f(0.f), Vec3f(0.f), transform_update_avatar_uid, 0.0);
+}
+
+
+static void makeObjectDestroyedPacket(const WorldObject& ob, BroadcastPacket& packet_out)
+{
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	MessageUtils::initPacket(scratch_packet, Protocol::ObjectDestroyed);
+	writeToStream(ob.uid, scratch_packet);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+
+	packet_out.data = SharedPacket::make(scratch_packet);
+	packet_out.filtered = false;
+	packet_out.entity_key = 0;
+	packet_out.entity_pos = Vec3d(0.0);
+	packet_out.is_transform_update = false;
+}
+
+
+void InterestManager::test()
+{
+	conPrint("InterestManager::test()");
+
+	//-------------------------- Test processUpdate() hysteresis --------------------------
+	{
+		InterestManager manager;
+		manager.setRadius(/*radius=*/100, /*hysteresis=*/10);
+
+		ClientInterestState client;
+		const uint64 key = objectEntityKey(UID(1));
+
+		// Client position not known yet, should receive everything.
+		testAssert(manager.processUpdate(client, key, Vec3d(1000, 0, 0)) == Decision_Deliver);
+		testAssert(client.stale_entities.empty());
+
+		client.setPos(Vec3d(0, 0, 0));
+		testAssert(client.pos_known);
+		client.setPos(Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0)); // Non-finite positions should be ignored.
+		testAssert(client.pos == Vec3d(0, 0, 0));
+
+		testAssert(manager.processUpdate(client, key, Vec3d(50, 0, 0)) == Decision_Deliver);
+		testAssert(manager.processUpdate(client, key, Vec3d(105, 0, 0)) == Decision_Deliver); // In hysteresis band, still in area.
+		testAssert(manager.processUpdate(client, key, Vec3d(111, 0, 0)) == Decision_Leave);
+		testAssert(manager.processUpdate(client, key, Vec3d(200, 0, 0)) == Decision_Suppress);
+		testAssert(manager.processUpdate(client, key, Vec3d(105, 0, 0)) == Decision_Suppress); // In hysteresis band, still out of area.
+		testAssert(manager.processUpdate(client, key, Vec3d(99, 0, 0)) == Decision_Enter);
+		testAssert(manager.processUpdate(client, key, Vec3d(105, 0, 0)) == Decision_Deliver);
+
+		// Entities with non-finite positions should be delivered.
+		testAssert(manager.processUpdate(client, objectEntityKey(UID(2)), Vec3d(std::numeric_limits<double>::infinity(), 0, 0)) == Decision_Deliver);
+
+		// Filtering disabled
+		manager.setRadius(0, 0);
+		testAssert(manager.processUpdate(client, key, Vec3d(1.0e10, 0, 0)) == Decision_Deliver);
+	}
+
+	//-------------------------- Test deliverPackets() with some fake worker sinks --------------------------
+	{
+		ServerWorldState world_state;
+
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(10);
+		ob->state = WorldObject::State_Alive;
+		ob->pos = Vec3d(0, 0, 0);
+		world_state.objects[ob->uid] = ob;
+
+		Reference<Avatar> avatar = new Avatar();
+		avatar->uid = UID(20);
+		avatar->state = Avatar::State_Alive;
+		avatar->pos = Vec3d(0, 0, 0);
+		world_state.avatars[avatar->uid] = avatar;
+
+		FakeBroadcastSink near_sink; // Client near the origin
+		near_sink.interest_state.setPos(Vec3d(10, 0, 0));
+
+		FakeBroadcastSink far_sink; // Client 500 m away
+		far_sink.interest_state.setPos(Vec3d(500, 0, 0));
+
+		FakeBroadcastSink unknown_pos_sink; // Client that hasn't told us its position yet.
+
+		std::vector<BroadcastSink*> sinks;
+		sinks.push_back(&near_sink);
+		sinks.push_back(&far_sink);
+		sinks.push_back(&unknown_pos_sink);
+
+		InterestManager manager;
+		manager.setRadius(/*radius=*/100, /*hysteresis=*/10);
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<BroadcastPacket> packets(2);
+
+		// Object and avatar move near the origin.  Only the near client and the client with unknown position should receive the updates.
+		// The far client gets the updates that take the entities out of its area of interest (leave events).
+		ob->pos = Vec3d(1, 0, 0);
+		avatar->pos = Vec3d(2, 0, 0);
+		makeObjectTransformUpdatePacket(*ob, packets[0]);
+		makeAvatarTransformUpdatePacket(*avatar, packets[1]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+
+		testAssert(near_sink.msg_types.size() == 2 && near_sink.receivedMsg(Protocol::ObjectTransformUpdate, ob->uid) && near_sink.receivedMsg(Protocol::AvatarTransformUpdate, avatar->uid));
+		testAssert(unknown_pos_sink.msg_types.size() == 2);
+		testAssert(far_sink.msg_types.size() == 2); // Leave events
+		testAssert(far_sink.interest_state.stale_entities.size() == 2);
+		testAssert(manager.num_leave_events == 2);
+
+		// Move again, far client should not receive updates now.
+		near_sink.clear(); far_sink.clear(); unknown_pos_sink.clear();
+		ob->pos = Vec3d(3, 0, 0);
+		avatar->pos = Vec3d(4, 0, 0);
+		makeObjectTransformUpdatePacket(*ob, packets[0]);
+		makeAvatarTransformUpdatePacket(*avatar, packets[1]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+
+		testAssert(near_sink.msg_types.size() == 2);
+		testAssert(unknown_pos_sink.msg_types.size() == 2);
+		testAssert(far_sink.msg_types.empty());
+		testAssert(manager.num_updates_suppressed == 2);
+
+		// Move object towards far client.  Far client should get a full update for the object (enter event).  Near client should get a leave event.
+		near_sink.clear(); far_sink.clear(); unknown_pos_sink.clear();
+		ob->pos = Vec3d(450, 0, 0);
+		makeObjectTransformUpdatePacket(*ob, packets[0]);
+		manager.deliverPackets(world_state, std::vector<BroadcastPacket>(1, packets[0]), sinks, scratch_packet);
+
+		testAssert(far_sink.msg_types.size() == 1 && far_sink.receivedMsg(Protocol::ObjectFullUpdate, ob->uid));
+		testAssert(near_sink.msg_types.size() == 1 && near_sink.receivedMsg(Protocol::ObjectTransformUpdate, ob->uid));
+		testAssert(near_sink.interest_state.stale_entities.count(objectEntityKey(ob->uid)) == 1);
+		testAssert(far_sink.interest_state.stale_entities.count(objectEntityKey(ob->uid)) == 0);
+
+		// Move far client to the origin, with no entity updates.  Should get a full update for the avatar, that is now in its area of interest.
+		near_sink.clear(); far_sink.clear(); unknown_pos_sink.clear();
+		far_sink.interest_state.setPos(Vec3d(0, 0, 0));
+		manager.deliverPackets(world_state, std::vector<BroadcastPacket>(), sinks, scratch_packet);
+
+		testAssert(far_sink.msg_types.size() == 1 && far_sink.receivedMsg(Protocol::AvatarFullUpdate, avatar->uid));
+		testAssert(far_sink.interest_state.stale_entities.empty());
+		testAssert(near_sink.msg_types.empty());
+
+		// Destroy the object.  Unfiltered packets should go to all clients, and the object should be removed from the stale set once it's gone.
+		near_sink.clear(); far_sink.clear(); unknown_pos_sink.clear();
+		world_state.objects.erase(ob->uid);
+		makeObjectDestroyedPacket(*ob, packets[0]);
+		manager.deliverPackets(world_state, std::vector<BroadcastPacket>(1, packets[0]), sinks, scratch_packet);
+
+		testAssert(near_sink.msg_types.size() == 1 && near_sink.receivedMsg(Protocol::ObjectDestroyed, ob->uid));
+		testAssert(far_sink.msg_types.size() == 1 && far_sink.receivedMsg(Protocol::ObjectDestroyed, ob->uid));
+		testAssert(unknown_pos_sink.msg_types.size() == 1 && unknown_pos_sink.receivedMsg(Protocol::ObjectDestroyed, ob->uid));
+		testAssert(near_sink.interest_state.stale_entities.empty());
+
+		// Disable filtering, all clients should get all updates.
+		near_sink.clear(); far_sink.clear(); unknown_pos_sink.clear();
+		manager.setRadius(0, 0);
+		far_sink.interest_state.setPos(Vec3d(1.0e6, 0, 0));
+		makeAvatarTransformUpdatePacket(*avatar, packets[1]);
+		manager.deliverPackets(world_state, std::vector<BroadcastPacket>(1, packets[1]), sinks, scratch_packet);
+		testAssert(near_sink.msg_types.size() == 1);
+		testAssert(far_sink.msg_types.size() == 1);
+		testAssert(unknown_pos_sink.msg_types.size() == 1);
+	}
+
+	//-------------------------- Test transform updates are batched for clients that support TransformUpdateBatch messages --------------------------
+	{
+		ServerWorldState world_state;
+
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(10);
+		ob->state = WorldObject::State_Alive;
+		ob->pos = Vec3d(1, 0, 0);
+		world_state.objects[ob->uid] = ob;
+
+		Reference<Avatar> avatar = new Avatar();
+		avatar->uid = UID(20);
+		avatar->state = Avatar::State_Alive;
+		avatar->pos = Vec3d(2, 0, 0);
+		world_state.avatars[avatar->uid] = avatar;
+
+		FakeBroadcastSink old_sink(/*supports_batches=*/false); // Client with protocol version < 40
+		old_sink.interest_state.setPos(Vec3d(10, 0, 0));
+		FakeBroadcastSink near_sink(/*supports_batches=*/true);
+		near_sink.interest_state.setPos(Vec3d(10, 0, 0));
+		FakeBroadcastSink far_sink(/*supports_batches=*/true);
+		far_sink.interest_state.setPos(Vec3d(500, 0, 0));
+		FakeBroadcastSink unknown_pos_sink_a(/*supports_batches=*/true);
+		FakeBroadcastSink unknown_pos_sink_b(/*supports_batches=*/true);
+
+		std::vector<BroadcastSink*> sinks;
+		sinks.push_back(&old_sink);
+		sinks.push_back(&near_sink);
+		sinks.push_back(&far_sink);
+		sinks.push_back(&unknown_pos_sink_a);
+		sinks.push_back(&unknown_pos_sink_b);
+
+		InterestManager manager;
+		manager.setRadius(/*radius=*/100, /*hysteresis=*/10);
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<BroadcastPacket> packets(3);
+		makeObjectTransformUpdatePacket(*ob, packets[0]);
+		makeObjectDestroyedPacket(*ob, packets[1]); // Not a transform update, should be sent individually.
+		makeAvatarTransformUpdatePacket(*avatar, packets[2]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+
+		// Old client gets individual messages.
+		testAssert(old_sink.msg_types.size() == 3 && old_sink.packets_received.size() == 3);
+		testAssert(old_sink.receivedMsg(Protocol::ObjectTransformUpdate, ob->uid) && old_sink.receivedMsg(Protocol::AvatarTransformUpdate, avatar->uid));
+
+		// Near client gets the destroyed message, then a single batch with both transform updates.
+		testAssert(near_sink.packets_received.size() == 2);
+		testAssert(near_sink.msg_types.size() == 3 && near_sink.msg_types[0] == Protocol::ObjectDestroyed);
+		testAssert(near_sink.receivedMsg(Protocol::TransformUpdateBatch, ob->uid) && near_sink.receivedMsg(Protocol::TransformUpdateBatch, avatar->uid));
+
+		// Far client gets the leave events in a batch.
+		testAssert(far_sink.receivedMsg(Protocol::TransformUpdateBatch, ob->uid) && far_sink.receivedMsg(Protocol::TransformUpdateBatch, avatar->uid));
+		testAssert(far_sink.interest_state.stale_entities.size() == 2);
+
+		// Clients that receive all updates share the same batch packet.
+		testAssert(unknown_pos_sink_a.packets_received.size() == 2 && unknown_pos_sink_b.packets_received.size() == 2);
+		testAssert(unknown_pos_sink_a.packets_received[1].getPointer() == unknown_pos_sink_b.packets_received[1].getPointer());
+		testAssert(unknown_pos_sink_a.receivedMsg(Protocol::TransformUpdateBatch, ob->uid) && unknown_pos_sink_a.receivedMsg(Protocol::TransformUpdateBatch, avatar->uid));
+
+		// Next tick, far client should get nothing, as the entities are out of its area of interest.
+		old_sink.clear(); near_sink.clear(); far_sink.clear(); unknown_pos_sink_a.clear(); unknown_pos_sink_b.clear();
+		packets.resize(1);
+		makeAvatarTransformUpdatePacket(*avatar, packets[0]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(far_sink.packets_received.empty());
+		testAssert(near_sink.packets_received.size() == 1 && near_sink.receivedMsg(Protocol::TransformUpdateBatch, avatar->uid));
+
+		// Lots of updates should be split into multiple batches.
+		old_sink.clear(); near_sink.clear(); far_sink.clear(); unknown_pos_sink_a.clear(); unknown_pos_sink_b.clear();
+		const size_t num_updates = TransformBatch::MAX_UPDATES_PER_MESSAGE + 10;
+		packets.resize(num_updates);
+		for(size_t i=0; i<num_updates; ++i)
+		{
+			avatar->uid = UID(1000 + i);
+			makeAvatarTransformUpdatePacket(*avatar, packets[i]);
+		}
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(near_sink.packets_received.size() == 2 && near_sink.msg_types.size() == num_updates);
+		testAssert(unknown_pos_sink_a.packets_received.size() == 2 && unknown_pos_sink_a.msg_types.size() == num_updates);
+		testAssert(old_sink.packets_received.size() == num_updates);
+	}
+
+	//-------------------------- Test clients with a backed up send queue get individual transform update messages, which can be coalesced --------------------------
+	{
+		ServerWorldState world_state;
+
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(10);
+		ob->state = WorldObject::State_Alive;
+		ob->pos = Vec3d(1, 0, 0);
+		world_state.objects[ob->uid] = ob;
+
+		FakeBroadcastSink near_sink(/*supports_batches=*/true);
+		near_sink.interest_state.setPos(Vec3d(10, 0, 0));
+		FakeBroadcastSink unknown_pos_sink(/*supports_batches=*/true);
+
+		std::vector<BroadcastSink*> sinks;
+		sinks.push_back(&near_sink);
+		sinks.push_back(&unknown_pos_sink);
+
+		InterestManager manager;
+		manager.setRadius(/*radius=*/100, /*hysteresis=*/10);
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<BroadcastPacket> packets(1);
+		makeObjectTransformUpdatePacket(*ob, packets[0]);
+
+		near_sink.send_queue_coalescing = true;
+		unknown_pos_sink.send_queue_coalescing = true;
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(near_sink.msg_types.size() == 1 && near_sink.receivedMsg(Protocol::ObjectTransformUpdate, ob->uid));
+		testAssert(unknown_pos_sink.msg_types.size() == 1 && unknown_pos_sink.receivedMsg(Protocol::ObjectTransformUpdate, ob->uid));
+
+		// Once the queues have been taken, batches should be used again.
+		near_sink.clear();
+		unknown_pos_sink.clear();
+		near_sink.send_queue_coalescing = false;
+		unknown_pos_sink.send_queue_coalescing = false;
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(near_sink.msg_types.size() == 1 && near_sink.receivedMsg(Protocol::TransformUpdateBatch, ob->uid));
+		testAssert(unknown_pos_sink.msg_types.size() == 1 && unknown_pos_sink.receivedMsg(Protocol::TransformUpdateBatch, ob->uid));
+	}
+
+	//-------------------------- Test a client that joins after an avatar's anim state last changed still gets the anim state --------------------------
+	{
+		ServerWorldState world_state;
+
+		Reference<Avatar> avatar = new Avatar();
+		avatar->uid = UID(20);
+		avatar->state = Avatar::State_Alive;
+		avatar->pos = Vec3d(2, 0, 0);
+		avatar->anim_state = 5;
+		world_state.avatars[avatar->uid] = avatar;
+
+		FakeBroadcastSink early_sink(/*supports_batches=*/true);
+		early_sink.interest_state.setPos(Vec3d(10, 0, 0));
+
+		std::vector<BroadcastSink*> sinks;
+		sinks.push_back(&early_sink);
+
+		InterestManager manager;
+		manager.setRadius(/*radius=*/100, /*hysteresis=*/10);
+
+		// First update for the avatar, all fields are sent.  Fields of later updates are relative to this one, as in Server.cpp.
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<BroadcastPacket> packets(1);
+		makeAvatarTransformUpdatePacket(*avatar, packets[0]);
+		TransformUpdate prev_update = TransformUpdate::makeAvatarUpdate(avatar->uid, avatar->pos, avatar->rotation, avatar->anim_state);
+		prev_update.setPresentFields(NULL);
+		packets[0].transform_update = prev_update;
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(early_sink.batch_updates.size() == 1 && early_sink.batch_updates[0].anim_state == 5);
+
+		// A new client joins, then the avatar moves without changing its anim state.
+		FakeBroadcastSink late_sink(/*supports_batches=*/true);
+		late_sink.interest_state.setPos(Vec3d(10, 0, 0));
+		sinks.push_back(&late_sink);
+
+		avatar->pos = Vec3d(3, 0, 0);
+		makeAvatarTransformUpdatePacket(*avatar, packets[0]);
+		TransformUpdate update = TransformUpdate::makeAvatarUpdate(avatar->uid, avatar->pos, avatar->rotation, avatar->anim_state);
+		update.setPresentFields(&prev_update);
+		packets[0].transform_update = update;
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+
+		testAssert(late_sink.batch_updates.size() == 1);
+		testAssert((late_sink.batch_updates[0].present_fields & TransformUpdate::FIELD_ANIM_STATE) != 0);
+		testAssert(late_sink.batch_updates[0].anim_state == 5);
+	}
+
+	//-------------------------- Test avatar and physics object transform updates are sent by UDP to clients with UDP enabled --------------------------
+	{
+		ServerWorldState world_state;
+
+		WorldObjectRef ob = new WorldObject(); // Object moved by an edit, updates should go over TCP.
+		ob->uid = UID(10);
+		ob->state = WorldObject::State_Alive;
+		ob->pos = Vec3d(1, 0, 0);
+		world_state.objects[ob->uid] = ob;
+
+		WorldObjectRef physics_ob = new WorldObject();
+		physics_ob->uid = UID(11);
+		physics_ob->state = WorldObject::State_Alive;
+		physics_ob->pos = Vec3d(2, 0, 0);
+		world_state.objects[physics_ob->uid] = physics_ob;
+
+		Reference<Avatar> avatar = new Avatar();
+		avatar->uid = UID(20);
+		avatar->state = Avatar::State_Alive;
+		avatar->pos = Vec3d(3, 0, 0);
+		world_state.avatars[avatar->uid] = avatar;
+
+		ClientUDPTransformState udp_state;
+		udp_state.enabled = true;
+		udp_state.client_avatar_uid = UID(30);
+		FakeBroadcastSink udp_sink(/*supports_batches=*/true, &udp_state);
+		udp_sink.interest_state.setPos(Vec3d(10, 0, 0));
+
+		ClientUDPTransformState owner_udp_state; // State for the client that is simulating the physics object.
+		owner_udp_state.enabled = true;
+		owner_udp_state.client_avatar_uid = UID(31);
+		FakeBroadcastSink owner_sink(/*supports_batches=*/true, &owner_udp_state);
+
+		std::vector<BroadcastSink*> sinks;
+		sinks.push_back(&udp_sink);
+		sinks.push_back(&owner_sink);
+
+		InterestManager manager;
+		manager.setRadius(/*radius=*/100, /*hysteresis=*/10);
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<BroadcastPacket> packets(3);
+		makeObjectTransformUpdatePacket(*ob, packets[0]);
+		makeObjectPhysicsTransformUpdatePacket(*physics_ob, /*transform_update_avatar_uid=*/31, packets[1]);
+		makeAvatarTransformUpdatePacket(*avatar, packets[2]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+
+		testAssert(udp_sink.num_datagrams == 1 && udp_sink.udp_uids.size() == 2);
+		testAssert(udp_sink.msg_types.size() == 1 && udp_sink.receivedMsg(Protocol::TransformUpdateBatch, ob->uid));
+		testAssert(udp_state.unsettled_updates.size() == 2);
+		testAssert(udp_state.num_datagrams_sent == 1);
+
+		// The client simulating the physics object shouldn't get its own physics updates back.  (Its position is unknown, so it gets everything else.)
+		testAssert(owner_sink.udp_uids.size() == 1 && owner_sink.udp_uids[0] == avatar->uid);
+		testAssert(owner_sink.msg_types.size() == 1 && owner_sink.receivedMsg(Protocol::TransformUpdateBatch, ob->uid));
+		testAssert(owner_udp_state.unsettled_updates.size() == 1);
+
+		// Next tick, only the avatar moves.  The last update for the physics object should be resent over TCP, as the datagram may have been lost.
+		udp_sink.clear(); owner_sink.clear();
+		packets.resize(1);
+		avatar->pos = Vec3d(4, 0, 0);
+		makeAvatarTransformUpdatePacket(*avatar, packets[0]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+
+		testAssert(udp_sink.udp_uids.size() == 1 && udp_sink.udp_uids[0] == avatar->uid);
+		testAssert(udp_sink.msg_types.size() == 1 && udp_sink.receivedMsg(Protocol::TransformUpdateBatch, physics_ob->uid));
+		testAssert(udp_state.unsettled_updates.size() == 1);
+
+		// Nothing moves.  The avatar update should be resent over TCP, and nothing more after that.
+		udp_sink.clear(); owner_sink.clear();
+		manager.deliverPackets(world_state, std::vector<BroadcastPacket>(), sinks, scratch_packet);
+		testAssert(udp_sink.num_datagrams == 0);
+		testAssert(udp_sink.msg_types.size() == 1 && udp_sink.receivedMsg(Protocol::TransformUpdateBatch, avatar->uid));
+		testAssert(owner_sink.msg_types.size() == 1 && owner_sink.receivedMsg(Protocol::TransformUpdateBatch, avatar->uid));
+		testAssert(udp_state.unsettled_updates.empty() && owner_udp_state.unsettled_updates.empty());
+
+		udp_sink.clear(); owner_sink.clear();
+		manager.deliverPackets(world_state, std::vector<BroadcastPacket>(), sinks, scratch_packet);
+		testAssert(udp_sink.msg_types.empty() && owner_sink.msg_types.empty());
+
+		// Updates for removed entities should not be resent.
+		udp_sink.clear(); owner_sink.clear();
+		packets.resize(1);
+		makeAvatarTransformUpdatePacket(*avatar, packets[0]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(udp_state.unsettled_updates.size() == 1);
+		world_state.avatars.erase(avatar->uid);
+		udp_sink.clear(); owner_sink.clear();
+		manager.deliverPackets(world_state, std::vector<BroadcastPacket>(), sinks, scratch_packet);
+		testAssert(udp_sink.msg_types.empty());
+		testAssert(udp_state.unsettled_updates.empty());
+		world_state.avatars[avatar->uid] = avatar;
+
+		// Disable UDP while an update is unsettled.  It should be resent over TCP, before the new updates, which should also go over TCP.
+		udp_sink.clear(); owner_sink.clear();
+		makeAvatarTransformUpdatePacket(*avatar, packets[0]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(udp_state.unsettled_updates.size() == 1);
+
+		udp_sink.clear(); owner_sink.clear();
+		udp_state.enabled = false;
+		makeObjectPhysicsTransformUpdatePacket(*physics_ob, /*transform_update_avatar_uid=*/31, packets[0]);
+		manager.deliverPackets(world_state, packets, sinks, scratch_packet);
+		testAssert(udp_sink.num_datagrams == 0);
+		testAssert(udp_sink.packets_received.size() == 2);
+		testAssert(udp_sink.msg_types.size() == 2 && udp_sink.uids[0] == avatar->uid && udp_sink.uids[1] == physics_ob->uid);
+		testAssert(udp_state.unsettled_updates.empty());
+	}
+
+	//-------------------------- Test ClientUDPTransformState::update() falls back to TCP --------------------------
+	{
+		Reference<UDPSocket> socket = new UDPSocket();
+		const IPAddress ip_addr("127.0.0.1");
+
+		ClientUDPTransformState state;
+		state.update(/*client_supports_UDP_transforms=*/true, socket, ip_addr, /*client_UDP_port=*/-1, UID(1), 0, /*last_client_UDP_packet_time=*/-1.0e10, /*cur_time=*/0.0);
+		testAssert(!state.enabled); // Port not known yet
+
+		state.update(false, socket, ip_addr, 1234, UID(1), 0, 1.0, 1.0);
+		testAssert(!state.enabled); // Client doesn't support UDP transform updates.
+
+		state.update(true, Reference<UDPSocket>(), ip_addr, 1234, UID(1), 0, 1.0, 1.0);
+		testAssert(!state.enabled); // Server doesn't have a UDP socket.
+
+		state.update(true, socket, ip_addr, 1234, UID(1), 0, 1.0, 1.0);
+		testAssert(state.enabled);
+
+		// No discovery packets from the client for a while.
+		state.update(true, socket, ip_addr, 1234, UID(1), 0, 1.0, 1.0 + ClientUDPTransformState::CLIENT_UDP_TIMEOUT + 1);
+		testAssert(!state.enabled && !state.failed);
+
+		// Send some datagrams, then check the client hasn't acknowledged any after ACK_TIMEOUT.
+		state.num_datagrams_sent = 10;
+		state.update(true, socket, ip_addr, 1234, UID(1), 0, 20.0, 20.0);
+		testAssert(state.enabled);
+		state.update(true, socket, ip_addr, 1234, UID(1), 0, 20.0 + ClientUDPTransformState::ACK_TIMEOUT, 20.0 + ClientUDPTransformState::ACK_TIMEOUT);
+		testAssert(state.enabled);
+		state.update(true, socket, ip_addr, 1234, UID(1), 0, 21.0 + ClientUDPTransformState::ACK_TIMEOUT, 21.0 + ClientUDPTransformState::ACK_TIMEOUT);
+		testAssert(!state.enabled && state.failed);
+		state.update(true, socket, ip_addr, 1234, UID(1), 5, 100.0, 100.0);
+		testAssert(!state.enabled); // Once failed, stays failed.
+
+		// Client that acknowledges datagrams stays enabled.
+		ClientUDPTransformState state2;
+		state2.num_datagrams_sent = 10;
+		state2.update(true, socket, ip_addr, 1234, UID(1), 0, 0.0, 0.0);
+		state2.update(true, socket, ip_addr, 1234, UID(1), 3, 100.0, 100.0);
+		testAssert(state2.enabled && !state2.failed);
+	}
+
+	conPrint("InterestManager::test() done");
+}
+
+
+#endif // BUILD_TESTS
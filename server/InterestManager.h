@@ -0,0 +1,236 @@
+/*=====================================================================
+InterestManager.h
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "PacketSendQueue.h"
+#include "../shared/UID.h"
+#include "../shared/TransformBatch.h"
+#include <vec3.h>
+#include <SocketBufferOutStream.h>
+#include <UDPSocket.h>
+#include <IPAddress.h>
+#include <Platform.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+class ServerWorldState;
+
+
+/*=====================================================================
+BroadcastPacket
+---------------
+A packet to be sent to the clients connected to a world.
+If filtered is true, the packet is an update about the entity identified by
+entity_key, and will only be sent to clients whose area of interest covers
+entity_pos.
+
+If is_transform_update is true, the packet is an AvatarTransformUpdate,
+ObjectTransformUpdate or ObjectPhysicsTransformUpdate message, and
+transform_update holds the same update, to be sent in a TransformUpdateBatch
+message instead to clients that support them.
+=====================================================================*/
+struct BroadcastPacket
+{
+	SharedPacketRef data;
+	bool filtered;
+	uint64 entity_key;
+	Vec3d entity_pos;
+	bool is_transform_update;
+	TransformUpdate transform_update;
+};
+
+
+/*=====================================================================
+ClientInterestState
+-------------------
+Area-of-interest state for a single connected client.
+Protected by the mutex of the world the client is connected to.
+=====================================================================*/
+struct ClientInterestState
+{
+	ClientInterestState() : pos_known(false), pos(0.0) {}
+
+	void setPos(const Vec3d& new_pos) { if(new_pos.isFinite()) { pos = new_pos; pos_known = true; } }
+	void reset() { pos_known = false; stale_entities.clear(); }
+
+	bool pos_known; // If the position of the client is not known yet, the client receives all updates.
+	Vec3d pos; // Last known camera or avatar position of the client.
+
+	// Entities that have left the client's area of interest.  Updates to these entities are not sent to the client until they re-enter the area.
+	std::unordered_set<uint64> stale_entities;
+};
+
+
+/*=====================================================================
+ClientUDPTransformState
+-----------------------
+State for sending avatar and physics object transform updates to a client
+as UDP datagrams (see TransformUDPChannel), instead of over the client's
+TCP connection.  Protected by the mutex of the world the client is connected to.
+
+The client reports the number of datagrams it has received in its UDP
+discovery packets.  If it hasn't received any datagrams after
+ACK_TIMEOUT, UDP is given up on for the rest of the connection, and
+updates are sent over TCP again.  Updates are also sent over TCP while
+no discovery packets are being received from the client.
+
+Datagrams may be lost, so when an entity stops being updated, the last
+update sent for it by UDP is resent over TCP (see
+InterestManager::settleUDPTransformUpdates()), so the client always ends
+up with the final transform.
+=====================================================================*/
+struct ClientUDPTransformState
+{
+	ClientUDPTransformState();
+
+	static const double ACK_TIMEOUT; // s
+	static const double CLIENT_UDP_TIMEOUT; // Time without a UDP discovery packet from the client before updates are sent over TCP (s)
+
+	// Decides if transform updates will be sent by UDP this tick.  Called by the server each tick before the packets are delivered.
+	// client_UDP_port is -1 if not known.  num_datagrams_received_by_client and last_client_UDP_packet_time come from the client's UDP discovery packets.
+	void update(bool client_supports_UDP_transforms, const Reference<UDPSocket>& socket, const IPAddress& client_ip_addr, int client_UDP_port, const UID& client_avatar_uid,
+		uint32 num_datagrams_received_by_client, double last_client_UDP_packet_time, double cur_time);
+
+	bool enabled; // Send avatar and physics object transform updates by UDP this tick.
+	bool failed; // The client didn't receive any datagrams, don't try UDP again for this connection.
+
+	Reference<UDPSocket> socket; // Server UDP socket to send datagrams with.
+	IPAddress ip_addr;
+	int port;
+	UID client_avatar_uid;
+
+	uint64 num_datagrams_sent;
+	double first_datagram_time; // Time of the first update() after a datagram was sent, or -1.
+
+	struct UnsettledUpdate
+	{
+		TransformUpdate update;
+		uint32 seq_num; // Sequence number of the datagram the update was sent in.
+	};
+	std::unordered_map<uint64, UnsettledUpdate> unsettled_updates; // Map from entity key to the last update sent by UDP, for entities that haven't been updated over TCP since.
+};
+
+
+/*=====================================================================
+BroadcastSink
+-------------
+Something that broadcast packets can be sent to.  Implemented by WorkerThread,
+and by fake sinks in tests.
+=====================================================================*/
+class BroadcastSink
+{
+public:
+	virtual ~BroadcastSink() {}
+
+	virtual void enqueuePacketToSend(const SharedPacketRef& packet) = 0; // threadsafe
+
+	virtual ClientInterestState& getInterestState() = 0;
+
+	virtual bool supportsTransformUpdateBatches() { return false; } // Can the client handle TransformUpdateBatch messages?
+
+	virtual bool isSendQueueCoalescing() { return false; } // Is the client's send queue backed up, and removing superseded transform updates?  See PacketSendQueue.
+
+	virtual ClientUDPTransformState* getUDPTransformState() { return NULL; } // Returns NULL if transform updates can't be sent to the client by UDP.
+
+	virtual void sendTransformDatagram(const uint8* data, size_t len) {}
+};
+
+
+/*=====================================================================
+InterestManager
+---------------
+Filters object and avatar updates by distance from each client, so that
+clients only receive updates for entities in their area of interest.
+
+An entity enters a client's area of interest when it is within 'radius' of
+the client, and leaves it when it is further than radius + hysteresis away.
+The hysteresis stops entities moving around the boundary from flipping
+between states every update.
+
+When an entity leaves, the update that took it out of the area is still
+sent, so the client has the position where it left.  Subsequent updates
+are dropped.  When an entity enters (either because it moved, or because
+the client moved), a full update for the entity is sent, so the client
+catches up on any changes it missed.
+
+A radius of zero disables filtering.
+
+For clients that have UDP transform updates enabled (see
+ClientUDPTransformState), avatar and physics object transform updates that
+pass the filter are sent as UDP datagrams.  All the datagrams sent in one
+deliverPackets() call have the same sequence number.  Other updates, and
+updates to entities entering the area of interest, are sent over TCP.
+
+Transform updates for clients that support TransformUpdateBatch messages are
+collected and sent in batches, after the other packets for the tick.  There
+is at most one update per entity per tick, so this doesn't reorder the
+updates for an entity.  While a client's send queue is coalescing, it is
+sent individual transform update messages instead, as superseded batches
+can't be removed from the queue.  Individual messages contain all the fields,
+so the next batch can still leave out fields that are unchanged since them.
+=====================================================================*/
+class InterestManager
+{
+public:
+	InterestManager();
+
+	void setRadius(double radius, double hysteresis);
+	bool isEnabled() const { return radius > 0; }
+
+	enum Decision
+	{
+		Decision_Deliver,	// Entity is in the area of interest, send the update.
+		Decision_Enter,		// Entity has entered the area of interest, send a full update for the entity.
+		Decision_Leave,		// Entity has left the area of interest, send this update, but not subsequent ones.
+		Decision_Suppress	// Entity is outside of the area of interest, don't send the update.
+	};
+
+	// Updates the client's set of stale entities.
+	Decision processUpdate(ClientInterestState& client, uint64 entity_key, const Vec3d& entity_pos) const;
+
+	// Sends packets to the sinks (clients connected to the world), filtering updates by area of interest,
+	// and sends full updates for stale entities that have re-entered a client's area of interest.
+	// The mutex of the world must be held.
+	void deliverPackets(ServerWorldState& world_state, const std::vector<BroadcastPacket>& packets, const std::vector<BroadcastSink*>& sinks, SocketBufferOutStream& scratch_packet);
+
+	static uint64 objectEntityKey(const UID& uid) { return uid.value() << 1; }
+	static uint64 avatarEntityKey(const UID& uid) { return (uid.value() << 1) | 1; }
+
+	static void test();
+
+	uint64 num_updates_suppressed;
+	uint64 num_enter_events;
+	uint64 num_leave_events;
+
+private:
+	// Writes a full update for the entity to scratch_packet.  Returns false if the entity no longer exists.
+	bool writeFullEntityUpdate(ServerWorldState& world_state, uint64 entity_key, SocketBufferOutStream& scratch_packet) const;
+	// Gets the current position of the entity.  Returns false if the entity no longer exists.
+	bool getEntityPos(ServerWorldState& world_state, uint64 entity_key, Vec3d& pos_out) const;
+	// Makes TransformUpdateBatch messages containing the updates, and appends them to batches_out.
+	void makeTransformUpdateBatches(const std::vector<const TransformUpdate*>& updates, SocketBufferOutStream& scratch_packet, std::vector<SharedPacketRef>& batches_out);
+	// Resends, over TCP, the last update sent by UDP for each entity that wasn't updated this tick (or for all entities if settle_all is true).
+	void settleUDPTransformUpdates(ServerWorldState& world_state, BroadcastSink* sink, ClientUDPTransformState& udp_state, bool settle_all, SocketBufferOutStream& scratch_packet);
+	// Sends the updates to the client as UDP datagrams.
+	void sendTransformDatagrams(BroadcastSink* sink, ClientUDPTransformState& udp_state, const std::vector<const TransformUpdate*>& updates);
+
+	double radius;
+	double hysteresis;
+
+	std::vector<const TransformUpdate*> all_transform_updates;
+	std::vector<SharedPacketRef> all_transform_update_batches; // Batches of all transform updates for the tick, shared between clients that receive all updates.
+	std::vector<const TransformUpdate*> sink_transform_updates;
+	std::vector<SharedPacketRef> sink_transform_update_batches;
+	std::vector<const TransformUpdate*> temp_batch_updates;
+
+	uint32 udp_seq_num; // Sequence number for transform datagrams, incremented each deliverPackets() call.
+	std::vector<const TransformUpdate*> sink_udp_updates;
+	std::vector<TransformUpdate> settled_updates;
+	std::vector<const TransformUpdate*> settled_update_ptrs;
+	SocketBufferOutStream datagrams;
+	std::vector<size_t> datagram_ends;
+};
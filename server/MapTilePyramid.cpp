@@ -0,0 +1,587 @@
+/*=====================================================================
+MapTilePyramid.cpp
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "MapTilePyramid.h"
+
+
+#include "../shared/ImageDecoding.h"
+#include <graphics/jpegdecoder.h>
+#include <ConPrint.h>
+#include <Exception.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <FileUtils.h>
+#include <CryptoRNG.h>
+
+
+static inline int floorDiv2(int x)
+{
+	return (x >= 0) ? (x / 2) : -((-x + 1) / 2);
+}
+
+
+Vec3<int> MapTilePyramid::getParentTileCoords(const Vec3<int>& tile_coords)
+{
+	return Vec3<int>(floorDiv2(tile_coords.x), floorDiv2(tile_coords.y), tile_coords.z - 1);
+}
+
+
+Vec3<int> MapTilePyramid::getChildTileCoords(const Vec3<int>& tile_coords, int i, int j)
+{
+	return Vec3<int>(tile_coords.x * 2 + i, tile_coords.y * 2 + j, tile_coords.z + 1);
+}
+
+
+bool MapTilePyramid::isRenderedTile(const MapTileInfo& map_tile_info, const Vec3<int>& tile_coords)
+{
+	if(tile_coords.z >= MAX_TILE_Z)
+		return true;
+
+	for(int j=0; j<2; ++j)
+	for(int i=0; i<2; ++i)
+		if(map_tile_info.info.count(getChildTileCoords(tile_coords, i, j)) != 0)
+			return false;
+
+	return true; // No child tiles to build this tile from.
+}
+
+
+void MapTilePyramid::markAncestorTilesAsChanged(ServerAllWorldsState& world_state, const Vec3<int>& tile_coords)
+{
+	uint64 next_shot_id = world_state.getNextScreenshotUID();
+
+	for(Vec3<int> v = getParentTileCoords(tile_coords); v.z >= MIN_TILE_Z; v = getParentTileCoords(v))
+	{
+		auto res = world_state.map_tile_info.info.find(v);
+		if(res == world_state.map_tile_info.info.end())
+			continue;
+
+		TileInfo& tile_info = res->second;
+
+		// Keep the current screenshot, if done, so it can be served until the new one is built.
+		if(tile_info.cur_tile_screenshot.nonNull() && tile_info.cur_tile_screenshot->state == Screenshot::ScreenshotState_done)
+			tile_info.prev_tile_screenshot = tile_info.cur_tile_screenshot;
+
+		// Always make a new screenshot, even if the current one is not done yet, so that if the current one is being built from the old children, buildChangedTiles() will discard it.
+		tile_info.cur_tile_screenshot = new Screenshot();
+		tile_info.cur_tile_screenshot->id = next_shot_id++;
+		tile_info.cur_tile_screenshot->created_time = TimeStamp::currentTime();
+		tile_info.cur_tile_screenshot->state = Screenshot::ScreenshotState_notdone;
+		tile_info.cur_tile_screenshot->is_map_tile = true;
+		tile_info.cur_tile_screenshot->tile_x = v.x;
+		tile_info.cur_tile_screenshot->tile_y = v.y;
+		tile_info.cur_tile_screenshot->tile_z = v.z;
+	}
+
+	world_state.map_tile_info.db_dirty = true;
+	world_state.markAsChanged();
+}
+
+
+ImageMapUInt8Ref MapTilePyramid::downsampleChildTiles(const ImageMapUInt8* const child_tiles[4])
+{
+	const ImageMapUInt8* first_child = NULL;
+	for(int i=0; i<4; ++i)
+		if(child_tiles[i] && !first_child)
+			first_child = child_tiles[i];
+	if(!first_child)
+		throw glare::Exception("No child tiles");
+
+	const size_t W = first_child->getMapWidth();
+	const size_t H = first_child->getMapHeight();
+	const size_t N = first_child->getN();
+	if(W % 2 != 0 || H % 2 != 0)
+		throw glare::Exception("Child tile width and height must be even");
+
+	for(int i=0; i<4; ++i)
+		if(child_tiles[i] && (child_tiles[i]->getMapWidth() != W || child_tiles[i]->getMapHeight() != H || child_tiles[i]->getN() != N))
+			throw glare::Exception("Child tiles have different sizes or numbers of channels");
+
+	ImageMapUInt8Ref parent = new ImageMapUInt8(W, H, N);
+	parent->zero();
+
+	const size_t half_W = W / 2;
+	const size_t half_H = H / 2;
+	for(int j=0; j<2; ++j)
+	for(int i=0; i<2; ++i)
+	{
+		const ImageMapUInt8* child = child_tiles[i + 2*j];
+		if(!child)
+			continue;
+
+		// The children with the greater y coordinate go in the top half of the image.
+		const size_t dest_x0 = i * half_W;
+		const size_t dest_y0 = (1 - j) * half_H;
+
+		for(size_t y=0; y<half_H; ++y)
+		{
+			const uint8* src_row_0 = child->getPixel(0, 2*y);
+			const uint8* src_row_1 = child->getPixel(0, 2*y + 1);
+			uint8* dest = parent->getPixel(dest_x0, dest_y0 + y);
+
+			for(size_t x=0; x<half_W; ++x)
+				for(size_t c=0; c<N; ++c)
+				{
+					const uint32 sum = (uint32)src_row_0[(2*x)*N + c] + (uint32)src_row_0[(2*x + 1)*N + c] + (uint32)src_row_1[(2*x)*N + c] + (uint32)src_row_1[(2*x + 1)*N + c];
+					dest[x*N + c] = (uint8)((sum + 2) / 4); // Round to nearest
+				}
+		}
+	}
+
+	return parent;
+}
+
+
+static ImageMapUInt8Ref loadTileImage(const std::string& path)
+{
+	Reference<Map2D> map = ImageDecoding::decodeImage(".", path);
+	if(!map.isType<ImageMapUInt8>())
+		throw glare::Exception("Tile image '" + path + "' is not an 8-bit image");
+	return map.downcast<ImageMapUInt8>();
+}
+
+
+struct ChangedTileToBuild
+{
+	Vec3<int> tile_coords;
+	ScreenshotRef screenshot; // The not-done screenshot for the tile.
+	std::string child_paths[4]; // Local paths of the child tile images, indexed by i + 2*j.  Empty for missing children.
+};
+
+
+// Gets the local paths of the images of the child tiles.  Returns false if any child tile is not done yet.
+static bool getChildTilePaths(const MapTileInfo& map_tile_info, const Vec3<int>& tile_coords, std::string child_paths_out[4])
+{
+	for(int j=0; j<2; ++j)
+	for(int i=0; i<2; ++i)
+	{
+		child_paths_out[i + 2*j].clear();
+
+		auto res = map_tile_info.info.find(MapTilePyramid::getChildTileCoords(tile_coords, i, j));
+		if(res != map_tile_info.info.end())
+		{
+			const TileInfo& child_info = res->second;
+			if(child_info.cur_tile_screenshot.nonNull())
+			{
+				if(child_info.cur_tile_screenshot->state != Screenshot::ScreenshotState_done)
+					return false;
+				child_paths_out[i + 2*j] = child_info.cur_tile_screenshot->local_path;
+			}
+			else if(child_info.prev_tile_screenshot.nonNull() && child_info.prev_tile_screenshot->state == Screenshot::ScreenshotState_done)
+				child_paths_out[i + 2*j] = child_info.prev_tile_screenshot->local_path;
+		}
+	}
+	return true;
+}
+
+
+size_t MapTilePyramid::buildChangedTiles(ServerAllWorldsState& world_state, const std::string& screenshot_dir)
+{
+	size_t num_built = 0;
+
+	// Build the finest levels first, so that changes propagate all the way up the pyramid in one call.
+	for(int z = MAX_TILE_Z - 1; z >= MIN_TILE_Z; --z)
+	{
+		std::vector<ChangedTileToBuild> tiles_to_build;
+		{
+			Lock lock(world_state.mutex);
+
+			for(auto it = world_state.map_tile_info.info.begin(); it != world_state.map_tile_info.info.end(); ++it)
+			{
+				const TileInfo& tile_info = it->second;
+				if(it->first.z == z && tile_info.cur_tile_screenshot.nonNull() && tile_info.cur_tile_screenshot->state == Screenshot::ScreenshotState_notdone && 
+					!isRenderedTile(world_state.map_tile_info, it->first))
+				{
+					ChangedTileToBuild tile;
+					tile.tile_coords = it->first;
+					tile.screenshot = tile_info.cur_tile_screenshot;
+					if(getChildTilePaths(world_state.map_tile_info, tile.tile_coords, tile.child_paths))
+						tiles_to_build.push_back(tile);
+				}
+			}
+		} // End lock scope
+
+		for(size_t t=0; t<tiles_to_build.size(); ++t)
+		{
+			const ChangedTileToBuild& tile = tiles_to_build[t];
+			try
+			{
+				ImageMapUInt8Ref child_images[4];
+				const ImageMapUInt8* child_image_ptrs[4];
+				for(int i=0; i<4; ++i)
+				{
+					if(!tile.child_paths[i].empty())
+						child_images[i] = loadTileImage(tile.child_paths[i]);
+					child_image_ptrs[i] = child_images[i].ptr();
+				}
+
+				ImageMapUInt8Ref tile_image = downsampleChildTiles(child_image_ptrs);
+
+				// Save with a random filename, as WorkerThread does for screenshots from the screenshot bot.
+				const int NUM_BYTES = 16;
+				uint8 pathdata[NUM_BYTES];
+				CryptoRNG::getRandomBytes(pathdata, NUM_BYTES);
+				const std::string screenshot_filename = "screenshot_" + StringUtils::convertByteArrayToHexString(pathdata, NUM_BYTES) + ".jpg";
+				const std::string screenshot_path = screenshot_dir + "/" + screenshot_filename;
+
+				JPEGDecoder::SaveOptions options;
+				options.quality = 95;
+				JPEGDecoder::save(tile_image, screenshot_path, options);
+
+				// Add map tile as a resource too, for access by embedded minimap on client.
+				const std::string URL = screenshot_filename;
+				ResourceRef resource = world_state.resource_manager->getOrCreateResourceForURL(URL);
+				FileUtils::copyFile(screenshot_path, world_state.resource_manager->getLocalAbsPathForResource(*resource));
+				resource->owner_id = UserID::invalidUserID();
+				resource->setState(Resource::State_Present);
+
+				{
+					Lock lock(world_state.mutex);
+
+					world_state.addResourcesAsDBDirty(resource);
+
+					// If the tile was changed again while we were building it, discard this build.  The new screenshot will be built on a later call.
+					auto res = world_state.map_tile_info.info.find(tile.tile_coords);
+					if(res != world_state.map_tile_info.info.end() && res->second.cur_tile_screenshot == tile.screenshot)
+					{
+						tile.screenshot->local_path = screenshot_path;
+						tile.screenshot->URL = URL;
+						tile.screenshot->state = Screenshot::ScreenshotState_done;
+						world_state.addScreenshotAsDBDirty(tile.screenshot);
+						world_state.map_tile_info.db_dirty = true;
+						num_built++;
+					}
+				} // End lock scope
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("MapTilePyramid: failed to build tile " + tile.tile_coords.toString() + ": " + e.what());
+			}
+			catch(FileUtils::FileUtilsExcep& e)
+			{
+				conPrint("MapTilePyramid: failed to build tile " + tile.tile_coords.toString() + ": " + e.what());
+			}
+		}
+	}
+
+	return num_built;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <PlatformUtils.h>
+#include <map>
+#include <cmath>
+
+
+// A smooth synthetic tile image, different for each tile, so it compresses well as a JPEG.
+static ImageMapUInt8Ref makeSyntheticTileImage(size_t W, size_t H, const Vec3<int>& tile_coords, int variant)
+{
+	ImageMapUInt8Ref image = new ImageMapUInt8(W, H, 3);
+	for(size_t y=0; y<H; ++y)
+	for(size_t x=0; x<W; ++x)
+	{
+		uint8* pixel = image->getPixel(x, y);
+		pixel[0] = (uint8)(20 + x * 3 + (tile_coords.x & 7) * 10 + variant * 15);
+		pixel[1] = (uint8)(20 + y * 3 + (tile_coords.y & 7) * 10);
+		pixel[2] = (uint8)(100 + (x + y) * (1 + (tile_coords.x & 1)) + (tile_coords.z & 3) * 5);
+	}
+	return image;
+}
+
+
+// Reference implementation: stitch the four children into one image of twice the size (with +y at the top), then apply a 2x2 box filter.
+static ImageMapUInt8Ref referenceParentImage(const ImageMapUInt8* const child_tiles[4], size_t W, size_t H, size_t N)
+{
+	ImageMapUInt8 stitched(W * 2, H * 2, N);
+	for(size_t y=0; y<H*2; ++y)
+	for(size_t x=0; x<W*2; ++x)
+	{
+		const int i = (x < W) ? 0 : 1;
+		const int j = (y < H) ? 1 : 0; // Top half of the image is the children with greater y.
+		const ImageMapUInt8* child = child_tiles[i + 2*j];
+		for(size_t c=0; c<N; ++c)
+			stitched.getPixel(x, y)[c] = child ? child->getPixel(x % W, y % H)[c] : 0;
+	}
+
+	ImageMapUInt8Ref parent = new ImageMapUInt8(W, H, N);
+	for(size_t y=0; y<H; ++y)
+	for(size_t x=0; x<W; ++x)
+		for(size_t c=0; c<N; ++c)
+		{
+			const int sum = stitched.getPixel(2*x, 2*y)[c] + stitched.getPixel(2*x + 1, 2*y)[c] + stitched.getPixel(2*x, 2*y + 1)[c] + stitched.getPixel(2*x + 1, 2*y + 1)[c];
+			parent->getPixel(x, y)[c] = (uint8)((sum + 2) / 4);
+		}
+	return parent;
+}
+
+
+// Returns the max absolute difference between pixel values of the images, and the mean absolute difference in mean_diff_out.
+static int imageDifference(const ImageMapUInt8& a, const ImageMapUInt8& b, double& mean_diff_out)
+{
+	testAssert(a.getMapWidth() == b.getMapWidth() && a.getMapHeight() == b.getMapHeight() && a.getN() == b.getN());
+	int max_diff = 0;
+	double sum_diff = 0;
+	for(size_t y=0; y<a.getMapHeight(); ++y)
+	for(size_t x=0; x<a.getMapWidth(); ++x)
+		for(size_t c=0; c<a.getN(); ++c)
+		{
+			const int diff = std::abs((int)a.getPixel(x, y)[c] - (int)b.getPixel(x, y)[c]);
+			max_diff = myMax(max_diff, diff);
+			sum_diff += diff;
+		}
+	mean_diff_out = sum_diff / (a.getMapWidth() * a.getMapHeight() * a.getN());
+	return max_diff;
+}
+
+
+static void saveTestTileImage(const ImageMapUInt8Ref& image, const std::string& path)
+{
+	JPEGDecoder::SaveOptions options;
+	options.quality = 95;
+	JPEGDecoder::save(image, path, options);
+}
+
+
+static void addTestTile(ServerAllWorldsState& world_state, const Vec3<int>& v, uint64 id, bool done, const std::string& local_path)
+{
+	TileInfo info;
+	info.cur_tile_screenshot = new Screenshot();
+	info.cur_tile_screenshot->id = id;
+	info.cur_tile_screenshot->state = done ? Screenshot::ScreenshotState_done : Screenshot::ScreenshotState_notdone;
+	info.cur_tile_screenshot->is_map_tile = true;
+	info.cur_tile_screenshot->tile_x = v.x;
+	info.cur_tile_screenshot->tile_y = v.y;
+	info.cur_tile_screenshot->tile_z = v.z;
+	info.cur_tile_screenshot->local_path = local_path;
+	world_state.map_tile_info.info[v] = info;
+}
+
+
+// Checks the image of a built tile against the reference box filter of its child tile images.  Tile images are JPEGs, so allow for some compression error.
+static void checkBuiltTile(ServerAllWorldsState& world_state, const Vec3<int>& v)
+{
+	std::string tile_path;
+	std::string child_paths[4];
+	{
+		Lock lock(world_state.mutex);
+		const TileInfo& info = world_state.map_tile_info.info[v];
+		testAssert(info.cur_tile_screenshot->state == Screenshot::ScreenshotState_done);
+		testAssert(!info.cur_tile_screenshot->URL.empty());
+		tile_path = info.cur_tile_screenshot->local_path;
+		testAssert(getChildTilePaths(world_state.map_tile_info, v, child_paths));
+	}
+
+	ImageMapUInt8Ref children[4];
+	const ImageMapUInt8* child_ptrs[4];
+	for(int i=0; i<4; ++i)
+	{
+		if(!child_paths[i].empty())
+			children[i] = loadTileImage(child_paths[i]);
+		child_ptrs[i] = children[i].ptr();
+	}
+
+	ImageMapUInt8Ref tile_image = loadTileImage(tile_path);
+	ImageMapUInt8Ref ref_image = referenceParentImage(child_ptrs, tile_image->getMapWidth(), tile_image->getMapHeight(), tile_image->getN());
+
+	double mean_diff;
+	const int max_diff = imageDifference(*tile_image, *ref_image, mean_diff);
+	testAssert(max_diff <= 24);
+	testAssert(mean_diff <= 3.0);
+}
+
+
+void MapTilePyramid::test()
+{
+	conPrint("MapTilePyramid::test()");
+
+	//-------------------------- Test tile coordinates --------------------------
+	{
+		testAssert(getParentTileCoords(Vec3<int>(0, 0, 6)) == Vec3<int>(0, 0, 5));
+		testAssert(getParentTileCoords(Vec3<int>(3, 2, 6)) == Vec3<int>(1, 1, 5));
+		testAssert(getParentTileCoords(Vec3<int>(-1, -2, 6)) == Vec3<int>(-1, -1, 5));
+		testAssert(getParentTileCoords(Vec3<int>(-3, -4, 6)) == Vec3<int>(-2, -2, 5));
+
+		for(int y=-5; y<5; ++y)
+		for(int x=-5; x<5; ++x)
+		{
+			const Vec3<int> v(x, y, 3);
+			for(int j=0; j<2; ++j)
+			for(int i=0; i<2; ++i)
+				testAssert(getParentTileCoords(getChildTileCoords(v, i, j)) == v);
+		}
+	}
+
+	//-------------------------- Test building a pyramid from synthetic tiles, checking each parent against the reference box filter --------------------------
+	try
+	{
+		const size_t W = 16;
+		const size_t H = 12;
+		const int base_z = 3;
+
+		std::map<Vec3<int>, ImageMapUInt8Ref> tiles;
+		for(int y=-3; y<2; ++y)
+		for(int x=-4; x<3; ++x)
+			if(!(x == 1 && y == -2)) // Leave out a tile, so there is a parent with a missing child.
+				tiles[Vec3<int>(x, y, base_z)] = makeSyntheticTileImage(W, H, Vec3<int>(x, y, base_z), /*variant=*/0);
+
+		size_t num_parents_checked = 0;
+		for(int z = base_z - 1; z >= 0; --z)
+		{
+			// Get the parents of the tiles at level z + 1
+			std::map<Vec3<int>, bool> parents;
+			for(auto it = tiles.begin(); it != tiles.end(); ++it)
+				if(it->first.z == z + 1)
+					parents[getParentTileCoords(it->first)] = true;
+
+			for(auto it = parents.begin(); it != parents.end(); ++it)
+			{
+				const ImageMapUInt8* children[4];
+				for(int j=0; j<2; ++j)
+				for(int i=0; i<2; ++i)
+				{
+					auto res = tiles.find(getChildTileCoords(it->first, i, j));
+					children[i + 2*j] = (res != tiles.end()) ? res->second.ptr() : NULL;
+				}
+
+				ImageMapUInt8Ref parent = downsampleChildTiles(children);
+				ImageMapUInt8Ref ref_parent = referenceParentImage(children, W, H, 3);
+
+				double mean_diff;
+				testAssert(imageDifference(*parent, *ref_parent, mean_diff) == 0);
+
+				tiles[it->first] = parent;
+				num_parents_checked++;
+			}
+		}
+		testAssert(tiles.count(Vec3<int>(0, 0, 0)) == 1);
+		testAssert(tiles.count(Vec3<int>(-1, -1, 0)) == 1);
+		testAssert(num_parents_checked > 10);
+
+		// Mismatched child sizes
+		{
+			ImageMapUInt8Ref a = makeSyntheticTileImage(W, H, Vec3<int>(0, 0, 0), 0);
+			ImageMapUInt8Ref b = makeSyntheticTileImage(W, H + 2, Vec3<int>(0, 0, 0), 0);
+			const ImageMapUInt8* children[4] = { a.ptr(), b.ptr(), NULL, NULL };
+			try
+			{
+				downsampleChildTiles(children);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	//-------------------------- Test buildChangedTiles --------------------------
+	try
+	{
+		const std::string test_dir = PlatformUtils::getTempDirPath() + "/map_tile_pyramid_test";
+		const std::string screenshot_dir = test_dir + "/screenshots";
+		FileUtils::createDirIfDoesNotExist(test_dir);
+		FileUtils::createDirIfDoesNotExist(screenshot_dir);
+		FileUtils::createDirIfDoesNotExist(test_dir + "/resources");
+
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->resource_manager = new ResourceManager(test_dir + "/resources");
+
+		const size_t W = 32;
+		const size_t H = 32;
+		const int Z = MAX_TILE_Z;
+
+		// Rendered tiles at MAX_TILE_Z: x in [0, 4), y in [0, 2).  Coarser tiles: (0, 0), (1, 0) at Z-1, and (0, 0) at Z-2.
+		{
+			Lock lock(world_state->mutex);
+			uint64 next_id = 1;
+			for(int y=0; y<2; ++y)
+			for(int x=0; x<4; ++x)
+			{
+				const std::string path = test_dir + "/tile_" + toString(x) + "_" + toString(y) + ".jpg";
+				saveTestTileImage(makeSyntheticTileImage(W, H, Vec3<int>(x, y, Z), /*variant=*/0), path);
+				addTestTile(*world_state, Vec3<int>(x, y, Z), next_id++, /*done=*/true, path);
+			}
+			addTestTile(*world_state, Vec3<int>(0, 0, Z-1), next_id++, /*done=*/false, "");
+			addTestTile(*world_state, Vec3<int>(1, 0, Z-1), next_id++, /*done=*/false, "");
+			addTestTile(*world_state, Vec3<int>(0, 0, Z-2), next_id++, /*done=*/false, "");
+
+			testAssert(isRenderedTile(world_state->map_tile_info, Vec3<int>(0, 0, Z)));
+			testAssert(!isRenderedTile(world_state->map_tile_info, Vec3<int>(0, 0, Z-1)));
+			testAssert(!isRenderedTile(world_state->map_tile_info, Vec3<int>(0, 0, Z-2)));
+			testAssert(isRenderedTile(world_state->map_tile_info, Vec3<int>(5, 5, Z-1))); // No children
+		}
+
+		// Build the whole pyramid
+		testAssert(buildChangedTiles(*world_state, screenshot_dir) == 3);
+		checkBuiltTile(*world_state, Vec3<int>(0, 0, Z-1));
+		checkBuiltTile(*world_state, Vec3<int>(1, 0, Z-1));
+		checkBuiltTile(*world_state, Vec3<int>(0, 0, Z-2)); // Has two missing children.
+
+		testAssert(buildChangedTiles(*world_state, screenshot_dir) == 0); // Nothing has changed.
+
+		// Change a rendered tile.  Only its ancestors should be rebuilt.
+		ScreenshotRef unchanged_tile_shot, changed_parent_old_shot;
+		{
+			Lock lock(world_state->mutex);
+			unchanged_tile_shot = world_state->map_tile_info.info[Vec3<int>(0, 0, Z-1)].cur_tile_screenshot;
+			changed_parent_old_shot = world_state->map_tile_info.info[Vec3<int>(1, 0, Z-1)].cur_tile_screenshot;
+
+			const std::string path = test_dir + "/tile_3_1_changed.jpg";
+			saveTestTileImage(makeSyntheticTileImage(W, H, Vec3<int>(3, 1, Z), /*variant=*/3), path);
+			world_state->map_tile_info.info[Vec3<int>(3, 1, Z)].cur_tile_screenshot->local_path = path;
+
+			markAncestorTilesAsChanged(*world_state, Vec3<int>(3, 1, Z));
+
+			const TileInfo& changed_parent = world_state->map_tile_info.info[Vec3<int>(1, 0, Z-1)];
+			testAssert(changed_parent.cur_tile_screenshot->state == Screenshot::ScreenshotState_notdone);
+			testAssert(changed_parent.prev_tile_screenshot == changed_parent_old_shot); // The old tile image is kept for serving until the new one is built.
+			testAssert(world_state->map_tile_info.info[Vec3<int>(0, 0, Z-2)].cur_tile_screenshot->state == Screenshot::ScreenshotState_notdone);
+			testAssert(world_state->map_tile_info.info[Vec3<int>(0, 0, Z-1)].cur_tile_screenshot == unchanged_tile_shot);
+		}
+
+		testAssert(buildChangedTiles(*world_state, screenshot_dir) == 2);
+		checkBuiltTile(*world_state, Vec3<int>(1, 0, Z-1));
+		checkBuiltTile(*world_state, Vec3<int>(0, 0, Z-2));
+		{
+			Lock lock(world_state->mutex);
+			testAssert(world_state->map_tile_info.info[Vec3<int>(0, 0, Z-1)].cur_tile_screenshot == unchanged_tile_shot);
+			testAssert(world_state->map_tile_info.info[Vec3<int>(1, 0, Z-1)].cur_tile_screenshot->local_path != changed_parent_old_shot->local_path);
+		}
+
+		// Ancestors aren't built until all their children are done.
+		{
+			Lock lock(world_state->mutex);
+			world_state->map_tile_info.info[Vec3<int>(0, 0, Z)].cur_tile_screenshot->state = Screenshot::ScreenshotState_notdone;
+			markAncestorTilesAsChanged(*world_state, Vec3<int>(0, 0, Z));
+		}
+		testAssert(buildChangedTiles(*world_state, screenshot_dir) == 0);
+		{
+			Lock lock(world_state->mutex);
+			world_state->map_tile_info.info[Vec3<int>(0, 0, Z)].cur_tile_screenshot->state = Screenshot::ScreenshotState_done;
+		}
+		testAssert(buildChangedTiles(*world_state, screenshot_dir) == 2);
+		checkBuiltTile(*world_state, Vec3<int>(0, 0, Z-1));
+		checkBuiltTile(*world_state, Vec3<int>(0, 0, Z-2));
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("MapTilePyramid::test() done");
+}
+
+
+#endif // BUILD_TESTS
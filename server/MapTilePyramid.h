@@ -0,0 +1,62 @@
+/*=====================================================================
+MapTilePyramid.h
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "ServerWorldState.h"
+#include <graphics/ImageMap.h>
+#include <string>
+
+
+/*=====================================================================
+MapTilePyramid
+--------------
+Builds the map tiles at the coarser zoom levels by downsampling the tiles
+at the next finer level, instead of having the screenshot bot render every
+zoom level.
+
+Tile (x, y, z) covers 5120 / 2^z metres along each axis, so its four child
+tiles at level z + 1 are (2x + i, 2y + j, z + 1) for i, j in {0, 1}.  A
+parent tile is made by stitching the four child images together and
+filtering with a 2x2 box filter, so it has the same resolution as the
+children.  Tile images have +y at the top.
+
+The screenshot bot only renders the 'rendered' tiles: the tiles at
+MAX_TILE_Z, and any coarser tiles that have no child tiles (so have nothing
+to be built from).
+
+When a tile changes, markAncestorTilesAsChanged() gives each of its
+ancestors a new not-done screenshot, keeping the old one as the previous
+screenshot so it can still be served.  MapTilePyramidThread then
+periodically calls buildChangedTiles(), which rebuilds just those
+ancestors, from the finest level to the coarsest, once all their children
+are done.
+=====================================================================*/
+class MapTilePyramid
+{
+public:
+	static const int MIN_TILE_Z = 0;
+	static const int MAX_TILE_Z = 6; // The most detailed zoom level, which is rendered by the screenshot bot.
+
+	static Vec3<int> getParentTileCoords(const Vec3<int>& tile_coords);
+	static Vec3<int> getChildTileCoords(const Vec3<int>& tile_coords, int i, int j); // i, j in {0, 1}.
+
+	// Returns true if the tile should be rendered by the screenshot bot, instead of being built from child tiles.
+	static bool isRenderedTile(const MapTileInfo& map_tile_info, const Vec3<int>& tile_coords);
+
+	// Gives each ancestor of the tile a new screenshot in the not-done state, so it will be rebuilt by buildChangedTiles().
+	static void markAncestorTilesAsChanged(ServerAllWorldsState& world_state, const Vec3<int>& tile_coords) REQUIRES(world_state.mutex);
+
+	// Makes a parent tile image from the images of its four child tiles.  child_tiles[i + 2*j] is the image of child (2x + i, 2y + j).
+	// Missing child tiles may be NULL, and are left black in the parent.  Throws glare::Exception if the child images don't all have the same (even) size and number of channels.
+	static ImageMapUInt8Ref downsampleChildTiles(const ImageMapUInt8* const child_tiles[4]);
+
+	// Builds the changed tiles whose children are all done, saving the images in screenshot_dir.  Locks world_state.mutex, but not while loading and saving images.
+	// Returns the number of tiles built.
+	static size_t buildChangedTiles(ServerAllWorldsState& world_state, const std::string& screenshot_dir);
+
+	static void test();
+};
@@ -0,0 +1,55 @@
+/*=====================================================================
+MapTilePyramidThread.cpp
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "MapTilePyramidThread.h"
+
+
+#include "MapTilePyramid.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+#include <KillThreadMessage.h>
+
+
+MapTilePyramidThread::MapTilePyramidThread(ServerAllWorldsState* world_state_, const std::string& screenshot_dir_)
+:	world_state(world_state_), screenshot_dir(screenshot_dir_)
+{
+}
+
+
+MapTilePyramidThread::~MapTilePyramidThread()
+{
+}
+
+
+void MapTilePyramidThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("MapTilePyramidThread");
+
+	try
+	{
+		while(1)
+		{
+			// Block for a while, or until we have a message
+			ThreadMessageRef msg;
+			const bool got_msg = getMessageQueue().dequeueWithTimeout(/*wait_time_seconds=*/20.0, msg);
+			if(got_msg && dynamic_cast<KillThreadMessage*>(msg.ptr()))
+				return;
+
+			const size_t num_built = MapTilePyramid::buildChangedTiles(*world_state, screenshot_dir);
+			if(num_built > 0)
+				conPrint("MapTilePyramidThread: built " + toString(num_built) + " map tile(s)");
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MapTilePyramidThread: glare::Exception: " + e.what());
+	}
+	catch(std::exception& e) // catch std::bad_alloc etc..
+	{
+		conPrint(std::string("MapTilePyramidThread: Caught std::exception: ") + e.what());
+	}
+}
@@ -0,0 +1,32 @@
+/*=====================================================================
+MapTilePyramidThread.h
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <MessageableThread.h>
+#include <string>
+class ServerAllWorldsState;
+
+
+/*=====================================================================
+MapTilePyramidThread
+--------------------
+Periodically rebuilds the changed map tiles at the coarser zoom levels from
+their child tiles.  See MapTilePyramid.
+=====================================================================*/
+class MapTilePyramidThread : public MessageableThread
+{
+public:
+	MapTilePyramidThread(ServerAllWorldsState* world_state, const std::string& screenshot_dir);
+
+	virtual ~MapTilePyramidThread();
+
+	virtual void doRun();
+
+private:
+	ServerAllWorldsState* world_state;
+	std::string screenshot_dir;
+};
@@ -48,6 +48,51 @@ struct LODMeshToGen
 };
 
 
+// Adds LOD models to the resources as they are generated.
+class MeshLODGenResultHandler : public LODGeneration::LODModelsGeneratedHandler
+{
+public:
+	virtual void LODModelsGenerated(size_t job_index, const std::vector<std::string>& errors)
+	{
+		const std::vector<size_t>& mesh_indices = (*job_mesh_indices)[job_index];
+		assert(mesh_indices.size() == errors.size());
+
+		for(size_t z=0; z<mesh_indices.size(); ++z)
+		{
+			const LODMeshToGen& mesh_to_gen = (*meshes_to_gen)[mesh_indices[z]];
+			if(!errors[z].empty())
+			{
+				conPrint("\tMeshLODGenThread: Error while generating LOD model '" + mesh_to_gen.lod_URL + "': " + errors[z]);
+				continue;
+			}
+
+			conPrint("MeshLODGenThread: Generated LOD mesh with URL " + mesh_to_gen.lod_URL);
+
+			// Now that we have generated the LOD model, add it to resources.
+			{ // lock scope
+				Lock lock(world_state->mutex);
+
+				const std::string raw_path = FileUtils::getFilename(mesh_to_gen.LOD_model_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
+
+				ResourceRef resource = new Resource(
+					mesh_to_gen.lod_URL, // URL
+					raw_path, // raw local path
+					Resource::State_Present, // state
+					mesh_to_gen.owner_id
+				);
+
+				world_state->addResourcesAsDBDirty(resource);
+				world_state->resource_manager->addResource(resource);
+			} // End lock scope
+		}
+	}
+
+	ServerAllWorldsState* world_state;
+	const std::vector<LODMeshToGen>* meshes_to_gen;
+	const std::vector<std::vector<size_t>>* job_mesh_indices;
+};
+
+
 struct LODTextureToGen
 {
 	std::string source_tex_abs_path; // Absolute base texture path, to read texture from.
@@ -147,7 +192,7 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 		// Compute and assign aabb_ws to object.
 		if(!aabb_os.isEmpty()) // If we got a valid aabb_os:
 		{
-			Lock lock(world_state->mutex);
+			Lock lock(world->mutex);
 
 			const bool updating_aabb_ws = !(approxEq(aabb_os.min_, ob->getAABBOS().min_) && approxEq(aabb_os.max_, ob->getAABBOS().max_)); //aabb_os != ob->getAABBOS();
 			if(updating_aabb_ws)
@@ -311,7 +356,7 @@ static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldSta
 							if(mat->flags != old_flags)
 							{
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(world->mutex);
 									world->addWorldObjectAsDBDirty(ob);
 								}
 								conPrint("Updated mat flags: (for mat with tex " + tex_abs_path + "): is_hi_res: " + boolToString(is_high_res));
@@ -497,13 +542,15 @@ void MeshLODGenThread::doRun()
 			Timer timer;
 			
 			{
-				Lock lock(world_state->mutex);
+				std::vector<Reference<ServerWorldState>> worlds;
+				world_state->getWorldStates(worlds);
 
 				if(do_initial_full_scan)
 				{
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
+						ServerWorldState* world = worlds[w].ptr();
+						Lock lock(world->mutex);
 						for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
 						{
 							WorldObject* ob = it->second.ptr();
@@ -530,9 +577,10 @@ void MeshLODGenThread::doRun()
 				else
 				{
 					// Look up object for UID
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
+						ServerWorldState* world = worlds[w].ptr();
+						Lock lock(world->mutex);
 						auto res = world->objects.find(ob_to_scan_UID);
 						if(res != world->objects.end())
 						{
@@ -560,37 +608,42 @@ void MeshLODGenThread::doRun()
 			conPrint("MeshLODGenThread: Generating LOD meshes...");
 			timer.reset();
 
-			for(size_t i=0; i<meshes_to_gen.size(); ++i)
 			{
-				const LODMeshToGen& mesh_to_gen = meshes_to_gen[i];
-				try
+				// Group LOD meshes by source model, so that each source model is only loaded once.
+				std::vector<LODGeneration::LODModelsToGen> jobs;
+				std::vector<std::vector<size_t>> job_mesh_indices; // Indices into meshes_to_gen for each job
+				std::map<std::string, size_t> model_path_to_job_index;
+				for(size_t i=0; i<meshes_to_gen.size(); ++i)
 				{
-					conPrint("MeshLODGenThread: Generating LOD mesh with URL " + mesh_to_gen.lod_URL);
+					const LODMeshToGen& mesh_to_gen = meshes_to_gen[i];
 
-					LODGeneration::generateLODModel(mesh_to_gen.model_abs_path, mesh_to_gen.lod_level, mesh_to_gen.LOD_model_abs_path);
+					auto res = model_path_to_job_index.find(mesh_to_gen.model_abs_path);
+					size_t job_index;
+					if(res == model_path_to_job_index.end())
+					{
+						job_index = jobs.size();
+						model_path_to_job_index[mesh_to_gen.model_abs_path] = job_index;
+						jobs.push_back(LODGeneration::LODModelsToGen());
+						jobs.back().model_path = mesh_to_gen.model_abs_path;
+						job_mesh_indices.push_back(std::vector<size_t>());
+					}
+					else
+						job_index = res->second;
 
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
+					jobs[job_index].lod_levels.push_back(mesh_to_gen.lod_level);
+					jobs[job_index].LOD_model_paths.push_back(mesh_to_gen.LOD_model_abs_path);
+					job_mesh_indices[job_index].push_back(i);
+				}
 
-						const std::string raw_path = FileUtils::getFilename(mesh_to_gen.LOD_model_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
+				MeshLODGenResultHandler handler;
+				handler.world_state = world_state;
+				handler.meshes_to_gen = &meshes_to_gen;
+				handler.job_mesh_indices = &job_mesh_indices;
 
-						ResourceRef resource = new Resource(
-							mesh_to_gen.lod_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							mesh_to_gen.owner_id
-						);
+				// Limit the number of source meshes loaded at once, as they can be large.
+				const size_t max_num_in_flight = myMax<size_t>(1, PlatformUtils::getNumLogicalProcessors());
 
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
-						
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: glare::Exception while generating LOD model: " + e.what());
-				}
+				LODGeneration::generateLODModelsInParallel(jobs, task_manager, max_num_in_flight, handler);
 			}
 
 			conPrint("MeshLODGenThread: Done generating LOD meshes. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
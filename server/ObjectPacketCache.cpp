@@ -0,0 +1,276 @@
+/*=====================================================================
+ObjectPacketCache.cpp
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ObjectPacketCache.h"
+
+
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include <ConPrint.h>
+#include <StringUtils.h>
+#include <cstring>
+
+
+ObjectPacketCache::ObjectPacketCache()
+:	num_hits(0),
+	num_misses(0)
+{
+#ifndef NDEBUG
+	verify_on_hit = true;
+#else
+	verify_on_hit = false;
+#endif
+}
+
+
+ObjectPacketCache::~ObjectPacketCache()
+{
+}
+
+
+void ObjectPacketCache::makeObjectInitialSendPacket(const WorldObject& ob, SocketBufferOutStream& packet_out)
+{
+	MessageUtils::initPacket(packet_out, Protocol::ObjectInitialSend);
+	ob.writeToNetworkStream(packet_out);
+	MessageUtils::updatePacketLengthField(packet_out);
+}
+
+
+bool ObjectPacketCache::packetMatchesObject(const SharedPacket& packet, const WorldObject& ob, SocketBufferOutStream& scratch_packet)
+{
+	makeObjectInitialSendPacket(ob, scratch_packet);
+	return (scratch_packet.buf.size() == packet.data.size()) && (std::memcmp(scratch_packet.buf.data(), packet.data.data(), packet.data.size()) == 0);
+}
+
+
+SharedPacketRef ObjectPacketCache::getObjectInitialSendPacket(const WorldObject& ob, SocketBufferOutStream& scratch_packet)
+{
+	auto res = entries.find(ob.uid);
+	if(res != entries.end() && res->second.network_state_version == ob.network_state_version)
+	{
+		num_hits++;
+
+		if(verify_on_hit && !packetMatchesObject(*res->second.packet, ob, scratch_packet))
+		{
+			conPrint("ERROR: ObjectPacketCache: cached ObjectInitialSend message for object " + ob.uid.toString() + " is stale.  Object was changed without incrementing network_state_version.");
+			assert(0);
+			res->second.packet = SharedPacket::make(scratch_packet); // scratch_packet holds the freshly serialised message.
+		}
+
+		return res->second.packet;
+	}
+
+	num_misses++;
+
+	makeObjectInitialSendPacket(ob, scratch_packet);
+
+	// Make a new packet instead of updating the existing one, as other threads may still hold references to the existing packet.
+	CacheEntry& entry = entries[ob.uid];
+	entry.network_state_version = ob.network_state_version;
+	entry.packet = SharedPacket::make(scratch_packet);
+	return entry.packet;
+}
+
+
+void ObjectPacketCache::removeObject(const UID& uid)
+{
+	entries.erase(uid);
+}
+
+
+void ObjectPacketCache::clear()
+{
+	entries.clear();
+}
+
+
+size_t ObjectPacketCache::verify(const std::map<UID, WorldObjectRef>& objects, SocketBufferOutStream& scratch_packet) const
+{
+	size_t num_wrong = 0;
+	for(auto it = entries.begin(); it != entries.end(); ++it)
+	{
+		auto ob_res = objects.find(it->first);
+		if(ob_res == objects.end())
+			continue; // Object has been removed.  The entry will never be returned, as UIDs are not reused.
+
+		const WorldObject& ob = *ob_res->second;
+		if(it->second.network_state_version == ob.network_state_version && !packetMatchesObject(*it->second.packet, ob, scratch_packet))
+		{
+			conPrint("ERROR: ObjectPacketCache: cached ObjectInitialSend message for object " + ob.uid.toString() + " is stale.");
+			num_wrong++;
+		}
+	}
+	return num_wrong;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ServerTestUtils.h"
+#include "ServerWorldState.h"
+#include <utils/TestUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+
+
+// Makes num_obs test objects, with a model and a material so that more of the object is serialised.  Returns them in the order they were made in obs_out, and keyed by UID in objects_out.
+static void makeTestObjects(ServerAllWorldsState& world_state, PCG32& rng, size_t num_obs, std::vector<WorldObjectRef>& obs_out, std::map<UID, WorldObjectRef>& objects_out)
+{
+	for(size_t i=0; i<num_obs; ++i)
+	{
+		WorldObjectRef ob = ServerTestUtils::makeTestObject(world_state, rng);
+		ob->model_url = "model_" + ob->uid.toString() + ".bmesh";
+		ob->materials.push_back(new WorldMaterial());
+		ob->materials[0]->colour_texture_url = "tex_" + ob->uid.toString() + ".jpg";
+		obs_out.push_back(ob);
+		objects_out[ob->uid] = ob;
+	}
+}
+
+
+static bool packetEquals(const SharedPacket& packet, const SocketBufferOutStream& expected)
+{
+	return (packet.data.size() == expected.buf.size()) && (std::memcmp(packet.data.data(), expected.buf.data(), expected.buf.size()) == 0);
+}
+
+
+void ObjectPacketCache::test()
+{
+	conPrint("ObjectPacketCache::test()");
+
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	SocketBufferOutStream expected(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+	Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+	PCG32 rng(1);
+
+	//-------------------------- Test cache misses, hits and invalidation --------------------------
+	{
+		ObjectPacketCache cache;
+		cache.verify_on_hit = true;
+
+		std::vector<WorldObjectRef> obs;
+		std::map<UID, WorldObjectRef> objects;
+		makeTestObjects(*world_state, rng, 10, obs, objects);
+
+		WorldObjectRef ob = obs[3];
+
+		// First request serialises the object
+		SharedPacketRef packet = cache.getObjectInitialSendPacket(*ob, scratch_packet);
+		makeObjectInitialSendPacket(*ob, expected);
+		testAssert(packetEquals(*packet, expected));
+		testAssert(cache.numMisses() == 1 && cache.numHits() == 0);
+		testAssert(cache.size() == 1);
+
+		// Second request returns the same packet
+		SharedPacketRef packet2 = cache.getObjectInitialSendPacket(*ob, scratch_packet);
+		testAssert(packet2.getPointer() == packet.getPointer());
+		testAssert(cache.numMisses() == 1 && cache.numHits() == 1);
+
+		// Change the object and increment the version.  Should get a new packet, and the old packet should be unchanged, as it may still be in use.
+		ob->pos = Vec3d(100.0, 200.0, 300.0);
+		ob->network_state_version++;
+		SharedPacketRef packet3 = cache.getObjectInitialSendPacket(*ob, scratch_packet);
+		testAssert(packet3.getPointer() != packet.getPointer());
+		testAssert(packetEquals(*packet, expected));
+		makeObjectInitialSendPacket(*ob, expected);
+		testAssert(packetEquals(*packet3, expected));
+		testAssert(cache.numMisses() == 2 && cache.numHits() == 1);
+		testAssert(cache.size() == 1);
+
+		// Fill the cache with all objects, and check it verifies.
+		for(auto it = objects.begin(); it != objects.end(); ++it)
+			cache.getObjectInitialSendPacket(*it->second, scratch_packet);
+		testAssert(cache.size() == objects.size());
+		testAssert(cache.verify(objects, scratch_packet) == 0);
+
+		// Remove an object
+		cache.removeObject(ob->uid);
+		testAssert(cache.size() == objects.size() - 1);
+		cache.removeObject(ob->uid); // Removing again should do nothing.
+		testAssert(cache.size() == objects.size() - 1);
+		objects.erase(ob->uid);
+		testAssert(cache.verify(objects, scratch_packet) == 0);
+
+		cache.clear();
+		testAssert(cache.size() == 0);
+	}
+
+	//-------------------------- Test the verifier finds changes made without incrementing the version --------------------------
+	{
+		ObjectPacketCache cache;
+		cache.verify_on_hit = false;
+
+		std::vector<WorldObjectRef> obs;
+		std::map<UID, WorldObjectRef> objects;
+		makeTestObjects(*world_state, rng, 10, obs, objects);
+		for(size_t i=0; i<obs.size(); ++i)
+			cache.getObjectInitialSendPacket(*obs[i], scratch_packet);
+		testAssert(cache.verify(objects, scratch_packet) == 0);
+
+		// Change some objects without incrementing network_state_version
+		obs[2]->content = "changed content";
+		obs[7]->physics_owner_id = 123;
+		testAssert(cache.verify(objects, scratch_packet) == 2);
+
+		// With verify_on_hit false, the stale packet is returned.
+		makeObjectInitialSendPacket(*obs[2], expected);
+		SharedPacketRef stale_packet = cache.getObjectInitialSendPacket(*obs[2], scratch_packet);
+		testAssert(!packetEquals(*stale_packet, expected));
+
+		// Objects changed with the version incremented are fine.
+		obs[2]->network_state_version++;
+		obs[7]->network_state_version++;
+		testAssert(cache.verify(objects, scratch_packet) == 0);
+		testAssert(packetEquals(*cache.getObjectInitialSendPacket(*obs[2], scratch_packet), expected));
+		testAssert(cache.verify(objects, scratch_packet) == 0);
+	}
+
+	//-------------------------- Perf test: serialising every object vs. using the cache --------------------------
+	if(false)
+	{
+		std::vector<WorldObjectRef> obs;
+		std::map<UID, WorldObjectRef> objects;
+		makeTestObjects(*world_state, rng, 100000, obs, objects);
+
+		ObjectPacketCache cache;
+		cache.verify_on_hit = false;
+		for(auto it = objects.begin(); it != objects.end(); ++it)
+			cache.getObjectInitialSendPacket(*it->second, scratch_packet);
+
+		for(int trial=0; trial<5; ++trial)
+		{
+			SocketBufferOutStream out(SocketBufferOutStream::DontUseNetworkByteOrder);
+			Timer timer;
+			for(auto it = objects.begin(); it != objects.end(); ++it)
+			{
+				makeObjectInitialSendPacket(*it->second, scratch_packet);
+				out.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
+			const double serialise_time = timer.elapsed();
+
+			SocketBufferOutStream out2(SocketBufferOutStream::DontUseNetworkByteOrder);
+			timer.reset();
+			std::vector<SharedPacketRef> packets;
+			packets.reserve(objects.size());
+			for(auto it = objects.begin(); it != objects.end(); ++it)
+				packets.push_back(cache.getObjectInitialSendPacket(*it->second, scratch_packet));
+			const double lookup_time = timer.elapsed();
+			for(size_t i=0; i<packets.size(); ++i)
+				out2.writeData(packets[i]->data.data(), packets[i]->data.size());
+			const double cache_time = timer.elapsed();
+
+			testAssert(out.buf.size() == out2.buf.size() && std::memcmp(out.buf.data(), out2.buf.data(), out.buf.size()) == 0);
+			conPrint("Serialising " + toString(objects.size()) + " objects: " + doubleToStringNSigFigs(serialise_time * 1.0e3, 4) + " ms, using cache: " +
+				doubleToStringNSigFigs(cache_time * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs(lookup_time * 1.0e3, 4) + " ms of which would be under lock)");
+		}
+	}
+
+	conPrint("ObjectPacketCache::test() done");
+}
+
+
+#endif // BUILD_TESTS
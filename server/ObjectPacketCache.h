@@ -0,0 +1,79 @@
+/*=====================================================================
+ObjectPacketCache.h
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "PacketSendQueue.h"
+#include "../shared/UID.h"
+#include "../shared/WorldObject.h"
+#include <SocketBufferOutStream.h>
+#include <map>
+#include <unordered_map>
+
+
+/*=====================================================================
+ObjectPacketCache
+-----------------
+Cache of the serialised ObjectInitialSend message for each object in a
+world, so that GetAllObjects and QueryObjects requests don't have to
+re-serialise every object they return.
+
+Each cache entry records the network_state_version of the object when the
+message was serialised.  Any code that changes state written by
+WorldObject::writeToNetworkStream() must increment the object's
+network_state_version.  ServerWorldState::addWorldObjectAsDBDirty() does
+this, so only changes that are not saved to the DB (e.g. physics
+ownership) need to do it explicitly.
+
+The cached messages are immutable once made, so references to them can be
+taken while holding the world state mutex, and the bytes copied to the
+client after the mutex is released.
+
+If verify_on_hit is true (the default in debug builds), each cache hit is
+re-serialised and checked against the cached message, to catch code paths
+that change an object without incrementing network_state_version.
+
+Not threadsafe, the world state mutex should be held while using this.
+=====================================================================*/
+class ObjectPacketCache
+{
+public:
+	ObjectPacketCache();
+	~ObjectPacketCache();
+
+	// Returns the ObjectInitialSend message for the object, serialising it (using scratch_packet) if there is no up-to-date cached message.
+	SharedPacketRef getObjectInitialSendPacket(const WorldObject& ob, SocketBufferOutStream& scratch_packet);
+
+	void removeObject(const UID& uid); // Does nothing if the object is not in the cache.
+	void clear();
+
+	// Re-serialises each object that has an up-to-date cache entry, and checks the serialised message matches the cached message.
+	// Returns the number of objects for which the cached message was wrong.
+	size_t verify(const std::map<UID, WorldObjectRef>& objects, SocketBufferOutStream& scratch_packet) const;
+
+	size_t size() const { return entries.size(); }
+	size_t numHits() const { return num_hits; }
+	size_t numMisses() const { return num_misses; }
+
+	static void makeObjectInitialSendPacket(const WorldObject& ob, SocketBufferOutStream& packet_out);
+
+	bool verify_on_hit;
+
+	static void test();
+
+private:
+	static bool packetMatchesObject(const SharedPacket& packet, const WorldObject& ob, SocketBufferOutStream& scratch_packet);
+
+	struct CacheEntry
+	{
+		uint32 network_state_version; // Value of the object's network_state_version when packet was serialised.
+		SharedPacketRef packet;
+	};
+
+	std::unordered_map<UID, CacheEntry, UIDHasher> entries;
+	size_t num_hits;
+	size_t num_misses;
+};
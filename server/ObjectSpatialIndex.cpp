@@ -0,0 +1,424 @@
+/*=====================================================================
+ObjectSpatialIndex.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ObjectSpatialIndex.h"
+
+
+#include "../shared/WorldObject.h"
+#include <maths/mathstypes.h>
+#include <algorithm>
+
+
+static const float CELL_WIDTH = 50.f;
+static const float RECIP_CELL_WIDTH = 1.f / CELL_WIDTH;
+static const float MAX_CELL_COORD = (float)(1 << 30); // Clamp cell coordinates to this, so we don't overflow when converting to int.
+
+// Cell coordinates are clamped to +-2^30, so a key with x = 0x7FFFFFFF can't be made from a valid position.
+static const uint64 INVALID_CELL_KEY = 0x7FFFFFFF7FFFFFFFull;
+
+
+static inline int cellCoord(float x)
+{
+	return (int)myClamp(std::floor(x * RECIP_CELL_WIDTH), -MAX_CELL_COORD, MAX_CELL_COORD);
+}
+
+
+static inline uint64 makeCellKey(int x, int y)
+{
+	return ((uint64)(uint32)x << 32) | (uint64)(uint32)y;
+}
+
+
+ObjectSpatialIndex::ObjectSpatialIndex()
+{
+}
+
+
+ObjectSpatialIndex::~ObjectSpatialIndex()
+{
+}
+
+
+uint64 ObjectSpatialIndex::cellKeyForPos(const Vec4f& pos)
+{
+	if(!pos.isFinite())
+		return INVALID_CELL_KEY;
+
+	return makeCellKey(cellCoord(pos[0]), cellCoord(pos[1]));
+}
+
+
+void ObjectSpatialIndex::addToCell(uint64 key, WorldObject* ob)
+{
+	if(key != INVALID_CELL_KEY)
+		cells[key].push_back(ob);
+}
+
+
+void ObjectSpatialIndex::removeFromCell(uint64 key, WorldObject* ob)
+{
+	if(key == INVALID_CELL_KEY)
+		return;
+
+	auto res = cells.find(key);
+	assert(res != cells.end());
+	if(res != cells.end())
+	{
+		std::vector<WorldObject*>& cell_obs = res->second;
+		for(size_t i=0; i<cell_obs.size(); ++i)
+			if(cell_obs[i] == ob)
+			{
+				cell_obs[i] = cell_obs.back(); // Swap with last element and pop
+				cell_obs.pop_back();
+				break;
+			}
+
+		if(cell_obs.empty())
+			cells.erase(res);
+	}
+}
+
+
+void ObjectSpatialIndex::insert(WorldObject* ob)
+{
+	update(ob);
+}
+
+
+void ObjectSpatialIndex::update(WorldObject* ob)
+{
+	const uint64 new_key = cellKeyForPos(ob->pos.toVec4fPoint());
+
+	auto res = ob_cell_keys.find(ob);
+	if(res == ob_cell_keys.end())
+	{
+		ob_cell_keys.insert(std::make_pair(ob, new_key));
+		addToCell(new_key, ob);
+	}
+	else if(res->second != new_key) // If object has moved to a different cell:
+	{
+		removeFromCell(res->second, ob);
+		addToCell(new_key, ob);
+		res->second = new_key;
+	}
+}
+
+
+void ObjectSpatialIndex::remove(WorldObject* ob)
+{
+	auto res = ob_cell_keys.find(ob);
+	if(res != ob_cell_keys.end())
+	{
+		removeFromCell(res->second, ob);
+		ob_cell_keys.erase(res);
+	}
+}
+
+
+void ObjectSpatialIndex::clear()
+{
+	cells.clear();
+	ob_cell_keys.clear();
+}
+
+
+void ObjectSpatialIndex::appendObsInAABB(const std::vector<WorldObject*>& cell_obs, const js::AABBox& aabb, std::vector<WorldObject*>& obs_out)
+{
+	for(size_t i=0; i<cell_obs.size(); ++i)
+	{
+		WorldObject* ob = cell_obs[i];
+		if(aabb.contains(ob->pos.toVec4fPoint()))
+			obs_out.push_back(ob);
+	}
+}
+
+
+void ObjectSpatialIndex::queryAABB(const js::AABBox& aabb, std::vector<WorldObject*>& obs_out) const
+{
+	if(!(aabb.min_[0] <= aabb.max_[0] && aabb.min_[1] <= aabb.max_[1] && aabb.min_[2] <= aabb.max_[2])) // Empty AABB, or AABB with NaNs in it.
+		return;
+
+	const int begin_x = cellCoord(aabb.min_[0]);
+	const int begin_y = cellCoord(aabb.min_[1]);
+	const int end_x   = cellCoord(aabb.max_[0]); // inclusive
+	const int end_y   = cellCoord(aabb.max_[1]); // inclusive
+
+	const int64 num_query_cells = ((int64)end_x - begin_x + 1) * ((int64)end_y - begin_y + 1);
+
+	if(num_query_cells > (int64)cells.size()) // If the query AABB covers more cells than are non-empty, it's faster to just iterate over the non-empty cells.
+	{
+		for(auto it = cells.begin(); it != cells.end(); ++it)
+			appendObsInAABB(it->second, aabb, obs_out);
+	}
+	else
+	{
+		for(int y=begin_y; y<=end_y; ++y)
+		for(int x=begin_x; x<=end_x; ++x)
+		{
+			auto res = cells.find(makeCellKey(x, y));
+			if(res != cells.end())
+				appendObsInAABB(res->second, aabb, obs_out);
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+
+
+static void bruteForceQuery(const std::vector<WorldObjectRef>& obs, const js::AABBox& aabb, std::vector<WorldObject*>& obs_out)
+{
+	for(size_t i=0; i<obs.size(); ++i)
+	{
+		const Vec4f pos = obs[i]->pos.toVec4fPoint();
+		if(pos.isFinite() && aabb.contains(pos))
+			obs_out.push_back(obs[i].ptr());
+	}
+}
+
+
+static void checkQueryMatchesBruteForce(const ObjectSpatialIndex& index, const std::vector<WorldObjectRef>& obs, const js::AABBox& aabb)
+{
+	std::vector<WorldObject*> index_res, brute_res;
+	index.queryAABB(aabb, index_res);
+	bruteForceQuery(obs, aabb, brute_res);
+
+	std::sort(index_res.begin(), index_res.end());
+	std::sort(brute_res.begin(), brute_res.end());
+	testAssert(index_res == brute_res);
+}
+
+
+static js::AABBox randomAABB(PCG32& rng, float world_w, float max_query_w)
+{
+	const Vec4f lower(-world_w/2 + rng.unitRandom() * world_w, -world_w/2 + rng.unitRandom() * world_w, -50 + rng.unitRandom() * 100, 1.f);
+	const Vec4f extent(rng.unitRandom() * max_query_w, rng.unitRandom() * max_query_w, rng.unitRandom() * max_query_w, 0.f);
+	return js::AABBox(lower, lower + extent);
+}
+
+
+static WorldObjectRef makeRandomObject(PCG32& rng, float world_w, uint64 uid)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = UID(uid);
+	ob->pos = Vec3d(-world_w/2 + rng.unitRandom() * world_w, -world_w/2 + rng.unitRandom() * world_w, -50 + rng.unitRandom() * 100);
+	return ob;
+}
+
+
+void ObjectSpatialIndex::test()
+{
+	conPrint("ObjectSpatialIndex::test()");
+
+	//-------------------------- Test some simple cases --------------------------
+	{
+		ObjectSpatialIndex index;
+
+		WorldObjectRef ob = new WorldObject();
+		ob->pos = Vec3d(10, 20, 30);
+		index.insert(ob.ptr());
+		testAssert(index.numObjects() == 1);
+
+		std::vector<WorldObject*> res;
+		index.queryAABB(js::AABBox(Vec4f(0,0,0,1), Vec4f(100,100,100,1)), res);
+		testAssert(res.size() == 1 && res[0] == ob.ptr());
+
+		// Query not containing object
+		res.clear();
+		index.queryAABB(js::AABBox(Vec4f(11,0,0,1), Vec4f(100,100,100,1)), res);
+		testAssert(res.empty());
+
+		// Move object to another cell
+		ob->pos = Vec3d(-1000, 20, 30);
+		index.update(ob.ptr());
+		res.clear();
+		index.queryAABB(js::AABBox(Vec4f(0,0,0,1), Vec4f(100,100,100,1)), res);
+		testAssert(res.empty());
+		res.clear();
+		index.queryAABB(js::AABBox(Vec4f(-1000,20,30,1), Vec4f(-1000,20,30,1)), res); // Test AABB with zero volume, object on boundary.
+		testAssert(res.size() == 1 && res[0] == ob.ptr());
+
+		// Test a query AABB with NaNs in it
+		res.clear();
+		index.queryAABB(js::AABBox(Vec4f(std::numeric_limits<float>::quiet_NaN(),0,0,1), Vec4f(100,100,100,1)), res);
+		testAssert(res.empty());
+
+		// Test a huge query AABB
+		res.clear();
+		index.queryAABB(js::AABBox(Vec4f(-1.0e30f,-1.0e30f,-1.0e30f,1), Vec4f(1.0e30f,1.0e30f,1.0e30f,1)), res);
+		testAssert(res.size() == 1 && res[0] == ob.ptr());
+
+		// Give object a non-finite position, it shouldn't be returned from queries any more.
+		ob->pos = Vec3d(std::numeric_limits<double>::infinity(), 0, 0);
+		index.update(ob.ptr());
+		testAssert(index.numObjects() == 1);
+		res.clear();
+		index.queryAABB(js::AABBox(Vec4f(-1.0e30f,-1.0e30f,-1.0e30f,1), Vec4f(1.0e30f,1.0e30f,1.0e30f,1)), res);
+		testAssert(res.empty());
+
+		// Give object a very large position
+		ob->pos = Vec3d(1.0e20, -1.0e20, 0);
+		index.update(ob.ptr());
+		res.clear();
+		index.queryAABB(js::AABBox(Vec4f(1.0e19f,-1.0e21f,-1,1), Vec4f(1.0e21f,-1.0e19f,1,1)), res);
+		testAssert(res.size() == 1 && res[0] == ob.ptr());
+
+		index.remove(ob.ptr());
+		testAssert(index.numObjects() == 0);
+		testAssert(index.cells.empty());
+		index.remove(ob.ptr()); // Removing again should do nothing.
+	}
+
+	//-------------------------- Test against brute force, with random insertions, moves and removals --------------------------
+	{
+		PCG32 rng(1);
+		const float world_w = 2000;
+		ObjectSpatialIndex index;
+		std::vector<WorldObjectRef> obs;
+
+		for(int i=0; i<2000; ++i)
+		{
+			obs.push_back(makeRandomObject(rng, world_w, i));
+			index.insert(obs.back().ptr());
+		}
+
+		for(int iter=0; iter<2000; ++iter)
+		{
+			const float r = rng.unitRandom();
+			if(r < 0.3f) // Move an object
+			{
+				WorldObject* ob = obs[rng.nextUInt((uint32)obs.size())].ptr();
+				ob->pos += Vec3d(-100 + rng.unitRandom() * 200, -100 + rng.unitRandom() * 200, 0);
+				index.update(ob);
+			}
+			else if(r < 0.4f) // Remove an object
+			{
+				const size_t i = rng.nextUInt((uint32)obs.size());
+				index.remove(obs[i].ptr());
+				obs[i] = obs.back();
+				obs.pop_back();
+			}
+			else if(r < 0.5f) // Add an object
+			{
+				obs.push_back(makeRandomObject(rng, world_w, 10000 + iter));
+				index.insert(obs.back().ptr());
+			}
+
+			testAssert(index.numObjects() == obs.size());
+
+			checkQueryMatchesBruteForce(index, obs, randomAABB(rng, world_w, /*max query w=*/500));
+		}
+
+		// Test some large queries, that will iterate over all cells.
+		for(int i=0; i<10; ++i)
+			checkQueryMatchesBruteForce(index, obs, randomAABB(rng, world_w, /*max query w=*/10000));
+	}
+
+	//-------------------------- Perf test: compare against the old linear scan, for a large world --------------------------
+	if(false)
+	{
+		PCG32 rng(1);
+		const int N = 500000;
+		const float world_w = 10000;
+		std::vector<WorldObjectRef> obs(N);
+		for(int i=0; i<N; ++i)
+			obs[i] = makeRandomObject(rng, world_w, i);
+
+		ObjectSpatialIndex index;
+		{
+			Timer timer;
+			for(int i=0; i<N; ++i)
+				index.insert(obs[i].ptr());
+			conPrint("Building index for " + toString(N) + " objects took " + timer.elapsedStringNSigFigs(4));
+		}
+
+		// QueryObjectsInAABB-like queries.  Query a 1km AABB around a random position.
+		const int num_queries = 100;
+		std::vector<js::AABBox> query_aabbs(num_queries);
+		for(int i=0; i<num_queries; ++i)
+		{
+			const Vec4f centre(-world_w/2 + rng.unitRandom() * world_w, -world_w/2 + rng.unitRandom() * world_w, 0, 1);
+			query_aabbs[i] = js::AABBox(centre - Vec4f(500, 500, 500, 0), centre + Vec4f(500, 500, 500, 0));
+		}
+
+		std::vector<WorldObject*> res;
+		size_t num_brute_force_results = 0;
+		size_t num_index_results = 0;
+		double brute_force_time, index_time;
+		{
+			Timer timer;
+			for(int i=0; i<num_queries; ++i)
+			{
+				res.clear();
+				bruteForceQuery(obs, query_aabbs[i], res);
+				num_brute_force_results += res.size();
+			}
+			brute_force_time = timer.elapsed();
+		}
+		{
+			Timer timer;
+			for(int i=0; i<num_queries; ++i)
+			{
+				res.clear();
+				index.queryAABB(query_aabbs[i], res);
+				num_index_results += res.size();
+			}
+			index_time = timer.elapsed();
+		}
+		testAssert(num_brute_force_results == num_index_results);
+
+		conPrint("1 km AABB query over " + toString(N) + " objects (avg " + toString(num_index_results / num_queries) + " results):");
+		conPrint("    linear scan:   " + doubleToStringNSigFigs(brute_force_time / num_queries * 1.0e3, 4) + " ms / query");
+		conPrint("    spatial index: " + doubleToStringNSigFigs(index_time     / num_queries * 1.0e3, 4) + " ms / query (" + doubleToStringNSigFigs(brute_force_time / index_time, 3) + "x speedup)");
+
+		// QueryObjects-like query: test against 200 m cells, with a radius of 2 cells around the camera.
+		{
+			std::vector<js::AABBox> cell_aabbs;
+			for(int y=-2; y<=2; ++y)
+			for(int x=-2; x<=2; ++x)
+				cell_aabbs.push_back(js::AABBox(Vec4f(x * 200.f, y * 200.f, -200.f, 1), Vec4f((x + 1) * 200.f, (y + 1) * 200.f, 200.f, 1)));
+
+			Timer timer;
+			size_t num_in_cells = 0;
+			for(int i=0; i<N; ++i)
+			{
+				const Vec4f pos = obs[i]->pos.toVec4fPoint();
+				for(size_t z=0; z<cell_aabbs.size(); ++z)
+					if(cell_aabbs[z].contains(pos))
+					{
+						num_in_cells++;
+						break;
+					}
+			}
+			const double old_time = timer.elapsed();
+
+			timer.reset();
+			res.clear();
+			for(size_t z=0; z<cell_aabbs.size(); ++z)
+				index.queryAABB(cell_aabbs[z], res);
+			std::sort(res.begin(), res.end());
+			res.erase(std::unique(res.begin(), res.end()), res.end());
+			const double new_time = timer.elapsed();
+
+			testAssert(res.size() == num_in_cells);
+
+			conPrint("QueryObjects with " + toString(cell_aabbs.size()) + " cells over " + toString(N) + " objects (" + toString(num_in_cells) + " results):");
+			conPrint("    linear scan:   " + doubleToStringNSigFigs(old_time * 1.0e3, 4) + " ms");
+			conPrint("    spatial index: " + doubleToStringNSigFigs(new_time * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs(old_time / new_time, 3) + "x speedup)");
+		}
+	}
+
+	conPrint("ObjectSpatialIndex::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,57 @@
+/*=====================================================================
+ObjectSpatialIndex.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <physics/jscol_aabbox.h>
+#include <Platform.h>
+#include <unordered_map>
+#include <vector>
+class WorldObject;
+
+
+/*=====================================================================
+ObjectSpatialIndex
+------------------
+A uniform hash grid over the x-y positions of the objects in a world.
+Lets QueryObjects and QueryObjectsInAABB find the objects in a region
+without iterating over every object in the world.
+
+Objects are indexed by WorldObject::pos.  Whenever the position of an
+indexed object changes, update() must be called.  Objects must be removed
+before they are destroyed.
+
+Objects with non-finite positions are tracked, but never returned from queries.
+
+Not threadsafe, the world state mutex should be held while using this.
+=====================================================================*/
+class ObjectSpatialIndex
+{
+public:
+	ObjectSpatialIndex();
+	~ObjectSpatialIndex();
+
+	void insert(WorldObject* ob);
+	void update(WorldObject* ob); // Call after ob->pos has changed.  Inserts the object if it is not already in the index.
+	void remove(WorldObject* ob); // Does nothing if the object is not in the index.
+	void clear();
+
+	// Appends all objects whose position is in aabb (using js::AABBox::contains()) to obs_out.
+	void queryAABB(const js::AABBox& aabb, std::vector<WorldObject*>& obs_out) const;
+
+	size_t numObjects() const { return ob_cell_keys.size(); }
+
+	static void test();
+
+private:
+	static uint64 cellKeyForPos(const Vec4f& pos);
+	void addToCell(uint64 key, WorldObject* ob);
+	void removeFromCell(uint64 key, WorldObject* ob);
+	static void appendObsInAABB(const std::vector<WorldObject*>& cell_obs, const js::AABBox& aabb, std::vector<WorldObject*>& obs_out);
+
+	std::unordered_map<uint64, std::vector<WorldObject*>> cells; // Map from cell key to objects in cell.  Only non-empty cells are stored.
+	std::unordered_map<WorldObject*, uint64> ob_cell_keys; // Map from object to the key of the cell it is currently stored in.
+};
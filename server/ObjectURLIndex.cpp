@@ -0,0 +1,356 @@
+/*=====================================================================
+ObjectURLIndex.cpp
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ObjectURLIndex.h"
+
+
+#include "../shared/WorldObject.h"
+#include <algorithm>
+#include <iterator>
+
+
+ObjectURLIndex::ObjectURLIndex()
+{
+}
+
+
+ObjectURLIndex::~ObjectURLIndex()
+{
+}
+
+
+void ObjectURLIndex::removeURLForObject(const std::string& URL, const UID& uid)
+{
+	auto res = URL_to_ob_UIDs.find(URL);
+	assert(res != URL_to_ob_UIDs.end());
+	if(res != URL_to_ob_UIDs.end())
+	{
+		res->second.erase(uid);
+		if(res->second.empty())
+			URL_to_ob_UIDs.erase(res);
+	}
+}
+
+
+void ObjectURLIndex::updateObject(const WorldObject& ob)
+{
+	// Get the current URLs for the object
+	std::vector<DependencyURL> dependency_URLs;
+	ob.appendDependencyURLsForAllLODLevels(dependency_URLs);
+
+	std::vector<std::string> new_URLs(dependency_URLs.size());
+	for(size_t i=0; i<dependency_URLs.size(); ++i)
+		new_URLs[i] = dependency_URLs[i].URL;
+	std::sort(new_URLs.begin(), new_URLs.end());
+	new_URLs.erase(std::unique(new_URLs.begin(), new_URLs.end()), new_URLs.end());
+
+	std::vector<std::string>& old_URLs = ob_URLs[ob.uid]; // Inserts an empty vector if the object is not in the index yet.
+	if(new_URLs == old_URLs) // Common case: URLs haven't changed.
+		return;
+
+	// Remove URLs the object no longer uses
+	std::vector<std::string> removed_URLs;
+	std::set_difference(old_URLs.begin(), old_URLs.end(), new_URLs.begin(), new_URLs.end(), std::back_inserter(removed_URLs));
+	for(size_t i=0; i<removed_URLs.size(); ++i)
+		removeURLForObject(removed_URLs[i], ob.uid);
+
+	// Add new URLs.  (Adding a UID already in the set does nothing)
+	for(size_t i=0; i<new_URLs.size(); ++i)
+		URL_to_ob_UIDs[new_URLs[i]].insert(ob.uid);
+
+	old_URLs.swap(new_URLs);
+}
+
+
+void ObjectURLIndex::removeObject(const UID& uid)
+{
+	auto res = ob_URLs.find(uid);
+	if(res != ob_URLs.end())
+	{
+		const std::vector<std::string>& URLs = res->second;
+		for(size_t i=0; i<URLs.size(); ++i)
+			removeURLForObject(URLs[i], uid);
+
+		ob_URLs.erase(res);
+	}
+}
+
+
+void ObjectURLIndex::clear()
+{
+	URL_to_ob_UIDs.clear();
+	ob_URLs.clear();
+}
+
+
+void ObjectURLIndex::getObjectsUsingURL(const std::string& URL, std::vector<UID>& uids_out) const
+{
+	auto res = URL_to_ob_UIDs.find(URL);
+	if(res != URL_to_ob_UIDs.end())
+		uids_out.insert(uids_out.end(), res->second.begin(), res->second.end());
+}
+
+
+bool ObjectURLIndex::operator == (const ObjectURLIndex& other) const
+{
+	return (URL_to_ob_UIDs == other.URL_to_ob_UIDs) && (ob_URLs == other.ob_URLs);
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <map>
+#include <set>
+
+
+// The linear scan that the upload path in WorkerThread used to do.
+static void bruteForceGetObjectsUsingURL(const std::map<UID, WorldObjectRef>& objects, const std::string& URL, std::vector<UID>& uids_out)
+{
+	std::set<DependencyURL> URLs;
+	for(auto it = objects.begin(); it != objects.end(); ++it)
+	{
+		URLs.clear();
+		it->second->getDependencyURLSetForAllLODLevels(URLs);
+		if(URLs.count(DependencyURL(URL)) > 0)
+			uids_out.push_back(it->first);
+	}
+}
+
+
+static std::string randomURL(PCG32& rng, uint32 num_URLs)
+{
+	return "resource_" + toString(rng.nextUInt(num_URLs)) + ".bmesh";
+}
+
+
+static void randomiseURLs(PCG32& rng, uint32 num_URLs, WorldObject& ob)
+{
+	const float r = rng.unitRandom();
+	if(r < 0.3f)
+		ob.model_url = (rng.unitRandom() < 0.1f) ? std::string() : randomURL(rng, num_URLs);
+	else if(r < 0.5f)
+		ob.max_model_lod_level = (ob.max_model_lod_level == 0) ? 2 : 0;
+	else if(r < 0.6f)
+		ob.lightmap_url = randomURL(rng, num_URLs);
+	else if(r < 0.7f)
+		ob.audio_source_url = (rng.unitRandom() < 0.5f) ? std::string() : randomURL(rng, num_URLs);
+	else if(r < 0.9f)
+	{
+		if(ob.materials.empty())
+			ob.materials.push_back(new WorldMaterial());
+		ob.materials[rng.nextUInt((uint32)ob.materials.size())]->colour_texture_url = randomURL(rng, num_URLs);
+	}
+	else
+		ob.materials.push_back(new WorldMaterial());
+}
+
+
+static WorldObjectRef makeRandomObject(PCG32& rng, uint32 num_URLs, uint64 uid)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = UID(uid);
+	ob->model_url = randomURL(rng, num_URLs);
+	ob->max_model_lod_level = (rng.unitRandom() < 0.5f) ? 0 : 2;
+	for(int i=0; i<3; ++i)
+		randomiseURLs(rng, num_URLs, *ob);
+	return ob;
+}
+
+
+static void checkIndexMatchesObjects(const ObjectURLIndex& index, const std::map<UID, WorldObjectRef>& objects, uint32 num_URLs)
+{
+	// Check the incremental index matches an index built from scratch
+	ObjectURLIndex rebuilt_index;
+	for(auto it = objects.begin(); it != objects.end(); ++it)
+		rebuilt_index.updateObject(*it->second);
+	testAssert(index == rebuilt_index);
+	testAssert(index.numObjects() == objects.size());
+
+	// Check lookups match a linear scan over the objects
+	for(uint32 i=0; i<num_URLs; ++i)
+	{
+		const std::string URL = "resource_" + toString(i) + ".bmesh";
+		std::vector<UID> index_uids, brute_uids;
+		index.getObjectsUsingURL(URL, index_uids);
+		bruteForceGetObjectsUsingURL(objects, URL, brute_uids);
+		std::sort(index_uids.begin(), index_uids.end());
+		testAssert(index_uids == brute_uids);
+	}
+}
+
+
+void ObjectURLIndex::test()
+{
+	conPrint("ObjectURLIndex::test()");
+
+	//-------------------------- Test some simple cases --------------------------
+	{
+		ObjectURLIndex index;
+
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(1);
+		ob->model_url = "a.bmesh";
+		ob->max_model_lod_level = 2;
+		index.updateObject(*ob);
+		testAssert(index.numObjects() == 1);
+		testAssert(index.numURLs() == 3); // a.bmesh and 2 LOD URLs
+
+		std::vector<UID> uids;
+		index.getObjectsUsingURL("a.bmesh", uids);
+		testAssert(uids.size() == 1 && uids[0] == UID(1));
+		uids.clear();
+		index.getObjectsUsingURL(WorldObject::getLODModelURLForLevel("a.bmesh", 2), uids);
+		testAssert(uids.size() == 1 && uids[0] == UID(1));
+
+		// Another object using the same URL
+		WorldObjectRef ob2 = new WorldObject();
+		ob2->uid = UID(2);
+		ob2->model_url = "a.bmesh";
+		ob2->max_model_lod_level = 0;
+		ob2->materials.push_back(new WorldMaterial());
+		ob2->materials[0]->colour_texture_url = "a.bmesh"; // Same URL used twice by an object
+		index.updateObject(*ob2);
+		uids.clear();
+		index.getObjectsUsingURL("a.bmesh", uids);
+		std::sort(uids.begin(), uids.end());
+		testAssert(uids.size() == 2 && uids[0] == UID(1) && uids[1] == UID(2));
+
+		// Change URL of first object
+		ob->model_url = "b.bmesh";
+		index.updateObject(*ob);
+		uids.clear();
+		index.getObjectsUsingURL("a.bmesh", uids);
+		testAssert(uids.size() == 1 && uids[0] == UID(2));
+		uids.clear();
+		index.getObjectsUsingURL(WorldObject::getLODModelURLForLevel("a.bmesh", 2), uids);
+		testAssert(uids.empty());
+
+		// Remove objects
+		index.removeObject(UID(2));
+		uids.clear();
+		index.getObjectsUsingURL("a.bmesh", uids);
+		testAssert(uids.empty());
+		index.removeObject(UID(2)); // Removing again should do nothing.
+		index.removeObject(UID(1));
+		testAssert(index.numObjects() == 0);
+		testAssert(index.numURLs() == 0);
+	}
+
+	//-------------------------- Test incremental updates against rebuilding from scratch --------------------------
+	{
+		PCG32 rng(1);
+		const uint32 num_URLs = 50;
+		std::map<UID, WorldObjectRef> objects;
+		ObjectURLIndex index;
+		uint64 next_uid = 0;
+
+		for(int i=0; i<200; ++i)
+		{
+			WorldObjectRef ob = makeRandomObject(rng, num_URLs, next_uid++);
+			objects[ob->uid] = ob;
+			index.updateObject(*ob);
+		}
+
+		for(int iter=0; iter<2000; ++iter)
+		{
+			const float r = rng.unitRandom();
+			auto it = objects.lower_bound(UID(rng.nextUInt((uint32)next_uid)));
+			if(r < 0.7f) // Change URLs of an object
+			{
+				if(it != objects.end())
+				{
+					randomiseURLs(rng, num_URLs, *it->second);
+					index.updateObject(*it->second);
+				}
+			}
+			else if(r < 0.8f) // Update an object without changing anything
+			{
+				if(it != objects.end())
+					index.updateObject(*it->second);
+			}
+			else if(r < 0.9f) // Remove an object
+			{
+				if(it != objects.end())
+				{
+					index.removeObject(it->first);
+					objects.erase(it);
+				}
+			}
+			else // Add an object
+			{
+				WorldObjectRef ob = makeRandomObject(rng, num_URLs, next_uid++);
+				objects[ob->uid] = ob;
+				index.updateObject(*ob);
+			}
+
+			if(iter % 100 == 0)
+				checkIndexMatchesObjects(index, objects, num_URLs);
+		}
+		checkIndexMatchesObjects(index, objects, num_URLs);
+	}
+
+	//-------------------------- Perf test: looking up objects for an uploaded resource --------------------------
+	{
+		PCG32 rng(1);
+		const int N = 100000;
+		const uint32 num_URLs = 10000;
+		std::map<UID, WorldObjectRef> objects;
+		ObjectURLIndex index;
+		for(int i=0; i<N; ++i)
+		{
+			WorldObjectRef ob = makeRandomObject(rng, num_URLs, i);
+			objects[ob->uid] = ob;
+		}
+
+		{
+			Timer timer;
+			for(auto it = objects.begin(); it != objects.end(); ++it)
+				index.updateObject(*it->second);
+			conPrint("Building URL index for " + toString(N) + " objects took " + timer.elapsedStringNSigFigs(4));
+		}
+
+		const int num_lookups = 10;
+		std::vector<UID> uids;
+		size_t num_brute_force_results = 0;
+		size_t num_index_results = 0;
+		double brute_force_time, index_time;
+		{
+			Timer timer;
+			for(int i=0; i<num_lookups; ++i)
+			{
+				uids.clear();
+				bruteForceGetObjectsUsingURL(objects, "resource_" + toString(i) + ".bmesh", uids);
+				num_brute_force_results += uids.size();
+			}
+			brute_force_time = timer.elapsed();
+		}
+		{
+			Timer timer;
+			for(int i=0; i<num_lookups; ++i)
+			{
+				uids.clear();
+				index.getObjectsUsingURL("resource_" + toString(i) + ".bmesh", uids);
+				num_index_results += uids.size();
+			}
+			index_time = timer.elapsed();
+		}
+		testAssert(num_brute_force_results == num_index_results);
+
+		conPrint("Finding objects using an uploaded resource, " + toString(N) + " objects:");
+		conPrint("    linear scan: " + doubleToStringNSigFigs(brute_force_time / num_lookups * 1.0e3, 4) + " ms / lookup");
+		conPrint("    URL index:   " + doubleToStringNSigFigs(index_time       / num_lookups * 1.0e3, 4) + " ms / lookup (" + doubleToStringNSigFigs(brute_force_time / index_time, 3) + "x speedup)");
+	}
+
+	conPrint("ObjectURLIndex::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,60 @@
+/*=====================================================================
+ObjectURLIndex.h
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+class WorldObject;
+
+
+/*=====================================================================
+ObjectURLIndex
+--------------
+Reverse index from resource URL to the UIDs of the objects that use the
+resource, over all worlds.  The URLs for an object are the ones returned
+by WorldObject::appendDependencyURLsForAllLODLevels(), so include LOD
+level URLs.
+
+Used for finding the objects affected when a resource is uploaded, without
+iterating over every object in every world.
+
+updateObject() must be called after an object is inserted into a world, and
+after any of its URL fields (model_url, lightmap_url, audio_source_url,
+material textures, max_model_lod_level) change.  removeObject() must be
+called when an object is removed from a world.
+
+Not threadsafe, the world state mutex should be held while using this.
+=====================================================================*/
+class ObjectURLIndex
+{
+public:
+	ObjectURLIndex();
+	~ObjectURLIndex();
+
+	void updateObject(const WorldObject& ob); // Inserts the object if it is not already in the index.
+	void removeObject(const UID& uid); // Does nothing if the object is not in the index.
+	void clear();
+
+	// Appends the UIDs of all objects using the resource with the given URL to uids_out.
+	void getObjectsUsingURL(const std::string& URL, std::vector<UID>& uids_out) const;
+
+	size_t numObjects() const { return ob_URLs.size(); }
+	size_t numURLs() const { return URL_to_ob_UIDs.size(); }
+
+	bool operator == (const ObjectURLIndex& other) const;
+
+	static void test();
+
+private:
+	void removeURLForObject(const std::string& URL, const UID& uid);
+
+	std::unordered_map<std::string, std::unordered_set<UID, UIDHasher>> URL_to_ob_UIDs; // Only URLs used by at least one object are stored.
+	std::unordered_map<UID, std::vector<std::string>, UIDHasher> ob_URLs; // Sorted, unique URLs that each object is currently indexed under.
+};
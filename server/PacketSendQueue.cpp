@@ -0,0 +1,697 @@
+/*=====================================================================
+PacketSendQueue.cpp
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "PacketSendQueue.h"
+
+
+#include "../shared/Protocol.h"
+#include <SocketBufferOutStream.h>
+#include <OutStream.h>
+#include <Lock.h>
+#include <cstring>
+#include <algorithm>
+
+
+SharedPacketRef SharedPacket::make(const SocketBufferOutStream& packet)
+{
+	return make(packet.buf.data(), packet.buf.size());
+}
+
+
+SharedPacketRef SharedPacket::make(const void* data, size_t size)
+{
+	SharedPacketRef shared_packet = new SharedPacket();
+	shared_packet->data.resize(size);
+	if(size > 0)
+		std::memcpy(shared_packet->data.data(), data, size);
+	return shared_packet;
+}
+
+
+PacketSendQueue::PacketSendQueue()
+:	num_queued_bytes(0),
+	coalesce_threshold(DEFAULT_COALESCE_THRESHOLD),
+	hard_limit(DEFAULT_HARD_LIMIT),
+	coalescing(false),
+	contains_removed_packets(false),
+	overflowed(false),
+	num_coalesced(0)
+{
+}
+
+
+PacketSendQueue::~PacketSendQueue()
+{
+}
+
+
+void PacketSendQueue::setLimits(size_t coalesce_threshold_, size_t hard_limit_)
+{
+	Lock lock(mutex);
+	coalesce_threshold = coalesce_threshold_;
+	hard_limit = hard_limit_;
+}
+
+
+// If the packet is a single AvatarTransformUpdate or ObjectTransformUpdate message, returns the message type and the UID of the entity it updates.
+static inline bool getTransformUpdateTypeAndUID(const SharedPacket& packet, uint32& msg_type_out, uint64& uid_out)
+{
+	if(packet.size() < sizeof(uint32) * 2 + sizeof(uint64))
+		return false;
+
+	uint32 msg_type, msg_len;
+	std::memcpy(&msg_type, packet.data.data(), sizeof(uint32));
+	std::memcpy(&msg_len, packet.data.data() + sizeof(uint32), sizeof(uint32));
+	if((msg_type != Protocol::AvatarTransformUpdate && msg_type != Protocol::ObjectTransformUpdate) || (msg_len != packet.size())) // Packets containing more than one message are not coalesced.
+		return false;
+
+	msg_type_out = msg_type;
+	std::memcpy(&uid_out, packet.data.data() + sizeof(uint32) * 2, sizeof(uint64));
+	return true;
+}
+
+
+// Records packets[packet_index] as the latest update for its entity, if it is a transform update.  Removes the update it supersedes, if any.
+void PacketSendQueue::indexTransformUpdate(size_t packet_index)
+{
+	uint32 msg_type;
+	uint64 uid;
+	if(!getTransformUpdateTypeAndUID(*packets[packet_index], msg_type, uid))
+		return;
+
+	std::unordered_map<uint64, size_t>& index = (msg_type == Protocol::AvatarTransformUpdate) ? avatar_transform_update_index : object_transform_update_index;
+	auto res = index.insert(std::make_pair(uid, packet_index));
+	if(!res.second) // If there was already an update for this entity:
+	{
+		SharedPacketRef& superseded = packets[res.first->second];
+		num_queued_bytes -= superseded->size();
+		superseded = NULL;
+		contains_removed_packets = true;
+		num_coalesced++;
+		res.first->second = packet_index;
+	}
+}
+
+
+void PacketSendQueue::enqueuePacket(const SharedPacketRef& packet)
+{
+	Lock lock(mutex);
+
+	if(overflowed)
+		return;
+
+	packets.push_back(packet);
+	num_queued_bytes += packet->size();
+
+	if(coalescing)
+		indexTransformUpdate(packets.size() - 1);
+	else if(num_queued_bytes > coalesce_threshold)
+	{
+		// Index the packets already in the queue, removing superseded updates.  We keep coalescing until the packets are taken.
+		coalescing = true;
+		for(size_t i=0; i<packets.size(); ++i)
+			if(packets[i].nonNull())
+				indexTransformUpdate(i);
+	}
+
+	if(num_queued_bytes > hard_limit)
+	{
+		// Drop the packet.  The queue is now missing a message, so the client should be disconnected.
+		num_queued_bytes -= packet->size();
+		packets.back() = NULL;
+		contains_removed_packets = true;
+		overflowed = true;
+	}
+}
+
+
+void PacketSendQueue::takePackets(std::vector<SharedPacketRef>& packets_out)
+{
+	assert(packets_out.empty());
+	Lock lock(mutex);
+	packets_out.swap(packets);
+
+	if(contains_removed_packets)
+	{
+		// Remove packets that were set to NULL because they were superseded or dropped.
+		packets_out.erase(std::remove(packets_out.begin(), packets_out.end(), SharedPacketRef()), packets_out.end());
+		contains_removed_packets = false;
+	}
+
+	if(coalescing)
+	{
+		avatar_transform_update_index.clear();
+		object_transform_update_index.clear();
+		coalescing = false;
+	}
+
+	num_queued_bytes = 0;
+}
+
+
+bool PacketSendQueue::empty() const
+{
+	Lock lock(mutex);
+	return packets.empty();
+}
+
+
+size_t PacketSendQueue::numQueuedBytes() const
+{
+	Lock lock(mutex);
+	return num_queued_bytes;
+}
+
+
+bool PacketSendQueue::hasOverflowed() const
+{
+	Lock lock(mutex);
+	return overflowed;
+}
+
+
+size_t PacketSendQueue::numCoalescedPackets() const
+{
+	Lock lock(mutex);
+	return num_coalesced;
+}
+
+
+bool PacketSendQueue::isCoalescing() const
+{
+	Lock lock(mutex);
+	return coalescing;
+}
+
+
+void PacketSendQueue::writePackets(const std::vector<SharedPacketRef>& packets, OutStream& stream, js::Vector<uint8, 16>& gather_buf)
+{
+	gather_buf.resize(0);
+
+	for(size_t i=0; i<packets.size(); ++i)
+	{
+		const SharedPacket* packet = packets[i].ptr();
+		const size_t packet_size = packet->size();
+		if(packet_size == 0)
+			continue;
+
+		if(gather_buf.size() + packet_size > GATHER_BUF_SIZE) // If packet won't fit in the gather buffer:
+		{
+			// Write out the gather buffer.
+			if(gather_buf.nonEmpty())
+			{
+				stream.writeData(gather_buf.data(), gather_buf.size());
+				gather_buf.resize(0);
+			}
+
+			if(packet_size >= GATHER_BUF_SIZE) // If the packet is large, write it directly.
+			{
+				stream.writeData(packet->data.data(), packet_size);
+				continue;
+			}
+		}
+
+		const size_t write_i = gather_buf.size();
+		gather_buf.resize(write_i + packet_size);
+		std::memcpy(&gather_buf[write_i], packet->data.data(), packet_size);
+	}
+
+	if(gather_buf.nonEmpty())
+	{
+		stream.writeData(gather_buf.data(), gather_buf.size());
+		gather_buf.resize(0);
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <utils/BufferOutStream.h>
+#include <utils/PlatformUtils.h>
+#include <utils/MyThread.h>
+#include <utils/AtomicInt.h>
+#include <maths/PCG32.h>
+#include <string>
+#include <memory>
+#include <map>
+
+
+static SharedPacketRef makeTestPacket(PCG32& rng, size_t size)
+{
+	SharedPacketRef packet = new SharedPacket();
+	packet->data.resize(size);
+	for(size_t i=0; i<size; ++i)
+		packet->data[i] = (uint8)rng.nextUInt(256);
+	return packet;
+}
+
+
+static void testWritingPackets(const std::vector<SharedPacketRef>& packets)
+{
+	js::Vector<uint8, 16> expected;
+	for(size_t i=0; i<packets.size(); ++i)
+		for(size_t z=0; z<packets[i]->size(); ++z)
+			expected.push_back(packets[i]->data[z]);
+
+	BufferOutStream stream;
+	js::Vector<uint8, 16> gather_buf;
+	PacketSendQueue::writePackets(packets, stream, gather_buf);
+
+	testAssert(stream.buf.size() == expected.size());
+	testAssert(expected.empty() || std::memcmp(stream.buf.data(), expected.data(), expected.size()) == 0);
+	testAssert(gather_buf.empty());
+}
+
+
+// Makes a packet with a single message with the UID and a sequence number, padded to packet_size bytes.
+static SharedPacketRef makeEntityPacket(uint32 msg_type, uint64 uid, uint32 seq, size_t packet_size = 40)
+{
+	BufferOutStream packet;
+	packet.writeUInt32(msg_type);
+	packet.writeUInt32((uint32)packet_size);
+	packet.writeUInt64(uid);
+	packet.writeUInt32(seq);
+	while(packet.buf.size() < packet_size)
+		packet.writeUInt8(0);
+	return SharedPacket::make(packet.buf.data(), packet.buf.size());
+}
+
+
+struct TestMessage
+{
+	uint32 msg_type;
+	uint64 uid;
+	uint32 seq;
+};
+
+
+// Splits a stream of packets made with makeEntityPacket() back into messages.
+static void parseEntityMessages(const uint8* data, size_t size, std::vector<TestMessage>& messages_out)
+{
+	size_t pos = 0;
+	while(pos < size)
+	{
+		testAssert(size - pos >= 20);
+		TestMessage msg;
+		uint32 msg_len;
+		std::memcpy(&msg.msg_type, data + pos, 4);
+		std::memcpy(&msg_len, data + pos + 4, 4);
+		std::memcpy(&msg.uid, data + pos + 8, 8);
+		std::memcpy(&msg.seq, data + pos + 16, 4);
+		testAssert(msg_len >= 20 && pos + msg_len <= size);
+		messages_out.push_back(msg);
+		pos += msg_len;
+	}
+}
+
+
+static void takeMessages(PacketSendQueue& queue, std::vector<TestMessage>& messages_out)
+{
+	std::vector<SharedPacketRef> packets;
+	queue.takePackets(packets);
+
+	BufferOutStream stream;
+	js::Vector<uint8, 16> gather_buf;
+	PacketSendQueue::writePackets(packets, stream, gather_buf);
+
+	messages_out.clear();
+	parseEntityMessages(stream.buf.data(), stream.buf.size(), messages_out);
+}
+
+
+// Simulates a socket to a client on a slow link.  Writes block so that the average write rate is at most bytes_per_sec.
+class ThrottledTestSocket : public BufferOutStream
+{
+public:
+	ThrottledTestSocket(double bytes_per_sec_) : bytes_per_sec(bytes_per_sec_) {}
+
+	virtual void writeData(const void* data, size_t num_bytes)
+	{
+		BufferOutStream::writeData(data, num_bytes);
+
+		const double target_time = buf.size() / bytes_per_sec;
+		const double elapsed = timer.elapsed();
+		if(target_time > elapsed)
+			PlatformUtils::Sleep((int)((target_time - elapsed) * 1000) + 1);
+	}
+
+	double bytes_per_sec;
+	Timer timer;
+};
+
+
+// Does what WorkerThread does with its send queue: takes all queued packets and writes them to the socket, until the queue is empty and done is set.
+// Stops if the queue overflows, as WorkerThread disconnects the client in that case.
+class TestSenderThread : public MyThread
+{
+public:
+	TestSenderThread(PacketSendQueue* queue_, ThrottledTestSocket* socket_) : queue(queue_), socket(socket_), done(0) {}
+
+	virtual void run()
+	{
+		std::vector<SharedPacketRef> packets;
+		js::Vector<uint8, 16> gather_buf;
+		while(1)
+		{
+			const bool producer_done = done != 0;
+			if(queue->hasOverflowed())
+				break;
+			queue->takePackets(packets);
+			if(!packets.empty())
+			{
+				PacketSendQueue::writePackets(packets, *socket, gather_buf);
+				packets.clear();
+			}
+			else if(producer_done)
+				break;
+			else
+				PlatformUtils::Sleep(1);
+		}
+	}
+
+	PacketSendQueue* queue;
+	ThrottledTestSocket* socket;
+	glare::AtomicInt done;
+};
+
+
+void PacketSendQueue::test()
+{
+	conPrint("PacketSendQueue::test()");
+
+	PCG32 rng(1);
+
+	//-------------------------- Test enqueuing and taking packets --------------------------
+	{
+		PacketSendQueue queue;
+		testAssert(queue.empty());
+
+		SharedPacketRef a = makeTestPacket(rng, 10);
+		SharedPacketRef b = makeTestPacket(rng, 20);
+		queue.enqueuePacket(a);
+		queue.enqueuePacket(b);
+		queue.enqueuePacket(a);
+		testAssert(!queue.empty());
+		testAssert(a->getRefCount() == 3);
+
+		std::vector<SharedPacketRef> packets;
+		queue.takePackets(packets);
+		testAssert(queue.empty());
+		testAssert(packets.size() == 3 && packets[0] == a && packets[1] == b && packets[2] == a);
+	}
+
+	//-------------------------- Test writePackets() --------------------------
+	{
+		testWritingPackets(std::vector<SharedPacketRef>());
+
+		std::vector<SharedPacketRef> packets;
+		packets.push_back(makeTestPacket(rng, 0));
+		testWritingPackets(packets);
+
+		// Lots of small packets
+		for(int i=0; i<10000; ++i)
+			packets.push_back(makeTestPacket(rng, 1 + rng.nextUInt(100)));
+		testWritingPackets(packets);
+
+		// Mix of small and large packets, including packets around the gather buffer size.
+		packets.clear();
+		const size_t sizes[] = { 10, GATHER_BUF_SIZE - 10, 10, GATHER_BUF_SIZE, 1, GATHER_BUF_SIZE + 1, 3 * GATHER_BUF_SIZE, 5, GATHER_BUF_SIZE - 1, 1, 1 };
+		for(size_t i=0; i<staticArrayNumElems(sizes); ++i)
+			packets.push_back(makeTestPacket(rng, sizes[i]));
+		testWritingPackets(packets);
+
+		for(int i=0; i<100; ++i)
+		{
+			packets.clear();
+			const int num = rng.nextUInt(50);
+			for(int z=0; z<num; ++z)
+				packets.push_back(makeTestPacket(rng, rng.nextUInt(2 * GATHER_BUF_SIZE)));
+			testWritingPackets(packets);
+		}
+	}
+
+	//-------------------------- Test coalescing of superseded transform updates --------------------------
+	{
+		PacketSendQueue queue;
+		queue.setLimits(/*coalesce threshold=*/400, /*hard limit=*/100000);
+
+		// Below the threshold, nothing is coalesced.
+		queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 1, 0));
+		queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 1, 1));
+		testAssert(queue.numQueuedBytes() == 80);
+
+		std::vector<TestMessage> messages;
+		takeMessages(queue, messages);
+		testAssert(messages.size() == 2 && messages[0].seq == 0 && messages[1].seq == 1);
+		testAssert(queue.numQueuedBytes() == 0);
+		testAssert(queue.numCoalescedPackets() == 0);
+
+		// Fill the queue with 10 packets (400 B), alternating between avatar 1 and an unrelated chat message.
+		for(uint32 i=0; i<5; ++i)
+		{
+			queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 1, i));
+			queue.enqueuePacket(makeEntityPacket(Protocol::ChatMessageID, 1, i));
+		}
+		testAssert(queue.numQueuedBytes() == 400);
+		testAssert(queue.numCoalescedPackets() == 0);
+		testAssert(!queue.isCoalescing());
+
+		// Going over the threshold removes all the superseded avatar 1 updates.
+		queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 1, 5));
+		testAssert(queue.isCoalescing());
+		testAssert(queue.numCoalescedPackets() == 5);
+		testAssert(queue.numQueuedBytes() == 6 * 40);
+
+		// Updates for other entities, and object updates for an object with the same UID value as the avatar, are kept.
+		queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 2, 6));
+		queue.enqueuePacket(makeEntityPacket(Protocol::ObjectTransformUpdate, 1, 7));
+		queue.enqueuePacket(makeEntityPacket(Protocol::ObjectFullUpdate, 1, 8)); // Not a transform update, so never coalesced.
+		queue.enqueuePacket(makeEntityPacket(Protocol::ObjectTransformUpdate, 1, 9)); // Supersedes seq 7, but is still sent after the full update (seq 8).
+		queue.enqueuePacket(makeEntityPacket(Protocol::ObjectFullUpdate, 1, 10));
+		queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 1, 11)); // Supersedes seq 5.
+		testAssert(queue.numCoalescedPackets() == 7);
+
+		// Packets with more than one message are not coalesced.
+		{
+			SharedPacketRef a = makeEntityPacket(Protocol::AvatarTransformUpdate, 3, 12);
+			SharedPacketRef b = makeEntityPacket(Protocol::AvatarTransformUpdate, 3, 13);
+			js::Vector<uint8, 16> combined(a->data.size() + b->data.size());
+			std::memcpy(combined.data(), a->data.data(), a->data.size());
+			std::memcpy(combined.data() + a->data.size(), b->data.data(), b->data.size());
+			queue.enqueuePacket(SharedPacket::make(combined.data(), combined.size()));
+			queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 3, 14));
+			testAssert(queue.numCoalescedPackets() == 7);
+		}
+
+		const size_t expected_bytes = queue.numQueuedBytes();
+		takeMessages(queue, messages);
+		testAssert(messages.size() * 40 == expected_bytes);
+		testAssert(!queue.isCoalescing());
+
+		const uint32 expected_seqs[] = { 0, 1, 2, 3, 4, 6, 8, 9, 10, 11, 12, 13, 14 }; // Chat messages 0-4, then the remaining updates in order.
+		testAssert(messages.size() == staticArrayNumElems(expected_seqs));
+		for(size_t i=0; i<messages.size(); ++i)
+			testAssert(messages[i].seq == expected_seqs[i]);
+		for(size_t i=0; i<5; ++i)
+			testAssert(messages[i].msg_type == Protocol::ChatMessageID);
+
+		// After taking the packets, we are below the threshold again, so nothing is coalesced.
+		queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 1, 15));
+		queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, 1, 16));
+		takeMessages(queue, messages);
+		testAssert(messages.size() == 2);
+		testAssert(!queue.hasOverflowed());
+	}
+
+	//-------------------------- Test the hard limit --------------------------
+	{
+		PacketSendQueue queue;
+		queue.setLimits(/*coalesce threshold=*/400, /*hard limit=*/1000);
+
+		// Updates for distinct entities can't be coalesced.  Once the hard limit is reached, packets are dropped.
+		for(uint32 i=0; i<100; ++i)
+		{
+			queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, /*uid=*/i, i));
+			testAssert(queue.numQueuedBytes() <= 1000);
+		}
+		testAssert(queue.hasOverflowed());
+		testAssert(queue.numQueuedBytes() == 1000);
+
+		std::vector<TestMessage> messages;
+		takeMessages(queue, messages);
+		testAssert(messages.size() == 25);
+		for(size_t i=0; i<messages.size(); ++i)
+			testAssert(messages[i].seq == i);
+
+		// Overflowed state is sticky, further packets are dropped.
+		queue.enqueuePacket(makeEntityPacket(Protocol::ChatMessageID, 0, 0));
+		testAssert(queue.empty() && queue.hasOverflowed());
+	}
+
+	//-------------------------- Test with a throttled socket --------------------------
+	// Avatar transform updates for 50 avatars are enqueued every 10 ms (200 KB/s), and sent to a client that can only receive 20 KB/s.
+	// Coalescing should keep the queue bounded, and the client should get the latest update for each avatar.
+	for(int coalescable=1; coalescable>=0; --coalescable)
+	{
+		const size_t threshold = 4000;
+		const size_t hard_limit = 64000;
+		const int num_avatars = 50;
+		const uint32 num_ticks = 50;
+
+		PacketSendQueue queue;
+		queue.setLimits(threshold, hard_limit);
+		ThrottledTestSocket socket(/*bytes per sec=*/20000);
+		Reference<TestSenderThread> sender = new TestSenderThread(&queue, &socket);
+		sender->launch();
+
+		size_t max_queued_bytes = 0;
+		for(uint32 t=0; t<num_ticks; ++t)
+		{
+			for(int i=0; i<num_avatars; ++i)
+			{
+				// In the non-coalescable case, use a new UID each tick.
+				const uint64 uid = coalescable ? i : (t * num_avatars + i);
+				queue.enqueuePacket(makeEntityPacket(Protocol::AvatarTransformUpdate, uid, t));
+				max_queued_bytes = myMax(max_queued_bytes, queue.numQueuedBytes());
+			}
+			if(t % 10 == 0)
+				queue.enqueuePacket(makeEntityPacket(Protocol::ChatMessageID, 0, t));
+			PlatformUtils::Sleep(10);
+		}
+		sender->done = 1;
+		sender->join();
+
+		testAssert(max_queued_bytes <= hard_limit);
+
+		std::vector<TestMessage> messages;
+		parseEntityMessages(socket.buf.data(), socket.buf.size(), messages);
+
+		if(coalescable)
+		{
+			testAssert(!queue.hasOverflowed());
+			testAssert(queue.numCoalescedPackets() > 0);
+			testAssert(max_queued_bytes <= threshold + num_avatars * 40 + 40);
+
+			// Updates for each avatar should arrive in order, and the final update for each avatar should arrive.  All chat messages should arrive.
+			std::map<uint64, uint32> last_seq;
+			int num_chat_messages = 0;
+			for(size_t i=0; i<messages.size(); ++i)
+			{
+				if(messages[i].msg_type == Protocol::ChatMessageID)
+					num_chat_messages++;
+				else
+				{
+					auto res = last_seq.find(messages[i].uid);
+					testAssert(res == last_seq.end() || messages[i].seq > res->second);
+					last_seq[messages[i].uid] = messages[i].seq;
+				}
+			}
+			testAssert(num_chat_messages == (int)(num_ticks / 10));
+			testAssert(last_seq.size() == (size_t)num_avatars);
+			for(auto it = last_seq.begin(); it != last_seq.end(); ++it)
+				testAssert(it->second == num_ticks - 1);
+
+			conPrint("Throttled socket: sent " + toString(messages.size()) + " of " + toString(num_ticks * num_avatars) + " transform updates, " +
+				toString(queue.numCoalescedPackets()) + " coalesced, max queued bytes: " + toString(max_queued_bytes));
+		}
+		else
+		{
+			// The client can't keep up and the updates can't be coalesced, so the queue should overflow, and the client would be disconnected.
+			testAssert(queue.hasOverflowed());
+		}
+	}
+
+	//-------------------------- Perf test: broadcasting packets to N workers --------------------------
+	// Compare the old approach (copy each packet into a std::string, append to each worker's byte queue, copy the
+	// queue to a temp buffer for writing) with sharing refcounted packets.
+	{
+		const int num_packets = 1000;
+		const size_t packet_size = 64; // Roughly the size of an AvatarTransformUpdate message.
+		std::vector<SharedPacketRef> source_packets(num_packets);
+		for(int i=0; i<num_packets; ++i)
+			source_packets[i] = makeTestPacket(rng, packet_size);
+
+		const int worker_counts[] = { 10, 100, 500 };
+		for(size_t c=0; c<staticArrayNumElems(worker_counts); ++c)
+		{
+			const int N = worker_counts[c];
+			BufferOutStream socket_stream; // Simulated socket.  Cleared after each worker's write.
+
+			// Old approach
+			double old_time;
+			{
+				std::vector<js::Vector<uint8, 16>> worker_data_to_send(N);
+				js::Vector<uint8, 16> temp_data_to_send;
+
+				Timer timer;
+				std::vector<std::string> broadcast_packets;
+				for(int i=0; i<num_packets; ++i)
+					broadcast_packets.push_back(std::string((const char*)source_packets[i]->data.data(), source_packets[i]->size()));
+
+				for(int w=0; w<N; ++w)
+					for(size_t i=0; i<broadcast_packets.size(); ++i)
+					{
+						js::Vector<uint8, 16>& data_to_send = worker_data_to_send[w];
+						const size_t write_i = data_to_send.size();
+						data_to_send.resize(write_i + broadcast_packets[i].size());
+						std::memcpy(&data_to_send[write_i], broadcast_packets[i].data(), broadcast_packets[i].size());
+					}
+
+				for(int w=0; w<N; ++w)
+				{
+					temp_data_to_send = worker_data_to_send[w];
+					worker_data_to_send[w].clear();
+					socket_stream.writeData(temp_data_to_send.data(), temp_data_to_send.size());
+					socket_stream.buf.resize(0);
+				}
+				old_time = timer.elapsed();
+			}
+
+			// New approach
+			double new_time;
+			{
+				std::vector<std::unique_ptr<PacketSendQueue>> queues(N);
+				for(int w=0; w<N; ++w)
+					queues[w].reset(new PacketSendQueue());
+				std::vector<SharedPacketRef> packets_to_send;
+				js::Vector<uint8, 16> gather_buf;
+
+				Timer timer;
+				std::vector<SharedPacketRef> broadcast_packets;
+				for(int i=0; i<num_packets; ++i)
+					broadcast_packets.push_back(SharedPacket::make(source_packets[i]->data.data(), source_packets[i]->size()));
+
+				for(int w=0; w<N; ++w)
+					for(size_t i=0; i<broadcast_packets.size(); ++i)
+						queues[w]->enqueuePacket(broadcast_packets[i]);
+
+				for(int w=0; w<N; ++w)
+				{
+					queues[w]->takePackets(packets_to_send);
+					writePackets(packets_to_send, socket_stream, gather_buf);
+					packets_to_send.clear();
+					socket_stream.buf.resize(0);
+				}
+				new_time = timer.elapsed();
+			}
+
+			const double total_bytes = (double)N * num_packets * packet_size;
+			conPrint("Broadcasting " + toString(num_packets) + " packets of " + toString(packet_size) + " B to " + toString(N) + " workers:");
+			conPrint("    string copies:  " + doubleToStringNSigFigs(old_time * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs(total_bytes / old_time * 1.0e-9, 4) + " GB/s)");
+			conPrint("    shared packets: " + doubleToStringNSigFigs(new_time * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs(total_bytes / new_time * 1.0e-9, 4) + " GB/s, " +
+				doubleToStringNSigFigs(old_time / new_time, 3) + "x speedup)");
+		}
+	}
+
+	conPrint("PacketSendQueue::test() done");
+}
+
+
+#endif // BUILD_TESTS
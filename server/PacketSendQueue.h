@@ -0,0 +1,119 @@
+/*=====================================================================
+PacketSendQueue.h
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Mutex.h>
+#include <Vector.h>
+#include <Platform.h>
+#include <vector>
+#include <unordered_map>
+class SocketBufferOutStream;
+class OutStream;
+
+
+/*=====================================================================
+SharedPacket
+------------
+An immutable, serialised packet.  A broadcast packet is serialised once into a
+SharedPacket, and then a reference to it is queued with each WorkerThread,
+instead of each WorkerThread taking its own copy.
+
+Must not be modified once it has been enqueued.
+=====================================================================*/
+class SharedPacket : public ThreadSafeRefCounted
+{
+public:
+	static Reference<SharedPacket> make(const SocketBufferOutStream& packet);
+	static Reference<SharedPacket> make(const void* data, size_t size);
+
+	size_t size() const { return data.size(); }
+
+	js::Vector<uint8, 16> data;
+};
+
+typedef Reference<SharedPacket> SharedPacketRef;
+
+
+/*=====================================================================
+PacketSendQueue
+---------------
+A queue of packets to be sent to a single client.
+
+Packets are enqueued by reference from any thread, and taken off in one go by
+the WorkerThread, which then writes them with writePackets().
+
+Small packets are coalesced into a single buffer before writing, so that
+sockets (in particular TLS sockets) do a small number of large writes.
+Packets larger than the gather buffer are written directly from the shared
+packet data, without a copy.
+
+Backpressure for slow clients: once more than coalesce_threshold bytes are
+queued, enqueuing an AvatarTransformUpdate or ObjectTransformUpdate removes
+any queued update of the same type for the same UID, as it has been
+superseded.  The new update is appended at the end of the queue, so it is
+still sent after any other message for that entity that was enqueued before
+it.  If the queue still grows past hard_limit bytes, further packets are
+dropped and the queue is marked as overflowed.  The client should then be
+disconnected, as it has missed updates.
+
+TransformUpdateBatch messages are not coalesced, so while isCoalescing()
+returns true, the InterestManager sends individual transform update messages
+instead of batches.
+=====================================================================*/
+class PacketSendQueue
+{
+public:
+	PacketSendQueue();
+	~PacketSendQueue();
+
+	void setLimits(size_t coalesce_threshold, size_t hard_limit); // threadsafe
+
+	void enqueuePacket(const SharedPacketRef& packet); // threadsafe.  Drops the packet if the queue has overflowed.
+
+	// Moves all queued packets to packets_out.  packets_out should be empty.
+	void takePackets(std::vector<SharedPacketRef>& packets_out); // threadsafe
+
+	bool empty() const; // threadsafe
+
+	size_t numQueuedBytes() const; // threadsafe
+
+	// Returns true if the queue has gone over the hard limit and packets have been dropped.  Stays true once set.
+	bool hasOverflowed() const; // threadsafe
+
+	size_t numCoalescedPackets() const; // threadsafe.  Total number of superseded transform update packets removed from the queue.
+
+	// Returns true if the queue has gone over coalesce_threshold since the packets were last taken.
+	bool isCoalescing() const; // threadsafe
+
+	// Writes the packets to the stream (socket), in order.  gather_buf is used as scratch space for coalescing packets.
+	// Doesn't flush the stream.
+	static void writePackets(const std::vector<SharedPacketRef>& packets, OutStream& stream, js::Vector<uint8, 16>& gather_buf);
+
+	static const size_t GATHER_BUF_SIZE = 65536;
+
+	static const size_t DEFAULT_COALESCE_THRESHOLD = 128 * 1024;
+	static const size_t DEFAULT_HARD_LIMIT = 8 * 1024 * 1024;
+
+	static void test();
+
+private:
+	void indexTransformUpdate(size_t packet_index) REQUIRES(mutex);
+
+	mutable Mutex mutex;
+	std::vector<SharedPacketRef> packets GUARDED_BY(mutex); // Packets removed by coalescing are set to NULL, and are skipped in takePackets().
+	size_t num_queued_bytes GUARDED_BY(mutex);
+	size_t coalesce_threshold GUARDED_BY(mutex);
+	size_t hard_limit GUARDED_BY(mutex);
+	bool coalescing GUARDED_BY(mutex); // True if num_queued_bytes has gone over coalesce_threshold since the packets were last taken.  The indices below are only maintained while coalescing.
+	bool contains_removed_packets GUARDED_BY(mutex); // Are there any NULL entries in packets?
+	bool overflowed GUARDED_BY(mutex);
+	size_t num_coalesced GUARDED_BY(mutex);
+	std::unordered_map<uint64, size_t> avatar_transform_update_index GUARDED_BY(mutex); // Map from avatar UID to index in packets of the latest queued AvatarTransformUpdate for the avatar.
+	std::unordered_map<uint64, size_t> object_transform_update_index GUARDED_BY(mutex); // Map from object UID to index in packets of the latest queued ObjectTransformUpdate for the object.
+};
@@ -0,0 +1,397 @@
+/*=====================================================================
+ParcelSpatialIndex.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ParcelSpatialIndex.h"
+
+
+#include <maths/mathstypes.h>
+
+
+static const float CELL_WIDTH = 32.f; // Parcels are typically 10 - 60 m wide.
+static const float RECIP_CELL_WIDTH = 1.f / CELL_WIDTH;
+static const float MAX_CELL_COORD = (float)(1 << 30); // Clamp cell coordinates to this, so we don't overflow when converting to int.
+static const int64 MAX_CELLS_PER_PARCEL = 1024; // Parcels overlapping more cells than this are stored in large_parcels instead.
+
+
+static inline int cellCoord(float x)
+{
+	return (int)myClamp(std::floor(x * RECIP_CELL_WIDTH), -MAX_CELL_COORD, MAX_CELL_COORD);
+}
+
+
+ParcelSpatialIndex::ParcelSpatialIndex()
+:	valid(false),
+	num_parcels(0),
+	num_all_writeable_parcels(0)
+{
+}
+
+
+ParcelSpatialIndex::~ParcelSpatialIndex()
+{
+}
+
+
+uint64 ParcelSpatialIndex::cellKeyForCoords(int x, int y)
+{
+	return ((uint64)(uint32)x << 32) | (uint64)(uint32)y;
+}
+
+
+static void addWritableParcelForUser(std::unordered_map<uint32, std::vector<const Parcel*>>& user_writable_parcels, const UserID& user_id, const Parcel* parcel)
+{
+	std::vector<const Parcel*>& user_parcels = user_writable_parcels[user_id.value()];
+	if(user_parcels.empty() || (user_parcels.back() != parcel)) // The user may be e.g. both the owner and a writer of the parcel, only add it once.
+		user_parcels.push_back(parcel);
+}
+
+
+void ParcelSpatialIndex::build(const std::map<ParcelID, ParcelRef>& parcels)
+{
+	cells.clear();
+	large_parcels.clear();
+	user_writable_parcels.clear();
+	num_all_writeable_parcels = 0;
+
+	for(auto it = parcels.begin(); it != parcels.end(); ++it)
+	{
+		const Parcel* parcel = it->second.ptr();
+
+		// Add to grid
+		const js::AABBox& aabb = parcel->aabb;
+		if(aabb.min_.isFinite() && aabb.max_.isFinite() && (aabb.min_[0] <= aabb.max_[0]) && (aabb.min_[1] <= aabb.max_[1]))
+		{
+			const int begin_x = cellCoord(aabb.min_[0]);
+			const int begin_y = cellCoord(aabb.min_[1]);
+			const int end_x   = cellCoord(aabb.max_[0]); // inclusive
+			const int end_y   = cellCoord(aabb.max_[1]); // inclusive
+
+			const int64 num_parcel_cells = ((int64)end_x - begin_x + 1) * ((int64)end_y - begin_y + 1);
+			if(num_parcel_cells <= MAX_CELLS_PER_PARCEL)
+			{
+				for(int y=begin_y; y<=end_y; ++y)
+				for(int x=begin_x; x<=end_x; ++x)
+					cells[cellKeyForCoords(x, y)].push_back(parcel);
+			}
+			else
+				large_parcels.push_back(parcel);
+		}
+		else // Parcel with empty or invalid bounds.  Just check it for every query, so pointInParcel() has the final say.
+			large_parcels.push_back(parcel);
+
+		// Add to per-user index
+		addWritableParcelForUser(user_writable_parcels, parcel->owner_id, parcel);
+		for(size_t z=0; z<parcel->admin_ids.size(); ++z)
+			addWritableParcelForUser(user_writable_parcels, parcel->admin_ids[z], parcel);
+		for(size_t z=0; z<parcel->writer_ids.size(); ++z)
+			addWritableParcelForUser(user_writable_parcels, parcel->writer_ids[z], parcel);
+
+		if(parcel->all_writeable)
+			num_all_writeable_parcels++;
+	}
+
+	num_parcels = parcels.size();
+	valid = true;
+}
+
+
+bool ParcelSpatialIndex::pointInParcelWithWritePerms(const Vec4f& p, const UserID& user_id) const
+{
+	assert(valid);
+
+	// Most users don't have write permissions for any parcels, so check for that case first.
+	if((num_all_writeable_parcels == 0) && (user_writable_parcels.count(user_id.value()) == 0))
+		return false;
+
+	if(p.isFinite())
+	{
+		auto res = cells.find(cellKeyForCoords(cellCoord(p[0]), cellCoord(p[1])));
+		if(res != cells.end())
+		{
+			const std::vector<const Parcel*>& cell_parcels = res->second;
+			for(size_t i=0; i<cell_parcels.size(); ++i)
+				if(cell_parcels[i]->pointInParcel(p) && cell_parcels[i]->userHasWritePerms(user_id))
+					return true;
+		}
+	}
+
+	for(size_t i=0; i<large_parcels.size(); ++i)
+		if(large_parcels[i]->pointInParcel(p) && large_parcels[i]->userHasWritePerms(user_id))
+			return true;
+
+	return false;
+}
+
+
+void ParcelSpatialIndex::getParcelsContainingPoint(const Vec4f& p, std::vector<const Parcel*>& parcels_out) const
+{
+	assert(valid);
+
+	if(p.isFinite())
+	{
+		auto res = cells.find(cellKeyForCoords(cellCoord(p[0]), cellCoord(p[1])));
+		if(res != cells.end())
+		{
+			const std::vector<const Parcel*>& cell_parcels = res->second;
+			for(size_t i=0; i<cell_parcels.size(); ++i)
+				if(cell_parcels[i]->pointInParcel(p))
+					parcels_out.push_back(cell_parcels[i]);
+		}
+	}
+
+	for(size_t i=0; i<large_parcels.size(); ++i)
+		if(large_parcels[i]->pointInParcel(p))
+			parcels_out.push_back(large_parcels[i]);
+}
+
+
+void ParcelSpatialIndex::getWritableParcelIDsForUser(const UserID& user_id, std::vector<ParcelID>& parcel_ids_out) const
+{
+	assert(valid);
+
+	auto res = user_writable_parcels.find(user_id.value());
+	if(res != user_writable_parcels.end())
+	{
+		const std::vector<const Parcel*>& user_parcels = res->second;
+		for(size_t i=0; i<user_parcels.size(); ++i)
+			parcel_ids_out.push_back(user_parcels[i]->id);
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <algorithm>
+
+
+// The linear scan that WorkerThread used to do.
+static bool bruteForcePointInParcelWithWritePerms(const std::map<ParcelID, ParcelRef>& parcels, const Vec4f& p, const UserID& user_id)
+{
+	for(auto it = parcels.begin(); it != parcels.end(); ++it)
+		if(it->second->pointInParcel(p) && it->second->userHasWritePerms(user_id))
+			return true;
+	return false;
+}
+
+
+static ParcelRef makeParcel(uint32 id, const Vec2d& min, const Vec2d& max, uint32 owner_id)
+{
+	ParcelRef parcel = new Parcel();
+	parcel->state = Parcel::State_Alive;
+	parcel->id = ParcelID(id);
+	parcel->owner_id = UserID(owner_id);
+	parcel->admin_ids.push_back(UserID(owner_id));
+	parcel->writer_ids.push_back(UserID(owner_id));
+	parcel->zbounds = Vec2d(-2, 20);
+	parcel->verts[0] = Vec2d(min.x, min.y);
+	parcel->verts[1] = Vec2d(max.x, min.y);
+	parcel->verts[2] = Vec2d(max.x, max.y);
+	parcel->verts[3] = Vec2d(min.x, max.y);
+	parcel->build();
+	return parcel;
+}
+
+
+// Make a city of blocks of parcels, separated by roads, similar to the blocks made in WorldCreation.
+// Each parcel is owned by one of num_users users, and some have an additional writer.
+static void makeCity(PCG32& rng, int num_parcels, uint32 num_users, std::map<ParcelID, ParcelRef>& parcels_out)
+{
+	const int parcels_per_side = (int)std::ceil(std::sqrt((double)num_parcels));
+	const double parcel_w = 20;
+	const double road_w = 5;
+	const double city_w = parcels_per_side * (parcel_w + road_w);
+
+	for(int i=0; i<num_parcels; ++i)
+	{
+		const int x = i % parcels_per_side;
+		const int y = i / parcels_per_side;
+		const Vec2d min(-city_w/2 + x * (parcel_w + road_w), -city_w/2 + y * (parcel_w + road_w));
+		ParcelRef parcel = makeParcel(i + 1, min, min + Vec2d(parcel_w, parcel_w), rng.nextUInt(num_users));
+		if(rng.unitRandom() < 0.2f)
+			parcel->writer_ids.push_back(UserID(rng.nextUInt(num_users)));
+		parcels_out[parcel->id] = parcel;
+	}
+}
+
+
+static Vec4f randomPointInCity(PCG32& rng, int num_parcels)
+{
+	const float city_w = (float)(std::ceil(std::sqrt((double)num_parcels)) * 25.0);
+	return Vec4f(-city_w/2 - 10 + rng.unitRandom() * (city_w + 20), -city_w/2 - 10 + rng.unitRandom() * (city_w + 20), -5 + rng.unitRandom() * 30, 1.f);
+}
+
+
+void ParcelSpatialIndex::test()
+{
+	conPrint("ParcelSpatialIndex::test()");
+
+	//-------------------------- Test some simple cases --------------------------
+	{
+		std::map<ParcelID, ParcelRef> parcels;
+		ParcelRef a = makeParcel(1, Vec2d(0, 0), Vec2d(20, 20), /*owner id=*/1);
+		ParcelRef b = makeParcel(2, Vec2d(30, 0), Vec2d(100, 20), /*owner id=*/2); // Spans multiple cells
+		b->writer_ids.push_back(UserID(3));
+		parcels[a->id] = a;
+		parcels[b->id] = b;
+
+		ParcelSpatialIndex index;
+		testAssert(!index.isValid());
+		index.build(parcels);
+		testAssert(index.isValid());
+		testAssert(index.numParcels() == 2);
+
+		testAssert(index.pointInParcelWithWritePerms(Vec4f(10, 10, 0, 1), UserID(1)));
+		testAssert(index.pointInParcelWithWritePerms(Vec4f(20, 20, 20, 1), UserID(1))); // On max corner of parcel
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(25, 10, 0, 1), UserID(1))); // Between parcels
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(10, 10, 0, 1), UserID(2))); // Not user 2's parcel
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(10, 10, 100, 1), UserID(1))); // Above parcel
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(10, 10, 0, 1), UserID(1000))); // User with no parcels
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(std::numeric_limits<float>::quiet_NaN(), 10, 0, 1), UserID(1)));
+
+		testAssert(index.pointInParcelWithWritePerms(Vec4f(90, 10, 0, 1), UserID(2)));
+		testAssert(index.pointInParcelWithWritePerms(Vec4f(90, 10, 0, 1), UserID(3))); // Writer
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(90, 10, 0, 1), UserID(1)));
+
+		std::vector<const Parcel*> containing;
+		index.getParcelsContainingPoint(Vec4f(50, 10, 0, 1), containing);
+		testAssert(containing.size() == 1 && containing[0] == b.ptr());
+
+		std::vector<ParcelID> ids;
+		index.getWritableParcelIDsForUser(UserID(2), ids);
+		testAssert(ids.size() == 1 && ids[0] == ParcelID(2)); // Should only be listed once, even though user 2 is the owner, an admin and a writer.
+		ids.clear();
+		index.getWritableParcelIDsForUser(UserID(1000), ids);
+		testAssert(ids.empty());
+
+		// Make parcel a all-writeable, and rebuild.
+		a->all_writeable = true;
+		index.invalidate();
+		testAssert(!index.isValid());
+		index.build(parcels);
+		testAssert(index.pointInParcelWithWritePerms(Vec4f(10, 10, 0, 1), UserID(1000)));
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(90, 10, 0, 1), UserID(1000)));
+
+		// Test a huge parcel, that will be stored in large_parcels.
+		ParcelRef huge = makeParcel(3, Vec2d(-1.0e6, -1.0e6), Vec2d(1.0e6, 1.0e6), /*owner id=*/4);
+		parcels[huge->id] = huge;
+		index.build(parcels);
+		testAssert(index.large_parcels.size() == 1);
+		testAssert(index.pointInParcelWithWritePerms(Vec4f(5.0e5f, -5.0e5f, 0, 1), UserID(4)));
+		testAssert(index.pointInParcelWithWritePerms(Vec4f(10, 10, 0, 1), UserID(4)));
+
+		// Building with no parcels
+		parcels.clear();
+		index.build(parcels);
+		testAssert(index.numParcels() == 0);
+		testAssert(!index.pointInParcelWithWritePerms(Vec4f(10, 10, 0, 1), UserID(1)));
+	}
+
+	//-------------------------- Test against brute force --------------------------
+	{
+		PCG32 rng(1);
+		const int num_parcels = 1000;
+		const uint32 num_users = 100;
+		std::map<ParcelID, ParcelRef> parcels;
+		makeCity(rng, num_parcels, num_users, parcels);
+
+		// Add some overlapping parcels, and a couple of all-writeable ones.
+		for(int i=0; i<50; ++i)
+		{
+			const Vec4f p = randomPointInCity(rng, num_parcels);
+			ParcelRef parcel = makeParcel(num_parcels + 1 + i, Vec2d(p[0], p[1]), Vec2d(p[0] + rng.unitRandom() * 200, p[1] + rng.unitRandom() * 200), rng.nextUInt(num_users));
+			parcel->all_writeable = i < 2;
+			parcels[parcel->id] = parcel;
+		}
+
+		ParcelSpatialIndex index;
+		index.build(parcels);
+
+		int num_true = 0;
+		for(int i=0; i<100000; ++i)
+		{
+			const Vec4f p = randomPointInCity(rng, num_parcels);
+			const UserID user_id(rng.nextUInt(num_users + 10)); // Include some users with no parcels
+			const bool res = index.pointInParcelWithWritePerms(p, user_id);
+			testAssert(res == bruteForcePointInParcelWithWritePerms(parcels, p, user_id));
+			if(res)
+				num_true++;
+		}
+		testAssert(num_true > 0);
+
+		// Check per-user index against brute force
+		for(uint32 u=0; u<num_users + 10; ++u)
+		{
+			std::vector<ParcelID> ids;
+			index.getWritableParcelIDsForUser(UserID(u), ids);
+			std::sort(ids.begin(), ids.end());
+
+			std::vector<ParcelID> brute_ids;
+			for(auto it = parcels.begin(); it != parcels.end(); ++it)
+				if(it->second->owner_id == UserID(u) || it->second->userIsParcelAdmin(UserID(u)) || it->second->userIsParcelWriter(UserID(u)))
+					brute_ids.push_back(it->first);
+
+			testAssert(ids == brute_ids);
+		}
+	}
+
+	//-------------------------- Perf test: write permission checks in a generated city of 10k parcels --------------------------
+	{
+		PCG32 rng(1);
+		const int num_parcels = 10000;
+		const uint32 num_users = 2000;
+		std::map<ParcelID, ParcelRef> parcels;
+		makeCity(rng, num_parcels, num_users, parcels);
+
+		ParcelSpatialIndex index;
+		{
+			Timer timer;
+			index.build(parcels);
+			conPrint("Building parcel index for " + toString(num_parcels) + " parcels took " + timer.elapsedStringNSigFigs(4));
+		}
+
+		const int num_queries = 100000;
+		std::vector<Vec4f> query_points(num_queries);
+		std::vector<UserID> query_users(num_queries);
+		for(int i=0; i<num_queries; ++i)
+		{
+			query_points[i] = randomPointInCity(rng, num_parcels);
+			query_users[i] = UserID(rng.nextUInt(num_users + num_users / 2)); // A third of the queries are from users without any parcels.
+		}
+
+		int num_brute_force_true = 0;
+		int num_index_true = 0;
+		double brute_force_time, index_time;
+		{
+			Timer timer;
+			for(int i=0; i<num_queries; ++i)
+				if(bruteForcePointInParcelWithWritePerms(parcels, query_points[i], query_users[i]))
+					num_brute_force_true++;
+			brute_force_time = timer.elapsed();
+		}
+		{
+			Timer timer;
+			for(int i=0; i<num_queries; ++i)
+				if(index.pointInParcelWithWritePerms(query_points[i], query_users[i]))
+					num_index_true++;
+			index_time = timer.elapsed();
+		}
+		testAssert(num_brute_force_true == num_index_true);
+
+		conPrint("Object write permission check with " + toString(num_parcels) + " parcels:");
+		conPrint("    linear scan:   " + doubleToStringNSigFigs(brute_force_time / num_queries * 1.0e9, 4) + " ns / check");
+		conPrint("    parcel index:  " + doubleToStringNSigFigs(index_time       / num_queries * 1.0e9, 4) + " ns / check (" + doubleToStringNSigFigs(brute_force_time / index_time, 3) + "x speedup)");
+	}
+
+	conPrint("ParcelSpatialIndex::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,72 @@
+/*=====================================================================
+ParcelSpatialIndex.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/Parcel.h"
+#include "../shared/UserID.h"
+#include <Platform.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+
+/*=====================================================================
+ParcelSpatialIndex
+------------------
+Acceleration structure for object write-permission checks.
+
+Consists of a uniform grid over the x-y bounds of the parcels in a world,
+and a map from user id to the parcels the user has write permissions for.
+Used for checking if an object is in a parcel that the user can write to,
+without iterating over every parcel in the world.
+
+The index is built from the whole parcel map in one go.  Parcels change
+rarely compared to objects, so when any parcel changes (see
+ServerWorldState::addParcelAsDBDirty()) the index is invalidated and is
+rebuilt on next use.
+
+Stores pointers to the parcels, so must be invalidated before a parcel
+is removed from the parcel map.
+
+Not threadsafe, the world state mutex should be held while using this.
+=====================================================================*/
+class ParcelSpatialIndex
+{
+public:
+	ParcelSpatialIndex();
+	~ParcelSpatialIndex();
+
+	void build(const std::map<ParcelID, ParcelRef>& parcels);
+
+	void invalidate() { valid = false; }
+	bool isValid() const { return valid; }
+
+	// Is the point p in some parcel that the user given by user_id has write permissions for?  (See Parcel::userHasWritePerms())
+	bool pointInParcelWithWritePerms(const Vec4f& p, const UserID& user_id) const;
+
+	// Appends all parcels containing point p (using Parcel::pointInParcel()) to parcels_out.
+	void getParcelsContainingPoint(const Vec4f& p, std::vector<const Parcel*>& parcels_out) const;
+
+	// Returns IDs of the parcels that the user is the owner, an admin or a writer of.  Doesn't include all-writeable parcels.
+	void getWritableParcelIDsForUser(const UserID& user_id, std::vector<ParcelID>& parcel_ids_out) const;
+
+	size_t numParcels() const { return num_parcels; }
+
+	static void test();
+
+private:
+	static uint64 cellKeyForCoords(int x, int y);
+
+	bool valid;
+	size_t num_parcels;
+
+	std::unordered_map<uint64, std::vector<const Parcel*>> cells; // Map from cell key to parcels overlapping cell.  Only non-empty cells are stored.
+	std::vector<const Parcel*> large_parcels; // Parcels that overlap too many cells to be stored in the grid.  Checked for every query.
+
+	std::unordered_map<uint32, std::vector<const Parcel*>> user_writable_parcels; // Map from user id value to parcels the user is the owner, an admin or a writer of.
+	size_t num_all_writeable_parcels;
+};
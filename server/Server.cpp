@@ -7,13 +7,18 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "ListenerThread.h"
+#include "EpollServer.h"
 #include "UDPHandlerThread.h"
 #include "MeshLODGenThread.h"
 #include "DynamicTextureUpdaterThread.h"
+#include "MapTilePyramidThread.h"
+#include "MapTilePyramid.h"
 //#include "ChunkGenThread.h"
 #include "WorkerThread.h"
+#include "DatabaseWriterThread.h"
 #include "ServerTestSuite.h"
 #include "WorldCreation.h"
+#include "TickScheduler.h"
 #include "../shared/Protocol.h"
 #include "../shared/Version.h"
 #include "../shared/MessageUtils.h"
@@ -39,6 +44,7 @@ Copyright Glare Technologies Limited 2023 -
 #include <utils/Timer.h>
 #include <utils/FileUtils.h>
 #include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
 #include <utils/Exception.h>
 #include <utils/Parser.h>
 #include <utils/XMLParseUtils.h>
@@ -47,14 +53,25 @@ Copyright Glare Technologies Limited 2023 -
 #include <utils/SocketBufferOutStream.h>
 #include <utils/OpenSSL.h>
 #include <tls.h>
+#include <csignal>
+
+
+// Set by the SIGINT/SIGTERM handler, to make the main server loop exit, so that the world state can be flushed to disk.
+static volatile sig_atomic_t server_should_stop = 0;
+
+static void stopSignalHandler(int /*sig*/)
+{
+	server_should_stop = 1;
+}
 
 
 void updateMapTiles(ServerAllWorldsState& world_state)
 {
 	uint64 next_shot_id = world_state.getNextScreenshotUID();
 
-	const int z_begin = 0;
-	const int z_end = 7;
+	// Only the tiles at MapTilePyramid::MAX_TILE_Z are rendered by the screenshot bot, the coarser tiles are built from them by MapTilePyramidThread.
+	const int z_begin = MapTilePyramid::MIN_TILE_Z;
+	const int z_end = MapTilePyramid::MAX_TILE_Z + 1;
 	if(true) // world_state.map_tile_info.empty())
 	{
 		// world_state.map_tile_info.clear();
@@ -126,17 +143,52 @@ void updateMapTiles(ServerAllWorldsState& world_state)
 }
 
 
-static void enqueueMessageToBroadcast(SocketBufferOutStream& packet_buffer, std::vector<std::string>& broadcast_packets)
+static void enqueueMessageToBroadcast(SocketBufferOutStream& packet_buffer, std::vector<BroadcastPacket>& broadcast_packets)
 {
 	MessageUtils::updatePacketLengthField(packet_buffer);
 
 	if(packet_buffer.buf.size() > 0)
 	{
-		std::string packet_string(packet_buffer.buf.size(), '\0');
+		broadcast_packets.push_back(BroadcastPacket());
+		BroadcastPacket& packet = broadcast_packets.back();
+		packet.data = SharedPacket::make(packet_buffer); // Serialise once, the packet is shared between all the WorkerThreads that send it.
+		packet.filtered = false;
+		packet.entity_key = 0;
+		packet.entity_pos = Vec3d(0.0);
+		packet.is_transform_update = false;
+	}
+}
+
+
+// Enqueue an update about an entity (object or avatar), that will only be sent to clients that have the entity in their area of interest.
+static void enqueueEntityUpdateToBroadcast(SocketBufferOutStream& packet_buffer, uint64 entity_key, const Vec3d& entity_pos, std::vector<BroadcastPacket>& broadcast_packets)
+{
+	enqueueMessageToBroadcast(packet_buffer, broadcast_packets);
+
+	if(packet_buffer.buf.size() > 0)
+	{
+		BroadcastPacket& packet = broadcast_packets.back();
+		packet.filtered = true;
+		packet.entity_key = entity_key;
+		packet.entity_pos = entity_pos;
+	}
+}
 
-		std::memcpy(&packet_string[0], packet_buffer.buf.data(), packet_buffer.buf.size());
 
-		broadcast_packets.push_back(packet_string);
+// Enqueue a transform update about an entity.  packet_buffer holds the individual transform update message, which is sent to clients that don't support TransformUpdateBatch messages.
+// Other clients will be sent 'update' in a TransformUpdateBatch message.
+static void enqueueTransformUpdateToBroadcast(SocketBufferOutStream& packet_buffer, uint64 entity_key, const Vec3d& entity_pos, TransformUpdate& update, ServerWorldState& world_state, std::vector<BroadcastPacket>& broadcast_packets)
+{
+	// Leave out fields that haven't changed since the last update for the entity.
+	world_state.setTransformUpdatePresentFields(entity_key, update);
+
+	enqueueEntityUpdateToBroadcast(packet_buffer, entity_key, entity_pos, broadcast_packets);
+
+	if(packet_buffer.buf.size() > 0)
+	{
+		BroadcastPacket& packet = broadcast_packets.back();
+		packet.is_transform_update = true;
+		packet.transform_update = update;
 	}
 }
 
@@ -183,6 +235,31 @@ static ServerConfig parseServerConfig(const std::string& config_path)
 	config.tls_private_key_path			= XMLParseUtils::parseStringWithDefault(root_elem, "tls_private_key_path", /*default val=*/"");
 	config.allow_light_mapper_bot_full_perms = XMLParseUtils::parseBoolWithDefault(root_elem, "allow_light_mapper_bot_full_perms", /*default val=*/false);
 	config.update_parcel_sales			= XMLParseUtils::parseBoolWithDefault(root_elem, "update_parcel_sales", /*default val=*/false);
+	config.interest_radius				= XMLParseUtils::parseDoubleWithDefault(root_elem, "interest_radius", /*default val=*/0.0);
+	config.interest_hysteresis			= XMLParseUtils::parseDoubleWithDefault(root_elem, "interest_hysteresis", /*default val=*/50.0);
+	config.voice_hearing_radius			= XMLParseUtils::parseDoubleWithDefault(root_elem, "voice_hearing_radius", /*default val=*/200.0);
+	config.num_UDP_handler_threads		= XMLParseUtils::parseIntWithDefault(root_elem, "num_UDP_handler_threads", /*default val=*/1);
+	config.use_epoll_connection_layer	= XMLParseUtils::parseBoolWithDefault(root_elem, "use_epoll_connection_layer", /*default val=*/false);
+	config.num_epoll_threads			= XMLParseUtils::parseIntWithDefault(root_elem, "num_epoll_threads", /*default val=*/4);
+	config.UDP_transform_updates		= XMLParseUtils::parseBoolWithDefault(root_elem, "UDP_transform_updates", /*default val=*/false);
+	config.tick_rate					= XMLParseUtils::parseDoubleWithDefault(root_elem, "tick_rate", /*default val=*/10.0);
+	config.idle_tick_rate				= XMLParseUtils::parseDoubleWithDefault(root_elem, "idle_tick_rate", /*default val=*/4.0);
+	config.use_database_write_log		= XMLParseUtils::parseBoolWithDefault(root_elem, "use_database_write_log", /*default val=*/true);
+
+	// Per-world tick rates, e.g. <world_tick_rate><world_name>physicsworld</world_name><rate>30</rate></world_tick_rate>
+	for(pugi::xml_node world_tick_rate_elem = root_elem.child("world_tick_rate"); world_tick_rate_elem; world_tick_rate_elem = world_tick_rate_elem.next_sibling("world_tick_rate"))
+	{
+		const std::string world_name = XMLParseUtils::parseString(world_tick_rate_elem, "world_name");
+		const double rate = XMLParseUtils::parseDouble(world_tick_rate_elem, "rate");
+		if(!(rate > 0 && rate <= 1000))
+			throw glare::Exception("Invalid rate for world '" + world_name + "' in world_tick_rate element: " + doubleToStringNSigFigs(rate, 4));
+		config.world_tick_rates[world_name] = rate;
+	}
+
+	if(!(config.tick_rate > 0 && config.tick_rate <= 1000))
+		throw glare::Exception("Invalid tick_rate: " + doubleToStringNSigFigs(config.tick_rate, 4));
+	if(!(config.idle_tick_rate > 0 && config.idle_tick_rate <= config.tick_rate))
+		throw glare::Exception("Invalid idle_tick_rate: " + doubleToStringNSigFigs(config.idle_tick_rate, 4) + ", should be > 0 and <= tick_rate.");
 	return config;
 }
 
@@ -203,6 +280,9 @@ int main(int argc, char *argv[])
 		syntax["--enable_dev_mode"] = std::vector<ArgumentParser::ArgumentType>();
 		syntax["--test"] = std::vector<ArgumentParser::ArgumentType>();
 		syntax["--save_sanitised_database"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // One string arg
+		syntax["--state_dir"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Use the given server state dir instead of the default one.  Screenshots and webserver files are kept in it as well.
+		syntax["--port"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Listen port for the substrata protocol, default 7600.
+		syntax["--no_webserver"] = std::vector<ArgumentParser::ArgumentType>(); // Don't listen for HTTP connections on ports 80 and 443.
 
 		std::vector<std::string> args;
 		for(int i=0; i<argc; ++i)
@@ -223,18 +303,23 @@ int main(int argc, char *argv[])
 		//-----------------------------------------------------------------------------------------
 
 
-		const int listen_port = 7600; // Listen port for sub protocol
+		const int listen_port = parsed_args.isArgPresent("--port") ? stringToInt(parsed_args.getArgStringValue("--port")) : 7600; // Listen port for sub protocol
+
+		// If the state dir is given explicitly (e.g. by the stress test for a local server), keep everything in it, as on Windows and Mac.
+		const bool use_local_state_dir = parsed_args.isArgPresent("--state_dir");
+		const bool run_webserver = !parsed_args.isArgPresent("--no_webserver");
 
 #if defined(_WIN32)
 		const std::string substrata_appdata_dir = PlatformUtils::getOrCreateAppDataDirectory("Substrata");
-		const std::string server_state_dir = substrata_appdata_dir + "/server_data";
+		const std::string default_server_state_dir = substrata_appdata_dir + "/server_data";
 #elif defined(OSX)
 		const std::string username = PlatformUtils::getLoggedInUserName();
-		const std::string server_state_dir = "/Users/" + username + "/cyberspace_server_state";
+		const std::string default_server_state_dir = "/Users/" + username + "/cyberspace_server_state";
 #else
 		const std::string username = PlatformUtils::getLoggedInUserName();
-		const std::string server_state_dir = "/home/" + username + "/cyberspace_server_state";
+		const std::string default_server_state_dir = "/home/" + username + "/cyberspace_server_state";
 #endif
+		const std::string server_state_dir = use_local_state_dir ? parsed_args.getArgStringValue("--state_dir") : default_server_state_dir;
 		conPrint("server_state_dir: " + server_state_dir);
 		FileUtils::createDirIfDoesNotExist(server_state_dir);
 
@@ -312,13 +397,15 @@ int main(int argc, char *argv[])
 #if defined(_WIN32) || defined(OSX)
 		server.screenshot_dir = server_state_dir + "/screenshots"; // Dir generated screenshots will be saved to.
 #else
-		server.screenshot_dir = "/var/www/cyberspace/screenshots";
+		server.screenshot_dir = use_local_state_dir ? (server_state_dir + "/screenshots") : "/var/www/cyberspace/screenshots";
 #endif
 		FileUtils::createDirIfDoesNotExist(server.screenshot_dir);
 
 
 		const std::string server_state_path = server_state_dir + "/server_state.bin";
 
+		server.world_state->use_database_write_log = server_config.use_database_write_log;
+
 		if(FileUtils::fileExists(server_state_path))
 			server.world_state->readFromDisk(server_state_path);
 		else
@@ -373,15 +460,23 @@ int main(int argc, char *argv[])
 
 		std::string default_fragments_dir, default_webclient_dir, default_webserver_public_files_dir;
 #if defined(_WIN32) || defined(OSX)
-		default_fragments_dir				= server_state_dir + "/webserver_fragments";
-		default_webserver_public_files_dir	= server_state_dir + "/webserver_public_files";
-		default_webclient_dir				= server_state_dir + "/webclient";
+		const bool use_state_dir_for_web_files = true;
 #else
-		default_fragments_dir				= "/var/www/cyberspace/webserver_fragments";
-		default_webserver_public_files_dir	= "/var/www/cyberspace/public_html";
-		default_webclient_dir				= "/var/www/cyberspace/webclient";
-		//web_data_store->letsencrypt_webroot			= "/var/www/cyberspace/letsencrypt_webroot";
+		const bool use_state_dir_for_web_files = use_local_state_dir;
 #endif
+		if(use_state_dir_for_web_files)
+		{
+			default_fragments_dir				= server_state_dir + "/webserver_fragments";
+			default_webserver_public_files_dir	= server_state_dir + "/webserver_public_files";
+			default_webclient_dir				= server_state_dir + "/webclient";
+		}
+		else
+		{
+			default_fragments_dir				= "/var/www/cyberspace/webserver_fragments";
+			default_webserver_public_files_dir	= "/var/www/cyberspace/public_html";
+			default_webclient_dir				= "/var/www/cyberspace/webclient";
+			//web_data_store->letsencrypt_webroot			= "/var/www/cyberspace/letsencrypt_webroot";
+		}
 		// Use fragments_dir from the server config.xml file if it's in there (if string is non-empty), otherwise use a default value.
 		if(!server_config.webserver_fragments_dir.empty())
 			web_data_store->fragments_dir = server_config.webserver_fragments_dir;
@@ -417,8 +512,13 @@ int main(int argc, char *argv[])
 		shared_request_handler->dev_mode = dev_mode;
 
 		ThreadManager web_thread_manager;
-		web_thread_manager.addThread(new web::WebListenerThread(80,  shared_request_handler.getPointer(), NULL));
-		web_thread_manager.addThread(new web::WebListenerThread(443, shared_request_handler.getPointer(), web_tls_configuration));
+		if(run_webserver)
+		{
+			web_thread_manager.addThread(new web::WebListenerThread(80,  shared_request_handler.getPointer(), NULL));
+			web_thread_manager.addThread(new web::WebListenerThread(443, shared_request_handler.getPointer(), web_tls_configuration));
+		}
+		else
+			conPrint("Not running webserver (--no_webserver was given).");
 
 
 		web_thread_manager.addThread(new WebDataFileWatcherThread(web_data_store));
@@ -446,10 +546,20 @@ int main(int argc, char *argv[])
 		if(tls_config_set_key_file(tls_configuration, tls_private_key_path.c_str()) != 0) // set private key
 			throw glare::Exception("tls_config_set_key_file failed: " + getTLSConfigErrorString(tls_configuration));
 
-		conPrint("Launching ListenerThread...");
-
 		ThreadManager thread_manager;
-		thread_manager.addThread(new ListenerThread(listen_port, &server, tls_configuration));
+#if defined(__linux__)
+		if(server_config.use_epoll_connection_layer)
+		{
+			const int num_epoll_threads = myMax(1, server_config.num_epoll_threads);
+			conPrint("Launching EpollListenerThread with " + toString(num_epoll_threads) + " loop threads...");
+			thread_manager.addThread(new EpollListenerThread(listen_port, &server, tls_configuration, num_epoll_threads));
+		}
+		else
+#endif
+		{
+			conPrint("Launching ListenerThread...");
+			thread_manager.addThread(new ListenerThread(listen_port, &server, tls_configuration));
+		}
 		
 		conPrint("Done.");
 		//----------------------------------------------- End launch substrata protocol server -----------------------------------------------
@@ -458,32 +568,140 @@ int main(int argc, char *argv[])
 
 		//thread_manager.addThread(new ChunkGenThread(server.world_state.ptr()));
 
-		server.udp_handler_thread_manager.addThread(new UDPHandlerThread(&server));
+		{
+			// Multiple UDP handler threads need SO_REUSEPORT, so just use one thread on other platforms.
+#if defined(__linux__)
+			const int num_UDP_handler_threads = myMax(1, server_config.num_UDP_handler_threads);
+#else
+			const int num_UDP_handler_threads = 1;
+#endif
+			for(int i=0; i<num_UDP_handler_threads; ++i)
+				server.udp_handler_thread_manager.addThread(new UDPHandlerThread(&server, /*reuse_port=*/num_UDP_handler_threads > 1));
+		}
 
 		server.dyn_tex_updater_thread_manager.addThread(new DynamicTextureUpdaterThread(&server, server.world_state.ptr()));
 
+		server.database_writer_thread_manager.addThread(new DatabaseWriterThread(server.world_state.ptr()));
+
+		server.map_tile_pyramid_thread_manager.addThread(new MapTilePyramidThread(server.world_state.ptr(), server.screenshot_dir));
+
 		Timer save_state_timer;
+		Timer write_log_compaction_timer;
+		Timer time_sync_timer;
+		Timer parcel_sales_timer;
+		Timer overrun_report_timer;
+
+		// Decides when each world is next due to have its updates generated and sent.
+		TickScheduler tick_scheduler(/*default period=*/1.0 / server_config.tick_rate, /*idle period=*/1.0 / server_config.idle_tick_rate);
+		for(auto it = server_config.world_tick_rates.begin(); it != server_config.world_tick_rates.end(); ++it)
+		{
+			conPrint("Using tick rate of " + doubleToStringNSigFigs(it->second, 4) + " Hz for world '" + it->first + "'");
+			tick_scheduler.setWorldPeriod(it->first, 1.0 / it->second);
+		}
 
 		// A map from world name to a vector of packets to send to clients connected to that world.
-		std::map<std::string, std::vector<std::string>> broadcast_packets;
+		std::map<std::string, std::vector<BroadcastPacket>> broadcast_packets;
+
+		// A map from world name to the clients connected to that world.
+		std::map<std::string, std::vector<BroadcastSink*>> world_sinks;
+		std::vector<Reference<WorkerThread>> sink_refs; // Keeps the clients in world_sinks alive while the packets for each world are delivered.
+		std::unordered_map<WorkerThread*, ServerConnectedClientInfo> udp_client_infos;
+		Reference<UDPSocket> udp_client_infos_socket;
+
+		std::vector<std::pair<std::string, Reference<ServerWorldState>>> worlds;
+
+		InterestManager interest_manager;
+		interest_manager.setRadius(server_config.interest_radius, server_config.interest_hysteresis);
+		if(interest_manager.isEnabled())
+			conPrint("Filtering broadcast updates with interest radius " + doubleToStringNSigFigs(server_config.interest_radius, 4) + " m");
+
+		std::signal(SIGINT, stopSignalHandler);
+		std::signal(SIGTERM, stopSignalHandler);
 
 		// Main server loop
 		uint64 loop_iter = 0;
-		while(1)
+		while(!server_should_stop)
 		{
-			PlatformUtils::Sleep(100);
-
 			SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-			{ // Begin scope for world_state->mutex lock
-
+			// Get the list of worlds, and send out any server admin message, while holding the global world state mutex.
+			{
 				Lock lock(server.world_state->mutex);
 
+				// Only process the worlds that are due to be ticked.
+				const double tick_start_time = Clock::getTimeSinceInit();
+				worlds.clear();
 				for(auto world_it = server.world_state->world_states.begin(); world_it != server.world_state->world_states.end(); ++world_it)
+					if(tick_scheduler.isWorldDue(world_it->first, tick_start_time))
+						worlds.push_back(std::make_pair(world_it->first, world_it->second));
+
+				if(server.world_state->server_admin_message_changed)
 				{
-					Reference<ServerWorldState> world_state = world_it->second;
+					conPrint("Sending ServerAdminMessages to clients...");
 
-					std::vector<std::string>& world_packets = broadcast_packets[world_it->first];
+					// Send out ServerAdminMessageID packets to clients
+					MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
+					scratch_packet.writeStringLengthFirst(server.world_state->server_admin_message);
+					MessageUtils::updatePacketLengthField(scratch_packet);
+					const SharedPacketRef admin_msg_packet = SharedPacket::make(scratch_packet);
+
+					server.enqueuePacketToAllClients(admin_msg_packet);
+
+					server.world_state->server_admin_message_changed = false;
+				}
+			}
+
+			// Get the connected clients, and the world each client is connected to.
+			// References to the clients are kept in sink_refs, so the sinks stay valid while the packets are delivered below.
+			if(!worlds.empty())
+			{
+				Reference<UDPSocket> udp_send_socket;
+				if(server_config.UDP_transform_updates)
+				{
+					Lock udp_lock(server.udp_send_socket_mutex);
+					udp_send_socket = server.udp_send_socket;
+				}
+
+				Lock lock2(server.worker_thread_manager.getMutex());
+				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
+				{
+					WorkerThread* worker = static_cast<WorkerThread*>(i->getPointer());
+					world_sinks[worker->connected_world_name].push_back(worker);
+					sink_refs.push_back(worker);
+				}
+
+				Lock lock3(server.epoll_clients_mutex);
+				for(auto i = server.epoll_clients.begin(); i != server.epoll_clients.end(); ++i)
+				{
+					world_sinks[(*i)->connected_world_name].push_back(*i);
+					sink_refs.push_back(*i);
+				}
+
+				// Get the client UDP info needed to decide which clients to send transform updates to by UDP this tick.
+				if(server_config.UDP_transform_updates)
+				{
+					udp_client_infos.clear();
+					Lock lock4(server.connected_clients_mutex);
+					for(size_t z=0; z<sink_refs.size(); ++z)
+					{
+						auto client_res = server.connected_clients.find(sink_refs[z].ptr());
+						if(client_res != server.connected_clients.end())
+							udp_client_infos[sink_refs[z].ptr()] = client_res->second;
+					}
+					udp_client_infos_socket = udp_send_socket;
+				}
+			}
+
+			// For each world, generate packets for avatar and object changes, and send them to the clients connected to the world, filtered by each client's area of interest.
+			// Each world is processed while holding just its own mutex, so that activity in other worlds isn't blocked.
+			for(size_t w=0; w<worlds.size(); ++w)
+			{
+				Reference<ServerWorldState> world_state = worlds[w].second;
+
+				{ // Begin scope for world mutex lock
+					Lock world_lock(world_state->mutex);
+
+					std::vector<BroadcastPacket>& world_packets = broadcast_packets[worlds[w].first];
 
 					// Generate packets for avatar changes
 					for(auto i = world_state->avatars.begin(); i != world_state->avatars.end();)
@@ -499,6 +717,8 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								world_state->clearLastSentTransformUpdate(InterestManager::avatarEntityKey(avatar->uid)); // The transform was sent in the full update.
+
 								avatar->other_dirty = false;
 								avatar->transform_dirty = false;
 								i++;
@@ -511,6 +731,8 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								world_state->clearLastSentTransformUpdate(InterestManager::avatarEntityKey(avatar->uid));
+
 								avatar->state = Avatar::State_Alive;
 								avatar->other_dirty = false;
 								avatar->transform_dirty = false;
@@ -525,6 +747,8 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								world_state->clearLastSentTransformUpdate(InterestManager::avatarEntityKey(avatar->uid));
+
 								// Remove avatar from avatar map
 								auto old_avatar_iterator = i;
 								i++;
@@ -548,7 +772,8 @@ int main(int argc, char *argv[])
 								writeToStream(avatar->rotation, scratch_packet);
 								scratch_packet.writeUInt32(avatar->anim_state);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								TransformUpdate update = TransformUpdate::makeAvatarUpdate(avatar->uid, avatar->pos, avatar->rotation, avatar->anim_state);
+								enqueueTransformUpdateToBroadcast(scratch_packet, InterestManager::avatarEntityKey(avatar->uid), avatar->pos, update, *world_state, world_packets);
 
 								avatar->transform_dirty = false;
 							}
@@ -575,7 +800,9 @@ int main(int argc, char *argv[])
 								MessageUtils::initPacket(scratch_packet, Protocol::ObjectFullUpdate);
 								ob->writeToNetworkStream(scratch_packet);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								enqueueEntityUpdateToBroadcast(scratch_packet, InterestManager::objectEntityKey(ob->uid), ob->pos, world_packets);
+
+								world_state->clearLastSentTransformUpdate(InterestManager::objectEntityKey(ob->uid)); // The transform was sent in the full update.
 
 								ob->from_remote_other_dirty = false;
 								ob->from_remote_transform_dirty = false; // transform is sent in full packet also.
@@ -589,6 +816,8 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+								world_state->clearLastSentTransformUpdate(InterestManager::objectEntityKey(ob->uid));
+
 								ob->state = WorldObject::State_Alive;
 								ob->from_remote_other_dirty = false;
 								server.world_state->markAsChanged();
@@ -601,13 +830,22 @@ int main(int argc, char *argv[])
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
 
-								// Remove from dirty-set, so it's not updated in DB.
+								// Remove from dirty-sets, so it's not updated in DB.
 								world_state->db_dirty_world_objects.erase(ob);
+								world_state->db_dirty_world_object_transforms.erase(ob);
 
 								// Add DB record to list of records to be deleted.
-								server.world_state->db_records_to_delete.insert(ob->database_key);
-
-								// Remove ob from object map
+								// Any transform record for the object is removed when the database is next loaded.  Deleting it here could leave the full record without its newer transform, if the batch is only partly written.
+								world_state->db_records_to_delete.insert(ob->database_key);
+
+								// Remove ob from object map, spatial index and URL index
+								world_state->object_spatial_index.remove(ob);
+								{
+									Lock url_index_lock(server.world_state->object_URL_index_mutex);
+									server.world_state->object_URL_index.removeObject(ob->uid);
+								}
+								world_state->object_packet_cache.removeObject(ob->uid);
+								world_state->clearLastSentTransformUpdate(InterestManager::objectEntityKey(ob->uid));
 								world_state->objects.erase(ob->uid);
 
 								conPrint("Removed object from world_state->objects");
@@ -635,7 +873,8 @@ int main(int argc, char *argv[])
 
 								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								TransformUpdate update = TransformUpdate::makeObjectUpdate(ob->uid, ob->pos, Quatf::fromAxisAndAngle(normalise(ob->axis), ob->angle), ob->scale, ob->last_transform_update_avatar_uid);
+								enqueueTransformUpdateToBroadcast(scratch_packet, InterestManager::objectEntityKey(ob->uid), ob->pos, update, *world_state, world_packets);
 
 								ob->from_remote_transform_dirty = false;
 								server.world_state->markAsChanged();
@@ -661,7 +900,9 @@ int main(int argc, char *argv[])
 								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
 								scratch_packet.writeDouble(ob->last_transform_client_time);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								TransformUpdate update = TransformUpdate::makeObjectPhysicsUpdate(ob->uid, ob->pos, rot, Vec3f(ob->linear_vel.x[0], ob->linear_vel.x[1], ob->linear_vel.x[2]),
+									Vec3f(ob->angular_vel.x[0], ob->angular_vel.x[1], ob->angular_vel.x[2]), ob->last_transform_update_avatar_uid, ob->last_transform_client_time);
+								enqueueTransformUpdateToBroadcast(scratch_packet, InterestManager::objectEntityKey(ob->uid), ob->pos, update, *world_state, world_packets);
 
 								ob->from_remote_transform_dirty = false;
 								server.world_state->markAsChanged();
@@ -707,66 +948,66 @@ int main(int argc, char *argv[])
 					}
 
 					world_state->dirty_from_remote_objects.clear();
-				} // End for each server world
-
-
-				if(server.world_state->server_admin_message_changed)
-				{
-					conPrint("Sending ServerAdminMessages to clients...");
 
-					// Send out ServerAdminMessageID packets to clients
-					MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
-					scratch_packet.writeStringLengthFirst(server.world_state->server_admin_message);
-					MessageUtils::updatePacketLengthField(scratch_packet);
-
-					Lock lock3(server.worker_thread_manager.getMutex());
-					for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
+					// Enqueue packets to worker threads to send.
+					// This is done while holding the world mutex, as the interest manager needs to read client positions, and may need to send full updates for entities.
+					auto sinks_res = world_sinks.find(worlds[w].first);
+					if(sinks_res != world_sinks.end() && !sinks_res->second.empty())
 					{
-						assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-						static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(scratch_packet);
-					}
+						std::vector<BroadcastSink*>& sinks = sinks_res->second;
 
-					server.world_state->server_admin_message_changed = false;
-				}
+						// Decide which clients to send transform updates to by UDP this tick.
+						if(server_config.UDP_transform_updates)
+						{
+							const double cur_time = Clock::getTimeSinceInit();
+							for(size_t z=0; z<sinks.size(); ++z)
+							{
+								WorkerThread* worker = static_cast<WorkerThread*>(sinks[z]);
+								auto client_res = udp_client_infos.find(worker);
+								if(client_res != udp_client_infos.end())
+								{
+									const ServerConnectedClientInfo& info = client_res->second;
+									worker->udp_transform_state.update(worker->supportsUDPTransformUpdates(), udp_client_infos_socket, info.ip_addr, info.client_UDP_port, info.client_avatar_id,
+										info.num_transform_datagrams_received, info.last_UDP_packet_time, cur_time);
+								}
+								else
+									worker->udp_transform_state.enabled = false;
+							}
+						}
 
-			} // End scope for world_state->mutex lock
+						interest_manager.deliverPackets(*world_state, world_packets, sinks, scratch_packet);
+					}
 
-			// Enqueue packets to worker threads to send
-			// For each connected client, get packets for the world the client is connected to, and send to them.
-			{
-				Lock lock2(server.worker_thread_manager.getMutex());
-				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
-				{
-					WorkerThread* worker = static_cast<WorkerThread*>(i->getPointer());
-					std::vector<std::string>& packets = broadcast_packets[worker->connected_world_name];
+					tick_scheduler.worldTicked(worlds[w].first, Clock::getTimeSinceInit(), /*had dirty entities=*/!world_packets.empty());
+				} // End scope for world mutex lock
+			} // End for each server world
 
-					for(size_t z=0; z<packets.size(); ++z)
-						worker->enqueueDataToSend(packets[z]);
-				}
-			}
+			for(auto it = world_sinks.begin(); it != world_sinks.end(); ++it)
+				it->second.clear();
+			sink_refs.clear();
 
 			// Clear broadcast_packets vectors of packets.
 			for(auto it = broadcast_packets.begin(); it != broadcast_packets.end(); ++it)
 				it->second.clear();
 			
-			if((loop_iter % 40) == 0) // Approx every 4 s.
+			if((loop_iter == 0) || (time_sync_timer.elapsed() > 4.0))
 			{
+				time_sync_timer.reset();
+
 				// Send out TimeSyncMessage packets to clients
 				MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
 				scratch_packet.writeDouble(server.getCurrentGlobalTime());
 				MessageUtils::updatePacketLengthField(scratch_packet);
+				const SharedPacketRef time_sync_packet = SharedPacket::make(scratch_packet);
 
-				Lock lock3(server.worker_thread_manager.getMutex());
-				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
-				{
-					assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-					static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(scratch_packet);
-				}
+				server.enqueuePacketToAllClients(time_sync_packet);
 			}
 
 #if USE_GLARE_PARCEL_AUCTION_CODE
-			if(server_config.update_parcel_sales && ((loop_iter % 512) == 0)) // Approx every 50 s.
+			if(server_config.update_parcel_sales && ((loop_iter == 0) || (parcel_sales_timer.elapsed() > 50.0)))
 			{
+				parcel_sales_timer.reset();
+
 				AuctionManagement::updateParcelSales(*server.world_state);
 
 				// Want want to list new parcels (to bring the total number being listed up to our target number) every day at midnight UTC.
@@ -792,16 +1033,30 @@ int main(int argc, char *argv[])
 			}
 #endif
 
-			if(server.world_state->hasChanged() && (save_state_timer.elapsed() > 10.0))
+			// Save world state to disk.
+			// Only the snapshot of the dirty records is taken while holding the world state mutex, the actual writing is done by the DatabaseWriterThread.
+			// Don't take a new snapshot while a previous one is still being written, the dirty records will just be saved next time.
+			if(server.world_state->hasChanged() && (save_state_timer.elapsed() > 10.0) && (server.world_state->numPendingDatabaseWrites() == 0))
 			{
 				try
 				{
-					// Save world state to disk
-					Lock lock2(server.world_state->mutex);
+					Reference<DatabaseWriteBatch> batch;
+					{
+						Lock lock2(server.world_state->mutex);
+
+						// Fold the write log into the database every 10 minutes, to limit the log size and the replay time on startup.
+						const bool compact_write_log = write_log_compaction_timer.elapsed() > 600.0;
 
-					server.world_state->serialiseToDisk();
+						batch = server.world_state->snapshotDirtyRecords(compact_write_log);
+
+						server.world_state->clearChangedFlag();
+
+						if(compact_write_log)
+							write_log_compaction_timer.reset();
+					}
+
+					DatabaseWriterThread::enqueueBatch(server.world_state.ptr(), server.database_writer_thread_manager, batch);
 
-					server.world_state->clearChangedFlag();
 					save_state_timer.reset();
 				}
 				catch(glare::Exception& e)
@@ -811,8 +1066,33 @@ int main(int argc, char *argv[])
 				}
 			}
 
+			// Report any ticks that took so long that the next tick for the world was missed.
+			if(overrun_report_timer.elapsed() > 60.0)
+			{
+				if(tick_scheduler.num_overruns > 0)
+					conPrint("Warning: " + toString(tick_scheduler.num_overruns) + " world tick overrun(s) in the last " + overrun_report_timer.elapsedStringNSigFigs(3) +
+						", max overrun: " + doubleToStringNSigFigs(tick_scheduler.max_overrun_time * 1.0e3, 3) + " ms");
+				tick_scheduler.num_overruns = 0;
+				tick_scheduler.max_overrun_time = 0;
+				overrun_report_timer.reset();
+			}
+
 			loop_iter++;
+
+			// Sleep until the next world is due to be ticked.  Deadlines are advanced by the tick period, so the time taken to process the ticks doesn't cause drift.
+			const double sleep_time = tick_scheduler.getSleepTime(Clock::getTimeSinceInit());
+			if(sleep_time > 0)
+				PlatformUtils::Sleep((int)std::ceil(sleep_time * 1000.0));
 		} // End of main server loop
+
+		// The server is stopping.  Write any remaining dirty records, after waiting for any batch still being written by the DatabaseWriterThread, so nothing is lost.
+		conPrint("Stopping server, flushing world state to disk...");
+		{
+			Lock lock(server.world_state->mutex);
+
+			server.world_state->serialiseToDisk(/*compact_write_log=*/false);
+		}
+		conPrint("World state flushed.");
 	}
 	catch(ArgumentParserExcep& e)
 	{
@@ -842,7 +1122,7 @@ double Server::getCurrentGlobalTime() const
 }
 
 
-void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id)
+void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id, const std::string& world_name)
 {
 	conPrint("Server::clientUDPPortOpen(): worker_thread: 0x" + toHexString((uint64)worker_thread) + ", ip_addr: " + ip_addr.toString());// + ", port: " + toString(client_UDP_port));
 
@@ -851,26 +1131,32 @@ void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_
 		if(connected_clients.count(worker_thread) == 0)
 		{
 			connected_clients.insert(std::make_pair(worker_thread, 
-				ServerConnectedClientInfo({ip_addr, client_avatar_id, /*client_UDP_port=*/-1})));
+				ServerConnectedClientInfo({ip_addr, client_avatar_id, /*client_UDP_port=*/-1, world_name, /*num_transform_datagrams_received=*/0, /*last_UDP_packet_time=*/-1.0})));
+			connected_client_for_avatar_uid[client_avatar_id] = worker_thread;
 			connected_clients_changed = 1;
 		}
 	}
 }
 
 
-void Server::clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip_addr, int client_UDP_port)
+void Server::clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip_addr, int client_UDP_port, uint32 num_transform_datagrams_received)
 {
 	bool change_made = false;
 	{
 		Lock lock(connected_clients_mutex);
-		for(auto it = connected_clients.begin(); it != connected_clients.end(); ++it)
+		auto res = connected_client_for_avatar_uid.find(client_avatar_uid);
+		if(res != connected_client_for_avatar_uid.end())
 		{
-			ServerConnectedClientInfo& info = it->second;
-			if(info.client_avatar_id == client_avatar_uid)
+			auto client_res = connected_clients.find(res->second);
+			assert(client_res != connected_clients.end());
+			if(client_res != connected_clients.end())
 			{
-				if(it->second.client_UDP_port != client_UDP_port)
+				ServerConnectedClientInfo& info = client_res->second;
+				info.num_transform_datagrams_received = num_transform_datagrams_received;
+				info.last_UDP_packet_time = Clock::getTimeSinceInit();
+				if(info.client_UDP_port != client_UDP_port)
 				{
-					it->second.client_UDP_port = client_UDP_port;
+					info.client_UDP_port = client_UDP_port;
 					change_made = true;
 					
 				}
@@ -887,13 +1173,38 @@ void Server::clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip
 }
 
 
+void Server::enqueuePacketToAllClients(const SharedPacketRef& packet)
+{
+	{
+		Lock lock(worker_thread_manager.getMutex());
+		for(auto i = worker_thread_manager.getThreads().begin(); i != worker_thread_manager.getThreads().end(); ++i)
+		{
+			assert(dynamic_cast<WorkerThread*>(i->getPointer()));
+			static_cast<WorkerThread*>(i->getPointer())->enqueuePacketToSend(packet);
+		}
+	}
+	{
+		Lock lock(epoll_clients_mutex);
+		for(auto i = epoll_clients.begin(); i != epoll_clients.end(); ++i)
+			(*i)->enqueuePacketToSend(packet);
+	}
+}
+
+
 void Server::clientDisconnected(WorkerThread* worker_thread)
 {
 	conPrint("Server::clientDisconnected(): worker_thread: 0x" + toHexString((uint64)worker_thread));
 
 	{
 		Lock lock(connected_clients_mutex);
-		connected_clients.erase(worker_thread);
+		auto res = connected_clients.find(worker_thread);
+		if(res != connected_clients.end())
+		{
+			auto uid_res = connected_client_for_avatar_uid.find(res->second.client_avatar_id);
+			if(uid_res != connected_client_for_avatar_uid.end() && uid_res->second == worker_thread)
+				connected_client_for_avatar_uid.erase(uid_res);
+			connected_clients.erase(res);
+		}
 		connected_clients_changed = 1;
 	}
 }
@@ -8,15 +8,21 @@ Copyright Glare Technologies Limited 2016 -
 
 #include "ServerWorldState.h"
 #include "ThreadManager.h"
+#include "PacketSendQueue.h"
 #include "../shared/ResourceManager.h"
 #include <IPAddress.h>
+#include <UDPSocket.h>
+#include <unordered_map>
+#include <set>
+#include <map>
 class WorkerThread;
 
 
 class ServerConfig
 {
 public:
-	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false) {}
+	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false), interest_radius(0), interest_hysteresis(50), voice_hearing_radius(200), num_UDP_handler_threads(1),
+		use_epoll_connection_layer(false), num_epoll_threads(4), UDP_transform_updates(false), tick_rate(10), idle_tick_rate(4), use_database_write_log(true) {}
 	
 	std::string webserver_fragments_dir; // empty string = use default.
 	std::string webserver_public_files_dir; // empty string = use default.
@@ -28,6 +34,23 @@ public:
 	bool allow_light_mapper_bot_full_perms; // Allow lightmapper bot (User account with name "lightmapperbot" to have full write permissions.
 
 	bool update_parcel_sales; // Should we run auctions?
+
+	double interest_radius; // Clients only receive object and avatar transform updates for entities within this distance (m) of them.  0 = no limit.
+	double interest_hysteresis; // Entities leave a client's area of interest when they are further than interest_radius + interest_hysteresis away.
+
+	double voice_hearing_radius; // Voice packets are only relayed to clients in the same world with avatars within this distance (m) of the speaker.  0 = no limit.
+	int num_UDP_handler_threads; // Number of UDPHandlerThreads, each with its own socket bound with SO_REUSEPORT.  Only used on Linux.
+
+	bool use_epoll_connection_layer; // Handle client update connections with a small pool of EpollLoopThreads instead of a thread per client.  Only used on Linux.
+	int num_epoll_threads; // Number of EpollLoopThreads, if use_epoll_connection_layer is true.
+
+	bool UDP_transform_updates; // Send avatar and physics object transform updates to clients that support it as UDP datagrams, instead of over TCP.
+
+	double tick_rate; // Rate (Hz) at which avatar and object updates are generated and sent to the clients in each world.
+	double idle_tick_rate; // Rate (Hz) to back off to for worlds without any changes.
+	std::map<std::string, double> world_tick_rates; // Tick rates for particular worlds, overriding tick_rate.  Map from world name to rate (Hz).
+
+	bool use_database_write_log; // Save changes to an append-only log next to the database file, which is periodically folded into the database.  See DatabaseWriteLog.
 };
 
 
@@ -36,6 +59,9 @@ struct ServerConnectedClientInfo
 	IPAddress ip_addr;
 	UID client_avatar_id;
 	int client_UDP_port; // UDP port on client end
+	std::string world_name; // Name of world the client is connected to.
+	uint32 num_transform_datagrams_received; // Number of transform datagrams the client says it has received, from its last UDP discovery packet.
+	double last_UDP_packet_time; // Time the last UDP discovery packet was received from the client, from Clock::getTimeSinceInit(), or -1.
 };
 
 
@@ -54,11 +80,15 @@ public:
 
 
 	// Called from off main thread
-	void clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id/*, int client_UDP_port*/);
+	void clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id, const std::string& world_name);
 	void clientDisconnected(WorkerThread* worker_thread);
 
 	// Called when we receive a UDP packet from a client, which allows the client remote UDP port to be known.
-	void clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip_addr, int client_UDP_port);
+	// num_transform_datagrams_received is the number of transform datagrams the client has received, as reported in the packet.
+	void clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip_addr, int client_UDP_port, uint32 num_transform_datagrams_received);
+
+	// Enqueues the packet to be sent to all connected clients, both WorkerThread threads and clients handled by EpollLoopThreads.  Threadsafe.
+	void enqueuePacketToAllClients(const SharedPacketRef& packet);
 
 
 	Reference<ServerAllWorldsState> world_state;
@@ -66,17 +96,31 @@ public:
 	// Connected client worker threads
 	ThreadManager worker_thread_manager;
 
+	// Update connections handled by EpollLoopThreads (see EpollServer.h).  These WorkerThreads are not run as threads, they just hold the per-connection state.
+	// Lock order: world_state->mutex, then any ServerWorldState mutex, then worker_thread_manager mutex, then epoll_clients_mutex, then connected_clients_mutex.
+	Mutex epoll_clients_mutex;
+	std::set<WorkerThread*> epoll_clients GUARDED_BY(epoll_clients_mutex);
+
 	ThreadManager mesh_lod_gen_thread_manager;
 
 	ThreadManager udp_handler_thread_manager;
 
 	ThreadManager dyn_tex_updater_thread_manager;
 
+	ThreadManager database_writer_thread_manager;
+
+	ThreadManager map_tile_pyramid_thread_manager;
+
 	std::string screenshot_dir;
 
 	ServerConfig config;
 
 	Mutex connected_clients_mutex;
 	std::map<WorkerThread*, ServerConnectedClientInfo> connected_clients;
+	std::unordered_map<UID, WorkerThread*, UIDHasher> connected_client_for_avatar_uid; // Map from client avatar UID to key in connected_clients.
 	glare::AtomicInt connected_clients_changed;
+
+	// Socket of one of the UDPHandlerThreads, used for sending transform datagrams to clients.  NULL if no UDPHandlerThread is running.
+	Mutex udp_send_socket_mutex;
+	Reference<UDPSocket> udp_send_socket GUARDED_BY(udp_send_socket_mutex);
 };
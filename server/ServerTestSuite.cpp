@@ -7,6 +7,26 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "AccountHandlers.h"
+#include "WebRouteTable.h"
+#include "WebDataStore.h"
+#include "WebServerResponseUtils.h"
+#include "ResourceBodyCache.h"
+#include "ResourceHandlers.h"
+#include "WebPageCache.h"
+#include "WebServerRequestHandlerTests.h"
+#include "ObjectSpatialIndex.h"
+#include "InterestManager.h"
+#include "PacketSendQueue.h"
+#include "DatabaseWriterThread.h"
+#include "DatabaseWriteLog.h"
+#include "ServerWorldState.h"
+#include "ParcelSpatialIndex.h"
+#include "ObjectURLIndex.h"
+#include "ObjectPacketCache.h"
+#include "TickScheduler.h"
+#include "MapTilePyramid.h"
+#include "VoiceRelay.h"
+#include "EpollServer.h"
 #include "../shared/WorldObject.h"
 #include "../shared/LODGeneration.h"
 #include "../ethereum/RLP.h"
@@ -99,6 +119,26 @@ void ServerTestSuite::test()
 	runTest([&]() { RLP::test();														});
 	runTest([&]() { Signing::test();													});
 	runTest([&]() { AccountHandlers::test();											});
+	runTest([&]() { WebRouteTable::test();												});
+	runTest([&]() { WebDataStore::test();												});
+	runTest([&]() { WebServerResponseUtils::test();										});
+	runTest([&]() { ResourceBodyCache::test();											});
+	runTest([&]() { ResourceHandlers::test();											});
+	runTest([&]() { WebPageCache::test();												});
+	runTest([&]() { WebServerRequestHandlerTests::test();								});
+	runTest([&]() { ObjectSpatialIndex::test();											});
+	runTest([&]() { InterestManager::test();											});
+	runTest([&]() { PacketSendQueue::test();											});
+	runTest([&]() { DatabaseWriterThread::test();										});
+	runTest([&]() { DatabaseWriteLog::test();											});
+	runTest([&]() { ServerAllWorldsState::test();										});
+	runTest([&]() { ParcelSpatialIndex::test();											});
+	runTest([&]() { ObjectURLIndex::test();												});
+	runTest([&]() { ObjectPacketCache::test();											});
+	runTest([&]() { MapTilePyramid::test();												});
+	runTest([&]() { TickScheduler::test();												});
+	runTest([&]() { VoiceRelay::test();													});
+	runTest([&]() { EpollListenerThread::test();										});
 	runTest([&]() { HTTPClient::test();													}, /*mem leak allowed=*/true); // Leaks due to libtls allocating globals
 	
 	// runTest([&]() { BatchedMeshTests::test();										}); // Uses some Indigo files
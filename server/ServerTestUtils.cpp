@@ -0,0 +1,28 @@
+/*=====================================================================
+ServerTestUtils.cpp
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ServerTestUtils.h"
+
+
+#if BUILD_TESTS
+
+
+#include "ServerWorldState.h"
+#include <utils/StringUtils.h>
+#include <maths/PCG32.h>
+
+
+WorldObjectRef ServerTestUtils::makeTestObject(ServerAllWorldsState& world_state, PCG32& rng)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = world_state.getNextObjectUID();
+	ob->state = WorldObject::State_Alive;
+	ob->pos = Vec3d(rng.unitRandom() * 100, rng.unitRandom() * 100, 0);
+	ob->content = "content " + toString(ob->uid.value());
+	return ob;
+}
+
+
+#endif // BUILD_TESTS
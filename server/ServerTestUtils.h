@@ -0,0 +1,24 @@
+/*=====================================================================
+ServerTestUtils.h
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/WorldObject.h"
+class ServerAllWorldsState;
+class PCG32;
+
+
+/*=====================================================================
+ServerTestUtils
+---------------
+Helpers shared by the server tests.
+=====================================================================*/
+class ServerTestUtils
+{
+public:
+	// Makes a live object with a new UID from world_state, at a random position, with some content.  The object is not added to a world.
+	static WorldObjectRef makeTestObject(ServerAllWorldsState& world_state, PCG32& rng);
+};
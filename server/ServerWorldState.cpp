@@ -19,6 +19,23 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <Database.h>
 #include <BufferOutStream.h>
 #include <BufferViewInStream.h>
+#include <TaskManager.h>
+
+
+void ServerWorldState::setTransformUpdatePresentFields(uint64 entity_key, TransformUpdate& update)
+{
+	auto res = last_sent_transform_updates.find(entity_key);
+	if(res != last_sent_transform_updates.end())
+	{
+		update.setPresentFields(&res->second);
+		res->second = update;
+	}
+	else
+	{
+		update.setPresentFields(NULL);
+		last_sent_transform_updates[entity_key] = update;
+	}
+}
 
 
 ServerAllWorldsState::ServerAllWorldsState()
@@ -28,7 +45,12 @@ ServerAllWorldsState::ServerAllWorldsState()
 	next_order_uid = 0;
 	next_sub_eth_transaction_uid = 0;
 
-	world_states[""] = new ServerWorldState();
+	num_pending_db_writes = 0;
+
+	use_database_write_log = true;
+
+	root_world_state = new ServerWorldState();
+	world_states[""] = root_world_state;
 
 	last_parcel_update_info.last_parcel_sale_update_hour = 0;
 	last_parcel_update_info.last_parcel_sale_update_day = 0;
@@ -60,13 +82,48 @@ Reference<ServerWorldState> ServerAllWorldsState::getRootWorldState() // Guarant
 }
 
 
+Reference<ServerWorldState> ServerAllWorldsState::getWorldState(const std::string& world_name)
+{
+	Lock lock(mutex);
+
+	auto res = world_states.find(world_name);
+	return (res != world_states.end()) ? res->second : Reference<ServerWorldState>();
+}
+
+
+void ServerAllWorldsState::getWorldStates(std::vector<Reference<ServerWorldState>>& worlds_out)
+{
+	Lock lock(mutex);
+
+	worlds_out.clear();
+	for(auto it = world_states.begin(); it != world_states.end(); ++it)
+		worlds_out.push_back(it->second);
+}
+
+
 void ServerAllWorldsState::createNewDatabase(const std::string& path)
 {
 	conPrint("Creating new world state database at '" + path + "'...");
 
 	Lock lock(mutex);
+	Lock db_lock(database_mutex);
 
 	database.openAndMakeOrClearDatabase(path);
+
+	// Remove any write log left over from a previous database at this path.
+	const std::string log_path = DatabaseWriteLog::logPathForDatabase(path);
+	try
+	{
+		if(FileUtils::fileExists(log_path))
+			FileUtils::deleteFile(log_path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	if(use_database_write_log)
+		write_log.open(log_path);
 }
 
 
@@ -86,19 +143,158 @@ static const uint32 SUB_ETH_TRANSACTIONS_CHUNK = 108;
 static const uint32 LAST_PARCEL_SALE_UPDATE_CHUNK = 109;
 static const uint32 MAP_TILE_INFO_CHUNK = 110;
 static const uint32 ETH_INFO_CHUNK = 111;
+static const uint32 OBJECT_TRANSFORM_CHUNK = 112;
 static const uint32 EOS_CHUNK = 1000;
 
 
 static const uint32 PARCEL_SALE_UPDATE_VERSION = 1;
 static const uint32 MAP_TILE_INFO_VERSION = 1;
 static const uint32 ETH_INFO_CHUNK_VERSION = 1;
+static const uint32 OBJECT_TRANSFORM_CHUNK_VERSION = 1;
+
+
+static void writeWorldObjectRecord(const std::string& world_name, const WorldObject& ob, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(WORLD_OBJECT_CHUNK);
+	buf.writeStringLengthFirst(world_name); // Write world name
+	ob.writeToStream(buf); // Write object
+}
+
+
+// The transform record of an object: just the fields that change when it is moved, keyed by object UID.  Much smaller than the full object record.
+static void writeObjectTransformRecord(const WorldObject& ob, BufferOutStream& buf)
+{
+	LoggedObjectTransform transform;
+	transform.setFromObject(ob);
+
+	buf.clear();
+	buf.writeUInt32(OBJECT_TRANSFORM_CHUNK);
+	buf.writeUInt32(OBJECT_TRANSFORM_CHUNK_VERSION);
+	writeToStream(ob.uid, buf);
+	transform.writeToStream(buf);
+}
+
+
+// Reads the rest of a WORLD_OBJECT_CHUNK record, after the chunk type.
+static void readWorldObjectRecord(BufferViewInStream& stream, const DatabaseKey& database_key, std::string& world_name_out, WorldObjectRef& ob_out)
+{
+	world_name_out = stream.readStringLengthFirst(10000);
+
+	ob_out = new WorldObject();
+	readWorldObjectFromStream(stream, *ob_out);
+
+	//TEMP HACK: clear lightmap needed flag
+	BitUtils::zeroBit(ob_out->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
+
+	ob_out->database_key = database_key;
+}
+
+
+// Reads the rest of a PARCEL_CHUNK record, after the chunk type.
+static void readParcelRecord(BufferViewInStream& stream, const DatabaseKey& database_key, std::string& world_name_out, ParcelRef& parcel_out)
+{
+	world_name_out = stream.readStringLengthFirst(10000);
 
+	parcel_out = new Parcel();
+	readFromStream(stream, *parcel_out);
 
-void ServerAllWorldsState::readFromDisk(const std::string& path)
+	parcel_out->database_key = database_key;
+}
+
+
+static std::string chunkTypeName(uint32 chunk)
+{
+	switch(chunk)
+	{
+	case WORLD_CHUNK: return "world";
+	case WORLD_SETTINGS_CHUNK: return "world settings";
+	case WORLD_OBJECT_CHUNK: return "object";
+	case USER_CHUNK: return "user";
+	case PARCEL_CHUNK: return "parcel";
+	case RESOURCE_CHUNK: return "resource";
+	case ORDER_CHUNK: return "order";
+	case USER_WEB_SESSION_CHUNK: return "user web session";
+	case PARCEL_AUCTION_CHUNK: return "parcel auction";
+	case SCREENSHOT_CHUNK: return "screenshot";
+	case SUB_ETH_TRANSACTIONS_CHUNK: return "sub eth transaction";
+	case LAST_PARCEL_SALE_UPDATE_CHUNK: return "last parcel sale update";
+	case MAP_TILE_INFO_CHUNK: return "map tile info";
+	case ETH_INFO_CHUNK: return "eth info";
+	case OBJECT_TRANSFORM_CHUNK: return "object transform";
+	default: return "chunk " + toString(chunk);
+	}
+}
+
+
+// An object or parcel record decoded by a DecodeRecordsTask.
+struct DecodedRecord
+{
+	std::string world_name;
+	WorldObjectRef world_ob;
+	ParcelRef parcel;
+};
+
+
+// Time spent decoding records of a particular type.
+struct RecordTypeLoadStats
+{
+	RecordTypeLoadStats() : num(0), time(0) {}
+	size_t num;
+	double time;
+};
+
+
+// Decodes the object and parcel records in records[begin, end) into decoded_records.  Other record types are left for the serial loop in readFromDisk().
+class DecodeRecordsTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		for(size_t i=begin; i<end; ++i)
+		{
+			const uint32 chunk = (*record_chunks)[i];
+			if(chunk != WORLD_OBJECT_CHUNK && chunk != PARCEL_CHUNK)
+				continue;
+
+			Timer timer;
+			try
+			{
+				BufferViewInStream stream((*records)[i].second);
+				stream.readUInt32(); // Skip chunk type
+				if(chunk == WORLD_OBJECT_CHUNK)
+					readWorldObjectRecord(stream, (*records)[i].first, (*decoded_records)[i].world_name, (*decoded_records)[i].world_ob);
+				else
+					readParcelRecord(stream, (*records)[i].first, (*decoded_records)[i].world_name, (*decoded_records)[i].parcel);
+			}
+			catch(glare::Exception&)
+			{
+				// Leave the record undecoded.  The serial loop will decode it again, and throw the exception when it gets to this record.
+				(*decoded_records)[i] = DecodedRecord();
+				continue;
+			}
+
+			RecordTypeLoadStats& stats = (chunk == WORLD_OBJECT_CHUNK) ? object_stats : parcel_stats;
+			stats.num++;
+			stats.time += timer.elapsed();
+		}
+	}
+
+	const std::vector<std::pair<DatabaseKey, ArrayRef<uint8>>>* records;
+	const std::vector<uint32>* record_chunks;
+	std::vector<DecodedRecord>* decoded_records;
+	size_t begin, end;
+
+	RecordTypeLoadStats object_stats, parcel_stats;
+};
+
+
+void ServerAllWorldsState::readFromDisk(const std::string& path, bool parallel_load)
 {
 	conPrint("Reading world state from '" + path + "'...");
 
 	Lock lock(mutex);
+	Lock db_lock(database_mutex);
 
 	Timer timer;
 
@@ -126,14 +322,89 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 		// Using database
 		database.startReadingFromDisk(path);
 
+		// Read the write log, which has the changes saved since the log was last folded into the database.
+		write_log.open(DatabaseWriteLog::logPathForDatabase(path));
+		if(write_log.num_entries_read > 0)
+			conPrint("Replaying " + toString(write_log.num_entries_read) + " write log entries...");
+
+		// Transform records, from object UID to transform.  The key of each transform is the key of the transform record.  Applied to the objects after all records are read.
+		std::unordered_map<UID, LoggedObjectTransform, UIDHasher> object_transform_records;
+
+		Timer scan_timer;
+
+		// Get the records to read: the valid records in the database file that haven't been changed in the write log, then the records updated in the write log.
+		std::vector<std::pair<DatabaseKey, ArrayRef<uint8>>> records;
+		records.reserve(database.getRecordMap().size() + write_log.updated_records.size());
 		for(auto it = database.getRecordMap().begin(); it != database.getRecordMap().end(); ++it)
 		{
-			const DatabaseKey database_key = it->first;
 			const Database::RecordInfo& record = it->second;
+			if(record.isRecordValid() && (write_log.updated_records.count(it->first) == 0) && (write_log.deleted_keys.count(it->first) == 0))
+				records.push_back(std::make_pair(it->first, ArrayRef<uint8>(database.getInitialRecordData(record), record.len)));
+		}
+		for(auto it = write_log.updated_records.begin(); it != write_log.updated_records.end(); ++it)
+			records.push_back(std::make_pair(it->first, ArrayRef<uint8>(it->second.data(), it->second.size())));
+
+		std::map<uint32, RecordTypeLoadStats> record_stats; // Decoding time for each record type.  For records decoded in parallel, this is summed over the threads.
+
+		// Decode the object and parcel records, which are most of the records, in parallel.  The decoded objects and parcels are then
+		// added to the worlds in record order by the loop below, so the result is the same as for a serial load.
+		std::vector<DecodedRecord> decoded_records; // Empty if not loading in parallel.
+		double scan_time = scan_timer.elapsed();
+		double parallel_decode_time = 0;
+		if(parallel_load)
+		{
+			// Find the chunk type of each record.
+			std::vector<uint32> record_chunks(records.size());
+			for(size_t i=0; i<records.size(); ++i)
+			{
+				uint32 chunk = 0; // Records too short to have a chunk type are left for the serial loop, which will throw an exception.
+				if(records[i].second.size() >= sizeof(uint32))
+					std::memcpy(&chunk, records[i].second.data(), sizeof(uint32));
+				record_chunks[i] = chunk;
+			}
+			scan_time = scan_timer.elapsed();
+
+			Timer decode_timer;
+			decoded_records.resize(records.size());
 
-			if(record.isRecordValid())
+			glare::TaskManager task_manager("readFromDisk task manager");
+			const size_t records_per_task = 256;
+			std::vector<Reference<DecodeRecordsTask>> tasks;
+			for(size_t begin=0; begin<records.size(); begin += records_per_task)
 			{
-				BufferViewInStream stream(ArrayRef<uint8>(database.getInitialRecordData(record), record.len));
+				Reference<DecodeRecordsTask> task = new DecodeRecordsTask();
+				task->records = &records;
+				task->record_chunks = &record_chunks;
+				task->decoded_records = &decoded_records;
+				task->begin = begin;
+				task->end = myMin(begin + records_per_task, records.size());
+				tasks.push_back(task);
+				task_manager.addTask(task);
+			}
+			task_manager.waitForTasksToComplete();
+
+			for(size_t i=0; i<tasks.size(); ++i)
+			{
+				record_stats[WORLD_OBJECT_CHUNK].num  += tasks[i]->object_stats.num;
+				record_stats[WORLD_OBJECT_CHUNK].time += tasks[i]->object_stats.time;
+				record_stats[PARCEL_CHUNK].num  += tasks[i]->parcel_stats.num;
+				record_stats[PARCEL_CHUNK].time += tasks[i]->parcel_stats.time;
+			}
+
+			parallel_decode_time = decode_timer.elapsed();
+		}
+
+		for(size_t record_i=0; record_i<records.size(); ++record_i)
+		{
+			const DatabaseKey database_key = records[record_i].first;
+
+			// If the record was an object or parcel decoded in parallel, use the decoded result.  Otherwise decode it here.
+			DecodedRecord* decoded = (record_i < decoded_records.size()) ? &decoded_records[record_i] : NULL;
+			const bool was_decoded = decoded && (decoded->world_ob.nonNull() || decoded->parcel.nonNull());
+
+			Timer record_timer;
+			{
+				BufferViewInStream stream(records[record_i].second);
 
 				// Now deserialise from our temp buffer
 				const uint32 chunk = stream.readUInt32();
@@ -143,24 +414,33 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				}
 				else if(chunk == WORLD_OBJECT_CHUNK)
 				{
-					// Read world name
-					/*const*/ std::string world_name = stream.readStringLengthFirst(10000);
+					// Deserialise object, unless it was already decoded in parallel.
+					std::string world_name;
+					WorldObjectRef world_ob;
+					if(was_decoded)
+					{
+						world_name = decoded->world_name;
+						world_ob = decoded->world_ob;
+					}
+					else
+					{
+						readWorldObjectRecord(stream, database_key, world_name, world_ob);
+						record_stats[chunk].time += record_timer.elapsed();
+						record_stats[chunk].num++;
+					}
 
 					// Create ServerWorldState for world name if needed
 					if(world_states.count(world_name) == 0) 
 						world_states[world_name] = new ServerWorldState();
 
-					// Deserialise object
-					WorldObjectRef world_ob = new WorldObject();
-					readWorldObjectFromStream(stream, *world_ob);
-
-					//TEMP HACK: clear lightmap needed flag
-					BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
-
-					world_ob->database_key = database_key;
-					world_states[world_name]->objects[world_ob->uid] = world_ob; // Add to object map
+					{
+						ServerWorldState* world = world_states[world_name].ptr();
+						Lock world_lock(world->mutex);
+						world->objects[world_ob->uid] = world_ob; // Add to object map
+					}
 					num_obs++;
 
+					Lock uid_lock(next_uid_mutex);
 					next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 				}
 				else if(chunk == USER_CHUNK)
@@ -175,19 +455,30 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				}
 				else if(chunk == PARCEL_CHUNK)
 				{
-					// Read world name
-					const std::string world_name = stream.readStringLengthFirst(10000);
+					// Deserialise parcel, unless it was already decoded in parallel.
+					std::string world_name;
+					ParcelRef parcel;
+					if(was_decoded)
+					{
+						world_name = decoded->world_name;
+						parcel = decoded->parcel;
+					}
+					else
+					{
+						readParcelRecord(stream, database_key, world_name, parcel);
+						record_stats[chunk].time += record_timer.elapsed();
+						record_stats[chunk].num++;
+					}
 
 					// Create ServerWorldState for world name if needed
 					if(world_states.count(world_name) == 0) 
 						world_states[world_name] = new ServerWorldState();
 
-					// Deserialise parcel
-					ParcelRef parcel = new Parcel();
-					readFromStream(stream, *parcel);
-
-					parcel->database_key = database_key;
-					world_states[world_name]->parcels[parcel->id] = parcel; // Add to parcel map
+					{
+						ServerWorldState* world = world_states[world_name].ptr();
+						Lock world_lock(world->mutex);
+						world->parcels[parcel->id] = parcel; // Add to parcel map
+					}
 					num_parcels++;
 				}
 				else if(chunk == WORLD_SETTINGS_CHUNK)
@@ -202,13 +493,15 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					// NOTE: There was a bug with multiple world settings for the same world getting saved to the database.  Resolve ambiguity of which one to use by choosing the setting with the largest database key value.
 					// Use these new settings iff the existing settings are either uninitialised (in which case database_key will be invalid), or the settings we are reading from the DB have a greater key 
 					// value than the existing settings.
-					const bool use_settings = !world_states[world_name]->world_settings.database_key.valid() || (database_key.value() > world_states[world_name]->world_settings.database_key.value());
+					ServerWorldState* world = world_states[world_name].ptr();
+					Lock world_lock(world->mutex);
+					const bool use_settings = !world->world_settings.database_key.valid() || (database_key.value() > world->world_settings.database_key.value());
 					if(use_settings)
 					{	
 						// Deserialise world settings
-						readWorldSettingsFromStream(stream, world_states[world_name]->world_settings);
+						readWorldSettingsFromStream(stream, world->world_settings);
 
-						world_states[world_name]->world_settings.database_key = database_key;
+						world->world_settings.database_key = database_key;
 					}
 
 					num_world_settings++;
@@ -238,7 +531,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					order->database_key = database_key;
 					orders[order->id] = order; // Add to order map
 
-					next_order_uid = myMax(order->id + 1, next_order_uid);
+					{
+						Lock uid_lock(next_uid_mutex);
+						next_order_uid = myMax(order->id + 1, next_order_uid);
+					}
 					num_orders++;
 				}
 				else if(chunk == USER_WEB_SESSION_CHUNK)
@@ -277,7 +573,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					SubEthTransactionRef trans = new SubEthTransaction();
 					readFromStream(stream, *trans);
 
-					next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+					{
+						Lock uid_lock(next_uid_mutex);
+						next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+					}
 
 					trans->database_key = database_key;
 					sub_eth_transactions[trans->id] = trans;
@@ -337,6 +636,22 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 					num_tiles_read = num_tiles;
 				}
+				else if(chunk == OBJECT_TRANSFORM_CHUNK)
+				{
+					const uint32 version = stream.readUInt32();
+					if(version != OBJECT_TRANSFORM_CHUNK_VERSION)
+						throw glare::Exception("invalid object transform version: " + toString(version));
+
+					const UID uid = readUIDFromStream(stream);
+					LoggedObjectTransform transform;
+					transform.readFromStream(stream);
+					transform.key = database_key;
+
+					auto res = object_transform_records.find(uid);
+					if(res != object_transform_records.end()) // There should only be one transform record per object, but if there are more, just keep one.
+						db_records_to_delete.insert(res->second.key);
+					object_transform_records[uid] = transform;
+				}
 				else if(chunk == EOS_CHUNK)
 				{
 					break;
@@ -345,16 +660,73 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				{
 					throw glare::Exception("Unknown chunk type '" + toString(chunk) + "'");
 				}
+
+				if(chunk != WORLD_OBJECT_CHUNK && chunk != PARCEL_CHUNK)
+				{
+					record_stats[chunk].time += record_timer.elapsed();
+					record_stats[chunk].num++;
+				}
+			}
+		}
+
+		std::string stats_str = "Record decoding: scan " + doubleToStringNSigFigs(scan_time, 3) + " s";
+		if(parallel_load)
+			stats_str += ", parallel object and parcel decoding " + doubleToStringNSigFigs(parallel_decode_time, 3) + " s";
+		for(auto it = record_stats.begin(); it != record_stats.end(); ++it)
+			stats_str += ", " + toString(it->second.num) + " " + chunkTypeName(it->first) + "(s) " + doubleToStringNSigFigs(it->second.time, 3) + " s";
+		conPrint(stats_str);
+
+		// Apply the transform records, which are newer than the transforms in the full object records.
+		if(!object_transform_records.empty())
+		{
+			for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
+			{
+				ServerWorldState* world = world_it->second.ptr();
+				Lock world_lock(world->mutex);
+				for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
+				{
+					WorldObject* ob = it->second.ptr();
+					auto res = object_transform_records.find(ob->uid);
+					if(res != object_transform_records.end())
+					{
+						res->second.applyToObject(*ob);
+						ob->transform_database_key = res->second.key;
+						object_transform_records.erase(res);
+					}
+				}
 			}
 		}
 
+		// Any remaining transform records are for deleted objects.  Remove them on the next save.
+		for(auto it = object_transform_records.begin(); it != object_transform_records.end(); ++it)
+			db_records_to_delete.insert(it->second.key);
+		if(!object_transform_records.empty())
+			conPrint("Removing " + toString(object_transform_records.size()) + " transform record(s) of deleted objects.");
 
 		database.finishReadingFromDisk();
+
+		// Fold the changes from the write log into the database, and reset the log.
+		if(write_log.hasPendingChanges())
+			compactWriteLog();
+
+		if(!use_database_write_log)
+		{
+			write_log.close();
+			try
+			{
+				FileUtils::deleteFile(DatabaseWriteLog::logPathForDatabase(path));
+			}
+			catch(FileUtils::FileUtilsExcep& e)
+			{
+				throw glare::Exception(e.what());
+			}
+		}
 	}
 	else // Else if is_pre_database:
 	{
 		Reference<ServerWorldState> current_world = new ServerWorldState();
 		world_states[""] = current_world;
+		root_world_state = current_world;
 
 		FileInStream stream(path);
 
@@ -388,9 +760,13 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				//TEMP HACK: clear lightmap needed flag
 				BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
 
-				current_world->objects[world_ob->uid] = world_ob; // Add to object map
+				{
+					Lock world_lock(current_world->mutex);
+					current_world->objects[world_ob->uid] = world_ob; // Add to object map
+				}
 				num_obs++;
 
+				Lock uid_lock(next_uid_mutex);
 				next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 			}
 			else if(chunk == USER_CHUNK)
@@ -408,7 +784,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				ParcelRef parcel = new Parcel();
 				readFromStream(stream, *parcel);
 
-				current_world->parcels[parcel->id] = parcel; // Add to parcel map
+				{
+					Lock world_lock(current_world->mutex);
+					current_world->parcels[parcel->id] = parcel; // Add to parcel map
+				}
 				num_parcels++;
 			}
 			else if(chunk == RESOURCE_CHUNK)
@@ -429,7 +808,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 				orders[order->id] = order; // Add to order map
 
-				next_order_uid = myMax(order->id + 1, next_order_uid);
+				{
+					Lock uid_lock(next_uid_mutex);
+					next_order_uid = myMax(order->id + 1, next_order_uid);
+				}
 				num_orders++;
 			}
 			else if(chunk == USER_WEB_SESSION_CHUNK)
@@ -465,7 +847,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				SubEthTransactionRef trans = new SubEthTransaction();
 				readFromStream(stream, *trans);
 
-				next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+				{
+					Lock uid_lock(next_uid_mutex);
+					next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+				}
 
 				sub_eth_transactions[trans->id] = trans;
 				num_sub_eth_transactions++;
@@ -535,6 +920,9 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 	{
 		database.openAndMakeOrClearDatabase(path);
 
+		if(use_database_write_log)
+			write_log.open(DatabaseWriteLog::logPathForDatabase(path));
+
 		// Add everything to dirty sets so it gets saved to the DB initially.
 		addEverythingToDirtySets();
 	}
@@ -542,19 +930,24 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 	denormaliseData();
 
-	// Compress voxel data if needed.
+	// Build object and parcel spatial indices, and the object URL index
+	{
+		Lock url_index_lock(object_URL_index_mutex);
+		object_URL_index.clear();
+	}
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
-		Reference<ServerWorldState> world_state = world_it->second;
+		ServerWorldState* world_state = world_it->second.ptr();
+		Lock world_lock(world_state->mutex);
+		Lock url_index_lock(object_URL_index_mutex);
+		world_state->object_spatial_index.clear();
 		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
 		{
-			/*WorldObject* ob = it->second.ptr();
-			if(!ob->voxel_group.voxels.empty() && ob->compressed_voxels.empty())
-			{
-				WorldObject::compressVoxelGroup(ob->voxel_group, ob->compressed_voxels);
-			}*/
-			//ob->compressVoxels();
+			world_state->object_spatial_index.insert(it->second.ptr());
+			object_URL_index.updateObject(*it->second);
 		}
+
+		world_state->parcel_spatial_index.build(world_state->parcels);
 	}
 
 	//conPrint("min_next_nonce: " + toString(eth_info.min_next_nonce));
@@ -581,6 +974,7 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		Lock world_lock(world_state->mutex);
 
 		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
 			world_state->db_dirty_world_objects.insert(it->second);
@@ -618,7 +1012,7 @@ bool ServerAllWorldsState::isInReadOnlyMode()
 
 void ServerAllWorldsState::clearAndReset() // Just for fuzzing
 {
-	Lock lock(mutex);
+	Lock lock(next_uid_mutex);
 	next_object_uid = UID(0);
 	next_avatar_uid = UID(0);
 }
@@ -631,13 +1025,17 @@ void ServerAllWorldsState::denormaliseData()
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		Lock world_lock(world_state->mutex);
 
 		// Build cached fields like WorldObject::creator_name
 		for(auto i=world_state->objects.begin(); i != world_state->objects.end(); ++i)
 		{
 			auto res = user_id_to_users.find(i->second->creator_id);
-			if(res != user_id_to_users.end())
+			if(res != user_id_to_users.end() && i->second->creator_name != res->second->name)
+			{
 				i->second->creator_name = res->second->name;
+				i->second->network_state_version++; // creator_name is sent in ObjectInitialSend messages, so invalidate the cached message.
+			}
 		}
 
 		for(auto i=world_state->parcels.begin(); i != world_state->parcels.end(); ++i)
@@ -695,6 +1093,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 		for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			Lock world_lock(world_state->mutex);
 
 			// Sanitise parcels
 			for(auto it = world_state->parcels.begin(); it != world_state->parcels.end(); ++it)
@@ -800,7 +1199,8 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 		// ETH_INFO_CHUNK
 
 		// Write to disk.  Will do the updates we have added to dirty sets, and delete records we have added to db_records_to_delete.
-		serialiseToDisk();
+		// Fold the write log into the database, so that the database file has all the changes when old records are removed from it.
+		serialiseToDisk(/*compact write log=*/true);
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -809,34 +1209,49 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 }
 
 
-// Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
-void ServerAllWorldsState::serialiseToDisk()
+void DatabaseWriteBatch::addRecordUpdate(const DatabaseKey& key, const BufferOutStream& record_data)
 {
-	conPrint("Saving world state to disk...");
+	RecordUpdate update;
+	update.key = key;
+	update.offset = data.size();
+	update.len = record_data.buf.size();
+	record_updates.push_back(update);
+
+	const size_t write_i = data.size();
+	data.resize(write_i + record_data.buf.size());
+	if(record_data.buf.size() > 0)
+		std::memcpy(&data[write_i], record_data.buf.data(), record_data.buf.size());
+}
+
+
+// Write any changed data (objects in dirty set) to disk, and wait until it has been written.  Mutex should be held already.
+void ServerAllWorldsState::serialiseToDisk(bool compact_write_log)
+{
+	// Wait for any batches being written by the DatabaseWriterThread, so that records are written in order.
+	waitForPendingDatabaseWrites();
 
+	Reference<DatabaseWriteBatch> batch = snapshotDirtyRecords(compact_write_log);
+	writeBatchToDatabase(*batch);
+}
+
+
+// Serialise any changed data (objects in dirty set) into a DatabaseWriteBatch, and clear the dirty sets.  Mutex should be held already.
+Reference<DatabaseWriteBatch> ServerAllWorldsState::snapshotDirtyRecords(bool compact_write_log)
+{
 	Timer timer;
 
-	try
+	Reference<DatabaseWriteBatch> batch = new DatabaseWriteBatch();
+
+	// We need the database mutex to allocate keys for new records.  If the DatabaseWriterThread is writing a batch, this will block until it is done,
+	// so callers should avoid taking a snapshot while a batch is pending.
+	Lock db_lock(database_mutex);
+
+	batch->compact_write_log = compact_write_log && write_log.isOpen();
+
 	{
-		// Number of various type of objects that were dirty and saved.
-		size_t num_obs = 0;
-		size_t num_parcels = 0;
-		size_t num_orders = 0;
-		size_t num_sessions = 0;
-		size_t num_auctions = 0;
-		size_t num_screenshots = 0;
-		size_t num_sub_eth_transactions = 0;
-		size_t num_tiles_written = 0;
-		size_t num_users = 0;
-		size_t num_resources = 0;
-		size_t num_world_settings = 0;
-
-		// First, delete any records in db_records_to_delete.  (This has the keys of deleted objects etc..)
+		// First, add any records in db_records_to_delete.  (This has the keys of deleted sessions etc..)  These are deleted before the record updates are written.
 		for(auto it = db_records_to_delete.begin(); it != db_records_to_delete.end(); ++it)
-		{
-			const DatabaseKey key = *it;
-			database.deleteRecord(key);
-		}
+			batch->keys_to_delete.push_back(*it);
 		db_records_to_delete.clear();
 
 		
@@ -849,23 +1264,65 @@ void ServerAllWorldsState::serialiseToDisk()
 		{
 			const std::string world_name = world_it->first;
 			Reference<ServerWorldState> world_state = world_it->second;
+			Lock world_lock(world_state->mutex);
+
+			// Deleted objects and parcels in this world
+			for(auto it = world_state->db_records_to_delete.begin(); it != world_state->db_records_to_delete.end(); ++it)
+				batch->keys_to_delete.push_back(*it);
+			world_state->db_records_to_delete.clear();
+
+			// Write transform-only changes as transform records.  Objects with other changes, or without a full record yet, are written in full below.
+			{
+				for(auto it = world_state->db_dirty_world_object_transforms.begin(); it != world_state->db_dirty_world_object_transforms.end(); ++it)
+				{
+					WorldObject* ob = it->ptr();
+					if(world_state->db_dirty_world_objects.count(*it) > 0)
+						continue;
+
+					auto res = world_state->objects.find(ob->uid);
+					if(res == world_state->objects.end() || res->second.ptr() != ob)
+						continue; // Object has been removed from the world.
+
+					if(ob->database_key.valid())
+					{
+						writeObjectTransformRecord(*ob, temp_buf);
+
+						if(!ob->transform_database_key.valid())
+							ob->transform_database_key = database.allocUnusedKey(); // Get a new key
+
+						batch->addRecordUpdate(ob->transform_database_key, temp_buf);
+
+						batch->num_object_transforms++;
+					}
+					else
+						world_state->db_dirty_world_objects.insert(*it);
+				}
+
+				world_state->db_dirty_world_object_transforms.clear();
+			}
 
 			// Write objects
 			{
 				for(auto it = world_state->db_dirty_world_objects.begin(); it != world_state->db_dirty_world_objects.end(); ++it)
 				{
 					WorldObject* ob = it->ptr();
-					temp_buf.clear();
-					temp_buf.writeUInt32(WORLD_OBJECT_CHUNK);
-					temp_buf.writeStringLengthFirst(world_name); // Write world name
-					ob->writeToStream(temp_buf); // Write object
+
+					// If the object has a transform record, it overrides the transform in the full record when loading, so update it as well.
+					// It is written before the full record, so that if the batch is only partly written, the transform loaded is still the newest one.
+					if(ob->transform_database_key.valid())
+					{
+						writeObjectTransformRecord(*ob, temp_buf);
+						batch->addRecordUpdate(ob->transform_database_key, temp_buf);
+					}
+
+					writeWorldObjectRecord(world_name, *ob, temp_buf);
 
 					if(!ob->database_key.valid())
 						ob->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(ob->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					batch->addRecordUpdate(ob->database_key, temp_buf);
 
-					num_obs++;
+					batch->num_obs++;
 				}
 
 				world_state->db_dirty_world_objects.clear();
@@ -884,9 +1341,9 @@ void ServerAllWorldsState::serialiseToDisk()
 					if(!parcel->database_key.valid())
 						parcel->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(parcel->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					batch->addRecordUpdate(parcel->database_key, temp_buf);
 
-					num_parcels++;
+					batch->num_parcels++;
 				}
 
 				world_state->db_dirty_parcels.clear();
@@ -903,11 +1360,11 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!world_state->world_settings.database_key.valid())
 					world_state->world_settings.database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(world_state->world_settings.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(world_state->world_settings.database_key, temp_buf);
 
 				world_state->world_settings.db_dirty = false;
 
-				num_world_settings++;
+				batch->num_world_settings++;
 			}
 		}
 
@@ -923,9 +1380,9 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!user->database_key.valid())
 					user->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(user->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(user->database_key, temp_buf);
 
-				num_users++;
+				batch->num_users++;
 			}
 
 			db_dirty_users.clear();
@@ -943,9 +1400,9 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!resource->database_key.valid())
 					resource->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(resource->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(resource->database_key, temp_buf);
 
-				num_resources++;
+				batch->num_resources++;
 			}
 
 			db_dirty_resources.clear();
@@ -963,9 +1420,9 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!order->database_key.valid())
 					order->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(order->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(order->database_key, temp_buf);
 
-				num_orders++;
+				batch->num_orders++;
 			}
 
 			db_dirty_orders.clear();
@@ -983,9 +1440,9 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!session->database_key.valid())
 					session->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(session->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(session->database_key, temp_buf);
 
-				num_sessions++;
+				batch->num_sessions++;
 			}
 
 			db_dirty_userwebsessions.clear();
@@ -1003,9 +1460,9 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!auction->database_key.valid())
 					auction->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(auction->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(auction->database_key, temp_buf);
 
-				num_auctions++;
+				batch->num_auctions++;
 			}
 
 			db_dirty_parcel_auctions.clear();
@@ -1023,9 +1480,9 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!shot->database_key.valid())
 					shot->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(shot->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(shot->database_key, temp_buf);
 
-				num_screenshots++;
+				batch->num_screenshots++;
 			}
 
 			db_dirty_screenshots.clear();
@@ -1043,9 +1500,9 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!trans->database_key.valid())
 					trans->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(trans->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				batch->addRecordUpdate(trans->database_key, temp_buf);
 
-				num_sub_eth_transactions++;
+				batch->num_sub_eth_transactions++;
 			}
 
 			db_dirty_sub_eth_transactions.clear();
@@ -1079,11 +1536,11 @@ void ServerAllWorldsState::serialiseToDisk()
 			if(!map_tile_info.database_key.valid())
 				map_tile_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(map_tile_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			batch->addRecordUpdate(map_tile_info.database_key, temp_buf);
 
 			map_tile_info.db_dirty = false;
 
-			num_tiles_written = map_tile_info.info.size();
+			batch->num_tiles_written = map_tile_info.info.size();
 		}
 
 		// Write LAST_PARCEL_SALE_UPDATE_CHUNK
@@ -1099,7 +1556,7 @@ void ServerAllWorldsState::serialiseToDisk()
 			if(!last_parcel_update_info.database_key.valid())
 				last_parcel_update_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(last_parcel_update_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			batch->addRecordUpdate(last_parcel_update_info.database_key, temp_buf);
 
 			last_parcel_update_info.db_dirty = false;
 		}
@@ -1115,17 +1572,65 @@ void ServerAllWorldsState::serialiseToDisk()
 			if(!eth_info.database_key.valid())
 				eth_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(eth_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			batch->addRecordUpdate(eth_info.database_key, temp_buf);
 
 			eth_info.db_dirty = false;
 		}
 
-		database.flush();
+	}
+
+	batch->snapshot_time = timer.elapsed();
+	return batch;
+}
+
+
+// Write the records in the batch to the database, and flush the database to disk.  Doesn't require the world state mutex.
+void ServerAllWorldsState::writeBatchToDatabase(const DatabaseWriteBatch& batch)
+{
+	conPrint("Saving world state to disk...");
+
+	Timer timer;
+
+	try
+	{
+		Lock db_lock(database_mutex);
+
+		if(write_log.isOpen())
+		{
+			// Append the changes to the write log, instead of rewriting the records in the database.
+			for(size_t i=0; i<batch.keys_to_delete.size(); ++i)
+				write_log.appendDelete(batch.keys_to_delete[i]);
+
+			for(size_t i=0; i<batch.record_updates.size(); ++i)
+			{
+				const DatabaseWriteBatch::RecordUpdate& update = batch.record_updates[i];
+				write_log.appendRecordUpdate(update.key, ArrayRef<uint8>(batch.data.data() + update.offset, update.len));
+			}
+
+			write_log.flush();
+
+			if(batch.compact_write_log)
+				compactWriteLog();
+		}
+		else
+		{
+			for(size_t i=0; i<batch.keys_to_delete.size(); ++i)
+				database.deleteRecord(batch.keys_to_delete[i]);
+
+			for(size_t i=0; i<batch.record_updates.size(); ++i)
+			{
+				const DatabaseWriteBatch::RecordUpdate& update = batch.record_updates[i];
+				database.updateRecord(update.key, ArrayRef<uint8>(batch.data.data() + update.offset, update.len));
+			}
+
+			database.flush();
+		}
 
-		conPrint("Saved " + toString(num_obs) + " object(s), " + toString(num_users) + " user(s), " +
-			toString(num_parcels) + " parcel(s), " + toString(num_resources) + " resource(s), " + toString(num_orders) + " order(s), " + 
-			toString(num_sessions) + " session(s), " + toString(num_auctions) + " auction(s), " + toString(num_screenshots) + " screenshot(s), " +
-			toString(num_sub_eth_transactions) + " sub eth transction(s), " + toString(num_tiles_written) + " tiles, " + toString(num_world_settings) + " world setting(s) in " + timer.elapsedStringNSigFigs(4));
+		conPrint("Saved " + toString(batch.num_obs) + " object(s), " + toString(batch.num_object_transforms) + " object transform(s), " + toString(batch.num_users) + " user(s), " +
+			toString(batch.num_parcels) + " parcel(s), " + toString(batch.num_resources) + " resource(s), " + toString(batch.num_orders) + " order(s), " + 
+			toString(batch.num_sessions) + " session(s), " + toString(batch.num_auctions) + " auction(s), " + toString(batch.num_screenshots) + " screenshot(s), " +
+			toString(batch.num_sub_eth_transactions) + " sub eth transction(s), " + toString(batch.num_tiles_written) + " tiles, " + toString(batch.num_world_settings) + " world setting(s) in " + timer.elapsedStringNSigFigs(4) + 
+			" (snapshot took " + doubleToStringNSigFigs(batch.snapshot_time * 1.0e3, 4) + " ms)");
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -1134,6 +1639,63 @@ void ServerAllWorldsState::serialiseToDisk()
 }
 
 
+// Writes the pending changes in the write log to the database, flushes the database, then resets the log.
+void ServerAllWorldsState::compactWriteLog()
+{
+	Timer timer;
+
+	const size_t num_updated = write_log.updated_records.size();
+	const size_t num_deleted = write_log.deleted_keys.size();
+	const uint64 log_size = write_log.getFileSize();
+
+	for(auto it = write_log.deleted_keys.begin(); it != write_log.deleted_keys.end(); ++it)
+		database.deleteRecord(*it);
+
+	for(auto it = write_log.updated_records.begin(); it != write_log.updated_records.end(); ++it)
+		database.updateRecord(it->first, ArrayRef<uint8>(it->second.data(), it->second.size()));
+
+	database.flush();
+
+	// The changes are now in the database, so the log can be reset.  If we crash before this, the changes will just be replayed and folded in again on the next load.
+	write_log.reset();
+
+	conPrint("Folded write log (" + getNiceByteSize(log_size) + ") into database: " + toString(num_updated) + " record update(s), " + toString(num_deleted) + " delete(s) in " + timer.elapsedStringNSigFigs(4));
+}
+
+
+void ServerAllWorldsState::beginPendingDatabaseWrite()
+{
+	Lock lock(pending_db_writes_mutex);
+	num_pending_db_writes++;
+}
+
+
+void ServerAllWorldsState::endPendingDatabaseWrite()
+{
+	{
+		Lock lock(pending_db_writes_mutex);
+		assert(num_pending_db_writes > 0);
+		num_pending_db_writes--;
+	}
+	pending_db_writes_condition.notifyAll();
+}
+
+
+size_t ServerAllWorldsState::numPendingDatabaseWrites()
+{
+	Lock lock(pending_db_writes_mutex);
+	return num_pending_db_writes;
+}
+
+
+void ServerAllWorldsState::waitForPendingDatabaseWrites()
+{
+	Lock lock(pending_db_writes_mutex);
+	while(num_pending_db_writes > 0)
+		pending_db_writes_condition.wait(pending_db_writes_mutex);
+}
+
+
 std::string ServerAllWorldsState::getCredential(const std::string& key) // Throws glare::Exception if not found
 {
 	Lock lock(mutex);
@@ -1147,7 +1709,7 @@ std::string ServerAllWorldsState::getCredential(const std::string& key) // Throw
 
 UID ServerAllWorldsState::getNextObjectUID()
 {
-	Lock lock(mutex);
+	Lock lock(next_uid_mutex);
 
 	const UID next = next_object_uid;
 	next_object_uid = UID(next_object_uid.value() + 1);
@@ -1157,7 +1719,7 @@ UID ServerAllWorldsState::getNextObjectUID()
 
 UID ServerAllWorldsState::getNextAvatarUID()
 {
-	Lock lock(mutex);
+	Lock lock(next_uid_mutex);
 
 	const UID next = next_avatar_uid;
 	next_avatar_uid = UID(next_avatar_uid.value() + 1);
@@ -1167,14 +1729,14 @@ UID ServerAllWorldsState::getNextAvatarUID()
 
 uint64 ServerAllWorldsState::getNextOrderUID()
 {
-	Lock lock(mutex);
+	Lock lock(next_uid_mutex);
 	return next_order_uid++;
 }
 
 
 uint64 ServerAllWorldsState::getNextSubEthTransactionUID()
 {
-	Lock lock(mutex);
+	Lock lock(next_uid_mutex);
 	return next_sub_eth_transaction_uid++;
 }
 
@@ -1225,3 +1787,652 @@ std::string ServerAllWorldsState::getAndRemoveUserWebMessage(const UserID& user_
 	else
 		return std::string();
 }
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/ResourceManager.h"
+#include "InterestManager.h"
+#include "ServerTestUtils.h"
+#include <utils/TestUtils.h>
+#include <utils/MyThread.h>
+#include <utils/PlatformUtils.h>
+#include <maths/PCG32.h>
+#include <set>
+
+
+// Edits objects in a single world, in the same way WorkerThread handles ObjectTransformUpdate and CreateObject messages.
+// If use_global_lock is true, the global mutex is held for each edit as well, which is how all edits were done before each world had its own mutex.
+class TestWorldEditorThread : public MyThread
+{
+public:
+	TestWorldEditorThread(ServerAllWorldsState* all_worlds_, Reference<ServerWorldState> world_, uint32 seed_, int num_edits_, bool use_global_lock_)
+	:	all_worlds(all_worlds_), world(world_), seed(seed_), num_edits(num_edits_), use_global_lock(use_global_lock_), num_created(0) {}
+
+	virtual void run()
+	{
+		PCG32 rng(seed);
+		for(int i=0; i<num_edits; ++i)
+		{
+			if(use_global_lock)
+			{
+				Lock lock(all_worlds->mutex);
+				Lock world_lock(world->mutex);
+				doEdit(rng);
+			}
+			else
+			{
+				Lock world_lock(world->mutex);
+				doEdit(rng);
+			}
+		}
+	}
+
+	void doEdit(PCG32& rng) REQUIRES(world->mutex)
+	{
+		if(rng.unitRandom() < 0.1f) // Create a new object
+		{
+			WorldObjectRef ob = new WorldObject();
+			ob->uid = all_worlds->getNextObjectUID();
+			ob->state = WorldObject::State_Alive;
+			ob->pos = Vec3d(rng.unitRandom() * 100, rng.unitRandom() * 100, 0);
+			ob->model_url = "model_" + toString(seed) + ".bmesh";
+			world->objects[ob->uid] = ob;
+			world->object_spatial_index.insert(ob.ptr());
+			{
+				Lock url_index_lock(all_worlds->object_URL_index_mutex);
+				all_worlds->object_URL_index.updateObject(*ob);
+			}
+			world->addWorldObjectAsDBDirty(ob);
+			world->dirty_from_remote_objects.insert(ob);
+			num_created++;
+		}
+		else if(!world->objects.empty()) // Move an existing object
+		{
+			const uint32 max_uid = (uint32)world->objects.rbegin()->first.value();
+			auto it = world->objects.lower_bound(UID(rng.nextUInt(max_uid + 1)));
+			WorldObject* ob = it->second.ptr();
+			ob->pos = Vec3d(rng.unitRandom() * 100, rng.unitRandom() * 100, ob->pos.z + 1);
+			world->object_spatial_index.update(ob);
+			world->addWorldObjectAsDBDirty(ob);
+			world->dirty_from_remote_objects.insert(ob);
+		}
+		all_worlds->markAsChanged();
+	}
+
+	ServerAllWorldsState* all_worlds;
+	Reference<ServerWorldState> world;
+	uint32 seed;
+	int num_edits;
+	bool use_global_lock;
+	int num_created; // Only read after the thread has been joined.
+};
+
+
+// Does what the main server loop does while edits are being made: looks up users under the global mutex, clears the per-world dirty_from_remote_objects sets, and takes database snapshots.
+class TestServerLoopThread : public MyThread
+{
+public:
+	TestServerLoopThread(ServerAllWorldsState* all_worlds_) : all_worlds(all_worlds_), done(0), num_user_lookups(0), num_snapshots(0) {}
+
+	virtual void run()
+	{
+		while(done == 0)
+		{
+			{
+				Lock lock(all_worlds->mutex);
+				for(int i=0; i<10; ++i)
+				{
+					auto res = all_worlds->name_to_users.find("user " + toString(i));
+					if(res != all_worlds->name_to_users.end() && res->second->name == "user " + toString(i))
+						num_user_lookups++;
+				}
+			}
+
+			std::vector<Reference<ServerWorldState>> worlds;
+			all_worlds->getWorldStates(worlds);
+			for(size_t w=0; w<worlds.size(); ++w)
+			{
+				Lock world_lock(worlds[w]->mutex);
+				worlds[w]->dirty_from_remote_objects.clear();
+			}
+
+			{
+				Lock lock(all_worlds->mutex);
+				Reference<DatabaseWriteBatch> batch = all_worlds->snapshotDirtyRecords();
+				num_snapshots++;
+			}
+
+			PlatformUtils::Sleep(1);
+		}
+	}
+
+	ServerAllWorldsState* all_worlds;
+	glare::AtomicInt done;
+	int num_user_lookups; // Only read after the thread has been joined.
+	int num_snapshots;
+};
+
+
+// Adds some users, and num_worlds worlds with num_obs_per_world objects each.
+static void populateTestWorldState(ServerAllWorldsState& all_worlds, int num_worlds, int num_obs_per_world)
+{
+	Lock lock(all_worlds.mutex);
+
+	for(int i=0; i<10; ++i)
+	{
+		UserRef user = new User();
+		user->id = UserID(i);
+		user->name = "user " + toString(i);
+		all_worlds.user_id_to_users[user->id] = user;
+		all_worlds.name_to_users[user->name] = user;
+	}
+
+	for(int w=0; w<num_worlds; ++w)
+	{
+		Reference<ServerWorldState> world = new ServerWorldState();
+		all_worlds.world_states["user " + toString(w)] = world;
+
+		Lock world_lock(world->mutex);
+		for(int i=0; i<num_obs_per_world; ++i)
+		{
+			WorldObjectRef ob = new WorldObject();
+			ob->uid = all_worlds.getNextObjectUID();
+			ob->state = WorldObject::State_Alive;
+			ob->pos = Vec3d((double)i, (double)w, 0);
+			world->objects[ob->uid] = ob;
+			world->object_spatial_index.insert(ob.ptr());
+			world->addWorldObjectAsDBDirty(ob);
+		}
+	}
+}
+
+
+// Makes a database at db_path with num_records object, parcel and user records, spread over several worlds.
+static void makeLoadTestDatabase(const std::string& db_path, const std::string& resource_dir, size_t num_records)
+{
+	Reference<ServerAllWorldsState> all_worlds = new ServerAllWorldsState();
+	all_worlds->resource_manager = new ResourceManager(resource_dir);
+	all_worlds->createNewDatabase(db_path);
+
+	Lock lock(all_worlds->mutex);
+
+	PCG32 rng(1);
+	for(size_t i=0; i<num_records; ++i)
+	{
+		const std::string world_name = (i % 4 == 0) ? "" : ("user " + toString(i % 7));
+		if(all_worlds->world_states.count(world_name) == 0)
+			all_worlds->world_states[world_name] = new ServerWorldState();
+		ServerWorldState* world = all_worlds->world_states[world_name].ptr();
+		Lock world_lock(world->mutex);
+
+		const float r = rng.unitRandom();
+		if(r < 0.8f)
+		{
+			WorldObjectRef ob = new WorldObject();
+			ob->uid = all_worlds->getNextObjectUID();
+			ob->state = WorldObject::State_Alive;
+			ob->pos = Vec3d(rng.unitRandom() * 1000, rng.unitRandom() * 1000, rng.unitRandom() * 10);
+			ob->model_url = "model_" + toString(rng.nextUInt(1000)) + ".bmesh";
+			ob->content = "content " + toString(i);
+			ob->materials.push_back(new WorldMaterial());
+			ob->materials[0]->colour_texture_url = "tex_" + toString(rng.nextUInt(1000)) + ".jpg";
+			world->objects[ob->uid] = ob;
+			world->addWorldObjectAsDBDirty(ob);
+		}
+		else if(r < 0.95f)
+		{
+			ParcelRef parcel = new Parcel();
+			parcel->id = ParcelID((uint32)i);
+			parcel->description = "parcel " + toString(i);
+			world->parcels[parcel->id] = parcel;
+			world->addParcelAsDBDirty(parcel);
+		}
+		else
+		{
+			UserRef user = new User();
+			user->id = UserID((uint32)i);
+			user->name = "load test user " + toString(i);
+			all_worlds->user_id_to_users[user->id] = user;
+			all_worlds->name_to_users[user->name] = user;
+			all_worlds->addUserAsDBDirty(user);
+		}
+	}
+
+	all_worlds->serialiseToDisk(/*compact write log=*/true);
+}
+
+
+// Checks that two loaded world states have the same worlds, objects, parcels and users.
+static void checkLoadedWorldStatesEqual(ServerAllWorldsState& a, ServerAllWorldsState& b)
+{
+	Lock lock_a(a.mutex);
+	Lock lock_b(b.mutex);
+
+	testAssert(a.world_states.size() == b.world_states.size());
+	testAssert(a.user_id_to_users.size() == b.user_id_to_users.size());
+	for(auto it = a.user_id_to_users.begin(); it != a.user_id_to_users.end(); ++it)
+	{
+		auto res = b.user_id_to_users.find(it->first);
+		testAssert(res != b.user_id_to_users.end() && res->second->name == it->second->name && res->second->database_key.value() == it->second->database_key.value());
+	}
+
+	BufferOutStream buf_a, buf_b;
+	for(auto world_it = a.world_states.begin(); world_it != a.world_states.end(); ++world_it)
+	{
+		auto world_res = b.world_states.find(world_it->first);
+		testAssert(world_res != b.world_states.end());
+		ServerWorldState* world_a = world_it->second.ptr();
+		ServerWorldState* world_b = world_res->second.ptr();
+		Lock world_lock_a(world_a->mutex);
+		Lock world_lock_b(world_b->mutex);
+
+		testAssert(world_a->objects.size() == world_b->objects.size());
+		for(auto it = world_a->objects.begin(); it != world_a->objects.end(); ++it)
+		{
+			auto res = world_b->objects.find(it->first);
+			testAssert(res != world_b->objects.end());
+			testAssert(res->second->database_key.value() == it->second->database_key.value());
+			buf_a.clear();
+			buf_b.clear();
+			it->second->writeToStream(buf_a);
+			res->second->writeToStream(buf_b);
+			testAssert(buf_a.buf == buf_b.buf);
+		}
+
+		testAssert(world_a->parcels.size() == world_b->parcels.size());
+		for(auto it = world_a->parcels.begin(); it != world_a->parcels.end(); ++it)
+		{
+			auto res = world_b->parcels.find(it->first);
+			testAssert(res != world_b->parcels.end());
+			testAssert(res->second->database_key.value() == it->second->database_key.value());
+			buf_a.clear();
+			buf_b.clear();
+			writeToStream(*it->second, buf_a);
+			writeToStream(*res->second, buf_b);
+			testAssert(buf_a.buf == buf_b.buf);
+		}
+	}
+
+	testAssert(a.getNextObjectUID() == b.getNextObjectUID());
+}
+
+
+// Makes an object with typical amounts of content, materials and script, so that the full record is much larger than the transform.
+static WorldObjectRef makeTransformTestObject(ServerAllWorldsState& all_worlds, PCG32& rng)
+{
+	WorldObjectRef ob = ServerTestUtils::makeTestObject(all_worlds, rng);
+	ob->model_url = "model_" + toString(ob->uid.value()) + ".bmesh";
+	ob->content = std::string(2000, 'c');
+	ob->script = std::string(1000, 's');
+	for(int i=0; i<4; ++i)
+	{
+		ob->materials.push_back(new WorldMaterial());
+		ob->materials.back()->colour_texture_url = "tex_" + toString(ob->uid.value()) + "_" + toString(i) + ".jpg";
+	}
+	return ob;
+}
+
+
+static Reference<ServerAllWorldsState> loadTestWorldState(const std::string& db_path, const std::string& resource_dir)
+{
+	Reference<ServerAllWorldsState> all_worlds = new ServerAllWorldsState();
+	all_worlds->resource_manager = new ResourceManager(resource_dir);
+	all_worlds->readFromDisk(db_path);
+	return all_worlds;
+}
+
+
+void ServerAllWorldsState::test()
+{
+	conPrint("ServerAllWorldsState::test()");
+
+	const std::string db_path = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_test.bin";
+
+	try
+	{
+		//-------------------------- Test the last sent transform updates are cleared when the transform is sent in a full update --------------------------
+		// Scale an object to S1 with a transform update, set the scale to S2 with a full update, then scale back to S1 with a transform update.
+		// The scale should be sent in the last transform update, otherwise clients would keep S2.
+		{
+			Reference<ServerWorldState> world = new ServerWorldState();
+			Lock lock(world->mutex);
+
+			const uint64 entity_key = InterestManager::objectEntityKey(UID(1));
+			const Vec3f S1(2.f, 2.f, 2.f);
+
+			TransformUpdate update = TransformUpdate::makeObjectUpdate(UID(1), Vec3d(1.0, 2.0, 3.0), Quatf::identity(), S1, 0);
+			world->setTransformUpdatePresentFields(entity_key, update);
+			testAssert(update.present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_SCALE));
+
+			// Unchanged scale and rotation should be left out.
+			update = TransformUpdate::makeObjectUpdate(UID(1), Vec3d(1.0, 2.0, 4.0), Quatf::identity(), S1, 0);
+			world->setTransformUpdatePresentFields(entity_key, update);
+			testAssert(update.present_fields == 0);
+
+			// Scale is set to S2 and sent in an ObjectFullUpdate.
+			world->clearLastSentTransformUpdate(entity_key);
+
+			update = TransformUpdate::makeObjectUpdate(UID(1), Vec3d(1.0, 2.0, 4.0), Quatf::identity(), S1, 0);
+			world->setTransformUpdatePresentFields(entity_key, update);
+			testAssert(update.present_fields & TransformUpdate::FIELD_SCALE);
+		}
+
+		//-------------------------- Edit objects in several worlds concurrently, while the main loop work is done on another thread --------------------------
+		// All access is done with the appropriate mutexes held, so this should run cleanly under ThreadSanitizer.
+		{
+			const int num_worlds = 4;
+			const int num_obs_per_world = 100;
+			const int num_edits = 5000;
+
+			Reference<ServerAllWorldsState> all_worlds = new ServerAllWorldsState();
+			all_worlds->createNewDatabase(db_path);
+			populateTestWorldState(*all_worlds, num_worlds, num_obs_per_world);
+
+			std::vector<Reference<ServerWorldState>> worlds;
+			all_worlds->getWorldStates(worlds);
+			testAssert(worlds.size() == num_worlds + 1); // Includes the root world
+
+			Reference<TestServerLoopThread> loop_thread = new TestServerLoopThread(all_worlds.ptr());
+			loop_thread->launch();
+
+			std::vector<Reference<TestWorldEditorThread>> editors;
+			for(int w=0; w<num_worlds; ++w)
+			{
+				editors.push_back(new TestWorldEditorThread(all_worlds.ptr(), all_worlds->getWorldState("user " + toString(w)), /*seed=*/w + 1, num_edits, /*use_global_lock=*/false));
+				editors.back()->launch();
+			}
+
+			for(size_t i=0; i<editors.size(); ++i)
+				editors[i]->join();
+
+			loop_thread->done = 1;
+			loop_thread->join();
+			testAssert(loop_thread->num_user_lookups == loop_thread->num_snapshots * 10);
+
+			// Check each world has the objects that were created in it, and that UIDs were not allocated twice.
+			size_t total_num_obs = 0;
+			std::set<UID> uids;
+			for(int w=0; w<num_worlds; ++w)
+			{
+				Reference<ServerWorldState> world = all_worlds->getWorldState("user " + toString(w));
+				testAssert(world.nonNull());
+
+				Lock world_lock(world->mutex);
+				testAssert(world->objects.size() == (size_t)(num_obs_per_world + editors[w]->num_created));
+				for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
+					uids.insert(it->first);
+				total_num_obs += world->objects.size();
+			}
+			testAssert(uids.size() == total_num_obs);
+			testAssert(all_worlds->getWorldState("no such world").isNull());
+
+			// Take a final snapshot.  All objects should then have database keys, and all dirty sets should be empty.
+			{
+				Lock lock(all_worlds->mutex);
+				Reference<DatabaseWriteBatch> batch = all_worlds->snapshotDirtyRecords();
+
+				for(auto world_it = all_worlds->world_states.begin(); world_it != all_worlds->world_states.end(); ++world_it)
+				{
+					ServerWorldState* world = world_it->second.ptr();
+					Lock world_lock(world->mutex);
+					testAssert(world->db_dirty_world_objects.empty());
+					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
+						testAssert(it->second->database_key.valid());
+				}
+			}
+		}
+
+		//-------------------------- Test serial and parallel loads of a database give the same result --------------------------
+		{
+			const std::string load_test_db_path = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_load_test.bin";
+			const std::string resource_dir = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_load_test_resources";
+			FileUtils::createDirIfDoesNotExist(resource_dir);
+			makeLoadTestDatabase(load_test_db_path, resource_dir, /*num records=*/20000);
+
+			// The write log is not used, so that loading doesn't change the database while both states have it open.
+			Reference<ServerAllWorldsState> serial_loaded = new ServerAllWorldsState();
+			serial_loaded->resource_manager = new ResourceManager(resource_dir);
+			serial_loaded->use_database_write_log = false;
+			serial_loaded->readFromDisk(load_test_db_path, /*parallel load=*/false);
+
+			Reference<ServerAllWorldsState> parallel_loaded = new ServerAllWorldsState();
+			parallel_loaded->resource_manager = new ResourceManager(resource_dir);
+			parallel_loaded->use_database_write_log = false;
+			parallel_loaded->readFromDisk(load_test_db_path, /*parallel load=*/true);
+
+			checkLoadedWorldStatesEqual(*serial_loaded, *parallel_loaded);
+		}
+
+		//-------------------------- Perf test: serial vs. parallel load of a database with 1M records --------------------------
+		if(false)
+		{
+			const std::string load_test_db_path = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_load_perf_test.bin";
+			const std::string resource_dir = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_load_test_resources";
+			FileUtils::createDirIfDoesNotExist(resource_dir);
+			makeLoadTestDatabase(load_test_db_path, resource_dir, /*num records=*/1000000);
+
+			Reference<ServerAllWorldsState> loaded[2];
+			for(int parallel=0; parallel<2; ++parallel)
+			{
+				Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+				world_state->resource_manager = new ResourceManager(resource_dir);
+				world_state->use_database_write_log = false;
+
+				Timer timer;
+				world_state->readFromDisk(load_test_db_path, /*parallel load=*/parallel != 0);
+				conPrint(std::string(parallel ? "Parallel" : "Serial") + " load of 1M records: " + timer.elapsedStringNSigFigs(4));
+				loaded[parallel] = world_state;
+			}
+
+			checkLoadedWorldStatesEqual(*loaded[0], *loaded[1]);
+		}
+
+		//-------------------------- Test transform records --------------------------
+		{
+			const std::string transform_test_db_path = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_transform_test.bin";
+			const std::string resource_dir = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_load_test_resources";
+			FileUtils::createDirIfDoesNotExist(resource_dir);
+
+			for(int use_write_log=0; use_write_log<2; ++use_write_log)
+			{
+				Reference<ServerAllWorldsState> all_worlds = new ServerAllWorldsState();
+				all_worlds->resource_manager = new ResourceManager(resource_dir);
+				all_worlds->use_database_write_log = use_write_log != 0;
+				all_worlds->createNewDatabase(transform_test_db_path);
+
+				PCG32 rng(1);
+				const int num_obs = 100;
+				std::vector<WorldObjectRef> obs;
+				{
+					Lock lock(all_worlds->mutex);
+					Reference<ServerWorldState> root_world = all_worlds->getRootWorldState();
+					{
+						Lock world_lock(root_world->mutex);
+						for(int i=0; i<num_obs; ++i)
+						{
+							WorldObjectRef ob = makeTransformTestObject(*all_worlds, rng);
+							root_world->objects[ob->uid] = ob;
+							root_world->addWorldObjectAsDBDirty(ob);
+							// A new object moved before its first save should be written in full.
+							root_world->addWorldObjectTransformAsDBDirty(ob);
+							obs.push_back(ob);
+						}
+					}
+					Reference<DatabaseWriteBatch> batch = all_worlds->snapshotDirtyRecords();
+					testAssert(batch->num_obs == num_obs && batch->num_object_transforms == 0);
+					all_worlds->writeBatchToDatabase(*batch);
+
+					// Move all the objects.  Only the transform records should be written.
+					{
+						Lock world_lock(root_world->mutex);
+						for(int i=0; i<num_obs; ++i)
+						{
+							obs[i]->pos = Vec3d(rng.unitRandom() * 100, rng.unitRandom() * 100, 1);
+							obs[i]->angle = rng.unitRandom();
+							root_world->addWorldObjectTransformAsDBDirty(obs[i]);
+						}
+					}
+					batch = all_worlds->snapshotDirtyRecords();
+					testAssert(batch->num_obs == 0 && batch->num_object_transforms == num_obs);
+					testAssert(batch->data.size() < num_obs * 100); // Full records are > 3 KB each.
+					all_worlds->writeBatchToDatabase(*batch);
+					for(int i=0; i<num_obs; ++i)
+						testAssert(obs[i]->transform_database_key.valid());
+
+					// Edit the content of object 0, and move it.  The full record and the transform record should be written.
+					// Move object 1 again.  Delete object 2, which leaves its transform record to be removed on the next load.
+					{
+						Lock world_lock(root_world->mutex);
+						obs[0]->content = "new content";
+						obs[0]->pos = Vec3d(1, 2, 3);
+						root_world->addWorldObjectAsDBDirty(obs[0]);
+						root_world->addWorldObjectTransformAsDBDirty(obs[0]);
+
+						obs[1]->pos = Vec3d(4, 5, 6);
+						root_world->addWorldObjectTransformAsDBDirty(obs[1]);
+
+						root_world->db_records_to_delete.insert(obs[2]->database_key);
+						root_world->objects.erase(obs[2]->uid);
+					}
+					batch = all_worlds->snapshotDirtyRecords();
+					testAssert(batch->num_obs == 1 && batch->num_object_transforms == 1);
+					testAssert(batch->record_updates.size() == 3);
+					all_worlds->writeBatchToDatabase(*batch);
+				}
+				all_worlds = NULL; // Close database
+
+				// Load, and check all the objects have their latest transforms.
+				for(int reload=0; reload<2; ++reload)
+				{
+					Reference<ServerAllWorldsState> loaded = loadTestWorldState(transform_test_db_path, resource_dir);
+					Lock lock(loaded->mutex);
+					Reference<ServerWorldState> root_world = loaded->getRootWorldState();
+					Lock world_lock(root_world->mutex);
+
+					testAssert(root_world->objects.size() == num_obs - 1);
+					testAssert(root_world->objects.count(obs[2]->uid) == 0);
+					for(int i=0; i<num_obs; ++i)
+					{
+						if(i == 2)
+							continue;
+						auto res = root_world->objects.find(obs[i]->uid);
+						testAssert(res != root_world->objects.end());
+						testAssert(res->second->pos == obs[i]->pos);
+						testAssert(res->second->angle == obs[i]->angle);
+						testAssert(res->second->content == obs[i]->content);
+						testAssert(res->second->transform_database_key.valid());
+					}
+
+					// The transform record of the deleted object should be removed on the first load.
+					testAssert(loaded->db_records_to_delete.size() == ((reload == 0) ? 1 : 0));
+					loaded->serialiseToDisk(/*compact write log=*/true);
+				}
+			}
+		}
+
+		//-------------------------- Perf test: write volume for moving objects, with transform records vs. full records --------------------------
+		if(false)
+		{
+			const std::string transform_test_db_path = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_transform_perf_test.bin";
+			const std::string resource_dir = PlatformUtils::getTempDirPath() + "/server_all_worlds_state_load_test_resources";
+			FileUtils::createDirIfDoesNotExist(resource_dir);
+
+			Reference<ServerAllWorldsState> all_worlds = new ServerAllWorldsState();
+			all_worlds->resource_manager = new ResourceManager(resource_dir);
+			all_worlds->createNewDatabase(transform_test_db_path);
+
+			Lock lock(all_worlds->mutex);
+			Reference<ServerWorldState> root_world = all_worlds->getRootWorldState();
+
+			PCG32 rng(1);
+			const int num_obs = 10000;
+			std::vector<WorldObjectRef> obs;
+			{
+				Lock world_lock(root_world->mutex);
+				for(int i=0; i<num_obs; ++i)
+				{
+					WorldObjectRef ob = makeTransformTestObject(*all_worlds, rng);
+					root_world->objects[ob->uid] = ob;
+					root_world->addWorldObjectAsDBDirty(ob);
+					obs.push_back(ob);
+				}
+			}
+			all_worlds->serialiseToDisk(/*compact write log=*/true);
+
+			// Simulate a physics-heavy world: each save, a tenth of the objects have moved.
+			const int num_saves = 100;
+			size_t transform_record_bytes = 0;
+			size_t full_record_bytes = 0;
+			BufferOutStream temp_buf;
+			Timer timer;
+			for(int save=0; save<num_saves; ++save)
+			{
+				{
+					Lock world_lock(root_world->mutex);
+					for(int i=0; i<num_obs / 10; ++i)
+					{
+						WorldObject* ob = obs[rng.nextUInt(num_obs)].ptr();
+						ob->pos = Vec3d(rng.unitRandom() * 100, rng.unitRandom() * 100, 0);
+						root_world->addWorldObjectTransformAsDBDirty(ob);
+
+						writeWorldObjectRecord("", *ob, temp_buf);
+						full_record_bytes += temp_buf.buf.size(); // What would have been written without transform records.  (Approximate, as an object may be moved more than once per save.)
+					}
+				}
+
+				Reference<DatabaseWriteBatch> batch = all_worlds->snapshotDirtyRecords();
+				transform_record_bytes += batch->data.size();
+				all_worlds->writeBatchToDatabase(*batch);
+			}
+
+			conPrint("Saved " + toString(num_saves) + " batches of moved objects in " + timer.elapsedStringNSigFigs(4));
+			conPrint("Record data written: transform records: " + getNiceByteSize(transform_record_bytes) + ", full records: " + getNiceByteSize(full_record_bytes) +
+				" (" + doubleToStringNSigFigs((double)full_record_bytes / transform_record_bytes, 3) + "x)");
+		}
+
+		//-------------------------- Perf test: simultaneous editing in several worlds, with a single global lock vs. a lock per world --------------------------
+		if(false)
+		{
+			const int num_worlds = 8;
+			const int num_edits = 200000;
+
+			for(int use_global_lock=1; use_global_lock >= 0; --use_global_lock)
+			{
+				Reference<ServerAllWorldsState> all_worlds = new ServerAllWorldsState();
+				all_worlds->createNewDatabase(db_path);
+				populateTestWorldState(*all_worlds, num_worlds, /*num_obs_per_world=*/10000);
+
+				Reference<TestServerLoopThread> loop_thread = new TestServerLoopThread(all_worlds.ptr());
+				loop_thread->launch();
+
+				Timer timer;
+				std::vector<Reference<TestWorldEditorThread>> editors;
+				for(int w=0; w<num_worlds; ++w)
+				{
+					editors.push_back(new TestWorldEditorThread(all_worlds.ptr(), all_worlds->getWorldState("user " + toString(w)), /*seed=*/w + 1, num_edits, use_global_lock != 0));
+					editors.back()->launch();
+				}
+				for(size_t i=0; i<editors.size(); ++i)
+					editors[i]->join();
+				const double elapsed = timer.elapsed();
+
+				loop_thread->done = 1;
+				loop_thread->join();
+
+				conPrint(std::string(use_global_lock ? "Global lock:    " : "Per-world lock: ") + toString(num_worlds) + " threads x " + toString(num_edits) + " edits: " + doubleToStringNSigFigs(elapsed, 4) + " s (" +
+					doubleToStringNSigFigs(num_worlds * num_edits / elapsed * 1.0e-6, 4) + " M edits/s), " + toString(loop_thread->num_snapshots) + " snapshots");
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ServerAllWorldsState::test() done");
+}
+
+
+#endif // BUILD_TESTS
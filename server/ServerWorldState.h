@@ -18,31 +18,75 @@ Generated at 2016-01-12 12:22:34 +1300
 #include "ParcelAuction.h"
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
+#include "ObjectSpatialIndex.h"
+#include "ParcelSpatialIndex.h"
+#include "ObjectURLIndex.h"
+#include "ObjectPacketCache.h"
+#include "../shared/TransformBatch.h"
+#include "DatabaseWriteLog.h"
 #include <ThreadSafeRefCounted.h>
 #include <Platform.h>
 #include <Mutex.h>
+#include <Condition.h>
 #include <Database.h>
+#include <BufferOutStream.h>
 #include <map>
 #include <unordered_set>
+#include <unordered_map>
 
 
+/*=====================================================================
+ServerWorldState
+----------------
+The state of a single world: its objects, avatars, parcels and settings.
+
+Each world has its own mutex, so that activity in one world doesn't block
+clients and web requests using other worlds.
+
+Lock order: ServerAllWorldsState::mutex, then ServerAllWorldsState::database_mutex,
+then ServerWorldState::mutex, then ServerAllWorldsState::object_URL_index_mutex.
+Don't hold the mutexes of more than one world at once.
+=====================================================================*/
 class ServerWorldState : public ThreadSafeRefCounted
 {
 public:
-	void addParcelAsDBDirty(const ParcelRef parcel) { db_dirty_parcels.insert(parcel); }
-	void addWorldObjectAsDBDirty(const WorldObjectRef ob) { db_dirty_world_objects.insert(ob); }
+	void addParcelAsDBDirty(const ParcelRef parcel) REQUIRES(mutex) { db_dirty_parcels.insert(parcel); parcel_spatial_index.invalidate(); parcels_generation++; }
+	// Also increments the object's network_state_version, since any change that is saved to the DB is assumed to change the network state of the object.
+	void addWorldObjectAsDBDirty(const WorldObjectRef ob) REQUIRES(mutex) { db_dirty_world_objects.insert(ob); ob->network_state_version++; }
+	// For changes to just the transform (pos, axis, angle, scale, last_modified_time) of an object.  These are saved as a small transform record for the object, instead of rewriting the full object record.
+	void addWorldObjectTransformAsDBDirty(const WorldObjectRef ob) REQUIRES(mutex) { db_dirty_world_object_transforms.insert(ob); ob->network_state_version++; }
+
+	WorldSettings world_settings GUARDED_BY(mutex);
 
-	WorldSettings world_settings;
+	std::map<UID, Reference<Avatar>> avatars GUARDED_BY(mutex);
 
-	std::map<UID, Reference<Avatar>> avatars;
+	std::map<UID, WorldObjectRef> objects GUARDED_BY(mutex);
+	ObjectSpatialIndex object_spatial_index GUARDED_BY(mutex); // Spatial index over the objects in 'objects'.  Needs to be kept in sync with 'objects' and object positions.
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects GUARDED_BY(mutex);
+	// Sets the fields of update that need to be sent, leaving out fields that haven't changed since the last transform update sent for the entity, and records update as the last one sent.
+	void setTransformUpdatePresentFields(uint64 entity_key, TransformUpdate& update) REQUIRES(mutex);
+	// Should be called when the entity's transform has been sent in another message (e.g. ObjectFullUpdate, AvatarCreated), or the entity was removed, so that the next transform update is sent with all fields.
+	void clearLastSentTransformUpdate(uint64 entity_key) REQUIRES(mutex) { last_sent_transform_updates.erase(entity_key); }
 
-	std::map<UID, WorldObjectRef> objects;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects;
+	std::unordered_map<uint64, TransformUpdate> last_sent_transform_updates GUARDED_BY(mutex); // Last transform update broadcast for each avatar and object, keyed by InterestManager entity key.  Used to leave unchanged fields out of TransformUpdateBatch messages.
+	ObjectPacketCache object_packet_cache GUARDED_BY(mutex); // Cached ObjectInitialSend messages for the objects in 'objects'.  Objects should be removed from this when removed from 'objects'.
 
-	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects;
+	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels GUARDED_BY(mutex);
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects GUARDED_BY(mutex);
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_object_transforms GUARDED_BY(mutex); // Objects with only transform changes.  May overlap db_dirty_world_objects, in which case the full object is saved.
+	std::unordered_set<DatabaseKey, DatabaseKeyHash> db_records_to_delete GUARDED_BY(mutex); // Keys of deleted objects and parcels in this world.
 
-	std::map<ParcelID, ParcelRef> parcels;
+	std::map<ParcelID, ParcelRef> parcels GUARDED_BY(mutex);
+
+	// Returns the spatial index over 'parcels', rebuilding it first if it has been invalidated.
+	// Any code that adds, removes or changes parcels without calling addParcelAsDBDirty() should call parcel_spatial_index.invalidate().
+	const ParcelSpatialIndex& getParcelSpatialIndex() REQUIRES(mutex) { if(!parcel_spatial_index.isValid()) parcel_spatial_index.build(parcels); return parcel_spatial_index; }
+
+	ParcelSpatialIndex parcel_spatial_index GUARDED_BY(mutex);
+
+	glare::AtomicInt parcels_generation; // Incremented by addParcelAsDBDirty().  Can be read without holding mutex.  See ServerAllWorldsState::getWebPageGeneration().
+
+	mutable ::Mutex mutex;
 };
 
 
@@ -99,9 +143,47 @@ struct ServerCredentials
 
 
 /*=====================================================================
-ServerWorldState
-----------------
+DatabaseWriteBatch
+------------------
+A snapshot of the serialised data of dirty records, taken while holding the
+world state mutex.  Written to the database by the DatabaseWriterThread,
+so the file I/O is done without holding the world state mutex.
+=====================================================================*/
+class DatabaseWriteBatch : public ThreadSafeRefCounted
+{
+public:
+	DatabaseWriteBatch() : compact_write_log(false), num_obs(0), num_object_transforms(0), num_parcels(0), num_orders(0), num_sessions(0), num_auctions(0), num_screenshots(0), num_sub_eth_transactions(0),
+		num_tiles_written(0), num_users(0), num_resources(0), num_world_settings(0), snapshot_time(0) {}
+
+	void addRecordUpdate(const DatabaseKey& key, const BufferOutStream& record_data);
+
+	struct RecordUpdate
+	{
+		DatabaseKey key;
+		size_t offset; // Offset of record data in data.
+		size_t len;
+	};
+
+	std::vector<DatabaseKey> keys_to_delete;
+	std::vector<RecordUpdate> record_updates;
+	js::Vector<uint8, 16> data; // Serialised record data for all record updates.
+	bool compact_write_log; // If true, fold the write log into the main database after writing this batch.
+
+	// Number of various type of objects that were dirty and saved.
+	size_t num_obs, num_object_transforms, num_parcels, num_orders, num_sessions, num_auctions, num_screenshots, num_sub_eth_transactions, num_tiles_written, num_users, num_resources, num_world_settings;
+	double snapshot_time;
+};
+
 
+/*=====================================================================
+ServerAllWorldsState
+--------------------
+All the worlds on the server, and the state shared between them: users,
+web sessions, orders, auctions, screenshots etc.
+
+'mutex' protects the shared state and the world_states map.  It doesn't
+protect the contents of the worlds, each ServerWorldState has its own
+mutex for that.  Code that needs both should lock 'mutex' first.
 =====================================================================*/
 class ServerAllWorldsState : public ThreadSafeRefCounted
 {
@@ -109,10 +191,29 @@ public:
 	ServerAllWorldsState();
 	~ServerAllWorldsState();
 
-	void readFromDisk(const std::string& path);
+	// Reads the database at path, and replays the write log next to it.  If parallel_load is true, object and parcel records are decoded on a task manager.
+	void readFromDisk(const std::string& path, bool parallel_load = true);
 	void createNewDatabase(const std::string& path);
-	void serialiseToDisk() REQUIRES(mutex); // Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
-	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.  Mutex should be locked already.
+	// Write any changed data (objects in dirty set) to disk, and wait until it has been written.  Mutex should be held already.
+	void serialiseToDisk(bool compact_write_log = false) REQUIRES(mutex);
+
+	// Serialise any changed data (objects in dirty set) into a batch, and clear the dirty sets.  Mutex should be held already.  Locks each world mutex in turn.
+	// This is much faster than writing to disk.  The batch can then be written with writeBatchToDatabase() on another thread.
+	// If compact_write_log is true, the write log is folded into the main database when the batch is written.
+	//
+	// Objects with only transform changes just have their transform record written, which is an OBJECT_TRANSFORM_CHUNK record keyed by the object UID,
+	// stored under WorldObject::transform_database_key.  When loading, the transform record overrides the transform in the full object record.
+	Reference<DatabaseWriteBatch> snapshotDirtyRecords(bool compact_write_log = false) REQUIRES(mutex);
+	// Writes batch to the write log if it is enabled, otherwise to the database, and flushes it.  Doesn't require mutex.
+	void writeBatchToDatabase(const DatabaseWriteBatch& batch);
+
+	// Track batches that have been snapshotted but not written yet.  Call beginPendingDatabaseWrite() before enqueuing a batch
+	// to the DatabaseWriterThread, and endPendingDatabaseWrite() when it has been written (or writing failed).
+	void beginPendingDatabaseWrite();
+	void endPendingDatabaseWrite();
+	size_t numPendingDatabaseWrites();
+	void waitForPendingDatabaseWrites(); // Blocks until all pending batches have been written.  Flush barrier.
+	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.  Locks mutex and each world mutex in turn.
 
 	// Removes sensitive information from the database, such as user passwords, email addresses, billing information, web sessions etc.
 	// Then saves the updates to disk.
@@ -120,11 +221,12 @@ public:
 
 	std::string getCredential(const std::string& key); // Throws glare::Exception if not found
 
-	UID getNextObjectUID(); // Gets and then increments next_object_uid.  Locks mutex.
-	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.  Locks mutex.
-	uint64 getNextOrderUID(); // Gets and then increments next_order_uid.  Locks mutex.
+	// These lock next_uid_mutex, so can be called while holding any other mutex.
+	UID getNextObjectUID(); // Gets and then increments next_object_uid.
+	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.
+	uint64 getNextOrderUID(); // Gets and then increments next_order_uid.
 	uint64 getNextSubEthTransactionUID();
-	uint64 getNextScreenshotUID();
+	uint64 getNextScreenshotUID(); // Locks mutex.
 
 	void markAsChanged() { changed = 1; }
 	void clearChangedFlag() { changed = 0; }
@@ -133,14 +235,20 @@ public:
 	void setUserWebMessage(const UserID& user_id, const std::string& s);
 	std::string getAndRemoveUserWebMessage(const UserID& user_id); // returns empty string if no message or user
 
-	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference
+	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference.  Locks mutex.
+	Reference<ServerWorldState> getWorldState(const std::string& world_name); // Returns NULL if there is no such world.  Locks mutex.
+	void getWorldStates(std::vector<Reference<ServerWorldState>>& worlds_out); // Gets all worlds.  Locks mutex.
+
+	// Returns a value that changes whenever a root world parcel, parcel auction or screenshot is added to the DB dirty sets.  Used for invalidating cached web pages, see WebPageCache.
+	// Doesn't lock any mutex.
+	uint64 getWebPageGeneration() const { return (uint64)((int64)web_data_generation + (int64)root_world_state->parcels_generation); }
 
 	void addResourcesAsDBDirty(const ResourceRef resource)					REQUIRES(mutex) { db_dirty_resources.insert(resource); changed = 1; }
 	void addSubEthTransactionAsDBDirty(const SubEthTransactionRef trans)	REQUIRES(mutex) { db_dirty_sub_eth_transactions.insert(trans); changed = 1; }
 	void addOrderAsDBDirty(const OrderRef order)							REQUIRES(mutex) { db_dirty_orders.insert(order); changed = 1; }
-	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; }
+	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; web_data_generation++; }
 	void addUserWebSessionAsDBDirty(const UserWebSessionRef screenshot)		REQUIRES(mutex) { db_dirty_userwebsessions.insert(screenshot); changed = 1; }
-	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; }
+	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; web_data_generation++; }
 	void addUserAsDBDirty(const UserRef user)								REQUIRES(mutex) { db_dirty_users.insert(user); changed = 1; }
 
 	void addEverythingToDirtySets();
@@ -149,6 +257,8 @@ public:
 
 	void clearAndReset(); // Just for fuzzing
 
+	static void test();
+
 	Reference<ResourceManager> resource_manager;
 
 	std::map<UserID, Reference<User>> user_id_to_users GUARDED_BY(mutex);  // User id to user
@@ -156,7 +266,12 @@ public:
 
 	std::map<uint64, OrderRef> orders GUARDED_BY(mutex); // Order ID to order
 
-	std::map<std::string, Reference<ServerWorldState> > world_states GUARDED_BY(mutex); // ServerWorldState contains WorldObjects and Parcels
+	std::map<std::string, Reference<ServerWorldState> > world_states GUARDED_BY(mutex); // ServerWorldState contains WorldObjects and Parcels.  Worlds are never removed.
+	// The same world as world_states[""].  Only set in the constructor and readFromDisk(), before other threads are started, so can be read without holding mutex.
+	Reference<ServerWorldState> root_world_state;
+
+	::Mutex object_URL_index_mutex; // Lock order: after any ServerWorldState mutex.
+	ObjectURLIndex object_URL_index GUARDED_BY(object_URL_index_mutex); // Map from resource URL to the objects (in all worlds) that use it.  Needs to be kept in sync with the objects in world_states.
 
 	std::map<std::string, UserWebSessionRef> user_web_sessions GUARDED_BY(mutex); // Map from key to UserWebSession
 	
@@ -207,21 +322,37 @@ public:
 	std::unordered_set<ScreenshotRef, ScreenshotRefHash>				db_dirty_screenshots			GUARDED_BY(mutex);
 	std::unordered_set<UserRef, UserRefHash>							db_dirty_users					GUARDED_BY(mutex);
 
-	std::unordered_set<DatabaseKey, DatabaseKeyHash>					db_records_to_delete			GUARDED_BY(mutex);
+	std::unordered_set<DatabaseKey, DatabaseKeyHash>					db_records_to_delete			GUARDED_BY(mutex); // Keys of deleted records that aren't in a world.  See also ServerWorldState::db_records_to_delete.
 
 
 	ServerCredentials server_credentials;
 
+	// If true, changes are appended to a DatabaseWriteLog next to the database file, which is periodically folded into the database.  Set before readFromDisk() or createNewDatabase().
+	// An existing write log is always replayed on load, even if this is false.
+	bool use_database_write_log;
+
 	mutable ::Mutex mutex;
 private:
 	GLARE_DISABLE_COPY(ServerAllWorldsState);
 
+	// Writes the pending changes in the write log to the database, flushes the database, then resets the log.
+	void compactWriteLog() REQUIRES(database_mutex);
+
 	glare::AtomicInt changed;
 
-	UID next_object_uid GUARDED_BY(mutex);
-	UID next_avatar_uid GUARDED_BY(mutex);
-	uint64 next_order_uid GUARDED_BY(mutex);
-	uint64 next_sub_eth_transaction_uid GUARDED_BY(mutex);
+	glare::AtomicInt web_data_generation; // Incremented when a parcel auction or screenshot is added to the DB dirty sets.
+
+	::Mutex next_uid_mutex; // Lock order: last.
+	UID next_object_uid GUARDED_BY(next_uid_mutex);
+	UID next_avatar_uid GUARDED_BY(next_uid_mutex);
+	uint64 next_order_uid GUARDED_BY(next_uid_mutex);
+	uint64 next_sub_eth_transaction_uid GUARDED_BY(next_uid_mutex);
+
+	::Mutex database_mutex; // Lock order: mutex, then database_mutex, then any ServerWorldState mutex.
+	Database database GUARDED_BY(database_mutex);
+	DatabaseWriteLog write_log GUARDED_BY(database_mutex);
 
-	Database database GUARDED_BY(mutex);
+	::Mutex pending_db_writes_mutex;
+	Condition pending_db_writes_condition;
+	size_t num_pending_db_writes GUARDED_BY(pending_db_writes_mutex);
 };
@@ -0,0 +1,275 @@
+/*=====================================================================
+TickScheduler.cpp
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "TickScheduler.h"
+
+
+#include <maths/mathstypes.h>
+#include <limits>
+
+
+const double TickScheduler::DEADLINE_TOLERANCE = 1.0e-3;
+
+
+TickScheduler::TickScheduler(double default_period_, double idle_period_)
+:	num_overruns(0),
+	max_overrun_time(0),
+	default_period(default_period_),
+	idle_period(idle_period_)
+{
+}
+
+
+TickScheduler::WorldTickState& TickScheduler::getOrCreateWorldState(const std::string& world_name)
+{
+	auto res = worlds.find(world_name);
+	if(res != worlds.end())
+		return res->second;
+
+	WorldTickState& state = worlds[world_name];
+	state.period = 0;
+	state.deadline = -std::numeric_limits<double>::infinity(); // Not ticked yet, due immediately.
+	state.num_idle_ticks = 0;
+	return state;
+}
+
+
+double TickScheduler::currentPeriod(const WorldTickState& state) const
+{
+	const double period = (state.period > 0) ? state.period : default_period;
+	if(state.num_idle_ticks >= IDLE_TICKS_BEFORE_BACKOFF)
+		return myMax(period, idle_period);
+	else
+		return period;
+}
+
+
+void TickScheduler::setWorldPeriod(const std::string& world_name, double period)
+{
+	getOrCreateWorldState(world_name).period = period;
+}
+
+
+double TickScheduler::getWorldPeriod(const std::string& world_name) const
+{
+	auto res = worlds.find(world_name);
+	if(res != worlds.end())
+		return currentPeriod(res->second);
+	else
+		return default_period;
+}
+
+
+bool TickScheduler::isWorldDue(const std::string& world_name, double now)
+{
+	WorldTickState& state = getOrCreateWorldState(world_name);
+	if(state.deadline == -std::numeric_limits<double>::infinity()) // If the world hasn't been ticked yet, it is due now.
+		state.deadline = now;
+
+	return now + DEADLINE_TOLERANCE >= state.deadline;
+}
+
+
+void TickScheduler::worldTicked(const std::string& world_name, double now, bool had_dirty_entities)
+{
+	WorldTickState& state = getOrCreateWorldState(world_name);
+
+	if(had_dirty_entities)
+		state.num_idle_ticks = 0;
+	else
+		state.num_idle_ticks++;
+
+	const double period = currentPeriod(state);
+
+	if(state.deadline == -std::numeric_limits<double>::infinity()) // If isWorldDue() wasn't called before the tick:
+		state.deadline = now;
+
+	state.deadline += period;
+
+	if(state.deadline <= now) // If we have already missed the next deadline:
+	{
+		num_overruns++;
+		max_overrun_time = myMax(max_overrun_time, now - state.deadline);
+
+		// Skip the missed ticks, instead of trying to catch up by running them back-to-back.
+		state.deadline = now + period;
+	}
+}
+
+
+double TickScheduler::getSleepTime(double now) const
+{
+	double next_deadline = now + idle_period;
+	for(auto it = worlds.begin(); it != worlds.end(); ++it)
+		next_deadline = myMin(next_deadline, it->second.deadline);
+
+	return myClamp(next_deadline - now, 0.0, idle_period);
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <vector>
+#include <cmath>
+
+
+// Runs a simulated main server loop with a fake clock, from start_time until end_time.
+// Each tick of a world takes processing_time.  Appends the start times of the ticks of each world to tick_times_out.
+static void runFakeServerLoop(TickScheduler& scheduler, const std::vector<std::string>& world_names, double start_time, double end_time, double processing_time,
+	std::vector<std::vector<double>>& tick_times_out)
+{
+	tick_times_out.resize(world_names.size());
+
+	double now = start_time;
+	while(now < end_time)
+	{
+		for(size_t i=0; i<world_names.size(); ++i)
+		{
+			if(scheduler.isWorldDue(world_names[i], now))
+			{
+				tick_times_out[i].push_back(now);
+				now += processing_time;
+				scheduler.worldTicked(world_names[i], now, /*had dirty entities=*/true);
+			}
+		}
+
+		now += scheduler.getSleepTime(now); // Sleep until the next world is due.
+	}
+}
+
+
+void TickScheduler::test()
+{
+	conPrint("TickScheduler::test()");
+
+	//-------------------------- Test that processing time doesn't cause drift --------------------------
+	{
+		TickScheduler scheduler(/*default period=*/0.1, /*idle period=*/0.5);
+
+		std::vector<std::string> world_names(1, "");
+		std::vector<std::vector<double>> tick_times;
+		runFakeServerLoop(scheduler, world_names, /*start time=*/1000.0, /*end time=*/1000.0 + 9.99, /*processing time=*/0.03, tick_times);
+
+		// Ticks should start at exactly 0.1 s intervals, not 0.13 s as when sleeping for a fixed time after the processing.
+		testAssert(tick_times[0].size() == 100);
+		for(size_t i=0; i<tick_times[0].size(); ++i)
+			testAssert(std::fabs(tick_times[0][i] - (1000.0 + i * 0.1)) < 1.0e-6);
+
+		testAssert(scheduler.num_overruns == 0);
+	}
+
+	//-------------------------- Test per-world periods --------------------------
+	{
+		TickScheduler scheduler(/*default period=*/0.1, /*idle period=*/0.5);
+		scheduler.setWorldPeriod("physics", 0.025);
+		scheduler.setWorldPeriod("quiet", 0.4);
+		testAssert(scheduler.getWorldPeriod("physics") == 0.025);
+		testAssert(scheduler.getWorldPeriod("quiet") == 0.4);
+		testAssert(scheduler.getWorldPeriod("") == 0.1);
+
+		std::vector<std::string> world_names;
+		world_names.push_back("");
+		world_names.push_back("physics");
+		world_names.push_back("quiet");
+		std::vector<std::vector<double>> tick_times;
+		runFakeServerLoop(scheduler, world_names, /*start time=*/0.0, /*end time=*/3.99, /*processing time=*/0.001, tick_times);
+
+		testAssert(tick_times[0].size() == 40);
+		testAssert(tick_times[1].size() == 160);
+		testAssert(tick_times[2].size() == 10);
+		for(size_t i=0; i<tick_times[1].size(); ++i)
+			testAssert(tick_times[1][i] >= i * 0.025 - DEADLINE_TOLERANCE && tick_times[1][i] < i * 0.025 + 0.005); // May be delayed by the processing of the other worlds.
+		testAssert(scheduler.num_overruns == 0);
+	}
+
+	//-------------------------- Test overruns --------------------------
+	{
+		TickScheduler scheduler(/*default period=*/0.1, /*idle period=*/0.5);
+
+		testAssert(scheduler.isWorldDue("", 0.0)); // New worlds are due immediately.
+		scheduler.worldTicked("", 0.01, true);
+		testAssert(!scheduler.isWorldDue("", 0.05));
+		testAssert(scheduler.isWorldDue("", 0.11));
+
+		// Tick processing takes 0.25 s, so the deadline at 0.2 is missed.
+		scheduler.worldTicked("", 0.36, true);
+		testAssert(scheduler.num_overruns == 1);
+		testAssert(std::fabs(scheduler.max_overrun_time - 0.16) < 1.0e-9);
+
+		// The missed tick is skipped, the next tick is due a period after the overrunning tick finished.
+		testAssert(!scheduler.isWorldDue("", 0.4));
+		testAssert(scheduler.isWorldDue("", 0.46));
+		scheduler.worldTicked("", 0.47, true);
+		testAssert(scheduler.num_overruns == 1);
+		testAssert(!scheduler.isWorldDue("", 0.5));
+		testAssert(scheduler.isWorldDue("", 0.56));
+
+		// A tick that finishes late, but before the next deadline, is not an overrun.
+		scheduler.worldTicked("", 0.65, true);
+		testAssert(scheduler.num_overruns == 1);
+		testAssert(scheduler.isWorldDue("", 0.66));
+	}
+
+	//-------------------------- Test idle backoff --------------------------
+	{
+		TickScheduler scheduler(/*default period=*/0.1, /*idle period=*/0.5);
+		scheduler.setWorldPeriod("slow", 1.0);
+
+		double now = 0;
+		for(int i=0; i<IDLE_TICKS_BEFORE_BACKOFF - 1; ++i)
+		{
+			testAssert(scheduler.isWorldDue("", now));
+			scheduler.worldTicked("", now, /*had dirty entities=*/false);
+			testAssert(scheduler.getWorldPeriod("") == 0.1);
+			now += 0.1;
+		}
+
+		// The next tick without dirty entities should back off to the idle period.
+		testAssert(scheduler.isWorldDue("", now));
+		scheduler.worldTicked("", now, /*had dirty entities=*/false);
+		testAssert(scheduler.getWorldPeriod("") == 0.5);
+		testAssert(!scheduler.isWorldDue("", now + 0.1));
+		testAssert(!scheduler.isWorldDue("", now + 0.4));
+		testAssert(scheduler.isWorldDue("", now + 0.5));
+		now += 0.5;
+
+		// A tick with dirty entities should return to the target period.
+		scheduler.worldTicked("", now, /*had dirty entities=*/true);
+		testAssert(scheduler.getWorldPeriod("") == 0.1);
+		testAssert(scheduler.isWorldDue("", now + 0.1));
+		testAssert(scheduler.num_overruns == 0);
+
+		// Backoff shouldn't shorten the period of a world with a period longer than the idle period.
+		for(int i=0; i<IDLE_TICKS_BEFORE_BACKOFF + 1; ++i)
+			scheduler.worldTicked("slow", i * 1.0, /*had dirty entities=*/false);
+		testAssert(scheduler.getWorldPeriod("slow") == 1.0);
+	}
+
+	//-------------------------- Test getSleepTime --------------------------
+	{
+		TickScheduler scheduler(/*default period=*/0.1, /*idle period=*/0.5);
+		testAssert(scheduler.getSleepTime(10.0) == 0.5); // No worlds, sleep for the idle period.
+
+		testAssert(scheduler.isWorldDue("", 10.0));
+		testAssert(scheduler.getSleepTime(10.0) == 0.0); // World has not been ticked yet, so is overdue.
+
+		scheduler.worldTicked("", 10.0, true);
+		testAssert(std::fabs(scheduler.getSleepTime(10.03) - 0.07) < 1.0e-9);
+		testAssert(scheduler.getSleepTime(10.2) == 0.0);
+
+		scheduler.setWorldPeriod("", 10.0);
+		scheduler.worldTicked("", 10.1, true);
+		testAssert(scheduler.getSleepTime(10.1) == 0.5); // Clamped to the idle period.
+	}
+
+	conPrint("TickScheduler::test() done");
+}
+
+
+#endif // BUILD_TESTS
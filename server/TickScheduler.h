@@ -0,0 +1,75 @@
+/*=====================================================================
+TickScheduler.h
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <string>
+#include <map>
+
+
+/*=====================================================================
+TickScheduler
+-------------
+Decides when the main server loop should next generate and send the
+updates for each world.
+
+Each world has a target tick period, which can be set per world.  After a
+tick, the world's deadline is advanced by the period from the previous
+deadline, instead of being set to the current time plus the period, so the
+time taken to process the tick doesn't accumulate as drift.  If a tick
+finishes after the next deadline has already passed, it is counted as an
+overrun, and the missed ticks are skipped instead of being run
+back-to-back.
+
+A world which hasn't had any dirty entities for IDLE_TICKS_BEFORE_BACKOFF
+ticks backs off to the idle period.  It goes back to its target period
+after the next tick with dirty entities.
+
+The current time is passed in to each method, so this can be tested with a
+fake clock.  Not threadsafe, only used by the main server loop.
+=====================================================================*/
+class TickScheduler
+{
+public:
+	// Periods are in seconds.
+	TickScheduler(double default_period, double idle_period);
+
+	void setWorldPeriod(const std::string& world_name, double period); // Overrides the default period for the world.
+	double getWorldPeriod(const std::string& world_name) const; // Returns the period the world is currently ticking at, taking into account idle backoff.
+
+	// Returns true if the world should be ticked at time 'now'.  A world not seen before is due immediately.
+	bool isWorldDue(const std::string& world_name, double now);
+
+	// Call after the world has been ticked.  'now' is the time the tick finished.  had_dirty_entities should be true if the tick sent any updates.
+	void worldTicked(const std::string& world_name, double now, bool had_dirty_entities);
+
+	// Returns the time to sleep for until the next world is due, clamped to [0, idle period], so the loop still wakes up regularly for other work.
+	double getSleepTime(double now) const;
+
+	static const int IDLE_TICKS_BEFORE_BACKOFF = 10;
+	static const double DEADLINE_TOLERANCE; // A world is due if it is within this time (s) of its deadline, as sleeps are only accurate to about a millisecond.
+
+	// Overrun stats, can be reset by the caller after reporting them.
+	size_t num_overruns;
+	double max_overrun_time; // Largest time (s) by which a tick finished after the next deadline.
+
+	static void test();
+
+private:
+	struct WorldTickState
+	{
+		double period; // Target period, or 0 to use the default.
+		double deadline; // Time the next tick is due.
+		int num_idle_ticks; // Number of consecutive ticks without dirty entities.
+	};
+
+	WorldTickState& getOrCreateWorldState(const std::string& world_name);
+	double currentPeriod(const WorldTickState& state) const;
+
+	std::map<std::string, WorldTickState> worlds;
+	double default_period;
+	double idle_period;
+};
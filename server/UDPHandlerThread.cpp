@@ -11,13 +11,21 @@ Copyright Glare Technologies Limited 2023 -
 #include <ConPrint.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
+#include <Lock.h>
+#include <Exception.h>
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
 
 
 static const int server_UDP_port = 7601;
 
+static const double VOICE_RELAY_CLIENTS_UPDATE_PERIOD = 0.1; // Update the connected clients and their avatar positions at most this often (s).
 
-UDPHandlerThread::UDPHandlerThread(Server* server_)
-:	server(server_)
+
+UDPHandlerThread::UDPHandlerThread(Server* server_, bool reuse_port_)
+:	server(server_),
+	reuse_port(reuse_port_)
 {
 }
 
@@ -27,6 +35,50 @@ UDPHandlerThread::~UDPHandlerThread()
 }
 
 
+// Get the connected clients with known UDP ports, and the positions of their avatars, and give them to the voice relay.
+void UDPHandlerThread::updateVoiceRelayClients(bool socket_is_IPv6)
+{
+	std::vector<VoiceRelayClient> clients;
+	{
+		Lock lock(server->connected_clients_mutex);
+
+		for(auto it = server->connected_clients.begin(); it != server->connected_clients.end(); ++it)
+		{
+			const ServerConnectedClientInfo& info = it->second;
+			if(info.client_UDP_port > 0) // If remote UDP port is known:
+			{
+				VoiceRelayClient client;
+				client.ip_addr = info.ip_addr;
+				client.UDP_port = info.client_UDP_port;
+				client.avatar_uid = info.client_avatar_id;
+				client.world_name = info.world_name;
+				clients.push_back(client);
+			}
+		}
+
+		server->connected_clients_changed = 0;
+	}
+
+	for(size_t i=0; i<clients.size(); ++i)
+	{
+		Reference<ServerWorldState> world = server->world_state->getWorldState(clients[i].world_name);
+		if(world.nonNull())
+		{
+			Lock lock(world->mutex);
+			auto avatar_res = world->avatars.find(clients[i].avatar_uid);
+			if(avatar_res != world->avatars.end())
+			{
+				clients[i].avatar_pos = avatar_res->second->pos;
+				clients[i].avatar_pos_known = true;
+			}
+		}
+	}
+
+	voice_relay.setClients(clients, socket_is_IPv6);
+	voice_relay_clients_timer.reset();
+}
+
+
 void UDPHandlerThread::doRun()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled("UDPHandlerThread");
@@ -35,10 +87,30 @@ void UDPHandlerThread::doRun()
 	{
 		conPrint("UDPHandlerThread: Listening on UDP port " + toString(server_UDP_port) + "...");
 		udp_socket = new UDPSocket();
+
+#if defined(__linux__)
+		if(reuse_port) // Allow multiple UDPHandlerThreads to bind to the same port.  The kernel distributes incoming packets between the sockets by source address.
+		{
+			const int enable = 1;
+			if(setsockopt((int)udp_socket->getSocketHandle(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0)
+				throw glare::Exception("setsockopt SO_REUSEPORT failed.");
+		}
+#endif
+
 		udp_socket->bindToPort(server_UDP_port, /*reuse_address=*/true);
 
 		conPrint("UDPHandlerThread: Bound to port " + toString(server_UDP_port));
 
+		{
+			Lock lock(server->udp_send_socket_mutex);
+			if(server->udp_send_socket.isNull())
+				server->udp_send_socket = udp_socket;
+		}
+
+		const bool socket_is_IPv6 = VoiceRelay::socketIsIPv6(*udp_socket);
+		voice_relay.setHearingRadius(server->config.voice_hearing_radius);
+		updateVoiceRelayClients(socket_is_IPv6);
+
 		std::vector<uint8> packet_buf(4096);
 		uint64 num_packets_rcvd = 0;
 
@@ -58,30 +130,18 @@ void UDPHandlerThread::doRun()
 				std::memcpy(&type, packet_buf.data(), 4);
 				if(type == 1) // If packet has voice type:
 				{
-					if(server->connected_clients_changed != 0)
-					{
-						// Rebuild our connected_clients vector.
-						connected_clients.clear();
+					// Avatars move, so update positions periodically, as well as when the set of connected clients changes.
+					if((server->connected_clients_changed != 0) || (voice_relay_clients_timer.elapsed() > VOICE_RELAY_CLIENTS_UPDATE_PERIOD))
+						updateVoiceRelayClients(socket_is_IPv6);
 
-						{
-							Lock lock(server->connected_clients_mutex);
+					// Relay packet to clients in the same world, within hearing range of the sender.
+					recipients.clear();
+					voice_relay.getRecipients(sender_ip_addr, sender_port, recipients);
 
-							for(auto it = server->connected_clients.begin(); it != server->connected_clients.end(); ++it)
-								if(it->second.client_UDP_port > 0) // If remote UDP port is known:
-									connected_clients.push_back(ConnectedClientInfo({it->second.ip_addr, it->second.client_UDP_port}));
+					if(num_packets_rcvd % 512 == 0) // Log occasional packets:
+						conPrint("UDPHandlerThread: Relaying packet to " + toString(recipients.size()) + " client(s)");
 
-							server->connected_clients_changed = 0;
-						}
-					}
-
-					// Broadcast packet to clients
-					for(size_t i=0; i<connected_clients.size(); ++i)
-					{
-						if(num_packets_rcvd % 512 == 0) // Log occasional packets:
-							conPrint("UDPHandlerThread: Sending packet to " + connected_clients[i].ip_addr.toString() + ", port " + toString(connected_clients[i].client_UDP_port) + " ...");
-
-						udp_socket->sendPacket(packet_buf.data(), packet_len, connected_clients[i].ip_addr, connected_clients[i].client_UDP_port);
-					}
+					VoiceRelay::sendPacketToClients(*udp_socket, packet_buf.data(), packet_len, recipients);
 				}
 				else if(type == 2)
 				{
@@ -90,7 +150,12 @@ void UDPHandlerThread::doRun()
 						UID client_avatar_uid;
 						std::memcpy(&client_avatar_uid, packet_buf.data() + 4, sizeof(UID));
 
-						server->clientUDPPortBecameKnown(client_avatar_uid, sender_ip_addr, sender_port);
+						// Clients with protocol version >= 41 append the number of transform datagrams they have received.
+						uint32 num_transform_datagrams_received = 0;
+						if(packet_len >= sizeof(uint32) + sizeof(UID) + sizeof(uint32))
+							std::memcpy(&num_transform_datagrams_received, packet_buf.data() + 4 + sizeof(UID), sizeof(uint32));
+
+						server->clientUDPPortBecameKnown(client_avatar_uid, sender_ip_addr, sender_port, num_transform_datagrams_received);
 					}
 				}
 			}
@@ -105,6 +170,12 @@ void UDPHandlerThread::doRun()
 		conPrint("UDPHandlerThread: Caught std::bad_alloc.");
 	}
 
+	{
+		Lock lock(server->udp_send_socket_mutex);
+		if(server->udp_send_socket.ptr() == udp_socket.ptr())
+			server->udp_send_socket = NULL;
+	}
+
 	udp_socket = NULL;
 
 	conPrint("UDPHandlerThread: terminating.");
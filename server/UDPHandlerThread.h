@@ -6,35 +6,38 @@ Copyright Glare Technologies Limited 2023 -
 #pragma once
 
 
+#include "VoiceRelay.h"
 #include <MessageableThread.h>
 #include <UDPSocket.h>
 #include <IPAddress.h>
+#include <Timer.h>
 #include <vector>
 class Server;
 
 
-struct ConnectedClientInfo
-{
-	IPAddress ip_addr;
-	int client_UDP_port;
-};
-
-
 /*=====================================================================
 UDPHandlerThread
 ----------------
-Handles UDP messages from clients, sends back to connected clients.
+Handles UDP messages from clients, relays voice packets to connected clients.
+
+If reuse_port is true, the socket is bound with SO_REUSEPORT, so several
+UDPHandlerThreads can share the server UDP port (Linux only).
 =====================================================================*/
 class UDPHandlerThread : public MessageableThread
 {
 public:
-	UDPHandlerThread(Server* server);
+	UDPHandlerThread(Server* server, bool reuse_port);
 	~UDPHandlerThread();
 
 	void doRun() override;
 
 private:
-	std::vector<ConnectedClientInfo> connected_clients;
+	void updateVoiceRelayClients(bool socket_is_IPv6);
+
+	VoiceRelay voice_relay;
+	Timer voice_relay_clients_timer; // Time since the voice relay clients were updated.
+	std::vector<const VoiceRelayClient*> recipients;
 	Reference<UDPSocket> udp_socket;
 	Server* server;
+	bool reuse_port;
 };
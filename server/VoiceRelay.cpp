@@ -0,0 +1,419 @@
+/*=====================================================================
+VoiceRelay.cpp
+--------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "VoiceRelay.h"
+
+
+#include <UDPSocket.h>
+#include <cstring>
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#endif
+
+
+VoiceRelay::VoiceRelay()
+:	hearing_radius(0)
+{
+}
+
+
+VoiceRelay::~VoiceRelay()
+{
+}
+
+
+std::string VoiceRelay::addressKey(const IPAddress& ip_addr, int port)
+{
+	return IPAddress::formatIPAddressAndPort(ip_addr, port);
+}
+
+
+#if defined(__linux__)
+// Makes a destination address for sendmmsg.  Sets sock_addr_len_out to 0 if the address can't be used with the socket.
+static void makeSockAddr(const IPAddress& ip_addr, int port, bool socket_is_IPv6, sockaddr_storage& sock_addr_out, socklen_t& sock_addr_len_out)
+{
+	std::memset(&sock_addr_out, 0, sizeof(sock_addr_out));
+	sock_addr_len_out = 0;
+
+	const std::string ip_str = ip_addr.toString();
+	in6_addr addr6;
+	in_addr addr4;
+	if(inet_pton(AF_INET6, ip_str.c_str(), &addr6) == 1)
+	{
+		if(socket_is_IPv6)
+		{
+			sockaddr_in6* a = (sockaddr_in6*)&sock_addr_out;
+			a->sin6_family = AF_INET6;
+			a->sin6_port = htons((uint16)port);
+			a->sin6_addr = addr6;
+			sock_addr_len_out = sizeof(sockaddr_in6);
+		}
+	}
+	else if(inet_pton(AF_INET, ip_str.c_str(), &addr4) == 1)
+	{
+		if(socket_is_IPv6) // Use an IPv4-mapped IPv6 address (::ffff:a.b.c.d) with dual-stack sockets.
+		{
+			sockaddr_in6* a = (sockaddr_in6*)&sock_addr_out;
+			a->sin6_family = AF_INET6;
+			a->sin6_port = htons((uint16)port);
+			a->sin6_addr.s6_addr[10] = 0xFF;
+			a->sin6_addr.s6_addr[11] = 0xFF;
+			std::memcpy(&a->sin6_addr.s6_addr[12], &addr4, 4);
+			sock_addr_len_out = sizeof(sockaddr_in6);
+		}
+		else
+		{
+			sockaddr_in* a = (sockaddr_in*)&sock_addr_out;
+			a->sin_family = AF_INET;
+			a->sin_port = htons((uint16)port);
+			a->sin_addr = addr4;
+			sock_addr_len_out = sizeof(sockaddr_in);
+		}
+	}
+}
+#endif
+
+
+void VoiceRelay::setClients(const std::vector<VoiceRelayClient>& new_clients, bool socket_is_IPv6)
+{
+	clients = new_clients;
+	address_to_client_index.clear();
+	world_client_indices.clear();
+
+	for(size_t i=0; i<clients.size(); ++i)
+	{
+		VoiceRelayClient& client = clients[i];
+#if defined(__linux__)
+		makeSockAddr(client.ip_addr, client.UDP_port, socket_is_IPv6, client.sock_addr, client.sock_addr_len);
+#endif
+		address_to_client_index[addressKey(client.ip_addr, client.UDP_port)] = i;
+		world_client_indices[client.world_name].push_back(i);
+	}
+}
+
+
+const VoiceRelayClient* VoiceRelay::findClientForAddress(const IPAddress& ip_addr, int port) const
+{
+	auto res = address_to_client_index.find(addressKey(ip_addr, port));
+	if(res == address_to_client_index.end())
+		return NULL;
+	return &clients[res->second];
+}
+
+
+void VoiceRelay::getRecipients(const IPAddress& sender_ip_addr, int sender_port, std::vector<const VoiceRelayClient*>& recipients_out) const
+{
+	const VoiceRelayClient* sender = findClientForAddress(sender_ip_addr, sender_port);
+	if(!sender) // Drop packets from unknown addresses, we don't know what world they are in.
+		return;
+
+	auto world_res = world_client_indices.find(sender->world_name);
+	assert(world_res != world_client_indices.end());
+	if(world_res == world_client_indices.end())
+		return;
+
+	// If we don't know where the sender or the recipient is, don't filter by distance.
+	const bool filter_by_dist = (hearing_radius > 0) && sender->avatar_pos_known;
+	const double hearing_radius2 = hearing_radius * hearing_radius;
+
+	const std::vector<size_t>& indices = world_res->second;
+	for(size_t i=0; i<indices.size(); ++i)
+	{
+		const VoiceRelayClient* client = &clients[indices[i]];
+		if(client == sender)
+			continue;
+
+		if(filter_by_dist && client->avatar_pos_known && (client->avatar_pos.getDist2(sender->avatar_pos) > hearing_radius2))
+			continue;
+
+		recipients_out.push_back(client);
+	}
+}
+
+
+size_t VoiceRelay::sendPacketToClients(UDPSocket& socket, const void* data, size_t data_len, const std::vector<const VoiceRelayClient*>& recipients)
+{
+	size_t num_syscalls = 0;
+
+#if defined(__linux__)
+	const int MAX_BATCH_SIZE = 64;
+	mmsghdr msgs[MAX_BATCH_SIZE];
+	iovec iov;
+	iov.iov_base = (void*)data;
+	iov.iov_len = data_len;
+
+	size_t i = 0;
+	while(i < recipients.size())
+	{
+		// Fill in a batch of messages
+		int batch_size = 0;
+		for(; (i < recipients.size()) && (batch_size < MAX_BATCH_SIZE); ++i)
+		{
+			const VoiceRelayClient* client = recipients[i];
+			if(client->sock_addr_len == 0) // If we couldn't make a sockaddr for this client, just send with the UDPSocket.
+			{
+				socket.sendPacket(data, data_len, client->ip_addr, client->UDP_port);
+				num_syscalls++;
+				continue;
+			}
+
+			mmsghdr& msg = msgs[batch_size++];
+			std::memset(&msg, 0, sizeof(msg));
+			msg.msg_hdr.msg_name = (void*)&client->sock_addr;
+			msg.msg_hdr.msg_namelen = client->sock_addr_len;
+			msg.msg_hdr.msg_iov = &iov;
+			msg.msg_hdr.msg_iovlen = 1;
+		}
+
+		// Send the batch
+		int num_sent = 0;
+		while(num_sent < batch_size)
+		{
+			const int res = sendmmsg((int)socket.getSocketHandle(), msgs + num_sent, batch_size - num_sent, /*flags=*/0);
+			num_syscalls++;
+			if(res < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				num_sent++; // Sending the first message in the remaining batch failed (e.g. host unreachable).  Skip it and carry on with the rest.
+			}
+			else
+				num_sent += res;
+		}
+	}
+#else
+	for(size_t i=0; i<recipients.size(); ++i)
+	{
+		socket.sendPacket(data, data_len, recipients[i]->ip_addr, recipients[i]->UDP_port);
+		num_syscalls++;
+	}
+#endif
+
+	return num_syscalls;
+}
+
+
+bool VoiceRelay::socketIsIPv6(UDPSocket& socket)
+{
+#if defined(__linux__)
+	sockaddr_storage addr;
+	socklen_t addr_len = sizeof(addr);
+	if(getsockname((int)socket.getSocketHandle(), (sockaddr*)&addr, &addr_len) != 0)
+		return true; // UDPSocket creates IPv6 sockets by default.
+	return addr.ss_family == AF_INET6;
+#else
+	return true;
+#endif
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <algorithm>
+
+
+static VoiceRelayClient makeClient(const std::string& ip, int port, uint64 avatar_uid, const std::string& world_name, const Vec3d& pos, bool pos_known = true)
+{
+	VoiceRelayClient client;
+	client.ip_addr = IPAddress(ip);
+	client.UDP_port = port;
+	client.avatar_uid = UID(avatar_uid);
+	client.world_name = world_name;
+	client.avatar_pos = pos;
+	client.avatar_pos_known = pos_known;
+	return client;
+}
+
+
+static std::vector<uint64> getRecipientAvatarUIDs(const VoiceRelay& relay, const std::string& ip, int port)
+{
+	std::vector<const VoiceRelayClient*> recipients;
+	relay.getRecipients(IPAddress(ip), port, recipients);
+	std::vector<uint64> uids;
+	for(size_t i=0; i<recipients.size(); ++i)
+		uids.push_back(recipients[i]->avatar_uid.value());
+	std::sort(uids.begin(), uids.end());
+	return uids;
+}
+
+
+void VoiceRelay::test()
+{
+	conPrint("VoiceRelay::test()");
+
+	//-------------------------- Test recipient selection --------------------------
+	{
+		std::vector<VoiceRelayClient> clients;
+		clients.push_back(makeClient("1.2.3.4", 1000, /*avatar uid=*/0, "",   Vec3d(0, 0, 0)));
+		clients.push_back(makeClient("1.2.3.4", 1001, /*avatar uid=*/1, "",   Vec3d(50, 0, 0))); // Same IP, different port.
+		clients.push_back(makeClient("1.2.3.5", 1000, /*avatar uid=*/2, "",   Vec3d(500, 0, 0)));
+		clients.push_back(makeClient("1.2.3.6", 1000, /*avatar uid=*/3, "w2", Vec3d(0, 0, 0)));
+		clients.push_back(makeClient("1.2.3.7", 1000, /*avatar uid=*/4, "",   Vec3d(0, 0, 0), /*pos known=*/false));
+
+		VoiceRelay relay;
+		relay.setClients(clients, /*socket is IPv6=*/true);
+		relay.setHearingRadius(100);
+		testAssert(relay.numClients() == 5);
+
+		testAssert(relay.findClientForAddress(IPAddress("1.2.3.4"), 1001)->avatar_uid == UID(1));
+		testAssert(relay.findClientForAddress(IPAddress("1.2.3.4"), 1002) == NULL);
+
+		// Not sent back to sender, not sent to other worlds or clients out of range.  Sent to clients with unknown positions.
+		testAssert(getRecipientAvatarUIDs(relay, "1.2.3.4", 1000) == std::vector<uint64>({1, 4}));
+		testAssert(getRecipientAvatarUIDs(relay, "1.2.3.5", 1000) == std::vector<uint64>({4}));
+		testAssert(getRecipientAvatarUIDs(relay, "1.2.3.6", 1000).empty()); // Only client in world w2.
+		testAssert(getRecipientAvatarUIDs(relay, "1.2.3.7", 1000) == std::vector<uint64>({0, 1, 2})); // Sender position unknown, send to whole world.
+		testAssert(getRecipientAvatarUIDs(relay, "9.9.9.9", 1000).empty()); // Unknown sender
+
+		relay.setHearingRadius(0); // No distance limit
+		testAssert(getRecipientAvatarUIDs(relay, "1.2.3.4", 1000) == std::vector<uint64>({1, 2, 4}));
+
+		relay.setClients(std::vector<VoiceRelayClient>(), /*socket is IPv6=*/true);
+		testAssert(getRecipientAvatarUIDs(relay, "1.2.3.4", 1000).empty());
+	}
+
+	try
+	{
+		//-------------------------- Test relaying over loopback --------------------------
+		{
+			Reference<UDPSocket> server_socket = new UDPSocket();
+			server_socket->bindToPort(0);
+
+			const int num_clients = 4;
+			std::vector<Reference<UDPSocket>> client_sockets(num_clients);
+			std::vector<VoiceRelayClient> clients;
+			for(int i=0; i<num_clients; ++i)
+			{
+				client_sockets[i] = new UDPSocket();
+				client_sockets[i]->bindToPort(0);
+				clients.push_back(makeClient("127.0.0.1", client_sockets[i]->getThisEndPort(), /*avatar uid=*/i, /*world name=*/(i == 3) ? "w2" : "", Vec3d(0, 0, 0)));
+			}
+
+			VoiceRelay relay;
+			relay.setClients(clients, socketIsIPv6(*server_socket));
+
+			const uint32 voice_packet[3] = { 1, 0, 123 }; // type, avatar id, seq num
+			std::vector<const VoiceRelayClient*> recipients;
+			relay.getRecipients(IPAddress("127.0.0.1"), client_sockets[0]->getThisEndPort(), recipients);
+			testAssert(recipients.size() == 2);
+			sendPacketToClients(*server_socket, voice_packet, sizeof(voice_packet), recipients);
+
+			// Send a terminator packet directly to each client, so we can check which clients got the voice packet without needing non-blocking reads.
+			const uint32 terminator_packet[1] = { 2 };
+			for(int i=0; i<num_clients; ++i)
+				server_socket->sendPacket(terminator_packet, sizeof(terminator_packet), IPAddress("127.0.0.1"), client_sockets[i]->getThisEndPort());
+
+			for(int i=0; i<num_clients; ++i)
+			{
+				uint32 buf[16];
+				IPAddress sender_ip;
+				int sender_port;
+				size_t len = client_sockets[i]->readPacket(buf, sizeof(buf), sender_ip, sender_port);
+				testAssert(sender_port == server_socket->getThisEndPort());
+
+				const bool should_receive_voice = (i == 1) || (i == 2);
+				if(should_receive_voice)
+				{
+					testAssert(len == sizeof(voice_packet) && std::memcmp(buf, voice_packet, sizeof(voice_packet)) == 0);
+					len = client_sockets[i]->readPacket(buf, sizeof(buf), sender_ip, sender_port);
+				}
+				testAssert(len == sizeof(terminator_packet) && buf[0] == 2);
+			}
+		}
+
+		//-------------------------- Perf test: relaying voice packets to 1000 fake clients over loopback --------------------------
+		// All fake clients use the same receiving socket, with different loopback addresses (127.0.x.y), so we don't need 1000 sockets.
+		// The receiving socket is not read from, so most packets will be dropped once its buffer is full, which doesn't affect the sending cost.
+		{
+			Reference<UDPSocket> server_socket = new UDPSocket();
+			server_socket->bindToPort(0);
+			Reference<UDPSocket> receiving_socket = new UDPSocket();
+			receiving_socket->bindToPort(0);
+			const int receiving_port = receiving_socket->getThisEndPort();
+
+			PCG32 rng(1);
+			const int num_clients = 1000;
+			std::vector<VoiceRelayClient> clients;
+			for(int i=0; i<num_clients; ++i)
+			{
+				const std::string ip = "127.0." + toString(i / 250) + "." + toString(1 + i % 250);
+				const std::string world_name = (i < num_clients / 2) ? "" : ("world" + toString(i % 4)); // Half the clients in the main world, the rest spread over 4 personal worlds.
+				clients.push_back(makeClient(ip, receiving_port, i, world_name, Vec3d(-1000 + rng.unitRandom() * 2000, -1000 + rng.unitRandom() * 2000, 0)));
+			}
+
+			VoiceRelay relay;
+			relay.setClients(clients, socketIsIPv6(*server_socket));
+			relay.setHearingRadius(200);
+
+			std::vector<uint8> packet(100, 0); // Roughly the size of an Opus voice packet.
+			const int num_packets = 100;
+			std::vector<const VoiceRelayClient*> recipients;
+
+			// Old approach: send to every client with a known UDP port, with one sendPacket call per client.
+			double old_time;
+			{
+				Timer timer;
+				for(int p=0; p<num_packets; ++p)
+					for(int i=0; i<num_clients; ++i)
+						server_socket->sendPacket(packet.data(), packet.size(), clients[i].ip_addr, clients[i].UDP_port);
+				old_time = timer.elapsed();
+			}
+
+			// Batched sends only, to the same set of clients (minus the sender).
+			double batched_time;
+			size_t batched_syscalls = 0;
+			{
+				std::vector<const VoiceRelayClient*> all_recipients;
+				for(int i=1; i<num_clients; ++i)
+					all_recipients.push_back(relay.findClientForAddress(clients[i].ip_addr, clients[i].UDP_port));
+
+				Timer timer;
+				for(int p=0; p<num_packets; ++p)
+					batched_syscalls += sendPacketToClients(*server_socket, packet.data(), packet.size(), all_recipients);
+				batched_time = timer.elapsed();
+			}
+
+			// Filtering by world and hearing radius, and batched sends.
+			double relay_time;
+			size_t relay_syscalls = 0;
+			size_t num_recipients = 0;
+			{
+				Timer timer;
+				for(int p=0; p<num_packets; ++p)
+				{
+					const VoiceRelayClient& sender = clients[rng.nextUInt(num_clients)];
+					recipients.clear();
+					relay.getRecipients(sender.ip_addr, sender.UDP_port, recipients);
+					num_recipients += recipients.size();
+					relay_syscalls += sendPacketToClients(*server_socket, packet.data(), packet.size(), recipients);
+				}
+				relay_time = timer.elapsed();
+			}
+
+			conPrint("Relaying " + toString(num_packets) + " voice packets with " + toString(num_clients) + " clients:");
+			conPrint("    sendPacket to all:        " + doubleToStringNSigFigs(old_time * 1.0e3, 4) + " ms (" + toString(num_packets * num_clients) + " syscalls)");
+			conPrint("    batched send to all:      " + doubleToStringNSigFigs(batched_time * 1.0e3, 4) + " ms (" + toString(batched_syscalls) + " syscalls)");
+			conPrint("    filtered + batched send:  " + doubleToStringNSigFigs(relay_time * 1.0e3, 4) + " ms (" + toString(relay_syscalls) + " syscalls, avg " +
+				doubleToStringNSigFigs((double)num_recipients / num_packets, 3) + " recipients / packet)");
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("VoiceRelay::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,90 @@
+/*=====================================================================
+VoiceRelay.h
+------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include <vec3.h>
+#include <IPAddress.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+class UDPSocket;
+
+
+// A client whose UDP address is known, with the world it is connected to, and the position of its avatar.
+struct VoiceRelayClient
+{
+	VoiceRelayClient() : UDP_port(-1), avatar_pos_known(false) {}
+
+	IPAddress ip_addr;
+	int UDP_port;
+	UID avatar_uid;
+	std::string world_name;
+	Vec3d avatar_pos;
+	bool avatar_pos_known;
+
+#if defined(__linux__)
+	// Destination address for sendmmsg, set in VoiceRelay::setClients().
+	sockaddr_storage sock_addr;
+	socklen_t sock_addr_len;
+#endif
+};
+
+
+/*=====================================================================
+VoiceRelay
+----------
+Decides which clients a voice packet should be relayed to, and sends it to
+them.
+
+Holds a snapshot of the connected clients, which the UDPHandlerThread
+refreshes periodically.  The sender of a packet is found by its remote
+address with a hash map lookup.  The packet is relayed to the other clients
+in the same world, within the hearing radius of the sender's avatar.
+Packets are never sent back to the sender, and packets from unknown
+addresses are dropped.
+
+On Linux, the packet is sent to all recipients with batched sendmmsg calls.
+
+Not threadsafe, each UDPHandlerThread has its own VoiceRelay.
+=====================================================================*/
+class VoiceRelay
+{
+public:
+	VoiceRelay();
+	~VoiceRelay();
+
+	void setHearingRadius(double r) { hearing_radius = r; } // 0 = no distance limit, relay to all clients in the same world.
+
+	// socket_is_IPv6: is the socket that packets will be sent with an IPv6 (dual-stack) socket?  See socketIsIPv6().
+	void setClients(const std::vector<VoiceRelayClient>& clients, bool socket_is_IPv6);
+
+	const VoiceRelayClient* findClientForAddress(const IPAddress& ip_addr, int port) const; // Returns NULL if not found.
+
+	// Appends the clients that a voice packet from the given address should be relayed to, to recipients_out.
+	void getRecipients(const IPAddress& sender_ip_addr, int sender_port, std::vector<const VoiceRelayClient*>& recipients_out) const;
+
+	// Sends the packet to each recipient.  Returns the number of send syscalls made.
+	static size_t sendPacketToClients(UDPSocket& socket, const void* data, size_t data_len, const std::vector<const VoiceRelayClient*>& recipients);
+
+	static bool socketIsIPv6(UDPSocket& socket);
+
+	size_t numClients() const { return clients.size(); }
+
+	static void test();
+
+private:
+	static std::string addressKey(const IPAddress& ip_addr, int port);
+
+	double hearing_radius;
+	std::vector<VoiceRelayClient> clients;
+	std::unordered_map<std::string, size_t> address_to_client_index; // Map from address key (see addressKey()) to index in clients.
+	std::unordered_map<std::string, std::vector<size_t>> world_client_indices; // Map from world name to indices of clients connected to that world.
+};
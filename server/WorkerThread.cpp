@@ -11,6 +11,7 @@ Copyright Glare Technologies Limited 2018 -
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
 #include "MeshLODGenThread.h"
+#include "MapTilePyramid.h"
 #include "../webserver/LoginHandlers.h"
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
@@ -51,8 +52,18 @@ static const bool CAPTURE_TRACES = false; // If true, records a trace of data re
 
 
 WorkerThread::WorkerThread(const Reference<SocketInterface>& socket_, Server* server_)
-:	socket(socket_),
+:	client_protocol_version(0),
+	received_goodbye(false),
+	nonblocking_send_buf(NULL),
+	socket(socket_),
 	server(server_),
+	world_state(server_->world_state.getPointer()),
+	handshake_already_done(false),
+	handshake_connection_type(0),
+	client_avatar_uid(0),
+	client_user_id(UserID::invalidUserID()),
+	client_user_flags(0),
+	logged_in_user_is_lightmapper_bot(false),
 	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
 	fuzzing(false),
 	write_trace(false)
@@ -110,30 +121,16 @@ void WorkerThread::sendGetFileMessageIfNeeded(const std::string& resource_URL)
 }
 
 
-static void writeErrorMessageToClient(SocketInterfaceRef& socket, const std::string& msg)
-{
-	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-	MessageUtils::initPacket(packet, Protocol::ErrorMessageID);
-	packet.writeStringLengthFirst(msg);
-	MessageUtils::updatePacketLengthField(packet);
-
-	socket->writeData(packet.buf.data(), packet.buf.size());
-	socket->flush();
-}
-
-
-// Enqueues packet to all WorkerThreads to send to all clients connected to the server.
+// Enqueues packet to all WorkerThreads and epoll clients, to send to all clients connected to the server.
+// The packet data is copied once, and shared between the WorkerThreads.
 static void enqueuePacketToBroadcast(const SocketBufferOutStream& packet_buffer, Server* server)
 {
 	assert(packet_buffer.buf.size() > 0);
 	if(packet_buffer.buf.size() > 0)
 	{
-		Lock lock(server->worker_thread_manager.getMutex());
-		for(auto i = server->worker_thread_manager.getThreads().begin(); i != server->worker_thread_manager.getThreads().end(); ++i)
-		{
-			assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-			static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(packet_buffer);
-		}
+		const SharedPacketRef packet = SharedPacket::make(packet_buffer);
+
+		server->enqueuePacketToAllClients(packet);
 	}
 }
 
@@ -301,24 +298,8 @@ void WorkerThread::handleResourceUploadConnection()
 		{
 			std::vector<UID> ob_uids; // UIDs of objects which use this resource
 			{
-				Lock lock(server->world_state->mutex);
-				for(auto world_it = server->world_state->world_states.begin(); world_it != server->world_state->world_states.end(); ++world_it)
-				{
-					ServerWorldState* world = world_it->second.ptr();
-
-					std::set<DependencyURL> URLs;
-					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
-					{
-						const WorldObject* ob = it->second.ptr();
-						URLs.clear();
-						ob->getDependencyURLSetForAllLODLevels(URLs);
-
-						if(URLs.count(DependencyURL(URL)) > 0) // If the object uses the resource with this URL:
-						{
-							ob_uids.push_back(ob->uid);
-						}
-					}
-				}
+				Lock lock(server->world_state->object_URL_index_mutex);
+				server->world_state->object_URL_index.getObjectsUsingURL(URL, ob_uids);
 			}
 
 			for(size_t i=0; i<ob_uids.size(); ++i)
@@ -480,10 +461,12 @@ void WorkerThread::handleScreenshotBotConnection()
 				if(screenshot.isNull())
 				{
 					// Find first screenshot in map_tile_info map in ScreenshotState_notdone state.  NOTE: slow linear scan.
+					// Tiles that can be built from their child tiles are built by MapTilePyramidThread instead.
 					for(auto it = server->world_state->map_tile_info.info.begin(); it != server->world_state->map_tile_info.info.end(); ++it)
 					{
 						TileInfo& tile_info = it->second;
-						if(tile_info.cur_tile_screenshot.nonNull() && tile_info.cur_tile_screenshot->state == Screenshot::ScreenshotState_notdone)
+						if(tile_info.cur_tile_screenshot.nonNull() && tile_info.cur_tile_screenshot->state == Screenshot::ScreenshotState_notdone &&
+							MapTilePyramid::isRenderedTile(server->world_state->map_tile_info, it->first))
 						{
 							screenshot = tile_info.cur_tile_screenshot;
 							break;
@@ -567,15 +550,21 @@ void WorkerThread::handleScreenshotBotConnection()
 					}
 
 
-					screenshot->state = Screenshot::ScreenshotState_done;
-					screenshot->local_path = screenshot_path;
-
 					{
 						Lock lock(server->world_state->mutex);
+
+						screenshot->state = Screenshot::ScreenshotState_done;
+						screenshot->local_path = screenshot_path;
+
 						server->world_state->addScreenshotAsDBDirty(screenshot);
 
 						if(screenshot->is_map_tile) // If we received a tile screenshot, mark map tile info as dirty to get it saved.
+						{
 							server->world_state->map_tile_info.db_dirty = true;
+
+							// The coarser tiles containing this tile need to be rebuilt from it.
+							MapTilePyramid::markAncestorTilesAsChanged(*server->world_state, Vec3<int>(screenshot->tile_x, screenshot->tile_y, screenshot->tile_z));
+						}
 					}
 				}
 				else
@@ -677,12 +666,14 @@ void WorkerThread::handleEthBotConnection()
 
 						server->world_state->addSubEthTransactionAsDBDirty(trans);
 
-						auto parcel_res = server->world_state->getRootWorldState()->parcels.find(trans->parcel_id);
-						if(parcel_res != server->world_state->getRootWorldState()->parcels.end())
+						ServerWorldState* root_world = server->world_state->getRootWorldState().ptr();
+						Lock root_world_lock(root_world->mutex);
+						auto parcel_res = root_world->parcels.find(trans->parcel_id);
+						if(parcel_res != root_world->parcels.end())
 						{
 							Parcel* parcel = parcel_res->second.ptr();
 							parcel->nft_status = Parcel::NFTStatus_MintedNFT;
-							server->world_state->getRootWorldState()->addParcelAsDBDirty(parcel);
+							root_world->addParcelAsDBDirty(parcel);
 							server->world_state->markAsChanged();
 						}
 					} // End lock scope
@@ -731,20 +722,11 @@ static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject&
 {
 	assert(user_id.valid());
 
-	const Vec4f ob_pos = ob.pos.toVec4fPoint();
-
-	for(auto& it : world_state.parcels)
-	{
-		const Parcel* parcel = it.second.ptr();
-		if(parcel->pointInParcel(ob_pos) && parcel->userHasWritePerms(user_id))
-			return true;
-	}
-
-	return false;
+	return world_state.getParcelSpatialIndex().pointInParcelWithWritePerms(ob.pos.toVec4fPoint(), user_id);
 }
 
 
-// NOTE: world state mutex should be locked before calling this method.
+// NOTE: the world mutex should be locked before calling this method.
 static bool userHasObjectWritePermissions(const WorldObject& ob, const UserID& user_id, const std::string& user_name, const std::string& connected_world_name, ServerWorldState& world_state, bool allow_light_mapper_bot_full_perms)
 {
 	if(user_id.valid())
@@ -768,7 +750,7 @@ static bool userConnectedToTheirPersonalWorldOrGodUser(const UserID& user_id, co
 
 
 // This is for editing the parcel itself.
-// NOTE: world state mutex should be locked before calling this method.
+// NOTE: the world mutex should be locked before calling this method.
 static bool userHasParcelWritePermissions(const Parcel& parcel, const UserID& user_id, const std::string& connected_world_name, ServerWorldState& world_state)
 {
 	if(user_id.valid())
@@ -788,37 +770,22 @@ static float maxAudioVolumeForObject(const WorldObject& ob, const UserID& user_i
 }
 
 
-void WorkerThread::doRun()
-{
-	PlatformUtils::setCurrentThreadNameIfTestsEnabled("WorkerThread");
+// NOTE: readHandshake(), connectToWorld() and handleUpdatesMessage() were split out of doRun(), and keep the indentation they had there, to keep the history readable.
 
 
-	if(CAPTURE_TRACES)
-		socket.downcastToPtr<RecordingSocket>()->clearRecordBuf();
-
-	ServerAllWorldsState* world_state = server->world_state.getPointer();
-
-	UID client_avatar_uid(0);
-	UserID client_user_id = UserID::invalidUserID(); // Will be an invalid reference if client is not logged in, otherwise will refer to the user account the client is logged in to.
-	std::string client_user_name;
-	AvatarSettings client_user_avatar_settings;
-	uint32 client_user_flags = 0;
-
-	Reference<ServerWorldState> cur_world_state; // World the client is connected to.
-	bool logged_in_user_is_lightmapper_bot = false; // Just for updating the last_lightmapper_bot_contact_time.
-
-	try
-	{
+// Reads the hello message, protocol version and connection type from the client, and writes the responses.  Returns the connection type.
+uint32 WorkerThread::readHandshake()
+{
 		// Read hello bytes
 		const uint32 hello = socket->readUInt32();
 		if(hello != Protocol::CyberspaceHello)
 			throw glare::Exception("Received invalid hello message (" + toString(hello) + ") from client.");
-		
+	
 		// Write hello response
 		socket->writeUInt32(Protocol::CyberspaceHello);
 
 		// Read protocol version
-		const uint32 client_protocol_version = socket->readUInt32();
+		client_protocol_version = socket->readUInt32();
 		conPrintIfNotFuzzing("client protocol version: " + toString(client_protocol_version));
 		if(client_protocol_version < 38) // We can't handle protocol versions < 38
 		{
@@ -837,7 +804,28 @@ void WorkerThread::doRun()
 
 		socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
 
-		const uint32 connection_type = socket->readUInt32();
+		return socket->readUInt32(); // Read connection type
+}
+
+
+void WorkerThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("WorkerThread");
+
+
+	if(CAPTURE_TRACES)
+		socket.downcastToPtr<RecordingSocket>()->clearRecordBuf();
+
+	try
+	{
+		if(!unsent_handshake_data.empty())
+		{
+			socket->writeData(unsent_handshake_data.data(), unsent_handshake_data.size());
+			socket->flush();
+			unsent_handshake_data.clear();
+		}
+
+		const uint32 connection_type = handshake_already_done ? handshake_connection_type : readHandshake();
 	
 		if(connection_type == Protocol::ConnectionTypeUploadResource)
 		{
@@ -862,8 +850,133 @@ void WorkerThread::doRun()
 
 			// Read name of world to connect to
 			const std::string world_name = socket->readStringLengthFirst(1000);
+
+			connectToWorld(world_name);
+
+			assert(cur_world_state.nonNull());
+
+
+			socket->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
+
+			while(!received_goodbye) // write to / read from socket loop
+			{
+				// See if we have any pending data to send in the send queue, and if so, send all pending data.
+				if(VERBOSE) conPrint("WorkerThread: checking for pending data to send...");
+
+				// If the client couldn't keep up with the data we are sending it, even after superseded transform updates were coalesced, disconnect it.
+				if(send_queue.hasOverflowed())
+					throw glare::Exception("Send queue for client went over the hard limit, disconnecting slow client.");
+
+				// We don't want to do network writes while holding the send queue mutex.  So take the packets off the queue first.
+				send_queue.takePackets(temp_packets_to_send);
+
+				if(!temp_packets_to_send.empty())
+				{
+					PacketSendQueue::writePackets(temp_packets_to_send, *socket, send_gather_buf);
+					socket->flush();
+					temp_packets_to_send.clear();
+				}
+
+
+#if defined(_WIN32) || defined(OSX)
+				if(socket->readable(0.05)) // If socket has some data to read from it:
+#else
+				if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means we have data to write.
+#endif
+				{
+					// Read msg type and length
+					uint32 msg_type_and_len[2];
+					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
+					const uint32 msg_type = msg_type_and_len[0];
+					const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
+
+					if((msg_len < sizeof(uint32) * 2) || (msg_len > MAX_MESSAGE_LEN))
+						throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+					// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
+
+					// Read entire message
+					msg_buffer.buf.resizeNoCopy(msg_len);
+					msg_buffer.read_index = sizeof(uint32) * 2;
+
+					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+
+					handleUpdatesMessage(msg_type);
+
+					if(received_goodbye)
+					{
+						conPrintIfNotFuzzing("WorkerThread: starting graceful shutdown..");
+						socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+						socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+						conPrintIfNotFuzzing("WorkerThread: waitForGracefulDisconnect done.");
+					}
+				}
+				else
+				{
+#if defined(_WIN32) || defined(OSX)
+#else
+					if(VERBOSE) conPrint("WorkerThread: event FD was signalled.");
+
+					// The event FD was signalled, which means there is some data to send on the socket.
+					// Reset the event fd by reading from it.
+					event_fd.read();
+
+					if(VERBOSE) conPrint("WorkerThread: event FD has been reset.");
+#endif
+				}
+			} // End write to / read from socket loop
+		} // End if(connection_type == Protocol::ConnectionTypeUpdates)
+		else
+		{
+			throw glare::Exception("Unknown connection_type: " + toString(connection_type));
+		}
+	}
+	catch(MySocketExcep& e)
+	{
+		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
+			conPrint("Updates client from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
+		else
+			conPrint("Socket error: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrintIfNotFuzzing("glare::Exception: " + e.what());
+	}
+	catch(std::bad_alloc&)
+	{
+		conPrint("WorkerThread: Caught std::bad_alloc.");
+	}
+
+
+	if(write_trace)
+		socket.downcastToPtr<RecordingSocket>()->writeRecordBufToDisk("traces/worker_thread_trace_" + ::toString(Clock::getTimeSinceInit()) + ".bin");
+
+	// Note that we want to do this after catching any exceptions, so the avatar is removed on broken connections etc.
+	connectionClosed();
+
+	// Remove thread-local OpenSSL error state, to avoid leaking it.
+	// NOTE: have to destroy socket first, before calling ERR_remove_thread_state(), otherwise memory will just be reallocated.
+	if(socket.nonNull())
+	{
+		assert(socket->getRefCount() == 1);
+	}
+	socket = NULL;
+	ERR_remove_thread_state(/*thread id=*/NULL); // Set thread ID to null to use current thread.
+}
+
+
+void WorkerThread::setHandshakeAlreadyDone(uint32 client_protocol_version_, uint32 connection_type, const uint8* unsent_handshake_data_, size_t unsent_handshake_data_len)
+{
+	handshake_already_done = true;
+	client_protocol_version = client_protocol_version_;
+	handshake_connection_type = connection_type;
+	unsent_handshake_data.assign(unsent_handshake_data_, unsent_handshake_data_ + unsent_handshake_data_len);
+}
+
+
+void WorkerThread::connectToWorld(const std::string& world_name)
+{
 			conPrintIfNotFuzzing("Client connecting to world '" + world_name + "'...");
-			
 
 			{
 				Lock lock(world_state->mutex);
@@ -885,14 +998,16 @@ void WorkerThread::doRun()
 
 			// Write avatar UID assigned to the connected client.
 			client_avatar_uid = world_state->getNextAvatarUID();
-			writeToStream(client_avatar_uid, *socket);
+			scratch_packet.buf.resize(0);
+			writeToStream(client_avatar_uid, scratch_packet);
+			writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
 
 			// If the client connected via a websocket, they can be logged in with a session cookie.
 			// Note that this may only work if the websocket connects over TLS.
 			{
 				Lock lock(world_state->mutex);
 				User* cookie_logged_in_user = LoginHandlers::getLoggedInUser(*world_state, this->websocket_request_info);
-	
+
 				if(cookie_logged_in_user != NULL)
 				{
 					client_user_id = cookie_logged_in_user->id;
@@ -912,8 +1027,8 @@ void WorkerThread::doRun()
 				scratch_packet.writeUInt32(client_user_flags);
 				MessageUtils::updatePacketLengthField(scratch_packet);
 
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-				socket->flush();
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+				flushToClient();
 			}
 
 			// Send TimeSyncMessage packet to client
@@ -921,7 +1036,7 @@ void WorkerThread::doRun()
 				MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
 				scratch_packet.writeDouble(server->getCurrentGlobalTime());
 				MessageUtils::updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
 			}
 
 			// Send a ServerAdminMessage to client if we have a non-empty message.
@@ -936,18 +1051,21 @@ void WorkerThread::doRun()
 				scratch_packet.writeStringLengthFirst(server_admin_msg);
 				MessageUtils::updatePacketLengthField(scratch_packet);
 
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-				socket->flush();
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+				flushToClient();
 			}
 
 			// Send world settings to client
 			{
 				MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsInitialSendMessage);
 
-				cur_world_state->world_settings.writeToStream(scratch_packet);
+				{
+					Lock lock(cur_world_state->mutex);
+					cur_world_state->world_settings.writeToStream(scratch_packet);
+				}
 
 				MessageUtils::updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
 			}
 
 
@@ -956,7 +1074,7 @@ void WorkerThread::doRun()
 				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
 				{ // Lock scope
-					Lock lock(world_state->mutex);
+					Lock lock(cur_world_state->mutex);
 					for(auto it = cur_world_state->avatars.begin(); it != cur_world_state->avatars.end(); ++it)
 					{
 						const Avatar* avatar = it->second.getPointer();
@@ -970,7 +1088,7 @@ void WorkerThread::doRun()
 					}
 				} // End lock scope
 
-				socket->writeData(packet.buf.data(), packet.buf.size());
+				writeToClient(packet.buf.data(), packet.buf.size());
 			}
 
 			// Send all current object data to client
@@ -984,7 +1102,7 @@ void WorkerThread::doRun()
 					SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 					packet.writeUInt32(Protocol::ObjectCreated);
 					ob->writeToNetworkStream(packet);
-					socket->writeData(packet.buf.data(), packet.buf.size());
+					writeToClient(packet.buf.data(), packet.buf.size());
 				}
 			}*/
 
@@ -993,7 +1111,7 @@ void WorkerThread::doRun()
 				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
 				{ // Lock scope
-					Lock lock(world_state->mutex);
+					Lock lock(cur_world_state->mutex);
 					for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
 					{
 						const Parcel* parcel = it->second.getPointer();
@@ -1007,90 +1125,41 @@ void WorkerThread::doRun()
 					}
 				} // End lock scope
 
-				socket->writeData(packet.buf.data(), packet.buf.size());
-				socket->flush();
+				writeToClient(packet.buf.data(), packet.buf.size());
+				flushToClient();
 			}
 
 			// Send a message saying we have sent all initial state
 			/*{
 				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 				packet.writeUInt32(Protocol::InitialStateSent);
-				socket->writeData(packet.buf.data(), packet.buf.size());
+				writeToClient(packet.buf.data(), packet.buf.size());
 			}*/
+}
 
 
-			assert(cur_world_state.nonNull());
-
-
-			socket->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
-
-			bool keep_looping = true;
-			while(keep_looping) // write to / read from socket loop
-			{
-				// See if we have any pending data to send in the data_to_send queue, and if so, send all pending data.
-				if(VERBOSE) conPrint("WorkerThread: checking for pending data to send...");
-
-				// We don't want to do network writes while holding the data_to_send_mutex.  So copy to temp_data_to_send.
-				{
-					Lock lock(data_to_send_mutex);
-					temp_data_to_send = data_to_send;
-					data_to_send.clear();
-				}
-
-				if(temp_data_to_send.nonEmpty())
-				{
-					socket->writeData(temp_data_to_send.data(), temp_data_to_send.size());
-					socket->flush();
-					temp_data_to_send.clear();
-				}
-
-
-				if(logged_in_user_is_lightmapper_bot)
-				{
-					Lock lock(server->world_state->mutex);
-					server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
-				}
-
-
-#if defined(_WIN32) || defined(OSX)
-				if(socket->readable(0.05)) // If socket has some data to read from it:
-#else
-				if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means we have data to write.
-#endif
-				{
-					// Read msg type and length
-					uint32 msg_type_and_len[2];
-					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
-					const uint32 msg_type = msg_type_and_len[0];
-					const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
-
-					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
-						throw glare::Exception("Invalid message size: " + toString(msg_len));
-
-					// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
-
-					// Read entire message
-					msg_buffer.buf.resizeNoCopy(msg_len);
-					msg_buffer.read_index = sizeof(uint32) * 2;
-
-					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+// Handles a message from a client connected with ConnectionTypeUpdates.  The message has been read into msg_buffer, with msg_buffer.read_index just past the type and length fields.
+void WorkerThread::handleUpdatesMessage(uint32 msg_type)
+{
+					if(logged_in_user_is_lightmapper_bot)
+					{
+						Lock lock(server->world_state->mutex);
+						server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
+					}
 
 					switch(msg_type)
 					{
 					case Protocol::CyberspaceGoodbye:
 						{
-							conPrintIfNotFuzzing("WorkerThread: received CyberspaceGoodbye, starting graceful shutdown..");
-							socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
-							socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
-							conPrintIfNotFuzzing("WorkerThread: waitForGracefulDisconnect done.");
-							keep_looping = false;
+							conPrintIfNotFuzzing("WorkerThread: received CyberspaceGoodbye.");
+							received_goodbye = true; // The caller will shut down the connection.
 							break;
 						}
 					case Protocol::ClientUDPSocketOpen:
 						{
 							conPrint("WorkerThread: received Protocol::ClientUDPSocketOpen");
 							//const uint32 client_UDP_port = msg_buffer.readUInt32();
-							server->clientUDPPortOpen(this, socket->getOtherEndIPAddress(), client_avatar_uid);
+							server->clientUDPPortOpen(this, getClientIPAddress(), client_avatar_uid, this->connected_world_name);
 							break;
 						}
 					case Protocol::AudioStreamToServerStarted:
@@ -1141,7 +1210,7 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								Lock lock(cur_world_state->mutex);
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
@@ -1153,6 +1222,9 @@ void WorkerThread::doRun()
 
 									//conPrint("updated avatar transform");
 								}
+
+								if(avatar_uid == client_avatar_uid)
+									interest_state.setPos(pos); // Use our avatar position as the centre of our area of interest.
 							}
 							break;
 						}
@@ -1166,7 +1238,7 @@ void WorkerThread::doRun()
 
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to perform a gesture.");
+								sendErrorMessageToClient("You must be logged in to perform a gesture.");
 							}
 							else
 							{
@@ -1187,7 +1259,7 @@ void WorkerThread::doRun()
 
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to stop a gesture.");
+								sendErrorMessageToClient("You must be logged in to stop a gesture.");
 							}
 							else
 							{
@@ -1210,7 +1282,8 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								Lock lock(world_state->mutex); // Needed for the user data.
+								Lock world_lock(cur_world_state->mutex);
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
@@ -1260,7 +1333,7 @@ void WorkerThread::doRun()
 							conPrintIfNotFuzzing("received Protocol::CreateAvatar");
 							// Note: name will come from user account
 							// will use the client_avatar_uid that we assigned to the client
-						
+		
 							Avatar temp_avatar;
 							temp_avatar.uid = readUIDFromStream(msg_buffer); // Will be replaced.
 							readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
@@ -1272,7 +1345,7 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								Lock lock(cur_world_state->mutex);
 								auto res = cur_world_state->avatars.find(use_avatar_uid);
 								if(res == cur_world_state->avatars.end())
 								{
@@ -1308,7 +1381,7 @@ void WorkerThread::doRun()
 
 							// Mark avatar as dead
 							{
-								Lock lock(world_state->mutex);
+								Lock lock(cur_world_state->mutex);
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
@@ -1328,7 +1401,7 @@ void WorkerThread::doRun()
 							const uint32 seat_index = msg_buffer.readUInt32();
 							const uint32 flags = msg_buffer.readUInt32();
 
-							
+			
 							// Enqueue AvatarEnteredVehicle messages to worker threads to send
 							MessageUtils::initPacket(scratch_packet, Protocol::AvatarEnteredVehicle);
 							writeToStream(avatar_uid, scratch_packet);
@@ -1366,18 +1439,18 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+								sendErrorMessageToClient("You must be logged in to modify an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								sendErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								std::string err_msg_to_client;
 								// Look up existing object in world state
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1392,11 +1465,12 @@ void WorkerThread::doRun()
 											ob->axis = axis;
 											ob->angle = angle;
 											ob->scale = scale;
+											cur_world_state->object_spatial_index.update(ob);
 											ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
 											ob->last_modified_time = TimeStamp::currentTime();
 
 											ob->from_remote_transform_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob);
+											cur_world_state->addWorldObjectTransformAsDBDirty(ob);
 											cur_world_state->dirty_from_remote_objects.insert(ob);
 
 											world_state->markAsChanged();
@@ -1407,7 +1481,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
+									sendErrorMessageToClient(err_msg_to_client);
 							}
 
 							break;
@@ -1421,18 +1495,18 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to summon an object.");
+								sendErrorMessageToClient("You must be logged in to summon an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								sendErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								std::string err_msg_to_client;
 								bool send_summon_object_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(summon_msg.object_uid); // Look up existing object in world state
 									if(res != cur_world_state->objects.end())
 									{
@@ -1450,10 +1524,11 @@ void WorkerThread::doRun()
 												ob->pos   = summon_msg.pos;
 												ob->axis  = summon_msg.axis;
 												ob->angle = summon_msg.angle;
+												cur_world_state->object_spatial_index.update(ob);
 												ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
 												ob->last_modified_time = TimeStamp::currentTime();
 
-												cur_world_state->addWorldObjectAsDBDirty(ob); // Object state has changed, so save to DB.
+												cur_world_state->addWorldObjectTransformAsDBDirty(ob); // Object transform has changed, so save to DB.
 												world_state->markAsChanged();
 
 												send_summon_object_msg = true;
@@ -1463,7 +1538,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
+									sendErrorMessageToClient(err_msg_to_client);
 
 								if(send_summon_object_msg)
 								{
@@ -1484,7 +1559,7 @@ void WorkerThread::doRun()
 							//conPrint("received ObjectPhysicsTransformUpdate");
 							const UID object_uid = readUIDFromStream(msg_buffer);
 							const Vec3d pos = readVec3FromStream<double>(msg_buffer);
-						
+		
 							Quatf rot;
 							msg_buffer.readData(rot.v.x, sizeof(float) * 4);
 
@@ -1498,19 +1573,19 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							/*if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+								sendErrorMessageToClient("You must be logged in to modify an object.");
 							}
 							*/
 							if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								sendErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								std::string err_msg_to_client;
 								// Look up existing object in world state
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1522,6 +1597,7 @@ void WorkerThread::doRun()
 										if(ob->isDynamic()) // We will only allow clients to apply PhysicsTransformUpdates to objects it the object is a dynamic object.
 										{
 											ob->pos = pos;
+											cur_world_state->object_spatial_index.update(ob);
 											Vec4f axis;
 											float angle;
 											rot.toAxisAndAngle(axis, angle);
@@ -1537,7 +1613,7 @@ void WorkerThread::doRun()
 											ob->last_modified_time = TimeStamp::currentTime();
 
 											ob->from_remote_physics_transform_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob);
+											cur_world_state->addWorldObjectTransformAsDBDirty(ob);
 											cur_world_state->dirty_from_remote_objects.insert(ob);
 
 											world_state->markAsChanged();
@@ -1546,7 +1622,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
+									sendErrorMessageToClient(err_msg_to_client);
 							}
 
 							break;
@@ -1562,18 +1638,18 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+								sendErrorMessageToClient("You must be logged in to modify an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								sendErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								// Look up existing object in world state
 								bool send_must_be_owner_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1587,7 +1663,12 @@ void WorkerThread::doRun()
 										else
 										{
 											ob->copyNetworkStateFrom(temp_ob);
-											
+											cur_world_state->object_spatial_index.update(ob); // copyNetworkStateFrom() may have changed the position.
+											{
+												Lock url_index_lock(world_state->object_URL_index_mutex);
+												world_state->object_URL_index.updateObject(*ob); // copyNetworkStateFrom() may have changed URLs.
+											}
+							
 											// Clamp volume to the max allowed level
 											ob->audio_volume = myClamp(ob->audio_volume, 0.f, maxAudioVolumeForObject(*ob, client_user_id, client_user_name, this->connected_world_name));
 
@@ -1610,7 +1691,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to change it.");
+									sendErrorMessageToClient("You must be the owner of this object to change it.");
 							}
 							break;
 						}
@@ -1622,15 +1703,21 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								const bool read_only_mode = world_state->isInReadOnlyMode(); // Call before locking the world mutex, as this locks the global world state mutex.
+
+								Lock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
 									WorldObject* ob = res->second.getPointer();
 
-									if(!world_state->isInReadOnlyMode())
+									if(!read_only_mode)
 									{
 										ob->lightmap_url = new_lightmap_url;
+										{
+											Lock url_index_lock(world_state->object_URL_index_mutex);
+											world_state->object_URL_index.updateObject(*ob);
+										}
 										ob->last_modified_time = TimeStamp::currentTime();
 
 										ob->from_remote_lightmap_url_dirty = true;
@@ -1651,15 +1738,21 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								const bool read_only_mode = world_state->isInReadOnlyMode(); // Call before locking the world mutex, as this locks the global world state mutex.
+
+								Lock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
 									WorldObject* ob = res->second.getPointer();
 
-									if(!world_state->isInReadOnlyMode())
+									if(!read_only_mode)
 									{
 										ob->model_url = new_model_url;
+										{
+											Lock url_index_lock(world_state->object_URL_index_mutex);
+											world_state->object_URL_index.updateObject(*ob);
+										}
 										ob->last_modified_time = TimeStamp::currentTime();
 
 										ob->from_remote_model_url_dirty = true;
@@ -1680,13 +1773,15 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								const bool read_only_mode = world_state->isInReadOnlyMode(); // Call before locking the world mutex, as this locks the global world state mutex.
+
+								Lock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
 									WorldObject* ob = res->second.getPointer();
 
-									if(!world_state->isInReadOnlyMode())
+									if(!read_only_mode)
 									{
 										ob->flags = flags; // Copy flags
 										ob->last_modified_time = TimeStamp::currentTime();
@@ -1711,16 +1806,19 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								const bool read_only_mode = world_state->isInReadOnlyMode(); // Call before locking the world mutex, as this locks the global world state mutex.
+
+								Lock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
 									WorldObject* ob = res->second.getPointer();
 
-									if(!world_state->isInReadOnlyMode())
+									if(!read_only_mode)
 									{
 										ob->physics_owner_id = physics_owner_id;
 										ob->last_physics_ownership_change_global_time = client_global_time;
+										ob->network_state_version++; // Physics ownership is sent in ObjectInitialSend messages, so invalidate the cached message.
 
 										// Consider physics_owner_id ephemeral state, so doesn't need to be written to DB.
 									}
@@ -1755,12 +1853,12 @@ void WorkerThread::doRun()
 								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
 								scratch_packet.writeStringLengthFirst("You must be logged in to create an object.");
 								MessageUtils::updatePacketLengthField(scratch_packet);
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't create an object right now.");
+								sendErrorMessageToClient("Server is in read-only mode, you can't create an object right now.");
 							}
 							else
 							{
@@ -1777,7 +1875,7 @@ void WorkerThread::doRun()
 
 								// Insert object into world state
 								{
-									::Lock lock(world_state->mutex);
+									::Lock lock(cur_world_state->mutex);
 
 									new_ob->uid = world_state->getNextObjectUID();
 									new_ob->state = WorldObject::State_JustCreated;
@@ -1785,6 +1883,11 @@ void WorkerThread::doRun()
 									cur_world_state->addWorldObjectAsDBDirty(new_ob);
 									cur_world_state->dirty_from_remote_objects.insert(new_ob);
 									cur_world_state->objects.insert(std::make_pair(new_ob->uid, new_ob));
+									cur_world_state->object_spatial_index.insert(new_ob.ptr());
+									{
+										Lock url_index_lock(world_state->object_URL_index_mutex);
+										world_state->object_URL_index.updateObject(*new_ob);
+									}
 
 									world_state->markAsChanged();
 								}
@@ -1800,17 +1903,17 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to destroy an object.");
+								sendErrorMessageToClient("You must be logged in to destroy an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't destroy an object right now.");
+								sendErrorMessageToClient("Server is in read-only mode, you can't destroy an object right now.");
 							}
 							else
 							{
 								bool send_must_be_owner_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1834,7 +1937,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to destroy it.");
+									sendErrorMessageToClient("You must be the owner of this object to destroy it.");
 							}
 							break;
 						}
@@ -1843,28 +1946,25 @@ void WorkerThread::doRun()
 							conPrintIfNotFuzzing("GetAllObjects");
 
 							SocketBufferOutStream temp_buf(SocketBufferOutStream::DontUseNetworkByteOrder); // Will contain several messages
+							std::vector<SharedPacketRef> ob_packets;
 
 							{
-								Lock lock(world_state->mutex);
+								Lock lock(cur_world_state->mutex);
+								ob_packets.reserve(cur_world_state->objects.size());
 								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.getPointer();
-
-									// Build ObjectInitialSend message
-									MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-									ob->writeToNetworkStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								}
+									ob_packets.push_back(cur_world_state->object_packet_cache.getObjectInitialSendPacket(*it->second, scratch_packet)); // Get ObjectInitialSend message
 							}
 
+							// Copy the cached messages to temp_buf, now we have released the world lock.
+							for(size_t i=0; i<ob_packets.size(); ++i)
+								temp_buf.writeData(ob_packets[i]->data.data(), ob_packets[i]->data.size());
+
 							MessageUtils::initPacket(scratch_packet, Protocol::AllObjectsSent); // Terminate the buffer with an AllObjectsSent message.
 							MessageUtils::updatePacketLengthField(scratch_packet);
 							temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
 
-							socket->writeData(temp_buf.buf.data(), temp_buf.buf.size());
-							socket->flush();
+							writeToClient(temp_buf.buf.data(), temp_buf.buf.size());
+							flushToClient();
 
 							break;
 						}
@@ -1881,7 +1981,7 @@ void WorkerThread::doRun()
 								throw glare::Exception("QueryObjects: too many cells: " + toString(num_cells));
 
 							//conPrint("QueryObjects, num_cells=" + toString(num_cells));
-					
+	
 							// Read cell coords from network and make AABBs for cells
 							js::Vector<js::AABBox, 16> cell_aabbs(num_cells);
 							for(uint32 i=0; i<num_cells; ++i)
@@ -1903,45 +2003,40 @@ void WorkerThread::doRun()
 
 
 							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-							int num_obs_written = 0;
+							std::vector<SharedPacketRef> ob_packets;
 
 							{ // Lock scope
-								Lock lock(world_state->mutex);
-								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
+								Lock lock(cur_world_state->mutex);
 
-									// See if the object is in any of the cell AABBs
-									bool in_cell = false;
-									for(uint32 i=0; i<num_cells; ++i)
-										if(cell_aabbs[i].contains(ob->pos.toVec4fPoint()))
-										{
-											in_cell = true;
-											break;
-										}
+								if(client_protocol_version >= 36)
+									interest_state.setPos(cam_position);
 
-									if(in_cell)
-									{
-										// Send ObjectInitialSend packet
-										MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-										ob->writeToNetworkStream(scratch_packet);
-										MessageUtils::updatePacketLengthField(scratch_packet);
+								// Get the objects in the cell AABBs from the spatial index.
+								std::vector<WorldObject*> obs;
+								for(uint32 i=0; i<num_cells; ++i)
+									cur_world_state->object_spatial_index.queryAABB(cell_aabbs[i], obs);
 
-										packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); 
+								// An object on a cell boundary may have been returned for more than one cell, so remove duplicates.
+								// Sort by UID so objects are sent in the same order as when iterating over the objects map.
+								std::sort(obs.begin(), obs.end(), [](const WorldObject* a, const WorldObject* b) { return a->uid < b->uid; });
+								obs.erase(std::unique(obs.begin(), obs.end()), obs.end());
 
-										num_obs_written++;
-									}
-								}
+								ob_packets.reserve(obs.size());
+								for(size_t i=0; i<obs.size(); ++i)
+									ob_packets.push_back(cur_world_state->object_packet_cache.getObjectInitialSendPacket(*obs[i], scratch_packet)); // Get ObjectInitialSend message
 							} // End lock scope
 
+							for(size_t i=0; i<ob_packets.size(); ++i)
+								packet.writeData(ob_packets[i]->data.data(), ob_packets[i]->data.size());
+
 							if(!packet.buf.empty())
 							{
-								conPrintIfNotFuzzing("QueryObjects: Sending back info on " + toString(num_obs_written) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ") ...");
+								conPrintIfNotFuzzing("QueryObjects: Sending back info on " + toString(ob_packets.size()) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ") ...");
 
-								socket->writeData(packet.buf.data(), packet.buf.size()); // Write data to network
-								socket->flush();
+								writeToClient(packet.buf.data(), packet.buf.size()); // Write data to network
+								flushToClient();
 							}
-						
+		
 							break;
 						}
 					case Protocol::QueryObjectsInAABB: // Client wants to query objects in a particular AABB
@@ -1972,7 +2067,7 @@ void WorkerThread::doRun()
 							const float upper_z = msg_buffer.readFloat();
 
 							const js::AABBox aabb(Vec4f(lower_x, lower_y, lower_z, 1.f), Vec4f(upper_x, upper_y, upper_z, 1.f));
-					
+	
 							conPrintIfNotFuzzing("QueryObjectsInAABB, aabb: " + aabb.toStringNSigFigs(4) + ", cam_position: " + cam_position.toString());
 
 							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
@@ -1981,18 +2076,17 @@ void WorkerThread::doRun()
 							chunk_begin_offsets.push_back(0);
 							size_t last_chunk_begin_offset = 0;
 
-							std::vector<const WorldObject*> obs;
+							std::vector<WorldObject*> obs;
 							obs.reserve(16384);
+							std::vector<SharedPacketRef> ob_packets;
 
 							{ // Lock scope
-								Lock lock(world_state->mutex);
-								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
-									const Vec4f ob_pos_vec4f = ob->pos.toVec4fPoint();
-									if(ob_pos_vec4f.isFinite() && aabb.contains(ob_pos_vec4f)) // If the object position is valid, and if it's in the query AABB:
-										obs.push_back(ob);
-								}
+								Lock lock(cur_world_state->mutex);
+
+								if(client_protocol_version >= 36)
+									interest_state.setPos(cam_position);
+
+								cur_world_state->object_spatial_index.queryAABB(aabb, obs); // Objects with non-finite positions are never returned.
 
 								// Sort objects from near to far from camera.
 								struct WorldObjectDistComparator
@@ -2010,24 +2104,22 @@ void WorkerThread::doRun()
 								comparator.campos = cam_position;
 								std::sort(obs.begin(), obs.end(), comparator);
 
+								ob_packets.reserve(obs.size());
 								for(size_t i=0; i<obs.size(); ++i)
-								{
-									const WorldObject* ob = obs[i];
-
-									// Create ObjectInitialSend packet
-									MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-									ob->writeToNetworkStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
+									ob_packets.push_back(cur_world_state->object_packet_cache.getObjectInitialSendPacket(*obs[i], scratch_packet)); // Get ObjectInitialSend message
+							} // End lock scope
 
-									packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Append scratch_packet with ObjectInitialSend message to packet.
+							// Copy the cached messages to packet, now we have released the world lock.
+							for(size_t i=0; i<ob_packets.size(); ++i)
+							{
+								packet.writeData(ob_packets[i]->data.data(), ob_packets[i]->data.size()); // Append ObjectInitialSend message to packet.
 
-									if(packet.buf.size() - last_chunk_begin_offset >= 4096) // If we have written more than X bytes since last chunk start:
-									{
-										last_chunk_begin_offset = packet.buf.size();
-										chunk_begin_offsets.push_back(packet.buf.size()); // Record offset of start of chunk.
-									}
+								if(packet.buf.size() - last_chunk_begin_offset >= 4096) // If we have written more than X bytes since last chunk start:
+								{
+									last_chunk_begin_offset = packet.buf.size();
+									chunk_begin_offsets.push_back(packet.buf.size()); // Record offset of start of chunk.
 								}
-							} // End lock scope
+							}
 
 							// Send back the data, now we have released the world lock.  Send it back in chunks instead of one big write. (better for websockets)
 							if(!packet.buf.empty())
@@ -2043,8 +2135,8 @@ void WorkerThread::doRun()
 										const size_t chunk_end = ((i + 1) < chunk_begin_offsets.size()) ? chunk_begin_offsets[i + 1] : packet.buf.size();
 										const size_t chunk_size = chunk_end - chunk_offset;
 										runtimeCheck((chunk_offset < packet.buf.size()) && (CheckedMaths::addUnsignedInts(chunk_offset, chunk_size) <= packet.buf.size())); 
-										socket->writeData(&packet.buf[chunk_offset], chunk_size); // Write data to network
-										socket->flush(); // Will cause websockets to send a data frame.
+										writeToClient(&packet.buf[chunk_offset], chunk_size); // Write data to network
+										flushToClient(); // Will cause websockets to send a data frame.
 									}
 								}
 
@@ -2060,14 +2152,14 @@ void WorkerThread::doRun()
 							// Send all current parcel data to client
 							MessageUtils::initPacket(scratch_packet, Protocol::ParcelList);
 							{
-								Lock lock(world_state->mutex);
+								Lock lock(cur_world_state->mutex);
 								scratch_packet.writeUInt64(cur_world_state->parcels.size()); // Write num parcels
 								for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
 									writeToNetworkStream(*it->second, scratch_packet, client_protocol_version); // Write parcel
 							}
 							MessageUtils::updatePacketLengthField(scratch_packet);
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
-							socket->flush();
+							writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
+							flushToClient();
 							break;
 						}
 					case Protocol::ParcelFullUpdate: // Client wants to update a parcel
@@ -2081,18 +2173,18 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse parcel modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify a parcel.");
+								sendErrorMessageToClient("You must be logged in to modify a parcel.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify a parcel right now.");
+								sendErrorMessageToClient("Server is in read-only mode, you can't modify a parcel right now.");
 							}
 							else
 							{
 								// Look up existing parcel in world state
 								std::string error_msg;
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(cur_world_state->mutex);
 									auto res = cur_world_state->parcels.find(parcel_id);
 									if(res != cur_world_state->parcels.end())
 									{
@@ -2117,7 +2209,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!error_msg.empty())
-									writeErrorMessageToClient(socket, error_msg);
+									sendErrorMessageToClient(error_msg);
 							}
 							break;
 						}
@@ -2130,7 +2222,7 @@ void WorkerThread::doRun()
 
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to chat.");
+								sendErrorMessageToClient("You must be logged in to chat.");
 							}
 							else
 							{
@@ -2187,7 +2279,7 @@ void WorkerThread::doRun()
 							const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
 							conPrintIfNotFuzzing("username: '" + username + "'");
-						
+		
 							bool logged_in = false;
 							{
 								Lock lock(world_state->mutex);
@@ -2224,8 +2316,8 @@ void WorkerThread::doRun()
 								scratch_packet.writeUInt32(client_user_flags);
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 							else
 							{
@@ -2234,10 +2326,10 @@ void WorkerThread::doRun()
 								scratch_packet.writeStringLengthFirst("Login failed: username or password incorrect.");
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
-					
+	
 							break;
 						}
 					case Protocol::LogOutMessage: // Client wants to log out.
@@ -2252,8 +2344,8 @@ void WorkerThread::doRun()
 							MessageUtils::initPacket(scratch_packet, Protocol::LoggedOutMessageID);
 							MessageUtils::updatePacketLengthField(scratch_packet);
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
+							writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+							flushToClient();
 							break;
 						}
 					case Protocol::SignUpMessage:
@@ -2325,8 +2417,8 @@ void WorkerThread::doRun()
 									scratch_packet.writeStringLengthFirst(username);
 									MessageUtils::updatePacketLengthField(scratch_packet);
 
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
+									writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+									flushToClient();
 								}
 								else
 								{
@@ -2337,8 +2429,8 @@ void WorkerThread::doRun()
 									scratch_packet.writeStringLengthFirst(msg_to_client);
 									MessageUtils::updatePacketLengthField(scratch_packet);
 
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
+									writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+									flushToClient();
 								}
 							}
 							catch(glare::Exception& e)
@@ -2350,8 +2442,8 @@ void WorkerThread::doRun()
 								scratch_packet.writeStringLengthFirst("Signup failed: internal error.");
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 
 							break;
@@ -2386,19 +2478,19 @@ void WorkerThread::doRun()
 							//			}
 							//		}
 							//}
-					
+	
 							break;
 						}
 					case Protocol::ChangePasswordWithResetToken:
 						{
 							conPrintIfNotFuzzing("ChangePasswordWithResetToken");
-						
+		
 							const std::string email			= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 							const std::string reset_token	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 							const std::string new_password	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
 							// NOTE: This stuff is done via the website now instead.
-					
+	
 							//conPrint("email: " + email);
 							//conPrint("reset_token: " + reset_token);
 							////conPrint("new_password: " + new_password);
@@ -2425,14 +2517,14 @@ void WorkerThread::doRun()
 					case Protocol::WorldSettingsUpdate:
 						{
 							conPrintIfNotFuzzing("WorldSettingsUpdate");
-						
+		
 							WorldSettings world_settings;
 							readWorldSettingsFromStream(msg_buffer, world_settings);
 
 							if(userConnectedToTheirPersonalWorldOrGodUser(client_user_id, client_user_name, this->connected_world_name))
 							{
 								{
-									Lock lock(server->world_state->mutex);
+									Lock lock(cur_world_state->mutex);
 									cur_world_state->world_settings.copyNetworkStateFrom(world_settings);
 									cur_world_state->world_settings.db_dirty = true;
 									world_state->markAsChanged();
@@ -2464,8 +2556,8 @@ void WorkerThread::doRun()
 								scratch_packet.writeStringLengthFirst("You do not have permissions to set the world settings");
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 
 							break;
@@ -2473,13 +2565,13 @@ void WorkerThread::doRun()
 					case Protocol::QueryMapTiles:
 						{
 							conPrintIfNotFuzzing("QueryMapTiles");
-						
+		
 							const uint32 num_tiles = msg_buffer.readUInt32();
 							if(num_tiles > 1000)
 								throw glare::Exception("QueryMapTiles: too many tiles: " + toString(num_tiles));
 
 							// conPrint("QueryMapTiles, num_tiles=" + toString(num_tiles));
-					
+	
 							// Read tile coords
 							std::vector<Vec3i> tile_coords(num_tiles);
 							msg_buffer.readData(tile_coords.data(), num_tiles * sizeof(Vec3i));
@@ -2521,8 +2613,8 @@ void WorkerThread::doRun()
 
 							MessageUtils::updatePacketLengthField(scratch_packet);
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
+							writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+							flushToClient();
 
 							break;
 						}
@@ -2532,103 +2624,93 @@ void WorkerThread::doRun()
 							throw glare::Exception("Unknown message id: " + toString(msg_type));
 						}
 					}
-				}
-				else
-				{
-#if defined(_WIN32) || defined(OSX)
-#else
-					if(VERBOSE) conPrint("WorkerThread: event FD was signalled.");
-
-					// The event FD was signalled, which means there is some data to send on the socket.
-					// Reset the event fd by reading from it.
-					event_fd.read();
-
-					if(VERBOSE) conPrint("WorkerThread: event FD has been reset.");
-#endif
-				}
-			} // End write to / read from socket loop
-		} // End if(connection_type == Protocol::ConnectionTypeUpdates)
-		else
-		{
-			throw glare::Exception("Unknown connection_type: " + toString(connection_type));
-		}
-	}
-	catch(MySocketExcep& e)
-	{
-		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
-			conPrint("Updates client from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
-		else
-			conPrint("Socket error: " + e.what());
-	}
-	catch(glare::Exception& e)
-	{
-		conPrintIfNotFuzzing("glare::Exception: " + e.what());
-	}
-	catch(std::bad_alloc&)
-	{
-		conPrint("WorkerThread: Caught std::bad_alloc.");
-	}
-
+}
 
-	if(write_trace)
-		socket.downcastToPtr<RecordingSocket>()->writeRecordBufToDisk("traces/worker_thread_trace_" + ::toString(Clock::getTimeSinceInit()) + ".bin");
 
+void WorkerThread::connectionClosed()
+{
 	server->clientDisconnected(this);
 	
-	// Mark avatar corresponding to client as dead.  Note that we want to do this after catching any exceptions, so avatar is removed on broken connections etc.
+	// Mark avatar corresponding to client as dead.
 	if(cur_world_state.nonNull())
 	{
-		Lock lock(world_state->mutex);
+		Lock lock(cur_world_state->mutex);
 		if(cur_world_state->avatars.count(client_avatar_uid) == 1)
 		{
 			cur_world_state->avatars[client_avatar_uid]->state = Avatar::State_Dead;
 			cur_world_state->avatars[client_avatar_uid]->other_dirty = true;
 		}
 	}
+}
 
-	// Remove thread-local OpenSSL error state, to avoid leaking it.
-	// NOTE: have to destroy socket first, before calling ERR_remove_thread_state(), otherwise memory will just be reallocated.
-	if(socket.nonNull())
-	{
-		assert(socket->getRefCount() == 1);
-	}
-	socket = NULL;
-	ERR_remove_thread_state(/*thread id=*/NULL); // Set thread ID to null to use current thread.
+
+void WorkerThread::writeToClient(const void* data, size_t len)
+{
+	if(nonblocking_send_buf)
+		nonblocking_send_buf->writeData(data, len);
+	else
+		socket->writeData(data, len);
 }
 
 
-void WorkerThread::enqueueDataToSend(const std::string& data)
+void WorkerThread::flushToClient()
 {
-	if(VERBOSE) conPrint("WorkerThread::enqueueDataToSend(), data: '" + data + "'");
+	if(!nonblocking_send_buf) // Data in nonblocking_send_buf is written by the EpollLoopThread.
+		socket->flush();
+}
 
-	// Append data to data_to_send
-	if(!data.empty())
-	{
-		Lock lock(data_to_send_mutex);
-		const size_t write_i = data_to_send.size();
-		data_to_send.resize(write_i + data.size());
-		std::memcpy(&data_to_send[write_i], data.data(), data.size());
-	}
 
-	event_fd.notify();
+void WorkerThread::sendErrorMessageToClient(const std::string& msg)
+{
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	MessageUtils::initPacket(packet, Protocol::ErrorMessageID);
+	packet.writeStringLengthFirst(msg);
+	MessageUtils::updatePacketLengthField(packet);
+
+	writeToClient(packet.buf.data(), packet.buf.size());
+	flushToClient();
+}
+
+
+IPAddress WorkerThread::getClientIPAddress()
+{
+	return nonblocking_send_buf ? epoll_client_ip_addr : socket->getOtherEndIPAddress();
 }
 
 
 void WorkerThread::enqueueDataToSend(const SocketBufferOutStream& packet) // threadsafe
 {
-	// Append data to data_to_send
 	if(!packet.buf.empty())
-	{
-		Lock lock(data_to_send_mutex);
-		const size_t write_i = data_to_send.size();
-		data_to_send.resize(write_i + packet.buf.size());
-		std::memcpy(&data_to_send[write_i], packet.buf.data(), packet.buf.size());
-	}
+		send_queue.enqueuePacket(SharedPacket::make(packet));
 
 	event_fd.notify();
 }
 
 
+void WorkerThread::enqueuePacketToSend(const SharedPacketRef& packet) // threadsafe
+{
+	if(VERBOSE) conPrint("WorkerThread::enqueuePacketToSend(), packet size: " + toString(packet->size()));
+
+	if(packet->size() > 0)
+		send_queue.enqueuePacket(packet);
+
+	event_fd.notify();
+}
+
+
+void WorkerThread::sendTransformDatagram(const uint8* data, size_t len)
+{
+	try
+	{
+		udp_transform_state.socket->sendPacket(data, len, udp_transform_state.ip_addr, udp_transform_state.port);
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("WorkerThread::sendTransformDatagram: glare::Exception: " + e.what());
+	}
+}
+
+
 void WorkerThread::conPrintIfNotFuzzing(const std::string& msg)
 {
 	if(!fuzzing)
@@ -6,6 +6,10 @@ Copyright Glare Technologies Limited 2018 -
 #pragma once
 
 
+#include "InterestManager.h"
+#include "../shared/UID.h"
+#include "../shared/UserID.h"
+#include "../shared/Avatar.h"
 #include <RequestInfo.h>
 #include <MessageableThread.h>
 #include <Platform.h>
@@ -15,16 +19,27 @@ Copyright Glare Technologies Limited 2018 -
 #include <SocketBufferOutStream.h>
 #include <Vector.h>
 #include <BufferInStream.h>
+#include <IPAddress.h>
 #include <string>
+#include <vector>
 class Server;
+class ServerAllWorldsState;
+class ServerWorldState;
 
 
 /*=====================================================================
 WorkerThread
 ------------
 This thread runs on the server, and handles communication with a single client.
+
+With the epoll connection layer (see EpollServer.h), clients with
+ConnectionTypeUpdates connections are not given their own thread.  Instead the
+WorkerThread object is used as the per-connection state, and an
+EpollLoopThread calls connectToWorld() and handleUpdatesMessage() as data
+arrives.  Data written to the client is then appended to
+nonblocking_send_buf, for the EpollLoopThread to send.
 =====================================================================*/
-class WorkerThread : public MessageableThread
+class WorkerThread : public MessageableThread, public BroadcastSink
 {
 public:
 	// May throw glare::Exception from constructor if EventFD init fails.
@@ -33,10 +48,51 @@ public:
 
 	virtual void doRun();
 
+	// Called when the hello message, protocol version and connection type have already been read from the socket (by an EpollLoopThread), so doRun() should skip them.
+	// unsent_handshake_data is any handshake response data the EpollLoopThread hasn't written yet; doRun() writes it before anything else.
+	void setHandshakeAlreadyDone(uint32 client_protocol_version, uint32 connection_type, const uint8* unsent_handshake_data, size_t unsent_handshake_data_len);
+
+	//----------------------- Interface for the epoll connection layer ------------------------
+	// Validates the world name, creates the client avatar UID, and writes the initial world state to the client.  Throws glare::Exception on invalid world name.
+	void connectToWorld(const std::string& world_name);
+
+	// Handles a message from a client connected with ConnectionTypeUpdates.  The message must have been read into msg_buffer.
+	void handleUpdatesMessage(uint32 msg_type);
+
+	// Removes the client from the server, and marks its avatar as dead.
+	void connectionClosed();
+
+	uint32 client_protocol_version;
+	bool received_goodbye; // Set when a CyberspaceGoodbye message is handled.  The connection should then be closed.
+	BufferInStream msg_buffer; // Message currently being handled.
+	SocketBufferOutStream* nonblocking_send_buf; // If non-NULL, data written to the client is appended to this buffer instead of written to the socket.
+	IPAddress epoll_client_ip_addr; // Address of the client, used when nonblocking_send_buf is non-NULL, as there is no socket.
+	PacketSendQueue send_queue; // Packets to send to the client.  Enqueued from other threads.
+	EventFD event_fd; // Signalled when packets are enqueued to send_queue.
+	//-----------------------------------------------------------------------------------------
+
+	static const uint32 MAX_MESSAGE_LEN = 1000000;
+
 	std::string connected_world_name;
 
-	void enqueueDataToSend(const std::string& data); // threadsafe
-	void enqueueDataToSend(const SocketBufferOutStream& packet); // threadsafe
+	void enqueueDataToSend(const SocketBufferOutStream& packet); // threadsafe.  Copies the packet data.
+	virtual void enqueuePacketToSend(const SharedPacketRef& packet); // threadsafe.  Packet must not be modified after this call.
+
+	virtual ClientInterestState& getInterestState() { return interest_state; }
+
+	virtual bool supportsTransformUpdateBatches() { return client_protocol_version >= 40; }
+
+	virtual bool isSendQueueCoalescing() { return send_queue.isCoalescing(); }
+
+	bool supportsUDPTransformUpdates() const { return client_protocol_version >= 41; }
+
+	virtual ClientUDPTransformState* getUDPTransformState() { return &udp_transform_state; }
+
+	virtual void sendTransformDatagram(const uint8* data, size_t len);
+
+	ClientInterestState interest_state; // Position of the client, used for filtering broadcast updates.  Protected by the mutex of the world the client is connected to.
+
+	ClientUDPTransformState udp_transform_state; // Protected by the mutex of the world the client is connected to.
 
 	web::RequestInfo websocket_request_info; // If the client connected via a websocket, this the HTTP request data.  Is used for accessing the login cookie.
 
@@ -47,18 +103,34 @@ private:
 	void handleScreenshotBotConnection();
 	void handleEthBotConnection();
 	void conPrintIfNotFuzzing(const std::string& msg);
+	uint32 readHandshake();
+
+	void writeToClient(const void* data, size_t len);
+	void flushToClient();
+	void sendErrorMessageToClient(const std::string& msg);
+	IPAddress getClientIPAddress();
 
 	Reference<SocketInterface> socket;
 	Server* server;
-	EventFD event_fd;	
+	ServerAllWorldsState* world_state;
 
-	Mutex data_to_send_mutex;
-	js::Vector<uint8, 16> data_to_send			GUARDED_BY(data_to_send_mutex);
-	js::Vector<uint8, 16> temp_data_to_send;
+	bool handshake_already_done;
+	uint32 handshake_connection_type;
+	std::vector<uint8> unsent_handshake_data;
 
-	SocketBufferOutStream scratch_packet;
+	// State of a ConnectionTypeUpdates connection
+	UID client_avatar_uid;
+	UserID client_user_id; // Will be an invalid reference if client is not logged in, otherwise will refer to the user account the client is logged in to.
+	std::string client_user_name;
+	AvatarSettings client_user_avatar_settings;
+	uint32 client_user_flags;
+	Reference<ServerWorldState> cur_world_state; // World the client is connected to.
+	bool logged_in_user_is_lightmapper_bot; // Just for updating the last_lightmapper_bot_contact_time.
 
-	BufferInStream msg_buffer;
+	std::vector<SharedPacketRef> temp_packets_to_send;
+	js::Vector<uint8, 16> send_gather_buf;
+
+	SocketBufferOutStream scratch_packet;
 public:
 	bool fuzzing; // Are we currently doing fuzz-testing?
 private:
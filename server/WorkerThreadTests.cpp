@@ -127,7 +127,10 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 		test_socket = NULL;
 		worker->doRun();
 
-		test_server->world_state->world_states.clear();
+		{
+			Lock lock(test_server->world_state->mutex);
+			test_server->world_state->world_states.clear();
+		}
 
 		// Create a parcel
 		const ParcelID parcel_id(0);
@@ -146,8 +149,13 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 
 		parcel->build();
 
-		test_server->world_state->world_states[""] = new ServerWorldState();
-		test_server->world_state->getRootWorldState()->parcels[parcel_id] = parcel;
+		{
+			Lock lock(test_server->world_state->mutex);
+			test_server->world_state->world_states[""] = new ServerWorldState();
+			Reference<ServerWorldState> root_world = test_server->world_state->getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
+			root_world->parcels[parcel_id] = parcel;
+		}
 
 		//test_server->world_state->user_id_to_users.clear();
 		//test_server->world_state->name_to_users.clear();
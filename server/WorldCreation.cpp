@@ -316,6 +316,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
 			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->object_spatial_index.insert(new_object.ptr());
+			world_state->object_URL_index.updateObject(*new_object);
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
 		}
 
@@ -353,6 +355,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
 			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->object_spatial_index.insert(new_object.ptr());
+			world_state->object_URL_index.updateObject(*new_object);
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
 		}
 
@@ -402,6 +406,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
 			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->object_spatial_index.insert(new_object.ptr());
+			world_state->object_URL_index.updateObject(*new_object);
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
 		}
 
@@ -438,6 +444,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
 			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->object_spatial_index.insert(new_object.ptr());
+			world_state->object_URL_index.updateObject(*new_object);
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
 		}
 
@@ -475,6 +483,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
 			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->object_spatial_index.insert(new_object.ptr());
+			world_state->object_URL_index.updateObject(*new_object);
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
 		}
 
@@ -514,6 +524,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
 			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->object_spatial_index.insert(new_object.ptr());
+			world_state->object_URL_index.updateObject(*new_object);
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
 		}
 
@@ -554,6 +566,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
 			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
+			world_state->getRootWorldState()->object_spatial_index.insert(new_object.ptr());
+			world_state->object_URL_index.updateObject(*new_object);
 			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
 		}
 	}
@@ -579,6 +593,8 @@ static void makeRoad(ServerAllWorldsState& world_state, const Vec3d& pos, const
 	test_object->materials[0]->colour_texture_url = "stone_floor_jpg_6978110256346892991.jpg";
 
 	world_state.getRootWorldState()->objects[test_object->uid] = test_object;
+	world_state.getRootWorldState()->object_spatial_index.insert(test_object.ptr());
+	world_state.object_URL_index.updateObject(*test_object);
 }
 
 
@@ -604,6 +620,7 @@ static void updateToUseImageCubeMeshes(ServerAllWorldsState& all_worlds_state)
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			Lock world_lock(world_state->mutex);
 
 			for(auto i = world_state->objects.begin(); i != world_state->objects.end(); ++i)
 			{
@@ -623,6 +640,10 @@ static void updateToUseImageCubeMeshes(ServerAllWorldsState& all_worlds_state)
 							{
 								conPrint("updateToUseImageCubeMeshes(): Updating model_url '" + ob->model_url + "' to 'image_cube_5438347426447337425.bmesh'.");
 								ob->model_url = "image_cube_5438347426447337425.bmesh";
+								{
+									Lock url_index_lock(all_worlds_state.object_URL_index_mutex);
+									all_worlds_state.object_URL_index.updateObject(*ob);
+								}
 
 								world_state->addWorldObjectAsDBDirty(ob);
 								num_updated++;
@@ -659,6 +680,7 @@ void WorldCreation::removeHypercardMaterials(ServerAllWorldsState& all_worlds_st
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			Lock world_lock(world_state->mutex);
 
 			for(auto i = world_state->objects.begin(); i != world_state->objects.end(); ++i)
 			{
@@ -683,6 +705,11 @@ void WorldCreation::removeHypercardMaterials(ServerAllWorldsState& all_worlds_st
 
 void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_state)
 {
+	// This is called on startup before any other threads are started, but lock anyway.
+	Lock lock(world_state->mutex);
+	Lock root_world_lock(world_state->getRootWorldState()->mutex);
+	Lock url_index_lock(world_state->object_URL_index_mutex);
+
 	// Add 'town square' parcels
 	if(world_state->getRootWorldState()->parcels.empty())
 	{
@@ -768,6 +795,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			parcel->build();
 
 			world_state->getRootWorldState()->parcels[parcel_id] = parcel;
+			world_state->getRootWorldState()->parcel_spatial_index.invalidate();
 		}
 	}
 
@@ -1051,7 +1079,11 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			for(auto it = world_state->getRootWorldState()->objects.begin(); it != world_state->getRootWorldState()->objects.end();)
 			{
 				if(it->second->uid.value() >= 1000000)
+				{
+					world_state->getRootWorldState()->object_spatial_index.remove(it->second.ptr());
+					world_state->object_URL_index.removeObject(it->second->uid);
 					it = world_state->getRootWorldState()->objects.erase(it);
+				}
 				else
 					++it;
 			}
@@ -1226,6 +1258,9 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 void WorldCreation::createPhysicsTest(ServerAllWorldsState& all_worlds_state)
 {
+	Lock root_world_lock(all_worlds_state.getRootWorldState()->mutex);
+	Lock url_index_lock(all_worlds_state.object_URL_index_mutex);
+
 	conPrint("creating blocks...");
 
 	const int N = 30000;
@@ -1266,7 +1301,13 @@ void WorldCreation::createPhysicsTest(ServerAllWorldsState& all_worlds_state)
 		test_object->materials[0]->colour_texture_url = "stone_floor_jpg_6978110256346892991.jpg";
 
 		//all_worlds_state.getRootWorldState()->objects[test_object->uid] = test_object;
-		all_worlds_state.getRootWorldState()->objects.erase(test_object->uid);
+		auto existing_res = all_worlds_state.getRootWorldState()->objects.find(test_object->uid);
+		if(existing_res != all_worlds_state.getRootWorldState()->objects.end())
+		{
+			all_worlds_state.getRootWorldState()->object_spatial_index.remove(existing_res->second.ptr());
+			all_worlds_state.object_URL_index.removeObject(existing_res->first);
+			all_worlds_state.getRootWorldState()->objects.erase(existing_res);
+		}
 		//all_worlds_state.getRootWorldState()->addWorldObjectAsDBDirty(test_object);
 
 
@@ -17,6 +17,9 @@ Copyright Glare Technologies Limited 2021 -
 #include <KillThreadMessage.h>
 #include <Timer.h>
 #include <TaskManager.h>
+#include <Task.h>
+#include <ThreadMessage.h>
+#include <ThreadSafeQueue.h>
 #include <GeneralMemAllocator.h>
 #include <graphics/MeshSimplification.h>
 #include <graphics/formatdecoderobj.h>
@@ -128,6 +131,109 @@ void generateLODModel(const std::string& model_path, int lod_level, const std::s
 }
 
 
+void generateLODModels(const LODModelsToGen& to_gen, std::vector<std::string>& errors_out)
+{
+	assert(to_gen.lod_levels.size() == to_gen.LOD_model_paths.size());
+
+	errors_out.resize(to_gen.lod_levels.size());
+
+	BatchedMeshRef batched_mesh;
+	try
+	{
+		batched_mesh = loadModel(to_gen.model_path);
+	}
+	catch(glare::Exception& e)
+	{
+		for(size_t i=0; i<errors_out.size(); ++i)
+			errors_out[i] = e.what();
+		return;
+	}
+
+	for(size_t i=0; i<to_gen.lod_levels.size(); ++i)
+	{
+		try
+		{
+			generateLODModel(batched_mesh, to_gen.lod_levels[i], to_gen.LOD_model_paths[i]);
+			errors_out[i].clear();
+		}
+		catch(glare::Exception& e)
+		{
+			errors_out[i] = e.what();
+		}
+		catch(std::exception& e) // For std::bad_alloc etc.
+		{
+			errors_out[i] = std::string("std::exception: ") + e.what();
+		}
+	}
+}
+
+
+class LODModelsGeneratedMessage : public ThreadMessage
+{
+public:
+	size_t job_index;
+	std::vector<std::string> errors;
+};
+
+
+class GenerateLODModelsTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		Reference<LODModelsGeneratedMessage> msg = new LODModelsGeneratedMessage();
+		msg->job_index = job_index;
+		try
+		{
+			generateLODModels(*to_gen, msg->errors);
+		}
+		catch(std::exception& e)
+		{
+			msg->errors.assign(to_gen->lod_levels.size(), std::string("std::exception: ") + e.what());
+		}
+		result_msg_queue->enqueue(msg);
+	}
+
+	const LODModelsToGen* to_gen;
+	size_t job_index;
+	ThreadSafeQueue<Reference<ThreadMessage> >* result_msg_queue;
+};
+
+
+void generateLODModelsInParallel(const std::vector<LODModelsToGen>& jobs, glare::TaskManager& task_manager, size_t max_num_in_flight, LODModelsGeneratedHandler& handler)
+{
+	max_num_in_flight = myMax<size_t>(1, max_num_in_flight);
+
+	ThreadSafeQueue<Reference<ThreadMessage> > result_msg_queue;
+	size_t next_job_index = 0;
+	size_t num_in_flight = 0;
+
+	while((next_job_index < jobs.size()) || (num_in_flight > 0))
+	{
+		// Top up the tasks in flight
+		while((next_job_index < jobs.size()) && (num_in_flight < max_num_in_flight))
+		{
+			Reference<GenerateLODModelsTask> task = new GenerateLODModelsTask();
+			task->to_gen = &jobs[next_job_index];
+			task->job_index = next_job_index;
+			task->result_msg_queue = &result_msg_queue;
+			task_manager.addTask(task);
+
+			next_job_index++;
+			num_in_flight++;
+		}
+
+		// Block until a task has finished
+		ThreadMessageRef msg;
+		result_msg_queue.dequeue(msg);
+		num_in_flight--;
+
+		const LODModelsGeneratedMessage* generated_msg = msg.downcastToPtr<LODModelsGeneratedMessage>();
+		handler.LODModelsGenerated(generated_msg->job_index, generated_msg->errors);
+	}
+}
+
+
 bool textureHasAlphaChannel(const std::string& tex_path)
 {
 	if(hasExtension(tex_path, "gif") || hasExtension(tex_path, "jpg"))
@@ -437,6 +543,43 @@ void generateLODTexturesForMaterialsIfNotPresent(std::vector<WorldMaterialRef>&
 #include "../utils/PlatformUtils.h"
 #include "../utils/Exception.h"
 #include "../utils/Timer.h"
+#include <map>
+#include <cmath>
+
+
+std::string LODGeneration::makeTestGridOBJ(int res)
+{
+	std::string s;
+	for(int y=0; y<=res; ++y)
+	for(int x=0; x<=res; ++x)
+	{
+		const float z = std::sin(x * 0.3f) * std::cos(y * 0.2f) * 0.1f;
+		s += "v " + toString(x / (float)res) + " " + toString(y / (float)res) + " " + toString(z) + "\n";
+	}
+	for(int y=0; y<res; ++y)
+	for(int x=0; x<res; ++x)
+	{
+		const int v0 = y * (res + 1) + x + 1; // OBJ indices are 1-based.
+		const int v1 = v0 + 1;
+		const int v2 = v0 + (res + 1) + 1;
+		const int v3 = v0 + (res + 1);
+		s += "f " + toString(v0) + " " + toString(v1) + " " + toString(v2) + " " + toString(v3) + "\n";
+	}
+	return s;
+}
+
+
+class TestLODModelsGeneratedHandler : public LODGeneration::LODModelsGeneratedHandler
+{
+public:
+	virtual void LODModelsGenerated(size_t job_index, const std::vector<std::string>& errors)
+	{
+		testAssert(job_errors.count(job_index) == 0);
+		job_errors[job_index] = errors;
+	}
+
+	std::map<size_t, std::vector<std::string>> job_errors;
+};
 
 
 void LODGeneration::test()
@@ -543,6 +686,123 @@ void LODGeneration::test()
 		}
 #endif
 
+		//------------------------------------------- Test LOD model generation -------------------------------------------
+		// Write some grid meshes with different resolutions as OBJ files.
+		std::vector<std::string> model_paths;
+		for(int res=16; res<=128; res *= 2)
+		{
+			const std::string model_path = PlatformUtils::getTempDirPath() + "/lod_gen_test_grid_" + toString(res) + ".obj";
+			FileUtils::writeEntireFileTextMode(model_path, makeTestGridOBJ(res));
+			model_paths.push_back(model_path);
+		}
+
+		// Generate LOD models with the serial path, loading the source model for each LOD level.
+		for(size_t i=0; i<model_paths.size(); ++i)
+			for(int lvl=1; lvl<=2; ++lvl)
+				generateLODModel(model_paths[i], lvl, model_paths[i] + "_serial_lod" + toString(lvl) + ".bmesh");
+
+		// Generate with generateLODModels(), check the results are the same.
+		for(size_t i=0; i<model_paths.size(); ++i)
+		{
+			LODModelsToGen to_gen;
+			to_gen.model_path = model_paths[i];
+			for(int lvl=1; lvl<=2; ++lvl)
+			{
+				to_gen.lod_levels.push_back(lvl);
+				to_gen.LOD_model_paths.push_back(model_paths[i] + "_single_load_lod" + toString(lvl) + ".bmesh");
+			}
+
+			std::vector<std::string> errors;
+			generateLODModels(to_gen, errors);
+			testAssert(errors.size() == 2);
+			for(int z=0; z<2; ++z)
+			{
+				testAssert(errors[z].empty());
+				testAssert(FileUtils::readEntireFile(to_gen.LOD_model_paths[z]) == FileUtils::readEntireFile(model_paths[i] + "_serial_lod" + toString(z + 1) + ".bmesh"));
+			}
+		}
+
+		// Generate with generateLODModelsInParallel(), check the results are the same as the serial path.
+		for(size_t max_num_in_flight=1; max_num_in_flight<=8; max_num_in_flight *= 2)
+		{
+			std::vector<LODModelsToGen> jobs(model_paths.size());
+			for(size_t i=0; i<model_paths.size(); ++i)
+			{
+				jobs[i].model_path = model_paths[i];
+				for(int lvl=1; lvl<=2; ++lvl)
+				{
+					jobs[i].lod_levels.push_back(lvl);
+					jobs[i].LOD_model_paths.push_back(model_paths[i] + "_parallel_lod" + toString(lvl) + ".bmesh");
+				}
+			}
+
+			// Also add a job with a missing source model, which should fail.
+			jobs.push_back(LODModelsToGen());
+			jobs.back().model_path = PlatformUtils::getTempDirPath() + "/lod_gen_test_missing.obj";
+			jobs.back().lod_levels.push_back(1);
+			jobs.back().LOD_model_paths.push_back(PlatformUtils::getTempDirPath() + "/lod_gen_test_missing_lod1.bmesh");
+
+			TestLODModelsGeneratedHandler handler;
+			generateLODModelsInParallel(jobs, task_manager, max_num_in_flight, handler);
+
+			testAssert(handler.job_errors.size() == jobs.size()); // Handler should be called exactly once for each job.
+			for(size_t i=0; i<model_paths.size(); ++i)
+			{
+				const std::vector<std::string>& errors = handler.job_errors[i];
+				testAssert(errors.size() == 2);
+				for(int z=0; z<2; ++z)
+				{
+					testAssert(errors[z].empty());
+					testAssert(FileUtils::readEntireFile(jobs[i].LOD_model_paths[z]) == FileUtils::readEntireFile(model_paths[i] + "_serial_lod" + toString(z + 1) + ".bmesh"));
+				}
+			}
+			testAssert(handler.job_errors[jobs.size() - 1].size() == 1);
+			testAssert(!handler.job_errors[jobs.size() - 1][0].empty());
+		}
+
+		// Perf test: serial vs parallel generation over a directory of sample models.
+		if(false)
+		{
+			const std::string sample_models_dir = TestUtils::getTestReposDir() + "/testfiles/bmesh";
+			const std::vector<std::string> sample_paths = FileUtils::getFilesInDirWithExtensionFullPaths(sample_models_dir, "bmesh");
+			const std::string out_dir = PlatformUtils::getTempDirPath() + "/lod_gen_perf_test";
+			FileUtils::createDirIfDoesNotExist(out_dir);
+
+			std::vector<LODModelsToGen> jobs(sample_paths.size());
+			for(size_t i=0; i<sample_paths.size(); ++i)
+			{
+				jobs[i].model_path = sample_paths[i];
+				for(int lvl=1; lvl<=2; ++lvl)
+				{
+					jobs[i].lod_levels.push_back(lvl);
+					jobs[i].LOD_model_paths.push_back(out_dir + "/" + FileUtils::getFilename(sample_paths[i]) + "_lod" + toString(lvl) + ".bmesh");
+				}
+			}
+
+			Timer timer;
+			for(size_t i=0; i<jobs.size(); ++i)
+				for(size_t z=0; z<jobs[i].lod_levels.size(); ++z)
+				{
+					try
+					{
+						generateLODModel(jobs[i].model_path, jobs[i].lod_levels[z], jobs[i].LOD_model_paths[z]);
+					}
+					catch(glare::Exception& e)
+					{
+						conPrint("Error: " + e.what());
+					}
+				}
+			const double serial_time = timer.elapsed();
+
+			timer.reset();
+			TestLODModelsGeneratedHandler handler;
+			generateLODModelsInParallel(jobs, task_manager, /*max num in flight=*/PlatformUtils::getNumLogicalProcessors(), handler);
+			const double parallel_time = timer.elapsed();
+
+			conPrint("Generating LOD models for " + toString(jobs.size()) + " models:");
+			conPrint("  serial (load per LOD level): " + doubleToStringNSigFigs(serial_time, 4) + " s");
+			conPrint("  parallel (load once):        " + doubleToStringNSigFigs(parallel_time, 4) + " s (" + doubleToStringNSigFigs(serial_time / parallel_time, 3) + "x speedup)");
+		}
 	}
 	catch(glare::Exception& e)
 	{
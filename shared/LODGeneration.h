@@ -11,6 +11,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <graphics/Map2D.h>
 #include <graphics/ImageMap.h>
 #include <string>
+#include <vector>
 class WorldMaterial;
 class WorldObject;
 class ResourceManager;
@@ -32,6 +33,33 @@ void generateLODModel(BatchedMeshRef batched_mesh, int lod_level, const std::str
 
 void generateLODModel(const std::string& model_path, int lod_level, const std::string& LOD_model_path);
 
+
+// A source model, and the LOD levels to generate from it.
+struct LODModelsToGen
+{
+	std::string model_path;
+	std::vector<int> lod_levels;
+	std::vector<std::string> LOD_model_paths; // LOD_model_paths[i] is the path to write the model for lod_levels[i] to.
+};
+
+// Loads and sanitises the source model once, then generates each LOD level from the in-memory mesh.
+// errors_out is resized to to_gen.lod_levels.size().  errors_out[i] is empty if LOD level i was written successfully, otherwise is the error message.
+void generateLODModels(const LODModelsToGen& to_gen, std::vector<std::string>& errors_out);
+
+class LODModelsGeneratedHandler
+{
+public:
+	virtual ~LODModelsGeneratedHandler() {}
+
+	// Called on the thread that called generateLODModelsInParallel(), after the models for job_index have been generated.
+	virtual void LODModelsGenerated(size_t job_index, const std::vector<std::string>& errors) = 0;
+};
+
+// Calls generateLODModels() for each job, running jobs on task_manager.
+// At most max_num_in_flight jobs are queued or running at once, which bounds the number of source meshes in memory.
+// Returns once all jobs are done.
+void generateLODModelsInParallel(const std::vector<LODModelsToGen>& jobs, glare::TaskManager& task_manager, size_t max_num_in_flight, LODModelsGeneratedHandler& handler);
+
 bool textureHasAlphaChannel(const std::string& tex_path, Map2DRef map);
 
 void generateLODTexture(const std::string& base_tex_path, int lod_level, const std::string& LOD_tex_path, glare::TaskManager& task_manager);
@@ -43,6 +71,9 @@ void generateLODTexturesForMaterialsIfNotPresent(std::vector<WorldMaterialRef>&
 
 void writeBasisUniversalKTXFile(const ImageMapUInt8& imagemap, const std::string& path);
 
+// Returns the contents of an OBJ file containing a bumpy res x res grid of quads, for tests.  Only defined if BUILD_TESTS is defined.
+std::string makeTestGridOBJ(int res);
+
 void test();
 
 }
@@ -33,13 +33,16 @@ CyberspaceProtocolVersion
 	Added scale to ObjectTransformUpdate message.
 38: Use length-prefixed serialisation for WorldMaterial, sending server version to client.
 39: Added QueryMapTiles, MapTilesResult
+40: Added TransformUpdateBatch, sent instead of AvatarTransformUpdate, ObjectTransformUpdate and ObjectPhysicsTransformUpdate messages.
+41: Added avatar and physics object transform updates sent as UDP datagrams (see TransformUDPChannel).
+	Client sends number of transform datagrams received in UDP discovery packets.
 */
 namespace Protocol
 {
 
 const uint32 CyberspaceHello = 1357924680;
 
-const uint32 CyberspaceProtocolVersion = 39;
+const uint32 CyberspaceProtocolVersion = 41;
 
 const uint32 ClientProtocolOK		= 10000;
 const uint32 ClientProtocolTooOld	= 10001;
@@ -81,6 +84,7 @@ const uint32 ObjectFlagsChanged		= 3011;
 const uint32 ObjectModelURLChanged	= 3012;
 const uint32 ObjectPhysicsOwnershipTaken	= 3013;
 const uint32 ObjectPhysicsTransformUpdate	= 3016;
+const uint32 TransformUpdateBatch	= 3040; // Transform updates for multiple avatars and objects.  See TransformBatch.h.  Sent to clients with protocol version >= 40.
 const uint32 SummonObject			= 3030;
 
 const uint32 CreateObject			= 3004; // Client wants to create an object.
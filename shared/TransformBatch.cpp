@@ -0,0 +1,743 @@
+/*=====================================================================
+TransformBatch.cpp
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "TransformBatch.h"
+
+
+#include "Protocol.h"
+#include "MessageUtils.h"
+#include <utils/SocketBufferOutStream.h>
+#include <utils/InStream.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <maths/mathstypes.h>
+#include <cmath>
+#include <limits>
+
+
+const double TransformBatch::POS_QUANTUM = 1.0 / 1024; // ~1 mm
+
+
+// Position encodings, stored in bits 2-3 of the type_and_pos_encoding byte.
+static const uint32 POS_ENCODING_INT16 = 0;
+static const uint32 POS_ENCODING_INT32 = 1;
+static const uint32 POS_ENCODING_FULL = 2;
+
+
+static inline bool quatsEqual(const Quatf& a, const Quatf& b)
+{
+	return a.v.x[0] == b.v.x[0] && a.v.x[1] == b.v.x[1] && a.v.x[2] == b.v.x[2] && a.v.x[3] == b.v.x[3];
+}
+
+
+TransformUpdate TransformUpdate::makeAvatarUpdate(const UID& uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state)
+{
+	TransformUpdate update;
+	update.type = Type_Avatar;
+	update.present_fields = FIELD_ROTATION | FIELD_ANIM_STATE;
+	update.uid = uid;
+	update.pos = pos;
+	update.avatar_rotation = rotation;
+	update.anim_state = anim_state;
+	update.rot = Quatf::identity();
+	update.scale = Vec3f(1.f);
+	update.linear_vel = update.angular_vel = Vec3f(0.f);
+	update.transform_update_avatar_uid = 0;
+	update.client_time = 0;
+	return update;
+}
+
+
+TransformUpdate TransformUpdate::makeObjectUpdate(const UID& uid, const Vec3d& pos, const Quatf& rot, const Vec3f& scale, uint32 transform_update_avatar_uid)
+{
+	TransformUpdate update;
+	update.type = Type_Object;
+	update.present_fields = FIELD_ROTATION | FIELD_SCALE;
+	update.uid = uid;
+	update.pos = pos;
+	update.avatar_rotation = Vec3f(0.f);
+	update.anim_state = 0;
+	update.rot = rot;
+	update.scale = scale;
+	update.linear_vel = update.angular_vel = Vec3f(0.f);
+	update.transform_update_avatar_uid = transform_update_avatar_uid;
+	update.client_time = 0;
+	return update;
+}
+
+
+TransformUpdate TransformUpdate::makeObjectPhysicsUpdate(const UID& uid, const Vec3d& pos, const Quatf& rot, const Vec3f& linear_vel, const Vec3f& angular_vel, uint32 transform_update_avatar_uid, double client_time)
+{
+	TransformUpdate update;
+	update.type = Type_ObjectPhysics;
+	update.present_fields = FIELD_ROTATION | FIELD_LINEAR_VEL | FIELD_ANGULAR_VEL;
+	update.uid = uid;
+	update.pos = pos;
+	update.avatar_rotation = Vec3f(0.f);
+	update.anim_state = 0;
+	update.rot = rot;
+	update.scale = Vec3f(1.f);
+	update.linear_vel = linear_vel;
+	update.angular_vel = angular_vel;
+	update.transform_update_avatar_uid = transform_update_avatar_uid;
+	update.client_time = client_time;
+	return update;
+}
+
+
+void TransformUpdate::setPresentFields(const TransformUpdate* prev)
+{
+	// An update of a different type (e.g. a physics update after a non-physics update) doesn't set all the fields of this type of update, so can't be used as a reference.
+	if(prev && (prev->type != type))
+		prev = NULL;
+
+	if(type == Type_Avatar)
+	{
+		// The anim state is always sent, as it isn't in the AvatarCreated and AvatarFullUpdate messages, so a client that starts getting updates for the avatar
+		// after the anim state last changed wouldn't get it otherwise.
+		present_fields = FIELD_ANIM_STATE;
+		if(!prev || (prev->avatar_rotation != avatar_rotation))
+			present_fields |= FIELD_ROTATION;
+	}
+	else if(type == Type_Object)
+	{
+		present_fields = 0;
+		if(!prev || !quatsEqual(prev->rot, rot))
+			present_fields |= FIELD_ROTATION;
+		if(!prev || (prev->scale != scale))
+			present_fields |= FIELD_SCALE;
+	}
+	else
+	{
+		// Physics objects will almost always be rotating, so always send the rotation.
+		present_fields = FIELD_ROTATION;
+		if(linear_vel != Vec3f(0.f))
+			present_fields |= FIELD_LINEAR_VEL;
+		if(angular_vel != Vec3f(0.f))
+			present_fields |= FIELD_ANGULAR_VEL;
+	}
+}
+
+
+static const float ROT_COMPONENT_MAX = 0.70710678f; // 1/sqrt(2): max magnitude of the components other than the largest.
+static const uint32 ROT_COMPONENT_BITS = 15;
+static const uint32 ROT_COMPONENT_MAX_QUANTISED = (1 << ROT_COMPONENT_BITS) - 1;
+
+
+uint64 TransformBatch::encodeRotation(const Quatf& rot)
+{
+	float c[4] = { rot.v.x[0], rot.v.x[1], rot.v.x[2], rot.v.x[3] };
+	float len2 = c[0]*c[0] + c[1]*c[1] + c[2]*c[2] + c[3]*c[3];
+	if(!(len2 > 1.0e-12f) || !isFinite(len2)) // If rotation is zero length or invalid, send the identity rotation.
+	{
+		c[0] = c[1] = c[2] = 0;
+		c[3] = 1;
+		len2 = 1;
+	}
+	const float recip_len = 1.f / std::sqrt(len2);
+
+	// Find the largest component.  The decoder recomputes it from the other three, using the unit length constraint.
+	int largest_i = 0;
+	for(int i=1; i<4; ++i)
+		if(std::fabs(c[i]) > std::fabs(c[largest_i]))
+			largest_i = i;
+
+	// q and -q represent the same rotation, so negate if needed to make the largest component positive.
+	const float scale = (c[largest_i] < 0) ? -recip_len : recip_len;
+
+	uint64 encoded = (uint64)largest_i << (ROT_COMPONENT_BITS * 3);
+	int shift = ROT_COMPONENT_BITS * 2;
+	for(int i=0; i<4; ++i)
+		if(i != largest_i)
+		{
+			const float x = c[i] * scale; // in [-ROT_COMPONENT_MAX, ROT_COMPONENT_MAX]
+			const float normalised = (x / ROT_COMPONENT_MAX) * 0.5f + 0.5f; // in [0, 1]
+			const int quantised = myClamp((int)std::lround(normalised * ROT_COMPONENT_MAX_QUANTISED), 0, (int)ROT_COMPONENT_MAX_QUANTISED);
+			encoded |= (uint64)quantised << shift;
+			shift -= ROT_COMPONENT_BITS;
+		}
+
+	return encoded;
+}
+
+
+Quatf TransformBatch::decodeRotation(uint64 encoded)
+{
+	const int largest_i = (int)((encoded >> (ROT_COMPONENT_BITS * 3)) & 0x3);
+
+	float c[4];
+	float sum2 = 0;
+	int shift = ROT_COMPONENT_BITS * 2;
+	for(int i=0; i<4; ++i)
+		if(i != largest_i)
+		{
+			const uint32 quantised = (uint32)(encoded >> shift) & ROT_COMPONENT_MAX_QUANTISED;
+			c[i] = ((float)quantised * (1.f / ROT_COMPONENT_MAX_QUANTISED) * 2.f - 1.f) * ROT_COMPONENT_MAX;
+			sum2 += c[i] * c[i];
+			shift -= ROT_COMPONENT_BITS;
+		}
+
+	c[largest_i] = std::sqrt(myMax(0.f, 1.f - sum2));
+
+	Quatf q;
+	q.v = Vec4f(c[0], c[1], c[2], c[3]);
+	return q;
+}
+
+
+static void writeRotation(const Quatf& rot, OutStream& stream)
+{
+	const uint64 encoded = TransformBatch::encodeRotation(rot);
+	const uint16 words[3] = { (uint16)(encoded >> 32), (uint16)(encoded >> 16), (uint16)encoded };
+	stream.writeData(words, sizeof(words));
+}
+
+
+static Quatf readRotation(InStream& stream)
+{
+	uint16 words[3];
+	stream.readData(words, sizeof(words));
+	return TransformBatch::decodeRotation(((uint64)words[0] << 32) | ((uint64)words[1] << 16) | (uint64)words[2]);
+}
+
+
+static void writeVec3f(const Vec3f& v, OutStream& stream)
+{
+	stream.writeFloat(v.x);
+	stream.writeFloat(v.y);
+	stream.writeFloat(v.z);
+}
+
+
+static Vec3f readVec3f(InStream& stream)
+{
+	const float x = stream.readFloat();
+	const float y = stream.readFloat();
+	const float z = stream.readFloat();
+	return Vec3f(x, y, z);
+}
+
+
+Vec3d TransformBatch::computeOrigin(const std::vector<const TransformUpdate*>& updates)
+{
+	// Use the centre of the bounding box of the positions as the origin, so positions are as close to the origin as possible.
+	Vec3d min_pos( std::numeric_limits<double>::infinity());
+	Vec3d max_pos(-std::numeric_limits<double>::infinity());
+	for(size_t i=0; i<updates.size(); ++i)
+	{
+		const Vec3d& pos = updates[i]->pos;
+		if(pos.isFinite())
+		{
+			min_pos = Vec3d(myMin(min_pos.x, pos.x), myMin(min_pos.y, pos.y), myMin(min_pos.z, pos.z));
+			max_pos = Vec3d(myMax(max_pos.x, pos.x), myMax(max_pos.y, pos.y), myMax(max_pos.z, pos.z));
+		}
+	}
+	return (min_pos.x <= max_pos.x) ? (min_pos + max_pos) * 0.5 : Vec3d(0.0);
+}
+
+
+void TransformBatch::writeUpdate(const TransformUpdate& update, const Vec3d& origin, OutStream& packet)
+{
+	const double recip_quantum = 1.0 / POS_QUANTUM;
+
+	// Work out position encoding
+	const double qx = std::round((update.pos.x - origin.x) * recip_quantum);
+	const double qy = std::round((update.pos.y - origin.y) * recip_quantum);
+	const double qz = std::round((update.pos.z - origin.z) * recip_quantum);
+	const double max_q = myMax(std::fabs(qx), myMax(std::fabs(qy), std::fabs(qz))); // Will be NaN or infinite if pos is not finite.
+
+	uint32 pos_encoding;
+	if(max_q <= 32767.0)
+		pos_encoding = POS_ENCODING_INT16;
+	else if(max_q <= 2147483647.0)
+		pos_encoding = POS_ENCODING_INT32;
+	else
+		pos_encoding = POS_ENCODING_FULL;
+
+	const uint8 type_and_pos_encoding = (uint8)(update.type | (pos_encoding << 2));
+	const uint8 present_fields = (uint8)update.present_fields;
+	packet.writeData(&type_and_pos_encoding, 1);
+	packet.writeData(&present_fields, 1);
+	writeToStream(update.uid, packet);
+
+	if(pos_encoding == POS_ENCODING_INT16)
+	{
+		const int16 q[3] = { (int16)qx, (int16)qy, (int16)qz };
+		packet.writeData(q, sizeof(q));
+	}
+	else if(pos_encoding == POS_ENCODING_INT32)
+	{
+		packet.writeInt32((int32)qx);
+		packet.writeInt32((int32)qy);
+		packet.writeInt32((int32)qz);
+	}
+	else
+	{
+		packet.writeDouble(update.pos.x);
+		packet.writeDouble(update.pos.y);
+		packet.writeDouble(update.pos.z);
+	}
+
+	if(update.type == TransformUpdate::Type_Avatar)
+	{
+		if(update.present_fields & TransformUpdate::FIELD_ROTATION)
+			writeVec3f(update.avatar_rotation, packet);
+		if(update.present_fields & TransformUpdate::FIELD_ANIM_STATE)
+			packet.writeUInt32(update.anim_state);
+	}
+	else
+	{
+		if(update.present_fields & TransformUpdate::FIELD_ROTATION)
+			writeRotation(update.rot, packet);
+		if(update.present_fields & TransformUpdate::FIELD_SCALE)
+			writeVec3f(update.scale, packet);
+		if(update.present_fields & TransformUpdate::FIELD_LINEAR_VEL)
+			writeVec3f(update.linear_vel, packet);
+		if(update.present_fields & TransformUpdate::FIELD_ANGULAR_VEL)
+			writeVec3f(update.angular_vel, packet);
+		packet.writeUInt32(update.transform_update_avatar_uid);
+		if(update.type == TransformUpdate::Type_ObjectPhysics)
+			packet.writeDouble(update.client_time);
+	}
+}
+
+
+void TransformBatch::writeBatchMessage(const std::vector<const TransformUpdate*>& updates, SocketBufferOutStream& packet)
+{
+	assert(updates.size() <= MAX_UPDATES_PER_MESSAGE);
+
+	const Vec3d origin = computeOrigin(updates);
+
+	MessageUtils::initPacket(packet, Protocol::TransformUpdateBatch);
+	packet.writeUInt32((uint32)updates.size());
+	packet.writeDouble(origin.x);
+	packet.writeDouble(origin.y);
+	packet.writeDouble(origin.z);
+
+	for(size_t i=0; i<updates.size(); ++i)
+		writeUpdate(*updates[i], origin, packet);
+
+	MessageUtils::updatePacketLengthField(packet);
+}
+
+
+void TransformBatch::readBatchMessage(InStream& stream, std::vector<TransformUpdate>& updates_out)
+{
+	const uint32 num_updates = stream.readUInt32();
+	if(num_updates > MAX_UPDATES_PER_MESSAGE)
+		throw glare::Exception("TransformUpdateBatch: too many updates: " + toString(num_updates));
+
+	Vec3d origin;
+	origin.x = stream.readDouble();
+	origin.y = stream.readDouble();
+	origin.z = stream.readDouble();
+
+	updates_out.resize(num_updates);
+	for(uint32 i=0; i<num_updates; ++i)
+		readUpdate(stream, origin, updates_out[i]);
+}
+
+
+void TransformBatch::readUpdate(InStream& stream, const Vec3d& origin, TransformUpdate& update)
+{
+	uint8 type_and_pos_encoding, present_fields;
+	stream.readData(&type_and_pos_encoding, 1);
+	stream.readData(&present_fields, 1);
+
+	update.type = type_and_pos_encoding & 0x3;
+	const uint32 pos_encoding = (type_and_pos_encoding >> 2) & 0x3;
+	if(update.type > TransformUpdate::Type_ObjectPhysics)
+		throw glare::Exception("TransformUpdateBatch: invalid update type " + toString(update.type));
+
+	update.present_fields = present_fields;
+	update.uid = readUIDFromStream(stream);
+
+	if(pos_encoding == POS_ENCODING_INT16)
+	{
+		int16 q[3];
+		stream.readData(q, sizeof(q));
+		update.pos = origin + Vec3d(q[0], q[1], q[2]) * POS_QUANTUM;
+	}
+	else if(pos_encoding == POS_ENCODING_INT32)
+	{
+		const int32 qx = stream.readInt32();
+		const int32 qy = stream.readInt32();
+		const int32 qz = stream.readInt32();
+		update.pos = origin + Vec3d(qx, qy, qz) * POS_QUANTUM;
+	}
+	else if(pos_encoding == POS_ENCODING_FULL)
+	{
+		update.pos.x = stream.readDouble();
+		update.pos.y = stream.readDouble();
+		update.pos.z = stream.readDouble();
+	}
+	else
+		throw glare::Exception("TransformUpdateBatch: invalid position encoding");
+
+	// Set fields that aren't present to defaults.
+	update.avatar_rotation = Vec3f(0.f);
+	update.anim_state = 0;
+	update.rot = Quatf::identity();
+	update.scale = Vec3f(1.f);
+	update.linear_vel = update.angular_vel = Vec3f(0.f);
+	update.transform_update_avatar_uid = 0;
+	update.client_time = 0;
+
+	if(update.type == TransformUpdate::Type_Avatar)
+	{
+		if(present_fields & TransformUpdate::FIELD_ROTATION)
+			update.avatar_rotation = readVec3f(stream);
+		if(present_fields & TransformUpdate::FIELD_ANIM_STATE)
+			update.anim_state = stream.readUInt32();
+	}
+	else
+	{
+		if(present_fields & TransformUpdate::FIELD_ROTATION)
+			update.rot = readRotation(stream);
+		if(present_fields & TransformUpdate::FIELD_SCALE)
+			update.scale = readVec3f(stream);
+		if(present_fields & TransformUpdate::FIELD_LINEAR_VEL)
+			update.linear_vel = readVec3f(stream);
+		if(present_fields & TransformUpdate::FIELD_ANGULAR_VEL)
+			update.angular_vel = readVec3f(stream);
+		update.transform_update_avatar_uid = stream.readUInt32();
+		if(update.type == TransformUpdate::Type_ObjectPhysics)
+			update.client_time = stream.readDouble();
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/BufferInStream.h>
+#include <maths/PCG32.h>
+
+
+static void checkRotationsEquivalent(const Quatf& a, const Quatf& b, float tol)
+{
+	// q and -q represent the same rotation.
+	const float dot = a.v.x[0]*b.v.x[0] + a.v.x[1]*b.v.x[1] + a.v.x[2]*b.v.x[2] + a.v.x[3]*b.v.x[3];
+	testAssert(std::fabs(std::fabs(dot) - 1.f) <= tol);
+}
+
+
+static Quatf randomRotation(PCG32& rng)
+{
+	Quatf q;
+	q.v = Vec4f(rng.unitRandom() * 2 - 1, rng.unitRandom() * 2 - 1, rng.unitRandom() * 2 - 1, rng.unitRandom() * 2 - 1);
+	const float len = std::sqrt(q.v.x[0]*q.v.x[0] + q.v.x[1]*q.v.x[1] + q.v.x[2]*q.v.x[2] + q.v.x[3]*q.v.x[3]);
+	q.v = q.v * (1.f / len);
+	return q;
+}
+
+
+static void roundTrip(const std::vector<TransformUpdate>& updates, std::vector<TransformUpdate>& decoded_out, size_t& msg_size_out)
+{
+	std::vector<const TransformUpdate*> update_ptrs;
+	for(size_t i=0; i<updates.size(); ++i)
+		update_ptrs.push_back(&updates[i]);
+
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	TransformBatch::writeBatchMessage(update_ptrs, packet);
+	msg_size_out = packet.buf.size();
+
+	BufferInStream stream;
+	stream.buf.resize(packet.buf.size());
+	std::memcpy(stream.buf.data(), packet.buf.data(), packet.buf.size());
+	testAssert(stream.readUInt32() == Protocol::TransformUpdateBatch);
+	testAssert(stream.readUInt32() == packet.buf.size());
+
+	TransformBatch::readBatchMessage(stream, decoded_out);
+	testAssert(stream.endOfStream());
+	testAssert(decoded_out.size() == updates.size());
+}
+
+
+// Size of the individual messages the updates would be sent as, for protocol versions < 40.
+static size_t individualMessagesSize(const std::vector<TransformUpdate>& updates)
+{
+	size_t size = 0;
+	for(size_t i=0; i<updates.size(); ++i)
+	{
+		if(updates[i].type == TransformUpdate::Type_Avatar)
+			size += 8 + sizeof(UID) + sizeof(Vec3d) + sizeof(Vec3f) + sizeof(uint32); // AvatarTransformUpdate
+		else if(updates[i].type == TransformUpdate::Type_Object)
+			size += 8 + sizeof(UID) + sizeof(Vec3d) + sizeof(Vec3f) + sizeof(float) + sizeof(Vec3f) + sizeof(uint32); // ObjectTransformUpdate
+		else
+			size += 8 + sizeof(UID) + sizeof(Vec3d) + sizeof(float) * 4 + sizeof(float) * 6 + sizeof(uint32) + sizeof(double); // ObjectPhysicsTransformUpdate
+	}
+	return size;
+}
+
+
+void TransformBatch::test()
+{
+	conPrint("TransformBatch::test()");
+
+	PCG32 rng(1);
+
+	//-------------------------- Test rotation encoding --------------------------
+	{
+		// Identity, and rotations with each component the largest, both positive and negative.
+		for(int i=0; i<4; ++i)
+			for(int sign=-1; sign<=1; sign += 2)
+			{
+				Quatf q;
+				q.v = Vec4f(0.1f, -0.2f, 0.3f, 0.15f);
+				q.v.x[i] = 0.9f * sign;
+				const float len = std::sqrt(q.v.x[0]*q.v.x[0] + q.v.x[1]*q.v.x[1] + q.v.x[2]*q.v.x[2] + q.v.x[3]*q.v.x[3]);
+				q.v = q.v * (1.f / len);
+
+				checkRotationsEquivalent(decodeRotation(encodeRotation(q)), q, 1.0e-6f);
+			}
+
+		checkRotationsEquivalent(decodeRotation(encodeRotation(Quatf::identity())), Quatf::identity(), 1.0e-7f);
+
+		// Zero and non-finite rotations should decode to the identity.
+		Quatf zero;
+		zero.v = Vec4f(0.f);
+		checkRotationsEquivalent(decodeRotation(encodeRotation(zero)), Quatf::identity(), 1.0e-7f);
+		Quatf nan;
+		nan.v = Vec4f(std::numeric_limits<float>::quiet_NaN(), 0, 0, 1);
+		checkRotationsEquivalent(decodeRotation(encodeRotation(nan)), Quatf::identity(), 1.0e-7f);
+
+		// Non-normalised rotations are normalised.
+		Quatf q = Quatf::fromAxisAndAngle(normalise(Vec3f(1, 2, 3)), 1.2f);
+		Quatf scaled_q;
+		scaled_q.v = q.v * 3.f;
+		checkRotationsEquivalent(decodeRotation(encodeRotation(scaled_q)), q, 1.0e-6f);
+
+		// Random rotations
+		float max_error = 0;
+		for(int i=0; i<100000; ++i)
+		{
+			const Quatf q = randomRotation(rng);
+			const Quatf decoded = decodeRotation(encodeRotation(q));
+			testAssert(encodeRotation(q) < ((uint64)1 << 48));
+			const float dot = std::fabs(q.v.x[0]*decoded.v.x[0] + q.v.x[1]*decoded.v.x[1] + q.v.x[2]*decoded.v.x[2] + q.v.x[3]*decoded.v.x[3]);
+			max_error = myMax(max_error, 1.f - dot);
+		}
+		conPrint("max rotation error (1 - |dot|): " + toString(max_error));
+		testAssert(max_error < 1.0e-6f);
+	}
+
+	//-------------------------- Test round-tripping updates --------------------------
+	{
+		std::vector<TransformUpdate> updates;
+		updates.push_back(TransformUpdate::makeAvatarUpdate(UID(1), Vec3d(10.0, 20.0, 1.8), Vec3f(0.f, 1.5f, 2.5f), 3 | (7 << 16)));
+		updates.push_back(TransformUpdate::makeObjectUpdate(UID(2), Vec3d(12.0, 19.0, 0.5), Quatf::fromAxisAndAngle(normalise(Vec3f(0, 0, 1)), 0.5f), Vec3f(1.f, 2.f, 3.f), 123));
+		updates.push_back(TransformUpdate::makeObjectPhysicsUpdate(UID(3), Vec3d(11.0, 21.0, 3.0), Quatf::fromAxisAndAngle(normalise(Vec3f(1, 1, 0)), -2.f), Vec3f(1, 2, 3), Vec3f(4, 5, 6), 456, 1000.25));
+		updates.push_back(TransformUpdate::makeObjectUpdate(UID(4), Vec3d(5000.0, -3000.0, 10.0), Quatf::identity(), Vec3f(1.f), 789)); // Needs a 32-bit position
+		updates.push_back(TransformUpdate::makeObjectUpdate(UID(5), Vec3d(1.0e9, 0.0, 0.0), Quatf::identity(), Vec3f(1.f), 789)); // Too far for 32-bit position
+		updates.push_back(TransformUpdate::makeAvatarUpdate(UID(6), Vec3d(std::numeric_limits<double>::infinity(), 0.0, 0.0), Vec3f(0.f), 0)); // Non-finite position
+
+		std::vector<TransformUpdate> decoded;
+		size_t msg_size;
+		roundTrip(updates, decoded, msg_size);
+
+		for(size_t i=0; i<updates.size(); ++i)
+		{
+			const TransformUpdate& a = updates[i];
+			const TransformUpdate& b = decoded[i];
+			testAssert(a.type == b.type);
+			testAssert(a.present_fields == b.present_fields);
+			testAssert(a.uid == b.uid);
+			if(a.pos.isFinite())
+			{
+				testAssert(std::fabs(a.pos.x - b.pos.x) <= TransformBatch::POS_QUANTUM * 0.5 + 1.0e-9);
+				testAssert(std::fabs(a.pos.y - b.pos.y) <= TransformBatch::POS_QUANTUM * 0.5 + 1.0e-9);
+				testAssert(std::fabs(a.pos.z - b.pos.z) <= TransformBatch::POS_QUANTUM * 0.5 + 1.0e-9);
+			}
+			else
+				testAssert(b.pos.x == a.pos.x);
+
+			if(a.type == TransformUpdate::Type_Avatar)
+			{
+				testAssert(a.avatar_rotation == b.avatar_rotation);
+				testAssert(a.anim_state == b.anim_state);
+			}
+			else
+			{
+				checkRotationsEquivalent(a.rot, b.rot, 1.0e-6f);
+				testAssert(a.transform_update_avatar_uid == b.transform_update_avatar_uid);
+				if(a.type == TransformUpdate::Type_Object)
+					testAssert(a.scale == b.scale);
+				else
+				{
+					testAssert(a.linear_vel == b.linear_vel);
+					testAssert(a.angular_vel == b.angular_vel);
+					testAssert(a.client_time == b.client_time);
+				}
+			}
+		}
+
+		// Empty batch
+		updates.clear();
+		roundTrip(updates, decoded, msg_size);
+		testAssert(decoded.empty());
+	}
+
+	//-------------------------- Test fields that haven't changed are not sent --------------------------
+	{
+		const TransformUpdate prev_avatar = TransformUpdate::makeAvatarUpdate(UID(1), Vec3d(0.0), Vec3f(0.f, 1.f, 2.f), 1);
+
+		TransformUpdate avatar = TransformUpdate::makeAvatarUpdate(UID(1), Vec3d(1.0), Vec3f(0.f, 1.f, 2.f), 1);
+		avatar.setPresentFields(&prev_avatar);
+		testAssert(avatar.present_fields == TransformUpdate::FIELD_ANIM_STATE); // Anim state is always sent.
+
+		avatar.avatar_rotation = Vec3f(0.f, 1.f, 2.5f);
+		avatar.setPresentFields(&prev_avatar);
+		testAssert(avatar.present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_ANIM_STATE));
+
+		avatar.setPresentFields(NULL);
+		testAssert(avatar.present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_ANIM_STATE));
+
+		const TransformUpdate prev_ob = TransformUpdate::makeObjectUpdate(UID(2), Vec3d(0.0), Quatf::identity(), Vec3f(2.f), 1);
+		TransformUpdate ob = TransformUpdate::makeObjectUpdate(UID(2), Vec3d(1.0), Quatf::identity(), Vec3f(2.f), 1);
+		ob.setPresentFields(&prev_ob);
+		testAssert(ob.present_fields == 0);
+		ob.scale = Vec3f(3.f);
+		ob.setPresentFields(&prev_ob);
+		testAssert(ob.present_fields == TransformUpdate::FIELD_SCALE);
+
+		// A previous update of a different type can't be used.
+		ob.setPresentFields(&prev_avatar);
+		testAssert(ob.present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_SCALE));
+
+		// Physics updates: zero velocities are not sent.
+		TransformUpdate phys = TransformUpdate::makeObjectPhysicsUpdate(UID(3), Vec3d(0.0), Quatf::identity(), Vec3f(0.f), Vec3f(0.f, 0.f, 1.f), 1, 0.0);
+		phys.setPresentFields(NULL);
+		testAssert(phys.present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_ANGULAR_VEL));
+
+		std::vector<TransformUpdate> updates(1, avatar);
+		updates[0].present_fields = 0;
+		updates.push_back(ob);
+		updates.push_back(phys);
+		std::vector<TransformUpdate> decoded;
+		size_t msg_size;
+		roundTrip(updates, decoded, msg_size);
+		testAssert(decoded[0].present_fields == 0);
+		testAssert(decoded[1].present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_SCALE));
+		testAssert(decoded[2].present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_ANGULAR_VEL));
+		testAssert(decoded[2].linear_vel == Vec3f(0.f) && decoded[2].angular_vel == Vec3f(0.f, 0.f, 1.f));
+	}
+
+	//-------------------------- Test invalid messages are rejected --------------------------
+	{
+		std::vector<TransformUpdate> updates(1, TransformUpdate::makeAvatarUpdate(UID(1), Vec3d(0.0), Vec3f(0.f), 0));
+		std::vector<const TransformUpdate*> update_ptrs(1, &updates[0]);
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		TransformBatch::writeBatchMessage(update_ptrs, packet);
+
+		std::vector<TransformUpdate> decoded;
+
+		// Invalid update type
+		{
+			BufferInStream stream;
+			stream.buf.resize(packet.buf.size());
+			std::memcpy(stream.buf.data(), packet.buf.data(), packet.buf.size());
+			stream.buf[8 + 4 + 24] = 3; // type_and_pos_encoding byte of first update.
+			stream.read_index = 8;
+			try
+			{
+				TransformBatch::readBatchMessage(stream, decoded);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// Too many updates
+		{
+			BufferInStream stream;
+			stream.buf.resize(packet.buf.size());
+			std::memcpy(stream.buf.data(), packet.buf.data(), packet.buf.size());
+			const uint32 num = 100000000;
+			std::memcpy(&stream.buf[8], &num, 4);
+			stream.read_index = 8;
+			try
+			{
+				TransformBatch::readBatchMessage(stream, decoded);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// Truncated message
+		{
+			BufferInStream stream;
+			stream.buf.resize(packet.buf.size() - 1);
+			std::memcpy(stream.buf.data(), packet.buf.data(), packet.buf.size() - 1);
+			stream.read_index = 8;
+			try
+			{
+				TransformBatch::readBatchMessage(stream, decoded);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+	}
+
+	//-------------------------- Compare bytes per tick with individual messages --------------------------
+	{
+		// Simulate ticks of updates for a crowd of avatars walking around within a few hundred metres, and some moving objects.
+		const int num_avatars = 100;
+		const int num_objects = 50;
+		const int num_physics_objects = 50;
+		const int num_ticks = 100;
+
+		std::vector<TransformUpdate> prev_updates(num_avatars + num_objects + num_physics_objects);
+		std::vector<bool> have_prev_update(prev_updates.size(), false);
+		std::vector<Vec3d> positions(prev_updates.size());
+		for(size_t i=0; i<positions.size(); ++i)
+			positions[i] = Vec3d(rng.unitRandom() * 400 - 200, rng.unitRandom() * 400 - 200, 1.0 + rng.unitRandom() * 10);
+
+		size_t total_individual_size = 0;
+		size_t total_batch_size = 0;
+		for(int t=0; t<num_ticks; ++t)
+		{
+			std::vector<TransformUpdate> updates;
+			for(size_t i=0; i<positions.size(); ++i)
+			{
+				positions[i] += Vec3d(rng.unitRandom() - 0.5, rng.unitRandom() - 0.5, 0) * 0.5;
+
+				TransformUpdate update;
+				if(i < num_avatars)
+					update = TransformUpdate::makeAvatarUpdate(UID(i), positions[i], Vec3f(0, 1.5f, (i % 10 == (size_t)t % 10) ? rng.unitRandom() * 6 : (float)i), /*anim_state=*/(t > 50) ? 1 : 0); // Heading changes occasionally.
+				else if(i < num_avatars + num_objects)
+					update = TransformUpdate::makeObjectUpdate(UID(i), positions[i], Quatf::fromAxisAndAngle(Vec3f(0, 0, 1), (float)i), Vec3f(1.f), 1); // Object being dragged around, without rotation or scale changes.
+				else
+					update = TransformUpdate::makeObjectPhysicsUpdate(UID(i), positions[i], randomRotation(rng), Vec3f(rng.unitRandom(), rng.unitRandom(), 0), Vec3f(0.f), 1, t * 0.1);
+
+				update.setPresentFields(have_prev_update[i] ? &prev_updates[i] : NULL);
+				prev_updates[i] = update;
+				have_prev_update[i] = true;
+				updates.push_back(update);
+			}
+
+			std::vector<TransformUpdate> decoded;
+			size_t batch_size;
+			roundTrip(updates, decoded, batch_size);
+
+			total_batch_size += batch_size;
+			total_individual_size += individualMessagesSize(updates);
+		}
+
+		conPrint("Transform updates for " + toString(num_avatars) + " avatars, " + toString(num_objects) + " objects and " + toString(num_physics_objects) + " physics objects:");
+		conPrint("Individual messages: " + toString(total_individual_size / num_ticks) + " B/tick");
+		conPrint("Batched messages:    " + toString(total_batch_size / num_ticks) + " B/tick (" + doubleToStringNSigFigs((double)total_batch_size / total_individual_size * 100, 3) + "%)");
+		testAssert(total_batch_size < total_individual_size);
+	}
+
+	conPrint("TransformBatch::test() done");
+}
+
+
+#endif // BUILD_TESTS
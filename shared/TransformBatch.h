@@ -0,0 +1,105 @@
+/*=====================================================================
+TransformBatch.h
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "UID.h"
+#include <maths/vec3.h>
+#include <maths/Quat.h>
+#include <utils/Platform.h>
+#include <vector>
+class SocketBufferOutStream;
+class OutStream;
+class InStream;
+
+
+/*=====================================================================
+TransformUpdate
+---------------
+The transform of a single avatar or object, as sent in a
+TransformUpdateBatch message.  Corresponds to an AvatarTransformUpdate,
+ObjectTransformUpdate or ObjectPhysicsTransformUpdate message.
+=====================================================================*/
+struct TransformUpdate
+{
+	enum Type
+	{
+		Type_Avatar = 0,
+		Type_Object = 1,
+		Type_ObjectPhysics = 2
+	};
+
+	// Bits for present_fields.
+	// Rotation and scale are only sent if they have changed since the last transform update for the entity.  If not present, the receiver should keep its current value.
+	// The avatar anim state is always sent.
+	// Velocities are only sent if non-zero.  If not present, they are zero.
+	static const uint32 FIELD_ROTATION		= 1;
+	static const uint32 FIELD_SCALE			= 2; // Objects only
+	static const uint32 FIELD_ANIM_STATE	= 4; // Avatars only
+	static const uint32 FIELD_LINEAR_VEL	= 8; // Physics objects only
+	static const uint32 FIELD_ANGULAR_VEL	= 16; // Physics objects only
+
+	uint32 type;
+	uint32 present_fields;
+	UID uid;
+	Vec3d pos;
+
+	Vec3f avatar_rotation; // Avatars only
+	uint32 anim_state; // Avatars only.  Anim state in the lower 16 bits, physics input bitflags in the upper 16 bits.
+
+	Quatf rot; // Objects and physics objects
+	Vec3f scale; // Objects only
+	Vec3f linear_vel; // Physics objects only
+	Vec3f angular_vel; // Physics objects only
+	uint32 transform_update_avatar_uid; // Objects and physics objects
+	double client_time; // Physics objects only
+
+	static TransformUpdate makeAvatarUpdate(const UID& uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state);
+	static TransformUpdate makeObjectUpdate(const UID& uid, const Vec3d& pos, const Quatf& rot, const Vec3f& scale, uint32 transform_update_avatar_uid);
+	static TransformUpdate makeObjectPhysicsUpdate(const UID& uid, const Vec3d& pos, const Quatf& rot, const Vec3f& linear_vel, const Vec3f& angular_vel, uint32 transform_update_avatar_uid, double client_time);
+
+	// Sets present_fields to the fields that need to be sent, given the last update that was sent for the entity.  prev_update may be NULL if no update has been sent.
+	void setPresentFields(const TransformUpdate* prev_update);
+};
+
+
+/*=====================================================================
+TransformBatch
+--------------
+Encoding and decoding of TransformUpdateBatch messages, which contain the
+transform updates for many avatars and objects in one message.
+
+Positions are quantised to POS_QUANTUM steps, relative to an origin for
+the batch, and written as 16 or 32 bit integers depending on the distance
+from the origin.  Positions too far from the origin (or non-finite
+positions) are written in full.
+
+Object rotations are written with the 'smallest three' quaternion
+encoding: the index of the largest component, and the other three
+components quantised to 15 bits each, in 6 bytes.
+=====================================================================*/
+class TransformBatch
+{
+public:
+	static const double POS_QUANTUM; // Position quantisation step size, in metres.
+	static const size_t MAX_UPDATES_PER_MESSAGE = 8192; // Keeps the message size well under the 1 MB message size limit in ClientThread.
+
+	// Writes a complete TransformUpdateBatch message to packet_out, including the message header.
+	static void writeBatchMessage(const std::vector<const TransformUpdate*>& updates, SocketBufferOutStream& packet_out);
+
+	// Reads the body of a TransformUpdateBatch message (after the header).  Throws glare::Exception if the message is invalid.
+	static void readBatchMessage(InStream& stream, std::vector<TransformUpdate>& updates_out);
+
+	// Lower level functions, also used for TransformUpdateBatch datagrams (see TransformUDPChannel).
+	static Vec3d computeOrigin(const std::vector<const TransformUpdate*>& updates); // Returns the origin to encode the update positions relative to.
+	static void writeUpdate(const TransformUpdate& update, const Vec3d& origin, OutStream& stream);
+	static void readUpdate(InStream& stream, const Vec3d& origin, TransformUpdate& update_out); // Throws glare::Exception if the update is invalid.
+
+	static uint64 encodeRotation(const Quatf& rot); // Returns 48-bit encoding of the normalised rotation.
+	static Quatf decodeRotation(uint64 encoded_rot);
+
+	static void test();
+};
@@ -0,0 +1,426 @@
+/*=====================================================================
+TransformUDPChannel.cpp
+-----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "TransformUDPChannel.h"
+
+
+#include <utils/SocketBufferOutStream.h>
+#include <utils/BufferViewInStream.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <cstring>
+
+
+static const size_t MIN_UPDATE_SIZE = 16; // type and position encoding, present fields, UID, int16 position, and rotation or anim state.
+
+
+void TransformUDPChannel::writeDatagrams(uint32 seq_num, const std::vector<const TransformUpdate*>& updates, SocketBufferOutStream& out, std::vector<size_t>& datagram_ends_out)
+{
+	// Use the same origin for all the datagrams of the tick.
+	const Vec3d origin = TransformBatch::computeOrigin(updates);
+
+	size_t i = 0;
+	while(i < updates.size())
+	{
+		const size_t datagram_start = out.buf.size();
+		out.writeUInt32(UDP_PACKET_TYPE);
+		out.writeUInt32(seq_num);
+		out.writeUInt32(0); // Number of updates, filled in below.
+		out.writeDouble(origin.x);
+		out.writeDouble(origin.y);
+		out.writeDouble(origin.z);
+		assert(out.buf.size() - datagram_start == HEADER_SIZE);
+
+		uint32 num_updates = 0;
+		for(; i<updates.size(); ++i)
+		{
+			TransformUpdate update = *updates[i];
+			update.setPresentFields(NULL); // Write all fields, as the receiver may not have received earlier updates.
+
+			const size_t update_start = out.buf.size();
+			TransformBatch::writeUpdate(update, origin, out);
+			if((out.buf.size() - datagram_start > MAX_DATAGRAM_SIZE) && (num_updates > 0)) // If the update doesn't fit in this datagram, remove it, and write it in the next datagram.
+			{
+				out.buf.resize(update_start);
+				break;
+			}
+			num_updates++;
+		}
+
+		std::memcpy(&out.buf[datagram_start + 8], &num_updates, sizeof(uint32));
+		datagram_ends_out.push_back(out.buf.size());
+	}
+}
+
+
+void TransformUDPChannel::readDatagram(const uint8* data, size_t len, uint32& seq_num_out, std::vector<TransformUpdate>& updates_out)
+{
+	BufferViewInStream stream(ArrayRef<uint8>(data, len));
+
+	const uint32 type = stream.readUInt32();
+	if(type != UDP_PACKET_TYPE)
+		throw glare::Exception("Transform datagram: invalid packet type " + toString(type));
+
+	seq_num_out = stream.readUInt32();
+
+	const uint32 num_updates = stream.readUInt32();
+	if(num_updates > MAX_DATAGRAM_SIZE / MIN_UPDATE_SIZE)
+		throw glare::Exception("Transform datagram: too many updates: " + toString(num_updates));
+
+	Vec3d origin;
+	origin.x = stream.readDouble();
+	origin.y = stream.readDouble();
+	origin.z = stream.readDouble();
+
+	updates_out.resize(num_updates);
+	for(uint32 i=0; i<num_updates; ++i)
+		TransformBatch::readUpdate(stream, origin, updates_out[i]);
+}
+
+
+TransformDatagramReceiver::TransformDatagramReceiver()
+:	num_datagrams_accepted(0),
+	num_datagrams_dropped(0),
+	received_datagram(false),
+	newest_seq_num(0)
+{
+}
+
+
+bool TransformDatagramReceiver::processDatagram(const uint8* data, size_t len, std::vector<TransformUpdate>& updates_out)
+{
+	uint32 seq_num;
+	TransformUDPChannel::readDatagram(data, len, seq_num, updates_out);
+
+	if(received_datagram && TransformUDPChannel::seqNumIsOlder(seq_num, newest_seq_num))
+	{
+		num_datagrams_dropped++;
+		return false;
+	}
+
+	received_datagram = true;
+	newest_seq_num = seq_num;
+	num_datagrams_accepted++;
+	return true;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "Avatar.h"
+#include <networking/UDPSocket.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <maths/PCG32.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
+#include <cmath>
+
+
+static std::vector<uint8> makeDatagram(uint32 seq_num, const std::vector<const TransformUpdate*>& updates)
+{
+	SocketBufferOutStream out(SocketBufferOutStream::DontUseNetworkByteOrder);
+	std::vector<size_t> datagram_ends;
+	TransformUDPChannel::writeDatagrams(seq_num, updates, out, datagram_ends);
+	testAssert(datagram_ends.size() == 1);
+	return std::vector<uint8>(out.buf.data(), out.buf.data() + out.buf.size());
+}
+
+
+static bool receiverAccepts(TransformDatagramReceiver& receiver, uint32 seq_num, const TransformUpdate& update)
+{
+	const std::vector<uint8> datagram = makeDatagram(seq_num, std::vector<const TransformUpdate*>(1, &update));
+	std::vector<TransformUpdate> updates;
+	const bool accepted = receiver.processDatagram(datagram.data(), datagram.size(), updates);
+	testAssert(updates.size() == 1 && updates[0].uid == update.uid);
+	return accepted;
+}
+
+
+static void testReadingInvalidDatagram(const std::vector<uint8>& datagram)
+{
+	try
+	{
+		uint32 seq_num;
+		std::vector<TransformUpdate> updates;
+		TransformUDPChannel::readDatagram(datagram.data(), datagram.size(), seq_num, updates);
+		failTest("Expected exception");
+	}
+	catch(glare::Exception&)
+	{}
+}
+
+
+// Position of the simulated avatar at time t: moving around a circle of radius 10 m at 5 m/s.
+static Vec3d simAvatarPos(double t)
+{
+	return Vec3d(10 * std::cos(0.5 * t), 10 * std::sin(0.5 * t), 1.0);
+}
+
+
+struct SimDatagram
+{
+	double delivery_time;
+	std::vector<uint8> data;
+};
+
+
+/*
+Simulates the server sending avatar transform updates at 10 Hz over a link that loses datagrams with probability loss_prob, and delays them by
+a random amount up to 'jitter' (which reorders them).  Datagrams are passed through the loopback sockets when they are delivered, then added as
+snapshots to an avatar, which is interpolated as on the client at 60 Hz.  Measures the distance between the interpolated and the true positions.
+*/
+static void measureInterpolationError(UDPSocket& send_socket, UDPSocket& recv_socket, double loss_prob, double jitter, bool drop_out_of_order,
+	double& rms_error_out, double& max_error_out, uint64& num_lost_out, uint64& num_dropped_out)
+{
+	const double send_period = 0.1;
+	const double base_latency = 0.05;
+	const double sim_duration = 30;
+
+	PCG32 rng(1);
+
+	std::vector<SimDatagram> in_flight;
+	num_lost_out = 0;
+	for(uint32 tick=0; tick * send_period < sim_duration; ++tick)
+	{
+		const double send_time = tick * send_period;
+		const TransformUpdate update = TransformUpdate::makeAvatarUpdate(UID(1), simAvatarPos(send_time), Vec3f(0, 0, (float)send_time), 0);
+		const std::vector<uint8> datagram = makeDatagram(/*seq num=*/tick, std::vector<const TransformUpdate*>(1, &update));
+
+		if(rng.unitRandom() < loss_prob)
+			num_lost_out++;
+		else
+			in_flight.push_back(SimDatagram({send_time + base_latency + rng.unitRandom() * jitter, datagram}));
+	}
+	std::stable_sort(in_flight.begin(), in_flight.end(), [](const SimDatagram& a, const SimDatagram& b) { return a.delivery_time < b.delivery_time; });
+
+	Reference<Avatar> avatar = new Avatar();
+	avatar->uid = UID(1);
+	for(int i=0; i<Avatar::HISTORY_BUF_SIZE; ++i)
+	{
+		avatar->pos_snapshots[i] = simAvatarPos(0);
+		avatar->rotation_snapshots[i] = Vec3f(0.f);
+		avatar->snapshot_times[i] = 0;
+	}
+
+	TransformDatagramReceiver receiver;
+	std::vector<TransformUpdate> received_updates;
+	std::vector<uint8> packet_buf(4096);
+	size_t next_delivery = 0;
+
+	// Avatars are rendered at a fixed delay behind the snapshot receive times (see Avatar::getInterpolatedTransform()), so compare with the
+	// true position at the render time minus that delay and the average latency.
+	const double interpolation_delay = send_period * 2;
+	const double mean_latency = base_latency + jitter * 0.5;
+
+	double sum_sqr_error = 0;
+	size_t num_samples = 0;
+	max_error_out = 0;
+	for(int frame=60; frame < (int)(sim_duration * 60); ++frame)
+	{
+		const double render_time = frame / 60.0;
+
+		for(; (next_delivery < in_flight.size()) && (in_flight[next_delivery].delivery_time <= render_time); ++next_delivery)
+		{
+			const SimDatagram& datagram = in_flight[next_delivery];
+			send_socket.sendPacket(datagram.data.data(), datagram.data.size(), IPAddress("127.0.0.1"), recv_socket.getThisEndPort());
+
+			IPAddress sender_ip;
+			int sender_port;
+			const size_t len = recv_socket.readPacket(packet_buf.data(), packet_buf.size(), sender_ip, sender_port);
+			testAssert(len == datagram.data.size());
+
+			bool apply = true;
+			if(drop_out_of_order)
+				apply = receiver.processDatagram(packet_buf.data(), len, received_updates);
+			else
+			{
+				uint32 seq_num;
+				TransformUDPChannel::readDatagram(packet_buf.data(), len, seq_num, received_updates);
+			}
+
+			if(apply)
+			{
+				testAssert(received_updates.size() == 1);
+				// Add snapshot as in WorldState::applyAvatarTransformUpdate(), with the simulated receive time.
+				const int i = Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE);
+				avatar->pos_snapshots[i] = received_updates[0].pos;
+				avatar->rotation_snapshots[i] = received_updates[0].avatar_rotation;
+				avatar->snapshot_times[i] = datagram.delivery_time;
+				avatar->next_snapshot_i++;
+			}
+		}
+
+		Vec3d pos;
+		Vec3f rotation;
+		avatar->getInterpolatedTransform(render_time, pos, rotation);
+
+		const double error = std::sqrt(pos.getDist2(simAvatarPos(render_time - interpolation_delay - mean_latency)));
+		sum_sqr_error += error * error;
+		max_error_out = myMax(max_error_out, error);
+		num_samples++;
+	}
+
+	rms_error_out = std::sqrt(sum_sqr_error / num_samples);
+	num_dropped_out = receiver.num_datagrams_dropped;
+}
+
+
+void TransformUDPChannel::test()
+{
+	conPrint("TransformUDPChannel::test()");
+
+	//-------------------------- Test writing and reading datagrams --------------------------
+	{
+		PCG32 rng(1);
+		std::vector<TransformUpdate> updates;
+		for(int i=0; i<300; ++i)
+		{
+			const Vec3d pos(-100 + rng.unitRandom() * 200, -100 + rng.unitRandom() * 200, rng.unitRandom() * 10);
+			TransformUpdate update;
+			if(i % 2 == 0)
+				update = TransformUpdate::makeAvatarUpdate(UID(i), pos, Vec3f(0, 0, rng.unitRandom()), /*anim state=*/i);
+			else
+				update = TransformUpdate::makeObjectPhysicsUpdate(UID(i), pos, Quatf::fromAxisAndAngle(Vec3f(0, 0, 1), rng.unitRandom()), Vec3f(1, 2, 3), Vec3f(0.f), /*avatar uid=*/7, /*client time=*/i);
+			update.present_fields = 0; // All fields should be written regardless.
+			updates.push_back(update);
+		}
+
+		std::vector<const TransformUpdate*> update_ptrs;
+		for(size_t i=0; i<updates.size(); ++i)
+			update_ptrs.push_back(&updates[i]);
+
+		SocketBufferOutStream out(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<size_t> datagram_ends;
+		TransformUDPChannel::writeDatagrams(/*seq num=*/123, update_ptrs, out, datagram_ends);
+		testAssert(datagram_ends.size() > 1);
+		testAssert(datagram_ends.back() == out.buf.size());
+
+		std::vector<TransformUpdate> decoded, datagram_updates;
+		size_t datagram_start = 0;
+		for(size_t d=0; d<datagram_ends.size(); ++d)
+		{
+			const size_t datagram_size = datagram_ends[d] - datagram_start;
+			testAssert(datagram_size <= MAX_DATAGRAM_SIZE);
+
+			uint32 seq_num;
+			readDatagram(out.buf.data() + datagram_start, datagram_size, seq_num, datagram_updates);
+			testAssert(seq_num == 123);
+			testAssert(!datagram_updates.empty());
+			decoded.insert(decoded.end(), datagram_updates.begin(), datagram_updates.end());
+			datagram_start = datagram_ends[d];
+		}
+
+		testAssert(decoded.size() == updates.size());
+		for(size_t i=0; i<updates.size(); ++i)
+		{
+			testAssert(decoded[i].type == updates[i].type);
+			testAssert(decoded[i].uid == updates[i].uid);
+			testAssert(std::sqrt(decoded[i].pos.getDist2(updates[i].pos)) < TransformBatch::POS_QUANTUM);
+			if(updates[i].type == TransformUpdate::Type_Avatar)
+			{
+				testAssert(decoded[i].present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_ANIM_STATE));
+				testAssert(decoded[i].avatar_rotation == updates[i].avatar_rotation);
+				testAssert(decoded[i].anim_state == updates[i].anim_state);
+			}
+			else
+			{
+				testAssert(decoded[i].present_fields == (TransformUpdate::FIELD_ROTATION | TransformUpdate::FIELD_LINEAR_VEL));
+				testAssert(decoded[i].linear_vel == updates[i].linear_vel);
+				testAssert(decoded[i].transform_update_avatar_uid == 7);
+				testAssert(decoded[i].client_time == updates[i].client_time);
+			}
+		}
+
+		// Writing no updates should give no datagrams.
+		datagram_ends.clear();
+		writeDatagrams(/*seq num=*/124, std::vector<const TransformUpdate*>(), out, datagram_ends);
+		testAssert(datagram_ends.empty());
+	}
+
+	//-------------------------- Test sequencing --------------------------
+	{
+		const TransformUpdate update = TransformUpdate::makeAvatarUpdate(UID(1), Vec3d(1, 2, 3), Vec3f(0.f), 0);
+
+		TransformDatagramReceiver receiver;
+		testAssert(receiverAccepts(receiver, 10, update));
+		testAssert(receiverAccepts(receiver, 10, update)); // Another datagram from the same tick
+		testAssert(receiverAccepts(receiver, 12, update));
+		testAssert(!receiverAccepts(receiver, 11, update)); // Arrived after a newer datagram, should be dropped.
+		testAssert(!receiverAccepts(receiver, 10, update));
+		testAssert(receiverAccepts(receiver, 13, update));
+		testAssert(receiver.num_datagrams_accepted == 4 && receiver.num_datagrams_dropped == 2);
+
+		// Test sequence number wrap-around
+		TransformDatagramReceiver receiver2;
+		testAssert(receiverAccepts(receiver2, 0xFFFFFFFEu, update));
+		testAssert(receiverAccepts(receiver2, 1, update));
+		testAssert(!receiverAccepts(receiver2, 0xFFFFFFFFu, update));
+		testAssert(receiverAccepts(receiver2, 2, update));
+	}
+
+	//-------------------------- Test invalid datagrams --------------------------
+	{
+		const TransformUpdate update = TransformUpdate::makeAvatarUpdate(UID(1), Vec3d(1, 2, 3), Vec3f(0.f), 0);
+		const std::vector<uint8> datagram = makeDatagram(1, std::vector<const TransformUpdate*>(1, &update));
+
+		std::vector<uint8> bad = datagram;
+		bad[0] = 1; // Voice packet type
+		testReadingInvalidDatagram(bad);
+
+		for(size_t len=0; len<datagram.size(); ++len) // Truncated datagrams
+			testReadingInvalidDatagram(std::vector<uint8>(datagram.begin(), datagram.begin() + len));
+
+		bad = datagram;
+		const uint32 huge_num_updates = 1000000;
+		std::memcpy(&bad[8], &huge_num_updates, 4);
+		testReadingInvalidDatagram(bad);
+	}
+
+	//-------------------------- Test over loopback with simulated loss and reordering, and measure the interpolation error --------------------------
+	try
+	{
+		Reference<UDPSocket> send_socket = new UDPSocket();
+		send_socket->bindToPort(0);
+		Reference<UDPSocket> recv_socket = new UDPSocket();
+		recv_socket->bindToPort(0);
+
+		const double loss_probs[] = { 0.0, 0.05, 0.2 };
+		const double jitters[] = { 0.0, 0.15 };
+		for(int l=0; l<3; ++l)
+		for(int j=0; j<2; ++j)
+		for(int drop=1; drop>=0; --drop)
+		{
+			if(jitters[j] == 0 && !drop) // Without jitter there is no reordering, so no difference.
+				continue;
+
+			double rms_error, max_error;
+			uint64 num_lost, num_dropped;
+			measureInterpolationError(*send_socket, *recv_socket, loss_probs[l], jitters[j], drop != 0, rms_error, max_error, num_lost, num_dropped);
+
+			conPrint("loss: " + doubleToStringNSigFigs(loss_probs[l] * 100, 2) + " %, jitter: " + doubleToStringNSigFigs(jitters[j] * 1000, 3) + " ms, " +
+				(drop ? "dropping out-of-order datagrams" : "applying all datagrams    ") + ": lost: " + toString(num_lost) + ", dropped: " + toString(num_dropped) +
+				", RMS interpolation error: " + doubleToStringNSigFigs(rms_error * 1000, 3) + " mm, max error: " + doubleToStringNSigFigs(max_error * 1000, 3) + " mm");
+
+			if(jitters[j] == 0)
+				testAssert(num_dropped == 0);
+			else if(drop)
+				testAssert(num_dropped > 0);
+
+			if(loss_probs[l] == 0 && jitters[j] == 0)
+				testAssert(max_error < 0.02); // Just quantisation and linear interpolation error.
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("TransformUDPChannel::test() done");
+}
+
+
+#endif // BUILD_TESTS
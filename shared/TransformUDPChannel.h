@@ -0,0 +1,77 @@
+/*=====================================================================
+TransformUDPChannel.h
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "TransformBatch.h"
+#include <utils/Platform.h>
+#include <vector>
+class SocketBufferOutStream;
+
+
+/*=====================================================================
+TransformUDPChannel
+-------------------
+Encoding of avatar and physics object transform updates sent from the
+server to clients as UDP datagrams.  Unlike the TCP connection, a lost
+datagram doesn't hold up the updates and messages sent after it.
+
+Datagram format:
+	uint32 packet type (UDP_PACKET_TYPE)
+	uint32 sequence number
+	uint32 number of updates
+	double origin x, y, z
+	updates, as written by TransformBatch::writeUpdate()
+
+All the datagrams for a server tick have the same sequence number.
+Since datagrams may be lost, every field of each update is written, not
+just the fields that have changed since the last update.
+=====================================================================*/
+class TransformUDPChannel
+{
+public:
+	static const uint32 UDP_PACKET_TYPE = 3; // Other UDP packet types: 1 = voice, 2 = client discovery packet.
+	static const size_t MAX_DATAGRAM_SIZE = 1200; // Keep datagrams under typical path MTUs, to avoid IP fragmentation.
+	static const size_t HEADER_SIZE = 36;
+
+	// Writes the updates into one or more datagrams, appended to datagrams_out.  The end offset of each datagram in datagrams_out.buf is appended to datagram_ends_out.
+	static void writeDatagrams(uint32 seq_num, const std::vector<const TransformUpdate*>& updates, SocketBufferOutStream& datagrams_out, std::vector<size_t>& datagram_ends_out);
+
+	// Reads a datagram, including the packet type.  Throws glare::Exception if the datagram is invalid.
+	static void readDatagram(const uint8* data, size_t len, uint32& seq_num_out, std::vector<TransformUpdate>& updates_out);
+
+	static bool seqNumIsOlder(uint32 a, uint32 b) { return (int32)(a - b) < 0; } // Is a older than b?  Handles wrap-around.
+
+	static void test();
+};
+
+
+/*=====================================================================
+TransformDatagramReceiver
+-------------------------
+Client-side sequencing of transform update datagrams.  A datagram that
+arrives after a datagram with a newer sequence number is dropped, as its
+updates have been superseded.  Applying it would move entities backwards.
+
+Datagrams with the same sequence number as the newest one are accepted,
+as they are the other datagrams for the same server tick.
+=====================================================================*/
+class TransformDatagramReceiver
+{
+public:
+	TransformDatagramReceiver();
+
+	// Returns true and sets updates_out if the updates in the datagram should be applied.  Returns false if the datagram is out of order.
+	// Throws glare::Exception if the datagram is invalid.
+	bool processDatagram(const uint8* data, size_t len, std::vector<TransformUpdate>& updates_out);
+
+	uint64 num_datagrams_accepted;
+	uint64 num_datagrams_dropped;
+
+private:
+	bool received_datagram;
+	uint32 newest_seq_num;
+};
@@ -65,6 +65,7 @@ WorldObject::WorldObject() noexcept
 	from_local_physics_dirty = false;
 	changed_flags = 0;
 	using_placeholder_model = false;
+	network_state_version = 0;
 
 #if GUI_CLIENT
 	is_selected = false;
@@ -345,6 +345,10 @@ public:
 	Vec4f translation; // As computed by a script.  Translation from current position in pos.
 
 	DatabaseKey database_key;
+	DatabaseKey transform_database_key; // Key of the object's transform record on the server, if it has one.  See ServerAllWorldsState::snapshotDirtyRecords().
+
+	// Incremented on the server whenever state written by writeToNetworkStream() changes, so that the cached ObjectInitialSend message for the object is re-serialised.  See server/ObjectPacketCache.h.
+	uint32 network_state_version;
 
 #if GUI_CLIENT
 	std::vector<InstanceInfo> instances;
@@ -0,0 +1,278 @@
+/*=====================================================================
+LatencyHistogram.cpp
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "LatencyHistogram.h"
+
+
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+
+const int LatencyHistogram::SUB_BUCKET_BITS;
+const uint64 LatencyHistogram::MAX_TRACKABLE_VALUE;
+
+
+static const uint64 SUB_BUCKET_COUNT = (uint64)1 << LatencyHistogram::SUB_BUCKET_BITS;
+static const uint64 SUB_BUCKET_HALF_COUNT = SUB_BUCKET_COUNT / 2;
+
+
+LatencyHistogram::LatencyHistogram()
+{
+	counts.resize(bucketIndexForValue(MAX_TRACKABLE_VALUE) + 1);
+	clear();
+}
+
+
+LatencyHistogram::~LatencyHistogram()
+{}
+
+
+// Buckets are arranged so that values < SUB_BUCKET_COUNT have their own bucket, then each subsequent power-of-two range of values
+// is split into SUB_BUCKET_HALF_COUNT buckets.
+size_t LatencyHistogram::bucketIndexForValue(uint64 value)
+{
+	value = std::min(value, MAX_TRACKABLE_VALUE);
+
+	uint64 shift = 0;
+	uint64 v = value;
+	while(v >= SUB_BUCKET_COUNT)
+	{
+		v >>= 1;
+		shift++;
+	}
+
+	return (size_t)(SUB_BUCKET_HALF_COUNT * shift + v);
+}
+
+
+uint64 LatencyHistogram::lowestValueForBucket(size_t bucket_index)
+{
+	if(bucket_index < SUB_BUCKET_COUNT)
+		return bucket_index;
+
+	const uint64 shift = bucket_index / SUB_BUCKET_HALF_COUNT - 1;
+	return (bucket_index - SUB_BUCKET_HALF_COUNT * shift) << shift;
+}
+
+
+uint64 LatencyHistogram::highestValueForBucket(size_t bucket_index)
+{
+	if(bucket_index < SUB_BUCKET_COUNT)
+		return bucket_index;
+
+	const uint64 shift = bucket_index / SUB_BUCKET_HALF_COUNT - 1;
+	return lowestValueForBucket(bucket_index) + ((uint64)1 << shift) - 1;
+}
+
+
+void LatencyHistogram::recordValue(uint64 value_us)
+{
+	value_us = std::min(value_us, MAX_TRACKABLE_VALUE);
+
+	counts[bucketIndexForValue(value_us)]++;
+	total_count++;
+	min_value = std::min(min_value, value_us);
+	max_value = std::max(max_value, value_us);
+	sum += (double)value_us;
+}
+
+
+void LatencyHistogram::recordTimeInterval(double interval_s)
+{
+	recordValue((interval_s > 0) ? (uint64)(interval_s * 1.0e6 + 0.5) : 0);
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+	assert(counts.size() == other.counts.size());
+	for(size_t i=0; i<counts.size(); ++i)
+		counts[i] += other.counts[i];
+
+	total_count += other.total_count;
+	min_value = std::min(min_value, other.min_value);
+	max_value = std::max(max_value, other.max_value);
+	sum += other.sum;
+}
+
+
+void LatencyHistogram::clear()
+{
+	std::fill(counts.begin(), counts.end(), 0);
+	total_count = 0;
+	min_value = std::numeric_limits<uint64>::max();
+	max_value = 0;
+	sum = 0;
+}
+
+
+double LatencyHistogram::mean() const
+{
+	return (total_count > 0) ? (sum / (double)total_count) : 0.0;
+}
+
+
+uint64 LatencyHistogram::valueAtPercentile(double percentile) const
+{
+	if(total_count == 0)
+		return 0;
+
+	// Number of values that must be <= the returned value.
+	const double frac = std::max(0.0, std::min(100.0, percentile)) / 100.0;
+	const uint64 target_count = std::max((uint64)1, (uint64)std::ceil(frac * (double)total_count));
+
+	uint64 count_so_far = 0;
+	for(size_t i=0; i<counts.size(); ++i)
+	{
+		count_so_far += counts[i];
+		if(count_so_far >= target_count)
+			return std::min(highestValueForBucket(i), max_value);
+	}
+
+	return max_value;
+}
+
+
+static const std::string usToMsString(double us)
+{
+	return doubleToStringNDecimalPlaces(us * 1.0e-3, 3);
+}
+
+
+std::string LatencyHistogram::toJSON() const
+{
+	return "{\"count\": " + toString(total_count) + 
+		", \"min_ms\": " + usToMsString((double)minValue()) + 
+		", \"mean_ms\": " + usToMsString(mean()) + 
+		", \"p50_ms\": " + usToMsString((double)valueAtPercentile(50)) + 
+		", \"p90_ms\": " + usToMsString((double)valueAtPercentile(90)) + 
+		", \"p99_ms\": " + usToMsString((double)valueAtPercentile(99)) + 
+		", \"p99_9_ms\": " + usToMsString((double)valueAtPercentile(99.9)) + 
+		", \"max_ms\": " + usToMsString((double)maxValue()) + "}";
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <PCG32.h>
+#include <maths/mathstypes.h>
+
+
+void LatencyHistogram::test()
+{
+	conPrint("LatencyHistogram::test()");
+
+	//-------------------- Test bucket boundaries --------------------
+	{
+		// Small values get their own bucket
+		for(uint64 v=0; v<SUB_BUCKET_COUNT; ++v)
+		{
+			testAssert(bucketIndexForValue(v) == v);
+			testAssert(lowestValueForBucket(v) == v && highestValueForBucket(v) == v);
+		}
+
+		// Buckets are contiguous, and each value maps to a bucket that contains it.
+		const size_t num_buckets = bucketIndexForValue(MAX_TRACKABLE_VALUE) + 1;
+		for(size_t i=1; i<num_buckets; ++i)
+		{
+			testAssert(lowestValueForBucket(i) == highestValueForBucket(i - 1) + 1);
+			testAssert(bucketIndexForValue(lowestValueForBucket(i)) == i);
+			testAssert(bucketIndexForValue(highestValueForBucket(i)) == i);
+
+			// Check relative precision
+			const uint64 width = highestValueForBucket(i) - lowestValueForBucket(i) + 1;
+			testAssert(width == 1 || (double)width / (double)lowestValueForBucket(i) <= 1.0 / SUB_BUCKET_HALF_COUNT);
+		}
+
+		// Values larger than the max trackable value are clamped
+		testAssert(bucketIndexForValue(MAX_TRACKABLE_VALUE * 4) == num_buckets - 1);
+	}
+
+	//-------------------- Test empty histogram --------------------
+	{
+		LatencyHistogram h;
+		testAssert(h.totalCount() == 0);
+		testAssert(h.minValue() == 0 && h.maxValue() == 0);
+		testAssert(h.mean() == 0);
+		testAssert(h.valueAtPercentile(50) == 0);
+	}
+
+	//-------------------- Test percentiles against exact values from a sorted array --------------------
+	{
+		PCG32 rng(1);
+		LatencyHistogram h;
+		std::vector<uint64> values;
+		double sum = 0;
+		for(int i=0; i<100000; ++i)
+		{
+			// Log-uniform distribution from 1 us to about 10 s.
+			const uint64 v = (uint64)std::exp(rng.unitRandom() * std::log(1.0e7));
+			values.push_back(v);
+			sum += (double)v;
+			h.recordValue(v);
+		}
+		std::sort(values.begin(), values.end());
+
+		testAssert(h.totalCount() == values.size());
+		testAssert(h.minValue() == values.front());
+		testAssert(h.maxValue() == values.back());
+		testAssert(epsEqual(h.mean(), sum / values.size()));
+
+		const double percentiles[] = { 0, 1, 10, 50, 90, 99, 99.9, 99.99, 100 };
+		for(size_t i=0; i<staticArrayNumElems(percentiles); ++i)
+		{
+			const size_t rank = std::max((size_t)1, (size_t)std::ceil(percentiles[i] / 100.0 * values.size()));
+			const uint64 exact = values[rank - 1];
+			const uint64 approx = h.valueAtPercentile(percentiles[i]);
+			testAssert(approx >= exact);
+			testAssert((double)(approx - exact) <= (double)exact / SUB_BUCKET_HALF_COUNT);
+		}
+	}
+
+	//-------------------- Test merge --------------------
+	{
+		LatencyHistogram a, b, all;
+		PCG32 rng(2);
+		for(int i=0; i<1000; ++i)
+		{
+			const uint64 v = (uint64)(rng.unitRandom() * 100000);
+			((i % 3 == 0) ? a : b).recordValue(v);
+			all.recordValue(v);
+		}
+
+		a.merge(b);
+		testAssert(a.totalCount() == all.totalCount());
+		testAssert(a.minValue() == all.minValue() && a.maxValue() == all.maxValue());
+		testAssert(epsEqual(a.mean(), all.mean()));
+		for(int p=0; p<=100; ++p)
+			testAssert(a.valueAtPercentile(p) == all.valueAtPercentile(p));
+		testAssert(a.toJSON() == all.toJSON());
+
+		a.clear();
+		testAssert(a.totalCount() == 0 && a.valueAtPercentile(99) == 0);
+	}
+
+	//-------------------- Test recordTimeInterval --------------------
+	{
+		LatencyHistogram h;
+		h.recordTimeInterval(0.0015);
+		h.recordTimeInterval(-1.0);
+		testAssert(h.totalCount() == 2);
+		testAssert(h.maxValue() == 1500);
+		testAssert(h.minValue() == 0);
+		testAssert(h.toJSON() == "{\"count\": 2, \"min_ms\": 0.000, \"mean_ms\": 0.750, \"p50_ms\": 0.000, \"p90_ms\": 1.500, \"p99_ms\": 1.500, \"p99_9_ms\": 1.500, \"max_ms\": 1.500}");
+	}
+
+	conPrint("LatencyHistogram::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,65 @@
+/*=====================================================================
+LatencyHistogram.h
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+LatencyHistogram
+----------------
+Records latency values (in microseconds) into log-linear buckets, in the
+style of an HDR histogram.  Values below 2^SUB_BUCKET_BITS are stored
+exactly, larger values are stored with a relative error of less than
+2^-(SUB_BUCKET_BITS - 1), so about 0.8%.
+
+Recording is constant time and doesn't allocate, so each bot thread can
+record into its own histogram, with the histograms merged at the end.
+
+Not threadsafe.
+=====================================================================*/
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+	~LatencyHistogram();
+
+	void recordValue(uint64 value_us);
+	void recordTimeInterval(double interval_s); // Records the interval in microseconds.  Negative intervals are recorded as zero.
+
+	void merge(const LatencyHistogram& other);
+	void clear();
+
+	uint64 totalCount() const { return total_count; }
+	uint64 minValue() const { return total_count > 0 ? min_value : 0; }
+	uint64 maxValue() const { return max_value; }
+	double mean() const;
+
+	// Returns the value at the given percentile (in [0, 100]), which will be >= the recorded value at that percentile, and within the bucket precision of it.
+	uint64 valueAtPercentile(double percentile) const;
+
+	// Returns a JSON object with count, min, mean, max and percentiles, with latencies in milliseconds.
+	std::string toJSON() const;
+
+	static size_t bucketIndexForValue(uint64 value);
+	static uint64 lowestValueForBucket(size_t bucket_index);
+	static uint64 highestValueForBucket(size_t bucket_index);
+
+	static void test();
+
+	static const int SUB_BUCKET_BITS = 8;
+	static const uint64 MAX_TRACKABLE_VALUE = (uint64)1 << 40; // About 12.7 days in microseconds.  Larger values are clamped.
+
+private:
+	std::vector<uint64> counts;
+	uint64 total_count;
+	uint64 min_value;
+	uint64 max_value;
+	double sum;
+};
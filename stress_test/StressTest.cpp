@@ -1,19 +1,21 @@
 /*=====================================================================
-ScreenshotBot.h
-----------------
+StressTest.cpp
+--------------
 Copyright Glare Technologies Limited 2021 -
 =====================================================================*/
 
 
+#include "LatencyHistogram.h"
 #include "../shared/Protocol.h"
 #include "../shared/UID.h"
 #include "../shared/Avatar.h"
+#include "../shared/TransformBatch.h"
 #include <networking/networking.h>
 #include <networking/TLSSocket.h>
 #include <networking/url.h>
 #include <utils/SocketBufferOutStream.h>
 #include <utils/BufferInStream.h>
-#include <utils/SocketBufferOutStream.h>
+#include <utils/ArgumentParser.h>
 #include <maths/vec3.h>
 #include <PlatformUtils.h>
 #include <Clock.h>
@@ -26,13 +28,55 @@ Copyright Glare Technologies Limited 2021 -
 #include <FileUtils.h>
 #include <StringUtils.h>
 #include <GlareProcess.h>
-#include <CryptoRNG.h>
+#include <Mutex.h>
+#include <Lock.h>
 #include <tls.h>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+
+/*
+Stress test for the Substrata server.
+
+Runs a number of bots, each with its own connection to the server.  Each bot creates an avatar and moves it around with one of several
+movement patterns, sending avatar transform updates at a fixed rate.  Bots can also log in (signing up if needed), create objects, and
+edit the transforms of their objects at a given rate.
+
+Latencies are measured by tagging each update with a sequence number (in the avatar roll angle, or the object x scale),
+and recording the time between sending the update and receiving the broadcast of it from the server:
+	round trip: the sending bot receiving its own update.
+	broadcast delivery: any other bot receiving the update.
+Since all bots run in this process, they share a clock.
+
+Latencies are recorded into HDR-style histograms, and a JSON summary is written for each bot count given with --num_bots.
+
+With --local_server, a server process is started with a fresh state dir, a self-signed TLS certificate (made with the openssl
+command line tool), and a generated world of scenery objects created by the bots.
+
+Example:
+	stress_test --local_server /path/to/server --num_bots 100,500,2000 --objects_per_bot 2 --object_edit_rate 1 --json_out results.json
+*/
 
 
-// TODO: do authentication
-//static const std::string username = "screenshotbot";
-//static const std::string password = "1NzpaaM3qN";
+struct StressTestConfig
+{
+	std::string server_hostname;
+	int server_port;
+	std::string world_name;
+	std::vector<int> num_bots_per_run;
+	double duration; // Length of measurement period, in seconds.
+	double warmup; // Time after all bots are launched before measurement starts, in seconds.
+	std::string movement; // "random_walk", "circle", "stationary" or "cluster"
+	double spawn_radius;
+	double avatar_update_rate; // Avatar transform updates per second per bot
+	int objects_per_bot;
+	double object_edit_rate; // Object transform edits per second per bot
+	double connect_rate; // Bots launched per second
+	std::string username_prefix;
+	std::string password;
+	int scenery_objects; // Total number of static objects to create in the first run.
+};
 
 
 static void updatePacketLengthField(SocketBufferOutStream& packet)
@@ -55,33 +99,231 @@ static void initPacket(SocketBufferOutStream& scratch_packet, uint32 message_id)
 }
 
 
+static void writeTimeStampToStream(uint64 time, SocketBufferOutStream& stream)
+{
+	stream.writeUInt32(1); // TimeStamp serialisation version
+	stream.writeData(&time, sizeof(time));
+}
+
+
+// Writes a CreateObject message for a hypercard object.
+// We don't link WorldObject into the stress test, so this needs to match WorldObject::writeToNetworkStream().
+static void writeCreateHypercardPacket(const Vec3d& pos, const std::string& content, SocketBufferOutStream& packet)
+{
+	initPacket(packet, Protocol::CreateObject);
+	writeToStream(UID::invalidUID(), packet); // Dummy UID, server will assign one.
+	packet.writeUInt32(1); // object_type = ObjectType_Hypercard
+	packet.writeStringLengthFirst(""); // model_url
+	packet.writeUInt32(0); // num materials
+	packet.writeStringLengthFirst(""); // lightmap_url
+	packet.writeStringLengthFirst(""); // script
+	packet.writeStringLengthFirst(content);
+	packet.writeStringLengthFirst(""); // target_url
+	packet.writeStringLengthFirst(""); // audio_source_url
+	packet.writeFloat(1.f); // audio_volume
+	writeToStream(pos, packet);
+	writeToStream(Vec3f(0, 0, 1), packet); // axis
+	packet.writeFloat(0.f); // angle
+	writeToStream(Vec3f(1, 1, 1), packet); // scale
+	writeTimeStampToStream(0, packet); // created_time
+	writeTimeStampToStream(0, packet); // last_modified_time
+	packet.writeUInt32(0); // creator_id, will be set by server
+	packet.writeUInt32(0); // flags
+	packet.writeStringLengthFirst(""); // creator_name
+	const float aabb_min[3] = { 0, 0, 0 };
+	const float aabb_max[3] = { 1, 0.01f, 1 };
+	packet.writeData(aabb_min, sizeof(float) * 3);
+	packet.writeData(aabb_max, sizeof(float) * 3);
+	packet.writeInt32(0); // max_model_lod_level
+	packet.writeFloat(50.f); // mass
+	packet.writeFloat(0.5f); // friction
+	packet.writeFloat(0.2f); // restitution
+	packet.writeUInt32(std::numeric_limits<uint32>::max()); // physics_owner_id
+	packet.writeDouble(0.0); // last_physics_ownership_change_global_time
+	writeToStream(Vec3f(0, 0, 0), packet); // centre_of_mass_offset_os
+	updatePacketLengthField(packet);
+}
+
+
+// The object sequence number is sent in the x scale, as 1 + seq * OBJECT_SEQ_SCALE_STEP.  The rotation can't be used as it's quantised in TransformUpdateBatch messages,
+// whereas the scale is sent as floats, which can represent these values exactly.
+static const float OBJECT_SEQ_SCALE_STEP = 1.f / 65536;
+
+static inline Vec3f objectScaleForSeq(uint32 seq) { return Vec3f(1.f + (float)(seq & 0xFFFF) * OBJECT_SEQ_SCALE_STEP, 1.f, 1.f); }
+static inline uint32 objectSeqFromScale(const Vec3f& scale) { return (uint32)std::lround((scale.x - 1.f) / OBJECT_SEQ_SCALE_STEP); }
+
+
+/*=====================================================================
+SentTimes
+---------
+Ring buffer of the send times of the most recent updates sent by a bot,
+indexed by sequence number.  Written by the sending bot, read by all bots
+when they receive the broadcast update, so each slot is a single atomic
+holding both the (masked) sequence number and the send time.
+=====================================================================*/
+class SentTimes
+{
+public:
+	static const uint32 RING_SIZE = 1024;
+	static const uint32 SEQ_BITS = 16;
+	static const uint64 SEQ_MASK = ((uint64)1 << SEQ_BITS) - 1;
+
+	SentTimes()
+	{
+		for(uint32 i=0; i<RING_SIZE; ++i)
+			slots[i] = std::numeric_limits<uint64>::max();
+	}
+
+	void recordSend(uint32 seq, uint64 send_time_us)
+	{
+		slots[seq % RING_SIZE].store((send_time_us << SEQ_BITS) | (seq & SEQ_MASK), std::memory_order_relaxed);
+	}
+
+	// Returns false if the send time for seq has been overwritten, or was never recorded.
+	bool lookup(uint32 seq, uint64& send_time_us_out) const
+	{
+		const uint64 slot = slots[seq % RING_SIZE].load(std::memory_order_relaxed);
+		if(slot == std::numeric_limits<uint64>::max() || (slot & SEQ_MASK) != (seq & SEQ_MASK))
+			return false;
+		send_time_us_out = slot >> SEQ_BITS;
+		return true;
+	}
+
+private:
+	std::atomic<uint64> slots[RING_SIZE];
+};
+
+
+class StressTestBotThread;
+
+
+// State shared between all bots in one run.
+struct StressTestRun
+{
+	StressTestRun() : should_quit(0), measure_start_time_us(std::numeric_limits<uint64>::max()) {}
+
+	int findBotForAvatarUID(uint32 avatar_uid)
+	{
+		Lock lock(avatar_uid_mutex);
+		auto res = avatar_uid_to_bot_index.find(avatar_uid);
+		return (res != avatar_uid_to_bot_index.end()) ? res->second : -1;
+	}
+
+	StressTestConfig config;
+	struct tls_config* client_tls_config;
+	bool create_scenery;
+	double start_time; // Clock::getCurTimeRealSec() at start of program, times in microseconds are relative to this.
+
+	std::vector<StressTestBotThread*> bots;
+
+	std::atomic<int> should_quit;
+	std::atomic<uint64> measure_start_time_us; // Updates sent before this time are not measured.
+
+	Mutex avatar_uid_mutex;
+	std::unordered_map<uint32, int> avatar_uid_to_bot_index GUARDED_BY(avatar_uid_mutex);
+};
+
+
 class StressTestBotThread : public MyThread
 {
 public:
-	virtual void run()
+	StressTestBotThread(StressTestRun* test_run_, int bot_index_)
+	:	test_run(test_run_),
+		bot_index(bot_index_),
+		connected(false),
+		num_avatar_updates_sent(0),
+		num_object_edits_sent(0),
+		num_messages_received(0),
+		num_bytes_received(0)
+	{}
+
+	uint64 curTimeUS() const
 	{
-		// Connect to substrata server
-		try
+		return (uint64)((Clock::getCurTimeRealSec() - test_run->start_time) * 1.0e6);
+	}
+
+	bool measuring(uint64 time_us) const { return time_us >= test_run->measure_start_time_us.load(); }
+
+	// Returns the bot that owns the avatar, or NULL if it's not a bot in this run.
+	StressTestBotThread* lookUpBotForAvatar(uint32 avatar_uid)
+	{
+		auto res = avatar_uid_to_bot_cache.find(avatar_uid);
+		int index;
+		if(res != avatar_uid_to_bot_cache.end())
+			index = res->second;
+		else
+		{
+			// Bots register their avatar UID before creating their avatar, so a miss here can be cached.
+			index = test_run->findBotForAvatarUID(avatar_uid);
+			avatar_uid_to_bot_cache[avatar_uid] = index;
+		}
+		return (index >= 0) ? test_run->bots[index] : NULL;
+	}
+
+	void recordLatency(StressTestBotThread* sender, const SentTimes& sent_times, uint32 seq, LatencyHistogram& round_trip_hist, LatencyHistogram& broadcast_hist)
+	{
+		uint64 send_time_us;
+		if(sent_times.lookup(seq, send_time_us) && measuring(send_time_us))
 		{
-			//const std::string server_hostname = "localhost";
-			const std::string server_hostname = "substrata.info";
-			const int server_port = 7600;
+			const uint64 now_us = curTimeUS();
+			const uint64 latency_us = (now_us > send_time_us) ? (now_us - send_time_us) : 0;
+			if(sender == this)
+				round_trip_hist.recordValue(latency_us);
+			else
+				broadcast_hist.recordValue(latency_us);
+		}
+	}
+
+	void sendPacket(SocketInterface& socket, SocketBufferOutStream& packet)
+	{
+		socket.writeData(packet.buf.data(), packet.buf.size());
+	}
+
+	std::string username() const { return test_run->config.username_prefix + toString(bot_index); }
+	std::string objectContentMarker() const { return "stress test bot " + toString(bot_index); }
+
+	void createObjects(SocketInterface& socket, PCG32& rng, SocketBufferOutStream& scratch_packet)
+	{
+		const StressTestConfig& config = test_run->config;
 
-			conPrint("Connecting to " + server_hostname + ":" + toString(server_port) + "...");
+		for(int i=0; i<config.objects_per_bot; ++i)
+		{
+			const Vec3d pos = spawn_pos + Vec3d(rng.unitRandom() * 4 - 2, rng.unitRandom() * 4 - 2, 0);
+			writeCreateHypercardPacket(pos, objectContentMarker(), scratch_packet);
+			sendPacket(socket, scratch_packet);
+		}
 
+		// Create this bot's share of the scenery objects.
+		if(test_run->create_scenery)
+		{
+			const int num_bots = (int)test_run->bots.size();
+			const int num_scenery = config.scenery_objects / num_bots + ((bot_index < config.scenery_objects % num_bots) ? 1 : 0);
+			for(int i=0; i<num_scenery; ++i)
+			{
+				const double r = std::sqrt(rng.unitRandom()) * config.spawn_radius;
+				const double theta = rng.unitRandom() * Maths::get2Pi<double>();
+				writeCreateHypercardPacket(Vec3d(r * cos(theta), r * sin(theta), 0), "stress test scenery", scratch_packet);
+				sendPacket(socket, scratch_packet);
+			}
+		}
+	}
+
+	virtual void run()
+	{
+		const StressTestConfig& config = test_run->config;
+		try
+		{
 			MySocketRef plain_socket = new MySocket();
 			plain_socket->setUseNetworkByteOrder(false);
-			plain_socket->connect(server_hostname, server_port);
+			plain_socket->connect(config.server_hostname, config.server_port);
 
-			conPrint("Connected to " + server_hostname + ":" + toString(server_port) + "!");
-
-			SocketInterfaceRef socket = new TLSSocket(plain_socket, client_tls_config, server_hostname);
+			SocketInterfaceRef socket = new TLSSocket(plain_socket, test_run->client_tls_config, config.server_hostname);
 
 			socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
 			socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
 			socket->writeUInt32(Protocol::ConnectionTypeUpdates); // Write connection type
 
-			socket->writeStringLengthFirst(""); // Write world name
+			socket->writeStringLengthFirst(config.world_name); // Write world name
 
 			// Read hello response from server
 			const uint32 hello_response = socket->readUInt32();
@@ -105,23 +347,35 @@ public:
 			else
 				throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
 
-			const uint32 peer_protocol_version = Protocol::CyberspaceProtocolVersion; // Just assume server is speaking the latest procotol version we know about, for now.
-			// TODO: Send server protocol version from the server.
-
+			// Read server protocol version
+			/*const uint32 server_protocol_version =*/ socket->readUInt32();
 
 			// Read assigned client avatar UID
 			const UID client_avatar_uid = readUIDFromStream(*socket);
 
+			// Register our avatar UID so other bots can attribute updates to us, before any updates are sent.
+			{
+				Lock lock(test_run->avatar_uid_mutex);
+				test_run->avatar_uid_to_bot_index[(uint32)client_avatar_uid.value()] = bot_index;
+			}
 
-			Vec3d cur_pos(0,0,1.67);
-			Vec3d cur_vel(0.5,0,0);
-			Vec3f cur_angles(0, Maths::pi_2<float>(), 0);
+			connected = true;
 
+			PCG32 rng(bot_index + 1);
+
+			// Choose spawn position
+			const double spawn_radius = (config.movement == "cluster") ? myMin(5.0, config.spawn_radius) : config.spawn_radius;
+			{
+				const double r = std::sqrt(rng.unitRandom()) * spawn_radius;
+				const double theta = rng.unitRandom() * Maths::get2Pi<double>();
+				spawn_pos = Vec3d(r * cos(theta), r * sin(theta), 1.67);
+			}
 
-			PCG32 rng(seed);
+			Vec3d cur_pos = spawn_pos;
 			float heading = rng.unitRandom() * Maths::get2Pi<float>();
-			cur_angles = Vec3f(0, Maths::pi_2<float>(), heading);
-			cur_vel = Vec3d(cos(heading), sin(heading), 0) * 2;
+			Vec3d cur_vel = Vec3d(cos(heading), sin(heading), 0) * 2;
+			const double circle_radius = 5;
+			double circle_phase = rng.unitRandom() * Maths::get2Pi<double>();
 
 			SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 			// Send CreateAvatar packet for this client's avatar
@@ -131,37 +385,49 @@ public:
 				Avatar avatar;
 				avatar.uid = client_avatar_uid;
 				avatar.pos = cur_pos;
-				avatar.rotation = cur_angles;
+				avatar.rotation = Vec3f(0, Maths::pi_2<float>(), heading);
 				writeToNetworkStream(avatar, scratch_packet);
 
 				updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				sendPacket(*socket, scratch_packet);
 			}
 
-			
-			Timer timer;
-			Timer time_since_update_packet_sent;
+			// Log in if we need to create objects.  If login fails, we will try signing up instead.
+			enum LoginState { LoginState_NotLoggedIn, LoginState_LoggingIn, LoginState_SigningUp, LoginState_LoggedIn, LoginState_Failed };
+			LoginState login_state = LoginState_NotLoggedIn;
+			if(config.objects_per_bot > 0 || test_run->create_scenery)
+			{
+				initPacket(scratch_packet, Protocol::LogInMessage);
+				scratch_packet.writeStringLengthFirst(username());
+				scratch_packet.writeStringLengthFirst(config.password);
+				updatePacketLengthField(scratch_packet);
+				sendPacket(*socket, scratch_packet);
+				login_state = LoginState_LoggingIn;
+			}
 
 			BufferInStream msg_buffer;
-
-			
+			std::vector<TransformUpdate> batch_updates;
 			Timer change_dir_timer;
-			
-
 			double last_think_time = Clock::getCurTimeRealSec();
+			double next_avatar_update_time = last_think_time;
+			double next_object_edit_time = last_think_time;
+			uint32 avatar_seq = 0;
+			uint32 object_seq = 0;
 
-			while(1)
+			while(test_run->should_quit.load() == 0)
 			{
-				if(socket->readable(/*timeout_s=*/0.05))
+				// Read all messages that are available
+				double read_timeout = 0.01;
+				while(socket->readable(read_timeout))
 				{
+					read_timeout = 0;
+
 					// Read msg type and length
 					uint32 msg_type_and_len[2];
 					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
 					const uint32 msg_type = msg_type_and_len[0];
 					const uint32 msg_len = msg_type_and_len[1];
 
-					// conPrint("ClientThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
-
 					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
 						throw glare::Exception("Invalid message size: " + toString(msg_len));
 
@@ -171,102 +437,597 @@ public:
 
 					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
 
-					//conPrint("Read msg of type " + toString(msg_type));
+					if(measuring(curTimeUS()))
+					{
+						num_messages_received++;
+						num_bytes_received += msg_len;
+					}
 
 					switch(msg_type)
 					{
-						case Protocol::AllObjectsSent:
+						case Protocol::AvatarTransformUpdate:
 						{
-						}
-					}
-				} // end if socket was readable
+							const UID avatar_uid = readUIDFromStream(msg_buffer);
+							/*const Vec3d pos =*/ readVec3FromStream<double>(msg_buffer);
+							const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
 
-				// Change heading to a random value every couple of seconds
-				if(change_dir_timer.elapsed() > 2)
-				{
-					heading = rng.unitRandom() * Maths::get2Pi<float>();// (float)std::atan2(cur_vel.y, cur_vel.x);
-					cur_angles = Vec3f(0, Maths::pi_2<float>(), heading);
+							StressTestBotThread* sender = lookUpBotForAvatar((uint32)avatar_uid.value());
+							if(sender)
+								recordLatency(sender, sender->avatar_sent_times, (uint32)rotation.x, avatar_round_trip_hist, avatar_broadcast_hist);
+							break;
+						}
+						case Protocol::ObjectTransformUpdate:
+						{
+							const UID object_uid = readUIDFromStream(msg_buffer);
+							/*const Vec3d pos =*/ readVec3FromStream<double>(msg_buffer);
+							/*const Vec3f axis =*/ readVec3FromStream<float>(msg_buffer);
+							/*const float angle =*/ msg_buffer.readFloat();
+							const Vec3f scale = readVec3FromStream<float>(msg_buffer);
+							const uint32 last_transform_update_avatar_uid = msg_buffer.readUInt32();
 
-					//cur_vel = normalise(Vec3d(rng.unitRandom(), rng.unitRandom(), 0));
-					cur_vel = Vec3d(cos(heading), sin(heading), 0) * 2;
+							StressTestBotThread* sender = lookUpBotForAvatar(last_transform_update_avatar_uid);
+							if(sender)
+								recordLatency(sender, sender->object_sent_times, objectSeqFromScale(scale), object_round_trip_hist, object_broadcast_hist);
+							break;
+						}
+						case Protocol::TransformUpdateBatch: // Sent instead of the individual transform update messages above, for protocol version >= 40.
+						{
+							TransformBatch::readBatchMessage(msg_buffer, batch_updates);
+							for(size_t i=0; i<batch_updates.size(); ++i)
+							{
+								const TransformUpdate& update = batch_updates[i];
+								// Rotation and scale are left out if they haven't changed, but the sequence number changes with every update, so they will be present for our updates.
+								if(update.type == TransformUpdate::Type_Avatar && (update.present_fields & TransformUpdate::FIELD_ROTATION))
+								{
+									StressTestBotThread* sender = lookUpBotForAvatar((uint32)update.uid.value());
+									if(sender)
+										recordLatency(sender, sender->avatar_sent_times, (uint32)update.avatar_rotation.x, avatar_round_trip_hist, avatar_broadcast_hist);
+								}
+								else if(update.type == TransformUpdate::Type_Object && (update.present_fields & TransformUpdate::FIELD_SCALE))
+								{
+									StressTestBotThread* sender = lookUpBotForAvatar(update.transform_update_avatar_uid);
+									if(sender)
+										recordLatency(sender, sender->object_sent_times, objectSeqFromScale(update.scale), object_round_trip_hist, object_broadcast_hist);
+								}
+							}
+							break;
+						}
+						case Protocol::ObjectCreated:
+						{
+							// Parse just enough of the object to see if it's one of ours, and get its position.  See WorldObject::writeToNetworkStream().
+							const UID object_uid = readUIDFromStream(msg_buffer);
+							/*const uint32 object_type =*/ msg_buffer.readUInt32();
+							/*const std::string model_url =*/ msg_buffer.readStringLengthFirst(10000);
+							const uint32 num_materials = msg_buffer.readUInt32();
+							if(num_materials == 0) // Our objects don't have any materials.
+							{
+								/*const std::string lightmap_url =*/ msg_buffer.readStringLengthFirst(10000);
+								/*const std::string script =*/ msg_buffer.readStringLengthFirst(10000);
+								const std::string content = msg_buffer.readStringLengthFirst(10000);
+								if(content == objectContentMarker())
+								{
+									/*const std::string target_url =*/ msg_buffer.readStringLengthFirst(10000);
+									/*const std::string audio_source_url =*/ msg_buffer.readStringLengthFirst(10000);
+									/*const float audio_volume =*/ msg_buffer.readFloat();
+									const Vec3d pos = readVec3FromStream<double>(msg_buffer);
 
-					change_dir_timer.reset();
-				}
+									own_object_uids.push_back(object_uid);
+									own_object_positions.push_back(pos);
+								}
+							}
+							break;
+						}
+						case Protocol::LoggedInMessageID:
+						case Protocol::SignedUpMessageID:
+						{
+							if(login_state == LoginState_LoggingIn || login_state == LoginState_SigningUp)
+							{
+								login_state = LoginState_LoggedIn;
+								createObjects(*socket, rng, scratch_packet);
+							}
+							break;
+						}
+						case Protocol::ErrorMessageID:
+						{
+							const std::string msg = msg_buffer.readStringLengthFirst(10000);
+							if(login_state == LoginState_LoggingIn)
+							{
+								// Login failed, presumably because the user doesn't exist yet, so try signing up.
+								initPacket(scratch_packet, Protocol::SignUpMessage);
+								scratch_packet.writeStringLengthFirst(username());
+								scratch_packet.writeStringLengthFirst(username() + "@example.com");
+								scratch_packet.writeStringLengthFirst(config.password);
+								updatePacketLengthField(scratch_packet);
+								sendPacket(*socket, scratch_packet);
+								login_state = LoginState_SigningUp;
+							}
+							else if(login_state == LoginState_SigningUp)
+							{
+								conPrint("Bot " + toString(bot_index) + ": sign up failed: " + msg);
+								login_state = LoginState_Failed;
+							}
+							else
+								conPrint("Bot " + toString(bot_index) + ": error message from server: " + msg);
+							break;
+						}
+					}
+				} // end while socket is readable
 
 				const double cur_time = Clock::getCurTimeRealSec();
 				const double dt = myMin(0.1, cur_time - last_think_time);
 				last_think_time = cur_time;
-				cur_pos += cur_vel * dt;
-				
 
-				// Send AvatarTransformUpdate packet every 0.1 s
-				if(time_since_update_packet_sent.elapsed() > 0.1)
+				// Move avatar
+				if(config.movement == "circle")
 				{
-					const uint32 anim_state = 0;
+					circle_phase += dt * 2.0 / circle_radius; // 2 m/s
+					cur_pos = spawn_pos + Vec3d(cos(circle_phase), sin(circle_phase), 0) * circle_radius;
+					heading = (float)circle_phase + Maths::pi_2<float>();
+				}
+				else if(config.movement == "random_walk" || config.movement == "cluster")
+				{
+					// Change heading to a random value every couple of seconds, or head back towards the centre if we have wandered too far.
+					const double walk_radius = (config.movement == "cluster") ? spawn_radius : myMax(spawn_radius, 10.0);
+					if(change_dir_timer.elapsed() > 2 || Vec3d(cur_pos.x, cur_pos.y, 0).length() > walk_radius)
+					{
+						heading = (Vec3d(cur_pos.x, cur_pos.y, 0).length() > walk_radius) ? (float)std::atan2(-cur_pos.y, -cur_pos.x) : rng.unitRandom() * Maths::get2Pi<float>();
+						cur_vel = Vec3d(cos(heading), sin(heading), 0) * 2;
+						change_dir_timer.reset();
+					}
+					cur_pos += cur_vel * dt;
+				}
+				// else stationary
+
+				// Send AvatarTransformUpdate packet, with the sequence number in the roll angle.
+				if(config.avatar_update_rate > 0 && cur_time >= next_avatar_update_time)
+				{
+					avatar_seq++;
+					const uint64 send_time_us = curTimeUS();
+					avatar_sent_times.recordSend(avatar_seq, send_time_us);
 
+					const uint32 anim_state = 0;
 					initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
 					writeToStream(client_avatar_uid, scratch_packet);
 					writeToStream(cur_pos, scratch_packet);
-					writeToStream(cur_angles, scratch_packet);
+					writeToStream(Vec3f((float)(avatar_seq & SentTimes::SEQ_MASK), Maths::pi_2<float>(), heading), scratch_packet);
 					scratch_packet.writeUInt32(anim_state);
-
 					updatePacketLengthField(scratch_packet);
-					socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+					sendPacket(*socket, scratch_packet);
+
+					if(measuring(send_time_us))
+						num_avatar_updates_sent++;
 
-					time_since_update_packet_sent.reset();
+					next_avatar_update_time = myMax(next_avatar_update_time + 1.0 / config.avatar_update_rate, cur_time - 1.0); // Don't let too much backlog build up.
 				}
 
-			} // End while(1) loop
+				// Edit one of our objects, with the sequence number in the x scale.
+				if(config.object_edit_rate > 0 && !own_object_uids.empty() && cur_time >= next_object_edit_time)
+				{
+					object_seq++;
+					const uint64 send_time_us = curTimeUS();
+					object_sent_times.recordSend(object_seq, send_time_us);
+
+					const size_t i = rng.nextUInt((uint32)own_object_uids.size());
+					initPacket(scratch_packet, Protocol::ObjectTransformUpdate);
+					writeToStream(own_object_uids[i], scratch_packet);
+					writeToStream(own_object_positions[i] + Vec3d(0, 0, rng.unitRandom() * 0.5), scratch_packet);
+					writeToStream(Vec3f(0, 0, 1), scratch_packet); // axis
+					scratch_packet.writeFloat(0.f); // angle
+					writeToStream(objectScaleForSeq(object_seq), scratch_packet); // scale
+					updatePacketLengthField(scratch_packet);
+					sendPacket(*socket, scratch_packet);
+
+					if(measuring(send_time_us))
+						num_object_edits_sent++;
+
+					next_object_edit_time = myMax(next_object_edit_time + 1.0 / config.object_edit_rate, cur_time - 1.0);
+				}
+			} // End while(!should_quit) loop
 		}
 		catch(glare::Exception& e)
 		{
-			// Connection failed.
-			conPrint("Error: " + e.what());
-			//PlatformUtils::Sleep(1000);
+			conPrint("Bot " + toString(bot_index) + ": Error: " + e.what());
+			error_msg = e.what();
 		}
+		connected = false;
 	}
 
-	struct tls_config* client_tls_config;
-	int seed;
+	StressTestRun* test_run;
+	int bot_index;
+	Vec3d spawn_pos;
+
+	std::atomic<bool> connected;
+	std::string error_msg;
+
+	SentTimes avatar_sent_times;
+	SentTimes object_sent_times;
+
+	std::unordered_map<uint32, int> avatar_uid_to_bot_cache; // Cache of test_run->avatar_uid_to_bot_index, only used by this thread.
+
+	std::vector<UID> own_object_uids;
+	std::vector<Vec3d> own_object_positions;
+
+	// Stats, only accessed by this thread until it has finished.
+	LatencyHistogram avatar_round_trip_hist;
+	LatencyHistogram avatar_broadcast_hist;
+	LatencyHistogram object_round_trip_hist;
+	LatencyHistogram object_broadcast_hist;
+	uint64 num_avatar_updates_sent;
+	uint64 num_object_edits_sent;
+	uint64 num_messages_received;
+	uint64 num_bytes_received;
 };
 
 
+//-------------------------------------------- Local server --------------------------------------------
+
+
+static void printProcessOutput(glare::Process& process, const std::string& prefix, bool print)
+{
+	// Read stdout even if we don't print it, so the process doesn't block on a full pipe.
+	while(process.isStdOutReadable())
+	{
+		const std::string output = process.readStdOut();
+		if(print)
+		{
+			const std::vector<std::string> lines = ::split(output, '\n');
+			for(size_t i=0; i<lines.size(); ++i)
+				if(!isAllWhitespace(lines[i]))
+					conPrint(prefix + lines[i]);
+		}
+	}
+}
+
+
+static void runProcessToCompletion(const std::string& exe_path, const std::vector<std::string>& args)
+{
+	glare::Process process(exe_path, args);
+	while(process.isProcessAlive())
+	{
+		printProcessOutput(process, "> ", /*print=*/true);
+		PlatformUtils::Sleep(10);
+	}
+	printProcessOutput(process, "> ", /*print=*/true);
+}
+
+
+// Starts a server process with the given state dir, generating a self-signed TLS certificate for it if needed.
+// Returns once the server is accepting connections.
+static std::unique_ptr<glare::Process> launchLocalServer(const std::string& server_exe_path, const std::string& state_dir, int port, const std::string& openssl_path, bool print_server_output)
+{
+	FileUtils::createDirIfDoesNotExist(state_dir);
+
+	const std::string cert_path = state_dir + "/MyCertificate.crt";
+	const std::string key_path  = state_dir + "/MyKey.key";
+	if(!FileUtils::fileExists(cert_path) || !FileUtils::fileExists(key_path))
+	{
+		conPrint("Generating self-signed TLS certificate...");
+		std::vector<std::string> args;
+		args.push_back(openssl_path);
+		args.push_back("req");
+		args.push_back("-x509");
+		args.push_back("-newkey");
+		args.push_back("rsa:2048");
+		args.push_back("-nodes");
+		args.push_back("-days");
+		args.push_back("30");
+		args.push_back("-subj");
+		args.push_back("/CN=localhost");
+		args.push_back("-keyout");
+		args.push_back(key_path);
+		args.push_back("-out");
+		args.push_back(cert_path);
+		runProcessToCompletion(openssl_path, args);
+
+		if(!FileUtils::fileExists(cert_path) || !FileUtils::fileExists(key_path))
+			throw glare::Exception("Failed to generate TLS certificate with '" + openssl_path + "'");
+	}
+
+	conPrint("Launching local server '" + server_exe_path + "' with state dir '" + state_dir + "'...");
+	std::vector<std::string> args;
+	args.push_back(server_exe_path);
+	args.push_back("--state_dir");
+	args.push_back(state_dir);
+	args.push_back("--port");
+	args.push_back(toString(port));
+	args.push_back("--no_webserver");
+	std::unique_ptr<glare::Process> process(new glare::Process(server_exe_path, args));
+
+	// Wait until the server accepts connections.  Loading the world can take a while.
+	Timer timer;
+	while(1)
+	{
+		printProcessOutput(*process, "SERVER> ", print_server_output);
+
+		if(!process->isProcessAlive())
+			throw glare::Exception("Local server process exited during startup.");
+		if(timer.elapsed() > 120)
+			throw glare::Exception("Timed out waiting for local server to accept connections.");
+
+		try
+		{
+			MySocketRef test_socket = new MySocket("localhost", port);
+			break;
+		}
+		catch(glare::Exception&)
+		{
+			PlatformUtils::Sleep(200);
+		}
+	}
+
+	conPrint("Local server is accepting connections.");
+	return process;
+}
+
+
+//-------------------------------------------- Runs and results --------------------------------------------
+
+
+static std::string jsonString(const std::string& s)
+{
+	std::string res = "\"";
+	for(size_t i=0; i<s.size(); ++i)
+	{
+		if(s[i] == '"' || s[i] == '\\')
+			res.push_back('\\');
+		res.push_back(s[i]);
+	}
+	return res + "\"";
+}
+
+
+// Runs num_bots bots for the warmup and measurement periods, returns a JSON summary of the run.
+static std::string doRun(const StressTestConfig& config, struct tls_config* client_tls_config, int num_bots, bool create_scenery, double start_time, 
+	glare::Process* local_server_process, bool print_server_output)
+{
+	conPrint("\n========== Running " + toString(num_bots) + " bots ==========");
+
+	StressTestRun run;
+	run.config = config;
+	run.client_tls_config = client_tls_config;
+	run.create_scenery = create_scenery;
+	run.start_time = start_time;
+
+	std::vector<Reference<StressTestBotThread>> threads;
+	for(int i=0; i<num_bots; ++i)
+	{
+		threads.push_back(new StressTestBotThread(&run, i));
+		run.bots.push_back(threads.back().ptr());
+	}
+
+	// Launch bots, at the connect rate
+	Timer launch_timer;
+	for(int i=0; i<num_bots; ++i)
+	{
+		while(launch_timer.elapsed() < i / config.connect_rate)
+		{
+			if(local_server_process)
+				printProcessOutput(*local_server_process, "SERVER> ", print_server_output);
+			PlatformUtils::Sleep(1);
+		}
+		threads[i]->launch();
+	}
+	conPrint("Launched " + toString(num_bots) + " bots in " + doubleToStringNSigFigs(launch_timer.elapsed(), 3) + " s, warming up for " + doubleToStringNSigFigs(config.warmup, 3) + " s...");
+
+	const double measure_start = Clock::getCurTimeRealSec() + config.warmup;
+	run.measure_start_time_us = (uint64)((measure_start - start_time) * 1.0e6);
+
+	const double measure_end = measure_start + config.duration;
+	bool server_exited = false;
+	while(Clock::getCurTimeRealSec() < measure_end && !server_exited)
+	{
+		if(local_server_process)
+		{
+			printProcessOutput(*local_server_process, "SERVER> ", print_server_output);
+			server_exited = !local_server_process->isProcessAlive();
+		}
+		PlatformUtils::Sleep(100);
+	}
+
+	int num_connected = 0;
+	for(int i=0; i<num_bots; ++i)
+		if(threads[i]->connected)
+			num_connected++;
+
+	run.should_quit = 1;
+	for(int i=0; i<num_bots; ++i)
+		threads[i]->join();
+
+	if(server_exited)
+		throw glare::Exception("Local server process exited during run.");
+
+	// Merge per-bot stats
+	LatencyHistogram avatar_round_trip_hist, avatar_broadcast_hist, object_round_trip_hist, object_broadcast_hist;
+	uint64 num_avatar_updates_sent = 0, num_object_edits_sent = 0, num_messages_received = 0, num_bytes_received = 0;
+	int num_with_objects = 0;
+	for(int i=0; i<num_bots; ++i)
+	{
+		const StressTestBotThread& bot = *threads[i];
+		avatar_round_trip_hist.merge(bot.avatar_round_trip_hist);
+		avatar_broadcast_hist.merge(bot.avatar_broadcast_hist);
+		object_round_trip_hist.merge(bot.object_round_trip_hist);
+		object_broadcast_hist.merge(bot.object_broadcast_hist);
+		num_avatar_updates_sent += bot.num_avatar_updates_sent;
+		num_object_edits_sent += bot.num_object_edits_sent;
+		num_messages_received += bot.num_messages_received;
+		num_bytes_received += bot.num_bytes_received;
+		if(!bot.own_object_uids.empty())
+			num_with_objects++;
+	}
+
+	conPrint("Bots connected at end of run: " + toString(num_connected) + " / " + toString(num_bots));
+	conPrint("Avatar round trip:               " + avatar_round_trip_hist.toJSON());
+	conPrint("Avatar broadcast delivery:       " + avatar_broadcast_hist.toJSON());
+	conPrint("Object edit round trip:          " + object_round_trip_hist.toJSON());
+	conPrint("Object edit broadcast delivery:  " + object_broadcast_hist.toJSON());
+
+	return "{\n"
+		"\t\t\"num_bots\": " + toString(num_bots) + ",\n"
+		"\t\t\"num_bots_connected\": " + toString(num_connected) + ",\n"
+		"\t\t\"num_bots_with_objects\": " + toString(num_with_objects) + ",\n"
+		"\t\t\"duration_s\": " + doubleToStringNDecimalPlaces(config.duration, 3) + ",\n"
+		"\t\t\"avatar_updates_sent\": " + toString(num_avatar_updates_sent) + ",\n"
+		"\t\t\"object_edits_sent\": " + toString(num_object_edits_sent) + ",\n"
+		"\t\t\"messages_received\": " + toString(num_messages_received) + ",\n"
+		"\t\t\"bytes_received\": " + toString(num_bytes_received) + ",\n"
+		"\t\t\"avatar_round_trip\": " + avatar_round_trip_hist.toJSON() + ",\n"
+		"\t\t\"avatar_broadcast_delivery\": " + avatar_broadcast_hist.toJSON() + ",\n"
+		"\t\t\"object_edit_round_trip\": " + object_round_trip_hist.toJSON() + ",\n"
+		"\t\t\"object_edit_broadcast_delivery\": " + object_broadcast_hist.toJSON() + "\n"
+		"\t}";
+}
+
+
 int main(int argc, char* argv[])
 {
 	Clock::init();
 	Networking::createInstance();
-	PlatformUtils::ignoreUnixSignals();
-	OpenSSL::init();
+	PlatformUtils::ignoreUnixSignals();
+	OpenSSL::init();
 	TLSSocket::initTLS();
 
+	try
+	{
+		std::map<std::string, std::vector<ArgumentParser::ArgumentType> > syntax;
+		const std::vector<ArgumentParser::ArgumentType> one_string_arg(1, ArgumentParser::ArgumentType_string);
+		syntax["--test"] = std::vector<ArgumentParser::ArgumentType>(); // Run unit tests
+		syntax["--host"] = one_string_arg; // Server hostname, default localhost
+		syntax["--port"] = one_string_arg; // Server port, default 7600
+		syntax["--world"] = one_string_arg; // World name, default is the main world.
+		syntax["--num_bots"] = one_string_arg; // Number of bots, or a comma-separated list of bot counts for multiple runs, e.g. 100,500,2000
+		syntax["--duration"] = one_string_arg; // Measurement period of each run in seconds
+		syntax["--warmup"] = one_string_arg; // Time after all bots are launched before measurement starts, in seconds
+		syntax["--movement"] = one_string_arg; // random_walk, circle, stationary or cluster
+		syntax["--spawn_radius"] = one_string_arg; // Bots spawn in a disc of this radius around the origin
+		syntax["--avatar_update_rate"] = one_string_arg; // Avatar transform updates per second per bot
+		syntax["--objects_per_bot"] = one_string_arg; // Objects created by each bot, for editing
+		syntax["--object_edit_rate"] = one_string_arg; // Object transform edits per second per bot
+		syntax["--connect_rate"] = one_string_arg; // Bots launched per second
+		syntax["--username_prefix"] = one_string_arg;
+		syntax["--password"] = one_string_arg;
+		syntax["--json_out"] = one_string_arg; // Path to write JSON summary to
+		syntax["--local_server"] = one_string_arg; // Path to server executable.  If given, a local server is started and used.
+		syntax["--local_state_dir"] = one_string_arg; // Server state dir for local server
+		syntax["--scenery_objects"] = one_string_arg; // Number of static objects to generate in the world, in the first run.
+		syntax["--openssl"] = one_string_arg; // Path to openssl executable, for generating the local server TLS certificate
+		syntax["--print_server_output"] = std::vector<ArgumentParser::ArgumentType>();
 
-	// Create and init TLS client config
-	struct tls_config* client_tls_config = tls_config_new();
-	if(!client_tls_config)
-		throw glare::Exception("Failed to initialise TLS (tls_config_new failed)");
-	tls_config_insecure_noverifycert(client_tls_config); // TODO: Fix this, check cert etc..
-	tls_config_insecure_noverifyname(client_tls_config);
+		std::vector<std::string> args;
+		for(int i=0; i<argc; ++i)
+			args.push_back(argv[i]);
 
+		ArgumentParser parsed_args(args, syntax, /*allow_unnamed_arg=*/false);
 
-	const int NUM_THREADS = 300;
-	std::vector<Reference<StressTestBotThread>> threads;
-	for(int i=0; i<NUM_THREADS; ++i)
+		if(parsed_args.isArgPresent("--test"))
+		{
+			LatencyHistogram::test();
+			return 0;
+		}
+
+		const bool use_local_server = parsed_args.isArgPresent("--local_server");
+
+		StressTestConfig config;
+		config.server_hostname		= parsed_args.isArgPresent("--host")				? parsed_args.getArgStringValue("--host") : "localhost";
+		config.server_port			= parsed_args.isArgPresent("--port")				? stringToInt(parsed_args.getArgStringValue("--port")) : 7600;
+		config.world_name			= parsed_args.isArgPresent("--world")				? parsed_args.getArgStringValue("--world") : "";
+		config.duration				= parsed_args.isArgPresent("--duration")			? stringToDouble(parsed_args.getArgStringValue("--duration")) : 30.0;
+		config.warmup				= parsed_args.isArgPresent("--warmup")				? stringToDouble(parsed_args.getArgStringValue("--warmup")) : 5.0;
+		config.movement				= parsed_args.isArgPresent("--movement")			? parsed_args.getArgStringValue("--movement") : "random_walk";
+		config.spawn_radius			= parsed_args.isArgPresent("--spawn_radius")		? stringToDouble(parsed_args.getArgStringValue("--spawn_radius")) : 50.0;
+		config.avatar_update_rate	= parsed_args.isArgPresent("--avatar_update_rate")	? stringToDouble(parsed_args.getArgStringValue("--avatar_update_rate")) : 10.0;
+		config.objects_per_bot		= parsed_args.isArgPresent("--objects_per_bot")		? stringToInt(parsed_args.getArgStringValue("--objects_per_bot")) : 0;
+		config.object_edit_rate		= parsed_args.isArgPresent("--object_edit_rate")	? stringToDouble(parsed_args.getArgStringValue("--object_edit_rate")) : 0.0;
+		config.connect_rate			= parsed_args.isArgPresent("--connect_rate")		? stringToDouble(parsed_args.getArgStringValue("--connect_rate")) : 100.0;
+		config.username_prefix		= parsed_args.isArgPresent("--username_prefix")		? parsed_args.getArgStringValue("--username_prefix") : "stressbot";
+		config.password				= parsed_args.isArgPresent("--password")			? parsed_args.getArgStringValue("--password") : "stressbotpassword";
+		config.scenery_objects		= parsed_args.isArgPresent("--scenery_objects")		? stringToInt(parsed_args.getArgStringValue("--scenery_objects")) : (use_local_server ? 1000 : 0);
+
+		const std::vector<std::string> num_bots_strings = ::split(parsed_args.isArgPresent("--num_bots") ? parsed_args.getArgStringValue("--num_bots") : "100", ',');
+		for(size_t i=0; i<num_bots_strings.size(); ++i)
+			config.num_bots_per_run.push_back(stringToInt(num_bots_strings[i]));
+
+		if(config.movement != "random_walk" && config.movement != "circle" && config.movement != "stationary" && config.movement != "cluster")
+			throw glare::Exception("Invalid movement pattern '" + config.movement + "', must be one of random_walk, circle, stationary or cluster.");
+		for(size_t i=0; i<config.num_bots_per_run.size(); ++i)
+			if(config.num_bots_per_run[i] <= 0)
+				throw glare::Exception("Invalid number of bots: " + toString(config.num_bots_per_run[i]));
+		if(config.connect_rate <= 0)
+			throw glare::Exception("connect_rate must be > 0");
+
+		// Start local server if requested
+		const bool print_server_output = parsed_args.isArgPresent("--print_server_output");
+		std::unique_ptr<glare::Process> local_server_process;
+		if(use_local_server)
+		{
+			const std::string state_dir = parsed_args.isArgPresent("--local_state_dir") ? parsed_args.getArgStringValue("--local_state_dir") : 
+				(PlatformUtils::getTempDirPath() + "/substrata_stress_test_server_" + toString((uint64)Clock::getSecsSince1970()));
+#if defined(_WIN32)
+			const std::string default_openssl_path = "openssl.exe";
+#else
+			const std::string default_openssl_path = "/usr/bin/openssl";
+#endif
+			const std::string openssl_path = parsed_args.isArgPresent("--openssl") ? parsed_args.getArgStringValue("--openssl") : default_openssl_path;
+
+			config.server_hostname = "localhost";
+			local_server_process = launchLocalServer(parsed_args.getArgStringValue("--local_server"), state_dir, config.server_port, openssl_path, print_server_output);
+		}
+
+		// Create and init TLS client config
+		struct tls_config* client_tls_config = tls_config_new();
+		if(!client_tls_config)
+			throw glare::Exception("Failed to initialise TLS (tls_config_new failed)");
+		tls_config_insecure_noverifycert(client_tls_config); // Local servers use a self-signed certificate.
+		tls_config_insecure_noverifyname(client_tls_config);
+
+		const double start_time = Clock::getCurTimeRealSec();
+
+		std::string runs_json;
+		for(size_t i=0; i<config.num_bots_per_run.size(); ++i)
+		{
+			const bool create_scenery = (i == 0) && (config.scenery_objects > 0);
+			runs_json += (i > 0 ? ",\n\t" : "\t") + doRun(config, client_tls_config, config.num_bots_per_run[i], create_scenery, start_time, local_server_process.get(), print_server_output);
+		}
+
+		const std::string json = "{\n"
+			"\t\"host\": " + jsonString(config.server_hostname) + ",\n"
+			"\t\"port\": " + toString(config.server_port) + ",\n"
+			"\t\"world\": " + jsonString(config.world_name) + ",\n"
+			"\t\"local_server\": " + boolToString(use_local_server) + ",\n"
+			"\t\"movement\": " + jsonString(config.movement) + ",\n"
+			"\t\"spawn_radius\": " + doubleToStringNDecimalPlaces(config.spawn_radius, 3) + ",\n"
+			"\t\"avatar_update_rate\": " + doubleToStringNDecimalPlaces(config.avatar_update_rate, 3) + ",\n"
+			"\t\"objects_per_bot\": " + toString(config.objects_per_bot) + ",\n"
+			"\t\"object_edit_rate\": " + doubleToStringNDecimalPlaces(config.object_edit_rate, 3) + ",\n"
+			"\t\"scenery_objects\": " + toString(config.scenery_objects) + ",\n"
+			"\t\"runs\": [\n" + runs_json + "\n\t]\n"
+			"}\n";
+
+		conPrint("\n" + json);
+
+		if(parsed_args.isArgPresent("--json_out"))
+		{
+			FileUtils::writeEntireFileTextMode(parsed_args.getArgStringValue("--json_out"), json);
+			conPrint("Wrote JSON summary to '" + parsed_args.getArgStringValue("--json_out") + "'.");
+		}
+
+		if(local_server_process)
+		{
+			conPrint("Terminating local server...");
+			local_server_process->terminateProcess();
+		}
+
+		tls_config_free(client_tls_config);
+	}
+	catch(ArgumentParserExcep& e)
 	{
-		Reference<StressTestBotThread> t = new StressTestBotThread();
-		t->client_tls_config = client_tls_config;
-		t->seed = i;
-		t->launch();
-		threads.push_back(t);
+		conPrint("ArgumentParserExcep: " + e.what());
+		return 1;
 	}
-
-	while(1)
+	catch(glare::Exception& e)
 	{
-		PlatformUtils::Sleep(100);
+		conPrint("Error: " + e.what());
+		return 1;
 	}
-	//while(1) // While stress-test bot should keep running:
-	//{
-	//	
-	//} // End while screenshot bot should keep running:
 
 	return 0;
 }
@@ -46,6 +46,7 @@ void renderUserAccountPage(ServerAllWorldsState& world_state, const web::Request
 
 	{ // lock scope
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -300,6 +301,7 @@ void renderMakeParcelIntoNFTPage(ServerAllWorldsState& world_state, const web::R
 
 	{ // lock scope
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -472,6 +474,7 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 		const ParcelID parcel_id(request_info.getPostIntField("parcel_id"));
 
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -552,6 +555,7 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 		parcel_id = ParcelID(request_info.getPostIntField("parcel_id"));
 
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -604,6 +608,7 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 
 			{ // lock scope
 				Lock lock(world_state.mutex);
+				Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 				User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 				if(logged_in_user == NULL)
@@ -626,12 +631,14 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 
 				// TODO: Log ownership change?
 
-				world_state.denormaliseData();
 				world_state.markAsChanged();
 
 				succeeded = true;
 
 			} // End lock scope
+
+			// Called after the root world lock is released, as denormaliseData() locks each world in turn.
+			world_state.denormaliseData();
 		}
 	}
 	catch(glare::Exception& e)
@@ -210,6 +210,7 @@ void renderParcelsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 
 	{ // Lock scope
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		page_out += "<h2>Root world Parcels</h2>\n";
 
@@ -804,6 +805,7 @@ void createParcelAuctionPost(ServerAllWorldsState& world_state, const web::Reque
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -915,6 +917,7 @@ void renderSetParcelOwnerPage(ServerAllWorldsState& world_state, const web::Requ
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		// Lookup parcel
 		const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -958,9 +961,12 @@ void handleSetParcelOwnerPost(ServerAllWorldsState& world_state, const web::Requ
 		const int parcel_id    = request.getPostIntField("parcel_id");
 		const int new_owner_id = request.getPostIntField("new_owner_id");
 
+		bool changed_owner = false;
+
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -976,13 +982,19 @@ void handleSetParcelOwnerPost(ServerAllWorldsState& world_state, const web::Requ
 				parcel->writer_ids = std::vector<UserID>(1, UserID(new_owner_id));
 				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
 
-				world_state.denormaliseData(); // Update denormalised data which includes parcel owner name
-
 				world_state.markAsChanged();
 
-				web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + toString(parcel_id));
+				changed_owner = true;
 			}
 		} // End lock scope
+
+		if(changed_owner)
+		{
+			// Update denormalised data which includes parcel owner name.  Called after the root world lock is released, as denormaliseData() locks each world in turn.
+			world_state.denormaliseData();
+
+			web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + toString(parcel_id));
+		}
 	}
 	catch(glare::Exception& e)
 	{
@@ -1007,6 +1019,7 @@ void handleMarkParcelAsNFTMintedPost(ServerAllWorldsState& world_state, const we
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -1044,6 +1057,7 @@ void handleMarkParcelAsNotNFTPost(ServerAllWorldsState& world_state, const web::
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -1082,6 +1096,7 @@ void handleRetryParcelMintPost(ServerAllWorldsState& world_state, const web::Req
 
 		{ // Lock scope
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 
@@ -1347,6 +1362,7 @@ void handleRegenerateParcelAuctionScreenshots(ServerAllWorldsState& world_state,
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel auction
 			const auto res = world_state.parcel_auctions.find(parcel_auction_id);
@@ -1414,6 +1430,7 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -1478,6 +1495,7 @@ void handleRegenerateMultipleParcelScreenshots(ServerAllWorldsState& world_state
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			for(auto it = world_state.getRootWorldState()->parcels.begin(); it != world_state.getRootWorldState()->parcels.end(); ++it)
 			{
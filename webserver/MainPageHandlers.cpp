@@ -64,6 +64,7 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 	std::string auction_html;
 	{ // lock scope
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		ServerWorldState* root_world = world_state.getRootWorldState().ptr();
 
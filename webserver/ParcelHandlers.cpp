@@ -49,6 +49,7 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 
 		{ // lock scope
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
@@ -314,6 +315,7 @@ void renderEditParcelDescriptionPage(ServerAllWorldsState& world_state, const we
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		// Lookup parcel
 		const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
@@ -348,6 +350,7 @@ void renderAddParcelWriterPage(ServerAllWorldsState& world_state, const web::Req
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -387,6 +390,7 @@ void renderRemoveParcelWriterPage(ServerAllWorldsState& world_state, const web::
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -444,6 +448,7 @@ void renderMetadata(ServerAllWorldsState& world_state, const web::RequestInfo& r
 
 		{ // lock scope
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
@@ -520,6 +525,7 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -585,6 +591,7 @@ void handleEditParcelDescriptionPost(ServerAllWorldsState& world_state, const we
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -632,6 +639,7 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -668,10 +676,7 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 					}
 
 					if(added_writer)
-					{
-						world_state.denormaliseData(); // Update parcel writer names
 						world_state.markAsChanged();
-					}
 
 					world_state.setUserWebMessage(logged_in_user->id, message);
 				}
@@ -679,7 +684,11 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 		} // End lock scope
 
 		if(added_writer)
+		{
+			world_state.denormaliseData(); // Update parcel writer names.  Called after the root world lock is released, as denormaliseData() locks each world in turn.
+
 			web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + parcel_id.toString());
+		}
 		else
 			web::ResponseUtils::writeRedirectTo(reply_info, "/add_parcel_writer?parcel_id=" + parcel_id.toString());
 	}
@@ -702,8 +711,11 @@ void handleRemoveParcelWriterPost(ServerAllWorldsState& world_state, const web::
 		const ParcelID parcel_id = ParcelID(request.getPostIntField("parcel_id"));
 		const UserID writer_id = UserID(request.getPostIntField("writer_id"));
 
+		bool parcel_changed = false;
+
 		{ // Lock scope
 			Lock lock(world_state.mutex);
+			Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -723,12 +735,16 @@ void handleRemoveParcelWriterPost(ServerAllWorldsState& world_state, const web::
 
 					world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
 
-					world_state.denormaliseData(); // Update parcel writer names
 					world_state.markAsChanged();
+
+					parcel_changed = true;
 				}
 			}
 		} // End lock scope
 
+		if(parcel_changed)
+			world_state.denormaliseData(); // Update parcel writer names.  Called after the root world lock is released, as denormaliseData() locks each world in turn.
+
 		web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + parcel_id.toString());
 	}
 	catch(glare::Exception& e)
@@ -0,0 +1,155 @@
+/*=====================================================================
+ResourceBodyCache.cpp
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceBodyCache.h"
+
+
+#include <Lock.h>
+
+
+ResourceBodyCache::ResourceBodyCache(size_t max_total_size, size_t max_body_size_)
+:	max_body_size(max_body_size_),
+	num_hits(0),
+	num_misses(0),
+	bodies(max_total_size)
+{}
+
+
+ResourceBodyCache::~ResourceBodyCache()
+{}
+
+
+Reference<ResourceBody> ResourceBodyCache::get(const std::string& URL)
+{
+	Lock lock(mutex);
+
+	const Reference<ResourceBody>* body = bodies.get(URL);
+	if(!body)
+	{
+		num_misses++;
+		return Reference<ResourceBody>();
+	}
+
+	num_hits++;
+	return *body;
+}
+
+
+void ResourceBodyCache::insert(const std::string& URL, const Reference<ResourceBody>& body)
+{
+	if(!shouldCacheBody(body->data.size()))
+		return;
+
+	Lock lock(mutex);
+	bodies.insert(URL, body, body->data.size());
+}
+
+
+void ResourceBodyCache::clear()
+{
+	Lock lock(mutex);
+	bodies.clear();
+}
+
+
+size_t ResourceBodyCache::getTotalSize()
+{
+	Lock lock(mutex);
+	return bodies.getTotalSize();
+}
+
+
+size_t ResourceBodyCache::getNumBodies()
+{
+	Lock lock(mutex);
+	return bodies.size();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <ConPrint.h>
+
+
+static Reference<ResourceBody> makeTestBody(size_t size)
+{
+	Reference<ResourceBody> body = new ResourceBody();
+	body->data.resize(size);
+	for(size_t i=0; i<size; ++i)
+		body->data[i] = (uint8)i;
+	return body;
+}
+
+
+void ResourceBodyCache::test()
+{
+	conPrint("ResourceBodyCache::test()");
+
+	{
+		ResourceBodyCache cache(/*max total size=*/1000, /*max body size=*/500);
+		testAssert(cache.get("a").isNull());
+		testAssert(cache.num_misses == 1);
+
+		Reference<ResourceBody> a = makeTestBody(300);
+		Reference<ResourceBody> b = makeTestBody(300);
+		Reference<ResourceBody> c = makeTestBody(300);
+		cache.insert("a", a);
+		cache.insert("b", b);
+		cache.insert("c", c);
+		testAssert(cache.getTotalSize() == 900);
+		testAssert(cache.getNumBodies() == 3);
+		testAssert(cache.get("a") == a);
+		testAssert(cache.num_hits == 1);
+
+		// Inserting d takes the total size over the limit, so the least recently used body, b, should be removed.
+		Reference<ResourceBody> d = makeTestBody(300);
+		cache.insert("d", d);
+		testAssert(cache.getTotalSize() == 900);
+		testAssert(cache.get("b").isNull());
+		testAssert(cache.get("a") == a);
+		testAssert(cache.get("c") == c);
+		testAssert(cache.get("d") == d);
+
+		// The removed body is still valid, as we hold a reference to it.
+		testAssert(b->data.size() == 300 && b->data[299] == (uint8)299);
+
+		// Bodies larger than the max body size are not cached.
+		cache.insert("big", makeTestBody(501));
+		testAssert(cache.get("big").isNull());
+		testAssert(cache.getNumBodies() == 3);
+
+		// Replace a body with a larger one.  a is now the LRU body, so should be removed.
+		Reference<ResourceBody> c2 = makeTestBody(450);
+		cache.insert("c", c2);
+		testAssert(cache.get("c") == c2);
+		testAssert(cache.get("a").isNull());
+		testAssert(cache.getTotalSize() == 750);
+		testAssert(cache.getNumBodies() == 2);
+
+		// Replace a body with a smaller one.
+		cache.insert("c", makeTestBody(10));
+		testAssert(cache.getTotalSize() == 310);
+
+		cache.clear();
+		testAssert(cache.getTotalSize() == 0);
+		testAssert(cache.getNumBodies() == 0);
+		testAssert(cache.get("d").isNull());
+	}
+
+	// Test a cache with a max total size smaller than the max body size: bodies are inserted then immediately removed.
+	{
+		ResourceBodyCache cache(/*max total size=*/100, /*max body size=*/500);
+		cache.insert("a", makeTestBody(200));
+		testAssert(cache.get("a").isNull());
+		testAssert(cache.getTotalSize() == 0);
+	}
+
+	conPrint("ResourceBodyCache::test() done");
+}
+
+
+#endif // BUILD_TESTS
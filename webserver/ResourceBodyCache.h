@@ -0,0 +1,73 @@
+/*=====================================================================
+ResourceBodyCache.h
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "SizeBoundedLRUCache.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Vector.h>
+#include <Mutex.h>
+#include <string>
+
+
+// The contents of a resource file, as served by ResourceHandlers::handleResourceRequest().
+class ResourceBody : public ThreadSafeRefCounted
+{
+public:
+	js::Vector<uint8, 16> data;
+	std::string local_path; // Path of the file the data was read from.
+};
+
+
+/*=====================================================================
+ResourceBodyCache
+-----------------
+A size-bounded cache of the contents of recently requested resource files,
+keyed by resource URL, so that popular resources don't have to be opened
+and mapped for every request.
+
+When the total size of the cached bodies exceeds max_total_size, the least
+recently used bodies are removed.  Bodies are reference counted, so a body
+removed from the cache stays valid while it is still being sent.
+
+Threadsafe.
+=====================================================================*/
+class ResourceBodyCache
+{
+public:
+	ResourceBodyCache(size_t max_total_size, size_t max_body_size);
+	~ResourceBodyCache();
+
+	// Returns the cached body for the URL, or NULL if it is not cached.  Marks the body as the most recently used.
+	Reference<ResourceBody> get(const std::string& URL);
+
+	// Inserts or replaces the body for the URL, then removes least recently used bodies until the total size is at most max_total_size.
+	// Bodies larger than max_body_size are not inserted.
+	void insert(const std::string& URL, const Reference<ResourceBody>& body);
+
+	bool shouldCacheBody(size_t body_size) const { return body_size <= max_body_size; }
+
+	void clear();
+
+	size_t getTotalSize();
+	size_t getNumBodies();
+
+	static void test();
+
+	// Limit.  Set before the cache is used.
+	size_t max_body_size;
+
+	// Stats
+	uint64 num_hits;
+	uint64 num_misses;
+
+private:
+	GLARE_DISABLE_COPY(ResourceBodyCache);
+
+	Mutex mutex;
+	SizeBoundedLRUCache<Reference<ResourceBody>> bodies GUARDED_BY(mutex); // Map from URL to body.  The size of each entry is the size of the body data.
+};
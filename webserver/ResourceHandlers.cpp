@@ -12,6 +12,8 @@ Copyright Glare Technologies Limited 2021 -
 #include "Escaping.h"
 #include "ResponseUtils.h"
 #include "WebServerResponseUtils.h"
+#include "WebDataStore.h"
+#include "ResourceBodyCache.h"
 #include "../server/ServerWorldState.h"
 #include "../server/Order.h"
 #include <graphics/FormatDecoderGLTF.h>
@@ -24,13 +26,263 @@ Copyright Glare Technologies Limited 2021 -
 #include <MemMappedFile.h>
 #include <FileUtils.h>
 #include <RuntimeCheck.h>
+#include <IncludeXXHash.h>
+#include <MySocket.h>
+#include <maths/mathstypes.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 
 namespace ResourceHandlers
 {
 
 
-void handleResourceRequest(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+// Resource URLs include a hash of the resource content, so the content for a given URL doesn't change.
+// Therefore a hash of the URL can be used as a strong entity tag.
+static const std::string makeETagForResourceURL(const std::string& resource_URL)
+{
+	return "\"" + toHexString(XXH64(resource_URL.data(), resource_URL.size(), /*seed=*/1)) + "\"";
+}
+
+
+// A byte range of a resource to send, after resolving a Range request header against the resource size.
+struct ByteRange
+{
+	uint64 start;
+	uint64 size;
+};
+
+
+enum RangeRequestType
+{
+	RangeRequest_WholeResource, // No ranges requested (or the Range header should be ignored), send the whole resource.
+	RangeRequest_Satisfiable, // Send the resolved ranges.
+	RangeRequest_Unsatisfiable // None of the ranges overlap the resource.
+};
+
+
+// Ignore range requests with more ranges than this, and send the whole resource instead.
+static const size_t MAX_NUM_RANGES = 16;
+
+
+// Resolves the ranges of a Range request header (as parsed into RequestInfo::ranges) against the resource size.
+// A range with end_incl = -1 extends to the end of the resource.  A range with a negative start and end_incl = -1 is a suffix range, for the last -start bytes.
+// See https://www.rfc-editor.org/rfc/rfc9110#name-range-requests
+static RangeRequestType resolveByteRanges(const std::vector<web::Range>& ranges, uint64 resource_size, std::vector<ByteRange>& ranges_out)
+{
+	ranges_out.resize(0);
+
+	if(ranges.empty() || ranges.size() > MAX_NUM_RANGES)
+		return RangeRequest_WholeResource;
+
+	uint64 total_range_size = 0;
+	for(size_t i=0; i<ranges.size(); ++i)
+	{
+		const web::Range& range = ranges[i];
+		if(range.start < 0) // Suffix range:
+		{
+			if(range.end_incl != -1) // Invalid range, ignore the Range header.
+			{
+				ranges_out.resize(0);
+				return RangeRequest_WholeResource;
+			}
+
+			const uint64 suffix_len = (uint64)(-range.start);
+			if(resource_size == 0)
+				continue; // Unsatisfiable
+
+			ByteRange byte_range;
+			byte_range.start = (suffix_len < resource_size) ? (resource_size - suffix_len) : 0;
+			byte_range.size = resource_size - byte_range.start;
+			ranges_out.push_back(byte_range);
+		}
+		else
+		{
+			if(range.end_incl != -1 && range.end_incl < range.start) // Invalid range, ignore the Range header.
+			{
+				ranges_out.resize(0);
+				return RangeRequest_WholeResource;
+			}
+
+			if((uint64)range.start >= resource_size)
+				continue; // Unsatisfiable
+
+			// Clamp the end of the range to the end of the resource.
+			const uint64 end_incl = (range.end_incl == -1 || (uint64)range.end_incl >= resource_size) ? (resource_size - 1) : (uint64)range.end_incl;
+
+			ByteRange byte_range;
+			byte_range.start = (uint64)range.start;
+			byte_range.size = end_incl - byte_range.start + 1;
+			ranges_out.push_back(byte_range);
+		}
+
+		total_range_size += ranges_out.back().size;
+	}
+
+	if(ranges_out.empty())
+		return RangeRequest_Unsatisfiable;
+
+	// If the ranges overlap, or cover more than the whole resource, just send the whole resource.  This stops clients making us send many copies of the resource in one response.
+	if(ranges_out.size() > 1 && total_range_size > resource_size)
+	{
+		ranges_out.resize(0);
+		return RangeRequest_WholeResource;
+	}
+
+	return RangeRequest_Satisfiable;
+}
+
+
+// The resource data to send.
+struct ResourceData
+{
+	const uint8* data;
+	uint64 size;
+
+	// If sendfile_socket is non-null, data is sent from the file sendfile_fd with sendfile() instead of being written from data.
+	MySocket* sendfile_socket;
+	int sendfile_fd;
+};
+
+
+#if defined(__linux__)
+static void sendFileRange(MySocket& socket, int fd, uint64 offset, uint64 size)
+{
+	off_t file_offset = (off_t)offset;
+	uint64 remaining = size;
+	while(remaining > 0)
+	{
+		const ssize_t res = ::sendfile((int)socket.getSocketHandle(), fd, &file_offset, (size_t)myMin<uint64>(remaining, 1 << 30));
+		if(res < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw glare::Exception("sendfile failed: " + PlatformUtils::getLastErrorString());
+		}
+		if(res == 0)
+			throw glare::Exception("sendfile failed: unexpected end of file");
+		remaining -= (uint64)res;
+	}
+}
+#endif
+
+
+static void writeResourceDataRange(web::ReplyInfo& reply_info, const ResourceData& resource_data, uint64 offset, uint64 size)
+{
+	// Sanity check range.  Should be valid by here.
+	runtimeCheck((offset <= resource_data.size) && (size <= resource_data.size - offset));
+
+#if defined(__linux__)
+	if(resource_data.sendfile_socket)
+	{
+		sendFileRange(*resource_data.sendfile_socket, resource_data.sendfile_fd, offset, size);
+		return;
+	}
+#endif
+	reply_info.socket->writeData(resource_data.data + offset, size);
+}
+
+
+static const std::string makeContentRange(const ByteRange& range, uint64 resource_size)
+{
+	return "bytes " + toString(range.start) + "-" + toString(range.start + range.size - 1) + "/" + toString(resource_size); // Note that ranges are inclusive, hence the - 1.
+}
+
+
+// Writes the response headers and data for a resource that is present, handling range requests.
+static void writeResourceResponse(const web::RequestInfo& request, web::ReplyInfo& reply_info, const ResourceData& resource_data, const std::string& content_type, const std::string& etag)
+{
+	const std::string common_headers = 
+		"ETag: " + etag + "\r\n"
+		"Accept-Ranges: bytes\r\n"
+		"Cache-Control: max-age=100000000\r\n"
+		"Connection: Keep-Alive\r\n";
+
+	std::vector<ByteRange> ranges;
+	const RangeRequestType range_request_type = resolveByteRanges(request.ranges, resource_data.size, ranges);
+
+	if(range_request_type == RangeRequest_Unsatisfiable)
+	{
+		const std::string response = 
+			"HTTP/1.1 416 Range Not Satisfiable\r\n"
+			"Content-Range: bytes */" + toString(resource_data.size) + "\r\n" + 
+			common_headers + 
+			"Content-Length: 0\r\n"
+			"\r\n";
+
+		reply_info.socket->writeData(response.c_str(), response.size());
+	}
+	else if(range_request_type == RangeRequest_WholeResource)
+	{
+		const std::string response = 
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: " + content_type + "\r\n" + 
+			common_headers + 
+			"Content-Length: " + toString(resource_data.size) + "\r\n"
+			"\r\n";
+
+		reply_info.socket->writeData(response.c_str(), response.size());
+		writeResourceDataRange(reply_info, resource_data, 0, resource_data.size);
+	}
+	else if(ranges.size() == 1)
+	{
+		//conPrint("\thandleResourceRequest: serving data range (start: " + toString(ranges[0].start) + ", range_size: " + toString(ranges[0].size) + ")");
+
+		const std::string response = 
+			"HTTP/1.1 206 Partial Content\r\n"
+			"Content-Type: " + content_type + "\r\n"
+			"Content-Range: " + makeContentRange(ranges[0], resource_data.size) + "\r\n" + 
+			common_headers + 
+			"Content-Length: " + toString(ranges[0].size) + "\r\n"
+			"\r\n";
+
+		reply_info.socket->writeData(response.c_str(), response.size());
+		writeResourceDataRange(reply_info, resource_data, ranges[0].start, ranges[0].size);
+	}
+	else
+	{
+		// Send a multipart/byteranges response, with a part for each range.
+		// The boundary must not occur in the data.  Resource data is mostly binary, so a long boundary derived from the ETag is very unlikely to occur in it.
+		const std::string boundary = "substrata_byteranges_" + etag.substr(1, etag.size() - 2); // Remove quotes from ETag
+
+		std::vector<std::string> part_headers(ranges.size());
+		uint64 content_length = 0;
+		for(size_t i=0; i<ranges.size(); ++i)
+		{
+			part_headers[i] = 
+				"\r\n--" + boundary + "\r\n"
+				"Content-Type: " + content_type + "\r\n"
+				"Content-Range: " + makeContentRange(ranges[i], resource_data.size) + "\r\n"
+				"\r\n";
+			content_length += part_headers[i].size() + ranges[i].size;
+		}
+		const std::string end_delimiter = "\r\n--" + boundary + "--\r\n";
+		content_length += end_delimiter.size();
+
+		const std::string response = 
+			"HTTP/1.1 206 Partial Content\r\n"
+			"Content-Type: multipart/byteranges; boundary=" + boundary + "\r\n" + 
+			common_headers + 
+			"Content-Length: " + toString(content_length) + "\r\n"
+			"\r\n";
+
+		reply_info.socket->writeData(response.c_str(), response.size());
+		for(size_t i=0; i<ranges.size(); ++i)
+		{
+			reply_info.socket->writeData(part_headers[i].c_str(), part_headers[i].size());
+			writeResourceDataRange(reply_info, resource_data, ranges[i].start, ranges[i].size);
+		}
+		reply_info.socket->writeData(end_delimiter.c_str(), end_delimiter.size());
+	}
+}
+
+
+void handleResourceRequest(ServerAllWorldsState& world_state, WebDataStore& data_store, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	try
 	{
@@ -131,62 +383,90 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 						return;
 					}
 
+				const std::string etag = makeETagForResourceURL(resource_URL);
+				if(WebServerResponseUtils::ifNoneMatchHeaderMatchesETag(WebServerResponseUtils::getRequestHeader(request, "if-none-match"), etag))
+				{
+					WebServerResponseUtils::writeHTTPNotModifiedHeader(reply_info, etag, /*vary on accept encoding=*/false);
+					return;
+				}
 
 				const std::string content_type = web::ResponseUtils::getContentTypeForPath(local_path); // Guess content type
 
-				MemMappedFile file(local_path);
+				// Serve from the cache of recently requested resources, if the resource is in it.
+				Reference<ResourceBody> body = data_store.resource_body_cache.get(resource_URL);
+				if(body.nonNull() && body->local_path != local_path) // If the resource has been moved to a different file since it was cached:
+					body = Reference<ResourceBody>();
 
-				// NOTE: only handle a single range for now, because the response content types (and encoding?) get different for multiple ranges.
-				if(request.ranges.size() == 1)
+				if(body.nonNull())
 				{
-					for(size_t i=0; i<request.ranges.size(); ++i)
+					ResourceData resource_data;
+					resource_data.data = body->data.data();
+					resource_data.size = body->data.size();
+					resource_data.sendfile_socket = NULL;
+					resource_data.sendfile_fd = -1;
+					writeResourceResponse(request, reply_info, resource_data, content_type, etag);
+					return;
+				}
+
+#if defined(__linux__)
+				// If the connection is a plain (non-TLS) socket, a file that is too large to cache is sent with sendfile(), where the kernel copies the file straight
+				// to the socket, so the file doesn't need to be mapped.
+				MySocket* plain_socket = dynamic_cast<MySocket*>(reply_info.socket);
+				if(plain_socket)
+				{
+					const int fd = ::open(local_path.c_str(), O_RDONLY);
+					struct stat file_stat;
+					if(fd != -1 && ::fstat(fd, &file_stat) == 0 && !data_store.resource_body_cache.shouldCacheBody((size_t)file_stat.st_size))
 					{
-						const web::Range range = request.ranges[i];
-						if(range.start < 0 || range.start >= (int64)file.fileSize())
-							throw glare::Exception("invalid range");
-						
-						int64 range_size;
-						if(range.end_incl == -1) // if this range is just to the end:
-							range_size = (int64)file.fileSize() - range.start;
-						else
+						ResourceData resource_data;
+						resource_data.data = NULL;
+						resource_data.size = (uint64)file_stat.st_size;
+						resource_data.sendfile_socket = plain_socket;
+						resource_data.sendfile_fd = fd;
+						try
 						{
-							if(range.start > range.end_incl)
-								throw glare::Exception("invalid range");
-							range_size = range.end_incl - range.start + 1;
+							writeResourceResponse(request, reply_info, resource_data, content_type, etag);
 						}
+						catch(glare::Exception&)
+						{
+							::close(fd);
+							throw;
+						}
+						::close(fd);
+						return;
+					}
+					if(fd != -1)
+						::close(fd);
+				}
+#endif
 
-						const int64 use_range_end = range.start + range_size;
-						if(use_range_end > (int64)file.fileSize())
-							throw glare::Exception("invalid range");
-
-						//conPrint("\thandleResourceRequest: serving data range (start: " + toString(range.start) + ", range_size: " + toString(range_size) + ")");
-				
-						const std::string response = 
-							"HTTP/1.1 206 Partial Content\r\n"
-							"Content-Type: " + content_type + "\r\n"
-							"Content-Range: bytes " + toString(range.start) + "-" + toString(use_range_end - 1) + "/" + toString(file.fileSize()) + "\r\n" // Note that ranges are inclusive, hence the - 1.
-							"Cache-Control: max-age=100000000\r\n"
-							"Connection: Keep-Alive\r\n"
-							"Content-Length: " + toString(range_size) + "\r\n"
-							"\r\n";
-
-						reply_info.socket->writeData(response.c_str(), response.size());
-
-						// Sanity check range.start and range_size.  Should be valid by here.
-						runtimeCheck((range.start >= 0) && (range.start <= (int64)file.fileSize()) && (range.start + range_size <= (int64)file.fileSize()));
+				MemMappedFile file(local_path);
 
-						reply_info.socket->writeData((const uint8*)file.fileData() + range.start, range_size);
-				
-						// conPrint("\thandleResourceRequest: sent data range. (len: " + toString(range_size) + ")");
-					}
+				if(data_store.resource_body_cache.shouldCacheBody(file.fileSize()))
+				{
+					// Copy the file contents into the cache, and send from the cached body.
+					body = new ResourceBody();
+					body->data.resize(file.fileSize());
+					BitUtils::checkedMemcpy(body->data.data(), file.fileData(), file.fileSize());
+					body->local_path = local_path;
+					data_store.resource_body_cache.insert(resource_URL, body);
+
+					ResourceData resource_data;
+					resource_data.data = body->data.data();
+					resource_data.size = body->data.size();
+					resource_data.sendfile_socket = NULL;
+					resource_data.sendfile_fd = -1;
+					writeResourceResponse(request, reply_info, resource_data, content_type, etag);
 				}
 				else
 				{
-					// conPrint("handleResourceRequest: serving data for '" + resource_URL + "' (len: " + toString(file.fileSize()) + " B)");
-
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheMaxAge(reply_info, file.fileData(), file.fileSize(), content_type.c_str(), /*max age(s)=*/100000000);
-
-					// conPrint("\thandleResourceRequest: sent data. (len: " + toString(file.fileSize()) + ")");
+					// The file is too large to cache.  Send it directly from the mapped file.
+					ResourceData resource_data;
+					resource_data.data = (const uint8*)file.fileData();
+					resource_data.size = file.fileSize();
+					resource_data.sendfile_socket = NULL;
+					resource_data.sendfile_fd = -1;
+					writeResourceResponse(request, reply_info, resource_data, content_type, etag);
 				}
 			}
 			catch(glare::Exception&)
@@ -248,3 +528,401 @@ void listResources(ServerAllWorldsState& world_state, const web::RequestInfo& re
 
 
 } // end namespace ResourceHandlers
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/ResourceManager.h"
+#include <TestUtils.h>
+#include <BufferOutStream.h>
+#include <MyThread.h>
+#include <Timer.h>
+
+
+static web::Range makeRange(int64 start, int64 end_incl)
+{
+	web::Range range;
+	range.start = start;
+	range.end_incl = end_incl;
+	return range;
+}
+
+
+static void testResolveSingleRange(int64 start, int64 end_incl, uint64 resource_size, ResourceHandlers::RangeRequestType expected_type, uint64 expected_start = 0, uint64 expected_size = 0)
+{
+	std::vector<web::Range> ranges(1, makeRange(start, end_incl));
+	std::vector<ResourceHandlers::ByteRange> byte_ranges;
+	testAssert(ResourceHandlers::resolveByteRanges(ranges, resource_size, byte_ranges) == expected_type);
+	if(expected_type == ResourceHandlers::RangeRequest_Satisfiable)
+	{
+		testAssert(byte_ranges.size() == 1);
+		testAssert(byte_ranges[0].start == expected_start);
+		testAssert(byte_ranges[0].size == expected_size);
+	}
+	else
+		testAssert(byte_ranges.empty());
+}
+
+
+struct TestResponse
+{
+	std::string status_line;
+	std::string headers;
+	std::string body;
+};
+
+
+// Handles a request for the resource, and splits the response written to the socket into the status line, headers and body.
+static TestResponse doTestResourceRequest(ServerAllWorldsState& world_state, WebDataStore& data_store, const std::string& URL, const std::vector<web::Range>& ranges, 
+	const std::string& if_none_match = std::string())
+{
+	web::RequestInfo request;
+	request.verb = "GET";
+	request.path = "/resource/" + URL;
+	request.ranges = ranges;
+	if(!if_none_match.empty())
+	{
+		web::Header header;
+		header.key = "If-None-Match";
+		header.value = if_none_match;
+		request.headers.push_back(header);
+	}
+
+	web::ReplyInfo reply_info;
+	BufferOutStream out_stream;
+	reply_info.socket = &out_stream;
+
+	ResourceHandlers::handleResourceRequest(world_state, data_store, request, reply_info);
+
+	const std::string response(out_stream.buf.begin(), out_stream.buf.end());
+	const size_t status_line_end = response.find("\r\n");
+	const size_t headers_end = response.find("\r\n\r\n");
+	testAssert(status_line_end != std::string::npos && headers_end != std::string::npos);
+
+	TestResponse res;
+	res.status_line = response.substr(0, status_line_end);
+	res.headers = response.substr(status_line_end + 2, headers_end + 2 - (status_line_end + 2));
+	res.body = response.substr(headers_end + 4);
+	return res;
+}
+
+
+static bool hasHeader(const TestResponse& response, const std::string& header_line)
+{
+	return response.headers.find(header_line + "\r\n") != std::string::npos;
+}
+
+
+// Tests single range, multiple range, unsatisfiable and 304 responses for the resource with the given contents.
+static void testResourceResponses(ServerAllWorldsState& world_state, WebDataStore& data_store, const std::string& URL, const std::string& contents)
+{
+	// Whole resource
+	const TestResponse whole_res = doTestResourceRequest(world_state, data_store, URL, std::vector<web::Range>());
+	testAssert(whole_res.status_line == "HTTP/1.1 200 OK");
+	testAssert(hasHeader(whole_res, "Content-Length: " + toString(contents.size())));
+	testAssert(hasHeader(whole_res, "Accept-Ranges: bytes"));
+	testAssert(whole_res.body == contents);
+
+	const size_t etag_pos = whole_res.headers.find("ETag: ");
+	testAssert(etag_pos != std::string::npos);
+	const std::string etag = whole_res.headers.substr(etag_pos + 6, whole_res.headers.find("\r\n", etag_pos) - (etag_pos + 6));
+	testAssert(etag.size() > 2 && etag[0] == '"' && etag.back() == '"');
+
+	// If-None-Match with the ETag should give a 304 with no body.
+	{
+		const TestResponse res = doTestResourceRequest(world_state, data_store, URL, std::vector<web::Range>(), etag);
+		testAssert(res.status_line == "HTTP/1.1 304 Not Modified");
+		testAssert(res.body.empty());
+
+		const TestResponse res2 = doTestResourceRequest(world_state, data_store, URL, std::vector<web::Range>(), "\"someotheretag\"");
+		testAssert(res2.status_line == "HTTP/1.1 200 OK");
+		testAssert(res2.body == contents);
+	}
+
+	// Single range
+	{
+		const TestResponse res = doTestResourceRequest(world_state, data_store, URL, std::vector<web::Range>(1, makeRange(10, 19)));
+		testAssert(res.status_line == "HTTP/1.1 206 Partial Content");
+		testAssert(hasHeader(res, "Content-Range: bytes 10-19/" + toString(contents.size())));
+		testAssert(hasHeader(res, "Content-Length: 10"));
+		testAssert(res.body == contents.substr(10, 10));
+	}
+
+	// Single range to end of resource
+	{
+		const TestResponse res = doTestResourceRequest(world_state, data_store, URL, std::vector<web::Range>(1, makeRange(100, -1)));
+		testAssert(res.status_line == "HTTP/1.1 206 Partial Content");
+		testAssert(hasHeader(res, "Content-Range: bytes 100-" + toString(contents.size() - 1) + "/" + toString(contents.size())));
+		testAssert(res.body == contents.substr(100));
+	}
+
+	// Multiple ranges
+	{
+		std::vector<web::Range> ranges;
+		ranges.push_back(makeRange(0, 9));
+		ranges.push_back(makeRange(100, 109));
+		ranges.push_back(makeRange(-5, -1));
+		const TestResponse res = doTestResourceRequest(world_state, data_store, URL, ranges);
+		testAssert(res.status_line == "HTTP/1.1 206 Partial Content");
+		testAssert(hasHeader(res, "Content-Length: " + toString(res.body.size())));
+
+		const size_t boundary_pos = res.headers.find("Content-Type: multipart/byteranges; boundary=");
+		testAssert(boundary_pos != std::string::npos);
+		const size_t boundary_start = boundary_pos + std::string("Content-Type: multipart/byteranges; boundary=").size();
+		const std::string boundary = res.headers.substr(boundary_start, res.headers.find("\r\n", boundary_start) - boundary_start);
+
+		const std::string content_type = web::ResponseUtils::getContentTypeForPath(world_state.resource_manager->pathForURL(URL));
+		const std::string expected_body = 
+			"\r\n--" + boundary + "\r\nContent-Type: " + content_type + "\r\nContent-Range: bytes 0-9/" + toString(contents.size()) + "\r\n\r\n" + contents.substr(0, 10) + 
+			"\r\n--" + boundary + "\r\nContent-Type: " + content_type + "\r\nContent-Range: bytes 100-109/" + toString(contents.size()) + "\r\n\r\n" + contents.substr(100, 10) + 
+			"\r\n--" + boundary + "\r\nContent-Type: " + content_type + "\r\nContent-Range: bytes " + toString(contents.size() - 5) + "-" + toString(contents.size() - 1) + "/" + toString(contents.size()) + "\r\n\r\n" + contents.substr(contents.size() - 5) + 
+			"\r\n--" + boundary + "--\r\n";
+		testAssert(res.body == expected_body);
+	}
+
+	// Unsatisfiable range
+	{
+		const TestResponse res = doTestResourceRequest(world_state, data_store, URL, std::vector<web::Range>(1, makeRange((int64)contents.size(), -1)));
+		testAssert(res.status_line == "HTTP/1.1 416 Range Not Satisfiable");
+		testAssert(hasHeader(res, "Content-Range: bytes */" + toString(contents.size())));
+		testAssert(res.body.empty());
+	}
+
+	// Invalid range: the range should be ignored, and the whole resource sent.
+	{
+		const TestResponse res = doTestResourceRequest(world_state, data_store, URL, std::vector<web::Range>(1, makeRange(20, 10)));
+		testAssert(res.status_line == "HTTP/1.1 200 OK");
+		testAssert(res.body == contents);
+	}
+}
+
+
+// Reads num_bytes from the socket, as a client of the benchmark would.
+class ResourceBenchmarkClientThread : public MyThread
+{
+public:
+	ResourceBenchmarkClientThread(MySocketRef socket_, uint64 num_bytes_) : socket(socket_), num_bytes(num_bytes_) {}
+
+	virtual void run()
+	{
+		std::vector<uint8> buf(1 << 16);
+		uint64 num_read = 0;
+		while(num_read < num_bytes)
+		{
+			const size_t read_size = (size_t)myMin<uint64>(buf.size(), num_bytes - num_read);
+			socket->readData(buf.data(), read_size);
+			num_read += read_size;
+		}
+	}
+
+	MySocketRef socket;
+	uint64 num_bytes;
+};
+
+
+void ResourceHandlers::test()
+{
+	conPrint("ResourceHandlers::test()");
+
+	//-------------------------- Test resolveByteRanges --------------------------
+	{
+		std::vector<ByteRange> byte_ranges;
+		testAssert(resolveByteRanges(std::vector<web::Range>(), 1000, byte_ranges) == RangeRequest_WholeResource);
+
+		testResolveSingleRange(0, 99,		1000, RangeRequest_Satisfiable, 0, 100);
+		testResolveSingleRange(0, 0,		1000, RangeRequest_Satisfiable, 0, 1);
+		testResolveSingleRange(999, 999,	1000, RangeRequest_Satisfiable, 999, 1);
+		testResolveSingleRange(100, -1,		1000, RangeRequest_Satisfiable, 100, 900);
+		testResolveSingleRange(0, -1,		1000, RangeRequest_Satisfiable, 0, 1000);
+		testResolveSingleRange(500, 5000,	1000, RangeRequest_Satisfiable, 500, 500); // End past end of resource is clamped.
+		testResolveSingleRange(0, 999,		1000, RangeRequest_Satisfiable, 0, 1000);
+
+		// Ranges starting at or past the end of the resource are unsatisfiable.
+		testResolveSingleRange(1000, -1,	1000, RangeRequest_Unsatisfiable);
+		testResolveSingleRange(1000, 1100,	1000, RangeRequest_Unsatisfiable);
+		testResolveSingleRange(0, 0,		0,    RangeRequest_Unsatisfiable);
+		testResolveSingleRange(0, -1,		0,    RangeRequest_Unsatisfiable);
+
+		// Invalid ranges: the Range header is ignored.
+		testResolveSingleRange(10, 5,		1000, RangeRequest_WholeResource);
+		testResolveSingleRange(-5, 10,		1000, RangeRequest_WholeResource);
+
+		// Suffix ranges
+		testResolveSingleRange(-100, -1,	1000, RangeRequest_Satisfiable, 900, 100);
+		testResolveSingleRange(-1, -1,		1000, RangeRequest_Satisfiable, 999, 1);
+		testResolveSingleRange(-1000, -1,	1000, RangeRequest_Satisfiable, 0, 1000);
+		testResolveSingleRange(-2000, -1,	1000, RangeRequest_Satisfiable, 0, 1000); // Suffix longer than resource.
+		testResolveSingleRange(-100, -1,	0,    RangeRequest_Unsatisfiable);
+
+		// Multiple ranges
+		{
+			std::vector<web::Range> ranges;
+			ranges.push_back(makeRange(0, 9));
+			ranges.push_back(makeRange(20, 29));
+			ranges.push_back(makeRange(-10, -1));
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_Satisfiable);
+			testAssert(byte_ranges.size() == 3);
+			testAssert(byte_ranges[0].start == 0   && byte_ranges[0].size == 10);
+			testAssert(byte_ranges[1].start == 20  && byte_ranges[1].size == 10);
+			testAssert(byte_ranges[2].start == 990 && byte_ranges[2].size == 10);
+		}
+
+		// Unsatisfiable ranges are left out, as long as one range is satisfiable.
+		{
+			std::vector<web::Range> ranges;
+			ranges.push_back(makeRange(2000, 3000));
+			ranges.push_back(makeRange(0, 9));
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_Satisfiable);
+			testAssert(byte_ranges.size() == 1);
+			testAssert(byte_ranges[0].start == 0 && byte_ranges[0].size == 10);
+
+			ranges[1] = makeRange(1000, -1);
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_Unsatisfiable);
+			testAssert(byte_ranges.empty());
+		}
+
+		// An invalid range in a list of ranges means the whole Range header is ignored.
+		{
+			std::vector<web::Range> ranges;
+			ranges.push_back(makeRange(0, 9));
+			ranges.push_back(makeRange(30, 20));
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_WholeResource);
+			testAssert(byte_ranges.empty());
+		}
+
+		// Overlapping ranges that add up to more than the resource size give the whole resource.
+		{
+			std::vector<web::Range> ranges;
+			ranges.push_back(makeRange(0, 599));
+			ranges.push_back(makeRange(400, 999));
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_WholeResource);
+
+			ranges[1] = makeRange(600, 999); // Not overlapping, adds up to exactly the resource size.
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_Satisfiable);
+			testAssert(byte_ranges.size() == 2);
+		}
+
+		// Too many ranges
+		{
+			std::vector<web::Range> ranges;
+			for(size_t i=0; i<MAX_NUM_RANGES; ++i)
+				ranges.push_back(makeRange(i * 10, i * 10 + 4));
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_Satisfiable);
+			testAssert(byte_ranges.size() == MAX_NUM_RANGES);
+
+			ranges.push_back(makeRange(900, 904));
+			testAssert(resolveByteRanges(ranges, 1000, byte_ranges) == RangeRequest_WholeResource);
+		}
+	}
+
+	//-------------------------- Test handleResourceRequest --------------------------
+	try
+	{
+		const std::string resource_dir = PlatformUtils::getTempDirPath() + "/resource_handlers_test_resources";
+		FileUtils::createDirIfDoesNotExist(resource_dir);
+
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->resource_manager = new ResourceManager(resource_dir);
+
+		std::string contents(1000, '\0');
+		for(size_t i=0; i<contents.size(); ++i)
+			contents[i] = (char)('a' + (i % 26));
+
+		const std::string src_path = PlatformUtils::getTempDirPath() + "/resource_handlers_test_resource.bin";
+		FileUtils::writeEntireFile(src_path, contents);
+		const std::string URL = "resource_handlers_test_resource_1234.bin";
+		world_state->resource_manager->copyLocalFileToResourceDir(src_path, URL);
+
+		Reference<WebDataStore> data_store = new WebDataStore();
+
+		// Test with the resource served from the cache.
+		testResourceResponses(*world_state, *data_store, URL, contents);
+		testAssert(data_store->resource_body_cache.getNumBodies() == 1);
+		testAssert(data_store->resource_body_cache.num_misses == 1); // Only the first request should have read the file.
+		testAssert(data_store->resource_body_cache.num_hits > 0);
+
+		// Test with the resource too large to cache, so served from the file.
+		data_store->resource_body_cache.clear();
+		data_store->resource_body_cache.max_body_size = 100;
+		testResourceResponses(*world_state, *data_store, URL, contents);
+		testAssert(data_store->resource_body_cache.getNumBodies() == 0);
+
+		// Test a resource that isn't present.
+		{
+			const TestResponse res = doTestResourceRequest(*world_state, *data_store, "not_present_5678.bin", std::vector<web::Range>());
+			testAssert(res.status_line != "HTTP/1.1 200 OK");
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	//-------------------------- Benchmark serving resources to a local client --------------------------
+	if(false)
+	{
+		try
+		{
+			const std::string resource_dir = PlatformUtils::getTempDirPath() + "/resource_handlers_test_resources";
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(resource_dir);
+
+			const std::string contents(1 << 20, 'a');
+			const std::string src_path = PlatformUtils::getTempDirPath() + "/resource_handlers_bench_resource.bin";
+			FileUtils::writeEntireFile(src_path, contents);
+			const std::string URL = "resource_handlers_bench_resource_1234.bin";
+			world_state->resource_manager->copyLocalFileToResourceDir(src_path, URL);
+
+			const int num_requests = 2000;
+			const int port = 7612;
+
+			for(int use_cache=0; use_cache<2; ++use_cache)
+			{
+				Reference<WebDataStore> data_store = new WebDataStore();
+				if(!use_cache)
+					data_store->resource_body_cache.max_body_size = 0; // Serve from the file, with sendfile() where supported.
+
+				web::RequestInfo request;
+				request.verb = "GET";
+				request.path = "/resource/" + URL;
+
+				// Get the response size
+				web::ReplyInfo buffer_reply_info;
+				BufferOutStream out_stream;
+				buffer_reply_info.socket = &out_stream;
+				handleResourceRequest(*world_state, *data_store, request, buffer_reply_info);
+				const uint64 response_size = out_stream.buf.size();
+
+				MySocketRef listener_socket = new MySocket();
+				listener_socket->bindAndListen(port, /*reuse address=*/true);
+				MySocketRef client_socket = new MySocket("localhost", port);
+				MySocketRef server_socket = listener_socket->acceptConnection();
+
+				Reference<ResourceBenchmarkClientThread> client_thread = new ResourceBenchmarkClientThread(client_socket, response_size * num_requests);
+				client_thread->launch();
+
+				web::ReplyInfo reply_info;
+				reply_info.socket = server_socket.getPointer();
+
+				Timer timer;
+				for(int i=0; i<num_requests; ++i)
+					handleResourceRequest(*world_state, *data_store, request, reply_info);
+				client_thread->join();
+				const double elapsed = timer.elapsed();
+
+				conPrint(std::string(use_cache ? "cached:   " : "uncached: ") + toString(num_requests) + " requests in " + doubleToStringNSigFigs(elapsed, 4) + " s (" + 
+					doubleToStringNSigFigs(num_requests / elapsed, 4) + " requests/s, " + doubleToStringNSigFigs(response_size * num_requests / elapsed * 1.0e-6, 4) + " MB/s)");
+			}
+		}
+		catch(glare::Exception& e)
+		{
+			failTest(e.what());
+		}
+	}
+
+	conPrint("ResourceHandlers::test() done");
+}
+
+
+#endif // BUILD_TESTS
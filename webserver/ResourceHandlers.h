@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2021 -
 
 
 class ServerAllWorldsState;
+class WebDataStore;
 namespace web
 {
 class RequestInfo;
@@ -21,7 +22,11 @@ ResourceHandlers
 =====================================================================*/
 namespace ResourceHandlers
 {
-	void handleResourceRequest(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+	// Serves the resource file for the URL.  Recently requested resources are served from data_store.resource_body_cache.
+	// Supports single and multiple byte ranges, and ETag / If-None-Match.
+	void handleResourceRequest(ServerAllWorldsState& world_state, WebDataStore& data_store, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
 
 	void listResources(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+
+	void test();
 } 
@@ -0,0 +1,133 @@
+/*=====================================================================
+SizeBoundedLRUCache.h
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <cassert>
+
+
+/*=====================================================================
+SizeBoundedLRUCache
+-------------------
+A map from string keys to values, where the total size of the entries is
+kept at most max_total_size by removing the least recently used entries.
+The size of an entry is given when it is inserted.
+
+Used by ResourceBodyCache and WebPageCache.
+
+Not threadsafe, the owner should hold a mutex.
+=====================================================================*/
+template <class Value>
+class SizeBoundedLRUCache
+{
+public:
+	SizeBoundedLRUCache(size_t max_total_size);
+
+	// Returns the value for the key, or NULL if there is none.  Marks the entry as the most recently used.
+	// The returned pointer is valid until the cache is next modified.
+	Value* get(const std::string& key);
+
+	// Inserts or replaces the value for the key, then removes least recently used entries until the total size is at most max_total_size.
+	// Entries larger than max_total_size are not inserted, so that every other entry isn't removed to make room for them.
+	void insert(const std::string& key, const Value& value, size_t size);
+
+	void clear();
+
+	size_t getTotalSize() const { return total_size; }
+	size_t size() const { return entries.size(); }
+
+	size_t max_total_size;
+
+private:
+	void removeLRUEntries();
+
+	struct Entry
+	{
+		Value value;
+		size_t size;
+		typename std::list<std::string>::iterator lru_list_it;
+	};
+
+	std::list<std::string> lru_list; // Keys of the entries, most recently used first.
+	std::unordered_map<std::string, Entry> entries; // Map from key to entry.
+	size_t total_size; // Sum of the sizes of the entries.
+};
+
+
+template <class Value>
+SizeBoundedLRUCache<Value>::SizeBoundedLRUCache(size_t max_total_size_)
+:	max_total_size(max_total_size_),
+	total_size(0)
+{}
+
+
+template <class Value>
+Value* SizeBoundedLRUCache<Value>::get(const std::string& key)
+{
+	auto res = entries.find(key);
+	if(res == entries.end())
+		return NULL;
+
+	lru_list.splice(lru_list.begin(), lru_list, res->second.lru_list_it); // Move to front of LRU list.  Doesn't invalidate the iterator.
+	return &res->second.value;
+}
+
+
+template <class Value>
+void SizeBoundedLRUCache<Value>::insert(const std::string& key, const Value& value, size_t size)
+{
+	if(size > max_total_size)
+		return;
+
+	auto res = entries.find(key);
+	if(res != entries.end())
+	{
+		// Replace the existing value
+		total_size -= res->second.size;
+		res->second.value = value;
+		res->second.size = size;
+		lru_list.splice(lru_list.begin(), lru_list, res->second.lru_list_it);
+	}
+	else
+	{
+		lru_list.push_front(key);
+		Entry entry;
+		entry.value = value;
+		entry.size = size;
+		entry.lru_list_it = lru_list.begin();
+		entries[key] = entry;
+	}
+	total_size += size;
+
+	removeLRUEntries();
+}
+
+
+template <class Value>
+void SizeBoundedLRUCache<Value>::removeLRUEntries()
+{
+	while(total_size > max_total_size && !lru_list.empty())
+	{
+		auto res = entries.find(lru_list.back());
+		assert(res != entries.end());
+		total_size -= res->second.size;
+		entries.erase(res);
+		lru_list.pop_back();
+	}
+}
+
+
+template <class Value>
+void SizeBoundedLRUCache<Value>::clear()
+{
+	lru_list.clear();
+	entries.clear();
+	total_size = 0;
+}
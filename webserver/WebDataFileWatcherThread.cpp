@@ -33,7 +33,7 @@ WebDataFileWatcherThread::~WebDataFileWatcherThread()
 #if defined(_WIN32)
 static HANDLE makeWaitHandleForDir(const std::string& dir, bool watch_subtree)
 {
-	HANDLE wait_handle = FindFirstChangeNotification(StringUtils::UTF8ToPlatformUnicodeEncoding(dir).c_str(), /*watch subtree=*/watch_subtree, FILE_NOTIFY_CHANGE_LAST_WRITE);
+	HANDLE wait_handle = FindFirstChangeNotification(StringUtils::UTF8ToPlatformUnicodeEncoding(dir).c_str(), /*watch subtree=*/watch_subtree, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME); // Watch for file name changes as well, so added and deleted files are picked up.
 	if(wait_handle == INVALID_HANDLE_VALUE)
 		throw glare::Exception("FindFirstChangeNotification failed: " + PlatformUtils::getLastErrorString());
 	return wait_handle;
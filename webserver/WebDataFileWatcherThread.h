@@ -21,6 +21,8 @@ WebDataFileWatcherThread
 ------------------------
 Watches for changes to files that the webserver is serving, 
 calls loadAndCompressFiles() when a file changes.
+loadAndCompressFiles() only recompresses the files whose contents have
+changed, so reloading after a single file is saved is cheap.
 =====================================================================*/
 class WebDataFileWatcherThread : public MessageableThread
 {
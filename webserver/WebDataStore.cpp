@@ -12,42 +12,65 @@ Copyright Glare Technologies Limited 2022 -
 #include <ConPrint.h>
 #include <FileUtils.h>
 #include <Lock.h>
+#include <TaskManager.h>
+#include <Timer.h>
+#include <IncludeXXHash.h>
 #include <zlib.h>
+#include <zstd.h>
 #include <ResponseUtils.h>
+#include <cstring>
 
 
-WebDataStore::WebDataStore() {}
+WebDataStore::WebDataStore()
+:	num_files_compressed(0),
+	resource_body_cache(/*max total size=*/256 * 1024 * 1024, /*max body size=*/16 * 1024 * 1024),
+	web_page_cache(/*max total size=*/64 * 1024 * 1024, /*max page age=*/10.0)
+{}
 
 
 WebDataStore::~WebDataStore() {}
 
 
+// Zstandard files are compressed once when loaded, then served many times, so use a high compression level.
+static const int ZSTD_COMPRESSION_LEVEL = 19;
 
-static js::Vector<uint8, 16> compressFile(const std::string& path)
+
+static void gzipCompress(const js::Vector<uint8, 16>& data, js::Vector<uint8, 16>& compressed_data_out)
 {
-	MemMappedFile file(path);
-	
-	const uLong bound = compressBound((uLong)file.fileSize());
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+
+	// Adding 16 to the window bits makes zlib write a gzip header and trailer, instead of the zlib ones.
+	if(deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, /*window bits=*/15 + 16, /*mem level=*/9, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw glare::Exception("deflateInit2 failed.");
+
+	compressed_data_out.resize(deflateBound(&stream, (uLong)data.size()));
 
-	js::Vector<uint8, 16> compressed_data(bound);
-	uLong dest_len = bound;
+	stream.next_in = (Bytef*)data.data();
+	stream.avail_in = (uInt)data.size();
+	stream.next_out = compressed_data_out.data();
+	stream.avail_out = (uInt)compressed_data_out.size();
 
-	const int result = ::compress2(
-		compressed_data.data(), // dest
-		&dest_len, // dest len
-		(Bytef*)file.fileData(), // source
-		(uLong)file.fileSize(), // source len
-		Z_BEST_COMPRESSION // Compression level
-	);
+	const int result = deflate(&stream, Z_FINISH);
+	const size_t compressed_size = stream.total_out;
+	deflateEnd(&stream);
 
-	if(result != Z_OK)
-		throw glare::Exception("Compression failed.");
+	if(result != Z_STREAM_END)
+		throw glare::Exception("gzip compression failed.");
 
-	compressed_data.resize(dest_len);
+	compressed_data_out.resize(compressed_size);
+}
+
+
+static void zstdCompress(const js::Vector<uint8, 16>& data, js::Vector<uint8, 16>& compressed_data_out)
+{
+	compressed_data_out.resize(ZSTD_compressBound(data.size()));
 
-	// conPrint("Compressed file '" + path + "' from " + toString(file.fileSize()) + " B to " + toString((uint32)dest_len) + " B");
+	const size_t compressed_size = ZSTD_compress(compressed_data_out.data(), compressed_data_out.size(), data.data(), data.size(), ZSTD_COMPRESSION_LEVEL);
+	if(ZSTD_isError(compressed_size))
+		throw glare::Exception("Zstandard compression failed: " + std::string(ZSTD_getErrorName(compressed_size)));
 
-	return compressed_data;
+	compressed_data_out.resize(compressed_size);
 }
 
 
@@ -71,105 +94,144 @@ static bool shouldCompressFile(const std::string& path)
 }
 
 
-static Reference<WebDataStoreFile> loadAndMaybeCompressFile(const std::string& path)
+// Loads a file, and compresses it if needed.  Returns existing_file instead if the file contents haven't changed.
+// Sets was_compressed_out to true if the file was compressed.
+static Reference<WebDataStoreFile> loadAndMaybeCompressFile(const std::string& path, const Reference<WebDataStoreFile>& existing_file, bool& was_compressed_out)
 {
+	was_compressed_out = false;
+
+	js::Vector<uint8, 16> data = readFile(path);
+	const uint64 content_hash = XXH64(data.data(), data.size(), /*seed=*/1);
+
+	if(existing_file.nonNull() && existing_file->content_hash == content_hash)
+		return existing_file;
+
 	Reference<WebDataStoreFile> file = new WebDataStoreFile();
-	const bool should_compresss = shouldCompressFile(path);
-	if(should_compresss)
+	file->compressed = shouldCompressFile(path);
+	if(file->compressed)
 	{
-		file->data = compressFile(path);
-		file->compressed = true;
+		gzipCompress(data, file->gzip_data);
+		zstdCompress(data, file->zstd_data);
+		was_compressed_out = true;
+
+		// conPrint("Compressed file '" + path + "' from " + toString(data.size()) + " B to " + toString(file->gzip_data.size()) + " B (gzip), " + toString(file->zstd_data.size()) + " B (zstd)");
 	}
-	else
+	file->data.swap(data);
+	file->content_type = web::ResponseUtils::getContentTypeForPath(path);
+	file->content_hash = content_hash;
+	file->etag = "\"" + toHexString(content_hash) + "\"";
+	if(file->compressed)
 	{
-		file->data = readFile(path);
-		file->compressed = false;
+		file->gzip_etag = "\"" + toHexString(content_hash) + "-gz\"";
+		file->zstd_etag = "\"" + toHexString(content_hash) + "-zst\"";
 	}
-	file->content_type = web::ResponseUtils::getContentTypeForPath(path);
 	return file;
 }
 
 
-void WebDataStore::loadAndCompressFiles()
+class LoadWebDataFileTask : public glare::Task
 {
-	conPrint("WebDataStore::loadAndCompressFiles");
-
-	//-------------- Load (HTML) fragment files --------------
-	const std::vector<std::string> fragment_filenames = FileUtils::getFilesInDir(this->fragments_dir);
-
-	for(auto it = fragment_filenames.begin(); it != fragment_filenames.end(); ++it)
+public:
+	virtual void run(size_t thread_index)
 	{
-		const std::string filename = *it;
-		const std::string path = fragments_dir + "/" + filename;
-
 		try
 		{
-			conPrint("Loading fragment from '" + path + "'...");
-			Reference<WebDataStoreFile> file = loadAndMaybeCompressFile(path);
-
-			{
-				Lock lock(mutex);
-				fragment_files[filename] = file;
-			}
+			file = loadAndMaybeCompressFile(path, existing_file, was_compressed);
 		}
 		catch(glare::Exception& e)
 		{
 			conPrint("WebDataStore::loadAndCompressFiles: warning: " + e.what());
+			file = existing_file; // Keep serving the existing version of the file, if there is one.
 		}
 	}
 
+	std::string path;
+	std::string key; // Key in the file map.
+	Reference<WebDataStoreFile> existing_file; // The currently loaded version of the file, or NULL if there isn't one.
 
-	//-------------- Load public files --------------
-	const std::vector<std::string> public_file_filenames = FileUtils::getFilesInDir(this->public_files_dir);
+	Reference<WebDataStoreFile> file; // Set by run().  NULL if loading failed and there was no existing file.
+	bool was_compressed;
+};
 
-	for(auto it = public_file_filenames.begin(); it != public_file_filenames.end(); ++it)
+
+// Makes tasks for loading the files at relative_paths in dir.
+static void makeLoadTasks(const std::string& dir, const std::vector<std::string>& relative_paths, const std::map<std::string, Reference<WebDataStoreFile>>& existing_files,
+	std::vector<Reference<LoadWebDataFileTask>>& tasks_out)
+{
+	for(auto it = relative_paths.begin(); it != relative_paths.end(); ++it)
 	{
-		const std::string filename = *it;
-		const std::string path = public_files_dir + "/" + filename;
+		Reference<LoadWebDataFileTask> task = new LoadWebDataFileTask();
+		task->path = dir + "/" + *it;
+		task->key = StringUtils::replaceCharacter(*it, '\\', '/'); // Replace backslashes with forward slashes.
+		task->was_compressed = false;
 
-		try
-		{
-			//conPrint("Loading file '" + path + "'...");
-			Reference<WebDataStoreFile> file = loadAndMaybeCompressFile(path);
+		const auto res = existing_files.find(task->key);
+		if(res != existing_files.end())
+			task->existing_file = res->second;
 
-			{
-				Lock lock(mutex);
-				public_files[filename] = file;
-			}
-		}
-		catch(glare::Exception& e)
-		{
-			conPrint("WebDataStore::loadAndCompressFiles: warning: " + e.what());
-		}
+		tasks_out.push_back(task);
+	}
+}
+
+
+static void getLoadedFiles(const std::vector<Reference<LoadWebDataFileTask>>& tasks, std::map<std::string, Reference<WebDataStoreFile>>& files_out, size_t& num_compressed_in_out)
+{
+	for(size_t i=0; i<tasks.size(); ++i)
+	{
+		if(tasks[i]->file.nonNull())
+			files_out[tasks[i]->key] = tasks[i]->file;
+		if(tasks[i]->was_compressed)
+			num_compressed_in_out++;
 	}
+}
 
 
-	//-------------- Load webclient files --------------
-	const std::vector<std::string> webclient_paths = FileUtils::getFilesInDirRecursive(this->webclient_dir);
+void WebDataStore::loadAndCompressFiles()
+{
+	conPrint("WebDataStore::loadAndCompressFiles");
+	Timer timer;
+
+	const std::vector<std::string> fragment_filenames = FileUtils::getFilesInDir(this->fragments_dir); // (HTML) fragment files
+	const std::vector<std::string> public_file_filenames = FileUtils::getFilesInDir(this->public_files_dir);
+	const std::vector<std::string> webclient_paths = FileUtils::getFilesInDirRecursive(this->webclient_dir); // paths relative to webclient_dir.
 
-	for(auto it = webclient_paths.begin(); it != webclient_paths.end(); ++it)
+	std::vector<Reference<LoadWebDataFileTask>> fragment_tasks, public_file_tasks, webclient_tasks;
 	{
-		const std::string relative_path = *it; // path relative to webclient_dir.
-		const std::string path = this->webclient_dir + "/" + relative_path;
+		Lock lock(mutex);
+		makeLoadTasks(fragments_dir,	fragment_filenames,		fragment_files,			fragment_tasks);
+		makeLoadTasks(public_files_dir,	public_file_filenames,	public_files,			public_file_tasks);
+		makeLoadTasks(webclient_dir,	webclient_paths,		webclient_dir_files,	webclient_tasks);
+	}
 
-		try
-		{
-			//conPrint("Loading file '" + path + "'...");
-			Reference<WebDataStoreFile> file = loadAndMaybeCompressFile(path);
-
-			const std::string use_relative_path = StringUtils::replaceCharacter(relative_path, '\\', '/'); // Replace backslashes with forward slashes.
-			{
-				Lock lock(mutex);
-				webclient_dir_files[use_relative_path] = file;
-			}
-		}
-		catch(glare::Exception& e)
-		{
-			conPrint("WebDataStore::loadAndCompressFiles: warning: " + e.what());
-		}
+	{
+		glare::TaskManager task_manager("WebDataStore task manager");
+		for(size_t i=0; i<fragment_tasks.size(); ++i)
+			task_manager.addTask(fragment_tasks[i]);
+		for(size_t i=0; i<public_file_tasks.size(); ++i)
+			task_manager.addTask(public_file_tasks[i]);
+		for(size_t i=0; i<webclient_tasks.size(); ++i)
+			task_manager.addTask(webclient_tasks[i]);
+		task_manager.waitForTasksToComplete();
+	}
+
+	std::map<std::string, Reference<WebDataStoreFile>> new_fragment_files, new_public_files, new_webclient_dir_files;
+	size_t num_compressed = 0;
+	getLoadedFiles(fragment_tasks,		new_fragment_files,			num_compressed);
+	getLoadedFiles(public_file_tasks,	new_public_files,			num_compressed);
+	getLoadedFiles(webclient_tasks,		new_webclient_dir_files,	num_compressed);
+
+	{
+		Lock lock(mutex);
+		fragment_files.swap(new_fragment_files);
+		public_files.swap(new_public_files);
+		webclient_dir_files.swap(new_webclient_dir_files);
+		num_files_compressed = num_compressed;
 	}
 
-	//conPrint("WebDataStore::loadAndCompressFiles done.");
+	web_page_cache.clear();
+
+	conPrint("WebDataStore::loadAndCompressFiles done.  Loaded " + toString(fragment_tasks.size() + public_file_tasks.size() + webclient_tasks.size()) + " files, compressed " + 
+		toString(num_compressed) + " files (elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
 }
 
 
@@ -182,3 +244,307 @@ Reference<WebDataStoreFile> WebDataStore::getFragmentFile(const std::string& pat
 	else
 		return Reference<WebDataStoreFile>();
 }
+
+
+// Parses a q-value (e.g. "0.5") from an Accept-Encoding header.  Returns -1 if it is not valid.
+static float parseQValue(const std::string& s)
+{
+	if(s.empty() || s.size() > 5 || (s[0] != '0' && s[0] != '1'))
+		return -1;
+
+	float q = (float)(s[0] - '0');
+	if(s.size() > 1)
+	{
+		if(s[1] != '.')
+			return -1;
+		float place_value = 0.1f;
+		for(size_t i=2; i<s.size(); ++i)
+		{
+			if(s[i] < '0' || s[i] > '9')
+				return -1;
+			q += place_value * (s[i] - '0');
+			place_value *= 0.1f;
+		}
+	}
+	return (q <= 1.f) ? q : -1;
+}
+
+
+WebDataStore::ContentEncoding WebDataStore::chooseContentEncoding(const std::string& accept_encoding_header)
+{
+	// The q-values for our encodings, and the wildcard.  -1 means not listed in the header.
+	float gzip_q = -1;
+	float zstd_q = -1;
+	float wildcard_q = -1;
+
+	size_t elem_begin = 0;
+	while(elem_begin < accept_encoding_header.size())
+	{
+		size_t elem_end = accept_encoding_header.find(',', elem_begin);
+		if(elem_end == std::string::npos)
+			elem_end = accept_encoding_header.size();
+
+		// Each element is a coding optionally followed by parameters, e.g. "gzip;q=0.5"
+		const std::string elem = accept_encoding_header.substr(elem_begin, elem_end - elem_begin);
+		const size_t semicolon_pos = elem.find(';');
+		const std::string coding = ::stripHeadAndTailWhitespace(elem.substr(0, semicolon_pos));
+
+		float q = 1;
+		if(semicolon_pos != std::string::npos)
+		{
+			const std::string param = ::stripHeadAndTailWhitespace(elem.substr(semicolon_pos + 1));
+			if(param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+				q = parseQValue(::stripHeadAndTailWhitespace(param.substr(2)));
+			else
+				q = -1;
+		}
+
+		if(q >= 0) // Ignore elements with invalid parameters.
+		{
+			if(StringUtils::equalCaseInsensitive(coding, "gzip") || StringUtils::equalCaseInsensitive(coding, "x-gzip"))
+				gzip_q = q;
+			else if(StringUtils::equalCaseInsensitive(coding, "zstd"))
+				zstd_q = q;
+			else if(coding == "*")
+				wildcard_q = q;
+		}
+
+		elem_begin = elem_end + 1;
+	}
+
+	// Encodings not listed get the q-value of the wildcard, if present.
+	if(gzip_q < 0)
+		gzip_q = wildcard_q;
+	if(zstd_q < 0)
+		zstd_q = wildcard_q;
+
+	if(zstd_q > 0 && zstd_q >= gzip_q)
+		return ContentEncoding_Zstd;
+	else if(gzip_q > 0)
+		return ContentEncoding_Gzip;
+	else
+		return ContentEncoding_Identity;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <PlatformUtils.h>
+
+
+static js::Vector<uint8, 16> gzipDecompress(const js::Vector<uint8, 16>& compressed_data, size_t decompressed_size)
+{
+	js::Vector<uint8, 16> data(decompressed_size);
+
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	testAssert(inflateInit2(&stream, /*window bits=*/15 + 16) == Z_OK); // Expect a gzip header
+	stream.next_in = (Bytef*)compressed_data.data();
+	stream.avail_in = (uInt)compressed_data.size();
+	stream.next_out = data.data();
+	stream.avail_out = (uInt)data.size();
+	const int result = inflate(&stream, Z_FINISH);
+	testAssert(result == Z_STREAM_END);
+	testAssert(stream.total_out == decompressed_size);
+	inflateEnd(&stream);
+	return data;
+}
+
+
+static js::Vector<uint8, 16> zstdDecompress(const js::Vector<uint8, 16>& compressed_data, size_t decompressed_size)
+{
+	js::Vector<uint8, 16> data(decompressed_size);
+	const size_t res = ZSTD_decompress(data.data(), data.size(), compressed_data.data(), compressed_data.size());
+	testAssert(!ZSTD_isError(res) && res == decompressed_size);
+	return data;
+}
+
+
+static void testCompressedFile(const Reference<WebDataStoreFile>& file, const std::string& expected_contents)
+{
+	testAssert(file.nonNull());
+	testAssert(std::string(file->data.begin(), file->data.end()) == expected_contents);
+	testAssert(file->compressed);
+	const js::Vector<uint8, 16> gzip_decompressed = gzipDecompress(file->gzip_data, file->data.size());
+	const js::Vector<uint8, 16> zstd_decompressed = zstdDecompress(file->zstd_data, file->data.size());
+	testAssert(std::string(gzip_decompressed.begin(), gzip_decompressed.end()) == expected_contents);
+	testAssert(std::string(zstd_decompressed.begin(), zstd_decompressed.end()) == expected_contents);
+	testAssert(file->gzip_data.size() < file->data.size());
+	testAssert(file->zstd_data.size() < file->data.size());
+}
+
+
+void WebDataStore::test()
+{
+	conPrint("WebDataStore::test()");
+
+	//-------------------------- Test chooseContentEncoding --------------------------
+	testAssert(chooseContentEncoding("") == ContentEncoding_Identity);
+	testAssert(chooseContentEncoding("gzip") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("x-gzip") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("GZip") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd") == ContentEncoding_Zstd);
+	testAssert(chooseContentEncoding("gzip, deflate, br, zstd") == ContentEncoding_Zstd); // Chrome
+	testAssert(chooseContentEncoding("gzip, deflate, br") == ContentEncoding_Gzip); // Safari
+	testAssert(chooseContentEncoding("deflate") == ContentEncoding_Identity);
+	testAssert(chooseContentEncoding("br") == ContentEncoding_Identity);
+	testAssert(chooseContentEncoding("identity") == ContentEncoding_Identity);
+
+	// q-values
+	testAssert(chooseContentEncoding("zstd;q=0.5, gzip") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd;q=0.5, gzip;q=0.25") == ContentEncoding_Zstd);
+	testAssert(chooseContentEncoding(" gzip ; q=0.8 ,zstd;Q=0.8 ") == ContentEncoding_Zstd); // Equal q-values prefer zstd
+	testAssert(chooseContentEncoding("gzip;q=1.000") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("gzip;q=0") == ContentEncoding_Identity);
+	testAssert(chooseContentEncoding("zstd;q=0, gzip;q=0.001") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd;q=0, gzip;q=0") == ContentEncoding_Identity);
+
+	// Invalid q-values: the element is ignored.
+	testAssert(chooseContentEncoding("zstd;q=abc, gzip") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd;q=2, gzip") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd;q=0.5555, gzip;q=0.1") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd;level=1, gzip;q=0.1") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd;q=") == ContentEncoding_Identity);
+
+	// Wildcard
+	testAssert(chooseContentEncoding("*") == ContentEncoding_Zstd);
+	testAssert(chooseContentEncoding("*;q=0.1, gzip;q=0.5") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("zstd;q=0, *") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding("*;q=0") == ContentEncoding_Identity);
+
+	// Malformed headers
+	testAssert(chooseContentEncoding(",,") == ContentEncoding_Identity);
+	testAssert(chooseContentEncoding(", gzip,") == ContentEncoding_Gzip);
+	testAssert(chooseContentEncoding(";;;") == ContentEncoding_Identity);
+
+
+	//-------------------------- Test loading and incremental reloading --------------------------
+	try
+	{
+		const std::string test_dir = PlatformUtils::getTempDirPath() + "/web_data_store_test";
+		const std::string fragments_dir = test_dir + "/fragments";
+		const std::string public_files_dir = test_dir + "/public_files";
+		const std::string webclient_dir = test_dir + "/webclient";
+		FileUtils::createDirIfDoesNotExist(test_dir);
+		FileUtils::createDirIfDoesNotExist(fragments_dir);
+		FileUtils::createDirIfDoesNotExist(public_files_dir);
+		FileUtils::createDirIfDoesNotExist(webclient_dir);
+		FileUtils::createDirIfDoesNotExist(webclient_dir + "/data");
+
+		if(FileUtils::fileExists(public_files_dir + "/new.css")) // Remove file left over from a previous run, if any.
+			FileUtils::deleteFile(public_files_dir + "/new.css");
+
+		std::string main_js;
+		for(int i=0; i<100; ++i)
+			main_js += "function f" + toString(i) + "() { return " + toString(i) + "; }\n";
+		const std::string client_html = "<html><body>" + std::string(1000, 'a') + "</body></html>";
+		const std::string fragment = "<p>Fragment</p>";
+
+		FileUtils::writeEntireFile(fragments_dir + "/frag.htmlfrag", fragment);
+		FileUtils::writeEntireFile(public_files_dir + "/main.js", main_js);
+		FileUtils::writeEntireFile(public_files_dir + "/image.png", std::string(1000, 'b'));
+		FileUtils::writeEntireFile(webclient_dir + "/data/client.html", client_html);
+
+		Reference<WebDataStore> store = new WebDataStore();
+		store->fragments_dir = fragments_dir;
+		store->public_files_dir = public_files_dir;
+		store->webclient_dir = webclient_dir;
+
+		store->loadAndCompressFiles();
+		testAssert(store->num_files_compressed == 2);
+
+		Reference<WebDataStoreFile> frag_file, main_js_file, image_file, client_html_file;
+		{
+			Lock lock(store->mutex);
+			testAssert(store->fragment_files.size() == 1);
+			testAssert(store->public_files.size() == 2);
+			testAssert(store->webclient_dir_files.size() == 1);
+			frag_file = store->fragment_files["frag.htmlfrag"];
+			main_js_file = store->public_files["main.js"];
+			image_file = store->public_files["image.png"];
+			client_html_file = store->webclient_dir_files["data/client.html"]; // Keys should use forward slashes
+		}
+
+		testCompressedFile(main_js_file, main_js);
+		testCompressedFile(client_html_file, client_html);
+		testAssert(main_js_file->content_type == web::ResponseUtils::getContentTypeForPath("main.js"));
+
+		// Fragments and images are not compressed.
+		testAssert(frag_file.nonNull() && !frag_file->compressed && std::string(frag_file->data.begin(), frag_file->data.end()) == fragment);
+		testAssert(image_file.nonNull() && !image_file->compressed && image_file->data.size() == 1000);
+		testAssert(image_file->gzip_data.empty() && image_file->zstd_data.empty());
+		testAssert(store->getFragmentFile("frag.htmlfrag") == frag_file);
+
+		// ETags should be quoted, and differ for different contents.
+		testAssert(main_js_file->etag.size() > 2 && main_js_file->etag[0] == '"' && main_js_file->etag.back() == '"');
+		testAssert(main_js_file->etag != client_html_file->etag);
+		testAssert(main_js_file->etag != image_file->etag);
+
+		// Each encoding of a compressed file should have its own ETag.
+		testAssert(main_js_file->gzip_etag.size() > 2 && main_js_file->zstd_etag.size() > 2);
+		testAssert(main_js_file->gzip_etag != main_js_file->etag && main_js_file->zstd_etag != main_js_file->etag && main_js_file->gzip_etag != main_js_file->zstd_etag);
+		testAssert(image_file->gzip_etag.empty() && image_file->zstd_etag.empty());
+
+		// Reload with no changes.  Nothing should be recompressed, and the existing file objects should be kept.
+		store->loadAndCompressFiles();
+		testAssert(store->num_files_compressed == 0);
+		{
+			Lock lock(store->mutex);
+			testAssert(store->fragment_files["frag.htmlfrag"] == frag_file);
+			testAssert(store->public_files["main.js"] == main_js_file);
+			testAssert(store->public_files["image.png"] == image_file);
+			testAssert(store->webclient_dir_files["data/client.html"] == client_html_file);
+		}
+
+		// Change main.js.  Only main.js should be recompressed.
+		const std::string new_main_js = main_js + "function g() { return 0; }\n";
+		FileUtils::writeEntireFile(public_files_dir + "/main.js", new_main_js);
+		store->loadAndCompressFiles();
+		testAssert(store->num_files_compressed == 1);
+		Reference<WebDataStoreFile> new_main_js_file;
+		{
+			Lock lock(store->mutex);
+			new_main_js_file = store->public_files["main.js"];
+			testAssert(store->public_files["image.png"] == image_file);
+			testAssert(store->webclient_dir_files["data/client.html"] == client_html_file);
+		}
+		testAssert(new_main_js_file != main_js_file);
+		testCompressedFile(new_main_js_file, new_main_js);
+		testAssert(new_main_js_file->etag != main_js_file->etag);
+
+		// Changing the file back should give the original ETag.
+		FileUtils::writeEntireFile(public_files_dir + "/main.js", main_js);
+		store->loadAndCompressFiles();
+		testAssert(store->num_files_compressed == 1);
+		{
+			Lock lock(store->mutex);
+			testAssert(store->public_files["main.js"]->etag == main_js_file->etag);
+		}
+
+		// Add a file and delete a file.
+		FileUtils::writeEntireFile(public_files_dir + "/new.css", "body { margin: 0px; margin: 0px; margin: 0px; margin: 0px; }");
+		FileUtils::deleteFile(public_files_dir + "/image.png");
+		store->loadAndCompressFiles();
+		testAssert(store->num_files_compressed == 1);
+		{
+			Lock lock(store->mutex);
+			testAssert(store->public_files.size() == 2);
+			testAssert(store->public_files.count("new.css") == 1 && store->public_files["new.css"]->compressed);
+			testAssert(store->public_files.count("image.png") == 0);
+			testAssert(store->webclient_dir_files["data/client.html"] == client_html_file);
+		}
+
+		FileUtils::deleteFile(public_files_dir + "/new.css");
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("WebDataStore::test() done");
+}
+
+
+#endif // BUILD_TESTS
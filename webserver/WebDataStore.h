@@ -6,6 +6,8 @@ Copyright Glare Technologies Limited 2022 -
 #pragma once
 
 
+#include "ResourceBodyCache.h"
+#include "WebPageCache.h"
 #include <ThreadSafeRefCounted.h>
 #include <Reference.h>
 #include <Vector.h>
@@ -19,9 +21,15 @@ Copyright Glare Technologies Limited 2022 -
 class WebDataStoreFile : public ThreadSafeRefCounted
 {
 public:
-	js::Vector<uint8, 16> data;
+	js::Vector<uint8, 16> data; // Uncompressed file data.
+	js::Vector<uint8, 16> gzip_data; // gzip compressed data, if compressed is true.
+	js::Vector<uint8, 16> zstd_data; // Zstandard compressed data, if compressed is true.
 	bool compressed;
 	std::string content_type;
+	uint64 content_hash; // Hash of the uncompressed data.
+	std::string etag; // Strong entity tag for the uncompressed file contents, including the double quotes.
+	std::string gzip_etag; // Strong entity tags for the gzip and Zstandard encodings, if compressed is true.  Strong validators must differ between content-codings.
+	std::string zstd_etag;
 };
 
 
@@ -35,10 +43,26 @@ public:
 	WebDataStore();
 	~WebDataStore();
 
-	void loadAndCompressFiles(); // Loads or reloads files.  Compresses files if needed.
+	// Loads or reloads files, in parallel.  Compresses files if needed.
+	// Files that haven't changed since the last load (same content hash) keep their existing compressed data, so only new and changed files are compressed.
+	// Files that have been deleted are removed.
+	void loadAndCompressFiles();
 
 	Reference<WebDataStoreFile> getFragmentFile(const std::string& path); // Returns NULL if not found
 
+	enum ContentEncoding
+	{
+		ContentEncoding_Identity,
+		ContentEncoding_Gzip,
+		ContentEncoding_Zstd
+	};
+
+	// Chooses the encoding to send a compressed file with, given the value of the Accept-Encoding request header.
+	// Picks the accepted encoding with the highest q-value, preferring zstd over gzip for equal q-values.  Returns ContentEncoding_Identity if neither is accepted.
+	static ContentEncoding chooseContentEncoding(const std::string& accept_encoding_header);
+
+	static void test();
+
 
 	//std::string letsencrypt_webroot;
 	std::string fragments_dir; // For HTML fragments
@@ -53,4 +77,10 @@ public:
 	std::map<std::string, Reference<WebDataStoreFile>> webclient_dir_files	GUARDED_BY(mutex);
 
 	Mutex mutex;
+
+	size_t num_files_compressed; // Number of files compressed by the last call to loadAndCompressFiles().
+
+	ResourceBodyCache resource_body_cache; // Contents of recently requested resources, for serving /resource/ requests.
+
+	WebPageCache web_page_cache; // Rendered pages, for anonymous requests.  Cleared by loadAndCompressFiles(), as pages may include fragment files.
 };
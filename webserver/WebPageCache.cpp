@@ -0,0 +1,449 @@
+/*=====================================================================
+WebPageCache.cpp
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "WebPageCache.h"
+
+
+#include "RequestInfo.h"
+#include <Lock.h>
+
+
+WebPageCache::WebPageCache(size_t max_total_size, double max_page_age_)
+:	max_page_age(max_page_age_),
+	num_hits(0),
+	num_misses(0),
+	pages(max_total_size)
+{}
+
+
+WebPageCache::~WebPageCache()
+{}
+
+
+Reference<CachedWebPage> WebPageCache::get(const std::string& key, uint64 current_generation, double current_time)
+{
+	Lock lock(mutex);
+
+	const Reference<CachedWebPage>* page = pages.get(key); // An invalid page is marked as the most recently used too, but it will be replaced when the page is re-rendered.
+	if(!page || ((*page)->generation != current_generation) || (current_time - (*page)->render_time > max_page_age))
+	{
+		num_misses++;
+		return Reference<CachedWebPage>();
+	}
+
+	num_hits++;
+	return *page;
+}
+
+
+void WebPageCache::insert(const std::string& key, const Reference<CachedWebPage>& page)
+{
+	Lock lock(mutex);
+	pages.insert(key, page, /*size=*/key.size() + page->response.size());
+}
+
+
+void WebPageCache::clear()
+{
+	Lock lock(mutex);
+	pages.clear();
+}
+
+
+size_t WebPageCache::getTotalSize()
+{
+	Lock lock(mutex);
+	return pages.getTotalSize();
+}
+
+
+size_t WebPageCache::getNumPages()
+{
+	Lock lock(mutex);
+	return pages.size();
+}
+
+
+std::string WebPageCache::makeKey(const web::RequestInfo& request, const std::vector<std::string>& key_URL_params)
+{
+	if(request.verb != "GET")
+		return std::string();
+
+	for(size_t i=0; i<request.cookies.size(); ++i)
+		if(request.cookies[i].key == "site-b") // If the request has a login session cookie:
+			return std::string();
+
+	// Other URL parameters don't change the page, so aren't included.  Otherwise requests with made-up parameters could fill the cache with copies of a page.
+	std::string key = request.path;
+	for(size_t i=0; i<key_URL_params.size(); ++i)
+	{
+		key += (i == 0) ? '?' : '&';
+		key += key_URL_params[i];
+		key += '=';
+		key += request.getURLParam(key_URL_params[i]).str();
+	}
+	return key;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "WebServerRequestHandler.h"
+#include "WebDataStore.h"
+#include "../server/ServerWorldState.h"
+#include <BufferOutStream.h>
+#include <FileUtils.h>
+#include <PlatformUtils.h>
+#include <StringUtils.h>
+#include <Timer.h>
+#include <TestUtils.h>
+#include <ConPrint.h>
+
+
+static Reference<CachedWebPage> makeTestPage(const std::string& response, uint64 generation, double render_time)
+{
+	Reference<CachedWebPage> page = new CachedWebPage();
+	page->response = response;
+	page->generation = generation;
+	page->render_time = render_time;
+	return page;
+}
+
+
+static web::RequestInfo makeTestRequest(const std::string& path, bool logged_in)
+{
+	web::RequestInfo request;
+	request.verb = "GET";
+	request.path = path;
+	request.tls_connection = true; // Avoid getting the redirect to https.
+	if(logged_in)
+	{
+		web::Cookie cookie;
+		cookie.key = "site-b"; // login session cookie key
+		cookie.value = "AAA";
+		request.cookies.push_back(cookie);
+	}
+	return request;
+}
+
+
+// Gets the response to a request through WebServerRequestHandler, which serves the page from the cache where possible.
+static std::string doTestPageRequest(WebServerRequestHandler& handler, const std::string& path, bool logged_in = false)
+{
+	const web::RequestInfo request = makeTestRequest(path, logged_in);
+
+	web::ReplyInfo reply_info;
+	BufferOutStream out_stream;
+	reply_info.socket = &out_stream;
+
+	handler.handleRequest(request, reply_info);
+
+	return std::string(out_stream.buf.begin(), out_stream.buf.end());
+}
+
+
+// Renders the page by calling the route handler directly, bypassing the cache.
+static std::string renderFreshPage(ServerAllWorldsState& world_state, WebDataStore& data_store, const std::string& path)
+{
+	const web::RequestInfo request = makeTestRequest(path, /*logged in=*/false);
+
+	web::ReplyInfo reply_info;
+	BufferOutStream out_stream;
+	reply_info.socket = &out_stream;
+
+	const WebRoute* route = WebServerRequestHandler::findRoute("GET", path);
+	testAssert(route && route->cache_anonymous_pages);
+	if(route->world_state_func)
+		route->world_state_func(world_state, request, reply_info);
+	else
+	{
+		testAssert(route->data_store_func != NULL);
+		route->data_store_func(world_state, data_store, request, reply_info);
+	}
+
+	return std::string(out_stream.buf.begin(), out_stream.buf.end());
+}
+
+
+static const char* cached_test_paths[] = { "/", "/parcel/1", "/map", "/terms", "/faq" };
+
+
+// Checks that each page is served from the cache, and is identical to a fresh render.
+static void checkCachedPagesMatchFreshRenders(WebServerRequestHandler& handler)
+{
+	WebPageCache& cache = handler.data_store->web_page_cache;
+
+	for(size_t i=0; i<staticArrayNumElems(cached_test_paths); ++i)
+	{
+		const std::string fresh_page = renderFreshPage(*handler.world_state, *handler.data_store, cached_test_paths[i]);
+		testAssert(::hasPrefix(fresh_page, "HTTP/1.1 200 OK"));
+
+		doTestPageRequest(handler, cached_test_paths[i]); // Make sure the page is cached.
+
+		const uint64 initial_num_hits = cache.num_hits;
+		const std::string cached_page = doTestPageRequest(handler, cached_test_paths[i]);
+		testAssert(cache.num_hits == initial_num_hits + 1);
+
+		if(cached_page != fresh_page)
+			failTest("Cached page for " + std::string(cached_test_paths[i]) + " differs from fresh render.");
+	}
+}
+
+
+void WebPageCache::test()
+{
+	conPrint("WebPageCache::test()");
+
+	//-------------------------- Test get and insert --------------------------
+	{
+		WebPageCache cache(/*max total size=*/1000, /*max page age=*/10.0);
+		testAssert(cache.get("/", /*generation=*/1, /*time=*/100.0).isNull());
+		testAssert(cache.num_misses == 1);
+
+		cache.insert("/", makeTestPage("a", /*generation=*/1, /*render time=*/100.0));
+		testAssert(cache.getNumPages() == 1);
+		testAssert(cache.get("/", 1, 100.0).nonNull());
+		testAssert(cache.get("/", 1, 100.0)->response == "a");
+		testAssert(cache.get("/", 1, 110.0).nonNull()); // Still valid at max_page_age.
+		testAssert(cache.num_hits == 3);
+
+		// Pages are invalid after a generation change
+		testAssert(cache.get("/", 2, 100.0).isNull());
+
+		// Pages are invalid when older than max_page_age
+		testAssert(cache.get("/", 1, 110.1).isNull());
+
+		// Replacing a page
+		cache.insert("/", makeTestPage("b", 2, 105.0));
+		testAssert(cache.getNumPages() == 1);
+		testAssert(cache.getTotalSize() == 2);
+		testAssert(cache.get("/", 1, 105.0).isNull());
+		testAssert(cache.get("/", 2, 105.0)->response == "b");
+
+		cache.clear();
+		testAssert(cache.getNumPages() == 0 && cache.getTotalSize() == 0);
+	}
+
+	//-------------------------- Test least recently used pages are removed when over max_total_size --------------------------
+	{
+		WebPageCache cache(/*max total size=*/1000, /*max page age=*/10.0);
+		cache.insert("/a", makeTestPage(std::string(298, 'a'), 1, 100.0)); // Entry size 300
+		cache.insert("/b", makeTestPage(std::string(298, 'b'), 1, 100.0));
+		cache.insert("/c", makeTestPage(std::string(298, 'c'), 1, 100.0));
+		testAssert(cache.getTotalSize() == 900 && cache.getNumPages() == 3);
+
+		testAssert(cache.get("/a", 1, 100.0).nonNull()); // Mark a as most recently used, so b is now the least recently used.
+		cache.insert("/d", makeTestPage(std::string(298, 'd'), 1, 100.0));
+		testAssert(cache.getTotalSize() == 900 && cache.getNumPages() == 3);
+		testAssert(cache.get("/b", 1, 100.0).isNull());
+		testAssert(cache.get("/c", 1, 100.0).nonNull() && cache.get("/d", 1, 100.0).nonNull() && cache.get("/a", 1, 100.0).nonNull());
+
+		// Requests for lots of distinct pages only remove the least recently used pages, so a popular page that is requested in between stays cached.
+		for(int i=0; i<1000; ++i)
+		{
+			cache.insert("/parcel/" + toString(i), makeTestPage(std::string(100, 'x'), 1, 100.0));
+			testAssert(cache.get("/a", 1, 100.0).nonNull());
+			testAssert(cache.getTotalSize() <= 1000);
+		}
+
+		// A page larger than max_total_size isn't inserted, and doesn't remove the other pages.
+		cache.insert("/big", makeTestPage(std::string(2000, 'x'), 1, 100.0));
+		testAssert(cache.get("/big", 1, 100.0).isNull());
+		testAssert(cache.get("/a", 1, 100.0).nonNull());
+	}
+
+	//-------------------------- Test makeKey --------------------------
+	{
+		const std::vector<std::string> no_params;
+		std::vector<std::string> key_params;
+		key_params.push_back("y");
+		key_params.push_back("z");
+
+		web::RequestInfo request = makeTestRequest("/parcel/10", /*logged in=*/false);
+		testAssert(makeKey(request, no_params) == "/parcel/10");
+		testAssert(makeKey(request, key_params) == "/parcel/10?y=&z=");
+
+		request.URL_params.resize(2);
+		request.URL_params[0].key = "x";
+		request.URL_params[0].value = std::string("1");
+		request.URL_params[1].key = "y";
+		request.URL_params[1].value = std::string("2");
+		testAssert(makeKey(request, no_params) == "/parcel/10"); // Parameters the handler doesn't read aren't in the key.
+		testAssert(makeKey(request, key_params) == "/parcel/10?y=2&z=");
+
+		request.verb = "POST";
+		testAssert(makeKey(request, no_params) == "");
+
+		testAssert(makeKey(makeTestRequest("/", /*logged in=*/true), no_params) == ""); // Logged-in requests aren't cached.
+		testAssert(makeKey(makeTestRequest("/", /*logged in=*/false), no_params) == "/");
+	}
+
+	//-------------------------- Test cached pages are identical to fresh renders after each kind of change --------------------------
+	try
+	{
+		const std::string fragments_dir = PlatformUtils::getTempDirPath() + "/web_page_cache_test_fragments";
+		const std::string public_files_dir = PlatformUtils::getTempDirPath() + "/web_page_cache_test_public_files";
+		const std::string webclient_dir = PlatformUtils::getTempDirPath() + "/web_page_cache_test_webclient";
+		FileUtils::createDirIfDoesNotExist(fragments_dir);
+		FileUtils::createDirIfDoesNotExist(public_files_dir);
+		FileUtils::createDirIfDoesNotExist(webclient_dir);
+		FileUtils::writeEntireFile(fragments_dir + "/root_page.htmlfrag", std::string("<div>LAND_PARCELS_FOR_SALE_HTML</div>"));
+
+		Reference<WebDataStore> data_store = new WebDataStore();
+		data_store->fragments_dir = fragments_dir;
+		data_store->public_files_dir = public_files_dir;
+		data_store->webclient_dir = webclient_dir;
+		data_store->loadAndCompressFiles();
+
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->BTC_per_EUR = 0.00002;
+		world_state->ETH_per_EUR = 0.0003;
+
+		Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+		ParcelRef parcel = new Parcel();
+		ScreenshotRef shot = new Screenshot();
+		{
+			Lock lock(world_state->mutex);
+			Lock root_world_lock(root_world->mutex);
+
+			Reference<User> user = new User();
+			user->id = UserID(0);
+			user->name = "MrAdmin";
+			world_state->user_id_to_users[user->id] = user;
+
+			parcel->id = ParcelID(1);
+			parcel->owner_id = UserID(0);
+			parcel->description = "initial description";
+			parcel->verts[0] = Vec2d(0, 0);
+			parcel->verts[1] = Vec2d(10, 0);
+			parcel->verts[2] = Vec2d(10, 20);
+			parcel->verts[3] = Vec2d(0, 20);
+			parcel->zbounds = Vec2d(-1, 10);
+			parcel->build();
+			parcel->screenshot_ids.push_back(1);
+			parcel->parcel_auction_ids.push_back(1); // The auction is added below.
+			root_world->parcels[parcel->id] = parcel;
+
+			shot->id = 1;
+			shot->state = Screenshot::ScreenshotState_notdone;
+			world_state->screenshots[shot->id] = shot;
+		}
+
+		WebServerRequestHandler handler;
+		handler.data_store = data_store.getPointer();
+		handler.server = NULL; // NOTE: only used for websocket connections
+		handler.world_state = world_state.getPointer();
+
+		checkCachedPagesMatchFreshRenders(handler);
+		testAssert(data_store->web_page_cache.getNumPages() == staticArrayNumElems(cached_test_paths));
+		testAssert(StringUtils::containsString(doTestPageRequest(handler, "/parcel/1"), "initial description"));
+		testAssert(StringUtils::containsString(doTestPageRequest(handler, "/parcel/1"), "Screenshot processing..."));
+		testAssert(!StringUtils::containsString(doTestPageRequest(handler, "/"), "/parcel_auction/1"));
+
+		// Changes that aren't added to the DB dirty sets don't change the generation, so the cached pages are still served, until they are older than max_page_age.
+		{
+			Lock lock(world_state->mutex);
+			Lock root_world_lock(root_world->mutex);
+			parcel->description = "changed description";
+		}
+		testAssert(StringUtils::containsString(doTestPageRequest(handler, "/parcel/1"), "initial description"));
+		data_store->web_page_cache.max_page_age = -1.0;
+		testAssert(StringUtils::containsString(doTestPageRequest(handler, "/parcel/1"), "changed description"));
+		data_store->web_page_cache.max_page_age = 10.0;
+
+		// Parcel change
+		const uint64 initial_generation = world_state->getWebPageGeneration();
+		{
+			Lock lock(world_state->mutex);
+			Lock root_world_lock(root_world->mutex);
+			parcel->description = "parcel change description";
+			root_world->addParcelAsDBDirty(parcel);
+		}
+		testAssert(world_state->getWebPageGeneration() != initial_generation);
+		testAssert(StringUtils::containsString(doTestPageRequest(handler, "/parcel/1"), "parcel change description"));
+		checkCachedPagesMatchFreshRenders(handler);
+
+		// Parcel auction change.  The start and end prices are the same, so the price doesn't depend on the time of rendering.
+		const uint64 parcel_change_generation = world_state->getWebPageGeneration();
+		{
+			Lock lock(world_state->mutex);
+
+			ParcelAuctionRef auction = new ParcelAuction();
+			auction->id = 1;
+			auction->parcel_id = parcel->id;
+			auction->auction_state = ParcelAuction::AuctionState_ForSale;
+			auction->auction_start_time = TimeStamp((uint64)(TimeStamp::currentTime().time - 3600));
+			auction->auction_end_time = TimeStamp((uint64)(TimeStamp::currentTime().time + 3600 * 24));
+			auction->auction_start_price = 1000;
+			auction->auction_end_price = 1000;
+			auction->last_locked_time = TimeStamp(0);
+			auction->screenshot_ids.push_back(shot->id);
+			world_state->parcel_auctions[auction->id] = auction;
+			world_state->addParcelAuctionAsDBDirty(auction);
+		}
+		testAssert(world_state->getWebPageGeneration() != parcel_change_generation);
+		testAssert(StringUtils::containsString(doTestPageRequest(handler, "/"), "/parcel_auction/1"));
+		checkCachedPagesMatchFreshRenders(handler);
+
+		// Screenshot change
+		const uint64 auction_change_generation = world_state->getWebPageGeneration();
+		{
+			Lock lock(world_state->mutex);
+			shot->state = Screenshot::ScreenshotState_done;
+			world_state->addScreenshotAsDBDirty(shot);
+		}
+		testAssert(world_state->getWebPageGeneration() != auction_change_generation);
+		testAssert(!StringUtils::containsString(doTestPageRequest(handler, "/parcel/1"), "Screenshot processing..."));
+		checkCachedPagesMatchFreshRenders(handler);
+
+		// Logged-in requests are never served from, or added to, the cache.
+		{
+			data_store->web_page_cache.clear();
+			const uint64 initial_num_hits = data_store->web_page_cache.num_hits;
+			doTestPageRequest(handler, "/", /*logged in=*/true);
+			doTestPageRequest(handler, "/", /*logged in=*/true);
+			testAssert(data_store->web_page_cache.num_hits == initial_num_hits);
+			testAssert(data_store->web_page_cache.getNumPages() == 0);
+		}
+
+		// Pages that aren't marked as cacheable aren't cached.
+		doTestPageRequest(handler, "/bot_status");
+		testAssert(data_store->web_page_cache.getNumPages() == 0);
+
+		// Reloading the web data files clears the cache, as pages include HTML fragments.
+		doTestPageRequest(handler, "/");
+		testAssert(data_store->web_page_cache.getNumPages() == 1);
+		data_store->loadAndCompressFiles();
+		testAssert(data_store->web_page_cache.getNumPages() == 0);
+
+		//-------------------------- Perf test: cached vs. uncached root page --------------------------
+		if(false)
+		{
+			const int N = 10000;
+			{
+				Timer timer;
+				for(int i=0; i<N; ++i)
+					renderFreshPage(*world_state, *data_store, "/");
+				conPrint("Fresh render:  " + doubleToStringNSigFigs(timer.elapsed() / N * 1.0e6, 4) + " us / page");
+			}
+			{
+				Timer timer;
+				for(int i=0; i<N; ++i)
+					doTestPageRequest(handler, "/");
+				conPrint("Cached render: " + doubleToStringNSigFigs(timer.elapsed() / N * 1.0e6, 4) + " us / page");
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("WebPageCache::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,98 @@
+/*=====================================================================
+WebPageCache.h
+--------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "SizeBoundedLRUCache.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Platform.h>
+#include <Mutex.h>
+#include <string>
+#include <vector>
+namespace web
+{
+class RequestInfo;
+}
+
+
+// A rendered web page: the complete HTTP response, including the header.
+class CachedWebPage : public ThreadSafeRefCounted
+{
+public:
+	std::string response;
+	uint64 generation; // ServerAllWorldsState::getWebPageGeneration() when the page started being rendered.
+	double render_time; // Time the page started being rendered, in seconds, from Clock::getTimeSinceInit().
+};
+
+
+/*=====================================================================
+WebPageCache
+------------
+A cache of rendered web pages, for pages that are requested often and
+are rendered from world state (the root page, parcel pages, the map etc.)
+
+Rendering one of these pages locks the world state mutexes, so a burst of
+requests for a page could hold up in-world clients.  Instead, anonymous
+requests for a page are served from the cache, without locking the world
+state at all, while the page is still valid.
+
+A page is valid while the web page generation (see
+ServerAllWorldsState::getWebPageGeneration()) is the same as when it was
+rendered, which changes when parcels, parcel auctions or screenshots change.
+Pages also show some data that changes without a generation change (auction
+prices, which change over time, exchange rates and OpenSea listings), so
+pages older than max_page_age are also re-rendered.
+
+Only anonymous requests (without a login session cookie) are cached.
+Pages for logged-in users show the user name, and may show (and remove) a
+web message for the user, so are always rendered.
+
+Anyone can make requests, so the cache must not be flushable by requests for
+many distinct URLs.  The key only includes the URL parameters that the page's
+handler reads, so adding other parameters maps to the same page, and when the
+total size of the cached pages exceeds max_total_size, the least recently used
+pages are removed, so popular pages stay cached.
+
+Threadsafe.
+=====================================================================*/
+class WebPageCache
+{
+public:
+	WebPageCache(size_t max_total_size, double max_page_age);
+	~WebPageCache();
+
+	// Returns the cached page for the key if it is still valid, otherwise NULL.  Marks the page as the most recently used.
+	Reference<CachedWebPage> get(const std::string& key, uint64 current_generation, double current_time);
+
+	// Inserts or replaces the page for the key, then removes least recently used pages until the total size is at most max_total_size.
+	// Pages larger than max_total_size are not inserted.
+	void insert(const std::string& key, const Reference<CachedWebPage>& page);
+
+	void clear();
+
+	size_t getTotalSize();
+	size_t getNumPages();
+
+	// Returns the cache key for a request: the path, and the values of the URL parameters in key_URL_params (the parameters the page's handler reads).
+	// Returns the empty string if the response to the request shouldn't be cached - if it isn't a GET request, or there is a login session cookie.
+	static std::string makeKey(const web::RequestInfo& request, const std::vector<std::string>& key_URL_params);
+
+	static void test();
+
+	// Limit.  Set before the cache is used.
+	double max_page_age; // in seconds
+
+	// Stats
+	uint64 num_hits;
+	uint64 num_misses;
+
+private:
+	GLARE_DISABLE_COPY(WebPageCache);
+
+	Mutex mutex;
+	SizeBoundedLRUCache<Reference<CachedWebPage>> pages GUARDED_BY(mutex); // Map from key to page.  The size of each entry is the size of the key and the response.
+};
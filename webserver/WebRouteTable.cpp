@@ -0,0 +1,202 @@
+/*=====================================================================
+WebRouteTable.cpp
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "WebRouteTable.h"
+
+
+#include <Exception.h>
+
+
+WebRouteTable::WebRouteTable()
+{}
+
+
+WebRouteTable::VerbRoutes& WebRouteTable::getOrCreateVerbRoutes(const std::string& verb)
+{
+	for(size_t i=0; i<verbs.size(); ++i)
+		if(verbs[i].first == verb)
+			return verbs[i].second;
+
+	verbs.push_back(std::make_pair(verb, VerbRoutes()));
+	VerbRoutes& routes = verbs.back().second;
+
+	PrefixTrieNode root;
+	root.route_index = NOT_FOUND;
+	routes.prefix_trie.push_back(root);
+	return routes;
+}
+
+
+const WebRouteTable::VerbRoutes* WebRouteTable::findVerbRoutes(const std::string& verb) const
+{
+	for(size_t i=0; i<verbs.size(); ++i)
+		if(verbs[i].first == verb)
+			return &verbs[i].second;
+	return NULL;
+}
+
+
+void WebRouteTable::addExactRoute(const std::string& verb, const std::string& path, size_t route_index)
+{
+	VerbRoutes& routes = getOrCreateVerbRoutes(verb);
+	if(!routes.exact_routes.insert(std::make_pair(path, route_index)).second)
+		throw glare::Exception("Duplicate route: " + verb + " " + path);
+}
+
+
+void WebRouteTable::addPrefixRoute(const std::string& verb, const std::string& prefix, size_t route_index)
+{
+	VerbRoutes& routes = getOrCreateVerbRoutes(verb);
+
+	uint32 node_i = 0;
+	for(size_t i=0; i<prefix.size(); ++i)
+	{
+		uint32 child_i = 0;
+		for(size_t z=0; z<routes.prefix_trie[node_i].children.size(); ++z)
+			if(routes.prefix_trie[node_i].children[z].first == prefix[i])
+				child_i = routes.prefix_trie[node_i].children[z].second;
+
+		if(child_i == 0) // If there is no child for this char yet (node 0 is the root, so is never a child):
+		{
+			child_i = (uint32)routes.prefix_trie.size();
+			PrefixTrieNode child;
+			child.route_index = NOT_FOUND;
+			routes.prefix_trie.push_back(child); // NOTE: may invalidate references to nodes.
+			routes.prefix_trie[node_i].children.push_back(std::make_pair(prefix[i], child_i));
+		}
+		node_i = child_i;
+	}
+
+	if(routes.prefix_trie[node_i].route_index != NOT_FOUND)
+		throw glare::Exception("Duplicate prefix route: " + verb + " " + prefix);
+	routes.prefix_trie[node_i].route_index = route_index;
+}
+
+
+size_t WebRouteTable::lookup(const std::string& verb, const std::string& path) const
+{
+	const VerbRoutes* routes = findVerbRoutes(verb);
+	if(!routes)
+		return NOT_FOUND;
+
+	const auto res = routes->exact_routes.find(path);
+	if(res != routes->exact_routes.end())
+		return res->second;
+
+	// Walk down the trie along the path, keeping the route of the longest prefix seen so far.
+	size_t best_route_index = NOT_FOUND;
+	const PrefixTrieNode* node = &routes->prefix_trie[0];
+	for(size_t i=0; ; ++i)
+	{
+		if(node->route_index != NOT_FOUND)
+			best_route_index = node->route_index;
+
+		if(i == path.size())
+			break;
+
+		const PrefixTrieNode* next = NULL;
+		for(size_t z=0; z<node->children.size(); ++z)
+			if(node->children[z].first == path[i])
+			{
+				next = &routes->prefix_trie[node->children[z].second];
+				break;
+			}
+
+		if(!next)
+			break;
+		node = next;
+	}
+
+	return best_route_index;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <ConPrint.h>
+
+
+void WebRouteTable::test()
+{
+	conPrint("WebRouteTable::test()");
+
+	try
+	{
+		WebRouteTable table;
+		testAssert(table.lookup("GET", "/") == NOT_FOUND);
+
+		table.addExactRoute("GET", "/", 0);
+		table.addExactRoute("GET", "/admin_users", 1);
+		table.addPrefixRoute("GET", "/admin_user/", 2);
+		table.addPrefixRoute("GET", "/p/", 3);
+		table.addPrefixRoute("GET", "/parcel/", 4);
+		table.addPrefixRoute("GET", "/parcel/special/", 5);
+		table.addExactRoute("GET", "/parcel/10", 6);
+		table.addExactRoute("POST", "/", 7);
+		table.addPrefixRoute("POST", "/p/", 8);
+
+		// Exact routes
+		testAssert(table.lookup("GET", "/") == 0);
+		testAssert(table.lookup("GET", "/admin_users") == 1);
+		testAssert(table.lookup("GET", "/admin_users/") == NOT_FOUND);
+		testAssert(table.lookup("GET", "/admin_user") == NOT_FOUND);
+		testAssert(table.lookup("GET", "") == NOT_FOUND);
+
+		// Prefix routes.  The prefix itself matches, with nothing following.
+		testAssert(table.lookup("GET", "/admin_user/") == 2);
+		testAssert(table.lookup("GET", "/admin_user/123") == 2);
+		testAssert(table.lookup("GET", "/p/1") == 3);
+		testAssert(table.lookup("GET", "/p") == NOT_FOUND);
+		testAssert(table.lookup("GET", "/pa") == NOT_FOUND);
+		testAssert(table.lookup("GET", "/parcel/") == 4);
+		testAssert(table.lookup("GET", "/parcel/123") == 4);
+		testAssert(table.lookup("GET", "/parcel") == NOT_FOUND);
+
+		// Longest prefix wins
+		testAssert(table.lookup("GET", "/parcel/special") == 4);
+		testAssert(table.lookup("GET", "/parcel/special/") == 5);
+		testAssert(table.lookup("GET", "/parcel/special/1") == 5);
+
+		// Exact routes take precedence over prefix routes
+		testAssert(table.lookup("GET", "/parcel/10") == 6);
+		testAssert(table.lookup("GET", "/parcel/100") == 4);
+
+		// Routes are per verb
+		testAssert(table.lookup("POST", "/") == 7);
+		testAssert(table.lookup("POST", "/admin_users") == NOT_FOUND);
+		testAssert(table.lookup("POST", "/p/1") == 8);
+		testAssert(table.lookup("POST", "/parcel/1") == NOT_FOUND);
+		testAssert(table.lookup("PUT", "/") == NOT_FOUND);
+
+		// Duplicate routes are not allowed
+		try
+		{
+			table.addExactRoute("GET", "/admin_users", 10);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+		try
+		{
+			table.addPrefixRoute("GET", "/parcel/", 10);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+		testAssert(table.lookup("GET", "/admin_users") == 1);
+		testAssert(table.lookup("GET", "/parcel/1") == 4);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("WebRouteTable::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,64 @@
+/*=====================================================================
+WebRouteTable.h
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <limits>
+
+
+/*=====================================================================
+WebRouteTable
+-------------
+Maps the verb and path of a HTTP request to a route index, which is chosen
+by the caller when adding routes (e.g. an index into an array of handlers).
+
+Exact path routes are looked up in a hash map.  Prefix routes (e.g.
+"/resource/", with something following in the path) are looked up in a trie
+of the prefixes, so the lookup time doesn't depend on the number of routes.
+
+Exact routes take precedence over prefix routes.  If more than one prefix
+route matches, the longest prefix is used.
+
+Built once, then only read, so lookups can be done from multiple threads.
+=====================================================================*/
+class WebRouteTable
+{
+public:
+	WebRouteTable();
+
+	// Throw glare::Exception if there is already a route with the same verb and path or prefix.
+	void addExactRoute(const std::string& verb, const std::string& path, size_t route_index);
+	void addPrefixRoute(const std::string& verb, const std::string& prefix, size_t route_index);
+
+	// Returns the route index for the request, or NOT_FOUND if no route matches.
+	size_t lookup(const std::string& verb, const std::string& path) const;
+
+	static const size_t NOT_FOUND = std::numeric_limits<size_t>::max();
+
+	static void test();
+
+private:
+	struct PrefixTrieNode
+	{
+		std::vector<std::pair<char, uint32> > children; // (next char, child node index).  Nodes have few children, so these are searched linearly.
+		size_t route_index; // Route for the prefix ending at this node, or NOT_FOUND.
+	};
+
+	struct VerbRoutes
+	{
+		std::unordered_map<std::string, size_t> exact_routes; // Map from path to route index.
+		std::vector<PrefixTrieNode> prefix_trie; // Node 0 is the root, for the empty prefix.
+	};
+
+	VerbRoutes& getOrCreateVerbRoutes(const std::string& verb);
+	const VerbRoutes* findVerbRoutes(const std::string& verb) const;
+
+	std::vector<std::pair<std::string, VerbRoutes> > verbs; // There are only a few verbs, so these are searched linearly.
+};
@@ -24,6 +24,8 @@ Copyright Glare Technologies Limited 2021 -
 #endif
 #include "ScreenshotHandlers.h"
 #include "ParcelHandlers.h"
+#include "WebRouteTable.h"
+#include "WebServerResponseUtils.h"
 #include "../server/WorkerThread.h"
 #include "../server/Server.h"
 #include <StringUtils.h>
@@ -33,6 +35,8 @@ Copyright Glare Technologies Limited 2021 -
 #include <FileUtils.h>
 #include <Exception.h>
 #include <Lock.h>
+#include <Clock.h>
+#include <BufferOutStream.h>
 #include <WebSocket.h>
 
 
@@ -63,6 +67,10 @@ WebServerRequestHandler::~WebServerRequestHandler()
 }*/
 
 
+static void callRouteHandler(WebServerRequestHandler& handler, const WebRoute& route, const web::RequestInfo& request, web::ReplyInfo& reply_info);
+static void handleCachedPageRequest(WebServerRequestHandler& handler, const WebRoute& route, const web::RequestInfo& request, web::ReplyInfo& reply_info);
+
+
 void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	if(!request.tls_connection)
@@ -87,522 +95,367 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 	}
 
 
-	if(request.verb == "POST")
+	const WebRoute* route = findRoute(request.verb, request.path);
+	if(route)
 	{
-		// Route PUT request
-		if(request.path == "/login_post")
-		{
-			LoginHandlers::handleLoginPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/logout_post")
-		{
-			LoginHandlers::handleLogoutPost(request, reply_info);
-		}
-		else if(request.path == "/signup_post")
-		{
-			LoginHandlers::handleSignUpPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/reset_password_post")
-		{
-			LoginHandlers::handleResetPasswordPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/change_password_post")
-		{
-			LoginHandlers::handleChangePasswordPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/set_new_password_post")
-		{
-			LoginHandlers::handleSetNewPasswordPost(*this->world_state, request, reply_info);
-		}
-#if USE_GLARE_PARCEL_AUCTION_CODE
-		else if(request.path == "/ipn_listener")
-		{
-			PayPalHandlers::handleIPNPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/coinbase_webhook")
-		{
-			CoinbaseHandlers::handleCoinbaseWebhookPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/buy_parcel_now_paypal")
-		{
-			AuctionHandlers::handleParcelBuyNowWithPayPal(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/buy_parcel_now_coinbase")
-		{
-			AuctionHandlers::handleParcelBuyNowWithCoinbase(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/buy_parcel_with_paypal_post")
-		{
-			AuctionHandlers::handleBuyParcelWithPayPalPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/buy_parcel_with_coinbase_post")
-		{
-			AuctionHandlers::handleBuyParcelWithCoinbasePost(*this->world_state, request, reply_info);
-		}
-#endif
-		else if(request.path == "/admin_create_parcel_auction_post")
-		{
-			AdminHandlers::createParcelAuctionPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_parcel_owner_post")
-		{
-			AdminHandlers::handleSetParcelOwnerPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_regenerate_parcel_auction_screenshots")
-		{
-			AdminHandlers::handleRegenerateParcelAuctionScreenshots(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_regenerate_parcel_screenshots")
-		{
-			AdminHandlers::handleRegenerateParcelScreenshots(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_regenerate_multiple_parcel_screenshots")
-		{
-			AdminHandlers::handleRegenerateMultipleParcelScreenshots(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_terminate_parcel_auction")
-		{
-			AdminHandlers::handleTerminateParcelAuction(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_mark_parcel_as_nft_minted_post")
-		{
-			AdminHandlers::handleMarkParcelAsNFTMintedPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_mark_parcel_as_not_nft_post")
-		{
-			AdminHandlers::handleMarkParcelAsNotNFTPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_retry_parcel_mint_post")
-		{
-			AdminHandlers::handleRetryParcelMintPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_transaction_state_to_new_post")
-		{
-			AdminHandlers::handleSetTransactionStateToNewPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_transaction_state_to_completed_post")
-		{
-			AdminHandlers::handleSetTransactionStateToCompletedPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_transaction_state_hash")
-		{
-			AdminHandlers::handleSetTransactionHashPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_transaction_nonce")
-		{
-			AdminHandlers::handleSetTransactionNoncePost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_server_admin_message_post")
-		{
-			AdminHandlers::handleSetServerAdminMessagePost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_read_only_mode_post")
-		{
-			AdminHandlers::handleSetReadOnlyModePost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_force_dyn_tex_update_post")
-		{
-			AdminHandlers::handleForceDynTexUpdatePost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_delete_transaction_post")
-		{
-			AdminHandlers::handleDeleteTransactionPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_regen_map_tiles_post")
-		{
-			AdminHandlers::handleRegenMapTilesPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_recreate_map_tiles_post")
-		{
-			AdminHandlers::handleRecreateMapTilesPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_min_next_nonce_post")
-		{
-			AdminHandlers::handleSetMinNextNoncePost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_user_as_world_gardener_post")
-		{
-			AdminHandlers::handleSetUserAsWorldGardenerPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_set_user_allow_dyn_tex_update_post")
-		{
-			AdminHandlers::handleSetUserAllowDynTexUpdatePost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/regenerate_parcel_screenshots")
-		{
-			ParcelHandlers::handleRegenerateParcelScreenshots(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/edit_parcel_description_post")
-		{
-			ParcelHandlers::handleEditParcelDescriptionPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/add_parcel_writer_post")
-		{
-			ParcelHandlers::handleAddParcelWriterPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/remove_parcel_writer_post")
-		{
-			ParcelHandlers::handleRemoveParcelWriterPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/account_eth_sign_message_post")
-		{
-			AccountHandlers::handleEthSignMessagePost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/make_parcel_into_nft_post")
-		{
-			AccountHandlers::handleMakeParcelIntoNFTPost(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/claim_parcel_owner_by_nft_post")
-		{
-			AccountHandlers::handleClaimParcelOwnerByNFTPost(*this->world_state, request, reply_info);
-		}
+		if(route->cache_anonymous_pages)
+			handleCachedPageRequest(*this, *route, request, reply_info);
 		else
-		{
-			const std::string page = "Unknown post URL";
-			web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page);
-		}
+			callRouteHandler(*this, *route, request, reply_info);
+	}
+	else if(request.verb == "POST")
+	{
+		const std::string page = "Unknown post URL";
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page);
 	}
 	else if(request.verb == "GET")
 	{
-		// Route GET request
-		if(request.path == "/")
-		{
-			MainPageHandlers::renderRootPage(*this->world_state, *this->data_store, request, reply_info);
-		}
-		else if(request.path == "/terms")
-		{
-			MainPageHandlers::renderTermsOfUse(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/about_parcel_sales")
-		{
-			MainPageHandlers::renderAboutParcelSales(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/about_scripting")
-		{
-			MainPageHandlers::renderAboutScripting(*this->world_state, *this->data_store, request, reply_info);
-		}
-		else if(request.path == "/about_substrata")
-		{
-			MainPageHandlers::renderAboutSubstrataPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/running_your_own_server")
-		{
-			MainPageHandlers::renderRunningYourOwnServerPage(*this->world_state, *this->data_store, request, reply_info);
-		}
-		else if(request.path == "/bot_status")
-		{
-			MainPageHandlers::renderBotStatusPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/faq")
-		{
-			MainPageHandlers::renderFAQ(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/map")
-		{
-			MainPageHandlers::renderMapPage(*this->world_state, request, reply_info);
-		}
-#if USE_GLARE_PARCEL_AUCTION_CODE
-		else if(request.path == "/pdt_landing")
-		{
-			PayPalHandlers::handlePayPalPDTOrderLanding(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/parcel_auction_list")
-		{
-			AuctionHandlers::renderParcelAuctionListPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/recent_parcel_sales")
-		{
-			AuctionHandlers::renderRecentParcelSalesPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/parcel_auction/")) // parcel auction ID follows in URL
-		{
-			AuctionHandlers::renderParcelAuctionPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/buy_parcel_with_paypal/")) // parcel ID follows in URL
-		{
-			AuctionHandlers::renderBuyParcelWithPayPalPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/buy_parcel_with_coinbase/")) // parcel ID follows in URL
-		{
-			AuctionHandlers::renderBuyParcelWithCoinbasePage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/order/")) // Order ID follows in URL
-		{
-			OrderHandlers::renderOrderPage(*this->world_state, request, reply_info);
-		}
-#endif
-		else if(::hasPrefix(request.path, "/parcel/")) // Parcel ID follows in URL
-		{
-			ParcelHandlers::renderParcelPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/edit_parcel_description")
-		{
-			ParcelHandlers::renderEditParcelDescriptionPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/add_parcel_writer")
-		{
-			ParcelHandlers::renderAddParcelWriterPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/remove_parcel_writer")
-		{
-			ParcelHandlers::renderRemoveParcelWriterPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin")
-		{
-			AdminHandlers::renderMainAdminPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_users")
-		{
-			AdminHandlers::renderUsersPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/admin_user/")) // user ID follows in URL
-		{
-			AdminHandlers::renderAdminUserPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_parcels")
-		{
-			AdminHandlers::renderParcelsPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_parcel_auctions")
-		{
-			AdminHandlers::renderParcelAuctionsPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/admin_parcel_auction/"))
-		{
-			AdminHandlers::renderAdminParcelAuctionPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_orders")
-		{
-			AdminHandlers::renderOrdersPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_sub_eth_transactions")
-		{
-			AdminHandlers::renderSubEthTransactionsPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/admin_sub_eth_transaction/"))
-		{
-			AdminHandlers::renderAdminSubEthTransactionPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/admin_map")
-		{
-			AdminHandlers::renderMapPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/admin_create_parcel_auction/")) // parcel ID follows in URL
-		{
-			AdminHandlers::renderCreateParcelAuction(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/admin_set_parcel_owner/")) // parcel ID follows in URL
-		{
-			AdminHandlers::renderSetParcelOwnerPage(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/admin_order/")) // order ID follows in URL
-		{
-			AdminHandlers::renderAdminOrderPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/login")
-		{
-			LoginHandlers::renderLoginPage(request, reply_info);
-		}
-		else if(request.path == "/signup")
-		{
-			LoginHandlers::renderSignUpPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/reset_password")
-		{
-			LoginHandlers::renderResetPasswordPage(request, reply_info);
-		}
-		else if(request.path == "/reset_password_email")
-		{
-			LoginHandlers::renderResetPasswordFromEmailPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/change_password")
-		{
-			LoginHandlers::renderChangePasswordPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/account")
-		{
-			AccountHandlers::renderUserAccountPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/prove_eth_address_owner")
-		{
-			AccountHandlers::renderProveEthAddressOwnerPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/prove_parcel_owner_by_nft")
-		{
-			AccountHandlers::renderProveParcelOwnerByNFT(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/make_parcel_into_nft")
-		{
-			AccountHandlers::renderMakeParcelIntoNFTPage(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/parcel_claim_succeeded")
-		{
-			AccountHandlers::renderParcelClaimSucceeded(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/parcel_claim_failed")
-		{
-			AccountHandlers::renderParcelClaimFailed(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/parcel_claim_invalid")
-		{
-			AccountHandlers::renderParcelClaimInvalid(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/making_parcel_into_nft")
-		{
-			AccountHandlers::renderMakingParcelIntoNFT(*this->world_state, request, reply_info);
-		}
-		else if(request.path == "/making_parcel_into_nft_failed")
-		{
-			AccountHandlers::renderMakingParcelIntoNFTFailed(*this->world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/p/")) // URL for parcel ERC 721 metadata JSON
-		{
-			ParcelHandlers::renderMetadata(*world_state, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/screenshot/")) // Screenshot ID follows
-		{
-			ScreenshotHandlers::handleScreenshotRequest(*world_state, *data_store, request, reply_info);
-		}
-		else if(request.path == "/tile")
-		{
-			ScreenshotHandlers::handleMapTileRequest(*world_state, *data_store, request, reply_info);
-		}
-		else if(::hasPrefix(request.path, "/files/"))
-		{
-			// Only serve files that are in the precomputed filename map.
-			// One reason for this is to avoid directory traversal issues, where "../" or absolute paths are used to traverse out of the public_files_dir.
-			const std::string filename = ::eatPrefix(request.path, "/files/");
+		std::string page = "Unknown page";
+		web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, page);
+	}
+}
 
-			Reference<WebDataStoreFile> store_file;
-			{
-				Lock lock(data_store->mutex);
-				const auto lookup_res = data_store->public_files.find(filename);
-				if(lookup_res != data_store->public_files.end())
-					store_file = lookup_res->second;
-			}
 
-			if(store_file.nonNull())
+// Serves a file from a map of files in the data store.  Only files in the precomputed map are served.
+// One reason for this is to avoid directory traversal issues, where "../" or absolute paths are used to traverse out of the files dir.
+static void serveDataStoreFile(WebDataStore& data_store, const std::map<std::string, Reference<WebDataStoreFile>>& files, const std::string& filename, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	Reference<WebDataStoreFile> store_file;
+	{
+		Lock lock(data_store.mutex);
+		const auto lookup_res = files.find(filename);
+		if(lookup_res != files.end())
+			store_file = lookup_res->second;
+	}
+
+	if(store_file.nonNull())
+	{
+		const js::Vector<uint8, 16>* file_data = &store_file->data;
+		const std::string* etag = &store_file->etag;
+		std::string content_encoding;
+		if(store_file->compressed)
+		{
+			const WebDataStore::ContentEncoding encoding = WebDataStore::chooseContentEncoding(WebServerResponseUtils::getRequestHeader(request, "accept-encoding"));
+			if(encoding == WebDataStore::ContentEncoding_Zstd)
 			{
-				const js::Vector<uint8, 16>& file_data = store_file->data;
-				const std::string& content_type = store_file->content_type;
-				if(store_file->compressed)
-					web::ResponseUtils::writeHTTPOKHeaderAndDeflatedDataWithCacheMaxAge(reply_info, file_data.data(), file_data.size(), content_type, 3600*24*14);
-				else
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheMaxAge(reply_info, file_data.data(), file_data.size(), content_type, 3600*24*14);
+				file_data = &store_file->zstd_data;
+				etag = &store_file->zstd_etag;
+				content_encoding = "zstd";
 			}
-			else
+			else if(encoding == WebDataStore::ContentEncoding_Gzip)
 			{
-				web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "No such file found or invalid filename");
-				return;
+				file_data = &store_file->gzip_data;
+				etag = &store_file->gzip_etag;
+				content_encoding = "gzip";
 			}
 		}
-		/* // Let's encrypt challenge response handling is disabled for now, as using godaddy certs
-		else if(::hasPrefix(request.path, "/.well-known/acme-challenge/")) // Support for Let's encrypt: Serve up challenge response file.
-		{
-			const std::string filename = ::eatPrefix(request.path, "/.well-known/acme-challenge/");
-			if(!isLetsEncryptFileQuerySafe(filename))
+
+		// If the client has the current version of the file cached, we don't need to send it again.
+		// The ETags of all the encodings refer to the current file contents, so accept any of them.  The ETag that matched is returned, so it refers to the response the client has.
+		const std::string if_none_match = WebServerResponseUtils::getRequestHeader(request, "if-none-match");
+		const std::string* candidate_etags[4] = { etag, &store_file->etag, &store_file->gzip_etag, &store_file->zstd_etag };
+		for(int i=0; i<4; ++i)
+			if(!candidate_etags[i]->empty() && WebServerResponseUtils::ifNoneMatchHeaderMatchesETag(if_none_match, *candidate_etags[i]))
 			{
-				web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "invalid/unsafe file query");
+				WebServerResponseUtils::writeHTTPNotModifiedHeader(reply_info, *candidate_etags[i], /*vary on accept encoding=*/store_file->compressed);
 				return;
 			}
 
-			// Serve up the file
-			try
-			{
-				std::string contents;
-				FileUtils::readEntireFile(data_store->letsencrypt_webroot + "/.well-known/acme-challenge/" + filename, contents);
-				web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, contents);
-			}
-			catch(FileUtils::FileUtilsExcep& e)
-			{
-				web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Failed to load file '" + filename + "': " + e.what());
-			}
-		}*/
-		else if(::hasPrefix(request.path, "/resource/"))
-		{
-			ResourceHandlers::handleResourceRequest(*this->world_state, request, reply_info);
-		}
-		/*else if(request.path ==  "/list_resources") // Disabled for now, rsync resources to back up instead.
-		{
-			ResourceHandlers::listResources(*this->world_state, request, reply_info);
-		}*/
-		else if(request.path == "/webclient")
+		WebServerResponseUtils::writeHTTPOKHeaderAndDataWithETag(reply_info, file_data->data(), file_data->size(), store_file->content_type, content_encoding, /*vary on accept encoding=*/store_file->compressed, 
+			*etag, /*max age (s)=*/3600*24*14);
+	}
+	else
+	{
+		web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "No such file found or invalid filename");
+	}
+}
+
+
+static void handlePublicFileRequest(WebServerRequestHandler& handler, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	const std::string filename = ::eatPrefix(request.path, "/files/");
+	serveDataStoreFile(*handler.data_store, handler.data_store->public_files, filename, request, reply_info);
+}
+
+
+/* // Let's encrypt challenge response handling is disabled for now, as using godaddy certs
+static void handleLetsEncryptChallengeRequest(WebServerRequestHandler& handler, const web::RequestInfo& request, web::ReplyInfo& reply_info) // Support for Let's encrypt: Serve up challenge response file.
+{
+	const std::string filename = ::eatPrefix(request.path, "/.well-known/acme-challenge/");
+	if(!isLetsEncryptFileQuerySafe(filename))
+	{
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "invalid/unsafe file query");
+		return;
+	}
+
+	// Serve up the file
+	try
+	{
+		std::string contents;
+		FileUtils::readEntireFile(handler.data_store->letsencrypt_webroot + "/.well-known/acme-challenge/" + filename, contents);
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, contents);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Failed to load file '" + filename + "': " + e.what());
+	}
+}*/
+
+
+static void handleWebClientPageRequest(WebServerRequestHandler& handler, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	try
+	{
+		std::string contents;
+		FileUtils::readEntireFile(handler.data_store->webclient_dir + "/client.html", contents);
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, contents);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("Failed to load file /webclient: " + e.what());
+		web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "Failed to load file /webclient");
+	}
+}
+
+
+static void handleWebClientFileRequest(WebServerRequestHandler& handler, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(handler.dev_mode)
+	{
+		try
 		{
+			// In development mode, serve any requested files directly from disk, out of the webclient dir.
+			const std::string path_relative_to_webclient_dir = ::eatPrefix(request.path, "/webclient/");
+			if(!FileUtils::isPathSafe(path_relative_to_webclient_dir))
+				throw glare::Exception("request '" + request.path + "' is not safe.");
+
 			try
 			{
 				std::string contents;
-				FileUtils::readEntireFile(data_store->webclient_dir + "/client.html", contents);
-				web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, contents);
+				FileUtils::readEntireFile(handler.data_store->webclient_dir + "/" + path_relative_to_webclient_dir, contents);
+				const std::string content_type = web::ResponseUtils::getContentTypeForPath(path_relative_to_webclient_dir);
+				web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, contents.data(), contents.length(), content_type);
 			}
 			catch(FileUtils::FileUtilsExcep& e)
 			{
-				conPrint("Failed to load file /webclient: " + e.what());
-				web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "Failed to load file /webclient");
+				conPrint("Failed to load file: " + e.what());
+				web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "Failed to load file");
 			}
 		}
-		else if(dev_mode && ::hasPrefix(request.path, "/webclient/"))
+		catch(glare::Exception& e)
 		{
-			try
-			{
-				// In development mode, serve any requested files directly from disk, out of the webclient dir.
-				const std::string path_relative_to_webclient_dir = ::eatPrefix(request.path, "/webclient/");
-				if(!FileUtils::isPathSafe(path_relative_to_webclient_dir))
-					throw glare::Exception("request '" + request.path + "' is not safe.");
-
-				try
-				{
-					std::string contents;
-					FileUtils::readEntireFile(data_store->webclient_dir + "/" + path_relative_to_webclient_dir, contents);
-					const std::string content_type = web::ResponseUtils::getContentTypeForPath(path_relative_to_webclient_dir);
-					web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, contents.data(), contents.length(), content_type);
-				}
-				catch(FileUtils::FileUtilsExcep& e)
-				{
-					conPrint("Failed to load file: " + e.what());
-					web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "Failed to load file");
-				}
-			}
-			catch(glare::Exception& e)
-			{
-				// Since we're in dev mode, print out a nice error message to stdout.
-				conPrint("Error while handling request with path '" + request.path + "': " + e.what());
-				throw e; // rethrow
-			}
-				
+			// Since we're in dev mode, print out a nice error message to stdout.
+			conPrint("Error while handling request with path '" + request.path + "': " + e.what());
+			throw e; // rethrow
 		}
-		else if(::hasPrefix(request.path, "/webclient/"))
-		{
-			const std::string path = ::eatPrefix(request.path, "/webclient/");
+	}
+	else
+	{
+		const std::string path = ::eatPrefix(request.path, "/webclient/");
+		serveDataStoreFile(*handler.data_store, handler.data_store->webclient_dir_files, path, request, reply_info);
+	}
+}
 
-			Reference<WebDataStoreFile> store_file;
-			{
-				Lock lock(data_store->mutex);
-				const auto lookup_res = data_store->webclient_dir_files.find(path);
-				if(lookup_res != data_store->webclient_dir_files.end())
-					store_file = lookup_res->second;
-			}
 
-			if(store_file.nonNull())
-			{
-				const js::Vector<uint8, 16>& file_data = store_file->data;
-				const std::string& content_type = store_file->content_type;
-				if(store_file->compressed)
-					web::ResponseUtils::writeHTTPOKHeaderAndDeflatedDataWithCacheMaxAge(reply_info, file_data.data(), file_data.size(), content_type, 3600*24*14);
-				else
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheMaxAge(reply_info, file_data.data(), file_data.size(), content_type, 3600*24*14);
-			}
-			else
-			{
-				web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "No such file found or invalid filename");
-				return;
-			}
-		}
-		else
-		{
-			std::string page = "Unknown page";
-			web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, page);
-		}
+static WebRoute makeRoute(WebRoute::WorldStateHandlerFunc func, const char* name)	{ WebRoute r = WebRoute(); r.world_state_func = func;	r.handler_name = name; return r; }
+static WebRoute makeRoute(WebRoute::DataStoreHandlerFunc func, const char* name)	{ WebRoute r = WebRoute(); r.data_store_func = func;	r.handler_name = name; return r; }
+static WebRoute makeRoute(WebRoute::RequestHandlerFunc func, const char* name)		{ WebRoute r = WebRoute(); r.request_func = func;		r.handler_name = name; return r; }
+static WebRoute makeRoute(WebRoute::HandlerFunc func, const char* name)				{ WebRoute r = WebRoute(); r.handler_func = func;		r.handler_name = name; return r; }
+
+// Makes a route for the handler function, named after the function.
+#define ROUTE(func) makeRoute(func, #func)
+
+// Marks a route as having its responses to anonymous requests cached.  See WebPageCache.
+// key_URL_params must list every URL parameter the handler reads, as other parameters are left out of the cache key.
+static WebRoute cachedForAnonymousRequests(WebRoute route, const std::vector<std::string>& key_URL_params = std::vector<std::string>())
+{
+	route.cache_anonymous_pages = true;
+	route.cache_key_URL_params = key_URL_params;
+	return route;
+}
+
+
+/*=====================================================================
+WebServerRoutes
+---------------
+The routes for all the requests handled by WebServerRequestHandler.
+=====================================================================*/
+class WebServerRoutes
+{
+public:
+	WebServerRoutes();
+
+	void addExact(const std::string& verb, const std::string& path, const WebRoute& route)		{ table.addExactRoute(verb, path, routes.size());  routes.push_back(route); }
+	void addPrefix(const std::string& verb, const std::string& prefix, const WebRoute& route)	{ table.addPrefixRoute(verb, prefix, routes.size()); routes.push_back(route); }
+
+	std::vector<WebRoute> routes;
+	WebRouteTable table;
+};
+
+
+WebServerRoutes::WebServerRoutes()
+{
+	// POST routes
+	addExact("POST", "/login_post",								ROUTE(LoginHandlers::handleLoginPost));
+	addExact("POST", "/logout_post",							ROUTE(LoginHandlers::handleLogoutPost));
+	addExact("POST", "/signup_post",							ROUTE(LoginHandlers::handleSignUpPost));
+	addExact("POST", "/reset_password_post",					ROUTE(LoginHandlers::handleResetPasswordPost));
+	addExact("POST", "/change_password_post",					ROUTE(LoginHandlers::handleChangePasswordPost));
+	addExact("POST", "/set_new_password_post",					ROUTE(LoginHandlers::handleSetNewPasswordPost));
+#if USE_GLARE_PARCEL_AUCTION_CODE
+	addExact("POST", "/ipn_listener",							ROUTE(PayPalHandlers::handleIPNPost));
+	addExact("POST", "/coinbase_webhook",						ROUTE(CoinbaseHandlers::handleCoinbaseWebhookPost));
+	addExact("POST", "/buy_parcel_now_paypal",					ROUTE(AuctionHandlers::handleParcelBuyNowWithPayPal));
+	addExact("POST", "/buy_parcel_now_coinbase",				ROUTE(AuctionHandlers::handleParcelBuyNowWithCoinbase));
+	addExact("POST", "/buy_parcel_with_paypal_post",			ROUTE(AuctionHandlers::handleBuyParcelWithPayPalPost));
+	addExact("POST", "/buy_parcel_with_coinbase_post",			ROUTE(AuctionHandlers::handleBuyParcelWithCoinbasePost));
+#endif
+	addExact("POST", "/admin_create_parcel_auction_post",		ROUTE(AdminHandlers::createParcelAuctionPost));
+	addExact("POST", "/admin_set_parcel_owner_post",			ROUTE(AdminHandlers::handleSetParcelOwnerPost));
+	addExact("POST", "/admin_regenerate_parcel_auction_screenshots",	ROUTE(AdminHandlers::handleRegenerateParcelAuctionScreenshots));
+	addExact("POST", "/admin_regenerate_parcel_screenshots",	ROUTE(AdminHandlers::handleRegenerateParcelScreenshots));
+	addExact("POST", "/admin_regenerate_multiple_parcel_screenshots",	ROUTE(AdminHandlers::handleRegenerateMultipleParcelScreenshots));
+	addExact("POST", "/admin_terminate_parcel_auction",			ROUTE(AdminHandlers::handleTerminateParcelAuction));
+	addExact("POST", "/admin_mark_parcel_as_nft_minted_post",	ROUTE(AdminHandlers::handleMarkParcelAsNFTMintedPost));
+	addExact("POST", "/admin_mark_parcel_as_not_nft_post",		ROUTE(AdminHandlers::handleMarkParcelAsNotNFTPost));
+	addExact("POST", "/admin_retry_parcel_mint_post",			ROUTE(AdminHandlers::handleRetryParcelMintPost));
+	addExact("POST", "/admin_set_transaction_state_to_new_post",	ROUTE(AdminHandlers::handleSetTransactionStateToNewPost));
+	addExact("POST", "/admin_set_transaction_state_to_completed_post",	ROUTE(AdminHandlers::handleSetTransactionStateToCompletedPost));
+	addExact("POST", "/admin_set_transaction_state_hash",		ROUTE(AdminHandlers::handleSetTransactionHashPost));
+	addExact("POST", "/admin_set_transaction_nonce",			ROUTE(AdminHandlers::handleSetTransactionNoncePost));
+	addExact("POST", "/admin_set_server_admin_message_post",	ROUTE(AdminHandlers::handleSetServerAdminMessagePost));
+	addExact("POST", "/admin_set_read_only_mode_post",			ROUTE(AdminHandlers::handleSetReadOnlyModePost));
+	addExact("POST", "/admin_force_dyn_tex_update_post",		ROUTE(AdminHandlers::handleForceDynTexUpdatePost));
+	addExact("POST", "/admin_delete_transaction_post",			ROUTE(AdminHandlers::handleDeleteTransactionPost));
+	addExact("POST", "/admin_regen_map_tiles_post",				ROUTE(AdminHandlers::handleRegenMapTilesPost));
+	addExact("POST", "/admin_recreate_map_tiles_post",			ROUTE(AdminHandlers::handleRecreateMapTilesPost));
+	addExact("POST", "/admin_set_min_next_nonce_post",			ROUTE(AdminHandlers::handleSetMinNextNoncePost));
+	addExact("POST", "/admin_set_user_as_world_gardener_post",	ROUTE(AdminHandlers::handleSetUserAsWorldGardenerPost));
+	addExact("POST", "/admin_set_user_allow_dyn_tex_update_post",	ROUTE(AdminHandlers::handleSetUserAllowDynTexUpdatePost));
+	addExact("POST", "/regenerate_parcel_screenshots",			ROUTE(ParcelHandlers::handleRegenerateParcelScreenshots));
+	addExact("POST", "/edit_parcel_description_post",			ROUTE(ParcelHandlers::handleEditParcelDescriptionPost));
+	addExact("POST", "/add_parcel_writer_post",					ROUTE(ParcelHandlers::handleAddParcelWriterPost));
+	addExact("POST", "/remove_parcel_writer_post",				ROUTE(ParcelHandlers::handleRemoveParcelWriterPost));
+	addExact("POST", "/account_eth_sign_message_post",			ROUTE(AccountHandlers::handleEthSignMessagePost));
+	addExact("POST", "/make_parcel_into_nft_post",				ROUTE(AccountHandlers::handleMakeParcelIntoNFTPost));
+	addExact("POST", "/claim_parcel_owner_by_nft_post",			ROUTE(AccountHandlers::handleClaimParcelOwnerByNFTPost));
+
+	// GET routes
+	addExact("GET", "/",										cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderRootPage)));
+	addExact("GET", "/terms",									cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderTermsOfUse)));
+	addExact("GET", "/about_parcel_sales",						cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderAboutParcelSales)));
+	addExact("GET", "/about_scripting",							cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderAboutScripting)));
+	addExact("GET", "/about_substrata",							cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderAboutSubstrataPage)));
+	addExact("GET", "/running_your_own_server",					cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderRunningYourOwnServerPage)));
+	addExact("GET", "/bot_status",								ROUTE(MainPageHandlers::renderBotStatusPage));
+	addExact("GET", "/faq",										cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderFAQ)));
+	addExact("GET", "/map",										cachedForAnonymousRequests(ROUTE(MainPageHandlers::renderMapPage)));
+#if USE_GLARE_PARCEL_AUCTION_CODE
+	addExact("GET", "/pdt_landing",								ROUTE(PayPalHandlers::handlePayPalPDTOrderLanding));
+	addExact("GET", "/parcel_auction_list",						ROUTE(AuctionHandlers::renderParcelAuctionListPage));
+	addExact("GET", "/recent_parcel_sales",						ROUTE(AuctionHandlers::renderRecentParcelSalesPage));
+	addPrefix("GET", "/parcel_auction/",						ROUTE(AuctionHandlers::renderParcelAuctionPage)); // parcel auction ID follows in URL
+	addPrefix("GET", "/buy_parcel_with_paypal/",				ROUTE(AuctionHandlers::renderBuyParcelWithPayPalPage)); // parcel ID follows in URL
+	addPrefix("GET", "/buy_parcel_with_coinbase/",				ROUTE(AuctionHandlers::renderBuyParcelWithCoinbasePage)); // parcel ID follows in URL
+	addPrefix("GET", "/order/",									ROUTE(OrderHandlers::renderOrderPage)); // Order ID follows in URL
+#endif
+	addPrefix("GET", "/parcel/",								cachedForAnonymousRequests(ROUTE(ParcelHandlers::renderParcelPage))); // Parcel ID follows in URL
+	addExact("GET", "/edit_parcel_description",					ROUTE(ParcelHandlers::renderEditParcelDescriptionPage));
+	addExact("GET", "/add_parcel_writer",						ROUTE(ParcelHandlers::renderAddParcelWriterPage));
+	addExact("GET", "/remove_parcel_writer",					ROUTE(ParcelHandlers::renderRemoveParcelWriterPage));
+	addExact("GET", "/admin",									ROUTE(AdminHandlers::renderMainAdminPage));
+	addExact("GET", "/admin_users",								ROUTE(AdminHandlers::renderUsersPage));
+	addPrefix("GET", "/admin_user/",							ROUTE(AdminHandlers::renderAdminUserPage)); // user ID follows in URL
+	addExact("GET", "/admin_parcels",							ROUTE(AdminHandlers::renderParcelsPage));
+	addExact("GET", "/admin_parcel_auctions",					ROUTE(AdminHandlers::renderParcelAuctionsPage));
+	addPrefix("GET", "/admin_parcel_auction/",					ROUTE(AdminHandlers::renderAdminParcelAuctionPage));
+	addExact("GET", "/admin_orders",							ROUTE(AdminHandlers::renderOrdersPage));
+	addExact("GET", "/admin_sub_eth_transactions",				ROUTE(AdminHandlers::renderSubEthTransactionsPage));
+	addPrefix("GET", "/admin_sub_eth_transaction/",				ROUTE(AdminHandlers::renderAdminSubEthTransactionPage));
+	addExact("GET", "/admin_map",								ROUTE(AdminHandlers::renderMapPage));
+	addPrefix("GET", "/admin_create_parcel_auction/",			ROUTE(AdminHandlers::renderCreateParcelAuction)); // parcel ID follows in URL
+	addPrefix("GET", "/admin_set_parcel_owner/",				ROUTE(AdminHandlers::renderSetParcelOwnerPage)); // parcel ID follows in URL
+	addPrefix("GET", "/admin_order/",							ROUTE(AdminHandlers::renderAdminOrderPage)); // order ID follows in URL
+	addExact("GET", "/login",									ROUTE(LoginHandlers::renderLoginPage));
+	addExact("GET", "/signup",									ROUTE(LoginHandlers::renderSignUpPage));
+	addExact("GET", "/reset_password",							ROUTE(LoginHandlers::renderResetPasswordPage));
+	addExact("GET", "/reset_password_email",					ROUTE(LoginHandlers::renderResetPasswordFromEmailPage));
+	addExact("GET", "/change_password",							ROUTE(LoginHandlers::renderChangePasswordPage));
+	addExact("GET", "/account",									ROUTE(AccountHandlers::renderUserAccountPage));
+	addExact("GET", "/prove_eth_address_owner",					ROUTE(AccountHandlers::renderProveEthAddressOwnerPage));
+	addExact("GET", "/prove_parcel_owner_by_nft",				ROUTE(AccountHandlers::renderProveParcelOwnerByNFT));
+	addExact("GET", "/make_parcel_into_nft",					ROUTE(AccountHandlers::renderMakeParcelIntoNFTPage));
+	addExact("GET", "/parcel_claim_succeeded",					ROUTE(AccountHandlers::renderParcelClaimSucceeded));
+	addExact("GET", "/parcel_claim_failed",						ROUTE(AccountHandlers::renderParcelClaimFailed));
+	addExact("GET", "/parcel_claim_invalid",					ROUTE(AccountHandlers::renderParcelClaimInvalid));
+	addExact("GET", "/making_parcel_into_nft",					ROUTE(AccountHandlers::renderMakingParcelIntoNFT));
+	addExact("GET", "/making_parcel_into_nft_failed",			ROUTE(AccountHandlers::renderMakingParcelIntoNFTFailed));
+	addPrefix("GET", "/p/",										ROUTE(ParcelHandlers::renderMetadata)); // URL for parcel ERC 721 metadata JSON
+	addPrefix("GET", "/screenshot/",							ROUTE(ScreenshotHandlers::handleScreenshotRequest)); // Screenshot ID follows
+	addExact("GET", "/tile",									ROUTE(ScreenshotHandlers::handleMapTileRequest));
+	addPrefix("GET", "/files/",									ROUTE(handlePublicFileRequest));
+	// addPrefix("GET", "/.well-known/acme-challenge/",			ROUTE(handleLetsEncryptChallengeRequest)); // Disabled for now, as using godaddy certs
+	addPrefix("GET", "/resource/",								ROUTE(ResourceHandlers::handleResourceRequest));
+	// addExact("GET", "/list_resources",						ROUTE(ResourceHandlers::listResources)); // Disabled for now, rsync resources to back up instead.
+	addExact("GET", "/webclient",								ROUTE(handleWebClientPageRequest));
+	addPrefix("GET", "/webclient/",								ROUTE(handleWebClientFileRequest));
+}
+
+
+const WebRoute* WebServerRequestHandler::findRoute(const std::string& verb, const std::string& path)
+{
+	static const WebServerRoutes web_server_routes; // Built on first use.  Initialisation of function-local statics is threadsafe.
+
+	const size_t route_index = web_server_routes.table.lookup(verb, path);
+	return (route_index == WebRouteTable::NOT_FOUND) ? NULL : &web_server_routes.routes[route_index];
+}
+
+
+static void callRouteHandler(WebServerRequestHandler& handler, const WebRoute& route, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(route.world_state_func)
+		route.world_state_func(*handler.world_state, request, reply_info);
+	else if(route.data_store_func)
+		route.data_store_func(*handler.world_state, *handler.data_store, request, reply_info);
+	else if(route.request_func)
+		route.request_func(request, reply_info);
+	else
+		route.handler_func(handler, request, reply_info);
+}
+
+
+// Serves anonymous requests from the web page cache if possible, otherwise renders the page and adds it to the cache.
+// Cache hits don't lock the world state.
+static void handleCachedPageRequest(WebServerRequestHandler& handler, const WebRoute& route, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	const std::string key = WebPageCache::makeKey(request, route.cache_key_URL_params);
+	if(key.empty()) // If the request is from a logged-in user (or otherwise can't be cached):
+	{
+		callRouteHandler(handler, route, request, reply_info);
+		return;
 	}
+
+	// Get the generation before rendering, so that if there is a change during rendering, the page will be re-rendered on the next request.
+	const uint64 generation = handler.world_state->getWebPageGeneration();
+	const double cur_time = Clock::getTimeSinceInit();
+
+	Reference<CachedWebPage> page = handler.data_store->web_page_cache.get(key, generation, cur_time);
+	if(page.isNull())
+	{
+		// Render the response into a buffer.  If the handler throws an exception, nothing is cached.
+		BufferOutStream buffer;
+		web::ReplyInfo buffer_reply_info;
+		buffer_reply_info.socket = &buffer;
+		callRouteHandler(handler, route, request, buffer_reply_info);
+
+		page = new CachedWebPage();
+		page->response.assign(buffer.buf.begin(), buffer.buf.end());
+		page->generation = generation;
+		page->render_time = cur_time;
+		handler.data_store->web_page_cache.insert(key, page);
+	}
+
+	reply_info.socket->writeData(page->response.data(), page->response.size());
 }
 
 
@@ -9,10 +9,31 @@ Copyright Glare Technologies Limited 2021 -
 #include <RequestHandler.h>
 #include "../shared/UID.h"
 #include "../server/User.h"
+#include <string>
+#include <vector>
 class WebDataStore;
 class ServerAllWorldsState;
 class ServerWorldState;
 class Server;
+class WebServerRequestHandler;
+
+
+// The handler for requests with a particular verb and path, or path prefix.  Exactly one of the handler functions is non-null.
+struct WebRoute
+{
+	typedef void (*WorldStateHandlerFunc)(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+	typedef void (*DataStoreHandlerFunc)(ServerAllWorldsState& world_state, WebDataStore& data_store, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+	typedef void (*RequestHandlerFunc)(const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+	typedef void (*HandlerFunc)(WebServerRequestHandler& handler, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+
+	WorldStateHandlerFunc world_state_func;
+	DataStoreHandlerFunc data_store_func;
+	RequestHandlerFunc request_func;
+	HandlerFunc handler_func;
+	const char* handler_name; // Name of the handler function, for tests.
+	bool cache_anonymous_pages; // If true, the responses to requests without a login session are cached in WebDataStore::web_page_cache.
+	std::vector<std::string> cache_key_URL_params; // For cached routes, the URL parameters the handler reads.  Only these are included in the cache key.
+};
 
 
 class WebServerRequestHandler : public web::RequestHandler
@@ -23,6 +44,10 @@ public:
 
 	virtual void handleRequest(const web::RequestInfo& request_info, web::ReplyInfo& reply_info) override;
 
+	// Returns the route for a request, or NULL if there is no such route.
+	// Routes are looked up in a route table (see WebRouteTable), instead of comparing the path against each route in turn.
+	static const WebRoute* findRoute(const std::string& verb, const std::string& path);
+
 	virtual void handleWebSocketConnection(const web::RequestInfo& request_info, Reference<SocketInterface>& socket) override;
 
 	WebDataStore* data_store;
@@ -26,6 +26,8 @@ Copyright Glare Technologies Limited 2022 -
 #include <PlatformUtils.h>
 #include <WorkerThread.h>
 #include <networking/Networking.h>
+#include <TestUtils.h>
+#include <Timer.h>
 
 
 #if 0
@@ -254,8 +256,244 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 #endif // end if fuzzing
 
 
+struct RouteTestCase
+{
+	const char* verb;
+	const char* path; // Path of a request.
+	const char* route_path; // Path or prefix of the route in the old if-else chain.
+	bool is_prefix;
+	const char* handler_name; // Expected handler, or NULL if no route should match.
+};
+
+
+// A request for each route, in the order of the old if-else chain in WebServerRequestHandler::handleRequest(), with the handler it called.
+static const RouteTestCase route_test_cases[] = {
+	{ "POST", "/login_post",									"/login_post",									false,	"LoginHandlers::handleLoginPost" },
+	{ "POST", "/logout_post",									"/logout_post",									false,	"LoginHandlers::handleLogoutPost" },
+	{ "POST", "/signup_post",									"/signup_post",									false,	"LoginHandlers::handleSignUpPost" },
+	{ "POST", "/reset_password_post",							"/reset_password_post",							false,	"LoginHandlers::handleResetPasswordPost" },
+	{ "POST", "/change_password_post",							"/change_password_post",						false,	"LoginHandlers::handleChangePasswordPost" },
+	{ "POST", "/set_new_password_post",							"/set_new_password_post",						false,	"LoginHandlers::handleSetNewPasswordPost" },
+#if USE_GLARE_PARCEL_AUCTION_CODE
+	{ "POST", "/ipn_listener",									"/ipn_listener",								false,	"PayPalHandlers::handleIPNPost" },
+	{ "POST", "/coinbase_webhook",								"/coinbase_webhook",							false,	"CoinbaseHandlers::handleCoinbaseWebhookPost" },
+	{ "POST", "/buy_parcel_now_paypal",							"/buy_parcel_now_paypal",						false,	"AuctionHandlers::handleParcelBuyNowWithPayPal" },
+	{ "POST", "/buy_parcel_now_coinbase",						"/buy_parcel_now_coinbase",						false,	"AuctionHandlers::handleParcelBuyNowWithCoinbase" },
+	{ "POST", "/buy_parcel_with_paypal_post",					"/buy_parcel_with_paypal_post",					false,	"AuctionHandlers::handleBuyParcelWithPayPalPost" },
+	{ "POST", "/buy_parcel_with_coinbase_post",					"/buy_parcel_with_coinbase_post",				false,	"AuctionHandlers::handleBuyParcelWithCoinbasePost" },
+#endif
+	{ "POST", "/admin_create_parcel_auction_post",				"/admin_create_parcel_auction_post",			false,	"AdminHandlers::createParcelAuctionPost" },
+	{ "POST", "/admin_set_parcel_owner_post",					"/admin_set_parcel_owner_post",					false,	"AdminHandlers::handleSetParcelOwnerPost" },
+	{ "POST", "/admin_regenerate_parcel_auction_screenshots",	"/admin_regenerate_parcel_auction_screenshots",	false,	"AdminHandlers::handleRegenerateParcelAuctionScreenshots" },
+	{ "POST", "/admin_regenerate_parcel_screenshots",			"/admin_regenerate_parcel_screenshots",			false,	"AdminHandlers::handleRegenerateParcelScreenshots" },
+	{ "POST", "/admin_regenerate_multiple_parcel_screenshots",	"/admin_regenerate_multiple_parcel_screenshots",false,	"AdminHandlers::handleRegenerateMultipleParcelScreenshots" },
+	{ "POST", "/admin_terminate_parcel_auction",				"/admin_terminate_parcel_auction",				false,	"AdminHandlers::handleTerminateParcelAuction" },
+	{ "POST", "/admin_mark_parcel_as_nft_minted_post",			"/admin_mark_parcel_as_nft_minted_post",		false,	"AdminHandlers::handleMarkParcelAsNFTMintedPost" },
+	{ "POST", "/admin_mark_parcel_as_not_nft_post",				"/admin_mark_parcel_as_not_nft_post",			false,	"AdminHandlers::handleMarkParcelAsNotNFTPost" },
+	{ "POST", "/admin_retry_parcel_mint_post",					"/admin_retry_parcel_mint_post",				false,	"AdminHandlers::handleRetryParcelMintPost" },
+	{ "POST", "/admin_set_transaction_state_to_new_post",		"/admin_set_transaction_state_to_new_post",		false,	"AdminHandlers::handleSetTransactionStateToNewPost" },
+	{ "POST", "/admin_set_transaction_state_to_completed_post",	"/admin_set_transaction_state_to_completed_post",	false,	"AdminHandlers::handleSetTransactionStateToCompletedPost" },
+	{ "POST", "/admin_set_transaction_state_hash",				"/admin_set_transaction_state_hash",			false,	"AdminHandlers::handleSetTransactionHashPost" },
+	{ "POST", "/admin_set_transaction_nonce",					"/admin_set_transaction_nonce",					false,	"AdminHandlers::handleSetTransactionNoncePost" },
+	{ "POST", "/admin_set_server_admin_message_post",			"/admin_set_server_admin_message_post",			false,	"AdminHandlers::handleSetServerAdminMessagePost" },
+	{ "POST", "/admin_set_read_only_mode_post",					"/admin_set_read_only_mode_post",				false,	"AdminHandlers::handleSetReadOnlyModePost" },
+	{ "POST", "/admin_force_dyn_tex_update_post",				"/admin_force_dyn_tex_update_post",				false,	"AdminHandlers::handleForceDynTexUpdatePost" },
+	{ "POST", "/admin_delete_transaction_post",					"/admin_delete_transaction_post",				false,	"AdminHandlers::handleDeleteTransactionPost" },
+	{ "POST", "/admin_regen_map_tiles_post",					"/admin_regen_map_tiles_post",					false,	"AdminHandlers::handleRegenMapTilesPost" },
+	{ "POST", "/admin_recreate_map_tiles_post",					"/admin_recreate_map_tiles_post",				false,	"AdminHandlers::handleRecreateMapTilesPost" },
+	{ "POST", "/admin_set_min_next_nonce_post",					"/admin_set_min_next_nonce_post",				false,	"AdminHandlers::handleSetMinNextNoncePost" },
+	{ "POST", "/admin_set_user_as_world_gardener_post",			"/admin_set_user_as_world_gardener_post",		false,	"AdminHandlers::handleSetUserAsWorldGardenerPost" },
+	{ "POST", "/admin_set_user_allow_dyn_tex_update_post",		"/admin_set_user_allow_dyn_tex_update_post",	false,	"AdminHandlers::handleSetUserAllowDynTexUpdatePost" },
+	{ "POST", "/regenerate_parcel_screenshots",					"/regenerate_parcel_screenshots",				false,	"ParcelHandlers::handleRegenerateParcelScreenshots" },
+	{ "POST", "/edit_parcel_description_post",					"/edit_parcel_description_post",				false,	"ParcelHandlers::handleEditParcelDescriptionPost" },
+	{ "POST", "/add_parcel_writer_post",						"/add_parcel_writer_post",						false,	"ParcelHandlers::handleAddParcelWriterPost" },
+	{ "POST", "/remove_parcel_writer_post",						"/remove_parcel_writer_post",					false,	"ParcelHandlers::handleRemoveParcelWriterPost" },
+	{ "POST", "/account_eth_sign_message_post",					"/account_eth_sign_message_post",				false,	"AccountHandlers::handleEthSignMessagePost" },
+	{ "POST", "/make_parcel_into_nft_post",						"/make_parcel_into_nft_post",					false,	"AccountHandlers::handleMakeParcelIntoNFTPost" },
+	{ "POST", "/claim_parcel_owner_by_nft_post",				"/claim_parcel_owner_by_nft_post",				false,	"AccountHandlers::handleClaimParcelOwnerByNFTPost" },
+
+	{ "GET", "/",												"/",											false,	"MainPageHandlers::renderRootPage" },
+	{ "GET", "/terms",											"/terms",										false,	"MainPageHandlers::renderTermsOfUse" },
+	{ "GET", "/about_parcel_sales",								"/about_parcel_sales",							false,	"MainPageHandlers::renderAboutParcelSales" },
+	{ "GET", "/about_scripting",								"/about_scripting",								false,	"MainPageHandlers::renderAboutScripting" },
+	{ "GET", "/about_substrata",								"/about_substrata",								false,	"MainPageHandlers::renderAboutSubstrataPage" },
+	{ "GET", "/running_your_own_server",						"/running_your_own_server",						false,	"MainPageHandlers::renderRunningYourOwnServerPage" },
+	{ "GET", "/bot_status",										"/bot_status",									false,	"MainPageHandlers::renderBotStatusPage" },
+	{ "GET", "/faq",											"/faq",											false,	"MainPageHandlers::renderFAQ" },
+	{ "GET", "/map",											"/map",											false,	"MainPageHandlers::renderMapPage" },
+#if USE_GLARE_PARCEL_AUCTION_CODE
+	{ "GET", "/pdt_landing",									"/pdt_landing",									false,	"PayPalHandlers::handlePayPalPDTOrderLanding" },
+	{ "GET", "/parcel_auction_list",							"/parcel_auction_list",							false,	"AuctionHandlers::renderParcelAuctionListPage" },
+	{ "GET", "/recent_parcel_sales",							"/recent_parcel_sales",							false,	"AuctionHandlers::renderRecentParcelSalesPage" },
+	{ "GET", "/parcel_auction/12",								"/parcel_auction/",								true,	"AuctionHandlers::renderParcelAuctionPage" },
+	{ "GET", "/buy_parcel_with_paypal/12",						"/buy_parcel_with_paypal/",						true,	"AuctionHandlers::renderBuyParcelWithPayPalPage" },
+	{ "GET", "/buy_parcel_with_coinbase/12",					"/buy_parcel_with_coinbase/",					true,	"AuctionHandlers::renderBuyParcelWithCoinbasePage" },
+	{ "GET", "/order/12",										"/order/",										true,	"OrderHandlers::renderOrderPage" },
+#endif
+	{ "GET", "/parcel/12",										"/parcel/",										true,	"ParcelHandlers::renderParcelPage" },
+	{ "GET", "/edit_parcel_description",						"/edit_parcel_description",						false,	"ParcelHandlers::renderEditParcelDescriptionPage" },
+	{ "GET", "/add_parcel_writer",								"/add_parcel_writer",							false,	"ParcelHandlers::renderAddParcelWriterPage" },
+	{ "GET", "/remove_parcel_writer",							"/remove_parcel_writer",						false,	"ParcelHandlers::renderRemoveParcelWriterPage" },
+	{ "GET", "/admin",											"/admin",										false,	"AdminHandlers::renderMainAdminPage" },
+	{ "GET", "/admin_users",									"/admin_users",									false,	"AdminHandlers::renderUsersPage" },
+	{ "GET", "/admin_user/12",									"/admin_user/",									true,	"AdminHandlers::renderAdminUserPage" },
+	{ "GET", "/admin_parcels",									"/admin_parcels",								false,	"AdminHandlers::renderParcelsPage" },
+	{ "GET", "/admin_parcel_auctions",							"/admin_parcel_auctions",						false,	"AdminHandlers::renderParcelAuctionsPage" },
+	{ "GET", "/admin_parcel_auction/12",						"/admin_parcel_auction/",						true,	"AdminHandlers::renderAdminParcelAuctionPage" },
+	{ "GET", "/admin_orders",									"/admin_orders",								false,	"AdminHandlers::renderOrdersPage" },
+	{ "GET", "/admin_sub_eth_transactions",						"/admin_sub_eth_transactions",					false,	"AdminHandlers::renderSubEthTransactionsPage" },
+	{ "GET", "/admin_sub_eth_transaction/12",					"/admin_sub_eth_transaction/",					true,	"AdminHandlers::renderAdminSubEthTransactionPage" },
+	{ "GET", "/admin_map",										"/admin_map",									false,	"AdminHandlers::renderMapPage" },
+	{ "GET", "/admin_create_parcel_auction/12",					"/admin_create_parcel_auction/",				true,	"AdminHandlers::renderCreateParcelAuction" },
+	{ "GET", "/admin_set_parcel_owner/12",						"/admin_set_parcel_owner/",						true,	"AdminHandlers::renderSetParcelOwnerPage" },
+	{ "GET", "/admin_order/12",									"/admin_order/",								true,	"AdminHandlers::renderAdminOrderPage" },
+	{ "GET", "/login",											"/login",										false,	"LoginHandlers::renderLoginPage" },
+	{ "GET", "/signup",											"/signup",										false,	"LoginHandlers::renderSignUpPage" },
+	{ "GET", "/reset_password",									"/reset_password",								false,	"LoginHandlers::renderResetPasswordPage" },
+	{ "GET", "/reset_password_email",							"/reset_password_email",						false,	"LoginHandlers::renderResetPasswordFromEmailPage" },
+	{ "GET", "/change_password",								"/change_password",								false,	"LoginHandlers::renderChangePasswordPage" },
+	{ "GET", "/account",										"/account",										false,	"AccountHandlers::renderUserAccountPage" },
+	{ "GET", "/prove_eth_address_owner",						"/prove_eth_address_owner",						false,	"AccountHandlers::renderProveEthAddressOwnerPage" },
+	{ "GET", "/prove_parcel_owner_by_nft",						"/prove_parcel_owner_by_nft",					false,	"AccountHandlers::renderProveParcelOwnerByNFT" },
+	{ "GET", "/make_parcel_into_nft",							"/make_parcel_into_nft",						false,	"AccountHandlers::renderMakeParcelIntoNFTPage" },
+	{ "GET", "/parcel_claim_succeeded",							"/parcel_claim_succeeded",						false,	"AccountHandlers::renderParcelClaimSucceeded" },
+	{ "GET", "/parcel_claim_failed",							"/parcel_claim_failed",							false,	"AccountHandlers::renderParcelClaimFailed" },
+	{ "GET", "/parcel_claim_invalid",							"/parcel_claim_invalid",						false,	"AccountHandlers::renderParcelClaimInvalid" },
+	{ "GET", "/making_parcel_into_nft",							"/making_parcel_into_nft",						false,	"AccountHandlers::renderMakingParcelIntoNFT" },
+	{ "GET", "/making_parcel_into_nft_failed",					"/making_parcel_into_nft_failed",				false,	"AccountHandlers::renderMakingParcelIntoNFTFailed" },
+	{ "GET", "/p/12",											"/p/",											true,	"ParcelHandlers::renderMetadata" },
+	{ "GET", "/screenshot/12",									"/screenshot/",									true,	"ScreenshotHandlers::handleScreenshotRequest" },
+	{ "GET", "/tile",											"/tile",										false,	"ScreenshotHandlers::handleMapTileRequest" },
+	{ "GET", "/files/logo.png",									"/files/",										true,	"handlePublicFileRequest" },
+	{ "GET", "/resource/abc_123.bmesh",							"/resource/",									true,	"ResourceHandlers::handleResourceRequest" },
+	{ "GET", "/webclient",										"/webclient",									false,	"handleWebClientPageRequest" },
+	{ "GET", "/webclient/gui_client.js",						"/webclient/",									true,	"handleWebClientFileRequest" },
+};
+
+
+// Requests that match a prefix route with nothing following, or that look like routes but aren't.
+static const RouteTestCase extra_route_test_cases[] = {
+	{ "GET", "/parcel/",										NULL, false,	"ParcelHandlers::renderParcelPage" },
+	{ "GET", "/resource/",										NULL, false,	"ResourceHandlers::handleResourceRequest" },
+	{ "GET", "/admin_user/12/34",								NULL, false,	"AdminHandlers::renderAdminUserPage" },
+	{ "GET", "/parcel",											NULL, false,	NULL },
+	{ "GET", "/resource",										NULL, false,	NULL },
+	{ "GET", "/admin_user",										NULL, false,	NULL },
+	{ "GET", "/admin_users/",									NULL, false,	NULL },
+	{ "GET", "/tile/",											NULL, false,	NULL },
+	{ "GET", "/Terms",											NULL, false,	NULL },
+	{ "GET", "",												NULL, false,	NULL },
+	{ "GET", "/login_post",										NULL, false,	NULL }, // POST route
+	{ "POST", "/login",											NULL, false,	NULL }, // GET route
+	{ "POST", "/parcel/12",										NULL, false,	NULL },
+	{ "PUT", "/login_post",										NULL, false,	NULL },
+	{ "HEAD", "/",												NULL, false,	NULL },
+};
+
+
+static void checkRoute(const RouteTestCase& test_case)
+{
+	const WebRoute* route = WebServerRequestHandler::findRoute(test_case.verb, test_case.path);
+	if(test_case.handler_name)
+	{
+		if(!route)
+			failTest(std::string("No route found for ") + test_case.verb + " " + test_case.path);
+		if(std::string(route->handler_name) != test_case.handler_name)
+			failTest(std::string("Wrong route for ") + test_case.verb + " " + test_case.path + ": " + route->handler_name + ", expected " + test_case.handler_name);
+
+		// Exactly one handler function should be set.
+		const int num_funcs = (route->world_state_func ? 1 : 0) + (route->data_store_func ? 1 : 0) + (route->request_func ? 1 : 0) + (route->handler_func ? 1 : 0);
+		testAssert(num_funcs == 1);
+	}
+	else
+	{
+		if(route)
+			failTest(std::string("Unexpected route found for ") + test_case.verb + " " + test_case.path + ": " + route->handler_name);
+	}
+}
+
+
+// Returns the index of the matching test case, like the old if-else chain did, or -1 if none matches.
+static int findRouteWithIfElseChain(const std::string& verb, const std::string& path)
+{
+	for(size_t i=0; i<staticArrayNumElems(route_test_cases); ++i)
+	{
+		const RouteTestCase& test_case = route_test_cases[i];
+		if(verb == test_case.verb && (test_case.is_prefix ? ::hasPrefix(path, test_case.route_path) : (path == test_case.route_path)))
+			return (int)i;
+	}
+	return -1;
+}
+
+
 void WebServerRequestHandlerTests::test()
 {
+	conPrint("WebServerRequestHandlerTests::test()");
+
+	//-------------------------- Test every route dispatches to the same handler as with the old if-else chain --------------------------
+	for(size_t i=0; i<staticArrayNumElems(route_test_cases); ++i)
+	{
+		checkRoute(route_test_cases[i]);
+
+		// The prefix routes should also match with some other suffix.
+		if(route_test_cases[i].is_prefix)
+		{
+			const std::string other_path = std::string(route_test_cases[i].route_path) + "other";
+			const RouteTestCase other_case = { route_test_cases[i].verb, other_path.c_str(), NULL, false, route_test_cases[i].handler_name };
+			checkRoute(other_case);
+		}
+
+		// The old chain should match the same test case.  (Checks the test cases don't overlap in a way where the old first-match order would matter.)
+		testAssert(findRouteWithIfElseChain(route_test_cases[i].verb, route_test_cases[i].path) == (int)i);
+	}
+
+	for(size_t i=0; i<staticArrayNumElems(extra_route_test_cases); ++i)
+	{
+		checkRoute(extra_route_test_cases[i]);
+
+		const int chain_i = findRouteWithIfElseChain(extra_route_test_cases[i].verb, extra_route_test_cases[i].path);
+		testAssert((chain_i == -1) == (extra_route_test_cases[i].handler_name == NULL));
+	}
+
+	//-------------------------- Perf test: routing with the route table vs. the old if-else chain --------------------------
+	if(false)
+	{
+		// Request paths weighted towards the hot paths: resources, map tiles and webclient files.
+		std::vector<std::pair<std::string, std::string>> requests;
+		for(int i=0; i<100; ++i)
+		{
+			requests.push_back(std::make_pair("GET", "/resource/model_" + toString(i) + ".bmesh"));
+			requests.push_back(std::make_pair("GET", "/resource/texture_" + toString(i) + ".ktx2"));
+			requests.push_back(std::make_pair("GET", "/tile"));
+			requests.push_back(std::make_pair("GET", "/webclient/gui_client.js"));
+			requests.push_back(std::make_pair("GET", "/"));
+			requests.push_back(std::make_pair("GET", "/parcel/" + toString(i)));
+		}
+		for(size_t i=0; i<staticArrayNumElems(route_test_cases); ++i)
+			requests.push_back(std::make_pair(route_test_cases[i].verb, route_test_cases[i].path));
+
+		const int num_iters = 1000;
+		const double num_lookups = (double)num_iters * requests.size();
+
+		{
+			Timer timer;
+			size_t sum = 0;
+			for(int iter=0; iter<num_iters; ++iter)
+				for(size_t i=0; i<requests.size(); ++i)
+					sum += (size_t)WebServerRequestHandler::findRoute(requests[i].first, requests[i].second);
+			conPrint("Route table:   " + doubleToStringNSigFigs(timer.elapsed() / num_lookups * 1.0e9, 4) + " ns / lookup (sum: " + toString(sum % 2) + ")");
+		}
+		{
+			Timer timer;
+			int sum = 0;
+			for(int iter=0; iter<num_iters; ++iter)
+				for(size_t i=0; i<requests.size(); ++i)
+					sum += findRouteWithIfElseChain(requests[i].first, requests[i].second);
+			conPrint("If-else chain: " + doubleToStringNSigFigs(timer.elapsed() / num_lookups * 1.0e9, 4) + " ns / lookup (sum: " + toString(sum) + ")");
+		}
+	}
+
+	conPrint("WebServerRequestHandlerTests::test() done");
 }
 
 
@@ -8,6 +8,7 @@ Copyright Glare Technologies Limited 2021 -
 
 #include "../server/ServerWorldState.h"
 #include "RequestInfo.h"
+#include "Response.h"
 #include "Escaping.h"
 #include "LoginHandlers.h"
 #include <ConPrint.h>
@@ -140,6 +141,7 @@ const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID hi
 
 	{ // lock scope
 		Lock lock(world_state.mutex);
+		Lock root_world_lock(world_state.getRootWorldState()->mutex);
 
 		ServerWorldState* root_world = world_state.getRootWorldState().ptr();
 
@@ -268,4 +270,109 @@ const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID hi
 }
 
 
+const std::string getRequestHeader(const web::RequestInfo& request_info, const char* header_name)
+{
+	for(size_t i=0; i<request_info.headers.size(); ++i)
+		if(StringUtils::equalCaseInsensitive(request_info.headers[i].key, header_name))
+			return std::string(request_info.headers[i].value);
+	return std::string();
+}
+
+
+bool ifNoneMatchHeaderMatchesETag(const std::string& if_none_match_header, const std::string& etag)
+{
+	// The header is either "*", or a comma-separated list of entity tags, which may be weak (prefixed with "W/").  If-None-Match uses the weak comparison, so the prefix is ignored.
+	size_t elem_begin = 0;
+	while(elem_begin < if_none_match_header.size())
+	{
+		size_t elem_end = if_none_match_header.find(',', elem_begin);
+		if(elem_end == std::string::npos)
+			elem_end = if_none_match_header.size();
+
+		std::string tag = ::stripHeadAndTailWhitespace(if_none_match_header.substr(elem_begin, elem_end - elem_begin));
+		if(tag == "*")
+			return true;
+		if(::hasPrefix(tag, "W/"))
+			tag = tag.substr(2);
+		if(!tag.empty() && tag == etag)
+			return true;
+
+		elem_begin = elem_end + 1;
+	}
+	return false;
+}
+
+
+void writeHTTPNotModifiedHeader(web::ReplyInfo& reply_info, const std::string& etag, bool vary_on_accept_encoding)
+{
+	std::string response = 
+		"HTTP/1.1 304 Not Modified\r\n";
+	if(vary_on_accept_encoding)
+		response += "Vary: Accept-Encoding\r\n";
+	response += 
+		"ETag: " + etag + "\r\n"
+		"Connection: Keep-Alive\r\n"
+		"\r\n";
+
+	reply_info.socket->writeData(response.c_str(), response.size());
+}
+
+
+void writeHTTPOKHeaderAndDataWithETag(web::ReplyInfo& reply_info, const void* data, size_t datalen, const std::string& content_type, const std::string& content_encoding, bool vary_on_accept_encoding,
+	const std::string& etag, int max_age_s)
+{
+	std::string response = 
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: " + content_type + "\r\n";
+	if(!content_encoding.empty())
+		response += "Content-Encoding: " + content_encoding + "\r\n";
+	if(vary_on_accept_encoding)
+		response += "Vary: Accept-Encoding\r\n"; // So that caches don't send the response to clients that don't accept the encoding.
+	response += 
+		"ETag: " + etag + "\r\n"
+		"Cache-Control: max-age=" + toString(max_age_s) + "\r\n"
+		"Connection: Keep-Alive\r\n"
+		"Content-Length: " + toString(datalen) + "\r\n"
+		"\r\n";
+
+	reply_info.socket->writeData(response.c_str(), response.size());
+	reply_info.socket->writeData(data, datalen);
+}
+
+
 } // end namespace WebServerResponseUtils
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+
+
+void WebServerResponseUtils::test()
+{
+	conPrint("WebServerResponseUtils::test()");
+
+	//-------------------------- Test ifNoneMatchHeaderMatchesETag --------------------------
+	const std::string etag = "\"1234abcd\"";
+	testAssert(ifNoneMatchHeaderMatchesETag("\"1234abcd\"", etag));
+	testAssert(ifNoneMatchHeaderMatchesETag("W/\"1234abcd\"", etag)); // Weak comparison is used for If-None-Match.
+	testAssert(ifNoneMatchHeaderMatchesETag("\"aaaa\", \"1234abcd\"", etag));
+	testAssert(ifNoneMatchHeaderMatchesETag("\"aaaa\",\"1234abcd\" , \"bbbb\"", etag));
+	testAssert(ifNoneMatchHeaderMatchesETag("*", etag));
+	testAssert(ifNoneMatchHeaderMatchesETag(" * ", etag));
+
+	testAssert(!ifNoneMatchHeaderMatchesETag("", etag));
+	testAssert(!ifNoneMatchHeaderMatchesETag("\"1234abc\"", etag));
+	testAssert(!ifNoneMatchHeaderMatchesETag("\"1234abcde\"", etag));
+	testAssert(!ifNoneMatchHeaderMatchesETag("1234abcd", etag)); // Entity tags must be quoted.
+	testAssert(!ifNoneMatchHeaderMatchesETag("\"aaaa\", \"bbbb\"", etag));
+	testAssert(!ifNoneMatchHeaderMatchesETag(",,", etag));
+	testAssert(!ifNoneMatchHeaderMatchesETag("W/", etag));
+	testAssert(!ifNoneMatchHeaderMatchesETag("", ""));
+
+	conPrint("WebServerResponseUtils::test() done");
+}
+
+
+#endif // BUILD_TESTS
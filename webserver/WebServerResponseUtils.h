@@ -29,4 +29,19 @@ namespace WebServerResponseUtils
 
 	const std::string getMapHeaderTags();
 	const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID highlighted_parcel_id);
+
+	// Returns the value of the first request header with the given name (case-insensitive), or the empty string if there is no such header.
+	const std::string getRequestHeader(const web::RequestInfo& request_info, const char* header_name);
+
+	// Returns true if the value of an If-None-Match request header matches etag, in which case the client has the current version of the content.
+	bool ifNoneMatchHeaderMatchesETag(const std::string& if_none_match_header, const std::string& etag);
+
+	// Set vary_on_accept_encoding if the encoding of the content, and so the ETag, is chosen based on the Accept-Encoding header.
+	void writeHTTPNotModifiedHeader(web::ReplyInfo& reply_info, const std::string& etag, bool vary_on_accept_encoding);
+
+	// content_encoding may be empty, for uncompressed data.  Set vary_on_accept_encoding if the encoding of the data was chosen based on the Accept-Encoding header.
+	void writeHTTPOKHeaderAndDataWithETag(web::ReplyInfo& reply_info, const void* data, size_t datalen, const std::string& content_type, const std::string& content_encoding, bool vary_on_accept_encoding,
+		const std::string& etag, int max_age_s);
+
+	void test();
 }